@@ -11,4 +11,35 @@ namespace ScreenRecorderLib {
 		virtual property String^ DeviceName;
 		virtual property String^ FriendlyName;
 	};
+	/// <summary>
+	/// An additional audio device to record and mix into the audio track, e.g. a second microphone.
+	/// </summary>
+	public ref class AudioSource {
+	public:
+		AudioSource() {
+			Volume = 1.0f;
+		};
+		AudioSource(String^ deviceName, bool isLoopbackDevice) {
+			DeviceName = deviceName;
+			IsLoopbackDevice = isLoopbackDevice;
+			Volume = 1.0f;
+		}
+		/// <summary>
+		/// The device to capture audio from, as returned by Recorder.GetSystemAudioDevices. Pass null or empty string to select system default.
+		/// </summary>
+		virtual property String^ DeviceName;
+		/// <summary>
+		/// True to capture the audio played on an output device, false to capture an input device.
+		/// </summary>
+		virtual property bool IsLoopbackDevice;
+		/// <summary>
+		/// Volume of the source. Value of 0 mutes the source and value of 1 makes it original volume.
+		/// </summary>
+		virtual property float Volume;
+		virtual property bool IsMuted;
+		/// <summary>
+		/// Delay in milliseconds applied to the source, to line it up with devices with a longer latency. Max 1000.
+		/// </summary>
+		virtual property int DelayMillis;
+	};
 }
\ No newline at end of file
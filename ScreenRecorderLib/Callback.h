@@ -62,4 +62,93 @@ namespace ScreenRecorderLib {
 			FrameNumber = frameNumber;
 		}
 	};
+
+	/// <summary>
+	/// The levels of an audio signal over one metering interval.
+	/// </summary>
+	public ref class AudioLevel {
+	public:
+		/// <summary>
+		/// The largest sample in the interval, in dBFS. -120 is silence.
+		/// </summary>
+		property float Peak;
+		/// <summary>
+		/// The RMS level of the interval, in dBFS. -120 is silence.
+		/// </summary>
+		property float Rms;
+		/// <summary>
+		/// The loudness of the last 400 ms in LUFS, as defined by ITU-R BS.1770. -120 is silence.
+		/// </summary>
+		property float MomentaryLoudness;
+		AudioLevel() {}
+		AudioLevel(float peak, float rms, float momentaryLoudness) {
+			Peak = peak;
+			Rms = rms;
+			MomentaryLoudness = momentaryLoudness;
+		}
+	};
+
+	public ref class AudioLevelsEventArgs :System::EventArgs {
+	public:
+		/// <summary>
+		/// The levels of the audio written to the recording.
+		/// </summary>
+		property AudioLevel^ Mix;
+		/// <summary>
+		/// The levels of the output device as captured, before volume and mute. Null if the output device is not recorded.
+		/// </summary>
+		property AudioLevel^ OutputDevice;
+		/// <summary>
+		/// The levels of the input device as captured, before volume, mute and noise gate. Null if the input device is not recorded.
+		/// </summary>
+		property AudioLevel^ InputDevice;
+		/// <summary>
+		/// The levels of the additional audio sources, in the order of AudioOptions.AdditionalAudioSources. Null for sources that failed to start.
+		/// </summary>
+		property List<AudioLevel^>^ AdditionalSources;
+		AudioLevelsEventArgs(AudioLevel^ mix, AudioLevel^ outputDevice, AudioLevel^ inputDevice, List<AudioLevel^>^ additionalSources) {
+			Mix = mix;
+			OutputDevice = outputDevice;
+			InputDevice = inputDevice;
+			AdditionalSources = additionalSources;
+		}
+	};
+
+	public ref class FragmentWrittenEventArgs :System::EventArgs {
+	public:
+		/// <summary>
+		/// The file the fragment was written to, or null when recording to a stream.
+		/// </summary>
+		property String^ FilePath;
+		/// <summary>
+		/// The sequence number of the fragment, starting at 1 in every file.
+		/// </summary>
+		property int SequenceNumber;
+		/// <summary>
+		/// The byte offset of the fragment from the start of the file. The bytes before the first fragment are the initialization segment, which a player needs first.
+		/// </summary>
+		property Int64 Offset;
+		/// <summary>
+		/// The size of the fragment in bytes. The fragment is complete in the file when the event is raised.
+		/// </summary>
+		property Int64 Size;
+		/// <summary>
+		/// The timestamp of the start of the fragment in the file.
+		/// </summary>
+		property TimeSpan StartTime;
+		property TimeSpan Duration;
+		/// <summary>
+		/// Whether the fragment starts with a keyframe, so playback can start at it.
+		/// </summary>
+		property bool IsKeyframe;
+		FragmentWrittenEventArgs(String^ filePath, int sequenceNumber, Int64 offset, Int64 size, TimeSpan startTime, TimeSpan duration, bool isKeyframe) {
+			FilePath = filePath;
+			SequenceNumber = sequenceNumber;
+			Offset = offset;
+			Size = size;
+			StartTime = startTime;
+			Duration = duration;
+			IsKeyframe = isKeyframe;
+		}
+	};
 }
\ No newline at end of file
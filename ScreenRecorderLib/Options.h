@@ -3,6 +3,7 @@
 #include "RecordingSources.h"
 #include "RecordingOverlays.h"
 #include "VideoEncoders.h"
+#include "AudioDevice.h"
 
 using namespace System;
 using namespace System::Collections::Generic;
@@ -31,7 +32,9 @@ namespace ScreenRecorderLib {
 		PNG,
 		JPEG,
 		TIFF,
-		BMP
+		BMP,
+		///<summary>Lossless QOI (Quite OK Image) format. Many times faster to write than PNG, with somewhat larger files for screen content.</summary>
+		QOI
 	};
 
 	public enum class AudioChannels {
@@ -53,7 +56,36 @@ namespace ScreenRecorderLib {
 		///<summary>Record a slideshow of pictures. </summary>
 		Slideshow = (int)RecorderModeInternal::Slideshow,
 		///<summary>Create a single screenshot.</summary>
-		Screenshot = (int)RecorderModeInternal::Screenshot
+		Screenshot = (int)RecorderModeInternal::Screenshot,
+		///<summary>Keep the last part of the recording in memory, and save it to a file or stream with Recorder.SaveReplay. Video is always encoded on the CPU in this mode, and VideoEncoderOptions.IsHardwareEncodingEnabled is ignored.</summary>
+		ReplayBuffer = (int)RecorderModeInternal::ReplayBuffer
+	};
+
+	public enum class FrameDropPolicy {
+		///<summary>Wait for the encoder when the encode queue is full. No frames are dropped, but a slow encoder delays capture.</summary>
+		Block = (int)EncodeQueueDropPolicy::Block,
+		///<summary>Drop the oldest queued frame when the encode queue is full, so the most recent frames are kept.</summary>
+		DropOldest = (int)EncodeQueueDropPolicy::DropOldest,
+		///<summary>Drop the new frame when the encode queue is full, so the queued frames are kept.</summary>
+		DropNewest = (int)EncodeQueueDropPolicy::DropNewest
+	};
+
+	public enum class DuplicateFrameMode {
+		///<summary>Render and encode every frame, also when nothing changed since the frame before.</summary>
+		Encode = (int)CfrRepeatMode::Encode,
+		///<summary>Send the frame before to the encoder again when nothing changed, without copying or processing it.</summary>
+		Reference = (int)CfrRepeatMode::Reference,
+		///<summary>Extend the duration of the frame before when nothing changed, so unchanged frames are not encoded. Frames last up to 500 ms, and the output has a variable framerate on the grid of the fixed framerate.</summary>
+		Extend = (int)CfrRepeatMode::Extend
+	};
+
+	public enum class ColorConversionMode {
+		///<summary>Convert frames to the encoder input format with the Media Foundation video processor, or on the CPU if the video processor is unavailable or there is no GPU.</summary>
+		Auto = (int)ColorConverterMode::Auto,
+		///<summary>Always convert frames with the Media Foundation video processor.</summary>
+		MediaFoundation = (int)ColorConverterMode::MediaFoundation,
+		///<summary>Always convert frames on the CPU, using SIMD instructions and multiple threads.</summary>
+		Software = (int)ColorConverterMode::Software
 	};
 
 	public ref class SourceOptions : public INotifyPropertyChanged {
@@ -133,11 +165,19 @@ namespace ScreenRecorderLib {
 		StretchMode _stretch;
 		ScreenSize^ _outputFrameSize;
 		RecorderMode _recorderMode;
+		int _segmentDurationMillis;
+		Int64 _segmentMaxBytes;
+		int _replayBufferDurationMillis;
+		Int64 _replayBufferMaxBytes;
 	public:
 		OutputOptions():DynamicOutputOptions(){
 			Stretch = StretchMode::Uniform;
 			OutputFrameSize = ScreenSize::Empty;
 			RecorderMode = ScreenRecorderLib::RecorderMode::Video;
+			SegmentDurationMillis = 0;
+			SegmentMaxBytes = 0;
+			ReplayBufferDurationMillis = 120000;
+			ReplayBufferMaxBytes = 256LL * 1024 * 1024;
 		}
 
 		/// <summary>
@@ -174,6 +214,55 @@ namespace ScreenRecorderLib {
 				OnPropertyChanged("RecorderMode");
 			}
 		}
+		/// <summary>
+		/// Splits video recordings into files of at most this duration, e.g. 3600000 for one file per hour. The first file is written to the output path, and the next ones get a number appended, e.g. recording_002.mp4.
+		/// Each file starts with a keyframe and plays on its own, and the files follow each other without a gap. 0 records to a single file. Only used when recording to a file. Default is 0.
+		/// </summary>
+		property int SegmentDurationMillis {
+			int get() {
+				return _segmentDurationMillis;
+			}
+			void set(int value) {
+				_segmentDurationMillis = value;
+				OnPropertyChanged("SegmentDurationMillis");
+			}
+		}
+		/// <summary>
+		/// Splits video recordings into files of about this size in bytes. A file can grow a little past it, as the next file starts with the next frame. 0 for no size limit. Only used when recording to a file. Default is 0.
+		/// </summary>
+		property Int64 SegmentMaxBytes {
+			Int64 get() {
+				return _segmentMaxBytes;
+			}
+			void set(Int64 value) {
+				_segmentMaxBytes = value;
+				OnPropertyChanged("SegmentMaxBytes");
+			}
+		}
+		/// <summary>
+		/// How much of the recording the replay buffer keeps, in milliseconds. Saved replays are this long, plus up to two seconds as the buffer is trimmed at keyframes. Only used with RecorderMode.ReplayBuffer. Default is 120000.
+		/// </summary>
+		property int ReplayBufferDurationMillis {
+			int get() {
+				return _replayBufferDurationMillis;
+			}
+			void set(int value) {
+				_replayBufferDurationMillis = value;
+				OnPropertyChanged("ReplayBufferDurationMillis");
+			}
+		}
+		/// <summary>
+		/// The most memory in bytes the replay buffer can use. If the encoded recording is larger, the oldest part is dropped and saved replays are shorter. 0 for no limit. Only used with RecorderMode.ReplayBuffer. Default is 256 MB.
+		/// </summary>
+		property Int64 ReplayBufferMaxBytes {
+			Int64 get() {
+				return _replayBufferMaxBytes;
+			}
+			void set(Int64 value) {
+				_replayBufferMaxBytes = value;
+				OnPropertyChanged("ReplayBufferMaxBytes");
+			}
+		}
 	};
 
 	public ref class VideoEncoderOptions : public INotifyPropertyChanged {
@@ -187,6 +276,11 @@ namespace ScreenRecorderLib {
 		bool _isHardwareEncodingEnabled;
 		bool _isMp4FastStartEnabled;
 		bool _isFragmentedMp4Enabled;
+		int _fragmentDurationMillis;
+		int _encodeQueueDepth;
+		FrameDropPolicy _frameDropPolicy;
+		ColorConversionMode _colorConversionMode;
+		DuplicateFrameMode _duplicateFrameMode;
 		IVideoEncoder^ _encoder = gcnew H264VideoEncoder();
 	public:
 		VideoEncoderOptions() {
@@ -199,6 +293,11 @@ namespace ScreenRecorderLib {
 			IsHardwareEncodingEnabled = true;
 			IsMp4FastStartEnabled = true;
 			IsFragmentedMp4Enabled = false;
+			FragmentDurationMillis = 2000;
+			EncodeQueueDepth = 3;
+			FrameDropPolicy = ScreenRecorderLib::FrameDropPolicy::Block;
+			ColorConversionMode = ScreenRecorderLib::ColorConversionMode::Auto;
+			DuplicateFrameMode = ScreenRecorderLib::DuplicateFrameMode::Encode;
 			Encoder = gcnew H264VideoEncoder();
 		}
 		virtual event PropertyChangedEventHandler^ PropertyChanged;
@@ -315,7 +414,67 @@ namespace ScreenRecorderLib {
 			}
 		}
 		/// <summary>
-		/// Set the video encoder to use. Current supported encoders are H264VideoEncoder and H265VideoEncoder.
+		/// The shortest duration of a fragment in milliseconds, when IsFragmentedMp4Enabled is set. A fragment ends at the first keyframe after this, and every fragment is reported through Recorder.OnFragmentWritten. 0 ends a fragment at every keyframe. Only used with H.264 when IsHardwareEncodingEnabled is false. Default is 2000.
+		/// </summary>
+		property int FragmentDurationMillis {
+			int get() {
+				return _fragmentDurationMillis;
+			}
+			void set(int value) {
+				_fragmentDurationMillis = value;
+				OnPropertyChanged("FragmentDurationMillis");
+			}
+		}
+		/// <summary>
+		/// The number of frames that can wait for the encoder. Frames are encoded on a separate thread, and the queue absorbs encoder hiccups without delaying capture. Default is 3.
+		/// </summary>
+		property int EncodeQueueDepth {
+			int get() {
+				return _encodeQueueDepth;
+			}
+			void set(int value) {
+				_encodeQueueDepth = value;
+				OnPropertyChanged("EncodeQueueDepth");
+			}
+		}
+		/// <summary>
+		/// What to do with captured frames when the encode queue is full. Dropped frames are merged into the next frame, so their audio is kept. Default is Block.
+		/// </summary>
+		property ScreenRecorderLib::FrameDropPolicy FrameDropPolicy {
+			ScreenRecorderLib::FrameDropPolicy get() {
+				return _frameDropPolicy;
+			}
+			void set(ScreenRecorderLib::FrameDropPolicy value) {
+				_frameDropPolicy = value;
+				OnPropertyChanged("FrameDropPolicy");
+			}
+		}
+		/// <summary>
+		/// How captured frames are converted to the YUV format the encoder takes. Default is Auto.
+		/// </summary>
+		property ScreenRecorderLib::ColorConversionMode ColorConversionMode {
+			ScreenRecorderLib::ColorConversionMode get() {
+				return _colorConversionMode;
+			}
+			void set(ScreenRecorderLib::ColorConversionMode value) {
+				_colorConversionMode = value;
+				OnPropertyChanged("ColorConversionMode");
+			}
+		}
+		/// <summary>
+		/// How a recording with IsFixedFramerate writes frames where nothing changed on screen. Default is Encode.
+		/// </summary>
+		property ScreenRecorderLib::DuplicateFrameMode DuplicateFrameMode {
+			ScreenRecorderLib::DuplicateFrameMode get() {
+				return _duplicateFrameMode;
+			}
+			void set(ScreenRecorderLib::DuplicateFrameMode value) {
+				_duplicateFrameMode = value;
+				OnPropertyChanged("DuplicateFrameMode");
+			}
+		}
+		/// <summary>
+		/// Set the video encoder to use. Current supported encoders are H264VideoEncoder, H265VideoEncoder and RawVideoEncoder.
 		/// </summary>
 		property IVideoEncoder^ Encoder {
 			IVideoEncoder^ get() {
@@ -334,11 +493,15 @@ namespace ScreenRecorderLib {
 		bool _snapshotsWithVideo;
 		int _snapshotsIntervalMillis;
 		String^ _snapshotsDirectory;
+		int _imageEncoderThreadCount;
+		Int64 _imageEncoderMaxBytes;
 	public:
 		SnapshotOptions() {
 			SnapshotFormat = ImageFormat::PNG;
 			SnapshotsWithVideo = false;
 			SnapshotsIntervalMillis = 10000;
+			ImageEncoderThreadCount = 0;
+			ImageEncoderMaxBytes = 256LL * 1024 * 1024;
 		}
 		virtual event PropertyChangedEventHandler^ PropertyChanged;
 		void OnPropertyChanged(String^ info)
@@ -393,6 +556,30 @@ namespace ScreenRecorderLib {
 				OnPropertyChanged("SnapshotsDirectory");
 			}
 		}
+		/// <summary>
+		///The number of threads encoding slideshow images and snapshots in a video recording, or a single screenshot in QOI format. 0 picks a number from the processor count, up to 4. Default is 0.
+		/// </summary>
+		property int ImageEncoderThreadCount {
+			int get() {
+				return _imageEncoderThreadCount;
+			}
+			void set(int value) {
+				_imageEncoderThreadCount = value;
+				OnPropertyChanged("ImageEncoderThreadCount");
+			}
+		}
+		/// <summary>
+		///The most memory in bytes the images waiting to be encoded can use. When the encoder threads fall this far behind, the recording waits for them. 0 for no limit. Default is 256 MB.
+		/// </summary>
+		property Int64 ImageEncoderMaxBytes {
+			Int64 get() {
+				return _imageEncoderMaxBytes;
+			}
+			void set(Int64 value) {
+				_imageEncoderMaxBytes = value;
+				OnPropertyChanged("ImageEncoderMaxBytes");
+			}
+		}
 	};
 
 	public ref class DynamicAudioOptions : public INotifyPropertyChanged {
@@ -472,6 +659,14 @@ namespace ScreenRecorderLib {
 		Nullable<AudioChannels> _channels;
 		String^ _audioInputDevice;
 		String^ _audioOutputDevice;
+		Nullable<int> _inputDelayMillis;
+		Nullable<int> _outputDelayMillis;
+		List<AudioSource^>^ _additionalSources;
+		Nullable<bool> _isNoiseGateEnabled;
+		Nullable<float> _noiseGateThreshold;
+		Nullable<bool> _isAudioLevelMeteringEnabled;
+		Nullable<int> _audioLevelMeteringInterval;
+		Nullable<bool> _isAudioDitherEnabled;
 
 	public:
 		AudioOptions() :DynamicAudioOptions() {
@@ -537,8 +732,102 @@ namespace ScreenRecorderLib {
 				OnPropertyChanged("AudioInputDevice");
 			}
 		}
-
-
+		/// <summary>
+		/// Delay in milliseconds applied to the output device audio, to line it up with devices with a longer latency. Max 1000.
+		/// </summary>
+		property Nullable<int> OutputDelayMillis {
+			Nullable<int> get() {
+				return _outputDelayMillis;
+			}
+			void set(Nullable<int> value) {
+				_outputDelayMillis = value;
+				OnPropertyChanged("OutputDelayMillis");
+			}
+		}
+		/// <summary>
+		/// Delay in milliseconds applied to the input device audio, to line it up with devices with a longer latency. Max 1000.
+		/// </summary>
+		property Nullable<int> InputDelayMillis {
+			Nullable<int> get() {
+				return _inputDelayMillis;
+			}
+			void set(Nullable<int> value) {
+				_inputDelayMillis = value;
+				OnPropertyChanged("InputDelayMillis");
+			}
+		}
+		/// <summary>
+		/// Audio devices to record in addition to the output and input device, e.g. a second microphone. All sources are mixed into one audio track.
+		/// </summary>
+		property List<AudioSource^>^ AdditionalAudioSources {
+			List<AudioSource^>^ get() {
+				return _additionalSources;
+			}
+			void set(List<AudioSource^>^ value) {
+				_additionalSources = value;
+				OnPropertyChanged("AdditionalAudioSources");
+			}
+		}
+		/// <summary>
+		/// Leave input devices out of the recording while their level is below NoiseGateThreshold, e.g. to remove the background noise of a microphone between sentences.
+		/// </summary>
+		property Nullable<bool> IsNoiseGateEnabled {
+			Nullable<bool> get() {
+				return _isNoiseGateEnabled;
+			}
+			void set(Nullable<bool> value) {
+				_isNoiseGateEnabled = value;
+				OnPropertyChanged("IsNoiseGateEnabled");
+			}
+		}
+		/// <summary>
+		/// The level in dBFS at which the noise gate opens, e.g. -50. Default is -50.
+		/// </summary>
+		property Nullable<float> NoiseGateThreshold {
+			Nullable<float> get() {
+				return _noiseGateThreshold;
+			}
+			void set(Nullable<float> value) {
+				_noiseGateThreshold = value;
+				OnPropertyChanged("NoiseGateThreshold");
+			}
+		}
+		/// <summary>
+		/// Measure the levels of the recorded audio and report them through Recorder.OnAudioLevelsChanged, e.g. to show level meters while recording. Default is false.
+		/// </summary>
+		property Nullable<bool> IsAudioLevelMeteringEnabled {
+			Nullable<bool> get() {
+				return _isAudioLevelMeteringEnabled;
+			}
+			void set(Nullable<bool> value) {
+				_isAudioLevelMeteringEnabled = value;
+				OnPropertyChanged("IsAudioLevelMeteringEnabled");
+			}
+		}
+		/// <summary>
+		/// The interval in milliseconds between audio level reports. Reports are raised with recorded frames, so they are never more frequent than the frame rate. Default is 100.
+		/// </summary>
+		property Nullable<int> AudioLevelMeteringInterval {
+			Nullable<int> get() {
+				return _audioLevelMeteringInterval;
+			}
+			void set(Nullable<int> value) {
+				_audioLevelMeteringInterval = value;
+				OnPropertyChanged("AudioLevelMeteringInterval");
+			}
+		}
+		/// <summary>
+		/// Add dither noise when the audio is converted to 16 bit for the encoder, which avoids distortion on quiet audio at the cost of a noise floor at -96 dB. Default is true.
+		/// </summary>
+		property Nullable<bool> IsAudioDitherEnabled {
+			Nullable<bool> get() {
+				return _isAudioDitherEnabled;
+			}
+			void set(Nullable<bool> value) {
+				_isAudioDitherEnabled = value;
+				OnPropertyChanged("IsAudioDitherEnabled");
+			}
+		}
 	};
 
 	public ref class DynamicMouseOptions : public INotifyPropertyChanged {
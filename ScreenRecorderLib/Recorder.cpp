@@ -37,6 +37,10 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 					encoderOptions = new H265_ENCODER_OPTIONS();
 					break;
 				}
+				case VideoEncoderFormat::Raw: {
+					encoderOptions = new RAW_ENCODER_OPTIONS();
+					break;
+				}
 			}
 			encoderOptions->SetVideoBitrateMode((UINT32)options->VideoEncoderOptions->Encoder->GetBitrateMode());
 			encoderOptions->SetEncoderProfile((UINT32)options->VideoEncoderOptions->Encoder->GetEncoderProfile());
@@ -49,12 +53,19 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 			encoderOptions->SetFastStartEnabled(options->VideoEncoderOptions->IsMp4FastStartEnabled);
 			encoderOptions->SetHardwareEncodingEnabled(options->VideoEncoderOptions->IsHardwareEncodingEnabled);
 			encoderOptions->SetFragmentedMp4Enabled(options->VideoEncoderOptions->IsFragmentedMp4Enabled);
+			encoderOptions->SetFragmentDuration((UINT32)(std::max)(0, options->VideoEncoderOptions->FragmentDurationMillis));
+			encoderOptions->SetEncodeQueueDepth((UINT32)(std::max)(1, options->VideoEncoderOptions->EncodeQueueDepth));
+			encoderOptions->SetEncodeQueueDropPolicy((EncodeQueueDropPolicy)options->VideoEncoderOptions->FrameDropPolicy);
+			encoderOptions->SetColorConverterMode((ColorConverterMode)options->VideoEncoderOptions->ColorConversionMode);
+			encoderOptions->SetCfrRepeatMode((CfrRepeatMode)options->VideoEncoderOptions->DuplicateFrameMode);
 			m_Rec->SetEncoderOptions(encoderOptions);
 		}
 		if (options->SnapshotOptions) {
 			SNAPSHOT_OPTIONS* snapshotOptions = new SNAPSHOT_OPTIONS();
 			snapshotOptions->SetTakeSnapshotsWithVideo(options->SnapshotOptions->SnapshotsWithVideo);
 			snapshotOptions->SetSnapshotsWithVideoInterval(options->SnapshotOptions->SnapshotsIntervalMillis);
+			snapshotOptions->SetImageEncoderThreadCount((UINT32)(std::max)(0, options->SnapshotOptions->ImageEncoderThreadCount));
+			snapshotOptions->SetImageEncoderMaxBytes((UINT64)(std::max)(0LL, options->SnapshotOptions->ImageEncoderMaxBytes));
 			if (options->SnapshotOptions->SnapshotsDirectory != nullptr) {
 				snapshotOptions->SetSnapshotDirectory(msclr::interop::marshal_as<std::wstring>(options->SnapshotOptions->SnapshotsDirectory));
 			}
@@ -69,6 +80,9 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 				case ImageFormat::TIFF:
 					snapshotOptions->SetSnapshotSaveFormat(GUID_ContainerFormatTiff);
 					break;
+				case ImageFormat::QOI:
+					snapshotOptions->SetSnapshotSaveFormat(GUID_ContainerFormatQoi);
+					break;
 				default:
 				case ImageFormat::PNG:
 					snapshotOptions->SetSnapshotSaveFormat(GUID_ContainerFormatPng);
@@ -89,6 +103,10 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 			}
 			outputOptions->SetRecorderMode(static_cast<RecorderModeInternal>(options->OutputOptions->RecorderMode));
 			outputOptions->SetStretch(static_cast<TextureStretchMode>(options->OutputOptions->Stretch));
+			outputOptions->SetSegmentDuration((UINT32)(std::max)(0, options->OutputOptions->SegmentDurationMillis));
+			outputOptions->SetSegmentMaxBytes((UINT64)(std::max)(0LL, options->OutputOptions->SegmentMaxBytes));
+			outputOptions->SetReplayBufferDuration((UINT32)(std::max)(0, options->OutputOptions->ReplayBufferDurationMillis));
+			outputOptions->SetReplayBufferMaxBytes((UINT64)(std::max)(0LL, options->OutputOptions->ReplayBufferMaxBytes));
 			m_Rec->SetOutputOptions(outputOptions);
 		}
 		if (options->AudioOptions) {
@@ -121,6 +139,30 @@ void Recorder::SetOptions(RecorderOptions^ options) {
 			if (options->AudioOptions->OutputVolume.HasValue) {
 				audioOptions->SetOutputVolume(options->AudioOptions->OutputVolume.Value);
 			}
+			if (options->AudioOptions->OutputDelayMillis.HasValue) {
+				audioOptions->SetOutputDelay((UINT32)(std::max)(0, options->AudioOptions->OutputDelayMillis.Value));
+			}
+			if (options->AudioOptions->InputDelayMillis.HasValue) {
+				audioOptions->SetInputDelay((UINT32)(std::max)(0, options->AudioOptions->InputDelayMillis.Value));
+			}
+			if (options->AudioOptions->IsNoiseGateEnabled.HasValue) {
+				audioOptions->SetNoiseGateEnabled(options->AudioOptions->IsNoiseGateEnabled.Value);
+			}
+			if (options->AudioOptions->NoiseGateThreshold.HasValue) {
+				audioOptions->SetNoiseGateThreshold(options->AudioOptions->NoiseGateThreshold.Value);
+			}
+			if (options->AudioOptions->IsAudioLevelMeteringEnabled.HasValue) {
+				audioOptions->SetAudioLevelMeteringEnabled(options->AudioOptions->IsAudioLevelMeteringEnabled.Value);
+			}
+			if (options->AudioOptions->AudioLevelMeteringInterval.HasValue) {
+				audioOptions->SetAudioLevelMeteringInterval((UINT32)(std::max)(0, options->AudioOptions->AudioLevelMeteringInterval.Value));
+			}
+			if (options->AudioOptions->IsAudioDitherEnabled.HasValue) {
+				audioOptions->SetAudioDitherEnabled(options->AudioOptions->IsAudioDitherEnabled.Value);
+			}
+			if (options->AudioOptions->AdditionalAudioSources) {
+				audioOptions->SetAdditionalSources(CreateAudioSourceList(options->AudioOptions->AdditionalAudioSources));
+			}
 			m_Rec->SetAudioOptions(audioOptions);
 		}
 		if (options->MouseOptions) {
@@ -553,6 +595,19 @@ void Recorder::Resume() {
 void Recorder::Stop() {
 	m_Rec->EndRecording();
 }
+bool Recorder::SaveReplay() {
+	return SaveReplay((System::String^)nullptr);
+}
+bool Recorder::SaveReplay(System::String^ path) {
+	std::wstring stdPathString = path ? msclr::interop::marshal_as<std::wstring>(path) : L"";
+	return m_Rec->SaveReplay(stdPathString) == S_OK;
+}
+bool Recorder::SaveReplay(System::IO::Stream^ stream) {
+	ManagedIStream* pManagedStream = new ManagedIStream(stream);
+	HRESULT hr = m_Rec->SaveReplay(pManagedStream);
+	pManagedStream->Release();
+	return hr == S_OK;
+}
 
 void Recorder::SetupCallbacks() {
 	CreateErrorCallback();
@@ -560,6 +615,8 @@ void Recorder::SetupCallbacks() {
 	CreateStatusCallback();
 	CreateSnapshotCallback();
 	CreateFrameNumberCallback();
+	CreateAudioLevelsCallback();
+	CreateFragmentWrittenCallback();
 }
 
 void Recorder::ClearCallbacks() {
@@ -573,6 +630,10 @@ void Recorder::ClearCallbacks() {
 		_snapshotDelegateGcHandler.Free();
 	if (_frameNumberDelegateGcHandler.IsAllocated)
 		_frameNumberDelegateGcHandler.Free();
+	if (_audioLevelsDelegateGcHandler.IsAllocated)
+		_audioLevelsDelegateGcHandler.Free();
+	if (_fragmentWrittenDelegateGcHandler.IsAllocated)
+		_fragmentWrittenDelegateGcHandler.Free();
 }
 
 HRESULT Recorder::CreateNativeRecordingSource(_In_ RecordingSourceBase^ managedSource, _Out_ RECORDING_SOURCE* pNativeSource)
@@ -771,6 +832,28 @@ std::vector<RECORDING_OVERLAY> Recorder::CreateOverlayList(IEnumerable<Recording
 	return overlays;
 }
 
+std::vector<AUDIO_SOURCE> Recorder::CreateAudioSourceList(IEnumerable<AudioSource^>^ managedSources) {
+	std::vector<AUDIO_SOURCE> sources{};
+	if (managedSources) {
+		for each (AudioSource^ source in managedSources)
+		{
+			if (!source) {
+				continue;
+			}
+			AUDIO_SOURCE nativeSource{};
+			if (source->DeviceName != nullptr) {
+				nativeSource.DeviceName = msclr::interop::marshal_as<std::wstring>(source->DeviceName);
+			}
+			nativeSource.IsLoopback = source->IsLoopbackDevice;
+			nativeSource.Volume = source->Volume;
+			nativeSource.IsMuted = source->IsMuted;
+			nativeSource.DelayMillis = (UINT32)(std::max)(0, source->DelayMillis);
+			sources.push_back(nativeSource);
+		}
+	}
+	return sources;
+}
+
 void Recorder::CreateErrorCallback() {
 	InternalErrorCallbackDelegate^ fp = gcnew InternalErrorCallbackDelegate(this, &Recorder::EventFailed);
 	_errorDelegateGcHandler = GCHandle::Alloc(fp);
@@ -807,6 +890,20 @@ void Recorder::CreateFrameNumberCallback() {
 	CallbackFrameNumberChangedFunction cb = static_cast<CallbackFrameNumberChangedFunction>(ip.ToPointer());
 	m_Rec->RecordingFrameNumberChangedCallback = cb;
 }
+void Recorder::CreateAudioLevelsCallback() {
+	InternalAudioLevelsCallbackDelegate^ fp = gcnew InternalAudioLevelsCallbackDelegate(this, &Recorder::EventAudioLevelsChanged);
+	_audioLevelsDelegateGcHandler = GCHandle::Alloc(fp);
+	IntPtr ip = Marshal::GetFunctionPointerForDelegate(fp);
+	CallbackAudioLevelsChangedFunction cb = static_cast<CallbackAudioLevelsChangedFunction>(ip.ToPointer());
+	m_Rec->RecordingAudioLevelsChangedCallback = cb;
+}
+void Recorder::CreateFragmentWrittenCallback() {
+	InternalFragmentWrittenCallbackDelegate^ fp = gcnew InternalFragmentWrittenCallbackDelegate(this, &Recorder::EventFragmentWritten);
+	_fragmentWrittenDelegateGcHandler = GCHandle::Alloc(fp);
+	IntPtr ip = Marshal::GetFunctionPointerForDelegate(fp);
+	CallbackFragmentWrittenFunction cb = static_cast<CallbackFragmentWrittenFunction>(ip.ToPointer());
+	m_Rec->RecordingFragmentWrittenCallback = cb;
+}
 void Recorder::EventComplete(std::wstring path, fifo_map<std::wstring, int> delays)
 {
 	ClearCallbacks();
@@ -849,3 +946,23 @@ void Recorder::FrameNumberChanged(int newFrameNumber)
 	OnFrameRecorded(this, gcnew FrameRecordedEventArgs(newFrameNumber));
 	CurrentFrameNumber = newFrameNumber;
 }
+
+void Recorder::EventAudioLevelsChanged(AUDIO_LEVELS_REPORT levels)
+{
+	AudioLevel^ outputDevice = levels.HasOutputDevice ? gcnew AudioLevel(levels.OutputDevice.PeakDb, levels.OutputDevice.RmsDb, levels.OutputDevice.MomentaryLoudness) : nullptr;
+	AudioLevel^ inputDevice = levels.HasInputDevice ? gcnew AudioLevel(levels.InputDevice.PeakDb, levels.InputDevice.RmsDb, levels.InputDevice.MomentaryLoudness) : nullptr;
+	List<AudioLevel^>^ additionalSources = gcnew List<AudioLevel^>();
+	for (size_t i = 0; i < levels.AdditionalSources.size(); i++) {
+		AUDIO_METER_READING const &reading = levels.AdditionalSources[i];
+		additionalSources->Add(levels.HasAdditionalSources[i] ? gcnew AudioLevel(reading.PeakDb, reading.RmsDb, reading.MomentaryLoudness) : nullptr);
+	}
+	AudioLevel^ mix = gcnew AudioLevel(levels.Mix.PeakDb, levels.Mix.RmsDb, levels.Mix.MomentaryLoudness);
+	OnAudioLevelsChanged(this, gcnew AudioLevelsEventArgs(mix, outputDevice, inputDevice, additionalSources));
+}
+
+void Recorder::EventFragmentWritten(std::wstring path, FMP4_FRAGMENT_INFO fragment)
+{
+	//TimeSpan ticks are 100 nanosecond units, like the native timestamps.
+	OnFragmentWritten(this, gcnew FragmentWrittenEventArgs(path.empty() ? nullptr : gcnew String(path.c_str()), (int)fragment.SequenceNumber, (Int64)fragment.Offset, (Int64)fragment.Size,
+		TimeSpan::FromTicks(fragment.StartPos), TimeSpan::FromTicks(fragment.Duration), fragment.IsKeyframe));
+}
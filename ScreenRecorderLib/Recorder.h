@@ -22,6 +22,8 @@ delegate void InternalCompletionCallbackDelegate(std::wstring path, nlohmann::fi
 delegate void InternalErrorCallbackDelegate(std::wstring error, std::wstring path);
 delegate void InternalSnapshotCallbackDelegate(std::wstring path);
 delegate void InternalFrameNumberCallbackDelegate(int newFrameNumber);
+delegate void InternalAudioLevelsCallbackDelegate(AUDIO_LEVELS_REPORT levels);
+delegate void InternalFragmentWrittenCallbackDelegate(std::wstring path, FMP4_FRAGMENT_INFO fragment);
 
 namespace ScreenRecorderLib {
 
@@ -61,17 +63,22 @@ namespace ScreenRecorderLib {
 		void CreateStatusCallback();
 		void CreateSnapshotCallback();
 		void CreateFrameNumberCallback();
+		void CreateAudioLevelsCallback();
+		void CreateFragmentWrittenCallback();
 		void EventComplete(std::wstring path, nlohmann::fifo_map<std::wstring, int> delays);
 		void EventFailed(std::wstring error, std::wstring path);
 		void EventStatusChanged(int status);
 		void EventSnapshotCreated(std::wstring str);
 		void FrameNumberChanged(int newFrameNumber);
+		void EventAudioLevelsChanged(AUDIO_LEVELS_REPORT levels);
+		void EventFragmentWritten(std::wstring path, FMP4_FRAGMENT_INFO fragment);
 		void SetupCallbacks();
 		void ClearCallbacks();
 		static HRESULT CreateNativeRecordingSource(_In_ RecordingSourceBase^ managedSource, _Out_ RECORDING_SOURCE* pNativeSource);
 		static HRESULT CreateNativeRecordingOverlay(_In_ RecordingOverlayBase^ managedOverlay, _Out_ RECORDING_OVERLAY* pNativeOverlay);
 		static std::vector<RECORDING_SOURCE> CreateRecordingSourceList(IEnumerable<RecordingSourceBase^>^ options);
 		static std::vector<RECORDING_OVERLAY> CreateOverlayList(IEnumerable<RecordingOverlayBase^>^ managedOverlays);
+		static std::vector<AUDIO_SOURCE> CreateAudioSourceList(IEnumerable<AudioSource^>^ managedSources);
 
 		int _currentFrameNumber;
 		RecorderStatus _status;
@@ -82,6 +89,8 @@ namespace ScreenRecorderLib {
 		GCHandle _completedDelegateGcHandler;
 		GCHandle _snapshotDelegateGcHandler;
 		GCHandle _frameNumberDelegateGcHandler;
+		GCHandle _audioLevelsDelegateGcHandler;
+		GCHandle _fragmentWrittenDelegateGcHandler;
 
 	internal:
 		void SetDynamicOptions(DynamicOptions^ options);
@@ -112,6 +121,22 @@ namespace ScreenRecorderLib {
 		void Pause();
 		void Resume();
 		void Stop();
+		/// <summary>
+		/// Saves the contents of the replay buffer, without interrupting the recording. Only used with RecorderMode.ReplayBuffer.
+		/// The replay is saved with a timestamped name in the folder passed to Record.
+		/// </summary>
+		/// <returns>true if the replay was saved, false if the buffer was empty or saving failed</returns>
+		bool SaveReplay();
+		/// <summary>
+		/// Saves the contents of the replay buffer to the given file, without interrupting the recording. Only used with RecorderMode.ReplayBuffer.
+		/// </summary>
+		/// <returns>true if the replay was saved, false if the buffer was empty or saving failed</returns>
+		bool SaveReplay(System::String^ path);
+		/// <summary>
+		/// Saves the contents of the replay buffer to the given stream, without interrupting the recording. Only used with RecorderMode.ReplayBuffer.
+		/// </summary>
+		/// <returns>true if the replay was saved, false if the buffer was empty or saving failed</returns>
+		bool SaveReplay(System::IO::Stream^ stream);
 		void SetOptions(RecorderOptions^ options);
 		/// <summary>
 		/// DynamicOptionsBuilder can be used to update a subset of options while a recording is in progress.
@@ -132,6 +157,14 @@ namespace ScreenRecorderLib {
 		event EventHandler<RecordingStatusEventArgs^>^ OnStatusChanged;
 		event EventHandler<SnapshotSavedEventArgs^>^ OnSnapshotSaved;
 		event EventHandler<FrameRecordedEventArgs^>^ OnFrameRecorded;
+		/// <summary>
+		/// Raised with the audio levels of the recording once per AudioOptions.AudioLevelMeteringInterval, if AudioOptions.IsAudioLevelMeteringEnabled is set.
+		/// </summary>
+		event EventHandler<AudioLevelsEventArgs^>^ OnAudioLevelsChanged;
+		/// <summary>
+		/// Raised on the encoding thread whenever a fragment of a fragmented MP4 recording is written, with where it is in the file. Only raised for H.264 with VideoEncoderOptions.IsFragmentedMp4Enabled set and IsHardwareEncodingEnabled cleared.
+		/// </summary>
+		event EventHandler<FragmentWrittenEventArgs^>^ OnFragmentWritten;
 	};
 
 	public ref class DynamicOptionsBuilder {
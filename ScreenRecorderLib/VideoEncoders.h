@@ -31,7 +31,9 @@ namespace ScreenRecorderLib {
 		///<summary>H.264/AVC encoder. </summary>
 		H264,
 		///<summary>H.265/HEVC encoder. </summary>
-		H265
+		H265,
+		///<summary>Uncompressed video in a .y4m file, with the audio in a .wav file next to it. </summary>
+		Raw
 	};
 
 	public interface class IVideoEncoder {
@@ -145,4 +147,20 @@ namespace ScreenRecorderLib {
 		virtual UInt32 GetEncoderProfile() { return (UInt32)EncoderProfile; }
 		virtual UInt32 GetBitrateMode() { return (UInt32)BitrateMode; }
 	};
+
+	/// <summary>
+	/// Write uncompressed I420 video to a YUV4MPEG2 (.y4m) file and the audio as PCM to a .wav file with the same name.
+	/// The video has a constant frame rate set by the Framerate option. Files are large, but are written without a hardware or Media Foundation encoder, which makes them useful for testing and as input for other encoders.
+	/// Recording to a stream is not supported.
+	/// </summary>
+	public ref class RawVideoEncoder : public IVideoEncoder {
+	public:
+		virtual property VideoEncoderFormat EncodingFormat {
+			VideoEncoderFormat get() {
+				return VideoEncoderFormat::Raw;
+			}
+		}
+		virtual UInt32 GetEncoderProfile() { return 0; }
+		virtual UInt32 GetBitrateMode() { return 0; }
+	};
 }
\ No newline at end of file
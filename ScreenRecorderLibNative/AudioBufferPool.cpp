@@ -0,0 +1,212 @@
+#include "AudioBufferPool.h"
+#include <cstring>
+#include <new>
+
+AudioBuffer::AudioBuffer(size_t capacity, int bucket) :
+	m_Data(new (std::nothrow) uint8_t[capacity]),
+	m_IsSilent(false),
+	m_Capacity(m_Data ? capacity : 0),
+	m_Size(0),
+	m_Bucket(bucket),
+	m_RefCount(1),
+	m_Pool(nullptr)
+{
+}
+
+AudioBuffer::AudioBuffer() :
+	m_Data(nullptr),
+	m_IsSilent(true),
+	m_Capacity(0),
+	m_Size(0),
+	m_Bucket(AudioBufferPool::SILENT_BUCKET),
+	m_RefCount(1),
+	m_Pool(nullptr)
+{
+}
+
+void AudioBuffer::AddRef()
+{
+	m_RefCount.fetch_add(1, std::memory_order_relaxed);
+}
+
+void AudioBuffer::Release()
+{
+	if (m_RefCount.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+		//The local reference keeps the pool alive until Recycle returns, even if this buffer held the last reference to it.
+		std::shared_ptr<AudioBufferPool> pool = std::move(m_Pool);
+		if (pool) {
+			pool->Recycle(this);
+		}
+		else {
+			delete this;
+		}
+	}
+}
+
+std::shared_ptr<AudioBufferPool> AudioBufferPool::Create(size_t maxIdleBuffersPerSize)
+{
+	return std::shared_ptr<AudioBufferPool>(new AudioBufferPool(maxIdleBuffersPerSize));
+}
+
+AudioBufferPool::AudioBufferPool(size_t maxIdleBuffersPerSize) :
+	m_MaxIdleBuffersPerSize(maxIdleBuffersPerSize),
+	m_Stats{}
+{
+	//Reserve up front so returning a buffer to the pool never allocates.
+	for (auto &buffers : m_IdleBuffers) {
+		buffers.reserve(m_MaxIdleBuffersPerSize);
+	}
+	m_IdleSilentBuffers.reserve(m_MaxIdleBuffersPerSize);
+}
+
+AudioBufferPool::~AudioBufferPool()
+{
+	//Buffers in use hold a reference to the pool, so only idle buffers remain at this point.
+	Trim();
+}
+
+int AudioBufferPool::GetBucket(size_t size)
+{
+	int bucket = 0;
+	while (bucket < BUCKET_COUNT && (static_cast<size_t>(1) << (bucket + MIN_BUCKET_SHIFT)) < size) {
+		bucket++;
+	}
+	return bucket < BUCKET_COUNT ? bucket : -1;
+}
+
+AudioBufferRef AudioBufferPool::Acquire(size_t size)
+{
+	int bucket = GetBucket(size);
+	AudioBuffer *pBuffer = nullptr;
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_Stats.AcquireCount++;
+		if (bucket >= 0 && !m_IdleBuffers[bucket].empty()) {
+			pBuffer = m_IdleBuffers[bucket].back();
+			m_IdleBuffers[bucket].pop_back();
+			m_Stats.IdleBytes -= pBuffer->GetCapacity();
+		}
+		else {
+			m_Stats.AllocationCount++;
+		}
+		m_Stats.OutstandingCount++;
+	}
+	if (pBuffer) {
+		pBuffer->m_RefCount.store(1, std::memory_order_relaxed);
+	}
+	else {
+		size_t capacity = bucket >= 0 ? static_cast<size_t>(1) << (bucket + MIN_BUCKET_SHIFT) : size;
+		pBuffer = new (std::nothrow) AudioBuffer(capacity, bucket);
+		if (!pBuffer || !pBuffer->GetData()) {
+			delete pBuffer;
+			std::scoped_lock lock(m_Mutex);
+			m_Stats.OutstandingCount--;
+			return AudioBufferRef();
+		}
+	}
+	pBuffer->m_Pool = shared_from_this();
+	pBuffer->SetSize(size);
+	return AudioBufferRef(pBuffer);
+}
+
+AudioBufferRef AudioBufferPool::AcquireSilence(size_t size)
+{
+	AudioBuffer *pBuffer = nullptr;
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_Stats.AcquireCount++;
+		m_Stats.SilentCount++;
+		if (!m_IdleSilentBuffers.empty()) {
+			pBuffer = m_IdleSilentBuffers.back();
+			m_IdleSilentBuffers.pop_back();
+		}
+		m_Stats.OutstandingCount++;
+	}
+	if (pBuffer) {
+		pBuffer->m_RefCount.store(1, std::memory_order_relaxed);
+	}
+	else {
+		pBuffer = new (std::nothrow) AudioBuffer();
+		if (!pBuffer) {
+			std::scoped_lock lock(m_Mutex);
+			m_Stats.OutstandingCount--;
+			return AudioBufferRef();
+		}
+	}
+	pBuffer->m_Pool = shared_from_this();
+	//A silent buffer is exactly as large as the silence it stands for.
+	pBuffer->m_Capacity = size;
+	pBuffer->m_Size = size;
+	return AudioBufferRef(pBuffer);
+}
+
+AudioBufferRef AudioBufferPool::Materialize(const AudioBufferRef &buffer)
+{
+	if (!buffer || !buffer->IsSilent()) {
+		return buffer;
+	}
+	std::shared_ptr<AudioBufferPool> pool = buffer->m_Pool;
+	if (!pool) {
+		return AudioBufferRef();
+	}
+	AudioBufferRef materialized = pool->Acquire(buffer->GetSize());
+	if (materialized) {
+		memset(materialized->GetData(), 0, materialized->GetSize());
+		std::scoped_lock lock(pool->m_Mutex);
+		pool->m_Stats.MaterializedCount++;
+	}
+	return materialized;
+}
+
+void AudioBufferPool::Recycle(AudioBuffer *pBuffer)
+{
+	bool isKept = false;
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_Stats.OutstandingCount--;
+		int bucket = pBuffer->m_Bucket;
+		if (bucket == SILENT_BUCKET && m_IdleSilentBuffers.size() < m_MaxIdleBuffersPerSize) {
+			m_IdleSilentBuffers.push_back(pBuffer);
+			isKept = true;
+		}
+		else if (bucket >= 0 && m_IdleBuffers[bucket].size() < m_MaxIdleBuffersPerSize) {
+			m_IdleBuffers[bucket].push_back(pBuffer);
+			m_Stats.IdleBytes += pBuffer->GetCapacity();
+			isKept = true;
+		}
+		else {
+			m_Stats.FreeCount++;
+		}
+	}
+	if (!isKept) {
+		delete pBuffer;
+	}
+}
+
+void AudioBufferPool::Trim()
+{
+	std::vector<AudioBuffer *> buffersToFree;
+	{
+		std::scoped_lock lock(m_Mutex);
+		for (auto &buffers : m_IdleBuffers) {
+			for (AudioBuffer *pBuffer : buffers) {
+				m_Stats.IdleBytes -= pBuffer->GetCapacity();
+				m_Stats.FreeCount++;
+			}
+			buffersToFree.insert(buffersToFree.end(), buffers.begin(), buffers.end());
+			buffers.clear();
+		}
+		m_Stats.FreeCount += m_IdleSilentBuffers.size();
+		buffersToFree.insert(buffersToFree.end(), m_IdleSilentBuffers.begin(), m_IdleSilentBuffers.end());
+		m_IdleSilentBuffers.clear();
+	}
+	for (AudioBuffer *pBuffer : buffersToFree) {
+		delete pBuffer;
+	}
+}
+
+AUDIO_BUFFER_POOL_STATS AudioBufferPool::GetStats()
+{
+	std::scoped_lock lock(m_Mutex);
+	return m_Stats;
+}
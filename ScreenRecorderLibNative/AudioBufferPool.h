@@ -0,0 +1,192 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+class AudioBufferPool;
+
+/// <summary>
+/// A reference counted block of PCM audio owned by an AudioBufferPool.
+/// When the last reference is released, the block goes back to the pool it came from instead of being freed.
+/// A silent buffer only records the length of the silence. It has no data until it is materialized with AudioBufferPool::Materialize.
+/// </summary>
+class AudioBuffer
+{
+public:
+	/// <summary>
+	/// The audio bytes, or nullptr if the buffer is silent.
+	/// </summary>
+	inline uint8_t *GetData() { return m_Data.get(); }
+	inline const uint8_t *GetData() const { return m_Data.get(); }
+	inline bool IsSilent() const { return m_IsSilent; }
+	/// <summary>
+	/// The number of bytes allocated for the buffer.
+	/// </summary>
+	inline size_t GetCapacity() const { return m_Capacity; }
+	/// <summary>
+	/// The number of valid bytes in the buffer.
+	/// </summary>
+	inline size_t GetSize() const { return m_Size; }
+	/// <summary>
+	/// Sets the number of valid bytes in the buffer. Values larger than the capacity are clamped.
+	/// </summary>
+	inline void SetSize(size_t size) { m_Size = size < m_Capacity ? size : m_Capacity; }
+
+	void AddRef();
+	void Release();
+
+private:
+	friend class AudioBufferPool;
+	AudioBuffer(size_t capacity, int bucket);
+	//Creates a silent buffer.
+	AudioBuffer();
+
+	std::unique_ptr<uint8_t[]> m_Data;
+	bool m_IsSilent;
+	size_t m_Capacity;
+	size_t m_Size;
+	//The size class of the buffer in the pool, or -1 if it is too large to be kept.
+	int m_Bucket;
+	std::atomic<uint32_t> m_RefCount;
+	//Keeps the pool alive while the buffer is in use. Cleared while the buffer is idle in the pool.
+	std::shared_ptr<AudioBufferPool> m_Pool;
+};
+
+/// <summary>
+/// Smart pointer holding a reference to an AudioBuffer, in the same way as CComPtr holds a COM object.
+/// </summary>
+class AudioBufferRef
+{
+public:
+	AudioBufferRef() : m_Buffer(nullptr) {}
+	AudioBufferRef(std::nullptr_t) : m_Buffer(nullptr) {}
+	AudioBufferRef(const AudioBufferRef &other) : m_Buffer(other.m_Buffer) {
+		if (m_Buffer) {
+			m_Buffer->AddRef();
+		}
+	}
+	AudioBufferRef(AudioBufferRef &&other) noexcept : m_Buffer(other.m_Buffer) {
+		other.m_Buffer = nullptr;
+	}
+	~AudioBufferRef() {
+		Reset();
+	}
+	AudioBufferRef &operator=(const AudioBufferRef &other) {
+		if (this != &other) {
+			AudioBufferRef copy(other);
+			Swap(copy);
+		}
+		return *this;
+	}
+	AudioBufferRef &operator=(AudioBufferRef &&other) noexcept {
+		if (this != &other) {
+			Reset();
+			m_Buffer = other.m_Buffer;
+			other.m_Buffer = nullptr;
+		}
+		return *this;
+	}
+	inline AudioBuffer *operator->() const { return m_Buffer; }
+	inline AudioBuffer *Get() const { return m_Buffer; }
+	inline explicit operator bool() const { return m_Buffer != nullptr; }
+	/// <summary>
+	/// The number of valid bytes in the buffer, or 0 if there is no buffer.
+	/// </summary>
+	inline size_t GetSize() const { return m_Buffer ? m_Buffer->GetSize() : 0; }
+	void Reset() {
+		if (m_Buffer) {
+			AudioBuffer *pBuffer = m_Buffer;
+			m_Buffer = nullptr;
+			pBuffer->Release();
+		}
+	}
+	inline void Swap(AudioBufferRef &other) {
+		AudioBuffer *pBuffer = m_Buffer;
+		m_Buffer = other.m_Buffer;
+		other.m_Buffer = pBuffer;
+	}
+
+private:
+	friend class AudioBufferPool;
+	//Takes ownership of a reference that is already counted.
+	explicit AudioBufferRef(AudioBuffer *pBuffer) : m_Buffer(pBuffer) {}
+	AudioBuffer *m_Buffer;
+};
+
+struct AUDIO_BUFFER_POOL_STATS
+{
+	//Number of buffers handed out.
+	uint64_t AcquireCount = 0;
+	//Number of silent buffers handed out, and how many of those were materialized.
+	uint64_t SilentCount = 0;
+	uint64_t MaterializedCount = 0;
+	//Number of buffers handed out that had to be allocated because no idle buffer was large enough.
+	uint64_t AllocationCount = 0;
+	//Number of buffers freed instead of being returned to the pool, because the pool was full or the buffer too large.
+	uint64_t FreeCount = 0;
+	//Number of buffers currently handed out.
+	uint64_t OutstandingCount = 0;
+	//Bytes held by idle buffers in the pool.
+	uint64_t IdleBytes = 0;
+};
+
+/// <summary>
+/// Thread safe pool of audio buffers in power of two size classes.
+/// Buffers can be acquired on one thread and released on another, e.g. by the media sink after encoding.
+/// After a short warm up, a recording with steady frame sizes acquires all its audio buffers without allocating.
+/// </summary>
+class AudioBufferPool : public std::enable_shared_from_this<AudioBufferPool>
+{
+public:
+	/// <summary>
+	/// Creates a pool. Pools are always owned by a shared_ptr, since the buffers handed out keep their pool alive.
+	/// </summary>
+	/// <param name="maxIdleBuffersPerSize">The number of idle buffers kept for each size class. Released buffers beyond this are freed.</param>
+	static std::shared_ptr<AudioBufferPool> Create(size_t maxIdleBuffersPerSize = DEFAULT_MAX_IDLE_BUFFERS_PER_SIZE);
+	~AudioBufferPool();
+
+	/// <summary>
+	/// Returns a buffer with room for at least the given number of bytes, and its size set to that number.
+	/// The contents of the buffer are undefined.
+	/// </summary>
+	/// <returns>The buffer, or an empty reference if the allocation failed.</returns>
+	AudioBufferRef Acquire(size_t size);
+	/// <summary>
+	/// Returns a silent buffer of the given number of bytes. No memory is allocated for the audio until the buffer is materialized.
+	/// </summary>
+	/// <returns>The buffer, or an empty reference if the allocation failed.</returns>
+	AudioBufferRef AcquireSilence(size_t size);
+	/// <summary>
+	/// Returns a buffer with the audio of the given buffer in memory. A silent buffer is replaced by a zeroed buffer from the pool it came from, other buffers are returned as they are.
+	/// </summary>
+	/// <returns>The buffer, or an empty reference if the allocation failed.</returns>
+	static AudioBufferRef Materialize(const AudioBufferRef &buffer);
+	/// <summary>
+	/// Frees all idle buffers. Buffers in use are returned to the pool as usual when released.
+	/// </summary>
+	void Trim();
+	AUDIO_BUFFER_POOL_STATS GetStats();
+
+private:
+	friend class AudioBuffer;
+	static const size_t DEFAULT_MAX_IDLE_BUFFERS_PER_SIZE = 8;
+	//Size classes range from 4 KB to 16 MB. Larger requests are allocated to size and not kept.
+	static const int MIN_BUCKET_SHIFT = 12;
+	static const int MAX_BUCKET_SHIFT = 24;
+	static const int BUCKET_COUNT = MAX_BUCKET_SHIFT - MIN_BUCKET_SHIFT + 1;
+	//The size class of silent buffers, which have no data and are kept in their own list.
+	static const int SILENT_BUCKET = -2;
+
+	explicit AudioBufferPool(size_t maxIdleBuffersPerSize);
+	void Recycle(AudioBuffer *pBuffer);
+	static int GetBucket(size_t size);
+
+	std::mutex m_Mutex;
+	std::vector<AudioBuffer *> m_IdleBuffers[BUCKET_COUNT];
+	std::vector<AudioBuffer *> m_IdleSilentBuffers;
+	size_t m_MaxIdleBuffersPerSize;
+	AUDIO_BUFFER_POOL_STATS m_Stats;
+};
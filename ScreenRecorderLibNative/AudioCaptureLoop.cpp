@@ -0,0 +1,135 @@
+#include "AudioCaptureLoop.h"
+#include <algorithm>
+
+AudioPollScheduler::AudioPollScheduler() :
+	m_SampleRate(0),
+	m_MaxInterval(0),
+	m_Interval(0),
+	m_PacketMicros(0),
+	m_EmptyPolls(0)
+{
+}
+
+void AudioPollScheduler::Initialize(uint32_t sampleRate, uint32_t devicePeriodMicros, uint32_t maxIntervalMicros)
+{
+	m_SampleRate = sampleRate;
+	m_MaxInterval = (std::max)(maxIntervalMicros, MIN_INTERVAL_MICROS);
+	m_PacketMicros = (std::max)(devicePeriodMicros, MIN_INTERVAL_MICROS);
+	m_Interval = (std::min)(static_cast<uint32_t>(m_PacketMicros), m_MaxInterval);
+	m_EmptyPolls = 0;
+}
+
+uint32_t AudioPollScheduler::Update(uint32_t packetCount, uint64_t frameCount)
+{
+	double interval;
+	if (packetCount > 0) {
+		if (m_SampleRate > 0 && frameCount > 0) {
+			double packetMicros = static_cast<double>(frameCount) * 1000000 / m_SampleRate / packetCount;
+			m_PacketMicros += (packetMicros - m_PacketMicros) * PACKET_SMOOTHING;
+		}
+		m_EmptyPolls = 0;
+		//More than one packet waiting means the polls are lagging the device, so the next one comes early to catch up.
+		interval = packetCount > 1 ? m_PacketMicros / 2 : m_PacketMicros;
+	}
+	else {
+		m_EmptyPolls++;
+		//The first empty poll was most likely just ahead of the packet, so it is retried soon. After that the device is probably idle, and the polls back off.
+		interval = m_EmptyPolls == 1 ? m_PacketMicros / 4 : m_PacketMicros * (1u << (std::min)(m_EmptyPolls - 1, 16u));
+	}
+	interval = (std::max)(static_cast<double>(MIN_INTERVAL_MICROS), (std::min)(static_cast<double>(m_MaxInterval), interval));
+	m_Interval = static_cast<uint32_t>(interval);
+	return m_Interval;
+}
+
+AudioCaptureLoop::AudioCaptureLoop() :
+	m_BlockAlign(0),
+	m_MaxWait(0),
+	m_Scheduler(),
+	m_HasDevicePosition(false),
+	m_NextDevicePosition(0),
+	m_Stats{}
+{
+}
+
+void AudioCaptureLoop::Initialize(uint32_t sampleRate, uint32_t blockAlign, uint32_t devicePeriodMicros, uint32_t maxWaitMicros)
+{
+	m_BlockAlign = blockAlign;
+	m_MaxWait = maxWaitMicros;
+	m_Scheduler.Initialize(sampleRate, devicePeriodMicros, maxWaitMicros);
+	m_HasDevicePosition = false;
+	m_NextDevicePosition = 0;
+	m_Stats = {};
+}
+
+bool AudioCaptureLoop::Run(IAudioCaptureDevice &device, AudioRingBuffer &buffer)
+{
+	bool isEventDriven = device.IsEventDriven();
+	uint32_t packetCount = 0;
+	uint64_t frameCount = 0;
+	//Drain whatever the device buffered before the loop started.
+	if (!DrainPackets(device, buffer, &packetCount, &frameCount)) {
+		return false;
+	}
+	while (true) {
+		uint32_t waitMicros = isEventDriven ? m_MaxWait : m_Scheduler.Update(packetCount, frameCount);
+		switch (device.Wait(waitMicros)) {
+		case AudioCaptureWaitResult::Stop:
+			return true;
+		case AudioCaptureWaitResult::Failed:
+			return false;
+		default:
+			break;
+		}
+		m_Stats.Wakeups++;
+		if (!DrainPackets(device, buffer, &packetCount, &frameCount)) {
+			return false;
+		}
+		if (packetCount == 0) {
+			m_Stats.EmptyWakeups++;
+		}
+	}
+}
+
+bool AudioCaptureLoop::DrainPackets(IAudioCaptureDevice &device, AudioRingBuffer &buffer, uint32_t *pPacketCount, uint64_t *pFrameCount)
+{
+	*pPacketCount = 0;
+	*pFrameCount = 0;
+	AUDIO_CAPTURE_PACKET packet;
+	while (true) {
+		if (!device.GetNextPacket(&packet)) {
+			return false;
+		}
+		if (packet.FrameCount == 0) {
+			return true;
+		}
+		//A discontinuity is commonly reported on the first packet without anything being lost, so it is only handled once the stream is running.
+		if (packet.IsDiscontinuity && m_HasDevicePosition) {
+			m_Stats.Discontinuities++;
+			if (packet.DevicePosition > m_NextDevicePosition) {
+				//The missing frames are padded with silence ahead of the packet, so the following audio stays in place.
+				//The padding is capped at the whole frames the buffer can hold, so the audio after it stays aligned to frames.
+				uint64_t maxPaddingBytes = (buffer.GetCapacity() / m_BlockAlign) * m_BlockAlign;
+				size_t paddingBytes = static_cast<size_t>((std::min)(maxPaddingBytes, (packet.DevicePosition - m_NextDevicePosition) * m_BlockAlign));
+				buffer.WriteSilence(paddingBytes);
+				m_Stats.PaddedFrames += paddingBytes / m_BlockAlign;
+			}
+		}
+		size_t bytes = static_cast<size_t>(packet.FrameCount) * m_BlockAlign;
+		if (packet.IsSilent || !packet.Data) {
+			m_Stats.SilentPackets++;
+			buffer.WriteSilence(bytes);
+		}
+		else {
+			buffer.Write(packet.Data, bytes);
+		}
+		if (!device.ReleasePacket(packet.FrameCount)) {
+			return false;
+		}
+		m_HasDevicePosition = true;
+		m_NextDevicePosition = packet.DevicePosition + packet.FrameCount;
+		m_Stats.Packets++;
+		m_Stats.Frames += packet.FrameCount;
+		(*pPacketCount)++;
+		*pFrameCount += packet.FrameCount;
+	}
+}
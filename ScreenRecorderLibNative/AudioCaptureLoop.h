@@ -0,0 +1,135 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "AudioRingBuffer.h"
+
+/// <summary>
+/// A packet of captured audio, owned by the device until it is released.
+/// </summary>
+struct AUDIO_CAPTURE_PACKET
+{
+	const uint8_t *Data = nullptr;
+	uint32_t FrameCount = 0;
+	//The position of the first frame in the device stream, in frames.
+	uint64_t DevicePosition = 0;
+	//The device marked the packet as silence, so Data must be ignored.
+	bool IsSilent = false;
+	//The device reported a gap in the stream before this packet.
+	bool IsDiscontinuity = false;
+};
+
+enum class AudioCaptureWaitResult {
+	//The device signaled that a packet is ready.
+	DataReady,
+	Timeout,
+	//The capture was asked to stop.
+	Stop,
+	Failed
+};
+
+/// <summary>
+/// The device side of an audio capture, e.g. a WASAPI capture client.
+/// </summary>
+class IAudioCaptureDevice
+{
+public:
+	virtual ~IAudioCaptureDevice() {}
+	/// <summary>
+	/// True if the device signals new packets through Wait. Otherwise the capture loop polls the device at an adaptive interval.
+	/// </summary>
+	virtual bool IsEventDriven() const = 0;
+	/// <summary>
+	/// Gets the next captured packet. A packet with a FrameCount of 0 means no packet is available.
+	/// </summary>
+	/// <returns>false if the device failed</returns>
+	virtual bool GetNextPacket(AUDIO_CAPTURE_PACKET *pPacket) = 0;
+	/// <summary>
+	/// Returns the packet from the last successful call to GetNextPacket to the device.
+	/// </summary>
+	/// <returns>false if the device failed</returns>
+	virtual bool ReleasePacket(uint32_t frameCount) = 0;
+	/// <summary>
+	/// Blocks until the device signals a packet, the capture is asked to stop, or the timeout passes.
+	/// </summary>
+	virtual AudioCaptureWaitResult Wait(uint32_t timeoutMicros) = 0;
+};
+
+/// <summary>
+/// Computes the wait between polls of a device that does not signal new packets.
+/// Polls are timed to the measured length of the packets the device delivers, so there is about one wake up per packet.
+/// Polls that find nothing back off, so an idle device, e.g. a loopback device with nothing playing, is rarely polled.
+/// </summary>
+class AudioPollScheduler
+{
+public:
+	AudioPollScheduler();
+	/// <param name="sampleRate">The sample rate of the device</param>
+	/// <param name="devicePeriodMicros">The expected length of a packet, used until packets are measured</param>
+	/// <param name="maxIntervalMicros">The longest wait between polls. Must be well below the length of the device buffer.</param>
+	void Initialize(uint32_t sampleRate, uint32_t devicePeriodMicros, uint32_t maxIntervalMicros);
+	/// <summary>
+	/// Feeds the result of a poll, and returns the wait before the next poll.
+	/// </summary>
+	/// <param name="packetCount">The number of packets the poll found</param>
+	/// <param name="frameCount">The total number of frames in the packets</param>
+	uint32_t Update(uint32_t packetCount, uint64_t frameCount);
+	inline uint32_t GetInterval() const { return m_Interval; }
+	/// <summary>
+	/// The smoothed length of the packets delivered by the device.
+	/// </summary>
+	inline double GetPacketMicros() const { return m_PacketMicros; }
+private:
+	//Weight of a new packet length measurement in the smoothed length.
+	static constexpr double PACKET_SMOOTHING = 0.125;
+	static constexpr uint32_t MIN_INTERVAL_MICROS = 1000;
+
+	uint32_t m_SampleRate;
+	uint32_t m_MaxInterval;
+	uint32_t m_Interval;
+	double m_PacketMicros;
+	uint32_t m_EmptyPolls;
+};
+
+struct AUDIO_CAPTURE_STATS
+{
+	//Times the capture thread woke up, and how many of those found no packets.
+	uint64_t Wakeups = 0;
+	uint64_t EmptyWakeups = 0;
+	uint64_t Packets = 0;
+	uint64_t Frames = 0;
+	uint64_t SilentPackets = 0;
+	uint64_t Discontinuities = 0;
+	//Frames of silence written in place of audio lost to discontinuities.
+	uint64_t PaddedFrames = 0;
+};
+
+/// <summary>
+/// Moves captured packets from a device to a ring buffer until the capture is stopped.
+/// The device is either waited on, if it is event driven, or polled at the interval computed by an AudioPollScheduler.
+/// </summary>
+class AudioCaptureLoop
+{
+public:
+	AudioCaptureLoop();
+	/// <param name="sampleRate">The sample rate of the device</param>
+	/// <param name="blockAlign">The size of a frame of the device, in bytes</param>
+	/// <param name="devicePeriodMicros">The period at which the device delivers packets</param>
+	/// <param name="maxWaitMicros">The longest wait between polls, and the timeout of waits on an event driven device</param>
+	void Initialize(uint32_t sampleRate, uint32_t blockAlign, uint32_t devicePeriodMicros, uint32_t maxWaitMicros);
+	/// <summary>
+	/// Runs the capture on the calling thread.
+	/// </summary>
+	/// <returns>true if the capture was stopped, false if the device failed</returns>
+	bool Run(IAudioCaptureDevice &device, AudioRingBuffer &buffer);
+	inline AUDIO_CAPTURE_STATS GetStats() const { return m_Stats; }
+	inline const AudioPollScheduler &GetPollScheduler() const { return m_Scheduler; }
+private:
+	uint32_t m_BlockAlign;
+	uint32_t m_MaxWait;
+	AudioPollScheduler m_Scheduler;
+	bool m_HasDevicePosition;
+	uint64_t m_NextDevicePosition;
+	AUDIO_CAPTURE_STATS m_Stats;
+
+	bool DrainPackets(IAudioCaptureDevice &device, AudioRingBuffer &buffer, uint32_t *pPacketCount, uint64_t *pFrameCount);
+};
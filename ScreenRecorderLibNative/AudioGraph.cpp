@@ -0,0 +1,364 @@
+#include "AudioGraph.h"
+#include <algorithm>
+#include <cstring>
+
+AudioGraph::AudioGraph() :
+	m_SampleRate(0),
+	m_Channels(0),
+	m_FrameSamples(0),
+	m_BlockFrames(0),
+	m_TargetLatencyFrames(0),
+	m_MasterGain(1.0f),
+	m_IsMeteringEnabled(false),
+	m_NextId(1),
+	m_Sources{},
+	m_Mixer(),
+	m_Analyzer(),
+	m_PulledFrames(0),
+	m_ReadBuffer{},
+	m_MixInputs{}
+{
+}
+
+void AudioGraph::Initialize(uint32_t sampleRate, uint32_t channels, uint32_t targetLatencyMillis)
+{
+	m_SampleRate = sampleRate;
+	m_Channels = channels;
+	m_FrameSamples = channels;
+	m_BlockFrames = (std::max)(static_cast<size_t>(1), static_cast<size_t>(sampleRate * BLOCK_MILLIS / 1000));
+	m_TargetLatencyFrames = static_cast<size_t>(sampleRate) * targetLatencyMillis / 1000;
+	for (SOURCE &source : m_Sources) {
+		source.Drift.Initialize(m_SampleRate, m_TargetLatencyFrames);
+		source.NoiseGate.Initialize(m_SampleRate, source.Options.NoiseGate);
+		source.Meter.Initialize(m_SampleRate, m_Channels, 0);
+	}
+	Clear();
+}
+
+int AudioGraph::AddSource(IAudioGraphInput *pInput, const AUDIO_GRAPH_SOURCE_OPTIONS &options)
+{
+	if (!pInput) {
+		return INVALID_SOURCE_ID;
+	}
+	SOURCE source;
+	source.Id = m_NextId++;
+	source.Input = pInput;
+	source.Options = options;
+	source.Options.DelayMillis = (std::min)(options.DelayMillis, MAX_DELAY_MILLIS);
+	source.Drift.Initialize(m_SampleRate, m_TargetLatencyFrames);
+	source.NoiseGate.Initialize(m_SampleRate, source.Options.NoiseGate);
+	source.GateGain = options.NoiseGate.IsEnabled ? GATE_CLOSED_GAIN : GATE_OPEN_GAIN;
+	//The readings are taken when the owner of the graph asks for them, so the meter has no interval of its own.
+	source.Meter.Initialize(m_SampleRate, m_Channels, 0);
+	m_Sources.push_back(std::move(source));
+	return m_Sources.back().Id;
+}
+
+bool AudioGraph::RemoveSource(int id)
+{
+	auto it = std::find_if(m_Sources.begin(), m_Sources.end(), [id](const SOURCE &source) { return source.Id == id; });
+	if (it == m_Sources.end()) {
+		return false;
+	}
+	m_Sources.erase(it);
+	return true;
+}
+
+bool AudioGraph::SetSourceOptions(int id, const AUDIO_GRAPH_SOURCE_OPTIONS &options)
+{
+	SOURCE *pSource = FindSource(id);
+	if (!pSource) {
+		return false;
+	}
+	size_t previousDelayFrames = GetDelayFrames(*pSource);
+	AUDIO_NOISE_GATE_OPTIONS previousGate = pSource->Options.NoiseGate;
+	pSource->Options = options;
+	if (previousGate.IsEnabled != options.NoiseGate.IsEnabled
+		|| previousGate.ThresholdDb != options.NoiseGate.ThresholdDb
+		|| previousGate.HysteresisDb != options.NoiseGate.HysteresisDb
+		|| previousGate.HoldMillis != options.NoiseGate.HoldMillis) {
+		pSource->NoiseGate.Initialize(m_SampleRate, options.NoiseGate);
+	}
+	pSource->Options.DelayMillis = (std::min)(options.DelayMillis, MAX_DELAY_MILLIS);
+	size_t delayFrames = GetDelayFrames(*pSource);
+	if (pSource->IsPrimed && delayFrames != previousDelayFrames) {
+		//A primed source already holds the old delay, so the difference is added as silence or skipped, right where the next block is read.
+		auto readPos = pSource->Pending.begin() + pSource->PendingOffset;
+		if (delayFrames > previousDelayFrames) {
+			pSource->Pending.insert(readPos, (delayFrames - previousDelayFrames) * m_FrameSamples, 0.0f);
+		}
+		else {
+			size_t skipSamples = (std::min)((previousDelayFrames - delayFrames) * m_FrameSamples, pSource->Pending.size() - pSource->PendingOffset);
+			pSource->Pending.erase(readPos, readPos + skipSamples);
+		}
+		pSource->Drift.ResetLatency();
+	}
+	return true;
+}
+
+bool AudioGraph::GetSourceOptions(int id, AUDIO_GRAPH_SOURCE_OPTIONS *pOptions) const
+{
+	const SOURCE *pSource = FindSource(id);
+	if (!pSource || !pOptions) {
+		return false;
+	}
+	*pOptions = pSource->Options;
+	return true;
+}
+
+bool AudioGraph::GetSourceSilenceStats(int id, AUDIO_SILENCE_STATS *pStats) const
+{
+	const SOURCE *pSource = FindSource(id);
+	if (!pSource || !pStats) {
+		return false;
+	}
+	*pStats = pSource->SilenceStats;
+	return true;
+}
+
+void AudioGraph::SetMeteringEnabled(bool isEnabled)
+{
+	if (isEnabled && !m_IsMeteringEnabled) {
+		for (SOURCE &source : m_Sources) {
+			source.Meter.Reset();
+		}
+	}
+	m_IsMeteringEnabled = isEnabled;
+}
+
+bool AudioGraph::ReadSourceLevels(int id, AUDIO_METER_READING *pReading)
+{
+	SOURCE *pSource = FindSource(id);
+	if (!pSource || !pReading) {
+		return false;
+	}
+	*pReading = pSource->Meter.Read();
+	return true;
+}
+
+bool AudioGraph::GetSourceStats(int id, AUDIO_DRIFT_STATS *pStats) const
+{
+	const SOURCE *pSource = FindSource(id);
+	if (!pSource || !pStats) {
+		return false;
+	}
+	*pStats = pSource->Drift.GetStats();
+	return true;
+}
+
+bool AudioGraph::PullFrames(size_t frameCount)
+{
+	m_PulledFrames = m_FrameSamples > 0 ? frameCount : 0;
+	bool isAudible = false;
+	for (SOURCE &source : m_Sources) {
+		ReadSource(source);
+		PullBlocks(source, m_PulledFrames);
+		for (const SOURCE_BLOCK &block : source.Blocks) {
+			isAudible |= block.IsAudible;
+		}
+	}
+	return isAudible;
+}
+
+void AudioGraph::MixFrames(float *pOutput)
+{
+	size_t blockIndex = 0;
+	for (size_t frameOffset = 0; frameOffset < m_PulledFrames; frameOffset += m_BlockFrames, blockIndex++) {
+		size_t blockFrames = (std::min)(m_BlockFrames, m_PulledFrames - frameOffset);
+		m_MixInputs.clear();
+		for (SOURCE &source : m_Sources) {
+			//A source added after the frames were pulled has no blocks.
+			if (blockIndex >= source.Blocks.size()) {
+				continue;
+			}
+			const SOURCE_BLOCK &block = source.Blocks[blockIndex];
+			const float *pSamples = source.Pending.data() + source.PendingOffset;
+			//Silent blocks are still consumed, so the source does not fall behind the timeline.
+			source.PendingOffset += block.Frames * m_FrameSamples;
+			if (!block.IsAudible) {
+				continue;
+			}
+			AUDIO_MIX_INPUT input;
+			input.Samples = pSamples;
+			//A source that ran short is padded with silence by the mixer.
+			input.SampleCount = block.Frames * m_Channels;
+			//The master gain is applied per source, which is the same as scaling the mix bus, but rounds only once.
+			input.Gain = source.Options.Gain * m_MasterGain;
+			m_MixInputs.push_back(input);
+		}
+		if (pOutput) {
+			m_Mixer.Mix(m_MixInputs.data(), m_MixInputs.size(), pOutput + frameOffset * m_Channels, blockFrames * m_Channels);
+		}
+	}
+	for (SOURCE &source : m_Sources) {
+		if (!source.Blocks.empty()) {
+			CompactPending(source);
+			UpdateDrift(source, m_PulledFrames);
+			source.Blocks.clear();
+		}
+	}
+	m_PulledFrames = 0;
+}
+
+void AudioGraph::Render(size_t frameCount, float *pOutput)
+{
+	if (frameCount == 0 || !pOutput || m_FrameSamples == 0) {
+		return;
+	}
+	if (!PullFrames(frameCount)) {
+		MixFrames(nullptr);
+		memset(pOutput, 0, frameCount * m_FrameSamples * sizeof(float));
+		return;
+	}
+	MixFrames(pOutput);
+}
+
+void AudioGraph::Clear()
+{
+	for (SOURCE &source : m_Sources) {
+		source.Pending.clear();
+		source.PendingOffset = 0;
+		source.IsPrimed = false;
+		source.Drift.ResetLatency();
+		source.NoiseGate.Reset();
+		source.GateGain = source.Options.NoiseGate.IsEnabled ? GATE_CLOSED_GAIN : GATE_OPEN_GAIN;
+		source.Blocks.clear();
+	}
+	m_PulledFrames = 0;
+}
+
+AudioGraph::SOURCE *AudioGraph::FindSource(int id)
+{
+	for (SOURCE &source : m_Sources) {
+		if (source.Id == id) {
+			return &source;
+		}
+	}
+	return nullptr;
+}
+
+const AudioGraph::SOURCE *AudioGraph::FindSource(int id) const
+{
+	for (const SOURCE &source : m_Sources) {
+		if (source.Id == id) {
+			return &source;
+		}
+	}
+	return nullptr;
+}
+
+size_t AudioGraph::GetDelayFrames(const SOURCE &source) const
+{
+	return static_cast<size_t>(m_SampleRate) * source.Options.DelayMillis / 1000;
+}
+
+void AudioGraph::ReadSource(SOURCE &source)
+{
+	source.Input->ReadAvailable(m_ReadBuffer);
+	source.DeliveredFrames = m_ReadBuffer.size() / m_FrameSamples;
+	if (source.DeliveredFrames == 0) {
+		return;
+	}
+	if (!source.IsPrimed) {
+		//Start the source with the target latency and its delay of silence, so capture jitter does not immediately cause an underrun.
+		source.Pending.assign((m_TargetLatencyFrames + GetDelayFrames(source)) * m_FrameSamples, 0.0f);
+		source.PendingOffset = 0;
+		source.Drift.ResetLatency();
+		source.IsPrimed = true;
+	}
+	source.Pending.insert(source.Pending.end(), m_ReadBuffer.begin(), m_ReadBuffer.begin() + source.DeliveredFrames * m_FrameSamples);
+}
+
+void AudioGraph::PullBlocks(SOURCE &source, size_t frameCount)
+{
+	source.Blocks.clear();
+	size_t pendingFrames = (source.Pending.size() - source.PendingOffset) / m_FrameSamples;
+	float *pSamples = source.Pending.data() + source.PendingOffset;
+	for (size_t frameOffset = 0; frameOffset < frameCount; frameOffset += m_BlockFrames) {
+		size_t blockFrames = (std::min)(m_BlockFrames, frameCount - frameOffset);
+		SOURCE_BLOCK block;
+		block.Frames = (std::min)(blockFrames, pendingFrames);
+		pendingFrames -= block.Frames;
+		if (block.Frames < blockFrames && source.IsPrimed) {
+			//A source that delivers nothing has stopped, e.g. a loopback device with nothing playing. That is silence, not an underrun.
+			if (source.DeliveredFrames > 0) {
+				source.Drift.AddUnderrun(blockFrames - block.Frames);
+			}
+			source.IsPrimed = false;
+		}
+		AUDIO_LEVELS levels;
+		if (block.Frames > 0 && (m_IsMeteringEnabled || !source.Options.IsMuted)) {
+			levels = m_Analyzer.Analyze(pSamples, block.Frames * m_Channels);
+		}
+		if (m_IsMeteringEnabled) {
+			source.Meter.Process(pSamples, block.Frames, levels);
+			source.Meter.ProcessSilence(blockFrames - block.Frames);
+		}
+		if (block.Frames > 0 && !source.Options.IsMuted) {
+			block.IsAudible = ApplyNoiseGate(source, pSamples, block.Frames, levels);
+		}
+		else {
+			source.SilenceStats.SilentFrames += blockFrames;
+		}
+		pSamples += block.Frames * m_FrameSamples;
+		source.Blocks.push_back(block);
+	}
+}
+
+bool AudioGraph::ApplyNoiseGate(SOURCE &source, float *pSamples, size_t frameCount, const AUDIO_LEVELS &levels)
+{
+	if (!source.Options.NoiseGate.IsEnabled) {
+		source.GateGain = GATE_OPEN_GAIN;
+	}
+	else {
+		float targetGain = source.NoiseGate.Process(levels, frameCount) ? GATE_OPEN_GAIN : GATE_CLOSED_GAIN;
+		if (targetGain != source.GateGain) {
+			//The gate fades over the block where it opens or closes, since switching the source on or off mid waveform would click.
+			for (size_t frame = 0; frame < frameCount; frame++) {
+				float gain = source.GateGain + (targetGain - source.GateGain) * (frame + 1) / frameCount;
+				for (size_t channel = 0; channel < m_Channels; channel++) {
+					pSamples[frame * m_Channels + channel] *= gain;
+				}
+			}
+			source.GateGain = targetGain;
+			source.SilenceStats.AudibleFrames += frameCount;
+			return true;
+		}
+		if (source.GateGain == GATE_CLOSED_GAIN) {
+			source.SilenceStats.GatedFrames += frameCount;
+			return false;
+		}
+	}
+	if (levels.IsSilent()) {
+		source.SilenceStats.SilentFrames += frameCount;
+		return false;
+	}
+	source.SilenceStats.AudibleFrames += frameCount;
+	return true;
+}
+
+void AudioGraph::CompactPending(SOURCE &source)
+{
+	source.Pending.erase(source.Pending.begin(), source.Pending.begin() + source.PendingOffset);
+	source.PendingOffset = 0;
+}
+
+void AudioGraph::UpdateDrift(SOURCE &source, size_t consumedFrames)
+{
+	if (!source.IsPrimed) {
+		return;
+	}
+	//The delay is a fixed offset on top of the target latency, so it is left out of the level the drift compensation sees.
+	size_t bufferedFrames = source.Pending.size() / m_FrameSamples;
+	size_t delayFrames = GetDelayFrames(source);
+	size_t latencyFrames = bufferedFrames > delayFrames ? bufferedFrames - delayFrames : 0;
+	if (latencyFrames > source.Drift.GetMaxLatencyFrames()) {
+		//The source delivered a backlog far larger than drift can explain, so skip ahead to the target latency instead of slowly resampling it away.
+		size_t droppedFrames = latencyFrames - source.Drift.GetTargetLatencyFrames();
+		source.Pending.erase(source.Pending.begin(), source.Pending.begin() + droppedFrames * m_FrameSamples);
+		source.Drift.AddDropped(droppedFrames);
+		source.Drift.ResetLatency();
+		latencyFrames -= droppedFrames;
+	}
+	source.Input->SetRateAdjustment(source.Drift.Update(latencyFrames, consumedFrames, source.DeliveredFrames));
+}
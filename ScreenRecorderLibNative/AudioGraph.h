@@ -0,0 +1,181 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "AudioMixer.h"
+#include "AudioTimeline.h"
+#include "AudioLevels.h"
+#include "AudioMeter.h"
+
+/// <summary>
+/// The pull side of an audio source feeding an AudioGraph, e.g. a capture device.
+/// The source is expected to queue audio on its own capture thread, and hand it over when the graph asks for it.
+/// </summary>
+class IAudioGraphInput
+{
+public:
+	virtual ~IAudioGraphInput() {}
+	/// <summary>
+	/// Replaces the contents of the vector with the audio delivered since the last call, as interleaved 32-bit float frames at the sample rate and channel count of the graph.
+	/// </summary>
+	virtual void ReadAvailable(std::vector<float> &output) = 0;
+	/// <summary>
+	/// Fine tunes the speed at which the source consumes its native audio to compensate for clock drift. Values above 1 deliver fewer frames.
+	/// Sources that cannot adjust their rate ignore this, and only get the coarse correction of dropped audio and underruns.
+	/// </summary>
+	virtual void SetRateAdjustment(double ratio) { (void)ratio; }
+};
+
+struct AUDIO_GRAPH_SOURCE_OPTIONS
+{
+	//Linear gain applied to the source before mixing.
+	float Gain = 1.0f;
+	//A muted source keeps being read, so its audio does not pile up, but is left out of the mix.
+	bool IsMuted = false;
+	//Delay applied to the source, to line it up with sources with a longer capture latency. At most 1 second.
+	uint32_t DelayMillis = 0;
+	//Leaves the source out of the mix while its level is below the threshold, e.g. the background noise of a microphone.
+	AUDIO_NOISE_GATE_OPTIONS NoiseGate;
+};
+
+struct AUDIO_SILENCE_STATS
+{
+	//Frames the source contributed to the mix.
+	uint64_t AudibleFrames = 0;
+	//Frames left out of the mix because they were digital silence, or because the source was muted or had no audio.
+	uint64_t SilentFrames = 0;
+	//Frames left out of the mix by the noise gate.
+	uint64_t GatedFrames = 0;
+};
+
+/// <summary>
+/// Mixes any number of audio sources onto the audio timeline.
+/// Each source gets a jitter buffer with drift compensation, and its own gain, mute and delay. The sources are summed on a mix bus with a master gain.
+/// Audio is analyzed and mixed in fixed size blocks, so the memory used does not depend on how much audio is requested at once.
+/// Each block of each source is flagged as audible or silent, and only audible blocks are mixed. If no block is audible, nothing needs to be mixed at all.
+/// The graph is not thread safe. The sources are expected to do the hand-off from their capture threads.
+/// </summary>
+class AudioGraph
+{
+public:
+	//An id no source has, for sources that were never added. Calls with it fail like calls with the id of a removed source.
+	static constexpr int INVALID_SOURCE_ID = 0;
+
+	AudioGraph();
+	/// <summary>
+	/// Sets the format of the graph. Existing sources are kept.
+	/// </summary>
+	/// <param name="sampleRate">The sample rate of the sources and the output</param>
+	/// <param name="channels">The channel count of the sources and the output</param>
+	/// <param name="targetLatencyMillis">The amount of audio buffered per source, as margin against capture jitter</param>
+	void Initialize(uint32_t sampleRate, uint32_t channels, uint32_t targetLatencyMillis);
+	/// <summary>
+	/// Adds a source to the mix. The graph does not take ownership of the input, which must outlive the graph or be removed first.
+	/// </summary>
+	/// <returns>The id of the source, or INVALID_SOURCE_ID if pInput is null</returns>
+	int AddSource(IAudioGraphInput *pInput, const AUDIO_GRAPH_SOURCE_OPTIONS &options = AUDIO_GRAPH_SOURCE_OPTIONS());
+	bool RemoveSource(int id);
+	bool SetSourceOptions(int id, const AUDIO_GRAPH_SOURCE_OPTIONS &options);
+	bool GetSourceOptions(int id, AUDIO_GRAPH_SOURCE_OPTIONS *pOptions) const;
+	bool GetSourceStats(int id, AUDIO_DRIFT_STATS *pStats) const;
+	bool GetSourceSilenceStats(int id, AUDIO_SILENCE_STATS *pStats) const;
+	/// <summary>
+	/// Turns level metering of the sources on or off. The sources are metered as they are captured, before gain, mute and the noise gate, so the meters show if a device picks up audio at all.
+	/// </summary>
+	void SetMeteringEnabled(bool isEnabled);
+	inline bool IsMeteringEnabled() const { return m_IsMeteringEnabled; }
+	/// <summary>
+	/// Returns the levels of the source since the previous call, and starts a new metering interval.
+	/// </summary>
+	bool ReadSourceLevels(int id, AUDIO_METER_READING *pReading);
+	inline size_t GetSourceCount() const { return m_Sources.size(); }
+	inline void SetMasterGain(float gain) { m_MasterGain = gain; }
+	inline float GetMasterGain() const { return m_MasterGain; }
+	inline size_t GetBlockFrames() const { return m_BlockFrames; }
+
+	/// <summary>
+	/// Reads all sources and analyzes the next frames, deciding for each block of each source if it is audible.
+	/// Must be followed by a call to MixFrames before the sources or their options are changed.
+	/// </summary>
+	/// <param name="frameCount">The number of frames to pull</param>
+	/// <returns>true if any source is audible in the pulled frames, false if they are all silence</returns>
+	bool PullFrames(size_t frameCount);
+	/// <summary>
+	/// Mixes the pulled frames into pOutput. Sources without enough audio are padded with silence.
+	/// The mix is not clipped, so it can exceed full scale until it is converted to the output format.
+	/// </summary>
+	/// <param name="pOutput">The destination, with room for the pulled number of interleaved frames. If nullptr, the pulled frames are discarded, e.g. because they are silent.</param>
+	void MixFrames(float *pOutput);
+	/// <summary>
+	/// Pulls and mixes the given number of frames into pOutput, writing zeros if they are silent.
+	/// </summary>
+	void Render(size_t frameCount, float *pOutput);
+	/// <summary>
+	/// Discards the audio buffered for all sources, e.g. when the recording is paused. The sources are primed again when audio arrives.
+	/// </summary>
+	void Clear();
+
+private:
+	//The length of the blocks the sources are mixed in.
+	static constexpr uint32_t BLOCK_MILLIS = 10;
+	static constexpr uint32_t MAX_DELAY_MILLIS = 1000;
+
+	//Linear gain of the noise gate while it is open, closed, and fading between the two over one block.
+	static constexpr float GATE_OPEN_GAIN = 1.0f;
+	static constexpr float GATE_CLOSED_GAIN = 0.0f;
+
+	struct SOURCE_BLOCK
+	{
+		//The frames of the block the source has audio for. The rest of the block is silence.
+		size_t Frames = 0;
+		bool IsAudible = false;
+	};
+
+	struct SOURCE
+	{
+		int Id = 0;
+		IAudioGraphInput *Input = nullptr;
+		AUDIO_GRAPH_SOURCE_OPTIONS Options;
+		//Audio read from the input and not yet mixed, including the silence of the delay.
+		std::vector<float> Pending;
+		//Read offset in Pending in samples, to avoid moving the buffer for every block.
+		size_t PendingOffset = 0;
+		AudioDriftCompensator Drift;
+		//True once the source holds the target latency of audio. Cleared when the input stops delivering audio.
+		bool IsPrimed = false;
+		//The frames read from the input for the current render.
+		size_t DeliveredFrames = 0;
+		AudioNoiseGate NoiseGate;
+		float GateGain = GATE_CLOSED_GAIN;
+		//The blocks of the pulled frames.
+		std::vector<SOURCE_BLOCK> Blocks;
+		AUDIO_SILENCE_STATS SilenceStats;
+		AudioLevelMeter Meter;
+	};
+
+	uint32_t m_SampleRate;
+	uint32_t m_Channels;
+	//The number of samples in a frame, i.e. the channel count, or 0 before the graph is initialized.
+	size_t m_FrameSamples;
+	size_t m_BlockFrames;
+	size_t m_TargetLatencyFrames;
+	float m_MasterGain;
+	bool m_IsMeteringEnabled;
+	int m_NextId;
+	std::vector<SOURCE> m_Sources;
+	AudioMixer m_Mixer;
+	AudioLevelAnalyzer m_Analyzer;
+	//The number of frames pulled and not yet mixed.
+	size_t m_PulledFrames;
+	std::vector<float> m_ReadBuffer;
+	std::vector<AUDIO_MIX_INPUT> m_MixInputs;
+
+	SOURCE *FindSource(int id);
+	const SOURCE *FindSource(int id) const;
+	size_t GetDelayFrames(const SOURCE &source) const;
+	void ReadSource(SOURCE &source);
+	void PullBlocks(SOURCE &source, size_t frameCount);
+	bool ApplyNoiseGate(SOURCE &source, float *pSamples, size_t frameCount, const AUDIO_LEVELS &levels);
+	void CompactPending(SOURCE &source);
+	void UpdateDrift(SOURCE &source, size_t consumedFrames);
+};
@@ -0,0 +1,180 @@
+#include "AudioLevels.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#if CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+	void AnalyzeScalar(const float *pSamples, size_t count, float *pPeak, double *pSumOfSquares) {
+		float peak = *pPeak;
+		double sumOfSquares = *pSumOfSquares;
+		for (size_t i = 0; i < count; i++) {
+			float magnitude = std::fabs(pSamples[i]);
+			peak = (std::max)(peak, magnitude);
+			sumOfSquares += static_cast<double>(pSamples[i]) * pSamples[i];
+		}
+		*pPeak = peak;
+		*pSumOfSquares = sumOfSquares;
+	}
+
+#if CPU_FEATURES_X86
+	void AnalyzeSSE2(const float *pSamples, size_t count, float *pPeak, double *pSumOfSquares) {
+		//Clearing the sign bit gives the magnitude.
+		const __m128 signMask = _mm_castsi128_ps(_mm_set1_epi32(0x7FFFFFFF));
+		__m128 vPeak = _mm_setzero_ps();
+		__m128d vSum = _mm_setzero_pd();
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128 samples = _mm_loadu_ps(pSamples + i);
+			vPeak = _mm_max_ps(vPeak, _mm_and_ps(samples, signMask));
+			//The squares are summed in double, so long blocks of quiet audio next to loud audio do not lose precision.
+			__m128d low = _mm_cvtps_pd(samples);
+			__m128d high = _mm_cvtps_pd(_mm_movehl_ps(samples, samples));
+			vSum = _mm_add_pd(vSum, _mm_add_pd(_mm_mul_pd(low, low), _mm_mul_pd(high, high)));
+		}
+		float peaks[4];
+		double sums[2];
+		_mm_storeu_ps(peaks, vPeak);
+		_mm_storeu_pd(sums, vSum);
+		float peak = *pPeak;
+		for (int lane = 0; lane < 4; lane++) {
+			peak = (std::max)(peak, peaks[lane]);
+		}
+		*pPeak = peak;
+		*pSumOfSquares += sums[0] + sums[1];
+		AnalyzeScalar(pSamples + i, count - i, pPeak, pSumOfSquares);
+	}
+
+	TARGET_AVX2 void AnalyzeAVX2(const float *pSamples, size_t count, float *pPeak, double *pSumOfSquares) {
+		const __m256 signMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7FFFFFFF));
+		__m256 vPeak = _mm256_setzero_ps();
+		__m256d vSum = _mm256_setzero_pd();
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256 samples = _mm256_loadu_ps(pSamples + i);
+			vPeak = _mm256_max_ps(vPeak, _mm256_and_ps(samples, signMask));
+			__m256d low = _mm256_cvtps_pd(_mm256_castps256_ps128(samples));
+			__m256d high = _mm256_cvtps_pd(_mm256_extractf128_ps(samples, 1));
+			vSum = _mm256_add_pd(vSum, _mm256_add_pd(_mm256_mul_pd(low, low), _mm256_mul_pd(high, high)));
+		}
+		float peaks[8];
+		double sums[4];
+		_mm256_storeu_ps(peaks, vPeak);
+		_mm256_storeu_pd(sums, vSum);
+		_mm256_zeroupper();
+		float peak = *pPeak;
+		for (int lane = 0; lane < 8; lane++) {
+			peak = (std::max)(peak, peaks[lane]);
+		}
+		*pPeak = peak;
+		*pSumOfSquares += sums[0] + sums[1] + sums[2] + sums[3];
+		AnalyzeScalar(pSamples + i, count - i, pPeak, pSumOfSquares);
+	}
+#endif
+}
+
+AudioLevelAnalyzer::AudioLevelAnalyzer() :
+	AudioLevelAnalyzer(AudioMixer::GetBestSupportedKernel())
+{
+}
+
+AudioLevelAnalyzer::AudioLevelAnalyzer(AudioMixerKernel kernel) :
+	m_Kernel(AudioMixerKernel::Scalar),
+	m_Analyze(AnalyzeScalar)
+{
+	if (!AudioMixer::IsKernelSupported(kernel)) {
+		kernel = AudioMixer::GetBestSupportedKernel();
+	}
+	m_Kernel = kernel;
+#if CPU_FEATURES_X86
+	switch (kernel)
+	{
+		case AudioMixerKernel::AVX2:
+			m_Analyze = AnalyzeAVX2;
+			break;
+		case AudioMixerKernel::SSE2:
+			m_Analyze = AnalyzeSSE2;
+			break;
+		default:
+			break;
+	}
+#endif
+}
+
+AUDIO_LEVELS AudioLevelAnalyzer::Analyze(const float *pSamples, size_t sampleCount) const
+{
+	AUDIO_LEVELS levels;
+	if (!pSamples || sampleCount == 0) {
+		return levels;
+	}
+	float peak = 0;
+	double sumOfSquares = 0;
+	m_Analyze(pSamples, sampleCount, &peak, &sumOfSquares);
+	levels.Peak = peak;
+	levels.Rms = static_cast<float>(std::sqrt(sumOfSquares / sampleCount));
+	return levels;
+}
+
+float AudioLevelAnalyzer::ToDecibels(float level)
+{
+	if (level <= 0) {
+		return MIN_DECIBELS;
+	}
+	return (std::max)(MIN_DECIBELS, 20.0f * std::log10(level));
+}
+
+float AudioLevelAnalyzer::FromDecibels(float decibels)
+{
+	if (decibels <= MIN_DECIBELS) {
+		return 0;
+	}
+	return std::pow(10.0f, decibels / 20.0f);
+}
+
+AudioNoiseGate::AudioNoiseGate() :
+	m_Options{},
+	m_OpenLevel(0),
+	m_CloseLevel(0),
+	m_HoldFrames(0),
+	m_FramesBelowThreshold(0),
+	m_IsOpen(false)
+{
+}
+
+void AudioNoiseGate::Initialize(uint32_t sampleRate, const AUDIO_NOISE_GATE_OPTIONS &options)
+{
+	m_Options = options;
+	m_OpenLevel = AudioLevelAnalyzer::FromDecibels(options.ThresholdDb);
+	m_CloseLevel = AudioLevelAnalyzer::FromDecibels(options.ThresholdDb - (std::max)(0.0f, options.HysteresisDb));
+	m_HoldFrames = static_cast<uint64_t>(sampleRate) * options.HoldMillis / 1000;
+	Reset();
+}
+
+bool AudioNoiseGate::Process(const AUDIO_LEVELS &levels, size_t frameCount)
+{
+	if (!m_Options.IsEnabled) {
+		return true;
+	}
+	if (levels.Rms >= m_OpenLevel) {
+		m_IsOpen = true;
+		m_FramesBelowThreshold = 0;
+	}
+	else if (m_IsOpen && levels.Rms < m_CloseLevel) {
+		m_FramesBelowThreshold += frameCount;
+		if (m_FramesBelowThreshold > m_HoldFrames) {
+			m_IsOpen = false;
+		}
+	}
+	else {
+		m_FramesBelowThreshold = 0;
+	}
+	return m_IsOpen;
+}
+
+void AudioNoiseGate::Reset()
+{
+	m_IsOpen = false;
+	m_FramesBelowThreshold = 0;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "AudioMixer.h"
+
+/// <summary>
+/// Signal levels of a block of audio, relative to full scale.
+/// </summary>
+struct AUDIO_LEVELS
+{
+	//The largest absolute sample value, with full scale at 1. Float audio can exceed full scale until it is converted to the output format.
+	float Peak = 0;
+	//The root mean square of the samples. A full scale sine wave has an RMS of 0.707.
+	float Rms = 0;
+	//True if every sample is zero.
+	inline bool IsSilent() const { return Peak == 0; }
+};
+
+/// <summary>
+/// Computes peak and RMS levels of interleaved 32-bit float audio, using the widest SIMD kernel the CPU supports.
+/// </summary>
+class AudioLevelAnalyzer
+{
+public:
+	AudioLevelAnalyzer();
+	explicit AudioLevelAnalyzer(AudioMixerKernel kernel);
+	/// <summary>
+	/// Returns the levels over all samples, regardless of channel.
+	/// </summary>
+	AUDIO_LEVELS Analyze(const float *pSamples, size_t sampleCount) const;
+	inline AudioMixerKernel GetKernel() const { return m_Kernel; }
+
+	/// <summary>
+	/// Converts a linear level, with full scale at 1, to decibels relative to full scale. Returns MIN_DECIBELS for silence.
+	/// </summary>
+	static float ToDecibels(float level);
+	static float FromDecibels(float decibels);
+	static constexpr float MIN_DECIBELS = -120.0f;
+
+private:
+	//Computes the largest absolute sample value and the sum of the squared samples.
+	typedef void(*AnalyzeFunction)(const float *pSamples, size_t count, float *pPeak, double *pSumOfSquares);
+
+	AudioMixerKernel m_Kernel;
+	AnalyzeFunction m_Analyze;
+};
+
+struct AUDIO_NOISE_GATE_OPTIONS
+{
+	bool IsEnabled = false;
+	//The RMS level in dBFS at which the gate opens.
+	float ThresholdDb = -50.0f;
+	//How far the level must fall below the threshold before the gate closes, so noise around the threshold does not make the gate flutter.
+	float HysteresisDb = 6.0f;
+	//How long the level must stay below the closing threshold before the gate closes, so pauses between words are not cut.
+	uint32_t HoldMillis = 300;
+};
+
+/// <summary>
+/// Noise gate deciding per block of audio if a source is audible.
+/// The gate only decides, the caller applies it, e.g. by leaving the source out of the mix while it is closed.
+/// </summary>
+class AudioNoiseGate
+{
+public:
+	AudioNoiseGate();
+	void Initialize(uint32_t sampleRate, const AUDIO_NOISE_GATE_OPTIONS &options);
+	/// <summary>
+	/// Feeds the levels of the next block and returns true if the gate is open for it. A disabled gate is always open.
+	/// </summary>
+	/// <param name="levels">The levels of the block</param>
+	/// <param name="frameCount">The length of the block</param>
+	bool Process(const AUDIO_LEVELS &levels, size_t frameCount);
+	/// <summary>
+	/// Closes the gate, e.g. after the source stopped delivering audio.
+	/// </summary>
+	void Reset();
+	inline bool IsOpen() const { return m_IsOpen; }
+	inline const AUDIO_NOISE_GATE_OPTIONS &GetOptions() const { return m_Options; }
+
+private:
+	AUDIO_NOISE_GATE_OPTIONS m_Options;
+	float m_OpenLevel;
+	float m_CloseLevel;
+	uint64_t m_HoldFrames;
+	uint64_t m_FramesBelowThreshold;
+	bool m_IsOpen;
+};
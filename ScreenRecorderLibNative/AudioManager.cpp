@@ -3,28 +3,76 @@
 
 using namespace std;
 AudioManager::AudioManager() :
-	m_AudioOptions(nullptr)
+	m_AudioOptions(nullptr),
+	m_Graph(),
+	m_OutputDeviceSourceId(0),
+	m_InputDeviceSourceId(0),
+	m_AdditionalSourceIds{},
+	m_AudioFrameCount(0),
+	m_SilentAudioFrameCount(0),
+	m_ClippedSampleCount(0),
+	m_BufferPool(AudioBufferPool::Create()),
+	m_MixBuffer{},
+	m_SinkConverter(),
+	m_MixMeter(),
+	m_IsMeteringEnabled(false),
+	m_HasLevelsReport(false),
+	m_LevelsReport{}
 {
 	InitializeCriticalSection(&m_CriticalSection);
 }
 
 AudioManager::~AudioManager()
 {
+	if (m_ClippedSampleCount > 0) {
+		LOG_WARN("Audio clipped, %llu samples in total", m_ClippedSampleCount);
+	}
+	if (m_LoopbackCaptureOutputDevice) {
+		LogDriftStats(L"AudioOutputDevice", m_OutputDeviceSourceId);
+	}
+	if (m_LoopbackCaptureInputDevice) {
+		LogDriftStats(L"AudioInputDevice", m_InputDeviceSourceId);
+	}
+	for (size_t i = 0; i < m_AdditionalSourceIds.size(); i++) {
+		if (m_AdditionalSourceIds[i] != AudioGraph::INVALID_SOURCE_ID) {
+			LogDriftStats(L"AudioSource" + to_wstring(i + 1), m_AdditionalSourceIds[i]);
+		}
+	}
+	AUDIO_BUFFER_POOL_STATS stats = m_BufferPool->GetStats();
+	LOG_DEBUG("Audio buffer pool: %llu buffers used, %llu allocated", stats.AcquireCount, stats.AllocationCount);
+	LOG_DEBUG("Audio frames: %llu written, %llu silent, %llu silent frames materialized by the encoder", m_AudioFrameCount, m_SilentAudioFrameCount, stats.MaterializedCount);
 	DeleteCriticalSection(&m_CriticalSection);
 }
 
 HRESULT AudioManager::Initialize(_In_ std::shared_ptr<AUDIO_OPTIONS> &audioOptions)
 {
 	m_AudioOptions = audioOptions;
-	return InitializeAudioCapture();
+	UINT32 sampleRate = GetAudioOptions()->GetAudioSamplesPerSecond();
+	m_Timeline.Initialize(sampleRate);
+	m_Graph.Initialize(sampleRate, GetAudioOptions()->GetAudioChannels(), TARGET_LATENCY_MILLIS);
+	m_IsMeteringEnabled = GetAudioOptions()->IsAudioLevelMeteringEnabled();
+	m_MixMeter.Initialize(sampleRate, GetAudioOptions()->GetAudioChannels(), GetAudioOptions()->GetAudioLevelMeteringInterval());
+	m_SinkConverter.SetDitherEnabled(GetAudioOptions()->IsAudioDitherEnabled());
+	m_Graph.SetMeteringEnabled(m_IsMeteringEnabled);
+	HRESULT hr = InitializeAudioCapture();
+	InitializeAdditionalSources();
+	return hr;
 }
 
 void AudioManager::ClearRecordedBytes()
 {
+	//The buffers are read by GrabAudioFrame, which can run on the write stage of the frame pipeline, so clearing them must not overlap it.
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
 	if (m_LoopbackCaptureOutputDevice)
 		m_LoopbackCaptureOutputDevice->ClearRecordedBytes();
 	if (m_LoopbackCaptureInputDevice)
 		m_LoopbackCaptureInputDevice->ClearRecordedBytes();
+	for (unique_ptr<LoopbackCapture> &capture : m_AdditionalCaptures) {
+		capture->ClearRecordedBytes();
+	}
+	//The timeline does not move while paused, so the buffered audio is stale. The sources are primed again when audio arrives.
+	m_Graph.Clear();
 }
 
 HRESULT AudioManager::InitializeAudioCapture()
@@ -34,6 +82,7 @@ HRESULT AudioManager::InitializeAudioCapture()
 	{
 		if (!m_LoopbackCaptureOutputDevice) {
 			m_LoopbackCaptureOutputDevice = make_unique<LoopbackCapture>(L"AudioOutputDevice");
+			m_OutputDeviceSourceId = m_Graph.AddSource(m_LoopbackCaptureOutputDevice.get());
 			LOG_DEBUG("Created audio capture AudioOutputDevice");
 		}
 		if (!m_LoopbackCaptureOutputDevice->IsCapturing()) {
@@ -54,6 +103,7 @@ HRESULT AudioManager::InitializeAudioCapture()
 	{
 		if (!m_LoopbackCaptureInputDevice) {
 			m_LoopbackCaptureInputDevice = make_unique<LoopbackCapture>(L"AudioInputDevice");
+			m_InputDeviceSourceId = m_Graph.AddSource(m_LoopbackCaptureInputDevice.get());
 			LOG_DEBUG("Created audio capture AudioInputDevice");
 		}
 		if (!m_LoopbackCaptureInputDevice->IsCapturing()) {
@@ -72,70 +122,164 @@ HRESULT AudioManager::InitializeAudioCapture()
 	return hr;
 }
 
-std::vector<BYTE> AudioManager::GrabAudioFrame()
+HRESULT AudioManager::InitializeAdditionalSources()
 {
-	EnterCriticalSection(&m_CriticalSection);
-	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
-	if (m_AudioOptions) {
-		InitializeAudioCapture();
+	if (!GetAudioOptions()->IsAudioEnabled() || !m_AdditionalSourceIds.empty()) {
+		return S_FALSE;
 	}
-	if (m_LoopbackCaptureOutputDevice && m_LoopbackCaptureInputDevice) {
-
-		auto returnAudioOverflowToBuffer = [&](auto &outputDeviceData, auto &inputDeviceData) {
-			if (outputDeviceData.size() > 0 && inputDeviceData.size() > 0) {
-				if (outputDeviceData.size() > inputDeviceData.size()) {
-					auto diff = outputDeviceData.size() - inputDeviceData.size();
-					std::vector<BYTE> overflow(outputDeviceData.end() - diff, outputDeviceData.end());
-					outputDeviceData.resize(outputDeviceData.size() - diff);
-					m_LoopbackCaptureOutputDevice->ReturnAudioBytesToBuffer(overflow);
-				}
-				else if (inputDeviceData.size() > outputDeviceData.size()) {
-					auto diff = inputDeviceData.size() - outputDeviceData.size();
-					std::vector<BYTE> overflow(inputDeviceData.end() - diff, inputDeviceData.end());
-					inputDeviceData.resize(inputDeviceData.size() - diff);
-					m_LoopbackCaptureInputDevice->ReturnAudioBytesToBuffer(overflow);
-				}
-			}
-		};
-
-		std::vector<BYTE> outputDeviceData = m_LoopbackCaptureOutputDevice->GetRecordedBytes();
-		std::vector<BYTE> inputDeviceData = m_LoopbackCaptureInputDevice->GetRecordedBytes();
-		returnAudioOverflowToBuffer(outputDeviceData, inputDeviceData);
-		if (inputDeviceData.size() > 0 && outputDeviceData.size() && inputDeviceData.size() != outputDeviceData.size()) {
-			LOG_ERROR(L"Mixing audio byte arrays with differing sizes");
+	HRESULT hr = S_FALSE;
+	//Additional sources are captured for the whole recording. A source that fails to start is left out, so one unplugged device does not stop the recording.
+	for (AUDIO_SOURCE const &source : GetAudioOptions()->GetAdditionalSources()) {
+		wstring tag = L"AudioSource" + to_wstring(m_AdditionalSourceIds.size() + 1);
+		unique_ptr<LoopbackCapture> capture = make_unique<LoopbackCapture>(tag);
+		hr = capture->StartCapture(GetAudioOptions()->GetAudioSamplesPerSecond(), GetAudioOptions()->GetAudioChannels(), source.DeviceName, source.IsLoopback ? eRender : eCapture);
+		if (FAILED(hr)) {
+			LOG_ERROR(L"Failed to start audio capture on %ls, device %ls: hr = 0x%08x", tag.c_str(), source.DeviceName.c_str(), hr);
+			m_AdditionalSourceIds.push_back(AudioGraph::INVALID_SOURCE_ID);
+			continue;
+		}
+		AUDIO_GRAPH_SOURCE_OPTIONS options;
+		options.Gain = source.Volume;
+		options.IsMuted = source.IsMuted;
+		options.DelayMillis = source.DelayMillis;
+		if (!source.IsLoopback) {
+			options.NoiseGate = GetInputNoiseGateOptions();
 		}
+		m_AdditionalSourceIds.push_back(m_Graph.AddSource(capture.get(), options));
+		m_AdditionalCaptures.push_back(move(capture));
+		LOG_DEBUG(L"Started audio capture on %ls", tag.c_str());
+	}
+	return hr;
+}
 
-		return std::move(MixAudio(outputDeviceData, inputDeviceData, GetAudioOptions()->GetOutputVolume(), GetAudioOptions()->GetInputVolume()));
-	}
-	else if (m_LoopbackCaptureOutputDevice)
-		return std::move(MixAudio(m_LoopbackCaptureOutputDevice->GetRecordedBytes(), std::vector<BYTE>(), GetAudioOptions()->GetOutputVolume(), 1.0));
-	else if (m_LoopbackCaptureInputDevice)
-		return std::move(MixAudio(std::vector<BYTE>(), m_LoopbackCaptureInputDevice->GetRecordedBytes(), 1.0, GetAudioOptions()->GetInputVolume()));
-	else
-		return std::vector<BYTE>();
+void AudioManager::UpdateSourceOptions()
+{
+	//Volumes of the default devices can change while recording.
+	AUDIO_GRAPH_SOURCE_OPTIONS options;
+	if (m_LoopbackCaptureOutputDevice) {
+		options.Gain = GetAudioOptions()->GetOutputVolume();
+		options.DelayMillis = GetAudioOptions()->GetOutputDelay();
+		m_Graph.SetSourceOptions(m_OutputDeviceSourceId, options);
+	}
+	if (m_LoopbackCaptureInputDevice) {
+		options.Gain = GetAudioOptions()->GetInputVolume();
+		options.DelayMillis = GetAudioOptions()->GetInputDelay();
+		options.NoiseGate = GetInputNoiseGateOptions();
+		m_Graph.SetSourceOptions(m_InputDeviceSourceId, options);
+	}
+}
+
+AUDIO_NOISE_GATE_OPTIONS AudioManager::GetInputNoiseGateOptions()
+{
+	//The noise gate is meant for the background noise of microphones, so it only applies to input devices.
+	AUDIO_NOISE_GATE_OPTIONS gate;
+	gate.IsEnabled = GetAudioOptions()->IsNoiseGateEnabled();
+	gate.ThresholdDb = GetAudioOptions()->GetNoiseGateThreshold();
+	return gate;
 }
 
-std::vector<BYTE> AudioManager::MixAudio(_In_ std::vector<BYTE> const &first, _In_ std::vector<BYTE> const &second, _In_ float firstVolume, _In_ float secondVolume)
+AudioBufferRef AudioManager::GrabAudioFrame(_In_ INT64 frameEndPos100Nanos)
 {
-	std::vector<BYTE> newvector(max(first.size(), second.size()));
-	bool clipped = false;
-	for (size_t i = 0; i < newvector.size(); i += 2) {
-		short firstSample = first.size() > i + 1 ? static_cast<short>(first[i] | first[i + 1] << 8) : 0;
-		short secondSample = second.size() > i + 1 ? static_cast<short>(second[i] | second[i + 1] << 8) : 0;
-		auto out = reinterpret_cast<short *>(&newvector[i]);
-		int mixedSample = int(round((firstSample)*firstVolume + (secondSample)*secondVolume));
-		if (mixedSample > MAXSHORT) {
-			clipped = true;
-			mixedSample = MAXSHORT;
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (!m_AudioOptions || !GetAudioOptions()->IsAudioEnabled()) {
+		return AudioBufferRef();
+	}
+	InitializeAudioCapture();
+	UpdateSourceOptions();
+	size_t frameCount = m_Timeline.Advance(frameEndPos100Nanos);
+	if (frameCount == 0) {
+		return AudioBufferRef();
+	}
+	size_t byteCount = frameCount * GetAudioOptions()->GetAudioChannels() * GetAudioOptions()->GetAudioBitsPerSample() / 8;
+	m_AudioFrameCount++;
+	//With no sources, or sources that have no audio, the frame gets silence so the media sink does not stall waiting for audio.
+	//The silence is only passed on as its length, and is not written out as zeros until the encoder reads it.
+	if (!m_Graph.PullFrames(frameCount)) {
+		m_Graph.MixFrames(nullptr);
+		UpdateLevels(nullptr, frameCount);
+		m_SilentAudioFrameCount++;
+		AudioBufferRef silence = m_BufferPool->AcquireSilence(byteCount);
+		if (!silence) {
+			LOG_ERROR(L"Failed to allocate silent audio buffer");
 		}
-		else if (mixedSample < -MAXSHORT) {
-			clipped = true;
-			mixedSample = -MAXSHORT;
+		return silence;
+	}
+	size_t sampleCount = frameCount * GetAudioOptions()->GetAudioChannels();
+	m_MixBuffer.resize(sampleCount);
+	m_Graph.MixFrames(m_MixBuffer.data());
+	UpdateLevels(m_MixBuffer.data(), frameCount);
+	//The mix is converted straight into the buffer that is handed to the media sink.
+	AudioBufferRef buffer = m_BufferPool->Acquire(byteCount);
+	if (!buffer) {
+		LOG_ERROR(L"Failed to allocate %zu byte audio buffer", byteCount);
+		return AudioBufferRef();
+	}
+	size_t clippedSamples = m_SinkConverter.ToInt16(m_MixBuffer.data(), sampleCount, reinterpret_cast<int16_t *>(buffer->GetData()));
+	if (clippedSamples > 0) {
+		m_ClippedSampleCount += clippedSamples;
+		LOG_TRACE("Audio clipped, %zu samples", clippedSamples);
+	}
+	return buffer;
+}
+
+void AudioManager::UpdateLevels(_In_opt_ const float *pMix, _In_ size_t frameCount)
+{
+	if (!m_IsMeteringEnabled) {
+		return;
+	}
+	m_MixMeter.Process(pMix, frameCount);
+	if (!m_MixMeter.IsReadingDue()) {
+		return;
+	}
+	//A report that was not taken yet is replaced, so a slow consumer only ever sees the latest levels.
+	m_LevelsReport.Mix = m_MixMeter.Read();
+	m_LevelsReport.HasOutputDevice = m_LoopbackCaptureOutputDevice && m_Graph.ReadSourceLevels(m_OutputDeviceSourceId, &m_LevelsReport.OutputDevice);
+	m_LevelsReport.HasInputDevice = m_LoopbackCaptureInputDevice && m_Graph.ReadSourceLevels(m_InputDeviceSourceId, &m_LevelsReport.InputDevice);
+	m_LevelsReport.HasAdditionalSources.resize(m_AdditionalSourceIds.size());
+	m_LevelsReport.AdditionalSources.resize(m_AdditionalSourceIds.size());
+	for (size_t i = 0; i < m_AdditionalSourceIds.size(); i++) {
+		bool hasSource = m_AdditionalSourceIds[i] != AudioGraph::INVALID_SOURCE_ID && m_Graph.ReadSourceLevels(m_AdditionalSourceIds[i], &m_LevelsReport.AdditionalSources[i]);
+		m_LevelsReport.HasAdditionalSources[i] = hasSource;
+		if (!hasSource) {
+			m_LevelsReport.AdditionalSources[i] = AUDIO_METER_READING();
 		}
-		*out = (short)mixedSample;
 	}
-	if (clipped) {
-		LOG_WARN("Audio clipped during mixing");
+	m_HasLevelsReport = true;
+}
+
+bool AudioManager::GetAudioLevels(_Out_ AUDIO_LEVELS_REPORT *pReport)
+{
+	EnterCriticalSection(&m_CriticalSection);
+	LeaveCriticalSectionOnExit leaveOnExit(&m_CriticalSection);
+	if (!m_HasLevelsReport || !pReport) {
+		return false;
+	}
+	*pReport = m_LevelsReport;
+	m_HasLevelsReport = false;
+	return true;
+}
+
+AUDIO_DRIFT_STATS AudioManager::GetOutputDeviceDriftStats()
+{
+	AUDIO_DRIFT_STATS stats{};
+	m_Graph.GetSourceStats(m_OutputDeviceSourceId, &stats);
+	return stats;
+}
+
+AUDIO_DRIFT_STATS AudioManager::GetInputDeviceDriftStats()
+{
+	AUDIO_DRIFT_STATS stats{};
+	m_Graph.GetSourceStats(m_InputDeviceSourceId, &stats);
+	return stats;
+}
+
+void AudioManager::LogDriftStats(_In_ std::wstring tag, _In_ int sourceId)
+{
+	AUDIO_DRIFT_STATS stats{};
+	if (!m_Graph.GetSourceStats(sourceId, &stats)) {
+		return;
 	}
-	return newvector;
-}
\ No newline at end of file
+	LOG_INFO(L"Audio clock for %ls: drift %.1f ppm, latency %.1f ms (max error %.1f ms), %llu frames of underrun, %llu frames dropped",
+		tag.c_str(), stats.DriftPpm, stats.LatencyMillis, stats.MaxLatencyErrorMillis, stats.UnderrunFrames, stats.DroppedFrames);
+}
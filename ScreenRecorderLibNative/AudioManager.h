@@ -1,7 +1,29 @@
 #pragma once
 #include <vector>
 #include "LoopbackCapture.h"
+#include "AudioGraph.h"
+#include "AudioBufferPool.h"
+#include "AudioTimeline.h"
+#include "AudioMeter.h"
+#include "AudioSampleConverter.h"
 #include "CommonTypes.h"
+
+/// <summary>
+/// The audio levels of a recording over one metering interval.
+/// </summary>
+struct AUDIO_LEVELS_REPORT
+{
+	//The levels of the mix written to the recording.
+	AUDIO_METER_READING Mix{};
+	bool HasOutputDevice = false;
+	AUDIO_METER_READING OutputDevice{};
+	bool HasInputDevice = false;
+	AUDIO_METER_READING InputDevice{};
+	//The levels of the additional sources, in the order they were configured, and whether each source is recorded. Sources that failed to start have no levels.
+	std::vector<bool> HasAdditionalSources{};
+	std::vector<AUDIO_METER_READING> AdditionalSources{};
+};
+
 class AudioManager
 {
 public:
@@ -9,15 +31,58 @@ public:
 	~AudioManager();
 	HRESULT Initialize(_In_ std::shared_ptr<AUDIO_OPTIONS> &audioOptions);
 	void ClearRecordedBytes();
-	std::vector<BYTE> GrabAudioFrame();
+	/// <summary>
+	/// Returns the mixed audio from all enabled devices and additional sources for the video timeline up to the given position, i.e. the end of the frame being written.
+	/// The audio is exactly as long as the time since the end of the previous call, filled with silence where the devices have no audio.
+	/// </summary>
+	AudioBufferRef GrabAudioFrame(_In_ INT64 frameEndPos100Nanos);
+	AUDIO_DRIFT_STATS GetOutputDeviceDriftStats();
+	AUDIO_DRIFT_STATS GetInputDeviceDriftStats();
+	/// <summary>
+	/// The total number of samples clipped when converting the mix to the output format since the recording started.
+	/// </summary>
+	inline UINT64 GetClippedSampleCount() { return m_ClippedSampleCount; }
+	/// <summary>
+	/// Takes the audio levels of the last completed metering interval, if level metering is enabled.
+	/// </summary>
+	/// <returns>true if a new report was available since the previous call</returns>
+	bool GetAudioLevels(_Out_ AUDIO_LEVELS_REPORT *pReport);
 private:
 	CRITICAL_SECTION m_CriticalSection;
 	std::shared_ptr<AUDIO_OPTIONS> m_AudioOptions;
 	std::unique_ptr<LoopbackCapture> m_LoopbackCaptureOutputDevice;
 	std::unique_ptr<LoopbackCapture> m_LoopbackCaptureInputDevice;
+	std::vector<std::unique_ptr<LoopbackCapture>> m_AdditionalCaptures;
+	//The graph only references the captures, so it is declared after them and destroyed first.
+	AudioGraph m_Graph;
+	int m_OutputDeviceSourceId;
+	int m_InputDeviceSourceId;
+	//The graph ids of the additional sources, in the order they were configured. AudioGraph::INVALID_SOURCE_ID for sources that failed to start.
+	std::vector<int> m_AdditionalSourceIds;
+	//The number of audio frames written, and how many of those were silent and never materialized.
+	UINT64 m_AudioFrameCount;
+	UINT64 m_SilentAudioFrameCount;
+	UINT64 m_ClippedSampleCount;
+	std::shared_ptr<AudioBufferPool> m_BufferPool;
+	AudioTimeline m_Timeline;
+	//The mix is kept in float, and converted to the output format once, when it is written to the buffer for the media sink.
+	std::vector<float> m_MixBuffer;
+	AudioSampleConverter m_SinkConverter;
+	//Meters the mix. The sources are metered by the graph, and all meters are read when this one completes an interval.
+	AudioLevelMeter m_MixMeter;
+	bool m_IsMeteringEnabled;
+	bool m_HasLevelsReport;
+	AUDIO_LEVELS_REPORT m_LevelsReport;
+
+	//Audio buffered per device to absorb the jitter of capture packets and video frames.
+	static const UINT32 TARGET_LATENCY_MILLIS = 20;
 
 	AUDIO_OPTIONS *GetAudioOptions() { return m_AudioOptions.get(); }
 	HRESULT InitializeAudioCapture();
-	std::vector<BYTE> MixAudio(_In_ std::vector<BYTE> const &first, _In_ std::vector<BYTE> const &second, _In_ float firstVolume, _In_ float secondVolume);
+	HRESULT InitializeAdditionalSources();
+	void UpdateSourceOptions();
+	AUDIO_NOISE_GATE_OPTIONS GetInputNoiseGateOptions();
+	void UpdateLevels(_In_opt_ const float *pMix, _In_ size_t frameCount);
+	void LogDriftStats(_In_ std::wstring tag, _In_ int sourceId);
 };
 
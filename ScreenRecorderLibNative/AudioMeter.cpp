@@ -0,0 +1,238 @@
+#include "AudioMeter.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	const double Pi = 3.14159265358979323846;
+}
+
+AudioLoudnessMeter::AudioLoudnessMeter() :
+	m_Channels(0),
+	m_Shelf{},
+	m_HighPass{},
+	m_State{},
+	m_StepFrames(0),
+	m_StepFramesProcessed(0),
+	m_StepSum(0),
+	m_WindowSums{},
+	m_WindowIndex(0),
+	m_WindowCount(0)
+{
+}
+
+void AudioLoudnessMeter::Initialize(uint32_t sampleRate, uint32_t channels)
+{
+	m_Channels = channels;
+	m_State.assign(channels, CHANNEL_STATE());
+	m_StepFrames = (std::max)(static_cast<size_t>(1), static_cast<size_t>(sampleRate) * STEP_MILLIS / 1000);
+	//The K-weighting filter of BS.1770 is a high shelf modeling the acoustic effect of the head, followed by a high pass.
+	//The coefficients are derived from the analog prototypes, so they are correct at any sample rate and not only at the 48 kHz the standard tabulates.
+	double rate = (std::max)(1u, sampleRate);
+	{
+		const double f0 = 1681.974450955533;
+		const double gainDb = 3.999843853973347;
+		const double q = 0.7071752369554196;
+		double k = std::tan(Pi * f0 / rate);
+		double vh = std::pow(10.0, gainDb / 20.0);
+		double vb = std::pow(vh, 0.4996667741545416);
+		double a0 = 1.0 + k / q + k * k;
+		m_Shelf.B0 = (vh + vb * k / q + k * k) / a0;
+		m_Shelf.B1 = 2.0 * (k * k - vh) / a0;
+		m_Shelf.B2 = (vh - vb * k / q + k * k) / a0;
+		m_Shelf.A1 = 2.0 * (k * k - 1.0) / a0;
+		m_Shelf.A2 = (1.0 - k / q + k * k) / a0;
+	}
+	{
+		const double f0 = 38.13547087602444;
+		const double q = 0.5003270373238773;
+		double k = std::tan(Pi * f0 / rate);
+		double a0 = 1.0 + k / q + k * k;
+		m_HighPass.B0 = 1.0;
+		m_HighPass.B1 = -2.0;
+		m_HighPass.B2 = 1.0;
+		m_HighPass.A1 = 2.0 * (k * k - 1.0) / a0;
+		m_HighPass.A2 = (1.0 - k / q + k * k) / a0;
+	}
+	Reset();
+}
+
+inline double AudioLoudnessMeter::Filter(CHANNEL_STATE &state, double sample) const
+{
+	double shelved = m_Shelf.B0 * sample + state.Shelf1;
+	state.Shelf1 = m_Shelf.B1 * sample - m_Shelf.A1 * shelved + state.Shelf2;
+	state.Shelf2 = m_Shelf.B2 * sample - m_Shelf.A2 * shelved;
+	double weighted = m_HighPass.B0 * shelved + state.HighPass1;
+	state.HighPass1 = m_HighPass.B1 * shelved - m_HighPass.A1 * weighted + state.HighPass2;
+	state.HighPass2 = m_HighPass.B2 * shelved - m_HighPass.A2 * weighted;
+	return weighted;
+}
+
+void AudioLoudnessMeter::Process(const float *pSamples, size_t frameCount)
+{
+	if (!pSamples || m_Channels == 0) {
+		return;
+	}
+	//The filters are recursive, so each channel is a serial dependency chain, and they are run per sample.
+	for (size_t frame = 0; frame < frameCount; frame++) {
+		for (uint32_t channel = 0; channel < m_Channels; channel++) {
+			double weighted = Filter(m_State[channel], pSamples[frame * m_Channels + channel]);
+			m_StepSum += weighted * weighted;
+		}
+		if (++m_StepFramesProcessed == m_StepFrames) {
+			CompleteStep();
+		}
+	}
+}
+
+void AudioLoudnessMeter::ProcessSilence(size_t frameCount)
+{
+	if (m_Channels == 0) {
+		return;
+	}
+	size_t frame = 0;
+	//The filters ring out after the signal stops, which is part of the loudness. Once they have decayed, the silence only needs to be counted.
+	for (; frame < frameCount && !IsFilterSilent(); frame++) {
+		for (uint32_t channel = 0; channel < m_Channels; channel++) {
+			double weighted = Filter(m_State[channel], 0);
+			m_StepSum += weighted * weighted;
+		}
+		if (++m_StepFramesProcessed == m_StepFrames) {
+			CompleteStep();
+		}
+	}
+	if (frame < frameCount) {
+		m_State.assign(m_Channels, CHANNEL_STATE());
+	}
+	while (frame < frameCount) {
+		size_t stepRemaining = m_StepFrames - m_StepFramesProcessed;
+		size_t count = (std::min)(stepRemaining, frameCount - frame);
+		m_StepFramesProcessed += count;
+		frame += count;
+		if (m_StepFramesProcessed == m_StepFrames) {
+			CompleteStep();
+		}
+	}
+}
+
+float AudioLoudnessMeter::GetMomentaryLoudness() const
+{
+	double sum = 0;
+	size_t frames = 0;
+	for (size_t i = 0; i < m_WindowCount; i++) {
+		sum += m_WindowSums[i];
+		frames += m_StepFrames;
+	}
+	//Until the first step completes, the partial step is all there is.
+	if (m_WindowCount == 0) {
+		sum = m_StepSum;
+		frames = m_StepFramesProcessed;
+	}
+	if (frames == 0 || sum <= 0) {
+		return AudioLevelAnalyzer::MIN_DECIBELS;
+	}
+	double loudness = LOUDNESS_OFFSET + 10.0 * std::log10(sum / frames);
+	return static_cast<float>((std::max)(static_cast<double>(AudioLevelAnalyzer::MIN_DECIBELS), loudness));
+}
+
+void AudioLoudnessMeter::Reset()
+{
+	m_State.assign(m_Channels, CHANNEL_STATE());
+	m_StepFramesProcessed = 0;
+	m_StepSum = 0;
+	std::fill(std::begin(m_WindowSums), std::end(m_WindowSums), 0.0);
+	m_WindowIndex = 0;
+	m_WindowCount = 0;
+}
+
+bool AudioLoudnessMeter::IsFilterSilent() const
+{
+	for (const CHANNEL_STATE &state : m_State) {
+		if (std::abs(state.Shelf1) > SILENT_STATE || std::abs(state.Shelf2) > SILENT_STATE
+			|| std::abs(state.HighPass1) > SILENT_STATE || std::abs(state.HighPass2) > SILENT_STATE) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void AudioLoudnessMeter::CompleteStep()
+{
+	m_WindowSums[m_WindowIndex] = m_StepSum;
+	m_WindowIndex = (m_WindowIndex + 1) % WINDOW_STEPS;
+	m_WindowCount = (std::min)(m_WindowCount + 1, WINDOW_STEPS);
+	m_StepSum = 0;
+	m_StepFramesProcessed = 0;
+}
+
+AudioLevelMeter::AudioLevelMeter() :
+	m_Analyzer(),
+	m_Loudness(),
+	m_Channels(0),
+	m_IntervalFrames(0),
+	m_Frames(0),
+	m_Peak(0),
+	m_SumOfSquares(0)
+{
+}
+
+void AudioLevelMeter::Initialize(uint32_t sampleRate, uint32_t channels, uint32_t intervalMillis)
+{
+	m_Channels = channels;
+	m_IntervalFrames = static_cast<uint64_t>(sampleRate) * intervalMillis / 1000;
+	m_Loudness.Initialize(sampleRate, channels);
+	Reset();
+}
+
+void AudioLevelMeter::Process(const float *pSamples, size_t frameCount)
+{
+	if (!pSamples) {
+		ProcessSilence(frameCount);
+		return;
+	}
+	Process(pSamples, frameCount, m_Analyzer.Analyze(pSamples, frameCount * m_Channels));
+}
+
+void AudioLevelMeter::Process(const float *pSamples, size_t frameCount, const AUDIO_LEVELS &levels)
+{
+	if (levels.IsSilent()) {
+		ProcessSilence(frameCount);
+		return;
+	}
+	m_Peak = (std::max)(m_Peak, levels.Peak);
+	m_SumOfSquares += static_cast<double>(levels.Rms) * levels.Rms * frameCount * m_Channels;
+	m_Frames += frameCount;
+	m_Loudness.Process(pSamples, frameCount);
+}
+
+void AudioLevelMeter::ProcessSilence(size_t frameCount)
+{
+	m_Frames += frameCount;
+	m_Loudness.ProcessSilence(frameCount);
+}
+
+bool AudioLevelMeter::IsReadingDue() const
+{
+	return m_Frames > 0 && m_Frames >= m_IntervalFrames;
+}
+
+AUDIO_METER_READING AudioLevelMeter::Read()
+{
+	AUDIO_METER_READING reading;
+	reading.PeakDb = AudioLevelAnalyzer::ToDecibels(m_Peak);
+	if (m_Frames > 0 && m_Channels > 0) {
+		reading.RmsDb = AudioLevelAnalyzer::ToDecibels(static_cast<float>(std::sqrt(m_SumOfSquares / (m_Frames * m_Channels))));
+	}
+	reading.MomentaryLoudness = m_Loudness.GetMomentaryLoudness();
+	m_Frames = 0;
+	m_Peak = 0;
+	m_SumOfSquares = 0;
+	return reading;
+}
+
+void AudioLevelMeter::Reset()
+{
+	m_Loudness.Reset();
+	m_Frames = 0;
+	m_Peak = 0;
+	m_SumOfSquares = 0;
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include "AudioLevels.h"
+
+/// <summary>
+/// The levels of an audio signal over a metering interval, as shown by a level meter.
+/// </summary>
+struct AUDIO_METER_READING
+{
+	//The largest sample in the interval, in dBFS.
+	float PeakDb = AudioLevelAnalyzer::MIN_DECIBELS;
+	//The RMS level of the interval, in dBFS.
+	float RmsDb = AudioLevelAnalyzer::MIN_DECIBELS;
+	//The ITU-R BS.1770 loudness of the last 400 ms, in LUFS.
+	float MomentaryLoudness = AudioLevelAnalyzer::MIN_DECIBELS;
+};
+
+/// <summary>
+/// Measures the momentary loudness of interleaved 32-bit float audio as defined by ITU-R BS.1770, i.e. the mean square of the K-weighted signal over a sliding 400 ms window.
+/// All channels are weighted equally, which matches BS.1770 for the mono and stereo layouts the recorder writes.
+/// </summary>
+class AudioLoudnessMeter
+{
+public:
+	AudioLoudnessMeter();
+	void Initialize(uint32_t sampleRate, uint32_t channels);
+	void Process(const float *pSamples, size_t frameCount);
+	/// <summary>
+	/// Processes frames of digital silence without needing a buffer of zeros.
+	/// </summary>
+	void ProcessSilence(size_t frameCount);
+	/// <summary>
+	/// Returns the loudness of the last 400 ms in LUFS, or of the audio processed so far if that is shorter. Returns MIN_DECIBELS for silence.
+	/// </summary>
+	float GetMomentaryLoudness() const;
+	void Reset();
+
+	//The offset of the BS.1770 loudness scale, so that a full scale 1 kHz sine in one channel reads -3.01 LUFS.
+	static constexpr double LOUDNESS_OFFSET = -0.691;
+
+private:
+	//The momentary window is measured in 100 ms steps, as in BS.1770 gating blocks with 75% overlap.
+	static constexpr uint32_t STEP_MILLIS = 100;
+	static constexpr size_t WINDOW_STEPS = 4;
+	//Filter state below this is inaudible, so silence no longer needs to run through the filter.
+	static constexpr double SILENT_STATE = 1e-10;
+
+	struct BIQUAD
+	{
+		double B0, B1, B2, A1, A2;
+	};
+	//The transposed direct form II state of both K-weighting stages of one channel.
+	struct CHANNEL_STATE
+	{
+		double Shelf1 = 0, Shelf2 = 0, HighPass1 = 0, HighPass2 = 0;
+	};
+
+	uint32_t m_Channels;
+	BIQUAD m_Shelf;
+	BIQUAD m_HighPass;
+	std::vector<CHANNEL_STATE> m_State;
+	size_t m_StepFrames;
+	size_t m_StepFramesProcessed;
+	double m_StepSum;
+	//The sums of squares of the last completed steps, in a ring of WINDOW_STEPS.
+	double m_WindowSums[WINDOW_STEPS];
+	size_t m_WindowIndex;
+	size_t m_WindowCount;
+
+	inline double Filter(CHANNEL_STATE &state, double sample) const;
+	bool IsFilterSilent() const;
+	void CompleteStep();
+};
+
+/// <summary>
+/// Level meter with peak, RMS and momentary loudness, read out once per metering interval.
+/// Peak and RMS use the SIMD kernels of AudioLevelAnalyzer, and can be fed levels that were already analyzed, e.g. by a noise gate, so no block is analyzed twice.
+/// </summary>
+class AudioLevelMeter
+{
+public:
+	AudioLevelMeter();
+	/// <param name="sampleRate">The sample rate of the audio</param>
+	/// <param name="channels">The channel count of the audio</param>
+	/// <param name="intervalMillis">The length of audio between readings</param>
+	void Initialize(uint32_t sampleRate, uint32_t channels, uint32_t intervalMillis);
+	void Process(const float *pSamples, size_t frameCount);
+	/// <summary>
+	/// Processes frames whose levels were already analyzed.
+	/// </summary>
+	void Process(const float *pSamples, size_t frameCount, const AUDIO_LEVELS &levels);
+	void ProcessSilence(size_t frameCount);
+	/// <summary>
+	/// True once a metering interval of audio was processed since the last reading.
+	/// </summary>
+	bool IsReadingDue() const;
+	/// <summary>
+	/// Returns the levels since the last reading, and starts the next interval. The loudness window carries over between readings.
+	/// </summary>
+	AUDIO_METER_READING Read();
+	void Reset();
+
+private:
+	AudioLevelAnalyzer m_Analyzer;
+	AudioLoudnessMeter m_Loudness;
+	uint32_t m_Channels;
+	uint64_t m_IntervalFrames;
+	uint64_t m_Frames;
+	float m_Peak;
+	//The sum of the squared samples of the interval, relative to full scale.
+	double m_SumOfSquares;
+};
@@ -0,0 +1,113 @@
+#include "AudioMixer.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cstring>
+#if CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+	void AccumulateScalar(const float *pSrc, size_t count, float gain, float *pAccumulator) {
+		for (size_t i = 0; i < count; i++) {
+			pAccumulator[i] += pSrc[i] * gain;
+		}
+	}
+
+#if CPU_FEATURES_X86
+	void AccumulateSSE2(const float *pSrc, size_t count, float gain, float *pAccumulator) {
+		const __m128 vGain = _mm_set1_ps(gain);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128 accLow = _mm_add_ps(_mm_loadu_ps(pAccumulator + i), _mm_mul_ps(_mm_loadu_ps(pSrc + i), vGain));
+			__m128 accHigh = _mm_add_ps(_mm_loadu_ps(pAccumulator + i + 4), _mm_mul_ps(_mm_loadu_ps(pSrc + i + 4), vGain));
+			_mm_storeu_ps(pAccumulator + i, accLow);
+			_mm_storeu_ps(pAccumulator + i + 4, accHigh);
+		}
+		AccumulateScalar(pSrc + i, count - i, gain, pAccumulator + i);
+	}
+
+	TARGET_AVX2 void AccumulateAVX2(const float *pSrc, size_t count, float gain, float *pAccumulator) {
+		const __m256 vGain = _mm256_set1_ps(gain);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			//Multiply and add are kept separate rather than fused, so every kernel produces the same mix.
+			__m256 accLow = _mm256_add_ps(_mm256_loadu_ps(pAccumulator + i), _mm256_mul_ps(_mm256_loadu_ps(pSrc + i), vGain));
+			__m256 accHigh = _mm256_add_ps(_mm256_loadu_ps(pAccumulator + i + 8), _mm256_mul_ps(_mm256_loadu_ps(pSrc + i + 8), vGain));
+			_mm256_storeu_ps(pAccumulator + i, accLow);
+			_mm256_storeu_ps(pAccumulator + i + 8, accHigh);
+		}
+		_mm256_zeroupper();
+		AccumulateScalar(pSrc + i, count - i, gain, pAccumulator + i);
+	}
+#endif
+}
+
+AudioMixer::AudioMixer() :
+	AudioMixer(GetBestSupportedKernel())
+{
+}
+
+AudioMixer::AudioMixer(AudioMixerKernel kernel) :
+	m_Kernel(AudioMixerKernel::Scalar),
+	m_Accumulate(AccumulateScalar)
+{
+	if (!IsKernelSupported(kernel)) {
+		kernel = GetBestSupportedKernel();
+	}
+	m_Kernel = kernel;
+#if CPU_FEATURES_X86
+	switch (kernel)
+	{
+		case AudioMixerKernel::AVX2:
+			m_Accumulate = AccumulateAVX2;
+			break;
+		case AudioMixerKernel::SSE2:
+			m_Accumulate = AccumulateSSE2;
+			break;
+		default:
+			break;
+	}
+#endif
+}
+
+AudioMixerKernel AudioMixer::GetBestSupportedKernel()
+{
+	if (IsKernelSupported(AudioMixerKernel::AVX2)) {
+		return AudioMixerKernel::AVX2;
+	}
+	if (IsKernelSupported(AudioMixerKernel::SSE2)) {
+		return AudioMixerKernel::SSE2;
+	}
+	return AudioMixerKernel::Scalar;
+}
+
+bool AudioMixer::IsKernelSupported(AudioMixerKernel kernel)
+{
+	switch (kernel)
+	{
+		case AudioMixerKernel::AVX2:
+			return CPU_FEATURES_X86 && CPU_FEATURES::Get().IsAvx2Supported;
+		case AudioMixerKernel::SSE2:
+			return CPU_FEATURES_X86 && CPU_FEATURES::Get().IsSse2Supported;
+		default:
+			return true;
+	}
+}
+
+void AudioMixer::Mix(const AUDIO_MIX_INPUT *pInputs, size_t inputCount, float *pOutput, size_t outputSampleCount) const
+{
+	memset(pOutput, 0, outputSampleCount * sizeof(float));
+	for (size_t input = 0; input < inputCount; input++) {
+		const AUDIO_MIX_INPUT &mixInput = pInputs[input];
+		size_t count = (std::min)(mixInput.SampleCount, outputSampleCount);
+		if (count == 0 || mixInput.Gain == 0.0f) {
+			continue;
+		}
+		//The first stream at unity gain is copied, which is the common case of a single source.
+		if (input == 0 && mixInput.Gain == 1.0f) {
+			memcpy(pOutput, mixInput.Samples, count * sizeof(float));
+			continue;
+		}
+		m_Accumulate(mixInput.Samples, count, mixInput.Gain, pOutput);
+	}
+}
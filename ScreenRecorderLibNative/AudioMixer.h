@@ -0,0 +1,58 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// One 32-bit float stream to be mixed. Streams shorter than the output are treated as silence past their end.
+/// </summary>
+struct AUDIO_MIX_INPUT
+{
+	const float *Samples = nullptr;
+	//The number of samples (not frames) in Samples.
+	size_t SampleCount = 0;
+	//Linear gain applied to the stream before mixing.
+	float Gain = 1.0f;
+};
+
+enum class AudioMixerKernel {
+	Scalar,
+	SSE2,
+	AVX2
+};
+
+/// <summary>
+/// Mixes any number of interleaved 32-bit float streams with per-stream gain, using the widest SIMD kernel the CPU supports.
+/// The mix is not clipped, so sources can be summed and scaled past full scale without distortion. It is clipped once, when it is converted to the output format.
+/// </summary>
+class AudioMixer
+{
+public:
+	AudioMixer();
+	explicit AudioMixer(AudioMixerKernel kernel);
+
+	/// <summary>
+	/// Mixes the inputs into pOutput.
+	/// </summary>
+	/// <param name="pInputs">The streams to mix</param>
+	/// <param name="inputCount">The number of streams in pInputs</param>
+	/// <param name="pOutput">The destination buffer. May not alias any of the inputs.</param>
+	/// <param name="outputSampleCount">The number of samples to write to pOutput</param>
+	void Mix(const AUDIO_MIX_INPUT *pInputs, size_t inputCount, float *pOutput, size_t outputSampleCount) const;
+
+	inline AudioMixerKernel GetKernel() const { return m_Kernel; }
+
+	/// <summary>
+	/// Returns the fastest kernel supported by the current CPU.
+	/// </summary>
+	static AudioMixerKernel GetBestSupportedKernel();
+	/// <summary>
+	/// Returns true if the kernel can run on the current CPU.
+	/// </summary>
+	static bool IsKernelSupported(AudioMixerKernel kernel);
+
+private:
+	typedef void(*AccumulateFunction)(const float *pSrc, size_t count, float gain, float *pAccumulator);
+
+	AudioMixerKernel m_Kernel;
+	AccumulateFunction m_Accumulate;
+};
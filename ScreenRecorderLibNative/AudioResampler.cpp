@@ -0,0 +1,395 @@
+#include "AudioResampler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+
+namespace {
+	const double Pi = 3.14159265358979323846;
+	//Kaiser window shape. Gives about 80 dB stopband attenuation.
+	const double KaiserBeta = 8.0;
+	//Downmix coefficient for center and surround channels (-3 dB).
+	const float SurroundMixLevel = 0.7071f;
+
+	//Speaker positions in the default WAVEFORMATEXTENSIBLE channel order.
+	enum Speaker {
+		FrontLeft = 0,
+		FrontRight = 1,
+		FrontCenter = 2,
+		LowFrequency = 3,
+		BackLeft = 4,
+		BackRight = 5,
+		SideLeft = 6,
+		SideRight = 7
+	};
+
+	double BesselI0(double x) {
+		double sum = 1.0;
+		double term = 1.0;
+		double halfX = x / 2.0;
+		for (int k = 1; k < 50; k++) {
+			term *= (halfX / k) * (halfX / k);
+			sum += term;
+			if (term < sum * 1e-12) {
+				break;
+			}
+		}
+		return sum;
+	}
+
+	double Sinc(double x) {
+		if (std::fabs(x) < 1e-9) {
+			return 1.0;
+		}
+		return std::sin(Pi * x) / (Pi * x);
+	}
+
+	inline int16_t FloatToInt16(float sample) {
+		if (sample > 32767.0f) {
+			return 32767;
+		}
+		if (sample < -32768.0f) {
+			return -32768;
+		}
+		return static_cast<int16_t>(std::lrintf(sample));
+	}
+}
+
+AudioResampler::AudioResampler() :
+	m_InputChannels(0),
+	m_OutputChannels(0),
+	m_FilterChannels(0),
+	m_IsPassthrough(true),
+	m_Interpolation(1),
+	m_Decimation(1),
+	m_PhaseCount(1),
+	m_HalfLength(1),
+	m_TapCount(2),
+	m_InputIndex(0),
+	m_IsRateAdjustable(false),
+	m_RateAdjustment(1.0),
+	m_NominalStep(FIXED_POINT_ONE),
+	m_Step(FIXED_POINT_ONE),
+	m_Fraction(0),
+	m_PendingSkip(0),
+	m_InputFrameTotal(0),
+	m_OutputFrameTotal(0)
+{
+}
+
+bool AudioResampler::Initialize(uint32_t inputSampleRate, uint32_t inputChannels, uint32_t outputSampleRate, uint32_t outputChannels, int halfFilterLength, bool isRateAdjustable)
+{
+	if (inputSampleRate == 0 || outputSampleRate == 0 || inputChannels == 0 || outputChannels == 0) {
+		return false;
+	}
+	m_InputChannels = inputChannels;
+	m_OutputChannels = outputChannels;
+	m_FilterChannels = (std::min)(inputChannels, outputChannels);
+	m_IsRateAdjustable = isRateAdjustable;
+	m_IsPassthrough = inputSampleRate == outputSampleRate && !isRateAdjustable;
+	uint32_t divisor = std::gcd(inputSampleRate, outputSampleRate);
+	m_Interpolation = outputSampleRate / divisor;
+	m_Decimation = inputSampleRate / divisor;
+	//An adjustable rate can put output frames anywhere between two input frames, so it always needs the full table.
+	m_PhaseCount = isRateAdjustable ? MAX_PHASES : (std::min)(m_Interpolation, MAX_PHASES);
+	m_NominalStep = static_cast<uint64_t>((static_cast<double>(m_Decimation) / m_Interpolation) * FIXED_POINT_ONE + 0.5);
+	m_RateAdjustment = 1.0;
+	m_Step = m_NominalStep;
+	m_HalfLength = (std::max)(1, (std::min)(60, halfFilterLength));
+	m_TapCount = m_HalfLength * 2;
+	BuildMixMatrix();
+	if (!m_IsPassthrough) {
+		BuildFilter();
+	}
+	Reset();
+	return true;
+}
+
+void AudioResampler::Reset()
+{
+	//The history is primed with silence, so the first output frame is centered on the first input frame.
+	m_History.resize(m_FilterChannels);
+	for (auto &channel : m_History) {
+		channel.assign(m_HalfLength - 1, 0.0f);
+	}
+	m_InputIndex = m_HalfLength - 1;
+	m_Fraction = 0;
+	m_PendingSkip = 0;
+	m_InputFrameTotal = 0;
+	m_OutputFrameTotal = 0;
+}
+
+size_t AudioResampler::GetMaxOutputFrames(size_t inputFrames) const
+{
+	if (m_IsPassthrough) {
+		return inputFrames;
+	}
+	//Up to 2 * m_HalfLength frames may be held in the history, and Flush adds m_HalfLength frames of silence.
+	double inputFramesPerOutputFrame = static_cast<double>(m_Step) / FIXED_POINT_ONE;
+	return static_cast<size_t>((inputFrames + 3 * m_HalfLength) / inputFramesPerOutputFrame) + 2;
+}
+
+bool AudioResampler::SetRateAdjustment(double ratio)
+{
+	if (!m_IsRateAdjustable) {
+		return false;
+	}
+	m_RateAdjustment = (std::max)(MIN_RATE_ADJUSTMENT, (std::min)(MAX_RATE_ADJUSTMENT, ratio));
+	m_Step = static_cast<uint64_t>(m_NominalStep * m_RateAdjustment + 0.5);
+	return true;
+}
+
+size_t AudioResampler::Process(const int16_t *pInput, size_t inputFrames, int16_t *pOutput)
+{
+	m_ScratchInput.resize(inputFrames * m_InputChannels);
+	for (size_t i = 0; i < m_ScratchInput.size(); i++) {
+		m_ScratchInput[i] = static_cast<float>(pInput[i]);
+	}
+	m_ScratchOutput.resize(GetMaxOutputFrames(inputFrames) * m_OutputChannels);
+	size_t outputFrames = Process(m_ScratchInput.data(), inputFrames, m_ScratchOutput.data());
+	for (size_t i = 0; i < outputFrames * m_OutputChannels; i++) {
+		pOutput[i] = FloatToInt16(m_ScratchOutput[i]);
+	}
+	return outputFrames;
+}
+
+size_t AudioResampler::Process(const float *pInput, size_t inputFrames, float *pOutput)
+{
+	m_InputFrameTotal += inputFrames;
+	size_t outputFrames;
+	if (m_IsPassthrough) {
+		outputFrames = ProcessPassthrough(pInput, inputFrames, pOutput);
+	}
+	else {
+		AppendInput(pInput, inputFrames);
+		outputFrames = ProduceOutput(pOutput);
+	}
+	m_OutputFrameTotal += outputFrames;
+	return outputFrames;
+}
+
+size_t AudioResampler::Flush(int16_t *pOutput)
+{
+	m_ScratchOutput.resize(GetMaxOutputFrames(0) * m_OutputChannels);
+	size_t outputFrames = Flush(m_ScratchOutput.data());
+	for (size_t i = 0; i < outputFrames * m_OutputChannels; i++) {
+		pOutput[i] = FloatToInt16(m_ScratchOutput[i]);
+	}
+	return outputFrames;
+}
+
+size_t AudioResampler::Flush(float *pOutput)
+{
+	if (m_IsPassthrough) {
+		return 0;
+	}
+	for (auto &channel : m_History) {
+		channel.insert(channel.end(), m_HalfLength, 0.0f);
+	}
+	size_t outputFrames = ProduceOutput(pOutput);
+	Reset();
+	return outputFrames;
+}
+
+void AudioResampler::BuildFilter()
+{
+	//Low pass at the lower of the two Nyquist frequencies, with some room for the transition band.
+	double rolloff = (std::max)(0.8, (std::min)(0.97, 1.0 - 3.0 / m_TapCount));
+	double cutoff = (std::min)(1.0, static_cast<double>(m_Interpolation) / m_Decimation) * rolloff;
+	double windowNormalization = BesselI0(KaiserBeta);
+	//One extra phase, equal to phase 0 shifted by one tap, so phases can be interpolated without wrapping.
+	m_Coefficients.assign(static_cast<size_t>(m_PhaseCount + 1) * m_TapCount, 0.0f);
+	for (uint32_t phase = 0; phase <= m_PhaseCount; phase++) {
+		double fraction = static_cast<double>(phase) / m_PhaseCount;
+		float *pPhase = &m_Coefficients[static_cast<size_t>(phase) * m_TapCount];
+		double sum = 0;
+		for (int tap = 0; tap < m_TapCount; tap++) {
+			double x = tap - (m_HalfLength - 1) - fraction;
+			double u = x / m_HalfLength;
+			double window = std::fabs(u) >= 1.0 ? 0.0 : BesselI0(KaiserBeta * std::sqrt(1.0 - u * u)) / windowNormalization;
+			double coefficient = cutoff * Sinc(cutoff * x) * window;
+			pPhase[tap] = static_cast<float>(coefficient);
+			sum += coefficient;
+		}
+		//Normalize every phase to unity gain at DC.
+		if (sum != 0) {
+			for (int tap = 0; tap < m_TapCount; tap++) {
+				pPhase[tap] = static_cast<float>(pPhase[tap] / sum);
+			}
+		}
+	}
+	m_ScratchCoefficients.resize(m_TapCount);
+}
+
+void AudioResampler::BuildMixMatrix()
+{
+	m_MixMatrix.assign(static_cast<size_t>(m_OutputChannels) * m_InputChannels, 0.0f);
+	auto Set([&](uint32_t output, uint32_t input, float value) {
+		if (output < m_OutputChannels && input < m_InputChannels) {
+			m_MixMatrix[static_cast<size_t>(output) * m_InputChannels + input] = value;
+		}
+	});
+	if (m_InputChannels == m_OutputChannels) {
+		for (uint32_t c = 0; c < m_InputChannels; c++) {
+			Set(c, c, 1.0f);
+		}
+	}
+	else if (m_InputChannels == 1) {
+		//Mono goes to the front left and right speakers.
+		Set(FrontLeft, 0, 1.0f);
+		Set(FrontRight, 0, 1.0f);
+	}
+	else if (m_OutputChannels == 1) {
+		//Average of the front left and right, plus center and surrounds at -3 dB. The low frequency channel is dropped.
+		Set(0, FrontLeft, 1.0f);
+		Set(0, FrontRight, 1.0f);
+		for (uint32_t input : { FrontCenter, BackLeft, BackRight, SideLeft, SideRight }) {
+			Set(0, input, SurroundMixLevel);
+		}
+	}
+	else if (m_OutputChannels == 2) {
+		Set(FrontLeft, FrontLeft, 1.0f);
+		Set(FrontRight, FrontRight, 1.0f);
+		Set(FrontLeft, FrontCenter, SurroundMixLevel);
+		Set(FrontRight, FrontCenter, SurroundMixLevel);
+		Set(FrontLeft, BackLeft, SurroundMixLevel);
+		Set(FrontRight, BackRight, SurroundMixLevel);
+		Set(FrontLeft, SideLeft, SurroundMixLevel);
+		Set(FrontRight, SideRight, SurroundMixLevel);
+	}
+	else {
+		//Channels present in both layouts are kept, the rest are dropped or silent.
+		for (uint32_t c = 0; c < (std::min)(m_InputChannels, m_OutputChannels); c++) {
+			Set(c, c, 1.0f);
+		}
+	}
+	//Scale down any output that sums more than one input, so a downmix of full scale input cannot clip.
+	for (uint32_t output = 0; output < m_OutputChannels; output++) {
+		float *pRow = &m_MixMatrix[static_cast<size_t>(output) * m_InputChannels];
+		float sum = 0;
+		for (uint32_t input = 0; input < m_InputChannels; input++) {
+			sum += pRow[input];
+		}
+		if (sum > 1.0f) {
+			for (uint32_t input = 0; input < m_InputChannels; input++) {
+				pRow[input] /= sum;
+			}
+		}
+	}
+	m_ScratchFrame.resize((std::max)(m_InputChannels, m_OutputChannels));
+}
+
+void AudioResampler::MixFrame(const float *pSrc, uint32_t srcChannels, float *pDest, uint32_t destChannels) const
+{
+	for (uint32_t output = 0; output < destChannels; output++) {
+		const float *pRow = &m_MixMatrix[static_cast<size_t>(output) * srcChannels];
+		float sum = 0;
+		for (uint32_t input = 0; input < srcChannels; input++) {
+			sum += pRow[input] * pSrc[input];
+		}
+		pDest[output] = sum;
+	}
+}
+
+size_t AudioResampler::ProcessPassthrough(const float *pInput, size_t inputFrames, float *pOutput)
+{
+	if (m_InputChannels == m_OutputChannels) {
+		memcpy(pOutput, pInput, inputFrames * m_InputChannels * sizeof(float));
+	}
+	else {
+		for (size_t frame = 0; frame < inputFrames; frame++) {
+			MixFrame(pInput + frame * m_InputChannels, m_InputChannels, pOutput + frame * m_OutputChannels, m_OutputChannels);
+		}
+	}
+	return inputFrames;
+}
+
+void AudioResampler::AppendInput(const float *pInput, size_t inputFrames)
+{
+	//Frames the filter has already stepped past without them being available yet are dropped.
+	size_t skip = (std::min)(m_PendingSkip, inputFrames);
+	m_PendingSkip -= skip;
+	pInput += skip * m_InputChannels;
+	inputFrames -= skip;
+
+	bool isDownmix = m_OutputChannels < m_InputChannels;
+	for (auto &channel : m_History) {
+		channel.reserve(channel.size() + inputFrames);
+	}
+	for (size_t frame = 0; frame < inputFrames; frame++) {
+		const float *pFrame = pInput + frame * m_InputChannels;
+		if (isDownmix) {
+			MixFrame(pFrame, m_InputChannels, m_ScratchFrame.data(), m_OutputChannels);
+			pFrame = m_ScratchFrame.data();
+		}
+		for (uint32_t c = 0; c < m_FilterChannels; c++) {
+			m_History[c].push_back(pFrame[c]);
+		}
+	}
+}
+
+size_t AudioResampler::ProduceOutput(float *pOutput)
+{
+	size_t outputFrames = 0;
+	size_t historySize = m_History.empty() ? 0 : m_History[0].size();
+	bool isUpmix = m_OutputChannels > m_InputChannels;
+	float *pFiltered = m_ScratchFrame.data();
+	//An output frame centered on m_InputIndex needs m_HalfLength frames of look-ahead.
+	while (m_InputIndex + m_HalfLength < historySize) {
+		uint64_t position = m_Fraction * m_PhaseCount;
+		uint32_t phase = static_cast<uint32_t>(position >> FIXED_POINT_BITS);
+		uint64_t remainder = position & (FIXED_POINT_ONE - 1);
+		//Positions within rounding distance of a table phase use it as is. For ratios with few phases, that is every position.
+		if (remainder > FIXED_POINT_ONE - PHASE_SNAP_DISTANCE) {
+			phase++;
+			remainder = 0;
+		}
+		else if (remainder < PHASE_SNAP_DISTANCE) {
+			remainder = 0;
+		}
+		const float *pCoefficients = &m_Coefficients[static_cast<size_t>(phase) * m_TapCount];
+		if (remainder != 0) {
+			//The position falls between two phases of the table, so interpolate between them.
+			float weight = static_cast<float>(static_cast<double>(remainder) / FIXED_POINT_ONE);
+			const float *pNext = pCoefficients + m_TapCount;
+			for (int tap = 0; tap < m_TapCount; tap++) {
+				m_ScratchCoefficients[tap] = pCoefficients[tap] + (pNext[tap] - pCoefficients[tap]) * weight;
+			}
+			pCoefficients = m_ScratchCoefficients.data();
+		}
+		size_t start = m_InputIndex + 1 - m_HalfLength;
+		for (uint32_t c = 0; c < m_FilterChannels; c++) {
+			const float *pSamples = m_History[c].data() + start;
+			float sum = 0;
+			for (int tap = 0; tap < m_TapCount; tap++) {
+				sum += pSamples[tap] * pCoefficients[tap];
+			}
+			pFiltered[c] = sum;
+		}
+		if (isUpmix) {
+			MixFrame(pFiltered, m_InputChannels, pOutput, m_OutputChannels);
+		}
+		else {
+			memcpy(pOutput, pFiltered, m_OutputChannels * sizeof(float));
+		}
+		pOutput += m_OutputChannels;
+		outputFrames++;
+
+		m_Fraction += m_Step;
+		m_InputIndex += static_cast<size_t>(m_Fraction >> FIXED_POINT_BITS);
+		m_Fraction &= FIXED_POINT_ONE - 1;
+	}
+	//Drop the history that no future output frame can reach.
+	size_t consumed = m_InputIndex + 1 - m_HalfLength;
+	if (consumed > historySize) {
+		m_PendingSkip += consumed - historySize;
+	}
+	size_t erased = (std::min)(consumed, historySize);
+	if (erased > 0) {
+		for (auto &channel : m_History) {
+			channel.erase(channel.begin(), channel.begin() + erased);
+		}
+	}
+	m_InputIndex -= consumed;
+	return outputFrames;
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+/// <summary>
+/// Streaming polyphase windowed-sinc sample rate converter with channel up/down-mixing for interleaved PCM.
+/// The filter history is kept between calls, so audio can be fed in chunks of any size without discontinuities at the chunk boundaries.
+/// All buffers are owned by the resampler or provided by the caller, so no allocations happen once the internal buffers have grown to the chunk size.
+/// </summary>
+class AudioResampler
+{
+public:
+	AudioResampler();
+
+	/// <summary>
+	/// Configures the conversion. Resets any state from earlier calls.
+	/// </summary>
+	/// <param name="inputSampleRate">Input sample rate in Hz</param>
+	/// <param name="inputChannels">Number of interleaved input channels</param>
+	/// <param name="outputSampleRate">Output sample rate in Hz</param>
+	/// <param name="outputChannels">Number of interleaved output channels</param>
+	/// <param name="halfFilterLength">Conversion quality, 1 (min) to 60 (max). The number of input frames on each side of an output frame used to compute it.</param>
+	/// <param name="isRateAdjustable">Allow the ratio to be fine tuned with SetRateAdjustment while streaming. The input is then always filtered, even if the sample rates are equal.</param>
+	/// <returns>false if the parameters are invalid</returns>
+	bool Initialize(uint32_t inputSampleRate, uint32_t inputChannels, uint32_t outputSampleRate, uint32_t outputChannels, int halfFilterLength, bool isRateAdjustable = false);
+
+	/// <summary>
+	/// Scales the speed at which input is consumed, to compensate for clock drift between the input and output.
+	/// A ratio above 1 produces fewer output frames per input frame. Only valid if the resampler was initialized as rate adjustable.
+	/// </summary>
+	/// <param name="ratio">The speed relative to the nominal ratio, clamped to [0.95, 1.05]</param>
+	/// <returns>false if the resampler is not rate adjustable</returns>
+	bool SetRateAdjustment(double ratio);
+	inline double GetRateAdjustment() const { return m_RateAdjustment; }
+
+	/// <summary>
+	/// Discards buffered input and restarts the filter from silence, keeping the configuration.
+	/// </summary>
+	void Reset();
+
+	/// <summary>
+	/// Returns the maximum number of frames a call to Process or Flush with the given number of input frames can produce.
+	/// </summary>
+	size_t GetMaxOutputFrames(size_t inputFrames) const;
+
+	/// <summary>
+	/// Converts interleaved 16-bit frames.
+	/// </summary>
+	/// <param name="pInput">The input frames</param>
+	/// <param name="inputFrames">The number of frames in pInput</param>
+	/// <param name="pOutput">The destination buffer. Must hold at least GetMaxOutputFrames(inputFrames) frames.</param>
+	/// <returns>The number of frames written to pOutput</returns>
+	size_t Process(const int16_t *pInput, size_t inputFrames, int16_t *pOutput);
+
+	/// <summary>
+	/// Converts interleaved 32-bit float frames.
+	/// </summary>
+	size_t Process(const float *pInput, size_t inputFrames, float *pOutput);
+
+	/// <summary>
+	/// Writes the frames still held back by the filter look-ahead, as if the input was followed by silence.
+	/// </summary>
+	/// <param name="pOutput">The destination buffer. Must hold at least GetMaxOutputFrames(0) frames.</param>
+	/// <returns>The number of frames written to pOutput</returns>
+	size_t Flush(int16_t *pOutput);
+	size_t Flush(float *pOutput);
+
+	inline bool IsPassthrough() const { return m_IsPassthrough; }
+	inline uint32_t GetInputChannels() const { return m_InputChannels; }
+	inline uint32_t GetOutputChannels() const { return m_OutputChannels; }
+	inline uint64_t GetInputFrameTotal() const { return m_InputFrameTotal; }
+	inline uint64_t GetOutputFrameTotal() const { return m_OutputFrameTotal; }
+
+private:
+	//Maximum number of precomputed filter phases. Ratios needing more are interpolated between the nearest phases.
+	static constexpr uint32_t MAX_PHASES = 1024;
+	//Output positions are tracked in 32.32 fixed point input frames.
+	static const int FIXED_POINT_BITS = 32;
+	static const uint64_t FIXED_POINT_ONE = 1ull << FIXED_POINT_BITS;
+	//Positions closer than 1/4096 of a phase to a table phase are not interpolated.
+	static const uint64_t PHASE_SNAP_DISTANCE = FIXED_POINT_ONE >> 12;
+	static constexpr double MIN_RATE_ADJUSTMENT = 0.95;
+	static constexpr double MAX_RATE_ADJUSTMENT = 1.05;
+
+	uint32_t m_InputChannels;
+	uint32_t m_OutputChannels;
+	//Filtering runs at the lower of the input and output channel counts.
+	uint32_t m_FilterChannels;
+	bool m_IsPassthrough;
+	//The rate ratio reduced to output/input = m_Interpolation/m_Decimation
+	uint32_t m_Interpolation;
+	uint32_t m_Decimation;
+	uint32_t m_PhaseCount;
+	int m_HalfLength;
+	int m_TapCount;
+	//m_PhaseCount + 1 phases of m_TapCount coefficients each.
+	std::vector<float> m_Coefficients;
+	//m_OutputChannels x m_InputChannels
+	std::vector<float> m_MixMatrix;
+
+	//Planar filter history, one buffer per filter channel.
+	std::vector<std::vector<float>> m_History;
+	//The index in m_History of the input frame the next output frame is centered on.
+	size_t m_InputIndex;
+	bool m_IsRateAdjustable;
+	double m_RateAdjustment;
+	//Input frames per output frame at the nominal ratio and with the rate adjustment applied, in fixed point.
+	uint64_t m_NominalStep;
+	uint64_t m_Step;
+	//The fractional position of the next output frame between m_InputIndex and the following input frame, in fixed point.
+	uint64_t m_Fraction;
+	//Input frames the filter has stepped past before they arrived, when decimating by more than the filter length.
+	size_t m_PendingSkip;
+	uint64_t m_InputFrameTotal;
+	uint64_t m_OutputFrameTotal;
+
+	std::vector<float> m_ScratchCoefficients;
+	std::vector<float> m_ScratchFrame;
+	std::vector<float> m_ScratchInput;
+	std::vector<float> m_ScratchOutput;
+
+	void BuildFilter();
+	void BuildMixMatrix();
+	void AppendInput(const float *pInput, size_t inputFrames);
+	size_t ProduceOutput(float *pOutput);
+	void MixFrame(const float *pSrc, uint32_t srcChannels, float *pDest, uint32_t destChannels) const;
+	size_t ProcessPassthrough(const float *pInput, size_t inputFrames, float *pOutput);
+};
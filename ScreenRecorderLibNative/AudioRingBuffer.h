@@ -0,0 +1,225 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <algorithm>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+/// <summary>
+/// A contiguous region of readable bytes in an AudioRingBuffer.
+/// Because the buffer wraps, a read may be split in two regions. Second is empty if the data is contiguous.
+/// </summary>
+struct AUDIO_RING_SPAN
+{
+	const uint8_t *First = nullptr;
+	size_t FirstSize = 0;
+	const uint8_t *Second = nullptr;
+	size_t SecondSize = 0;
+
+	size_t Size() const { return FirstSize + SecondSize; }
+};
+
+/// <summary>
+/// Fixed capacity, lock free single producer/single consumer byte queue for PCM data.
+/// The producer (the audio capture thread) calls Write and WriteSilence, the consumer (the recorder thread) calls
+/// the read methods and Clear. Neither side ever blocks the other, so the MMCSS audio thread cannot stall on the encoder.
+/// The read and write indices live on separate cache lines to avoid false sharing between the two threads.
+/// </summary>
+class AudioRingBuffer
+{
+public:
+	AudioRingBuffer() :
+		m_Buffer(nullptr),
+		m_Capacity(0),
+		m_Mask(0),
+		m_BlockBytes(1)
+	{
+	}
+	explicit AudioRingBuffer(size_t capacityBytes, size_t blockBytes = 1) :
+		AudioRingBuffer()
+	{
+		Initialize(capacityBytes, blockBytes);
+	}
+
+	AudioRingBuffer(const AudioRingBuffer &) = delete;
+	AudioRingBuffer &operator=(const AudioRingBuffer &) = delete;
+
+	/// <summary>
+	/// Allocates the buffer. The capacity is rounded up to the nearest power of two.
+	/// Must not be called while a producer or consumer is active.
+	/// </summary>
+	/// <param name="capacityBytes">The minimum number of bytes the buffer can hold</param>
+	/// <param name="blockBytes">The size of an audio frame. Writes that do not fit are cut at a whole frame, so the buffer never holds a partial frame</param>
+	void Initialize(size_t capacityBytes, size_t blockBytes = 1) {
+		size_t capacity = 1;
+		while (capacity < capacityBytes) {
+			capacity <<= 1;
+		}
+		if (capacity != m_Capacity) {
+			m_Buffer.reset(new uint8_t[capacity]);
+			m_Capacity = capacity;
+			m_Mask = capacity - 1;
+		}
+		m_BlockBytes = (std::max)(blockBytes, static_cast<size_t>(1));
+		m_WriteIndex.Value.store(0, std::memory_order_relaxed);
+		m_ReadIndex.Value.store(0, std::memory_order_relaxed);
+		m_OverflowBytes.Value.store(0, std::memory_order_relaxed);
+		m_OverflowCount.Value.store(0, std::memory_order_relaxed);
+		m_UnderrunCount.Value.store(0, std::memory_order_relaxed);
+	}
+
+	inline bool IsInitialized() const { return m_Buffer != nullptr; }
+	inline size_t GetCapacity() const { return m_Capacity; }
+	inline size_t GetBlockBytes() const { return m_BlockBytes; }
+
+	/// <summary>
+	/// Number of bytes that can be read. Exact when called from the consumer, a lower bound from the producer.
+	/// </summary>
+	inline size_t AvailableToRead() const {
+		return m_WriteIndex.Value.load(std::memory_order_acquire) - m_ReadIndex.Value.load(std::memory_order_acquire);
+	}
+
+	/// <summary>
+	/// Number of bytes that can be written. Exact when called from the producer, a lower bound from the consumer.
+	/// </summary>
+	inline size_t AvailableToWrite() const {
+		return m_Capacity - AvailableToRead();
+	}
+
+	/// <summary>
+	/// Producer side. Appends bytes to the buffer. If there is not enough room, the frames that do not fit are dropped and counted as overflow.
+	/// </summary>
+	/// <returns>The number of bytes written</returns>
+	size_t Write(const uint8_t *pData, size_t bytes) {
+		return WriteInternal(pData, bytes);
+	}
+
+	/// <summary>
+	/// Producer side. Appends zero bytes to the buffer, e.g. to fill a discontinuity in the audio stream.
+	/// </summary>
+	/// <returns>The number of bytes written</returns>
+	size_t WriteSilence(size_t bytes) {
+		return WriteInternal(nullptr, bytes);
+	}
+
+	/// <summary>
+	/// Consumer side. Returns the readable bytes without copying. The data stays valid until CommitRead or Clear is called.
+	/// </summary>
+	/// <param name="maxBytes">The maximum number of bytes to include in the span</param>
+	AUDIO_RING_SPAN GetReadSpan(size_t maxBytes = SIZE_MAX) const {
+		AUDIO_RING_SPAN span{};
+		if (!IsInitialized()) {
+			return span;
+		}
+		size_t readIndex = m_ReadIndex.Value.load(std::memory_order_relaxed);
+		size_t available = m_WriteIndex.Value.load(std::memory_order_acquire) - readIndex;
+		size_t count = (std::min)(available, maxBytes);
+		size_t offset = readIndex & m_Mask;
+		size_t firstSize = (std::min)(count, m_Capacity - offset);
+		span.First = m_Buffer.get() + offset;
+		span.FirstSize = firstSize;
+		if (count > firstSize) {
+			span.Second = m_Buffer.get();
+			span.SecondSize = count - firstSize;
+		}
+		return span;
+	}
+
+	/// <summary>
+	/// Consumer side. Releases bytes previously returned by GetReadSpan back to the producer.
+	/// </summary>
+	void CommitRead(size_t bytes) {
+		size_t readIndex = m_ReadIndex.Value.load(std::memory_order_relaxed);
+		size_t available = m_WriteIndex.Value.load(std::memory_order_acquire) - readIndex;
+		m_ReadIndex.Value.store(readIndex + (std::min)(bytes, available), std::memory_order_release);
+	}
+
+	/// <summary>
+	/// Consumer side. Copies up to the requested number of bytes to pDest. If fewer bytes are available, an underrun is counted.
+	/// </summary>
+	/// <returns>The number of bytes copied</returns>
+	size_t Read(uint8_t *pDest, size_t bytes) {
+		AUDIO_RING_SPAN span = GetReadSpan(bytes);
+		if (span.Size() < bytes) {
+			m_UnderrunCount.Value.fetch_add(1, std::memory_order_relaxed);
+		}
+		if (span.FirstSize > 0) {
+			memcpy(pDest, span.First, span.FirstSize);
+		}
+		if (span.SecondSize > 0) {
+			memcpy(pDest + span.FirstSize, span.Second, span.SecondSize);
+		}
+		CommitRead(span.Size());
+		return span.Size();
+	}
+
+	/// <summary>
+	/// Consumer side. Discards all readable bytes.
+	/// </summary>
+	void Clear() {
+		m_ReadIndex.Value.store(m_WriteIndex.Value.load(std::memory_order_acquire), std::memory_order_release);
+	}
+
+	/// <summary>
+	/// Total number of bytes dropped by the producer because the buffer was full.
+	/// </summary>
+	inline uint64_t GetOverflowBytes() const { return m_OverflowBytes.Value.load(std::memory_order_relaxed); }
+	/// <summary>
+	/// Number of writes that did not fit entirely in the buffer.
+	/// </summary>
+	inline uint64_t GetOverflowCount() const { return m_OverflowCount.Value.load(std::memory_order_relaxed); }
+	/// <summary>
+	/// Number of reads that requested more bytes than were available.
+	/// </summary>
+	inline uint64_t GetUnderrunCount() const { return m_UnderrunCount.Value.load(std::memory_order_relaxed); }
+
+private:
+	template <typename T>
+	struct alignas(CACHE_LINE_SIZE) PADDED_ATOMIC
+	{
+		std::atomic<T> Value{ 0 };
+	};
+
+	std::unique_ptr<uint8_t[]> m_Buffer;
+	size_t m_Capacity;
+	size_t m_Mask;
+	size_t m_BlockBytes;
+	//Written by the producer only.
+	PADDED_ATOMIC<size_t> m_WriteIndex;
+	//Written by the consumer only.
+	PADDED_ATOMIC<size_t> m_ReadIndex;
+	PADDED_ATOMIC<uint64_t> m_OverflowBytes;
+	PADDED_ATOMIC<uint64_t> m_OverflowCount;
+	PADDED_ATOMIC<uint64_t> m_UnderrunCount;
+
+	size_t WriteInternal(const uint8_t *pData, size_t bytes) {
+		if (!IsInitialized()) {
+			return 0;
+		}
+		size_t writeIndex = m_WriteIndex.Value.load(std::memory_order_relaxed);
+		size_t freeBytes = m_Capacity - (writeIndex - m_ReadIndex.Value.load(std::memory_order_acquire));
+		size_t count = (std::min)(bytes, freeBytes);
+		if (count < bytes) {
+			//The capacity is a power of two, which need not be a whole number of frames, so the write is cut at the last whole frame that fits.
+			count -= count % m_BlockBytes;
+			m_OverflowBytes.Value.fetch_add(bytes - count, std::memory_order_relaxed);
+			m_OverflowCount.Value.fetch_add(1, std::memory_order_relaxed);
+		}
+		size_t offset = writeIndex & m_Mask;
+		size_t firstSize = (std::min)(count, m_Capacity - offset);
+		if (pData) {
+			memcpy(m_Buffer.get() + offset, pData, firstSize);
+			memcpy(m_Buffer.get(), pData + firstSize, count - firstSize);
+		}
+		else {
+			memset(m_Buffer.get() + offset, 0, firstSize);
+			memset(m_Buffer.get(), 0, count - firstSize);
+		}
+		m_WriteIndex.Value.store(writeIndex + count, std::memory_order_release);
+		return count;
+	}
+};
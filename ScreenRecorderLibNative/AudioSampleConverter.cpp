@@ -0,0 +1,304 @@
+#include "AudioSampleConverter.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+	const float Int16Scale = 32768.0f;
+	const float Int16ToFloatScale = 1.0f / 32768.0f;
+	const float Int32ToFloatScale = 1.0f / 2147483648.0f;
+	const float MaxInt16 = 32767.0f;
+	const float MinInt16 = -32768.0f;
+	//The top 24 bits of a random value, scaled to [0, 1).
+	const float UniformScale = 1.0f / 16777216.0f;
+	const size_t DitherLanes = 8;
+
+	inline size_t CountBits(unsigned int value) {
+		size_t count = 0;
+		while (value) {
+			value &= value - 1;
+			count++;
+		}
+		return count;
+	}
+
+	inline uint32_t NextRandom(uint32_t &state) {
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	void Int16ToFloatScalar(const int16_t *pSrc, size_t count, float *pDest) {
+		for (size_t i = 0; i < count; i++) {
+			pDest[i] = pSrc[i] * Int16ToFloatScale;
+		}
+	}
+
+	void Int32ToFloatScalar(const int32_t *pSrc, size_t count, float *pDest) {
+		for (size_t i = 0; i < count; i++) {
+			pDest[i] = static_cast<float>(pSrc[i]) * Int32ToFloatScale;
+		}
+	}
+
+	size_t FloatToInt16Scalar(const float *pSrc, size_t count, int16_t *pDest, uint32_t *pDitherState) {
+		size_t clipped = 0;
+		for (size_t i = 0; i < count; i++) {
+			float sample = pSrc[i] * Int16Scale;
+			if (sample > MaxInt16 || sample < MinInt16) {
+				clipped++;
+			}
+			if (pDitherState) {
+				//The scalar kernel uses the first lane of both generators.
+				sample += (NextRandom(pDitherState[0]) >> 8) * UniformScale - (NextRandom(pDitherState[DitherLanes]) >> 8) * UniformScale;
+			}
+			//Written so that NaN ends up at the minimum, as it does in the SIMD kernels.
+			sample = sample > MinInt16 ? sample : MinInt16;
+			sample = sample < MaxInt16 ? sample : MaxInt16;
+			pDest[i] = static_cast<int16_t>(std::lrintf(sample));
+		}
+		return clipped;
+	}
+
+#if CPU_FEATURES_X86
+	inline __m128i NextRandomSSE2(__m128i state) {
+		state = _mm_xor_si128(state, _mm_slli_epi32(state, 13));
+		state = _mm_xor_si128(state, _mm_srli_epi32(state, 17));
+		return _mm_xor_si128(state, _mm_slli_epi32(state, 5));
+	}
+
+	inline __m128 UniformSSE2(__m128i random) {
+		return _mm_mul_ps(_mm_cvtepi32_ps(_mm_srli_epi32(random, 8)), _mm_set1_ps(UniformScale));
+	}
+
+	void Int16ToFloatSSE2(const int16_t *pSrc, size_t count, float *pDest) {
+		const __m128 vScale = _mm_set1_ps(Int16ToFloatScale);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + i));
+			//Sign extend to 32 bits by placing each sample in the high half and shifting back down.
+			__m128i low = _mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16);
+			__m128i high = _mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16);
+			_mm_storeu_ps(pDest + i, _mm_mul_ps(_mm_cvtepi32_ps(low), vScale));
+			_mm_storeu_ps(pDest + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(high), vScale));
+		}
+		Int16ToFloatScalar(pSrc + i, count - i, pDest + i);
+	}
+
+	void Int32ToFloatSSE2(const int32_t *pSrc, size_t count, float *pDest) {
+		const __m128 vScale = _mm_set1_ps(Int32ToFloatScale);
+		size_t i = 0;
+		for (; i + 4 <= count; i += 4) {
+			__m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pSrc + i));
+			_mm_storeu_ps(pDest + i, _mm_mul_ps(_mm_cvtepi32_ps(samples), vScale));
+		}
+		Int32ToFloatScalar(pSrc + i, count - i, pDest + i);
+	}
+
+	size_t FloatToInt16SSE2(const float *pSrc, size_t count, int16_t *pDest, uint32_t *pDitherState) {
+		const __m128 vScale = _mm_set1_ps(Int16Scale);
+		const __m128 vMax = _mm_set1_ps(MaxInt16);
+		const __m128 vMin = _mm_set1_ps(MinInt16);
+		__m128i stateA = _mm_setzero_si128();
+		__m128i stateB = _mm_setzero_si128();
+		if (pDitherState) {
+			stateA = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pDitherState));
+			stateB = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pDitherState + DitherLanes));
+		}
+		size_t clipped = 0;
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m128 low = _mm_mul_ps(_mm_loadu_ps(pSrc + i), vScale);
+			__m128 high = _mm_mul_ps(_mm_loadu_ps(pSrc + i + 4), vScale);
+			int clipMask = _mm_movemask_ps(_mm_or_ps(_mm_cmpgt_ps(low, vMax), _mm_cmplt_ps(low, vMin)))
+				| (_mm_movemask_ps(_mm_or_ps(_mm_cmpgt_ps(high, vMax), _mm_cmplt_ps(high, vMin))) << 4);
+			clipped += CountBits(static_cast<unsigned int>(clipMask));
+			if (pDitherState) {
+				stateA = NextRandomSSE2(stateA);
+				stateB = NextRandomSSE2(stateB);
+				low = _mm_add_ps(low, _mm_sub_ps(UniformSSE2(stateA), UniformSSE2(stateB)));
+				stateA = NextRandomSSE2(stateA);
+				stateB = NextRandomSSE2(stateB);
+				high = _mm_add_ps(high, _mm_sub_ps(UniformSSE2(stateA), UniformSSE2(stateB)));
+			}
+			low = _mm_min_ps(_mm_max_ps(low, vMin), vMax);
+			high = _mm_min_ps(_mm_max_ps(high, vMin), vMax);
+			__m128i packed = _mm_packs_epi32(_mm_cvtps_epi32(low), _mm_cvtps_epi32(high));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pDest + i), packed);
+		}
+		if (pDitherState) {
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pDitherState), stateA);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(pDitherState + DitherLanes), stateB);
+		}
+		return clipped + FloatToInt16Scalar(pSrc + i, count - i, pDest + i, pDitherState);
+	}
+
+	TARGET_AVX2 inline __m256i NextRandomAVX2(__m256i state) {
+		state = _mm256_xor_si256(state, _mm256_slli_epi32(state, 13));
+		state = _mm256_xor_si256(state, _mm256_srli_epi32(state, 17));
+		return _mm256_xor_si256(state, _mm256_slli_epi32(state, 5));
+	}
+
+	TARGET_AVX2 inline __m256 UniformAVX2(__m256i random) {
+		return _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_srli_epi32(random, 8)), _mm256_set1_ps(UniformScale));
+	}
+
+	TARGET_AVX2 void Int16ToFloatAVX2(const int16_t *pSrc, size_t count, float *pDest) {
+		const __m256 vScale = _mm256_set1_ps(Int16ToFloatScale);
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pSrc + i));
+			__m256i low = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(samples));
+			__m256i high = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(samples, 1));
+			_mm256_storeu_ps(pDest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(low), vScale));
+			_mm256_storeu_ps(pDest + i + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(high), vScale));
+		}
+		_mm256_zeroupper();
+		Int16ToFloatScalar(pSrc + i, count - i, pDest + i);
+	}
+
+	TARGET_AVX2 void Int32ToFloatAVX2(const int32_t *pSrc, size_t count, float *pDest) {
+		const __m256 vScale = _mm256_set1_ps(Int32ToFloatScale);
+		size_t i = 0;
+		for (; i + 8 <= count; i += 8) {
+			__m256i samples = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pSrc + i));
+			_mm256_storeu_ps(pDest + i, _mm256_mul_ps(_mm256_cvtepi32_ps(samples), vScale));
+		}
+		_mm256_zeroupper();
+		Int32ToFloatScalar(pSrc + i, count - i, pDest + i);
+	}
+
+	TARGET_AVX2 size_t FloatToInt16AVX2(const float *pSrc, size_t count, int16_t *pDest, uint32_t *pDitherState) {
+		const __m256 vScale = _mm256_set1_ps(Int16Scale);
+		const __m256 vMax = _mm256_set1_ps(MaxInt16);
+		const __m256 vMin = _mm256_set1_ps(MinInt16);
+		__m256i stateA = _mm256_setzero_si256();
+		__m256i stateB = _mm256_setzero_si256();
+		if (pDitherState) {
+			stateA = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pDitherState));
+			stateB = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(pDitherState + DitherLanes));
+		}
+		size_t clipped = 0;
+		size_t i = 0;
+		for (; i + 16 <= count; i += 16) {
+			__m256 low = _mm256_mul_ps(_mm256_loadu_ps(pSrc + i), vScale);
+			__m256 high = _mm256_mul_ps(_mm256_loadu_ps(pSrc + i + 8), vScale);
+			int clipMask = _mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(low, vMax, _CMP_GT_OQ), _mm256_cmp_ps(low, vMin, _CMP_LT_OQ)))
+				| (_mm256_movemask_ps(_mm256_or_ps(_mm256_cmp_ps(high, vMax, _CMP_GT_OQ), _mm256_cmp_ps(high, vMin, _CMP_LT_OQ))) << 8);
+			clipped += CountBits(static_cast<unsigned int>(clipMask));
+			if (pDitherState) {
+				stateA = NextRandomAVX2(stateA);
+				stateB = NextRandomAVX2(stateB);
+				low = _mm256_add_ps(low, _mm256_sub_ps(UniformAVX2(stateA), UniformAVX2(stateB)));
+				stateA = NextRandomAVX2(stateA);
+				stateB = NextRandomAVX2(stateB);
+				high = _mm256_add_ps(high, _mm256_sub_ps(UniformAVX2(stateA), UniformAVX2(stateB)));
+			}
+			low = _mm256_min_ps(_mm256_max_ps(low, vMin), vMax);
+			high = _mm256_min_ps(_mm256_max_ps(high, vMin), vMax);
+			//packs works within 128 bit lanes, so the 64 bit quarters are reordered afterwards.
+			__m256i packed = _mm256_packs_epi32(_mm256_cvtps_epi32(low), _mm256_cvtps_epi32(high));
+			packed = _mm256_permute4x64_epi64(packed, 0xD8);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(pDest + i), packed);
+		}
+		if (pDitherState) {
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(pDitherState), stateA);
+			_mm256_storeu_si256(reinterpret_cast<__m256i *>(pDitherState + DitherLanes), stateB);
+		}
+		_mm256_zeroupper();
+		return clipped + FloatToInt16Scalar(pSrc + i, count - i, pDest + i, pDitherState);
+	}
+#endif
+}
+
+AudioSampleConverter::AudioSampleConverter() :
+	AudioSampleConverter(AudioMixer::GetBestSupportedKernel())
+{
+}
+
+AudioSampleConverter::AudioSampleConverter(AudioMixerKernel kernel) :
+	m_Kernel(AudioMixerKernel::Scalar),
+	m_Int16ToFloat(Int16ToFloatScalar),
+	m_Int32ToFloat(Int32ToFloatScalar),
+	m_FloatToInt16(FloatToInt16Scalar),
+	m_IsDitherEnabled(false),
+	m_DitherState{}
+{
+	if (!AudioMixer::IsKernelSupported(kernel)) {
+		kernel = AudioMixer::GetBestSupportedKernel();
+	}
+	m_Kernel = kernel;
+#if CPU_FEATURES_X86
+	switch (kernel)
+	{
+		case AudioMixerKernel::AVX2:
+			m_Int16ToFloat = Int16ToFloatAVX2;
+			m_Int32ToFloat = Int32ToFloatAVX2;
+			m_FloatToInt16 = FloatToInt16AVX2;
+			break;
+		case AudioMixerKernel::SSE2:
+			m_Int16ToFloat = Int16ToFloatSSE2;
+			m_Int32ToFloat = Int32ToFloatSSE2;
+			m_FloatToInt16 = FloatToInt16SSE2;
+			break;
+		default:
+			break;
+	}
+#endif
+	//xorshift generators must not start at zero. Each gets a different seed, so the lanes are not correlated.
+	for (size_t i = 0; i < 2 * DITHER_LANES; i++) {
+		m_DitherState[i] = (0x9E3779B9u * static_cast<uint32_t>(i + 1)) ^ 0x5BD1E995u;
+	}
+}
+
+void AudioSampleConverter::SetDitherEnabled(bool isEnabled)
+{
+	m_IsDitherEnabled = isEnabled;
+}
+
+size_t AudioSampleConverter::GetSampleBytes(AudioSampleFormat format)
+{
+	switch (format)
+	{
+		case AudioSampleFormat::Int16:
+			return 2;
+		case AudioSampleFormat::Int24:
+			return 3;
+		default:
+			return 4;
+	}
+}
+
+void AudioSampleConverter::ToFloat(const void *pSrc, AudioSampleFormat format, size_t sampleCount, float *pDest) const
+{
+	switch (format)
+	{
+		case AudioSampleFormat::Int16:
+			m_Int16ToFloat(static_cast<const int16_t *>(pSrc), sampleCount, pDest);
+			break;
+		case AudioSampleFormat::Int24: {
+			//Packed 24-bit samples are rare enough on capture devices that they are not vectorized.
+			const uint8_t *pBytes = static_cast<const uint8_t *>(pSrc);
+			for (size_t i = 0; i < sampleCount; i++, pBytes += 3) {
+				uint32_t sample = (static_cast<uint32_t>(pBytes[0]) << 8) | (static_cast<uint32_t>(pBytes[1]) << 16) | (static_cast<uint32_t>(pBytes[2]) << 24);
+				pDest[i] = static_cast<float>(static_cast<int32_t>(sample)) * Int32ToFloatScale;
+			}
+			break;
+		}
+		case AudioSampleFormat::Int32:
+			m_Int32ToFloat(static_cast<const int32_t *>(pSrc), sampleCount, pDest);
+			break;
+		case AudioSampleFormat::Float32:
+			memcpy(pDest, pSrc, sampleCount * sizeof(float));
+			break;
+	}
+}
+
+size_t AudioSampleConverter::ToInt16(const float *pSrc, size_t sampleCount, int16_t *pDest)
+{
+	return m_FloatToInt16(pSrc, sampleCount, pDest, m_IsDitherEnabled ? m_DitherState : nullptr);
+}
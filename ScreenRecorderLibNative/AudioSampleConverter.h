@@ -0,0 +1,64 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "AudioMixer.h"
+
+enum class AudioSampleFormat {
+	Int16,
+	//24-bit signed integer, packed in 3 bytes.
+	Int24,
+	//32-bit signed integer, also used for 24-bit samples padded to 32 bits.
+	Int32,
+	Float32
+};
+
+/// <summary>
+/// Converts between the sample formats of capture devices and encoders and the 32-bit float samples audio is processed in, using the widest SIMD kernel the CPU supports.
+/// Float samples have full scale at 1, and may exceed it until they are converted back to integers.
+/// </summary>
+class AudioSampleConverter
+{
+public:
+	AudioSampleConverter();
+	explicit AudioSampleConverter(AudioMixerKernel kernel);
+
+	/// <summary>
+	/// Converts samples of the given format to float.
+	/// </summary>
+	/// <param name="pSrc">The samples to convert</param>
+	/// <param name="format">The format of pSrc</param>
+	/// <param name="sampleCount">The number of samples (not frames) in pSrc</param>
+	/// <param name="pDest">The destination buffer, with room for sampleCount samples</param>
+	void ToFloat(const void *pSrc, AudioSampleFormat format, size_t sampleCount, float *pDest) const;
+	/// <summary>
+	/// Converts float samples to 16-bit, adding triangular (TPDF) dither of +/-1 LSB if dither is enabled. Samples beyond full scale are clipped.
+	/// </summary>
+	/// <returns>The number of samples that were clipped</returns>
+	size_t ToInt16(const float *pSrc, size_t sampleCount, int16_t *pDest);
+
+	/// <summary>
+	/// Turns dither on or off for ToInt16. Dither turns the rounding error of 16-bit conversion, which is audible as distortion on quiet audio, into a constant noise floor at -96 dBFS.
+	/// </summary>
+	void SetDitherEnabled(bool isEnabled);
+	inline bool IsDitherEnabled() const { return m_IsDitherEnabled; }
+	inline AudioMixerKernel GetKernel() const { return m_Kernel; }
+
+	static size_t GetSampleBytes(AudioSampleFormat format);
+
+private:
+	//The widest kernel converts 8 samples at a time, so there are 8 independent dither generators.
+	static constexpr size_t DITHER_LANES = 8;
+
+	typedef void(*Int16ToFloatFunction)(const int16_t *pSrc, size_t count, float *pDest);
+	typedef void(*Int32ToFloatFunction)(const int32_t *pSrc, size_t count, float *pDest);
+	//Converts to 16 bit, with dither if pDitherState is not nullptr. Returns the number of clipped samples.
+	typedef size_t(*FloatToInt16Function)(const float *pSrc, size_t count, int16_t *pDest, uint32_t *pDitherState);
+
+	AudioMixerKernel m_Kernel;
+	Int16ToFloatFunction m_Int16ToFloat;
+	Int32ToFloatFunction m_Int32ToFloat;
+	FloatToInt16Function m_FloatToInt16;
+	bool m_IsDitherEnabled;
+	//Two xorshift generators per lane, whose uniform outputs are subtracted to give triangular dither. The first DITHER_LANES values are the first generator.
+	uint32_t m_DitherState[2 * DITHER_LANES];
+};
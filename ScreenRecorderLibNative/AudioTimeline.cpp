@@ -0,0 +1,128 @@
+#include "AudioTimeline.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	const int64_t HundredNanosPerSecond = 10000000;
+}
+
+AudioTimeline::AudioTimeline() :
+	m_SampleRate(0),
+	m_FramePosition(0)
+{
+}
+
+void AudioTimeline::Initialize(uint32_t sampleRate)
+{
+	m_SampleRate = sampleRate;
+	m_FramePosition = 0;
+}
+
+size_t AudioTimeline::Advance(int64_t position100Nanos)
+{
+	uint64_t targetPosition = HundredNanosToFrames(position100Nanos, m_SampleRate);
+	if (targetPosition <= m_FramePosition) {
+		return 0;
+	}
+	size_t frames = static_cast<size_t>(targetPosition - m_FramePosition);
+	m_FramePosition = targetPosition;
+	return frames;
+}
+
+int64_t AudioTimeline::GetPosition100Nanos() const
+{
+	return FramesToHundredNanos(m_FramePosition, m_SampleRate);
+}
+
+uint64_t AudioTimeline::HundredNanosToFrames(int64_t position100Nanos, uint32_t sampleRate)
+{
+	if (position100Nanos <= 0 || sampleRate == 0) {
+		return 0;
+	}
+	//Split in whole seconds and remainder to avoid overflow on long recordings.
+	uint64_t seconds = static_cast<uint64_t>(position100Nanos / HundredNanosPerSecond);
+	uint64_t remainder = static_cast<uint64_t>(position100Nanos % HundredNanosPerSecond);
+	return seconds * sampleRate + (remainder * sampleRate + HundredNanosPerSecond / 2) / HundredNanosPerSecond;
+}
+
+int64_t AudioTimeline::FramesToHundredNanos(uint64_t frames, uint32_t sampleRate)
+{
+	if (sampleRate == 0) {
+		return 0;
+	}
+	uint64_t seconds = frames / sampleRate;
+	uint64_t remainder = frames % sampleRate;
+	return static_cast<int64_t>(seconds * HundredNanosPerSecond + (remainder * HundredNanosPerSecond + sampleRate / 2) / sampleRate);
+}
+
+AudioDriftCompensator::AudioDriftCompensator() :
+	m_SampleRate(0),
+	m_TargetLatencyFrames(0),
+	m_HasLevel(false),
+	m_SmoothedLevel(0),
+	m_Drift(0),
+	m_RateAdjustment(1.0),
+	m_SecondsSinceReset(0),
+	m_Stats{}
+{
+}
+
+void AudioDriftCompensator::Initialize(uint32_t sampleRate, size_t targetLatencyFrames)
+{
+	m_SampleRate = sampleRate;
+	m_TargetLatencyFrames = targetLatencyFrames;
+	m_Drift = 0;
+	m_RateAdjustment = 1.0;
+	m_Stats = {};
+	ResetLatency();
+}
+
+void AudioDriftCompensator::ResetLatency()
+{
+	m_HasLevel = false;
+	m_SmoothedLevel = 0;
+	m_SecondsSinceReset = 0;
+	//Keep compensating the known drift until a new level is measured.
+	m_RateAdjustment = 1.0 + m_Drift;
+}
+
+double AudioDriftCompensator::Update(size_t bufferedFrames, size_t consumedFrames, size_t deliveredFrames)
+{
+	m_Stats.DeviceFrames += deliveredFrames;
+	m_Stats.TimelineFrames += consumedFrames;
+	if (m_SampleRate == 0 || consumedFrames == 0) {
+		return m_RateAdjustment;
+	}
+	double elapsedSeconds = static_cast<double>(consumedFrames) / m_SampleRate;
+	m_SecondsSinceReset += elapsedSeconds;
+	if (!m_HasLevel) {
+		m_SmoothedLevel = static_cast<double>(bufferedFrames);
+		m_HasLevel = true;
+	}
+	else {
+		double smoothing = (std::min)(1.0, elapsedSeconds / LEVEL_SMOOTHING_SECONDS);
+		m_SmoothedLevel += (bufferedFrames - m_SmoothedLevel) * smoothing;
+	}
+	double latencyErrorSeconds = (m_SmoothedLevel - m_TargetLatencyFrames) / m_SampleRate;
+
+	//The integral term converges on the relative clock drift, the proportional term pulls the buffer level back to the target.
+	m_Drift += latencyErrorSeconds * elapsedSeconds * INTEGRAL_GAIN;
+	m_Drift = (std::max)(-MAX_DRIFT, (std::min)(MAX_DRIFT, m_Drift));
+	double correction = m_Drift + latencyErrorSeconds * PROPORTIONAL_GAIN;
+	correction = (std::max)(-MAX_CORRECTION, (std::min)(MAX_CORRECTION, correction));
+	m_RateAdjustment = 1.0 + correction;
+
+	if (m_SecondsSinceReset > SETTLE_SECONDS) {
+		m_Stats.MaxLatencyErrorMillis = (std::max)(m_Stats.MaxLatencyErrorMillis, std::fabs(latencyErrorSeconds) * 1000);
+	}
+	return m_RateAdjustment;
+}
+
+AUDIO_DRIFT_STATS AudioDriftCompensator::GetStats() const
+{
+	AUDIO_DRIFT_STATS stats = m_Stats;
+	stats.DriftPpm = m_Drift * 1e6;
+	stats.CorrectionPpm = (m_RateAdjustment - 1.0) * 1e6;
+	stats.LatencyMillis = m_SampleRate > 0 ? m_SmoothedLevel * 1000 / m_SampleRate : 0;
+	return stats;
+}
@@ -0,0 +1,111 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+
+/// <summary>
+/// Maps the 100 nanosecond video timeline to audio sample positions, so the audio written for each video frame adds up to exactly the length of the video.
+/// Rounding is done on the absolute position, so it never accumulates.
+/// </summary>
+class AudioTimeline
+{
+public:
+	AudioTimeline();
+	void Initialize(uint32_t sampleRate);
+	/// <summary>
+	/// Returns the number of frames needed to fill the audio up to the given position on the video timeline, and advances the timeline past them.
+	/// Returns 0 if the position is not past the end of the audio already written.
+	/// </summary>
+	size_t Advance(int64_t position100Nanos);
+	/// <summary>
+	/// The number of frames written since the start of the timeline.
+	/// </summary>
+	inline uint64_t GetFramePosition() const { return m_FramePosition; }
+	/// <summary>
+	/// The exact end position of the frames written, in 100 nanosecond units.
+	/// </summary>
+	int64_t GetPosition100Nanos() const;
+	inline uint32_t GetSampleRate() const { return m_SampleRate; }
+
+	static uint64_t HundredNanosToFrames(int64_t position100Nanos, uint32_t sampleRate);
+	static int64_t FramesToHundredNanos(uint64_t frames, uint32_t sampleRate);
+private:
+	uint32_t m_SampleRate;
+	uint64_t m_FramePosition;
+};
+
+struct AUDIO_DRIFT_STATS
+{
+	//The estimated clock drift of the device against the video timeline, in parts per million. Positive if the device clock runs fast.
+	double DriftPpm = 0;
+	//The rate correction currently applied, in parts per million. Includes the drift estimate and the correction of the buffer level.
+	double CorrectionPpm = 0;
+	//The smoothed amount of audio buffered ahead of the timeline.
+	double LatencyMillis = 0;
+	//The largest deviation of the buffered audio from the target latency, after the stream settled.
+	double MaxLatencyErrorMillis = 0;
+	//Frames of silence inserted because the device did not deliver audio in time.
+	uint64_t UnderrunFrames = 0;
+	//Frames discarded because the device delivered far more audio than the timeline could take.
+	uint64_t DroppedFrames = 0;
+	//Frames delivered by the device and frames taken from it by the timeline.
+	uint64_t DeviceFrames = 0;
+	uint64_t TimelineFrames = 0;
+};
+
+/// <summary>
+/// Estimates the clock drift between an audio device and the video timeline from the amount of audio buffered for the device,
+/// and computes the resampling ratio that keeps the buffer at the target latency.
+/// Drift is corrected by resampling fractionally faster or slower, never by inserting silence or dropping audio.
+/// </summary>
+class AudioDriftCompensator
+{
+public:
+	AudioDriftCompensator();
+	/// <param name="sampleRate">The sample rate of the buffered audio</param>
+	/// <param name="targetLatencyFrames">The amount of audio to keep buffered, as margin against capture jitter.</param>
+	void Initialize(uint32_t sampleRate, size_t targetLatencyFrames);
+	/// <summary>
+	/// Forgets the buffer level, e.g. after the device stopped delivering audio. The drift estimate is kept, since it is a property of the device clock.
+	/// </summary>
+	void ResetLatency();
+	/// <summary>
+	/// Feeds the state of the buffer after a block was taken from it, and returns the rate adjustment to apply to the device audio.
+	/// A value above 1 means the device audio should be consumed faster, i.e. resampled to fewer frames.
+	/// </summary>
+	/// <param name="bufferedFrames">The frames left in the buffer</param>
+	/// <param name="consumedFrames">The frames taken from the buffer</param>
+	/// <param name="deliveredFrames">The frames the device added to the buffer since the last update</param>
+	double Update(size_t bufferedFrames, size_t consumedFrames, size_t deliveredFrames);
+	inline void AddUnderrun(size_t frames) { m_Stats.UnderrunFrames += frames; }
+	inline void AddDropped(size_t frames) { m_Stats.DroppedFrames += frames; }
+	inline double GetRateAdjustment() const { return m_RateAdjustment; }
+	inline size_t GetTargetLatencyFrames() const { return m_TargetLatencyFrames; }
+	/// <summary>
+	/// The buffer level above which audio is discarded to resynchronize, e.g. after the device delivered a large backlog at once.
+	/// </summary>
+	inline size_t GetMaxLatencyFrames() const { return m_TargetLatencyFrames * MAX_LATENCY_FACTOR + m_SampleRate / 10; }
+	AUDIO_DRIFT_STATS GetStats() const;
+
+private:
+	//Proportional gain, as rate correction per second of latency error. 10 ms off target gives a 500 ppm correction.
+	static constexpr double PROPORTIONAL_GAIN = 0.05;
+	//Integral gain, as rate correction per second of latency error per second.
+	static constexpr double INTEGRAL_GAIN = 0.002;
+	//Time constant of the buffer level smoothing, which filters out the jitter of capture packets and video frames.
+	static constexpr double LEVEL_SMOOTHING_SECONDS = 2.0;
+	//Time after a reset before latency errors count towards the statistics.
+	static constexpr double SETTLE_SECONDS = 10.0;
+	//The largest drift and correction applied, as a fraction of the sample rate.
+	static constexpr double MAX_DRIFT = 0.005;
+	static constexpr double MAX_CORRECTION = 0.01;
+	static const size_t MAX_LATENCY_FACTOR = 4;
+
+	uint32_t m_SampleRate;
+	size_t m_TargetLatencyFrames;
+	bool m_HasLevel;
+	double m_SmoothedLevel;
+	double m_Drift;
+	double m_RateAdjustment;
+	double m_SecondsSinceReset;
+	AUDIO_DRIFT_STATS m_Stats;
+};
@@ -0,0 +1,115 @@
+#pragma once
+#include <mfapi.h>
+#include <mfidl.h>
+#include <Shlwapi.h>
+#include "AudioBufferPool.h"
+
+/// <summary>
+/// IMFMediaBuffer over a pooled AudioBuffer, so audio can be handed to the sink writer without copying it into a new media buffer.
+/// The AudioBuffer goes back to its pool when the sink writer releases the media buffer.
+/// A silent AudioBuffer is only materialized as zeros when the media buffer is locked, i.e. when the encoder reads it.
+/// </summary>
+class CAudioMediaBuffer : public IMFMediaBuffer {
+
+public:
+	CAudioMediaBuffer(_In_ AudioBufferRef buffer) :
+		m_nRefCount(1),
+		m_Buffer(std::move(buffer)) {}
+	virtual ~CAudioMediaBuffer()
+	{
+	}
+
+	/// <summary>
+	/// Wraps the buffer in a media buffer with the current length set to the size of the audio buffer.
+	/// </summary>
+	static HRESULT Create(_In_ AudioBufferRef buffer, _Outptr_ IMFMediaBuffer **ppMediaBuffer) {
+		if (!ppMediaBuffer) {
+			return E_POINTER;
+		}
+		*ppMediaBuffer = nullptr;
+		if (!buffer) {
+			return E_INVALIDARG;
+		}
+		CAudioMediaBuffer *pMediaBuffer = new (std::nothrow) CAudioMediaBuffer(std::move(buffer));
+		if (!pMediaBuffer) {
+			return E_OUTOFMEMORY;
+		}
+		*ppMediaBuffer = pMediaBuffer;
+		return S_OK;
+	}
+
+	// IMFMediaBuffer methods
+	STDMETHODIMP Lock(BYTE **ppbBuffer, DWORD *pcbMaxLength, DWORD *pcbCurrentLength) {
+		if (!ppbBuffer) {
+			return E_POINTER;
+		}
+		if (m_Buffer->IsSilent()) {
+			AudioBufferRef materialized = AudioBufferPool::Materialize(m_Buffer);
+			if (!materialized) {
+				return E_OUTOFMEMORY;
+			}
+			m_Buffer = std::move(materialized);
+		}
+		*ppbBuffer = m_Buffer->GetData();
+		if (pcbMaxLength) {
+			*pcbMaxLength = static_cast<DWORD>(m_Buffer->GetCapacity());
+		}
+		if (pcbCurrentLength) {
+			*pcbCurrentLength = static_cast<DWORD>(m_Buffer->GetSize());
+		}
+		return S_OK;
+	}
+
+	STDMETHODIMP Unlock() {
+		return S_OK;
+	}
+
+	STDMETHODIMP GetCurrentLength(DWORD *pcbCurrentLength) {
+		if (!pcbCurrentLength) {
+			return E_POINTER;
+		}
+		*pcbCurrentLength = static_cast<DWORD>(m_Buffer->GetSize());
+		return S_OK;
+	}
+
+	STDMETHODIMP SetCurrentLength(DWORD cbCurrentLength) {
+		if (cbCurrentLength > m_Buffer->GetCapacity()) {
+			return E_INVALIDARG;
+		}
+		m_Buffer->SetSize(cbCurrentLength);
+		return S_OK;
+	}
+
+	STDMETHODIMP GetMaxLength(DWORD *pcbMaxLength) {
+		if (!pcbMaxLength) {
+			return E_POINTER;
+		}
+		*pcbMaxLength = static_cast<DWORD>(m_Buffer->GetCapacity());
+		return S_OK;
+	}
+
+	// IUnknown methods
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv) {
+		static const QITAB qit[] = {
+			QITABENT(CAudioMediaBuffer, IMFMediaBuffer),
+		{0}
+		};
+		return QISearch(this, qit, riid, ppv);
+	}
+
+	STDMETHODIMP_(ULONG) AddRef() {
+		return InterlockedIncrement(&m_nRefCount);
+	}
+
+	STDMETHODIMP_(ULONG) Release() {
+		ULONG refCount = InterlockedDecrement(&m_nRefCount);
+		if (refCount == 0) {
+			delete this;
+		}
+		return refCount;
+	}
+
+private:
+	volatile long m_nRefCount;
+	AudioBufferRef m_Buffer;
+};
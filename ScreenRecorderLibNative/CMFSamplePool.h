@@ -0,0 +1,163 @@
+#pragma once
+#include <mfapi.h>
+#include <mfidl.h>
+#include <Shlwapi.h>
+#include <atlbase.h>
+#include <map>
+#include <mutex>
+#include <new>
+#include "util.h"
+#include "RecyclingPool.h"
+
+/// <summary>
+/// The format and frame size of the samples in a CMFSamplePool, and the size of their memory buffer.
+/// </summary>
+struct MF_SAMPLE_POOL_KEY
+{
+	GUID Format;
+	UINT32 Width;
+	UINT32 Height;
+	//The size of the memory buffer of the sample, or 0 for samples that get their buffers from the caller, e.g. a DXGI surface buffer. Those buffers are removed when the sample is recycled.
+	DWORD BufferSize;
+
+	bool operator<(const MF_SAMPLE_POOL_KEY &other) const {
+		int format = memcmp(&Format, &other.Format, sizeof(GUID));
+		if (format != 0) {
+			return format < 0;
+		}
+		if (Width != other.Width) {
+			return Width < other.Width;
+		}
+		if (Height != other.Height) {
+			return Height < other.Height;
+		}
+		return BufferSize < other.BufferSize;
+	}
+};
+
+/// <summary>
+/// Pool of media samples, which are recycled when the sink writer and everyone else has released them, instead of allocating a new sample and frame sized buffer for every frame.
+/// The samples are tracked samples, which call back to the pool when their last reference is released. Samples in use keep the pool alive.
+/// </summary>
+class CMFSamplePool : public IMFAsyncCallback {
+
+public:
+	CMFSamplePool(_In_ size_t maxIdleSamplesPerKey = RecyclingPool<MF_SAMPLE_POOL_KEY, CComPtr<IMFSample>>::DEFAULT_MAX_IDLE_PER_KEY) :
+		m_nRefCount(1),
+		m_Pool(maxIdleSamplesPerKey) {}
+	virtual ~CMFSamplePool()
+	{
+	}
+
+	static HRESULT Create(_Outptr_ CMFSamplePool **ppPool) {
+		if (!ppPool) {
+			return E_POINTER;
+		}
+		*ppPool = new (std::nothrow) CMFSamplePool();
+		return *ppPool ? S_OK : E_OUTOFMEMORY;
+	}
+
+	/// <summary>
+	/// Returns a sample for the key, with a memory buffer of key.BufferSize bytes if that is not 0. The sample goes back to the pool once all references to it are released.
+	/// The sample has no attributes, time or duration set, and the current length of its buffer is 0.
+	/// </summary>
+	HRESULT AcquireSample(_In_ const MF_SAMPLE_POOL_KEY &key, _Outptr_ IMFSample **ppSample) {
+		if (!ppSample) {
+			return E_POINTER;
+		}
+		*ppSample = nullptr;
+		CComPtr<IMFSample> pSample;
+		if (!m_Pool.TryAcquire(key, pSample)) {
+			CComPtr<IMFTrackedSample> pNewSample;
+			RETURN_ON_BAD_HR(MFCreateTrackedSample(&pNewSample));
+			RETURN_ON_BAD_HR(pNewSample->QueryInterface(IID_PPV_ARGS(&pSample)));
+			if (key.BufferSize > 0) {
+				CComPtr<IMFMediaBuffer> pBuffer;
+				RETURN_ON_BAD_HR(MFCreateMemoryBuffer(key.BufferSize, &pBuffer));
+				RETURN_ON_BAD_HR(pSample->AddBuffer(pBuffer));
+			}
+		}
+		CComPtr<IMFTrackedSample> pTrackedSample;
+		RETURN_ON_BAD_HR(pSample->QueryInterface(IID_PPV_ARGS(&pTrackedSample)));
+		{
+			std::scoped_lock lock(m_Mutex);
+			m_Outstanding[pSample.p] = key;
+		}
+		//The allocator is called once, when the last reference is released, so it is set again every time the sample is handed out.
+		HRESULT hr = pTrackedSample->SetAllocator(this, nullptr);
+		if (FAILED(hr)) {
+			std::scoped_lock lock(m_Mutex);
+			m_Outstanding.erase(pSample.p);
+			return hr;
+		}
+		*ppSample = pSample.Detach();
+		return S_OK;
+	}
+
+	RECYCLING_POOL_STATS GetStats() {
+		return m_Pool.GetStats();
+	}
+
+	// IMFAsyncCallback methods
+	STDMETHODIMP GetParameters(DWORD *pdwFlags, DWORD *pdwQueue) {
+		return E_NOTIMPL;
+	}
+
+	STDMETHODIMP Invoke(IMFAsyncResult *pAsyncResult) {
+		CComPtr<IUnknown> pObject;
+		CComPtr<IMFSample> pSample;
+		RETURN_ON_BAD_HR(pAsyncResult->GetObject(&pObject));
+		RETURN_ON_BAD_HR(pObject->QueryInterface(IID_PPV_ARGS(&pSample)));
+		MF_SAMPLE_POOL_KEY key{};
+		{
+			std::scoped_lock lock(m_Mutex);
+			auto outstanding = m_Outstanding.find(pSample.p);
+			if (outstanding == m_Outstanding.end()) {
+				return E_UNEXPECTED;
+			}
+			key = outstanding->second;
+			m_Outstanding.erase(outstanding);
+		}
+		//Reset the sample to how it was created, so nothing carries over to the next frame.
+		pSample->DeleteAllItems();
+		if (key.BufferSize == 0) {
+			pSample->RemoveAllBuffers();
+		}
+		else {
+			CComPtr<IMFMediaBuffer> pBuffer;
+			if (SUCCEEDED(pSample->GetBufferByIndex(0, &pBuffer))) {
+				pBuffer->SetCurrentLength(0);
+			}
+		}
+		m_Pool.Recycle(key, std::move(pSample));
+		return S_OK;
+	}
+
+	// IUnknown methods
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv) {
+		static const QITAB qit[] = {
+			QITABENT(CMFSamplePool, IMFAsyncCallback),
+		{0}
+		};
+		return QISearch(this, qit, riid, ppv);
+	}
+
+	STDMETHODIMP_(ULONG) AddRef() {
+		return InterlockedIncrement(&m_nRefCount);
+	}
+
+	STDMETHODIMP_(ULONG) Release() {
+		ULONG refCount = InterlockedDecrement(&m_nRefCount);
+		if (refCount == 0) {
+			delete this;
+		}
+		return refCount;
+	}
+
+private:
+	volatile long m_nRefCount;
+	RecyclingPool<MF_SAMPLE_POOL_KEY, CComPtr<IMFSample>> m_Pool;
+	std::mutex m_Mutex;
+	//The keys of the samples that are handed out, which are needed to recycle them.
+	std::map<IMFSample *, MF_SAMPLE_POOL_KEY> m_Outstanding;
+};
@@ -0,0 +1,191 @@
+#pragma once
+#include <objidl.h>
+#include <atlbase.h>
+#include <memory>
+#include <new>
+#include "WriteBehindBuffer.h"
+
+/// <summary>
+/// A stream that buffers the writes to another stream with WriteBehindBuffer, e.g. so a managed stream is written in large chunks on a background thread, instead of once for every box a media sink writes.
+/// Reads, SetSize and Commit flush the buffer first, so they see everything written.
+/// </summary>
+class CWriteBehindStream : public IStream {
+
+public:
+	static HRESULT Create(_In_ IStream *pStream, _Outptr_ CWriteBehindStream **ppStream) {
+		if (!pStream || !ppStream) {
+			return E_POINTER;
+		}
+		*ppStream = nullptr;
+		LARGE_INTEGER zero{};
+		ULARGE_INTEGER position{};
+		HRESULT hr = pStream->Seek(zero, STREAM_SEEK_CUR, &position);
+		if (FAILED(hr)) {
+			return hr;
+		}
+		STATSTG stat{};
+		hr = pStream->Stat(&stat, STATFLAG_NONAME);
+		if (FAILED(hr)) {
+			return hr;
+		}
+		*ppStream = new (std::nothrow) CWriteBehindStream(pStream, position.QuadPart, stat.cbSize.QuadPart);
+		return *ppStream ? S_OK : E_OUTOFMEMORY;
+	}
+
+	/// <summary>
+	/// Writes everything buffered to the underlying stream.
+	/// </summary>
+	/// <returns>S_OK, or STG_E_WRITEFAULT if a write to the underlying stream failed, now or earlier</returns>
+	HRESULT Flush() {
+		return m_Buffer->Flush() ? S_OK : STG_E_WRITEFAULT;
+	}
+
+	WRITE_BEHIND_STATS GetStats() {
+		return m_Buffer->GetStats();
+	}
+
+	// IUnknown methods
+	STDMETHODIMP QueryInterface(REFIID riid, void **ppv) override
+	{
+		if (!ppv) {
+			return E_POINTER;
+		}
+		if (riid == __uuidof(IUnknown) || riid == __uuidof(ISequentialStream) || riid == __uuidof(IStream)) {
+			*ppv = static_cast<IStream *>(this);
+			AddRef();
+			return S_OK;
+		}
+		*ppv = nullptr;
+		return E_NOINTERFACE;
+	}
+	STDMETHODIMP_(ULONG) AddRef() override
+	{
+		return InterlockedIncrement(&m_nRefCount);
+	}
+	STDMETHODIMP_(ULONG) Release() override
+	{
+		ULONG uCount = InterlockedDecrement(&m_nRefCount);
+		if (uCount == 0)
+		{
+			delete this;
+		}
+		return uCount;
+	}
+
+	// ISequentialStream methods
+	STDMETHODIMP Read(_Out_writes_bytes_to_(cb, *pcbRead) void *pv, _In_ ULONG cb, _Out_opt_ ULONG *pcbRead) override
+	{
+		if (!m_Buffer->Flush()) {
+			return STG_E_WRITEFAULT;
+		}
+		ULONG read = 0;
+		HRESULT hr = m_Stream->Read(pv, cb, &read);
+		m_Buffer->Reset(m_Buffer->GetPosition() + read, m_Buffer->GetLength());
+		if (pcbRead) {
+			*pcbRead = read;
+		}
+		return hr;
+	}
+	STDMETHODIMP Write(_In_reads_bytes_(cb) const void *pv, _In_ ULONG cb, _Out_opt_ ULONG *pcbWritten) override
+	{
+		if (pcbWritten) {
+			*pcbWritten = 0;
+		}
+		if (!m_Buffer->Write(static_cast<const uint8_t *>(pv), cb)) {
+			return STG_E_WRITEFAULT;
+		}
+		if (pcbWritten) {
+			*pcbWritten = cb;
+		}
+		return S_OK;
+	}
+
+	// IStream methods
+	STDMETHODIMP Seek(_In_ LARGE_INTEGER dlibMove, _In_ DWORD dwOrigin, _Out_opt_ ULARGE_INTEGER *plibNewPosition) override
+	{
+		//Seeks stay in the buffer, and reach the underlying stream with the next write.
+		INT64 origin = 0;
+		switch (dwOrigin)
+		{
+			case STREAM_SEEK_SET: origin = 0; break;
+			case STREAM_SEEK_CUR: origin = static_cast<INT64>(m_Buffer->GetPosition()); break;
+			case STREAM_SEEK_END: origin = static_cast<INT64>(m_Buffer->GetLength()); break;
+			default: return STG_E_INVALIDFUNCTION;
+		}
+		INT64 position = origin + dlibMove.QuadPart;
+		if (position < 0) {
+			return STG_E_INVALIDFUNCTION;
+		}
+		m_Buffer->SetPosition(static_cast<UINT64>(position));
+		if (plibNewPosition) {
+			plibNewPosition->QuadPart = static_cast<UINT64>(position);
+		}
+		return S_OK;
+	}
+	STDMETHODIMP SetSize(_In_ ULARGE_INTEGER libNewSize) override
+	{
+		if (!m_Buffer->Flush()) {
+			return STG_E_WRITEFAULT;
+		}
+		HRESULT hr = m_Stream->SetSize(libNewSize);
+		if (SUCCEEDED(hr)) {
+			m_Buffer->Reset(m_Buffer->GetPosition(), libNewSize.QuadPart);
+		}
+		return hr;
+	}
+	STDMETHODIMP CopyTo(_In_ IStream *pstm, _In_ ULARGE_INTEGER cb, _Out_opt_ ULARGE_INTEGER *pcbRead, _Out_opt_ ULARGE_INTEGER *pcbWritten) override
+	{
+		return E_NOTIMPL;
+	}
+	STDMETHODIMP Commit(_In_ DWORD grfCommitFlags) override
+	{
+		if (!m_Buffer->Flush()) {
+			return STG_E_WRITEFAULT;
+		}
+		//Streams that do not buffer, such as the managed stream wrapper, do not implement Commit.
+		HRESULT hr = m_Stream->Commit(grfCommitFlags);
+		return hr == E_NOTIMPL ? S_OK : hr;
+	}
+	STDMETHODIMP Revert() override { return E_NOTIMPL; }
+	STDMETHODIMP LockRegion(_In_ ULARGE_INTEGER libOffset, _In_ ULARGE_INTEGER cb, _In_ DWORD dwLockType) override { return E_NOTIMPL; }
+	STDMETHODIMP UnlockRegion(_In_ ULARGE_INTEGER libOffset, _In_ ULARGE_INTEGER cb, _In_ DWORD dwLockType) override { return E_NOTIMPL; }
+	STDMETHODIMP Stat(_Out_ STATSTG *pstatstg, _In_ DWORD grfStatFlag) override
+	{
+		HRESULT hr = m_Stream->Stat(pstatstg, grfStatFlag);
+		if (SUCCEEDED(hr)) {
+			//The underlying stream does not have the buffered writes yet.
+			pstatstg->cbSize.QuadPart = m_Buffer->GetLength();
+		}
+		return hr;
+	}
+	STDMETHODIMP Clone(_Outptr_ IStream **ppstm) override { return E_NOTIMPL; }
+
+private:
+	CWriteBehindStream(_In_ IStream *pStream, _In_ UINT64 position, _In_ UINT64 length) :
+		m_nRefCount(1),
+		m_Stream(pStream)
+	{
+		IStream *pTarget = pStream;
+		m_Buffer = std::make_unique<WriteBehindBuffer>(
+			[pTarget](const uint8_t *pData, size_t size) {
+				ULONG written = 0;
+				return SUCCEEDED(pTarget->Write(pData, static_cast<ULONG>(size), &written)) && written == size;
+			},
+			[pTarget](uint64_t position) {
+				LARGE_INTEGER move{};
+				move.QuadPart = static_cast<LONGLONG>(position);
+				return SUCCEEDED(pTarget->Seek(move, STREAM_SEEK_SET, nullptr));
+			},
+			position,
+			length);
+	}
+	virtual ~CWriteBehindStream()
+	{
+		//Flushes what is left, before the underlying stream is released.
+		m_Buffer.reset();
+	}
+
+	long m_nRefCount;
+	CComPtr<IStream> m_Stream;
+	std::unique_ptr<WriteBehindBuffer> m_Buffer;
+};
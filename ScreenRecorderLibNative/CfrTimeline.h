@@ -0,0 +1,172 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+
+/// <summary>
+/// How a fixed framerate recording writes the frames where nothing changed since the frame before.
+/// </summary>
+enum class CfrRepeatMode {
+	//Render and encode every frame, also when it repeats the frame before.
+	Encode,
+	//Write the rendered texture of the frame before again, without copying or processing it.
+	Reference,
+	//Extend the duration of the frame before, so repeated frames are not written at all. Frames are held back until the next change, or until they reach the longest sample duration.
+	Extend
+};
+
+struct CFR_TIMELINE_STATS
+{
+	//The new frames added, and the samples written for them and their repeats.
+	uint64_t FrameCount = 0;
+	uint64_t SampleCount = 0;
+	//The frame intervals that repeated the frame before, because nothing changed or the frame was late.
+	uint64_t DuplicateCount = 0;
+	//The duplicates written as a sample that refers to the texture before, and the duplicates merged into the duration of the sample before.
+	uint64_t ReferencedCount = 0;
+	uint64_t ElidedCount = 0;
+	//The updates of the capture sources that were replaced by a newer update before a frame was written.
+	uint64_t DroppedCount = 0;
+};
+
+/// <summary>
+/// The timeline of frames written at a fixed framerate. New frames are added with the duration the frame pacer gave them, and frames where nothing changed repeat the frame before, according to the repeat mode.
+/// The frame type is a reference to a rendered frame, e.g. a texture, that is not changed after it is added, so it can be written again without a copy.
+/// Keeps the start position of each sample, and counts duplicate and dropped frames.
+/// </summary>
+template <typename T>
+class CfrTimeline
+{
+public:
+	//Writes a sample of a frame. Returns false if writing failed.
+	typedef std::function<bool(const T &frame, int64_t startPos100Nanos, int64_t duration100Nanos)> WriteFunction;
+
+	/// <param name="mode">How frames that repeat the frame before are written</param>
+	/// <param name="interval100Nanos">The duration of a frame at the fixed framerate, used to count duplicates. 0 to not count them</param>
+	/// <param name="maxSampleDuration100Nanos">With CfrRepeatMode::Extend, the longest a sample is extended to before the frame is written</param>
+	/// <param name="write">Writes samples</param>
+	CfrTimeline(CfrRepeatMode mode, int64_t interval100Nanos, int64_t maxSampleDuration100Nanos, WriteFunction write) :
+		m_Mode(mode),
+		m_Interval(interval100Nanos),
+		m_MaxSampleDuration(maxSampleDuration100Nanos),
+		m_Write(write),
+		m_Frame{},
+		m_HasFrame(false),
+		m_IsHeld(false),
+		m_HeldDuration(0),
+		m_Position(0),
+		m_Stats{}
+	{
+	}
+
+	CfrTimeline(const CfrTimeline &) = delete;
+	CfrTimeline &operator=(const CfrTimeline &) = delete;
+
+	/// <summary>
+	/// Adds a new frame after the frame before it. With CfrRepeatMode::Extend, the frame is held until it is followed by another, or is extended to the longest sample duration. Otherwise it is written right away.
+	/// </summary>
+	/// <param name="frame">The rendered frame</param>
+	/// <param name="duration100Nanos">The duration of the frame</param>
+	/// <param name="updateCount">The number of source updates in the frame. 0 if the frame was rendered again without a change</param>
+	/// <returns>false if writing a sample failed</returns>
+	bool AddFrame(const T &frame, int64_t duration100Nanos, uint32_t updateCount)
+	{
+		if (!WriteHeldFrame()) {
+			return false;
+		}
+		uint64_t intervals = GetIntervals(duration100Nanos);
+		m_Stats.FrameCount++;
+		m_Stats.DuplicateCount += updateCount == 0 ? intervals : (intervals > 0 ? intervals - 1 : 0);
+		m_Stats.DroppedCount += updateCount > 1 ? updateCount - 1 : 0;
+		m_Frame = frame;
+		m_HasFrame = true;
+		m_IsHeld = true;
+		m_HeldDuration = duration100Nanos;
+		if (m_Mode != CfrRepeatMode::Extend || m_HeldDuration >= m_MaxSampleDuration) {
+			return WriteHeldFrame();
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Repeats the frame before, without rendering it again. Must only be called after a frame is added.
+	/// </summary>
+	/// <returns>false if there is no frame to repeat, or if writing a sample failed</returns>
+	bool RepeatFrame(int64_t duration100Nanos)
+	{
+		if (!m_HasFrame) {
+			return false;
+		}
+		uint64_t intervals = GetIntervals(duration100Nanos);
+		m_Stats.DuplicateCount += intervals;
+		if (m_Mode == CfrRepeatMode::Extend && m_IsHeld) {
+			m_Stats.ElidedCount += intervals;
+			m_HeldDuration += duration100Nanos;
+		}
+		else {
+			//The frame before was already written, so the repeat starts a sample of its own.
+			m_Stats.ReferencedCount += intervals;
+			m_IsHeld = true;
+			m_HeldDuration = duration100Nanos;
+		}
+		if (m_Mode != CfrRepeatMode::Extend || m_HeldDuration >= m_MaxSampleDuration) {
+			return WriteHeldFrame();
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Writes the frame that is held, and releases the frame, so the next frame must be added. Used at the end of the recording, and before the frames are invalidated.
+	/// </summary>
+	/// <returns>false if writing a sample failed</returns>
+	bool Flush()
+	{
+		bool isWritten = WriteHeldFrame();
+		m_Frame = T{};
+		m_HasFrame = false;
+		return isWritten;
+	}
+
+	//Whether there is a frame to repeat.
+	inline bool HasFrame() const { return m_HasFrame; }
+	//The end of the timeline, including the frame that is held.
+	inline int64_t GetPosition() const { return m_Position + (m_IsHeld ? m_HeldDuration : 0); }
+	inline CFR_TIMELINE_STATS GetStats() const { return m_Stats; }
+
+private:
+	const CfrRepeatMode m_Mode;
+	const int64_t m_Interval;
+	const int64_t m_MaxSampleDuration;
+	WriteFunction m_Write;
+	//The last frame added, which repeats refer to.
+	T m_Frame;
+	bool m_HasFrame;
+	//Whether the frame has a sample that is not written yet, and its duration so far.
+	bool m_IsHeld;
+	int64_t m_HeldDuration;
+	//The start of the next sample.
+	int64_t m_Position;
+	CFR_TIMELINE_STATS m_Stats;
+
+	bool WriteHeldFrame()
+	{
+		if (!m_IsHeld) {
+			return true;
+		}
+		m_IsHeld = false;
+		if (!m_Write(m_Frame, m_Position, m_HeldDuration)) {
+			return false;
+		}
+		m_Position += m_HeldDuration;
+		m_Stats.SampleCount++;
+		return true;
+	}
+
+	//The number of frame intervals in a duration, rounded to the nearest.
+	uint64_t GetIntervals(int64_t duration100Nanos) const
+	{
+		if (m_Interval <= 0 || duration100Nanos <= 0) {
+			return 0;
+		}
+		return static_cast<uint64_t>((duration100Nanos + m_Interval / 2) / m_Interval);
+	}
+};
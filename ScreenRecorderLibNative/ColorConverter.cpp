@@ -0,0 +1,530 @@
+#include "ColorConverter.h"
+#include "CpuFeatures.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#if CPU_FEATURES_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+	//Coefficients are scaled by 2^14, which keeps the largest one in 16 bits for the multiply-add instructions.
+	const int CoefficientBits = 14;
+	//Frames smaller than this many pixels per band are not worth handing to another thread.
+	const size_t MinBandPixels = 64 * 1024;
+	const uint32_t MaxThreadCount = 8;
+
+	inline int32_t Clamp(int32_t value, int32_t max) {
+		return value < 0 ? 0 : (value > max ? max : value);
+	}
+
+	inline int32_t LumaScalar(const uint8_t *pPixel, const ColorConverter::COEFFICIENTS &c) {
+		return Clamp((c.Y[0] * pPixel[0] + c.Y[1] * pPixel[1] + c.Y[2] * pPixel[2] + c.YBias) >> c.YShift, c.Max);
+	}
+
+	template <YuvFormat Format>
+	inline void StoreLuma(uint8_t *pRow, uint32_t x, int32_t y) {
+		if constexpr (Format == YuvFormat::P010) {
+			reinterpret_cast<uint16_t *>(pRow)[x] = static_cast<uint16_t>(y << 6);
+		}
+		else {
+			pRow[x] = static_cast<uint8_t>(y);
+		}
+	}
+
+	//Stores the chroma of the 2x2 block starting at column x. pU is the interleaved UV row for NV12 and P010.
+	template <YuvFormat Format>
+	inline void StoreChroma(uint8_t *pU, uint8_t *pV, uint32_t x, int32_t u, int32_t v) {
+		if constexpr (Format == YuvFormat::P010) {
+			reinterpret_cast<uint16_t *>(pU)[x] = static_cast<uint16_t>(u << 6);
+			reinterpret_cast<uint16_t *>(pU)[x + 1] = static_cast<uint16_t>(v << 6);
+		}
+		else if constexpr (Format == YuvFormat::I420) {
+			pU[x / 2] = static_cast<uint8_t>(u);
+			pV[x / 2] = static_cast<uint8_t>(v);
+		}
+		else {
+			pU[x] = static_cast<uint8_t>(u);
+			pU[x + 1] = static_cast<uint8_t>(v);
+		}
+	}
+
+	template <YuvFormat Format>
+	void ConvertRowPairScalar(const uint8_t *pRow0, const uint8_t *pRow1, uint32_t x, uint32_t width, uint8_t *pY0, uint8_t *pY1, uint8_t *pU, uint8_t *pV, const ColorConverter::COEFFICIENTS &c) {
+		for (; x < width; x += 2) {
+			const uint8_t *p00 = pRow0 + 4 * static_cast<size_t>(x);
+			const uint8_t *p10 = pRow1 + 4 * static_cast<size_t>(x);
+			StoreLuma<Format>(pY0, x, LumaScalar(p00, c));
+			StoreLuma<Format>(pY0, x + 1, LumaScalar(p00 + 4, c));
+			StoreLuma<Format>(pY1, x, LumaScalar(p10, c));
+			StoreLuma<Format>(pY1, x + 1, LumaScalar(p10 + 4, c));
+			int32_t b = p00[0] + p00[4] + p10[0] + p10[4];
+			int32_t g = p00[1] + p00[5] + p10[1] + p10[5];
+			int32_t r = p00[2] + p00[6] + p10[2] + p10[6];
+			int32_t u = Clamp((c.U[0] * b + c.U[1] * g + c.U[2] * r + c.UVBias) >> c.UVShift, c.Max);
+			int32_t v = Clamp((c.V[0] * b + c.V[1] * g + c.V[2] * r + c.UVBias) >> c.UVShift, c.Max);
+			StoreChroma<Format>(pU, pV, x, u, v);
+		}
+	}
+
+	//The rows of a row pair in each plane.
+	struct ROW_PAIR
+	{
+		const uint8_t *Src0, *Src1;
+		uint8_t *Y0, *Y1, *U, *V;
+
+		ROW_PAIR(const uint8_t *pSrc, size_t srcStride, const YUV_IMAGE &dest, uint32_t pair) {
+			Src0 = pSrc + 2 * pair * srcStride;
+			Src1 = Src0 + srcStride;
+			Y0 = dest.Planes[0] + 2 * pair * dest.Strides[0];
+			Y1 = Y0 + dest.Strides[0];
+			U = dest.Planes[1] + pair * dest.Strides[1];
+			V = dest.Planes[2] ? dest.Planes[2] + pair * dest.Strides[2] : nullptr;
+		}
+	};
+
+	template <YuvFormat Format>
+	void ConvertRowsScalar(const uint8_t *pSrc, size_t srcStride, uint32_t width, uint32_t rowPairs, const YUV_IMAGE &dest, const ColorConverter::COEFFICIENTS &c) {
+		for (uint32_t pair = 0; pair < rowPairs; pair++) {
+			ROW_PAIR rows(pSrc, srcStride, dest, pair);
+			ConvertRowPairScalar<Format>(rows.Src0, rows.Src1, 0, width, rows.Y0, rows.Y1, rows.U, rows.V, c);
+		}
+	}
+
+#if CPU_FEATURES_X86
+	//Returns the luma of 8 pixels as 16-bit values.
+	TARGET_SSE41 inline __m128i LumaSSE41(__m128i px0to3, __m128i px4to7, __m128i coefficients, __m128i bias, __m128i shift) {
+		const __m128i zero = _mm_setzero_si128();
+		__m128i sum0 = _mm_hadd_epi32(
+			_mm_madd_epi16(_mm_cvtepu8_epi16(px0to3), coefficients),
+			_mm_madd_epi16(_mm_unpackhi_epi8(px0to3, zero), coefficients));
+		__m128i sum1 = _mm_hadd_epi32(
+			_mm_madd_epi16(_mm_cvtepu8_epi16(px4to7), coefficients),
+			_mm_madd_epi16(_mm_unpackhi_epi8(px4to7, zero), coefficients));
+		sum0 = _mm_sra_epi32(_mm_add_epi32(sum0, bias), shift);
+		sum1 = _mm_sra_epi32(_mm_add_epi32(sum1, bias), shift);
+		return _mm_packs_epi32(sum0, sum1);
+	}
+
+	//Returns one chroma component of the 4 2x2 blocks of 8 pixels from the pixel sums of the two rows, two pixels per register.
+	TARGET_SSE41 inline __m128i ChromaSSE41(const __m128i sums[4], __m128i coefficients, __m128i bias, __m128i shift) {
+		__m128i pixels0to3 = _mm_hadd_epi32(_mm_madd_epi16(sums[0], coefficients), _mm_madd_epi16(sums[1], coefficients));
+		__m128i pixels4to7 = _mm_hadd_epi32(_mm_madd_epi16(sums[2], coefficients), _mm_madd_epi16(sums[3], coefficients));
+		return _mm_sra_epi32(_mm_add_epi32(_mm_hadd_epi32(pixels0to3, pixels4to7), bias), shift);
+	}
+
+	TARGET_SSE41 inline __m128i Clamp10SSE41(__m128i values) {
+		return _mm_min_epi16(_mm_max_epi16(values, _mm_setzero_si128()), _mm_set1_epi16(1023));
+	}
+
+	template <YuvFormat Format>
+	TARGET_SSE41 void ConvertRowsSSE41(const uint8_t *pSrc, size_t srcStride, uint32_t width, uint32_t rowPairs, const YUV_IMAGE &dest, const ColorConverter::COEFFICIENTS &c) {
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i yCoefficients = _mm_setr_epi16(c.Y[0], c.Y[1], c.Y[2], 0, c.Y[0], c.Y[1], c.Y[2], 0);
+		const __m128i uCoefficients = _mm_setr_epi16(c.U[0], c.U[1], c.U[2], 0, c.U[0], c.U[1], c.U[2], 0);
+		const __m128i vCoefficients = _mm_setr_epi16(c.V[0], c.V[1], c.V[2], 0, c.V[0], c.V[1], c.V[2], 0);
+		const __m128i yBias = _mm_set1_epi32(c.YBias);
+		const __m128i uvBias = _mm_set1_epi32(c.UVBias);
+		const __m128i yShift = _mm_cvtsi32_si128(c.YShift);
+		const __m128i uvShift = _mm_cvtsi32_si128(c.UVShift);
+		const uint32_t vectorWidth = width & ~7u;
+		for (uint32_t pair = 0; pair < rowPairs; pair++) {
+			ROW_PAIR rows(pSrc, srcStride, dest, pair);
+			for (uint32_t x = 0; x < vectorWidth; x += 8) {
+				__m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.Src0 + 4 * static_cast<size_t>(x)));
+				__m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.Src0 + 4 * static_cast<size_t>(x) + 16));
+				__m128i b0 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.Src1 + 4 * static_cast<size_t>(x)));
+				__m128i b1 = _mm_loadu_si128(reinterpret_cast<const __m128i *>(rows.Src1 + 4 * static_cast<size_t>(x) + 16));
+				__m128i y0 = LumaSSE41(a0, a1, yCoefficients, yBias, yShift);
+				__m128i y1 = LumaSSE41(b0, b1, yCoefficients, yBias, yShift);
+
+				const __m128i sums[4] = {
+					_mm_add_epi16(_mm_cvtepu8_epi16(a0), _mm_cvtepu8_epi16(b0)),
+					_mm_add_epi16(_mm_unpackhi_epi8(a0, zero), _mm_unpackhi_epi8(b0, zero)),
+					_mm_add_epi16(_mm_cvtepu8_epi16(a1), _mm_cvtepu8_epi16(b1)),
+					_mm_add_epi16(_mm_unpackhi_epi8(a1, zero), _mm_unpackhi_epi8(b1, zero))
+				};
+				__m128i u = ChromaSSE41(sums, uCoefficients, uvBias, uvShift);
+				__m128i v = ChromaSSE41(sums, vCoefficients, uvBias, uvShift);
+
+				if constexpr (Format == YuvFormat::P010) {
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(rows.Y0 + 2 * static_cast<size_t>(x)), _mm_slli_epi16(Clamp10SSE41(y0), 6));
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(rows.Y1 + 2 * static_cast<size_t>(x)), _mm_slli_epi16(Clamp10SSE41(y1), 6));
+					__m128i uv = _mm_unpacklo_epi16(_mm_packs_epi32(u, u), _mm_packs_epi32(v, v));
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(rows.U + 2 * static_cast<size_t>(x)), _mm_slli_epi16(Clamp10SSE41(uv), 6));
+				}
+				else {
+					_mm_storel_epi64(reinterpret_cast<__m128i *>(rows.Y0 + x), _mm_packus_epi16(y0, y0));
+					_mm_storel_epi64(reinterpret_cast<__m128i *>(rows.Y1 + x), _mm_packus_epi16(y1, y1));
+					if constexpr (Format == YuvFormat::I420) {
+						__m128i planar = _mm_packus_epi16(_mm_packs_epi32(u, v), zero);
+						int32_t uBytes = _mm_cvtsi128_si32(planar);
+						int32_t vBytes = _mm_cvtsi128_si32(_mm_srli_si128(planar, 4));
+						memcpy(rows.U + x / 2, &uBytes, sizeof(uBytes));
+						memcpy(rows.V + x / 2, &vBytes, sizeof(vBytes));
+					}
+					else {
+						__m128i uv = _mm_unpacklo_epi16(_mm_packs_epi32(u, u), _mm_packs_epi32(v, v));
+						_mm_storel_epi64(reinterpret_cast<__m128i *>(rows.U + x), _mm_packus_epi16(uv, uv));
+					}
+				}
+			}
+			ConvertRowPairScalar<Format>(rows.Src0, rows.Src1, vectorWidth, width, rows.Y0, rows.Y1, rows.U, rows.V, c);
+		}
+	}
+
+	//Returns the luma of 16 pixels as 16-bit values, in order.
+	TARGET_AVX2 inline __m256i LumaAVX2(__m256i px0to7, __m256i px8to15, __m256i coefficients, __m256i bias, __m128i shift) {
+		const __m256i zero = _mm256_setzero_si256();
+		//Unpacking works within 128-bit lanes, so the sums come out as pixels 0-3 | 4-7 and 8-11 | 12-15.
+		__m256i sum0 = _mm256_hadd_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi8(px0to7, zero), coefficients),
+			_mm256_madd_epi16(_mm256_unpackhi_epi8(px0to7, zero), coefficients));
+		__m256i sum1 = _mm256_hadd_epi32(
+			_mm256_madd_epi16(_mm256_unpacklo_epi8(px8to15, zero), coefficients),
+			_mm256_madd_epi16(_mm256_unpackhi_epi8(px8to15, zero), coefficients));
+		sum0 = _mm256_sra_epi32(_mm256_add_epi32(sum0, bias), shift);
+		sum1 = _mm256_sra_epi32(_mm256_add_epi32(sum1, bias), shift);
+		return _mm256_permute4x64_epi64(_mm256_packs_epi32(sum0, sum1), 0xD8);
+	}
+
+	//Returns one chroma component of the 8 2x2 blocks of 16 pixels from the pixel sums of the two rows, in order.
+	TARGET_AVX2 inline __m256i ChromaAVX2(const __m256i sums[4], __m256i coefficients, __m256i bias, __m128i shift) {
+		__m256i pixels0 = _mm256_hadd_epi32(_mm256_madd_epi16(sums[0], coefficients), _mm256_madd_epi16(sums[1], coefficients));
+		__m256i pixels1 = _mm256_hadd_epi32(_mm256_madd_epi16(sums[2], coefficients), _mm256_madd_epi16(sums[3], coefficients));
+		//The blocks come out as 0, 1, 4, 5 | 2, 3, 6, 7.
+		__m256i blocks = _mm256_sra_epi32(_mm256_add_epi32(_mm256_hadd_epi32(pixels0, pixels1), bias), shift);
+		return _mm256_permutevar8x32_epi32(blocks, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+	}
+
+	TARGET_AVX2 inline __m256i Clamp10AVX2(__m256i values) {
+		return _mm256_min_epi16(_mm256_max_epi16(values, _mm256_setzero_si256()), _mm256_set1_epi16(1023));
+	}
+
+	//Interleaves 8 U and 8 V values into 16-bit UV pairs.
+	TARGET_AVX2 inline __m256i InterleaveChromaAVX2(__m256i u, __m256i v) {
+		//Packing gives U0-3 V0-3 | U4-7 V4-7, which is interleaved within each lane.
+		const __m256i interleave = _mm256_setr_epi8(
+			0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15,
+			0, 1, 8, 9, 2, 3, 10, 11, 4, 5, 12, 13, 6, 7, 14, 15);
+		return _mm256_shuffle_epi8(_mm256_packs_epi32(u, v), interleave);
+	}
+
+	template <YuvFormat Format>
+	TARGET_AVX2 void ConvertRowsAVX2(const uint8_t *pSrc, size_t srcStride, uint32_t width, uint32_t rowPairs, const YUV_IMAGE &dest, const ColorConverter::COEFFICIENTS &c) {
+		const __m256i zero = _mm256_setzero_si256();
+		const __m256i yCoefficients = _mm256_setr_epi16(c.Y[0], c.Y[1], c.Y[2], 0, c.Y[0], c.Y[1], c.Y[2], 0, c.Y[0], c.Y[1], c.Y[2], 0, c.Y[0], c.Y[1], c.Y[2], 0);
+		const __m256i uCoefficients = _mm256_setr_epi16(c.U[0], c.U[1], c.U[2], 0, c.U[0], c.U[1], c.U[2], 0, c.U[0], c.U[1], c.U[2], 0, c.U[0], c.U[1], c.U[2], 0);
+		const __m256i vCoefficients = _mm256_setr_epi16(c.V[0], c.V[1], c.V[2], 0, c.V[0], c.V[1], c.V[2], 0, c.V[0], c.V[1], c.V[2], 0, c.V[0], c.V[1], c.V[2], 0);
+		const __m256i yBias = _mm256_set1_epi32(c.YBias);
+		const __m256i uvBias = _mm256_set1_epi32(c.UVBias);
+		const __m128i yShift = _mm_cvtsi32_si128(c.YShift);
+		const __m128i uvShift = _mm_cvtsi32_si128(c.UVShift);
+		const uint32_t vectorWidth = width & ~15u;
+		for (uint32_t pair = 0; pair < rowPairs; pair++) {
+			ROW_PAIR rows(pSrc, srcStride, dest, pair);
+			for (uint32_t x = 0; x < vectorWidth; x += 16) {
+				__m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.Src0 + 4 * static_cast<size_t>(x)));
+				__m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.Src0 + 4 * static_cast<size_t>(x) + 32));
+				__m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.Src1 + 4 * static_cast<size_t>(x)));
+				__m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(rows.Src1 + 4 * static_cast<size_t>(x) + 32));
+				__m256i y0 = LumaAVX2(a0, a1, yCoefficients, yBias, yShift);
+				__m256i y1 = LumaAVX2(b0, b1, yCoefficients, yBias, yShift);
+
+				const __m256i sums[4] = {
+					_mm256_add_epi16(_mm256_unpacklo_epi8(a0, zero), _mm256_unpacklo_epi8(b0, zero)),
+					_mm256_add_epi16(_mm256_unpackhi_epi8(a0, zero), _mm256_unpackhi_epi8(b0, zero)),
+					_mm256_add_epi16(_mm256_unpacklo_epi8(a1, zero), _mm256_unpacklo_epi8(b1, zero)),
+					_mm256_add_epi16(_mm256_unpackhi_epi8(a1, zero), _mm256_unpackhi_epi8(b1, zero))
+				};
+				__m256i u = ChromaAVX2(sums, uCoefficients, uvBias, uvShift);
+				__m256i v = ChromaAVX2(sums, vCoefficients, uvBias, uvShift);
+
+				if constexpr (Format == YuvFormat::P010) {
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(rows.Y0 + 2 * static_cast<size_t>(x)), _mm256_slli_epi16(Clamp10AVX2(y0), 6));
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(rows.Y1 + 2 * static_cast<size_t>(x)), _mm256_slli_epi16(Clamp10AVX2(y1), 6));
+					_mm256_storeu_si256(reinterpret_cast<__m256i *>(rows.U + 2 * static_cast<size_t>(x)), _mm256_slli_epi16(Clamp10AVX2(InterleaveChromaAVX2(u, v)), 6));
+				}
+				else {
+					//Packing to bytes works within lanes, so the low 64 bits of each lane are gathered into the low 128 bits.
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(rows.Y0 + x), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(y0, y0), 0xD8)));
+					_mm_storeu_si128(reinterpret_cast<__m128i *>(rows.Y1 + x), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(y1, y1), 0xD8)));
+					if constexpr (Format == YuvFormat::I420) {
+						//U0-3 U4-7 | V0-3 V4-7 after the permute, and U0-7 | V0-7 as bytes.
+						__m256i planar = _mm256_permute4x64_epi64(_mm256_packs_epi32(u, v), 0xD8);
+						planar = _mm256_packus_epi16(planar, planar);
+						_mm_storel_epi64(reinterpret_cast<__m128i *>(rows.U + x / 2), _mm256_castsi256_si128(planar));
+						_mm_storel_epi64(reinterpret_cast<__m128i *>(rows.V + x / 2), _mm256_extracti128_si256(planar, 1));
+					}
+					else {
+						__m256i uv = InterleaveChromaAVX2(u, v);
+						_mm_storeu_si128(reinterpret_cast<__m128i *>(rows.U + x), _mm256_castsi256_si128(_mm256_permute4x64_epi64(_mm256_packus_epi16(uv, uv), 0xD8)));
+					}
+				}
+			}
+			ConvertRowPairScalar<Format>(rows.Src0, rows.Src1, vectorWidth, width, rows.Y0, rows.Y1, rows.U, rows.V, c);
+		}
+		_mm256_zeroupper();
+	}
+#endif
+
+	template <YuvFormat Format>
+	ColorConverter::ConvertRowsFunction SelectKernel(ColorConverterKernel kernel) {
+#if CPU_FEATURES_X86
+		switch (kernel)
+		{
+			case ColorConverterKernel::AVX2:
+				return ConvertRowsAVX2<Format>;
+			case ColorConverterKernel::SSE41:
+				return ConvertRowsSSE41<Format>;
+			default:
+				break;
+		}
+#endif
+		return ConvertRowsScalar<Format>;
+	}
+
+	ColorConverter::COEFFICIENTS CreateCoefficients(YuvFormat format, YuvMatrix matrix, YuvRange range) {
+		const double kr = matrix == YuvMatrix::BT601 ? 0.299 : 0.2126;
+		const double kb = matrix == YuvMatrix::BT601 ? 0.114 : 0.0722;
+		const double yScale = range == YuvRange::Limited ? 219.0 / 255.0 : 1.0;
+		const double uvScale = range == YuvRange::Limited ? 224.0 / 255.0 : 1.0;
+		const double unit = 1 << CoefficientBits;
+		ColorConverter::COEFFICIENTS c{};
+		c.Y[0] = static_cast<int16_t>(std::lround(yScale * kb * unit));
+		c.Y[2] = static_cast<int16_t>(std::lround(yScale * kr * unit));
+		//Green takes the rounding error, so that white maps to the top of the range.
+		c.Y[1] = static_cast<int16_t>(std::lround(yScale * unit) - c.Y[0] - c.Y[2]);
+		const double uDivisor = 2.0 * (1.0 - kb);
+		const double vDivisor = 2.0 * (1.0 - kr);
+		c.U[0] = static_cast<int16_t>(std::lround(uvScale * 0.5 * unit));
+		c.U[2] = static_cast<int16_t>(std::lround(-uvScale * kr / uDivisor * unit));
+		//The chroma coefficients sum to zero, so that grays have no color.
+		c.U[1] = static_cast<int16_t>(-c.U[0] - c.U[2]);
+		c.V[2] = static_cast<int16_t>(std::lround(uvScale * 0.5 * unit));
+		c.V[0] = static_cast<int16_t>(std::lround(-uvScale * kb / vDivisor * unit));
+		c.V[1] = static_cast<int16_t>(-c.V[0] - c.V[2]);
+		//10-bit output is the 8-bit result times 4, so it shifts 2 bits less. The offsets are the same in fixed point.
+		//Chroma is computed from the sum of 4 pixels, so it shifts 2 bits more.
+		int extraBits = format == YuvFormat::P010 ? 2 : 0;
+		c.YShift = CoefficientBits - extraBits;
+		c.UVShift = CoefficientBits + 2 - extraBits;
+		int32_t yOffset = range == YuvRange::Limited ? 16 : 0;
+		c.YBias = (yOffset << CoefficientBits) + (1 << (c.YShift - 1));
+		c.UVBias = (128 << (CoefficientBits + 2)) + (1 << (c.UVShift - 1));
+		c.Max = format == YuvFormat::P010 ? 1023 : 255;
+		return c;
+	}
+}
+
+ColorConverter::ColorConverter() :
+	ColorConverter(GetBestSupportedKernel())
+{
+}
+
+ColorConverter::ColorConverter(ColorConverterKernel kernel) :
+	m_Kernel(kernel),
+	m_Format(YuvFormat::NV12),
+	m_Matrix(YuvMatrix::BT709),
+	m_Range(YuvRange::Limited),
+	m_Coefficients{},
+	m_ConvertRows(nullptr),
+	m_ThreadCount(1),
+	m_Job{},
+	m_BandCount(0),
+	m_Generation(0),
+	m_PendingBands(0),
+	m_IsShuttingDown(false)
+{
+	if (!IsKernelSupported(kernel)) {
+		m_Kernel = GetBestSupportedKernel();
+	}
+	Initialize(YuvFormat::NV12, YuvMatrix::BT709, YuvRange::Limited, 1);
+}
+
+ColorConverter::~ColorConverter()
+{
+	StopWorkers();
+}
+
+void ColorConverter::Initialize(YuvFormat format, YuvMatrix matrix, YuvRange range, uint32_t threadCount)
+{
+	m_Format = format;
+	m_Matrix = matrix;
+	m_Range = range;
+	m_Coefficients = CreateCoefficients(format, matrix, range);
+	switch (format)
+	{
+		case YuvFormat::I420:
+			m_ConvertRows = SelectKernel<YuvFormat::I420>(m_Kernel);
+			break;
+		case YuvFormat::P010:
+			m_ConvertRows = SelectKernel<YuvFormat::P010>(m_Kernel);
+			break;
+		default:
+			m_ConvertRows = SelectKernel<YuvFormat::NV12>(m_Kernel);
+			break;
+	}
+	if (threadCount == 0) {
+		//Conversion is bound by memory bandwidth long before it runs out of cores, so half of the processors is plenty.
+		threadCount = (std::max)(std::thread::hardware_concurrency() / 2, 1u);
+	}
+	threadCount = (std::min)(threadCount, MaxThreadCount);
+	if (threadCount != m_ThreadCount || m_Workers.size() + 1 != threadCount) {
+		StopWorkers();
+		m_ThreadCount = threadCount;
+		StartWorkers(threadCount - 1);
+	}
+}
+
+bool ColorConverter::Convert(const uint8_t *pSrc, size_t srcStride, uint32_t width, uint32_t height, const YUV_IMAGE &dest)
+{
+	if (!pSrc || !dest.Planes[0] || !dest.Planes[1] || (m_Format == YuvFormat::I420 && !dest.Planes[2])) {
+		return false;
+	}
+	if (width % 2 != 0 || height % 2 != 0) {
+		return false;
+	}
+	JOB job{ pSrc, srcStride, width, height / 2, &dest };
+	uint32_t bandCount = static_cast<uint32_t>((std::min)(static_cast<size_t>(m_ThreadCount), (std::max)(static_cast<size_t>(width) * height / MinBandPixels, static_cast<size_t>(1))));
+	bandCount = (std::min)(bandCount, job.RowPairs);
+	if (bandCount <= 1) {
+		ConvertBand(job, 0, 1);
+		return true;
+	}
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_Job = job;
+		m_BandCount = bandCount;
+		m_PendingBands = bandCount - 1;
+		m_Generation++;
+	}
+	m_WorkAvailable.notify_all();
+	//The calling thread converts the first band while the workers convert the rest.
+	ConvertBand(job, 0, bandCount);
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_WorkDone.wait(lock, [this]() { return m_PendingBands == 0; });
+	return true;
+}
+
+void ColorConverter::ConvertBand(const JOB &job, uint32_t band, uint32_t bandCount) const
+{
+	uint32_t firstPair = static_cast<uint32_t>(static_cast<uint64_t>(job.RowPairs) * band / bandCount);
+	uint32_t endPair = static_cast<uint32_t>(static_cast<uint64_t>(job.RowPairs) * (band + 1) / bandCount);
+	if (endPair <= firstPair) {
+		return;
+	}
+	YUV_IMAGE bandImage = *job.Dest;
+	bandImage.Planes[0] += 2 * static_cast<size_t>(firstPair) * bandImage.Strides[0];
+	bandImage.Planes[1] += static_cast<size_t>(firstPair) * bandImage.Strides[1];
+	if (bandImage.Planes[2]) {
+		bandImage.Planes[2] += static_cast<size_t>(firstPair) * bandImage.Strides[2];
+	}
+	m_ConvertRows(job.Src + 2 * static_cast<size_t>(firstPair) * job.SrcStride, job.SrcStride, job.Width, endPair - firstPair, bandImage, m_Coefficients);
+}
+
+void ColorConverter::StartWorkers(uint32_t workerCount)
+{
+	m_IsShuttingDown = false;
+	for (uint32_t i = 0; i < workerCount; i++) {
+		m_Workers.emplace_back(&ColorConverter::WorkerLoop, this, i + 1);
+	}
+}
+
+void ColorConverter::StopWorkers()
+{
+	{
+		std::scoped_lock lock(m_Mutex);
+		m_IsShuttingDown = true;
+	}
+	m_WorkAvailable.notify_all();
+	for (std::thread &worker : m_Workers) {
+		worker.join();
+	}
+	m_Workers.clear();
+}
+
+void ColorConverter::WorkerLoop(uint32_t band)
+{
+	uint64_t generation = 0;
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true) {
+		m_WorkAvailable.wait(lock, [&]() { return m_Generation != generation || m_IsShuttingDown; });
+		if (m_IsShuttingDown) {
+			return;
+		}
+		generation = m_Generation;
+		if (band >= m_BandCount) {
+			//Small frames are split into fewer bands than there are workers.
+			continue;
+		}
+		JOB job = m_Job;
+		uint32_t bandCount = m_BandCount;
+		lock.unlock();
+		ConvertBand(job, band, bandCount);
+		lock.lock();
+		if (--m_PendingBands == 0) {
+			m_WorkDone.notify_one();
+		}
+	}
+}
+
+size_t ColorConverter::GetImageBytes(YuvFormat format, uint32_t width, uint32_t height)
+{
+	size_t pixels = static_cast<size_t>(width) * height;
+	return format == YuvFormat::P010 ? pixels * 3 : pixels * 3 / 2;
+}
+
+YUV_IMAGE ColorConverter::GetContiguousImage(YuvFormat format, uint8_t *pBuffer, size_t stride, uint32_t height)
+{
+	YUV_IMAGE image{};
+	image.Planes[0] = pBuffer;
+	image.Strides[0] = stride;
+	image.Planes[1] = pBuffer + stride * height;
+	if (format == YuvFormat::I420) {
+		image.Strides[1] = stride / 2;
+		image.Planes[2] = image.Planes[1] + image.Strides[1] * (height / 2);
+		image.Strides[2] = stride / 2;
+	}
+	else {
+		image.Strides[1] = stride;
+	}
+	return image;
+}
+
+ColorConverterKernel ColorConverter::GetBestSupportedKernel()
+{
+	if (IsKernelSupported(ColorConverterKernel::AVX2)) {
+		return ColorConverterKernel::AVX2;
+	}
+	if (IsKernelSupported(ColorConverterKernel::SSE41)) {
+		return ColorConverterKernel::SSE41;
+	}
+	return ColorConverterKernel::Scalar;
+}
+
+bool ColorConverter::IsKernelSupported(ColorConverterKernel kernel)
+{
+	switch (kernel)
+	{
+		case ColorConverterKernel::AVX2:
+			return CPU_FEATURES::Get().IsAvx2Supported;
+		case ColorConverterKernel::SSE41:
+			return CPU_FEATURES::Get().IsSse41Supported;
+		default:
+			return true;
+	}
+}
+
+const char *ColorConverter::GetKernelName(ColorConverterKernel kernel)
+{
+	switch (kernel)
+	{
+		case ColorConverterKernel::AVX2:
+			return "AVX2";
+		case ColorConverterKernel::SSE41:
+			return "SSE4.1";
+		default:
+			return "scalar";
+	}
+}
@@ -0,0 +1,148 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+enum class YuvFormat {
+	//8-bit Y plane followed by an interleaved UV plane at half resolution. The input format of the Media Foundation video encoders.
+	NV12,
+	//8-bit Y, U and V planes, with U and V at half resolution.
+	I420,
+	//As NV12, with 16-bit samples holding 10-bit values in the high bits.
+	P010
+};
+
+enum class YuvMatrix {
+	//ITU-R BT.601, for standard definition video.
+	BT601,
+	//ITU-R BT.709, for high definition video.
+	BT709
+};
+
+enum class YuvRange {
+	//Y from 16 to 235 and UV from 16 to 240, as expected by most players.
+	Limited,
+	//The full 0 to 255 range.
+	Full
+};
+
+enum class ColorConverterKernel {
+	Scalar,
+	SSE41,
+	AVX2
+};
+
+/// <summary>
+/// The planes of a YUV image. NV12 and P010 use the first two planes, I420 uses all three. Strides are in bytes.
+/// </summary>
+struct YUV_IMAGE
+{
+	uint8_t *Planes[3]{};
+	size_t Strides[3]{};
+};
+
+/// <summary>
+/// Converts BGRA frames, as captured from the desktop, to YUV on the CPU, using the widest SIMD kernel the CPU supports and splitting the frame into row bands that are converted in parallel.
+/// Chroma is the average of each 2x2 block of pixels, so frames must have an even width and height.
+/// The alpha channel is ignored.
+/// </summary>
+class ColorConverter
+{
+public:
+	ColorConverter();
+	explicit ColorConverter(ColorConverterKernel kernel);
+	~ColorConverter();
+
+	ColorConverter(const ColorConverter &) = delete;
+	ColorConverter &operator=(const ColorConverter &) = delete;
+
+	/// <param name="format">The output format</param>
+	/// <param name="matrix">The color matrix of the output</param>
+	/// <param name="range">The value range of the output</param>
+	/// <param name="threadCount">The number of threads a frame is converted on, including the calling thread. 0 picks a count from the number of processors.</param>
+	void Initialize(YuvFormat format, YuvMatrix matrix, YuvRange range, uint32_t threadCount = 0);
+
+	/// <summary>
+	/// Converts a BGRA frame.
+	/// </summary>
+	/// <param name="pSrc">The first row of the frame</param>
+	/// <param name="srcStride">The distance between rows of the frame in bytes</param>
+	/// <param name="width">The width of the frame in pixels. Must be even.</param>
+	/// <param name="height">The height of the frame in pixels. Must be even.</param>
+	/// <param name="dest">The planes to write to, with room for the frame in the output format</param>
+	/// <returns>false if the frame size is not even or a plane is missing</returns>
+	bool Convert(const uint8_t *pSrc, size_t srcStride, uint32_t width, uint32_t height, const YUV_IMAGE &dest);
+
+	inline ColorConverterKernel GetKernel() const { return m_Kernel; }
+	inline YuvFormat GetFormat() const { return m_Format; }
+	inline YuvMatrix GetMatrix() const { return m_Matrix; }
+	inline YuvRange GetRange() const { return m_Range; }
+	inline uint32_t GetThreadCount() const { return m_ThreadCount; }
+
+	/// <summary>
+	/// Returns the number of bytes of a frame in the given format with tightly packed planes.
+	/// </summary>
+	static size_t GetImageBytes(YuvFormat format, uint32_t width, uint32_t height);
+	/// <summary>
+	/// Returns the planes of a frame stored in one buffer, with the planes following each other and the Y plane stride given. This is the layout of Media Foundation video buffers.
+	/// </summary>
+	static YUV_IMAGE GetContiguousImage(YuvFormat format, uint8_t *pBuffer, size_t stride, uint32_t height);
+	/// <summary>
+	/// Returns the fastest kernel supported by the current CPU.
+	/// </summary>
+	static ColorConverterKernel GetBestSupportedKernel();
+	static bool IsKernelSupported(ColorConverterKernel kernel);
+	static const char *GetKernelName(ColorConverterKernel kernel);
+
+	//The fixed point conversion coefficients, in the order B, G, R.
+	struct COEFFICIENTS
+	{
+		int16_t Y[3];
+		int16_t U[3];
+		int16_t V[3];
+		//The offset and rounding added before shifting, for a single pixel for Y and the sum of a 2x2 block for UV.
+		int32_t YBias;
+		int32_t UVBias;
+		int YShift;
+		int UVShift;
+		int32_t Max;
+	};
+	//Converts row pairs of a band. The planes of dest point at the first row of the band.
+	typedef void(*ConvertRowsFunction)(const uint8_t *pSrc, size_t srcStride, uint32_t width, uint32_t rowPairs, const YUV_IMAGE &dest, const COEFFICIENTS &coefficients);
+
+private:
+	struct JOB
+	{
+		const uint8_t *Src;
+		size_t SrcStride;
+		uint32_t Width;
+		uint32_t RowPairs;
+		const YUV_IMAGE *Dest;
+	};
+
+	ColorConverterKernel m_Kernel;
+	YuvFormat m_Format;
+	YuvMatrix m_Matrix;
+	YuvRange m_Range;
+	COEFFICIENTS m_Coefficients;
+	ConvertRowsFunction m_ConvertRows;
+	uint32_t m_ThreadCount;
+
+	std::vector<std::thread> m_Workers;
+	std::mutex m_Mutex;
+	std::condition_variable m_WorkAvailable;
+	std::condition_variable m_WorkDone;
+	JOB m_Job;
+	uint32_t m_BandCount;
+	uint64_t m_Generation;
+	uint32_t m_PendingBands;
+	bool m_IsShuttingDown;
+
+	void StartWorkers(uint32_t workerCount);
+	void StopWorkers();
+	void WorkerLoop(uint32_t band);
+	void ConvertBand(const JOB &job, uint32_t band, uint32_t bandCount) const;
+};
@@ -12,6 +12,10 @@
 #include <wincodec.h>
 #include <chrono>
 #include "util.h"
+#include "EncodeQueue.h"
+#include "CfrTimeline.h"
+#include "FrameSlotExchange.h"
+#include "SegmentedOutput.h"
 
 struct REC_RESULT {
 	HRESULT RecordingResult;
@@ -143,7 +147,9 @@ enum class RecorderModeInternal {
 	///<summary>Record a slideshow of pictures. </summary>
 	Slideshow = 1,
 	///<summary>Create a single screenshot.</summary>
-	Screenshot = 2
+	Screenshot = 2,
+	///<summary>Keep the last part of the recording in memory, and save it to a file on request.</summary>
+	ReplayBuffer = 3
 };
 
 enum class TextureStretchMode {
@@ -182,6 +188,15 @@ enum class RecordingSourceApi {
 	WindowsGraphicsCapture
 };
 
+enum class ColorConverterMode {
+	///<summary>Use the Media Foundation video processor, unless it is unavailable or the device has no GPU.</summary>
+	Auto,
+	///<summary>Always use the Media Foundation video processor.</summary>
+	MediaFoundation,
+	///<summary>Always convert frames with the SIMD converter on the CPU.</summary>
+	Software
+};
+
 struct RECORDING_SOURCE_BASE abstract {
 	std::wstring SourcePath;
 	HWND SourceWindow;
@@ -306,10 +321,12 @@ struct RECORDING_SOURCE_DATA {
 //
 struct THREAD_DATA_BASE
 {
-	////Handle to shared surface texture
-	HANDLE CanvasTexSharedHandle{ nullptr };
 	// Used to signal an error in the ongoing capture
 	HANDLE ErrorEvent{};
+	// Used to wake the recorder loop when a new frame is written
+	HANDLE FrameUpdatedEvent{};
+	// Used to wake AcquireNextFrame when a new frame is published
+	HANDLE FramePublishedEvent{};
 	// Used by WinProc to signal to threads to exit
 	HANDLE TerminateThreadsEvent{};
 	LARGE_INTEGER LastUpdateTimeStamp{};
@@ -322,9 +339,14 @@ struct THREAD_DATA_BASE
 struct CAPTURE_THREAD_DATA :THREAD_DATA_BASE
 {
 	RECORDING_SOURCE_DATA *RecordingSource{ nullptr };
-	INT UpdatedFrameCountSinceLastWrite{};
 	INT64 TotalUpdatedFrameCount{};
 	PTR_INFO *PtrInfo{ nullptr };
+	//Guards PtrInfo, which is shared by all capture threads.
+	CRITICAL_SECTION *PtrInfoCriticalSection{ nullptr };
+	//Hands the frames of the source to the recorder loop. The thread is the producer.
+	FrameSlotExchange *FrameSlots{ nullptr };
+	//Handles to the shared slot textures, which have the size of the source on the canvas.
+	HANDLE FrameSlotSharedHandles[FRAME_SLOT_COUNT]{};
 };
 
 //
@@ -367,6 +389,33 @@ public:
 	UINT32 GetMouseClickDetectionDurationMillis() { return m_MouseClickDetectionDurationMillis; }
 };
 
+struct AUDIO_SOURCE {
+	/// <summary>
+	/// The device ID of the source. The default device is used if empty.
+	/// </summary>
+	std::wstring DeviceName;
+	/// <summary>
+	/// True to record what is played on an output device, false to record an input device, e.g. a microphone.
+	/// </summary>
+	bool IsLoopback;
+	float Volume;
+	bool IsMuted;
+	/// <summary>
+	/// Delay applied to the source, to line it up with sources with a longer capture latency.
+	/// </summary>
+	UINT32 DelayMillis;
+
+	AUDIO_SOURCE() :
+		DeviceName(L""),
+		IsLoopback(false),
+		Volume(1),
+		IsMuted(false),
+		DelayMillis(0)
+	{
+
+	}
+};
+
 struct AUDIO_OPTIONS {
 protected:
 #pragma region Format constants
@@ -384,6 +433,14 @@ protected:
 	UINT32 m_AudioChannels = 2; //Number of audio channels. 1,2 and 6 is supported. 6 only on windows 8 and up.
 	float m_OutputVolumeModifier = 1;
 	float m_InputVolumeModifier = 1;
+	UINT32 m_OutputDelayMillis = 0;
+	UINT32 m_InputDelayMillis = 0;
+	std::vector<AUDIO_SOURCE> m_AdditionalSources{};
+	bool m_IsNoiseGateEnabled = false;
+	float m_NoiseGateThresholdDb = -50;
+	bool m_IsAudioLevelMeteringEnabled = false;
+	UINT32 m_AudioLevelMeteringIntervalMillis = 100;
+	bool m_IsAudioDitherEnabled = true;
 public:
 	void SetInputVolume(float volume) { m_InputVolumeModifier = volume; }
 	void SetOutputVolume(float volume) { m_OutputVolumeModifier = volume; }
@@ -394,6 +451,14 @@ public:
 	void SetAudioEnabled(bool value) { m_IsAudioEnabled = value; }
 	void SetOutputDeviceEnabled(bool value) { m_IsOutputDeviceEnabled = value; }
 	void SetInputDeviceEnabled(bool value) { m_IsInputDeviceEnabled = value; }
+	void SetOutputDelay(UINT32 millis) { m_OutputDelayMillis = millis; }
+	void SetInputDelay(UINT32 millis) { m_InputDelayMillis = millis; }
+	void SetAdditionalSources(std::vector<AUDIO_SOURCE> sources) { m_AdditionalSources = sources; }
+	void SetNoiseGateEnabled(bool value) { m_IsNoiseGateEnabled = value; }
+	void SetNoiseGateThreshold(float decibels) { m_NoiseGateThresholdDb = decibels; }
+	void SetAudioLevelMeteringEnabled(bool value) { m_IsAudioLevelMeteringEnabled = value; }
+	void SetAudioLevelMeteringInterval(UINT32 millis) { m_AudioLevelMeteringIntervalMillis = millis; }
+	void SetAudioDitherEnabled(bool value) { m_IsAudioDitherEnabled = value; }
 
 	std::wstring GetAudioOutputDevice() { return m_AudioOutputDevice; }
 	std::wstring GetAudioInputDevice() { return m_AudioInputDevice; }
@@ -404,6 +469,14 @@ public:
 	float GetInputVolume() { return m_InputVolumeModifier; }
 	bool IsOutputDeviceEnabled() { return m_IsOutputDeviceEnabled; }
 	bool IsInputDeviceEnabled() { return m_IsInputDeviceEnabled; }
+	UINT32 GetOutputDelay() { return m_OutputDelayMillis; }
+	UINT32 GetInputDelay() { return m_InputDelayMillis; }
+	std::vector<AUDIO_SOURCE> GetAdditionalSources() { return m_AdditionalSources; }
+	bool IsNoiseGateEnabled() { return m_IsNoiseGateEnabled; }
+	float GetNoiseGateThreshold() { return m_NoiseGateThresholdDb; }
+	bool IsAudioLevelMeteringEnabled() { return m_IsAudioLevelMeteringEnabled; }
+	UINT32 GetAudioLevelMeteringInterval() { return m_AudioLevelMeteringIntervalMillis; }
+	bool IsAudioDitherEnabled() { return m_IsAudioDitherEnabled; }
 	GUID GetAudioEncoderFormat() { return AUDIO_ENCODING_FORMAT; }
 	UINT32 GetAudioBitsPerSample() { return AUDIO_BITS_PER_SAMPLE; }
 	UINT32 GetAudioSamplesPerSecond() { return AUDIO_SAMPLES_PER_SECOND; }
@@ -416,6 +489,9 @@ protected:
 	TextureStretchMode m_Stretch = TextureStretchMode::Uniform;
 	RecorderModeInternal m_RecorderMode = RecorderModeInternal::Video;
 	bool m_IsVideoCaptureEnabled = true;
+	SEGMENT_POLICY m_SegmentPolicy{};
+	UINT32 m_ReplayBufferDuration = 120 * 1000;
+	UINT64 m_ReplayBufferMaxBytes = 256ULL * 1024 * 1024;
 public:
 	SIZE GetFrameSize() { return m_FrameSize; }
 	void SetFrameSize(SIZE size) { m_FrameSize = size; }
@@ -427,6 +503,17 @@ public:
 	void SetRecorderMode(RecorderModeInternal recorderMode) { m_RecorderMode = recorderMode; }
 	bool IsVideoCaptureEnabled() { return m_IsVideoCaptureEnabled; }
 	void SetVideoCaptureEnabled(bool value) { m_IsVideoCaptureEnabled = value; }
+	//Splits video recordings into files of at most this duration. 0 disables the limit.
+	void SetSegmentDuration(UINT32 millis) { m_SegmentPolicy.MaxDuration = MillisToHundredNanos(millis); }
+	//Splits video recordings into files of about this size. 0 disables the limit.
+	void SetSegmentMaxBytes(UINT64 bytes) { m_SegmentPolicy.MaxBytes = bytes; }
+	SEGMENT_POLICY GetSegmentPolicy() { return m_SegmentPolicy; }
+	//The duration the replay buffer keeps, in milliseconds.
+	void SetReplayBufferDuration(UINT32 millis) { m_ReplayBufferDuration = millis; }
+	UINT32 GetReplayBufferDuration() { return m_ReplayBufferDuration; }
+	//The most memory the encoded packets of the replay buffer can use. 0 disables the limit.
+	void SetReplayBufferMaxBytes(UINT64 bytes) { m_ReplayBufferMaxBytes = bytes; }
+	UINT64 GetReplayBufferMaxBytes() { return m_ReplayBufferMaxBytes; }
 
 };
 
@@ -442,9 +529,14 @@ protected:
 	bool m_IsLowLatencyModeEnabled = false;
 	bool m_IsMp4FastStartEnabled = true;
 	bool m_IsFragmentedMp4Enabled = false;
+	UINT32 m_FragmentDuration = 2000;
 	bool m_IsHardwareEncodingEnabled = true;
 	UINT32 m_VideoBitrateControlMode = eAVEncCommonRateControlMode_Quality;
 	UINT32 m_EncoderProfile = eAVEncH264VProfile_High;
+	UINT32 m_EncodeQueueDepth = 3;
+	EncodeQueueDropPolicy m_EncodeQueueDropPolicy = EncodeQueueDropPolicy::Block;
+	ColorConverterMode m_ColorConverterMode = ColorConverterMode::Auto;
+	CfrRepeatMode m_CfrRepeatMode = CfrRepeatMode::Encode;
 public:
 	void SetVideoFps(UINT32 fps) { m_VideoFps = fps; }
 	void SetVideoBitrate(UINT32 bitrate) { m_VideoBitrate = bitrate; }
@@ -453,10 +545,17 @@ public:
 	void SetThrottlingDisabled(bool value) { m_IsThrottlingDisabled = value; }
 	void SetFastStartEnabled(bool value) { m_IsMp4FastStartEnabled = value; }
 	void SetFragmentedMp4Enabled(bool value) { m_IsFragmentedMp4Enabled = value; }
+	//The shortest duration of a fragment of a fragmented MP4 recording in milliseconds. Fragments are cut at the first keyframe after it. 0 cuts at every keyframe.
+	void SetFragmentDuration(UINT32 millis) { m_FragmentDuration = millis; }
 	void SetHardwareEncodingEnabled(bool value) { m_IsHardwareEncodingEnabled = value; }
 	void SetLowLatencyModeEnabled(bool value) { m_IsLowLatencyModeEnabled = value; }
 	void SetVideoBitrateMode(UINT32 bitrateMode) { m_VideoBitrateControlMode = bitrateMode; }
 	void SetEncoderProfile(UINT32 profile) { m_EncoderProfile = profile; }
+	void SetEncodeQueueDepth(UINT32 depth) { m_EncodeQueueDepth = depth; }
+	void SetEncodeQueueDropPolicy(EncodeQueueDropPolicy policy) { m_EncodeQueueDropPolicy = policy; }
+	void SetColorConverterMode(ColorConverterMode mode) { m_ColorConverterMode = mode; }
+	//How fixed framerate recordings write frames where nothing changed.
+	void SetCfrRepeatMode(CfrRepeatMode mode) { m_CfrRepeatMode = mode; }
 
 	UINT32 GetVideoFps() { return m_VideoFps; }
 	UINT32 GetVideoBitrate() { return m_VideoBitrate; }
@@ -465,10 +564,15 @@ public:
 	bool GetIsThrottlingDisabled() { return  m_IsThrottlingDisabled; }
 	bool GetIsFastStartEnabled() { return m_IsMp4FastStartEnabled; }
 	bool GetIsFragmentedMp4Enabled() { return m_IsFragmentedMp4Enabled; }
+	UINT32 GetFragmentDuration() { return m_FragmentDuration; }
 	bool GetIsHardwareEncodingEnabled() { return m_IsHardwareEncodingEnabled; }
 	bool GetIsLowLatencyModeEnabled() { return m_IsLowLatencyModeEnabled; }
 	UINT32 GetVideoBitrateMode() { return m_VideoBitrateControlMode; }
 	UINT32 GetEncoderProfile() { return m_EncoderProfile; }
+	UINT32 GetEncodeQueueDepth() { return m_EncodeQueueDepth; }
+	EncodeQueueDropPolicy GetEncodeQueueDropPolicy() { return m_EncodeQueueDropPolicy; }
+	ColorConverterMode GetColorConverterMode() { return m_ColorConverterMode; }
+	CfrRepeatMode GetCfrRepeatMode() { return m_CfrRepeatMode; }
 
 	virtual GUID GetVideoEncoderFormat() abstract;
 	virtual std::wstring GetVideoExtension() {
@@ -492,17 +596,36 @@ public:
 	virtual GUID GetVideoEncoderFormat() override { return MFVideoFormat_HEVC; }
 };
 
+struct RAW_ENCODER_OPTIONS :ENCODER_OPTIONS {
+public:
+	//Uncompressed I420 video in a Y4M file, with the audio as PCM in a WAV file next to it. Written by RawEncoderBackend instead of a Media Foundation encoder.
+	virtual GUID GetVideoEncoderFormat() override { return MFVideoFormat_I420; }
+	virtual std::wstring GetVideoExtension() override {
+		return L".y4m";
+	}
+};
+
+//Windows has no codec for QOI images, so they are written with QoiEncoder instead of WIC. The GUID only identifies the format in the snapshot options.
+// {6D9D9AAA-B81A-448A-B068-49B61EC02BA6}
+static const GUID GUID_ContainerFormatQoi = { 0x6d9d9aaa, 0xb81a, 0x448a, { 0xb0, 0x68, 0x49, 0xb6, 0x1e, 0xc0, 0x2b, 0xa6 } };
+
 struct SNAPSHOT_OPTIONS {
 protected:
 	std::wstring m_OutputSnapshotsFolderPath = L"";
 	std::chrono::milliseconds m_SnapshotsInterval = std::chrono::milliseconds(10000);
 	bool m_TakesSnapshotsWithVideo = false;
 	GUID m_ImageEncoderFormat = GUID_ContainerFormatPng;
+	UINT32 m_ImageEncoderThreadCount = 0;
+	UINT64 m_ImageEncoderMaxBytes = 256ULL * 1024 * 1024;
 public:
 	void SetTakeSnapshotsWithVideo(bool isEnabled) { m_TakesSnapshotsWithVideo = isEnabled; }
 	void SetSnapshotsWithVideoInterval(UINT32 value) { m_SnapshotsInterval = std::chrono::milliseconds(value); }
 	void SetSnapshotDirectory(std::wstring string) { m_OutputSnapshotsFolderPath = string; }
 	void SetSnapshotSaveFormat(GUID value) { m_ImageEncoderFormat = value; }
+	//The number of threads encoding slideshow frames and snapshots, or a single QOI screenshot. 0 picks one from the number of processors.
+	void SetImageEncoderThreadCount(UINT32 count) { m_ImageEncoderThreadCount = count; }
+	//The most memory the frames waiting to be encoded can hold, before the recording waits for the encoder threads. 0 for no limit.
+	void SetImageEncoderMaxBytes(UINT64 bytes) { m_ImageEncoderMaxBytes = bytes; }
 
 	bool IsSnapshotWithVideoEnabled() {
 		return m_TakesSnapshotsWithVideo;
@@ -516,6 +639,12 @@ public:
 	GUID GetSnapshotEncoderFormat() {
 		return m_ImageEncoderFormat;
 	}
+	UINT32 GetImageEncoderThreadCount() {
+		return m_ImageEncoderThreadCount;
+	}
+	UINT64 GetImageEncoderMaxBytes() {
+		return m_ImageEncoderMaxBytes;
+	}
 
 
 	std::wstring GetImageExtension() {
@@ -531,6 +660,9 @@ public:
 		else if (m_ImageEncoderFormat == GUID_ContainerFormatTiff) {
 			return L".tiff";
 		}
+		else if (m_ImageEncoderFormat == GUID_ContainerFormatQoi) {
+			return L".qoi";
+		}
 		else {
 			return L".jpg";
 		}
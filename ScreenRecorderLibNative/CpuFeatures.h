@@ -0,0 +1,83 @@
+#pragma once
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CPU_FEATURES_X86 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define CPU_FEATURES_X86 0
+#endif
+
+//MSVC allows intrinsics for any instruction set in any function, GCC and Clang require the function to be compiled for the target.
+#if CPU_FEATURES_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_SSE41 __attribute__((target("sse4.1")))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_SSE41
+#define TARGET_AVX2
+#endif
+
+/// <summary>
+/// Runtime detection of the SIMD instruction sets available to the process, used to select between vectorized kernels.
+/// </summary>
+struct CPU_FEATURES
+{
+	bool IsSse2Supported = false;
+	bool IsSse41Supported = false;
+	bool IsAvx2Supported = false;
+
+	/// <summary>
+	/// Returns the features of the current CPU. The detection runs once and is cached.
+	/// </summary>
+	static const CPU_FEATURES &Get() {
+		static const CPU_FEATURES features = Detect();
+		return features;
+	}
+
+private:
+	static CPU_FEATURES Detect() {
+		CPU_FEATURES features{};
+#if CPU_FEATURES_X86
+		unsigned int regs[4]{};
+		CpuId(0, 0, regs);
+		unsigned int maxLeaf = regs[0];
+		if (maxLeaf < 1) {
+			return features;
+		}
+		CpuId(1, 0, regs);
+		features.IsSse2Supported = (regs[3] & (1u << 26)) != 0;
+		features.IsSse41Supported = (regs[2] & (1u << 19)) != 0;
+		bool isOsXsaveEnabled = (regs[2] & (1u << 27)) != 0;
+		bool isAvxSupported = (regs[2] & (1u << 28)) != 0;
+		//The OS must save the YMM registers on context switches for AVX to be usable.
+		bool isYmmStateEnabled = isOsXsaveEnabled && (ReadXcr0() & 0x6) == 0x6;
+		if (maxLeaf >= 7 && isAvxSupported && isYmmStateEnabled) {
+			CpuId(7, 0, regs);
+			features.IsAvx2Supported = (regs[1] & (1u << 5)) != 0;
+		}
+#endif
+		return features;
+	}
+
+#if CPU_FEATURES_X86
+	static void CpuId(unsigned int leaf, unsigned int subleaf, unsigned int regs[4]) {
+#if defined(_MSC_VER)
+		__cpuidex(reinterpret_cast<int *>(regs), static_cast<int>(leaf), static_cast<int>(subleaf));
+#else
+		__cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	}
+
+	static unsigned long long ReadXcr0() {
+#if defined(_MSC_VER)
+		return _xgetbv(0);
+#else
+		unsigned int eax, edx;
+		__asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+		return (static_cast<unsigned long long>(edx) << 32) | eax;
+#endif
+	}
+#endif
+};
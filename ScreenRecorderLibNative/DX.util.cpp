@@ -96,6 +96,19 @@ HRESULT GetAdapterForDevice(_In_ ID3D11Device *pDevice, _Outptr_ IDXGIAdapter **
 	return hr;
 }
 
+bool IsSoftwareAdapter(_In_ ID3D11Device *pDevice)
+{
+	CComPtr<IDXGIAdapter> pAdapter;
+	CComPtr<IDXGIAdapter1> pAdapter1;
+	DXGI_ADAPTER_DESC1 desc{};
+	if (FAILED(GetAdapterForDevice(pDevice, &pAdapter))
+		|| FAILED(pAdapter->QueryInterface(IID_PPV_ARGS(&pAdapter1)))
+		|| FAILED(pAdapter1->GetDesc1(&desc))) {
+		return false;
+	}
+	return (desc.Flags & DXGI_ADAPTER_FLAG_SOFTWARE) != 0;
+}
+
 
 HRESULT GetOutputRectsForRecordingSources(_In_ const std::vector<RECORDING_SOURCE *> &sources, _Out_ std::vector<std::pair<RECORDING_SOURCE *, RECT>> *outputs)
 {
@@ -3,6 +3,10 @@
 
 HRESULT InitializeDx(_In_opt_ IDXGIAdapter *adapter, _Out_ DX_RESOURCES *Data);
 HRESULT GetAdapterForDevice(_In_ ID3D11Device *pDevice, _Outptr_ IDXGIAdapter **ppAdapter);
+/// <summary>
+/// Returns true if the device runs on a software rasterizer such as WARP or the Microsoft Basic Render Driver, i.e. there is no GPU to offload work to.
+/// </summary>
+bool IsSoftwareAdapter(_In_ ID3D11Device *pDevice);
 HRESULT GetAdapterForDeviceName(_In_ std::wstring deviceName, _Outptr_opt_result_maybenull_ IDXGIAdapter **ppAdapter);
 HRESULT GetOutputForDeviceName(_In_ std::wstring deviceName, _Outptr_opt_result_maybenull_ IDXGIOutput **ppOutput);
 
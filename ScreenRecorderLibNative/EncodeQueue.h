@@ -0,0 +1,255 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// <summary>
+/// What EncodeQueue does with a new item when the queue is full.
+/// </summary>
+enum class EncodeQueueDropPolicy {
+	//Wait until the encoder has room. No frames are lost, but a slow encoder stalls capture.
+	Block,
+	//Drop the oldest queued item to make room, so the queue holds the most recent frames.
+	DropOldest,
+	//Drop the new item, so the frames already queued are encoded as they were captured.
+	DropNewest
+};
+
+struct ENCODE_QUEUE_STATS
+{
+	//The number of items pushed, encoded and dropped.
+	uint64_t PushedCount = 0;
+	uint64_t EncodedCount = 0;
+	uint64_t DroppedCount = 0;
+	//The number of pushes that had to wait for room in the queue, and the total time they waited.
+	uint64_t BlockedCount = 0;
+	uint64_t BlockedMicros = 0;
+	//The largest number of items that were queued at once.
+	size_t MaxDepth = 0;
+	//The time from an item being pushed until it starts encoding.
+	uint64_t TotalQueueLatencyMicros = 0;
+	uint64_t MaxQueueLatencyMicros = 0;
+	//The time spent encoding items.
+	uint64_t TotalEncodeMicros = 0;
+	uint64_t MaxEncodeMicros = 0;
+
+	inline double GetAverageQueueLatencyMillis() const { return EncodedCount > 0 ? TotalQueueLatencyMicros / 1000.0 / EncodedCount : 0; }
+	inline double GetAverageEncodeMillis() const { return EncodedCount > 0 ? TotalEncodeMicros / 1000.0 / EncodedCount : 0; }
+};
+
+/// <summary>
+/// Bounded queue with a dedicated encoder thread, which decouples the producer of items, e.g. the capture loop, from the time it takes to encode them.
+/// When the queue is full, new items are handled according to the drop policy. A dropped item can be merged into the item that replaces it, so data that must not be lost, such as the audio of a frame, is carried over.
+/// If the encode function fails, the queue stops encoding, discards what is queued, and all further pushes fail.
+/// </summary>
+template <typename T>
+class EncodeQueue
+{
+public:
+	//Encodes an item on the encoder thread. Returns false if encoding failed.
+	typedef std::function<bool(T &item)> EncodeFunction;
+	//Merges a dropped item into the queued item that takes its place in the timeline.
+	typedef std::function<void(T &dropped, T &survivor)> MergeFunction;
+
+	/// <param name="depth">The maximum number of queued items, not counting the item being encoded</param>
+	/// <param name="policy">What to do with new items when the queue is full</param>
+	/// <param name="encode">The function that encodes items on the encoder thread</param>
+	/// <param name="merge">Optional function called with each dropped item</param>
+	EncodeQueue(size_t depth, EncodeQueueDropPolicy policy, EncodeFunction encode, MergeFunction merge = nullptr) :
+		m_Depth((std::max)(depth, static_cast<size_t>(1))),
+		m_Policy(policy),
+		m_Encode(encode),
+		m_Merge(merge),
+		m_IsClosed(false),
+		m_IsFailed(false),
+		m_IsEncoding(false),
+		m_Stats{}
+	{
+		m_Thread = std::thread(&EncodeQueue::EncodeLoop, this);
+	}
+
+	~EncodeQueue()
+	{
+		Close();
+	}
+
+	EncodeQueue(const EncodeQueue &) = delete;
+	EncodeQueue &operator=(const EncodeQueue &) = delete;
+
+	/// <summary>
+	/// Queues an item for encoding. With the Block policy, this waits while the queue is full.
+	/// </summary>
+	/// <returns>false if the encoder failed or the queue is closed, and the item was not queued</returns>
+	bool Push(T &&item)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (m_IsFailed || m_IsClosed) {
+			return false;
+		}
+		m_Stats.PushedCount++;
+		if (m_Queue.size() >= m_Depth) {
+			switch (m_Policy)
+			{
+			case EncodeQueueDropPolicy::DropOldest: {
+				//The next item in line, or the new item if the queue only holds one, takes over the timeline of the dropped one.
+				QUEUED_ITEM &dropped = m_Queue.front();
+				T &survivor = m_Queue.size() > 1 ? m_Queue[1].Item : item;
+				if (m_Merge) {
+					m_Merge(dropped.Item, survivor);
+				}
+				m_Queue.pop_front();
+				m_Stats.DroppedCount++;
+				break;
+			}
+			case EncodeQueueDropPolicy::DropNewest: {
+				if (m_Merge) {
+					m_Merge(item, m_Queue.back().Item);
+				}
+				m_Stats.DroppedCount++;
+				return true;
+			}
+			default:
+			case EncodeQueueDropPolicy::Block: {
+				auto blockStart = std::chrono::steady_clock::now();
+				m_SpaceAvailable.wait(lock, [this]() { return m_Queue.size() < m_Depth || m_IsFailed; });
+				m_Stats.BlockedCount++;
+				m_Stats.BlockedMicros += MicrosSince(blockStart);
+				if (m_IsFailed) {
+					return false;
+				}
+				break;
+			}
+			}
+		}
+		m_Queue.push_back(QUEUED_ITEM{ std::move(item), std::chrono::steady_clock::now() });
+		m_Stats.MaxDepth = (std::max)(m_Stats.MaxDepth, m_Queue.size());
+		m_ItemAvailable.notify_one();
+		return true;
+	}
+
+	/// <summary>
+	/// Waits until every queued item is encoded.
+	/// </summary>
+	/// <returns>false if the encoder failed</returns>
+	bool Drain()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Idle.wait(lock, [this]() { return (m_Queue.empty() && !m_IsEncoding) || m_IsFailed; });
+		return !m_IsFailed;
+	}
+
+	/// <summary>
+	/// Encodes the items still queued, and stops the encoder thread. Further pushes fail.
+	/// </summary>
+	/// <returns>false if the encoder failed</returns>
+	bool Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_IsClosed = true;
+		}
+		m_ItemAvailable.notify_all();
+		if (m_Thread.joinable()) {
+			m_Thread.join();
+		}
+		return !IsFailed();
+	}
+
+	bool IsFailed()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_IsFailed;
+	}
+
+	size_t GetQueuedCount()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Queue.size();
+	}
+
+	ENCODE_QUEUE_STATS GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+	inline size_t GetDepth() const { return m_Depth; }
+	inline EncodeQueueDropPolicy GetDropPolicy() const { return m_Policy; }
+
+private:
+	struct QUEUED_ITEM
+	{
+		T Item;
+		std::chrono::steady_clock::time_point PushTime;
+	};
+
+	const size_t m_Depth;
+	const EncodeQueueDropPolicy m_Policy;
+	EncodeFunction m_Encode;
+	MergeFunction m_Merge;
+
+	std::mutex m_Mutex;
+	std::condition_variable m_ItemAvailable;
+	std::condition_variable m_SpaceAvailable;
+	std::condition_variable m_Idle;
+	std::deque<QUEUED_ITEM> m_Queue;
+	bool m_IsClosed;
+	bool m_IsFailed;
+	bool m_IsEncoding;
+	ENCODE_QUEUE_STATS m_Stats;
+	std::thread m_Thread;
+
+	static uint64_t MicrosSince(std::chrono::steady_clock::time_point start)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	void EncodeLoop()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (true) {
+			m_ItemAvailable.wait(lock, [this]() { return !m_Queue.empty() || m_IsClosed; });
+			if (m_Queue.empty()) {
+				break;
+			}
+			QUEUED_ITEM queued = std::move(m_Queue.front());
+			m_Queue.pop_front();
+			m_IsEncoding = true;
+			uint64_t queueLatency = MicrosSince(queued.PushTime);
+			m_SpaceAvailable.notify_one();
+
+			//Encoding runs unlocked, so the producer can keep queueing meanwhile.
+			lock.unlock();
+			auto encodeStart = std::chrono::steady_clock::now();
+			bool isEncoded = m_Encode(queued.Item);
+			uint64_t encodeTime = MicrosSince(encodeStart);
+			//The item is released before the lock is taken again, so its resources are not held while waiting for the next one.
+			queued = QUEUED_ITEM{};
+			lock.lock();
+
+			m_IsEncoding = false;
+			m_Stats.TotalQueueLatencyMicros += queueLatency;
+			m_Stats.MaxQueueLatencyMicros = (std::max)(m_Stats.MaxQueueLatencyMicros, queueLatency);
+			if (!isEncoded) {
+				m_IsFailed = true;
+				m_Queue.clear();
+				m_SpaceAvailable.notify_all();
+				m_Idle.notify_all();
+				break;
+			}
+			m_Stats.EncodedCount++;
+			m_Stats.TotalEncodeMicros += encodeTime;
+			m_Stats.MaxEncodeMicros = (std::max)(m_Stats.MaxEncodeMicros, encodeTime);
+			if (m_Queue.empty()) {
+				m_Idle.notify_all();
+			}
+		}
+		m_Idle.notify_all();
+	}
+};
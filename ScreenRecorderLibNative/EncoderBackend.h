@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include "AudioBufferPool.h"
+
+/// <summary>
+/// The format of the streams an EncoderBackend writes.
+/// </summary>
+struct ENCODER_BACKEND_CONFIG
+{
+	//The frame size of the video in pixels.
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	//The nominal frame rate of the video, used by backends that write a constant frame rate.
+	uint32_t FrameRate = 30;
+	bool IsAudioEnabled = false;
+	//The format of the interleaved PCM audio passed to EncodeAudio.
+	uint32_t AudioSampleRate = 48000;
+	uint32_t AudioChannels = 2;
+	uint32_t AudioBitsPerSample = 16;
+};
+
+/// <summary>
+/// A video frame in system memory.
+/// </summary>
+struct ENCODER_VIDEO_FRAME
+{
+	//Timestamp of the start of the frame, in 100 nanosecond units.
+	int64_t StartPos = 0;
+	//Duration of the frame, in 100 nanosecond units.
+	int64_t Duration = 0;
+	//The first row of the frame in 32-bit BGRA. The alpha channel is ignored.
+	const uint8_t *Data = nullptr;
+	//The distance between rows of the frame in bytes.
+	size_t Stride = 0;
+};
+
+/// <summary>
+/// Writes the encoded video and audio of a recording. OutputManager hands each rendered frame and its audio to the backend in timeline order, and finalizes the backend when the recording stops.
+/// Backends are portable, and have no dependency on Media Foundation or Direct3D.
+/// </summary>
+class EncoderBackend
+{
+public:
+	virtual ~EncoderBackend() = default;
+	/// <summary>
+	/// Prepares the backend for the streams of a recording. Called once, before anything is encoded.
+	/// </summary>
+	virtual bool Configure(const ENCODER_BACKEND_CONFIG &config) = 0;
+	/// <summary>
+	/// Encodes a video frame. The frame data is only valid during the call.
+	/// </summary>
+	virtual bool EncodeVideo(const ENCODER_VIDEO_FRAME &frame) = 0;
+	/// <summary>
+	/// Encodes a block of audio starting at startPos, in 100 nanosecond units. Silent buffers have no data and stand for silence of their size.
+	/// </summary>
+	virtual bool EncodeAudio(int64_t startPos, int64_t duration, const AudioBufferRef &audio) = 0;
+	/// <summary>
+	/// Flushes and closes the output. Nothing can be encoded afterwards.
+	/// </summary>
+	virtual bool Finalize() = 0;
+	/// <summary>
+	/// The number of bytes written to the output so far.
+	/// </summary>
+	virtual uint64_t GetOutputSize() const = 0;
+};
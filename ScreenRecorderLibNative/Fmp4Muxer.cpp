@@ -0,0 +1,600 @@
+#include "Fmp4Muxer.h"
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+namespace {
+	const int64_t HundredNanosPerSecond = 10 * 1000 * 1000;
+	//Sample flags of the trun box. Keyframes depend on no other sample, and other frames are not sync samples.
+	const uint32_t SampleFlagsKeyframe = 0x02000000;
+	const uint32_t SampleFlagsNonKeyframe = 0x01010000;
+	const uint8_t NalUnitTypeSps = 7;
+	const uint8_t NalUnitTypePps = 8;
+	const uint8_t NalUnitTypeAccessUnitDelimiter = 9;
+	const uint32_t AacSampleRates[] = { 96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050, 16000, 12000, 11025, 8000, 7350 };
+
+	/// <summary>
+	/// Appends ISO BMFF boxes to a buffer in big endian byte order. The size of a box is filled in when it is ended.
+	/// </summary>
+	class BoxWriter
+	{
+	public:
+		explicit BoxWriter(std::vector<uint8_t> &data) : m_Data(data) {}
+
+		void Begin(const char *type) {
+			m_Starts.push_back(m_Data.size());
+			U32(0);
+			m_Data.insert(m_Data.end(), type, type + 4);
+		}
+		void BeginFull(const char *type, uint8_t version, uint32_t flags) {
+			Begin(type);
+			U32((static_cast<uint32_t>(version) << 24) | (flags & 0xFFFFFF));
+		}
+		void End() {
+			size_t start = m_Starts.back();
+			m_Starts.pop_back();
+			PatchU32(start, static_cast<uint32_t>(m_Data.size() - start));
+		}
+		void U8(uint8_t value) { m_Data.push_back(value); }
+		void U16(uint16_t value) { U8(static_cast<uint8_t>(value >> 8)); U8(static_cast<uint8_t>(value)); }
+		void U24(uint32_t value) { U8(static_cast<uint8_t>(value >> 16)); U16(static_cast<uint16_t>(value)); }
+		void U32(uint32_t value) { U16(static_cast<uint16_t>(value >> 16)); U16(static_cast<uint16_t>(value)); }
+		void U64(uint64_t value) { U32(static_cast<uint32_t>(value >> 32)); U32(static_cast<uint32_t>(value)); }
+		void Bytes(const uint8_t *pData, size_t size) { m_Data.insert(m_Data.end(), pData, pData + size); }
+		void Zeros(size_t count) { m_Data.insert(m_Data.end(), count, 0); }
+		void Matrix() {
+			const uint32_t unity[] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+			for (uint32_t value : unity) {
+				U32(value);
+			}
+		}
+		size_t Position() const { return m_Data.size(); }
+		void PatchU32(size_t pos, uint32_t value) {
+			m_Data[pos] = static_cast<uint8_t>(value >> 24);
+			m_Data[pos + 1] = static_cast<uint8_t>(value >> 16);
+			m_Data[pos + 2] = static_cast<uint8_t>(value >> 8);
+			m_Data[pos + 3] = static_cast<uint8_t>(value);
+		}
+	private:
+		std::vector<uint8_t> &m_Data;
+		std::vector<size_t> m_Starts;
+	};
+
+	inline bool IsAnnexB(const uint8_t *pData, size_t size) {
+		return (size >= 3 && pData[0] == 0 && pData[1] == 0 && pData[2] == 1)
+			|| (size >= 4 && pData[0] == 0 && pData[1] == 0 && pData[2] == 0 && pData[3] == 1);
+	}
+
+	/// <summary>
+	/// Calls onNalUnit with every NAL unit of an H.264 access unit, in Annex B format or with 4 byte length prefixes.
+	/// </summary>
+	template <typename TFunction>
+	void ForEachNalUnit(const uint8_t *pData, size_t size, TFunction onNalUnit) {
+		if (!IsAnnexB(pData, size)) {
+			size_t pos = 0;
+			while (pos + 4 <= size) {
+				size_t length = (static_cast<size_t>(pData[pos]) << 24) | (pData[pos + 1] << 16) | (pData[pos + 2] << 8) | pData[pos + 3];
+				pos += 4;
+				if (length == 0 || length > size - pos) {
+					break;
+				}
+				onNalUnit(pData + pos, length);
+				pos += length;
+			}
+			return;
+		}
+		size_t start = 0;
+		size_t pos = 0;
+		bool isInNalUnit = false;
+		while (pos + 3 <= size) {
+			if (pData[pos] == 0 && pData[pos + 1] == 0 && pData[pos + 2] == 1) {
+				if (isInNalUnit) {
+					//The zero byte of a 4 byte start code belongs to the start code, not the NAL unit before it.
+					size_t end = pos;
+					while (end > start && pData[end - 1] == 0) {
+						end--;
+					}
+					if (end > start) {
+						onNalUnit(pData + start, end - start);
+					}
+				}
+				pos += 3;
+				start = pos;
+				isInNalUnit = true;
+			}
+			else {
+				pos++;
+			}
+		}
+		if (isInNalUnit && size > start) {
+			onNalUnit(pData + start, size - start);
+		}
+	}
+}
+
+Fmp4Muxer::Fmp4Muxer(WriteFunction write, int64_t fragmentDuration, FragmentFunction onFragment) :
+	m_Write(write),
+	m_OnFragment(onFragment),
+	m_FragmentDuration(fragmentDuration),
+	m_KeyTrack(0),
+	m_NextSequenceNumber(1),
+	m_OutputSize(0),
+	m_InitSegmentSize(0),
+	m_IsInitSegmentWritten(false),
+	m_IsFinalized(false),
+	m_IsFailed(false)
+{
+}
+
+Fmp4Muxer::~Fmp4Muxer()
+{
+}
+
+uint32_t Fmp4Muxer::AddTrack(const FMP4_TRACK_CONFIG &config)
+{
+	TRACK track{};
+	track.Config = config;
+	track.Timescale = config.Codec == Fmp4Codec::H264 ? VIDEO_TIMESCALE : config.SampleRate;
+	if (config.Codec == Fmp4Codec::H264) {
+		ParseParameterSets(config.CodecPrivateData.data(), config.CodecPrivateData.size(), track);
+	}
+	uint32_t index = static_cast<uint32_t>(m_Tracks.size());
+	bool hasVideo = std::any_of(m_Tracks.begin(), m_Tracks.end(), [this](const TRACK &t) { return IsVideo(t); });
+	m_Tracks.push_back(std::move(track));
+	if (!hasVideo && IsVideo(m_Tracks.back())) {
+		m_KeyTrack = index;
+	}
+	return index;
+}
+
+void Fmp4Muxer::SetCodecPrivateData(uint32_t trackIndex, const std::vector<uint8_t> &data)
+{
+	if (trackIndex >= m_Tracks.size() || m_IsInitSegmentWritten) {
+		return;
+	}
+	TRACK &track = m_Tracks[trackIndex];
+	track.Config.CodecPrivateData = data;
+	if (IsVideo(track)) {
+		ParseParameterSets(data.data(), data.size(), track);
+	}
+}
+
+bool Fmp4Muxer::WriteSample(uint32_t trackIndex, const FMP4_SAMPLE &sample)
+{
+	if (m_IsFinalized || m_IsFailed || trackIndex >= m_Tracks.size() || sample.Data == nullptr || sample.Size == 0 || sample.Duration < 0) {
+		return false;
+	}
+	TRACK &keyTrack = m_Tracks[m_KeyTrack];
+	if (!keyTrack.HasKeyframe) {
+		//Nothing is written until the first keyframe, so the output starts with a picture that can be decoded.
+		if (trackIndex != m_KeyTrack || !sample.IsKeyframe) {
+			return true;
+		}
+	}
+	else if (trackIndex == m_KeyTrack && sample.IsKeyframe && !keyTrack.Samples.empty()
+		&& sample.StartPos - keyTrack.FirstStartPos >= m_FragmentDuration) {
+		if (!WriteFragment()) {
+			return false;
+		}
+	}
+
+	TRACK &track = m_Tracks[trackIndex];
+	size_t dataStart = track.Data.size();
+	if (IsVideo(track)) {
+		AppendVideoSample(track, sample);
+	}
+	else {
+		track.Data.insert(track.Data.end(), sample.Data, sample.Data + sample.Size);
+	}
+	size_t size = track.Data.size() - dataStart;
+	if (size == 0) {
+		//The sample held nothing but parameter sets.
+		return true;
+	}
+	if (track.Samples.empty()) {
+		track.BaseDecodeTime = ToTimescale(sample.StartPos, track.Timescale);
+		track.FirstStartPos = sample.StartPos;
+		track.EndPos = sample.StartPos;
+	}
+	SAMPLE_ENTRY entry{};
+	//Durations are the difference of the rounded start and end, so the samples of a continuous stream add up to its timeline without drift.
+	entry.Duration = static_cast<uint32_t>(ToTimescale(sample.StartPos + sample.Duration, track.Timescale) - ToTimescale(sample.StartPos, track.Timescale));
+	entry.Size = static_cast<uint32_t>(size);
+	entry.Flags = sample.IsKeyframe || !IsVideo(track) ? SampleFlagsKeyframe : SampleFlagsNonKeyframe;
+	track.Samples.push_back(entry);
+	track.EndPos = (std::max)(track.EndPos, sample.StartPos + sample.Duration);
+	if (trackIndex == m_KeyTrack && sample.IsKeyframe) {
+		track.HasKeyframe = true;
+	}
+	return true;
+}
+
+bool Fmp4Muxer::Finalize()
+{
+	if (m_IsFinalized) {
+		return !m_IsFailed;
+	}
+	m_IsFinalized = true;
+	if (m_IsFailed) {
+		return false;
+	}
+	bool hasSamples = std::any_of(m_Tracks.begin(), m_Tracks.end(), [](const TRACK &t) { return !t.Samples.empty(); });
+	if (hasSamples) {
+		return WriteFragment();
+	}
+	if (!m_IsInitSegmentWritten) {
+		//A recording without samples still gets an initialization segment, if the video format is known.
+		return WriteInitSegment();
+	}
+	return true;
+}
+
+bool Fmp4Muxer::Output(const std::vector<uint8_t> &data)
+{
+	if (!m_Write(data.data(), data.size())) {
+		m_IsFailed = true;
+		return false;
+	}
+	m_OutputSize += data.size();
+	return true;
+}
+
+bool Fmp4Muxer::WriteInitSegment()
+{
+	for (const TRACK &track : m_Tracks) {
+		if (IsVideo(track) && (track.Sps.size() < 4 || track.Pps.empty())) {
+			m_IsFailed = true;
+			return false;
+		}
+		if (!IsVideo(track) && std::find(std::begin(AacSampleRates), std::end(AacSampleRates), track.Config.SampleRate) == std::end(AacSampleRates)) {
+			m_IsFailed = true;
+			return false;
+		}
+	}
+	m_Buffer.clear();
+	BoxWriter box(m_Buffer);
+	box.Begin("ftyp");
+	box.Bytes(reinterpret_cast<const uint8_t *>("iso6"), 4);
+	box.U32(0);
+	box.Bytes(reinterpret_cast<const uint8_t *>("iso6"), 4);
+	box.Bytes(reinterpret_cast<const uint8_t *>("isom"), 4);
+	box.Bytes(reinterpret_cast<const uint8_t *>("mp41"), 4);
+	if (m_Tracks.size() == 1) {
+		box.Bytes(reinterpret_cast<const uint8_t *>("cmfc"), 4);
+	}
+	box.End();
+
+	box.Begin("moov");
+	box.BeginFull("mvhd", 0, 0);
+	box.U32(0);//creation time
+	box.U32(0);//modification time
+	box.U32(MOVIE_TIMESCALE);
+	box.U32(0);//duration, unknown while fragments are added
+	box.U32(0x00010000);//rate
+	box.U16(0x0100);//volume
+	box.Zeros(10);
+	box.Matrix();
+	box.Zeros(24);
+	box.U32(static_cast<uint32_t>(m_Tracks.size()) + 1);//next track ID
+	box.End();
+
+	for (uint32_t i = 0; i < m_Tracks.size(); i++) {
+		const TRACK &track = m_Tracks[i];
+		bool isVideo = IsVideo(track);
+		box.Begin("trak");
+		box.BeginFull("tkhd", 0, 0x000003);//enabled and in movie
+		box.U32(0);
+		box.U32(0);
+		box.U32(i + 1);//track ID
+		box.U32(0);
+		box.U32(0);//duration
+		box.Zeros(8);
+		box.U16(0);//layer
+		box.U16(0);//alternate group
+		box.U16(isVideo ? 0 : 0x0100);//volume
+		box.U16(0);
+		box.Matrix();
+		box.U32(isVideo ? track.Config.Width << 16 : 0);
+		box.U32(isVideo ? track.Config.Height << 16 : 0);
+		box.End();
+
+		box.Begin("mdia");
+		box.BeginFull("mdhd", 0, 0);
+		box.U32(0);
+		box.U32(0);
+		box.U32(track.Timescale);
+		box.U32(0);
+		box.U16(0x55C4);//language 'und'
+		box.U16(0);
+		box.End();
+		box.BeginFull("hdlr", 0, 0);
+		box.U32(0);
+		box.Bytes(reinterpret_cast<const uint8_t *>(isVideo ? "vide" : "soun"), 4);
+		box.Zeros(12);
+		const char *name = isVideo ? "VideoHandler" : "SoundHandler";
+		box.Bytes(reinterpret_cast<const uint8_t *>(name), strlen(name) + 1);
+		box.End();
+
+		box.Begin("minf");
+		if (isVideo) {
+			box.BeginFull("vmhd", 0, 1);
+			box.Zeros(8);
+			box.End();
+		}
+		else {
+			box.BeginFull("smhd", 0, 0);
+			box.Zeros(4);
+			box.End();
+		}
+		box.Begin("dinf");
+		box.BeginFull("dref", 0, 0);
+		box.U32(1);
+		box.BeginFull("url ", 0, 1);//media is in the same file
+		box.End();
+		box.End();
+		box.End();
+
+		box.Begin("stbl");
+		box.BeginFull("stsd", 0, 0);
+		box.U32(1);
+		if (isVideo) {
+			box.Begin("avc1");
+			box.Zeros(6);
+			box.U16(1);//data reference index
+			box.Zeros(16);
+			box.U16(static_cast<uint16_t>(track.Config.Width));
+			box.U16(static_cast<uint16_t>(track.Config.Height));
+			box.U32(0x00480000);//72 dpi
+			box.U32(0x00480000);
+			box.U32(0);
+			box.U16(1);//frame count
+			box.Zeros(32);//compressor name
+			box.U16(0x0018);//depth
+			box.U16(0xFFFF);
+			box.Begin("avcC");
+			box.U8(1);
+			box.U8(track.Sps[1]);//profile
+			box.U8(track.Sps[2]);//profile compatibility
+			box.U8(track.Sps[3]);//level
+			box.U8(0xFF);//4 byte NAL unit lengths
+			box.U8(0xE1);//one sequence parameter set
+			box.U16(static_cast<uint16_t>(track.Sps.size()));
+			box.Bytes(track.Sps.data(), track.Sps.size());
+			box.U8(1);//one picture parameter set
+			box.U16(static_cast<uint16_t>(track.Pps.size()));
+			box.Bytes(track.Pps.data(), track.Pps.size());
+			uint8_t profile = track.Sps[1];
+			if (profile == 100 || profile == 110 || profile == 122 || profile == 144) {
+				//The encoders are fed 8 bit 4:2:0, which is what the high profiles need spelled out.
+				box.U8(0xFC | 1);
+				box.U8(0xF8);
+				box.U8(0xF8);
+				box.U8(0);
+			}
+			box.End();
+			box.End();
+		}
+		else {
+			uint8_t frequencyIndex = static_cast<uint8_t>(std::find(std::begin(AacSampleRates), std::end(AacSampleRates), track.Config.SampleRate) - std::begin(AacSampleRates));
+			//AudioSpecificConfig of AAC-LC: object type 2, the sample rate index and the channel configuration.
+			uint16_t audioSpecificConfig = static_cast<uint16_t>((2 << 11) | (frequencyIndex << 7) | ((track.Config.Channels & 0xF) << 3));
+			box.Begin("mp4a");
+			box.Zeros(6);
+			box.U16(1);//data reference index
+			box.Zeros(8);
+			box.U16(static_cast<uint16_t>(track.Config.Channels));
+			box.U16(16);//sample size
+			box.U16(0);
+			box.U16(0);
+			box.U32(track.Config.SampleRate << 16);
+			box.BeginFull("esds", 0, 0);
+			box.U8(0x03);//ES descriptor
+			box.U8(25);
+			box.U16(0);//ES ID
+			box.U8(0);
+			box.U8(0x04);//decoder config descriptor
+			box.U8(17);
+			box.U8(0x40);//MPEG-4 audio
+			box.U8(0x15);//audio stream
+			box.U24(0);//buffer size
+			box.U32(track.Config.Bitrate);//max bitrate
+			box.U32(track.Config.Bitrate);//average bitrate
+			box.U8(0x05);//decoder specific info
+			box.U8(2);
+			box.U16(audioSpecificConfig);
+			box.U8(0x06);//SL config descriptor
+			box.U8(1);
+			box.U8(2);
+			box.End();
+			box.End();
+		}
+		box.End();//stsd
+		//The sample tables are empty, since all samples are in the fragments.
+		box.BeginFull("stts", 0, 0);
+		box.U32(0);
+		box.End();
+		box.BeginFull("stsc", 0, 0);
+		box.U32(0);
+		box.End();
+		box.BeginFull("stsz", 0, 0);
+		box.U32(0);
+		box.U32(0);
+		box.End();
+		box.BeginFull("stco", 0, 0);
+		box.U32(0);
+		box.End();
+		box.End();//stbl
+		box.End();//minf
+		box.End();//mdia
+		box.End();//trak
+	}
+
+	box.Begin("mvex");
+	for (uint32_t i = 0; i < m_Tracks.size(); i++) {
+		box.BeginFull("trex", 0, 0);
+		box.U32(i + 1);
+		box.U32(1);//sample description index
+		box.U32(0);
+		box.U32(0);
+		box.U32(0);
+		box.End();
+	}
+	box.End();
+	box.End();//moov
+
+	if (!Output(m_Buffer)) {
+		return false;
+	}
+	m_InitSegmentSize = m_OutputSize;
+	m_IsInitSegmentWritten = true;
+	return true;
+}
+
+bool Fmp4Muxer::WriteFragment()
+{
+	if (!m_IsInitSegmentWritten && !WriteInitSegment()) {
+		return false;
+	}
+	uint64_t dataSize = 0;
+	for (const TRACK &track : m_Tracks) {
+		dataSize += track.Data.size();
+	}
+	bool isLargeData = dataSize + 8 > (std::numeric_limits<uint32_t>::max)();
+	uint64_t mdatHeaderSize = isLargeData ? 16 : 8;
+
+	m_Buffer.clear();
+	BoxWriter box(m_Buffer);
+	std::vector<size_t> dataOffsetPositions;
+	box.Begin("moof");
+	box.BeginFull("mfhd", 0, 0);
+	box.U32(m_NextSequenceNumber);
+	box.End();
+	for (uint32_t i = 0; i < m_Tracks.size(); i++) {
+		const TRACK &track = m_Tracks[i];
+		if (track.Samples.empty()) {
+			continue;
+		}
+		box.Begin("traf");
+		box.BeginFull("tfhd", 0, 0x020000);//default-base-is-moof
+		box.U32(i + 1);
+		box.End();
+		box.BeginFull("tfdt", 1, 0);
+		box.U64(track.BaseDecodeTime);
+		box.End();
+		box.BeginFull("trun", 0, 0x000001 | 0x000100 | 0x000200 | 0x000400);//data offset, sample durations, sizes and flags
+		box.U32(static_cast<uint32_t>(track.Samples.size()));
+		dataOffsetPositions.push_back(box.Position());
+		box.U32(0);
+		for (const SAMPLE_ENTRY &sample : track.Samples) {
+			box.U32(sample.Duration);
+			box.U32(sample.Size);
+			box.U32(sample.Flags);
+		}
+		box.End();
+		box.End();
+	}
+	box.End();
+
+	//The data offsets are relative to the start of the moof box, and point to the data of each track in the mdat box that follows it.
+	uint64_t dataOffset = m_Buffer.size() + mdatHeaderSize;
+	size_t positionIndex = 0;
+	for (const TRACK &track : m_Tracks) {
+		if (track.Samples.empty()) {
+			continue;
+		}
+		box.PatchU32(dataOffsetPositions[positionIndex++], static_cast<uint32_t>(dataOffset));
+		dataOffset += track.Data.size();
+	}
+	if (isLargeData) {
+		box.U32(1);
+		box.Bytes(reinterpret_cast<const uint8_t *>("mdat"), 4);
+		box.U64(dataSize + mdatHeaderSize);
+	}
+	else {
+		box.U32(static_cast<uint32_t>(dataSize + mdatHeaderSize));
+		box.Bytes(reinterpret_cast<const uint8_t *>("mdat"), 4);
+	}
+
+	const TRACK &keyTrack = m_Tracks[m_KeyTrack].Samples.empty()
+		? *std::find_if(m_Tracks.begin(), m_Tracks.end(), [](const TRACK &t) { return !t.Samples.empty(); })
+		: m_Tracks[m_KeyTrack];
+	FMP4_FRAGMENT_INFO fragment{};
+	fragment.SequenceNumber = m_NextSequenceNumber;
+	fragment.Offset = m_OutputSize;
+	fragment.Size = m_Buffer.size() + dataSize;
+	fragment.StartPos = keyTrack.FirstStartPos;
+	fragment.Duration = keyTrack.EndPos - keyTrack.FirstStartPos;
+	fragment.IsKeyframe = keyTrack.Samples.front().Flags == SampleFlagsKeyframe;
+
+	if (!Output(m_Buffer)) {
+		return false;
+	}
+	for (TRACK &track : m_Tracks) {
+		if (!track.Data.empty() && !Output(track.Data)) {
+			return false;
+		}
+		track.Samples.clear();
+		track.Data.clear();
+	}
+	m_NextSequenceNumber++;
+	m_Fragments.push_back(fragment);
+	if (m_OnFragment) {
+		m_OnFragment(fragment);
+	}
+	return true;
+}
+
+void Fmp4Muxer::AppendVideoSample(TRACK &track, const FMP4_SAMPLE &sample)
+{
+	//Samples are stored with 4 byte length prefixes. Parameter sets go in the sample entry, and access unit delimiters are not needed in MP4.
+	ForEachNalUnit(sample.Data, sample.Size, [&track](const uint8_t *pNalUnit, size_t size) {
+		uint8_t type = pNalUnit[0] & 0x1F;
+		if (type == NalUnitTypeSps) {
+			if (track.Sps.empty()) {
+				track.Sps.assign(pNalUnit, pNalUnit + size);
+			}
+			return;
+		}
+		if (type == NalUnitTypePps) {
+			if (track.Pps.empty()) {
+				track.Pps.assign(pNalUnit, pNalUnit + size);
+			}
+			return;
+		}
+		if (type == NalUnitTypeAccessUnitDelimiter) {
+			return;
+		}
+		uint32_t length = static_cast<uint32_t>(size);
+		track.Data.push_back(static_cast<uint8_t>(length >> 24));
+		track.Data.push_back(static_cast<uint8_t>(length >> 16));
+		track.Data.push_back(static_cast<uint8_t>(length >> 8));
+		track.Data.push_back(static_cast<uint8_t>(length));
+		track.Data.insert(track.Data.end(), pNalUnit, pNalUnit + size);
+	});
+}
+
+void Fmp4Muxer::ParseParameterSets(const uint8_t *pData, size_t size, TRACK &track)
+{
+	if (pData == nullptr || size == 0) {
+		return;
+	}
+	ForEachNalUnit(pData, size, [&track](const uint8_t *pNalUnit, size_t nalSize) {
+		uint8_t type = pNalUnit[0] & 0x1F;
+		if (type == NalUnitTypeSps) {
+			track.Sps.assign(pNalUnit, pNalUnit + nalSize);
+		}
+		else if (type == NalUnitTypePps) {
+			track.Pps.assign(pNalUnit, pNalUnit + nalSize);
+		}
+	});
+}
+
+uint64_t Fmp4Muxer::ToTimescale(int64_t pos, uint32_t timescale)
+{
+	if (pos <= 0) {
+		return 0;
+	}
+	//Split in whole seconds and the rest, so long recordings do not overflow.
+	return static_cast<uint64_t>(pos / HundredNanosPerSecond) * timescale
+		+ static_cast<uint64_t>(((pos % HundredNanosPerSecond) * timescale + HundredNanosPerSecond / 2) / HundredNanosPerSecond);
+}
@@ -0,0 +1,164 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <vector>
+
+enum class Fmp4Codec {
+	//H.264/AVC video. Samples can be in Annex B format with start codes, as Media Foundation encoders output them, or length prefixed.
+	H264,
+	//AAC-LC audio, as raw access units without ADTS headers.
+	AAC
+};
+
+/// <summary>
+/// The format of a track of a fragmented MP4 file.
+/// </summary>
+struct FMP4_TRACK_CONFIG
+{
+	Fmp4Codec Codec = Fmp4Codec::H264;
+	//The frame size of a video track in pixels.
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	//The format of an audio track.
+	uint32_t SampleRate = 48000;
+	uint32_t Channels = 2;
+	//The average bitrate in bits per second, written to the decoder configuration of an audio track. 0 if unknown.
+	uint32_t Bitrate = 0;
+	//The sequence and picture parameter sets of a video track, in Annex B format. If empty, they are taken from the first keyframe.
+	std::vector<uint8_t> CodecPrivateData;
+};
+
+/// <summary>
+/// An encoded sample passed to Fmp4Muxer.
+/// </summary>
+struct FMP4_SAMPLE
+{
+	//Timestamp of the start of the sample, in 100 nanosecond units.
+	int64_t StartPos = 0;
+	//Duration of the sample, in 100 nanosecond units.
+	int64_t Duration = 0;
+	bool IsKeyframe = false;
+	const uint8_t *Data = nullptr;
+	size_t Size = 0;
+};
+
+/// <summary>
+/// Where a fragment was written, e.g. to serve a recording in progress with HTTP range requests.
+/// </summary>
+struct FMP4_FRAGMENT_INFO
+{
+	//The sequence number of the fragment, starting at 1.
+	uint32_t SequenceNumber = 0;
+	//The offset of the moof box of the fragment from the start of the output, in bytes.
+	uint64_t Offset = 0;
+	//The size of the moof and mdat boxes of the fragment, in bytes.
+	uint64_t Size = 0;
+	//The timestamp of the start of the fragment and its duration, in 100 nanosecond units, from the samples of the video track.
+	int64_t StartPos = 0;
+	int64_t Duration = 0;
+	//Whether the fragment starts with a keyframe, so playback can start at it.
+	bool IsKeyframe = false;
+};
+
+/// <summary>
+/// Writes encoded video and audio as a fragmented MP4 file: an initialization segment with the ftyp and moov boxes, followed by fragments of a moof and an mdat box each.
+/// A fragment is closed when a keyframe of the video track arrives after at least the fragment duration, so every fragment starts with a keyframe, and the fragments follow the CMAF structure (default-base-is-moof, tfdt in every fragment, parameter sets only in the sample entry).
+/// A file with a single track is branded as CMAF. CMAF puts every track in a file of its own, so a file with video and audio is branded as plain ISO BMFF, with the same layout.
+/// The output is written sequentially, and nothing is written back once it is out, so it can go to a stream that is being read while recording.
+/// Methods must be called from a single thread. The muxer is portable, and has no dependency on Media Foundation.
+/// </summary>
+class Fmp4Muxer
+{
+public:
+	//Writes the next part of the output. Returns false if the write failed.
+	typedef std::function<bool(const uint8_t *pData, size_t size)> WriteFunction;
+	//Called after each fragment is written.
+	typedef std::function<void(const FMP4_FRAGMENT_INFO &fragment)> FragmentFunction;
+
+	/// <param name="write">Receives the output</param>
+	/// <param name="fragmentDuration">The shortest duration of a fragment, in 100 nanosecond units. 0 starts a fragment at every keyframe</param>
+	/// <param name="onFragment">Called with the position of every fragment written, or nullptr</param>
+	Fmp4Muxer(WriteFunction write, int64_t fragmentDuration, FragmentFunction onFragment = nullptr);
+	~Fmp4Muxer();
+
+	Fmp4Muxer(const Fmp4Muxer &) = delete;
+	Fmp4Muxer &operator=(const Fmp4Muxer &) = delete;
+
+	/// <summary>
+	/// Adds a track. All tracks must be added before the first sample.
+	/// </summary>
+	/// <returns>The index of the track, for WriteSample</returns>
+	uint32_t AddTrack(const FMP4_TRACK_CONFIG &config);
+	/// <summary>
+	/// Sets the parameter sets of a video track, in Annex B format, if they were not known when the track was added. Has no effect once the initialization segment is written.
+	/// </summary>
+	void SetCodecPrivateData(uint32_t trackIndex, const std::vector<uint8_t> &data);
+	/// <summary>
+	/// Adds a sample to the current fragment, and writes the fragment first if the sample starts the next one.
+	/// Video samples before the first keyframe are dropped, since they cannot be decoded.
+	/// </summary>
+	/// <returns>false if the sample is invalid, or writing failed</returns>
+	bool WriteSample(uint32_t trackIndex, const FMP4_SAMPLE &sample);
+	/// <summary>
+	/// Writes the last fragment. Nothing can be written afterwards.
+	/// </summary>
+	/// <returns>false if writing failed, or if the initialization segment could not be written because the parameter sets of the video were never found</returns>
+	bool Finalize();
+
+	inline uint64_t GetOutputSize() const { return m_OutputSize; }
+	//The size of the initialization segment, which is the start of the output up to the first fragment. 0 until it is written.
+	inline uint64_t GetInitSegmentSize() const { return m_InitSegmentSize; }
+	inline const std::vector<FMP4_FRAGMENT_INFO> &GetFragments() const { return m_Fragments; }
+	inline bool IsFailed() const { return m_IsFailed; }
+
+	static constexpr uint32_t VIDEO_TIMESCALE = 90000;
+	static constexpr uint32_t MOVIE_TIMESCALE = 1000;
+
+private:
+	struct SAMPLE_ENTRY
+	{
+		uint32_t Duration;
+		uint32_t Size;
+		uint32_t Flags;
+	};
+
+	struct TRACK
+	{
+		FMP4_TRACK_CONFIG Config;
+		uint32_t Timescale;
+		std::vector<uint8_t> Sps;
+		std::vector<uint8_t> Pps;
+		//The samples of the current fragment, with their data back to back.
+		std::vector<SAMPLE_ENTRY> Samples;
+		std::vector<uint8_t> Data;
+		//The decode time of the first sample of the fragment, in the timescale of the track.
+		uint64_t BaseDecodeTime;
+		int64_t FirstStartPos;
+		int64_t EndPos;
+		bool HasKeyframe;
+	};
+
+	WriteFunction m_Write;
+	FragmentFunction m_OnFragment;
+	const int64_t m_FragmentDuration;
+	std::vector<TRACK> m_Tracks;
+	//The track fragments are timed and cut by. The first video track, or the first track if there is no video.
+	uint32_t m_KeyTrack;
+	uint32_t m_NextSequenceNumber;
+	uint64_t m_OutputSize;
+	uint64_t m_InitSegmentSize;
+	std::vector<FMP4_FRAGMENT_INFO> m_Fragments;
+	std::vector<uint8_t> m_Buffer;
+	bool m_IsInitSegmentWritten;
+	bool m_IsFinalized;
+	bool m_IsFailed;
+
+	bool IsVideo(const TRACK &track) const { return track.Config.Codec == Fmp4Codec::H264; }
+	bool Output(const std::vector<uint8_t> &data);
+	bool WriteInitSegment();
+	bool WriteFragment();
+	void AppendVideoSample(TRACK &track, const FMP4_SAMPLE &sample);
+	static void ParseParameterSets(const uint8_t *pData, size_t size, TRACK &track);
+	static uint64_t ToTimescale(int64_t pos, uint32_t timescale);
+};
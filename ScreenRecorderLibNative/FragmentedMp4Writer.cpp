@@ -0,0 +1,136 @@
+#include "FragmentedMp4Writer.h"
+#include "Log.h"
+#include "util.h"
+#include <Mferror.h>
+
+FragmentedMp4Writer::FragmentedMp4Writer() :
+	m_OutStream(nullptr),
+	m_Muxer(nullptr),
+	m_VideoTrack(0),
+	m_AudioTrack(0),
+	m_IsAudioEnabled(false),
+	m_IsCodecPrivateDataSet(false)
+{
+}
+
+FragmentedMp4Writer::~FragmentedMp4Writer()
+{
+}
+
+HRESULT FragmentedMp4Writer::Initialize(
+	_In_ IMFByteStream *pOutStream,
+	_In_ IMFMediaType *pVideoMediaTypeIn,
+	_In_ IMFMediaType *pVideoMediaTypeOut,
+	_In_opt_ IMFMediaType *pAudioMediaTypeIn,
+	_In_opt_ IMFMediaType *pAudioMediaTypeOut,
+	_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions,
+	_In_ INT64 fragmentDuration,
+	_In_opt_ Fmp4Muxer::FragmentFunction onFragment)
+{
+	m_OutStream = pOutStream;
+	m_Muxer = std::make_unique<Fmp4Muxer>([this](const uint8_t *pData, size_t size) { return Write(pData, size); }, fragmentDuration, onFragment);
+
+	FMP4_TRACK_CONFIG videoConfig{};
+	videoConfig.Codec = Fmp4Codec::H264;
+	RETURN_ON_BAD_HR(MFGetAttributeSize(pVideoMediaTypeOut, MF_MT_FRAME_SIZE, &videoConfig.Width, &videoConfig.Height));
+	m_VideoTrack = m_Muxer->AddTrack(videoConfig);
+
+	m_IsAudioEnabled = pAudioMediaTypeIn && pAudioMediaTypeOut;
+	if (m_IsAudioEnabled) {
+		FMP4_TRACK_CONFIG audioConfig{};
+		audioConfig.Codec = Fmp4Codec::AAC;
+		RETURN_ON_BAD_HR(pAudioMediaTypeOut->GetUINT32(MF_MT_AUDIO_SAMPLES_PER_SECOND, &audioConfig.SampleRate));
+		RETURN_ON_BAD_HR(pAudioMediaTypeOut->GetUINT32(MF_MT_AUDIO_NUM_CHANNELS, &audioConfig.Channels));
+		audioConfig.Bitrate = MFGetAttributeUINT32(pAudioMediaTypeOut, MF_MT_AUDIO_AVG_BYTES_PER_SECOND, 0) * 8;
+		m_AudioTrack = m_Muxer->AddTrack(audioConfig);
+	}
+
+	//A keyframe at every fragment boundary keeps the fragments close to the requested duration. With no duration, the encoder picks the interval.
+	UINT32 keyframeInterval = fragmentDuration > 0 ? static_cast<UINT32>(max(1LL, pEncoderOptions->GetVideoFps() * HundredNanosToMillis(fragmentDuration) / 1000)) : 0;
+	RETURN_ON_BAD_HR(m_VideoEncoder.Create(pVideoMediaTypeIn, pVideoMediaTypeOut));
+	RETURN_ON_BAD_HR(m_VideoEncoder.ConfigureVideo(pEncoderOptions, keyframeInterval));
+	RETURN_ON_BAD_HR(m_VideoEncoder.Start([this](ENCODED_PACKET &packet) { return WritePacket(m_VideoTrack, packet); }));
+	if (m_IsAudioEnabled) {
+		RETURN_ON_BAD_HR(m_AudioEncoder.Create(pAudioMediaTypeIn, pAudioMediaTypeOut));
+		RETURN_ON_BAD_HR(m_AudioEncoder.Start([this](ENCODED_PACKET &packet) { return WritePacket(m_AudioTrack, packet); }));
+	}
+	LOG_INFO("Writing fragmented MP4 with fragments of at least %lld ms", HundredNanosToMillis(fragmentDuration));
+	return S_OK;
+}
+
+HRESULT FragmentedMp4Writer::WriteSample(_In_ DWORD streamIndex, _In_ IMFSample *pSample)
+{
+	if (!m_Muxer) {
+		return MF_E_NOT_INITIALIZED;
+	}
+	if (streamIndex == VIDEO_STREAM_INDEX) {
+		return m_VideoEncoder.Encode(pSample);
+	}
+	else if (streamIndex == AUDIO_STREAM_INDEX && m_IsAudioEnabled) {
+		return m_AudioEncoder.Encode(pSample);
+	}
+	return MF_E_INVALIDSTREAMNUMBER;
+}
+
+HRESULT FragmentedMp4Writer::Finalize()
+{
+	if (!m_Muxer) {
+		return MF_E_NOT_INITIALIZED;
+	}
+	HRESULT hr = m_VideoEncoder.Drain();
+	if (SUCCEEDED(hr) && m_IsAudioEnabled) {
+		hr = m_AudioEncoder.Drain();
+	}
+	//The last fragment is written even if draining failed, so the samples already encoded are kept.
+	if (!m_Muxer->Finalize()) {
+		LOG_ERROR("Failed to write the last fragment of the fragmented MP4 file");
+		return FAILED(hr) ? hr : E_FAIL;
+	}
+	LOG_DEBUG("Wrote %zu fragments and %llu bytes of fragmented MP4", m_Muxer->GetFragments().size(), m_Muxer->GetOutputSize());
+	return hr;
+}
+
+HRESULT FragmentedMp4Writer::WritePacket(_In_ uint32_t track, _In_ ENCODED_PACKET &packet)
+{
+	if (track == m_VideoTrack && !m_IsCodecPrivateDataSet) {
+		//The parameter sets are in the output type once the encoder has produced output. Encoders that repeat them in the keyframes are covered by the muxer as well.
+		CComPtr<IMFMediaType> pOutputType = m_VideoEncoder.GetOutputType();
+		UINT32 size = 0;
+		if (pOutputType && SUCCEEDED(pOutputType->GetBlobSize(MF_MT_MPEG_SEQUENCE_HEADER, &size)) && size > 0) {
+			std::vector<uint8_t> sequenceHeader(size);
+			RETURN_ON_BAD_HR(pOutputType->GetBlob(MF_MT_MPEG_SEQUENCE_HEADER, sequenceHeader.data(), size, nullptr));
+			m_Muxer->SetCodecPrivateData(m_VideoTrack, sequenceHeader);
+		}
+		m_IsCodecPrivateDataSet = true;
+	}
+	BYTE *pData = nullptr;
+	DWORD length = 0;
+	RETURN_ON_BAD_HR(packet.Buffer->Lock(&pData, nullptr, &length));
+	FMP4_SAMPLE sample{};
+	sample.StartPos = packet.StartPos;
+	sample.Duration = packet.Duration;
+	sample.IsKeyframe = packet.IsKeyframe;
+	sample.Data = pData;
+	sample.Size = length;
+	bool isWritten = m_Muxer->WriteSample(track, sample);
+	packet.Buffer->Unlock();
+	if (!isWritten) {
+		LOG_ERROR("Failed to write %hs sample at %lld ms to fragmented MP4", track == m_VideoTrack ? "video" : "audio", HundredNanosToMillis(packet.StartPos));
+		return E_FAIL;
+	}
+	return S_OK;
+}
+
+bool FragmentedMp4Writer::Write(_In_ const uint8_t *pData, _In_ size_t size)
+{
+	while (size > 0) {
+		ULONG chunkSize = static_cast<ULONG>(min(size, static_cast<size_t>(ULONG_MAX)));
+		ULONG written = 0;
+		if (FAILED(m_OutStream->Write(pData, chunkSize, &written)) || written == 0) {
+			return false;
+		}
+		pData += written;
+		size -= written;
+	}
+	return true;
+}
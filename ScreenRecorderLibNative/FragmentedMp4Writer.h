@@ -0,0 +1,60 @@
+#pragma once
+#include <memory>
+#include "MFEncoder.h"
+#include "Fmp4Muxer.h"
+
+/// <summary>
+/// Writes a recording as fragmented MP4 with a fragment duration of its own choosing, and reports every fragment as it is written, so a recording in progress can be served with HTTP range requests.
+/// Video and audio are encoded with synchronous Media Foundation encoders on the thread that writes the samples, and muxed with Fmp4Muxer. The video gets a keyframe at every fragment boundary.
+/// Only H.264 video is supported by the muxer.
+/// </summary>
+class FragmentedMp4Writer
+{
+public:
+	FragmentedMp4Writer();
+	~FragmentedMp4Writer();
+	/// <summary>
+	/// Creates and starts the encoders. Nothing is written to the output until the first fragment is complete.
+	/// </summary>
+	/// <param name="pOutStream">Receives the fragmented MP4 file. Written sequentially, and never seeked</param>
+	/// <param name="pVideoMediaTypeIn">The uncompressed video type, in a YUV format the encoder accepts</param>
+	/// <param name="pVideoMediaTypeOut">The encoded video type</param>
+	/// <param name="pAudioMediaTypeIn">The PCM audio type, or nullptr for no audio</param>
+	/// <param name="pAudioMediaTypeOut">The encoded audio type, or nullptr for no audio</param>
+	/// <param name="pEncoderOptions">The rate control and frame rate of the video encoder</param>
+	/// <param name="fragmentDuration">The shortest duration of a fragment, in 100 nanosecond units</param>
+	/// <param name="onFragment">Called on the encoding thread after every fragment is written, or nullptr</param>
+	HRESULT Initialize(
+		_In_ IMFByteStream *pOutStream,
+		_In_ IMFMediaType *pVideoMediaTypeIn,
+		_In_ IMFMediaType *pVideoMediaTypeOut,
+		_In_opt_ IMFMediaType *pAudioMediaTypeIn,
+		_In_opt_ IMFMediaType *pAudioMediaTypeOut,
+		_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions,
+		_In_ INT64 fragmentDuration,
+		_In_opt_ Fmp4Muxer::FragmentFunction onFragment);
+	/// <summary>
+	/// Encodes a sample and muxes the output. Samples must be written from a single thread.
+	/// </summary>
+	HRESULT WriteSample(_In_ DWORD streamIndex, _In_ IMFSample *pSample);
+	/// <summary>
+	/// Drains the encoders and writes the last fragment. Nothing can be written afterwards.
+	/// </summary>
+	HRESULT Finalize();
+	UINT64 GetOutputSize() { return m_Muxer ? m_Muxer->GetOutputSize() : 0; }
+
+	static constexpr DWORD VIDEO_STREAM_INDEX = 0;
+	static constexpr DWORD AUDIO_STREAM_INDEX = 1;
+private:
+	CComPtr<IMFByteStream> m_OutStream;
+	std::unique_ptr<Fmp4Muxer> m_Muxer;
+	MFEncoder m_VideoEncoder;
+	MFEncoder m_AudioEncoder;
+	uint32_t m_VideoTrack;
+	uint32_t m_AudioTrack;
+	bool m_IsAudioEnabled;
+	bool m_IsCodecPrivateDataSet;
+
+	HRESULT WritePacket(_In_ uint32_t track, _In_ ENCODED_PACKET &packet);
+	bool Write(_In_ const uint8_t *pData, _In_ size_t size);
+};
@@ -0,0 +1,102 @@
+#include "FramePacer.h"
+#include <algorithm>
+#include <chrono>
+
+namespace {
+	typedef std::chrono::duration<int64_t, std::ratio<1, 10000000>> HundredNanos;
+}
+
+SteadyFrameWaiter::SteadyFrameWaiter() :
+	m_IsSignaled(false)
+{
+}
+
+int64_t SteadyFrameWaiter::Now()
+{
+	return std::chrono::duration_cast<HundredNanos>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameWaitResult SteadyFrameWaiter::WaitUntil(int64_t time100Nanos)
+{
+	std::chrono::steady_clock::time_point deadline{ std::chrono::duration_cast<std::chrono::steady_clock::duration>(HundredNanos(time100Nanos)) };
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	bool isSignaled = m_Signaled.wait_until(lock, deadline, [this] { return m_IsSignaled; });
+	m_IsSignaled = false;
+	return isSignaled ? FrameWaitResult::Signaled : FrameWaitResult::Deadline;
+}
+
+void SteadyFrameWaiter::Signal()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsSignaled = true;
+	}
+	m_Signaled.notify_one();
+}
+
+FramePacer::FramePacer(FrameWaiter *pWaiter, int64_t interval100Nanos, bool isFixedFramerate) :
+	m_Waiter(pWaiter),
+	m_Interval((std::max)(interval100Nanos, int64_t(0))),
+	m_IsFixedFramerate(isFixedFramerate),
+	m_LastFrameEnd(0),
+	m_NextDeadline(0),
+	m_Stats{}
+{
+	Start();
+}
+
+void FramePacer::Start()
+{
+	m_LastFrameEnd = Now();
+	m_NextDeadline = m_LastFrameEnd + m_Interval;
+}
+
+int64_t FramePacer::GetTimeSinceLastFrame()
+{
+	return (std::max)(Now() - m_LastFrameEnd, int64_t(0));
+}
+
+FrameWaitResult FramePacer::WaitForDeadline()
+{
+	return WaitUntil(m_NextDeadline);
+}
+
+FrameWaitResult FramePacer::WaitFor(int64_t duration100Nanos)
+{
+	return WaitUntil(Now() + (std::max)(duration100Nanos, int64_t(0)));
+}
+
+FrameWaitResult FramePacer::WaitUntil(int64_t time100Nanos)
+{
+	FrameWaitResult result = m_Waiter->WaitUntil(time100Nanos);
+	m_Stats.WaitCount++;
+	if (result == FrameWaitResult::Signaled) {
+		m_Stats.SignaledWaitCount++;
+	}
+	else {
+		int64_t lateness = (std::max)(Now() - time100Nanos, int64_t(0));
+		m_Stats.TotalWakeLateness100Nanos += lateness;
+		m_Stats.MaxWakeLateness100Nanos = (std::max)(m_Stats.MaxWakeLateness100Nanos, lateness);
+	}
+	return result;
+}
+
+int64_t FramePacer::CompleteFrame()
+{
+	int64_t now = Now();
+	int64_t frameEnd = now;
+	if (m_IsFixedFramerate && m_Interval > 0 && now >= m_NextDeadline) {
+		int64_t missedIntervals = (now - m_NextDeadline) / m_Interval;
+		frameEnd = m_NextDeadline + missedIntervals * m_Interval;
+		int64_t lateness = now - frameEnd;
+		m_Stats.MissedIntervalCount += missedIntervals;
+		m_Stats.PacedFrameCount++;
+		m_Stats.TotalLateness100Nanos += lateness;
+		m_Stats.MaxLateness100Nanos = (std::max)(m_Stats.MaxLateness100Nanos, lateness);
+	}
+	int64_t duration = (std::max)(frameEnd - m_LastFrameEnd, int64_t(0));
+	m_LastFrameEnd = (std::max)(frameEnd, m_LastFrameEnd);
+	m_NextDeadline = m_LastFrameEnd + m_Interval;
+	m_Stats.FrameCount++;
+	return duration;
+}
@@ -0,0 +1,116 @@
+#pragma once
+#include <cstdint>
+#include <condition_variable>
+#include <mutex>
+
+enum class FrameWaitResult
+{
+	//The time waited for was reached.
+	Deadline,
+	//Another thread signaled, e.g. because a new frame was captured.
+	Signaled
+};
+
+/// <summary>
+/// A monotonic clock, and a way to sleep on it until a deadline or until another thread signals. FramePacer runs on this, so it can be tested against a fake clock.
+/// Times are in 100 nanosecond units, like the rest of the recorder.
+/// </summary>
+class FrameWaiter
+{
+public:
+	virtual ~FrameWaiter() = default;
+	virtual int64_t Now() = 0;
+	/// <summary>
+	/// Sleeps until the time is reached, or until Signal is called. A signal sent before the call ends the wait right away, so none are lost.
+	/// </summary>
+	virtual FrameWaitResult WaitUntil(int64_t time100Nanos) = 0;
+	virtual void Signal() = 0;
+};
+
+/// <summary>
+/// A FrameWaiter on std::chrono::steady_clock and a condition variable.
+/// </summary>
+class SteadyFrameWaiter : public FrameWaiter
+{
+public:
+	SteadyFrameWaiter();
+	int64_t Now() override;
+	FrameWaitResult WaitUntil(int64_t time100Nanos) override;
+	void Signal() override;
+
+private:
+	bool m_IsSignaled;
+	std::mutex m_Mutex;
+	std::condition_variable m_Signaled;
+};
+
+struct FRAME_PACER_STATS
+{
+	uint64_t FrameCount = 0;
+	//The frame intervals that passed without a frame of their own, because the frame before was completed too late. Only counted for fixed framerates.
+	uint64_t MissedIntervalCount = 0;
+	//The frames completed at or after their deadline with a fixed framerate, and how late they were. This is the jitter of the frame times.
+	uint64_t PacedFrameCount = 0;
+	int64_t TotalLateness100Nanos = 0;
+	int64_t MaxLateness100Nanos = 0;
+	//The number of times the pacer slept, and how many of those a signal ended before the deadline.
+	uint64_t WaitCount = 0;
+	uint64_t SignaledWaitCount = 0;
+	//How late the waits that ran to their deadline woke up. This is the jitter of the timer.
+	int64_t TotalWakeLateness100Nanos = 0;
+	int64_t MaxWakeLateness100Nanos = 0;
+
+	inline double GetAverageLatenessMillis() const { return PacedFrameCount > 0 ? TotalLateness100Nanos / 10000.0 / PacedFrameCount : 0; }
+	inline double GetAverageWakeLatenessMillis() const { return WaitCount > SignaledWaitCount ? TotalWakeLateness100Nanos / 10000.0 / (WaitCount - SignaledWaitCount) : 0; }
+};
+
+/// <summary>
+/// Paces frames to an interval on the monotonic clock of a FrameWaiter. The recorder loop sleeps until the next deadline or until a new frame is signaled, instead of polling.
+/// Deadlines are set from where the previous frame ended on the timeline, not from when it was completed, so time spent waking up and rendering does not add up to drift.
+/// With a fixed framerate, a late frame is moved back to the start of the interval it was completed in, so every frame lasts a whole number of intervals and the timeline stays in step with the clock. Intervals that pass without a frame are added to the frame before them.
+/// Otherwise, frames last from the end of the previous frame to when they are completed.
+/// Frames completed before their deadline, such as the first frame, end when they are completed, and the intervals after them start there.
+/// Not thread safe, except for signaling the waiter.
+/// </summary>
+class FramePacer
+{
+public:
+	/// <param name="pWaiter">The clock and wait to pace on. Must outlive the pacer</param>
+	/// <param name="interval100Nanos">The duration of a frame. 0 for no pacing</param>
+	/// <param name="isFixedFramerate">Whether frames last a whole number of intervals</param>
+	FramePacer(FrameWaiter *pWaiter, int64_t interval100Nanos, bool isFixedFramerate);
+
+	/// <summary>
+	/// Starts the timeline at the current time, with the first deadline an interval from now. Also used to resume after a pause, which leaves the paused time out of the frames.
+	/// </summary>
+	void Start();
+	inline int64_t Now() { return m_Waiter->Now(); }
+	inline int64_t GetNextDeadline() const { return m_NextDeadline; }
+	//The time since the end of the previous frame, or since the start.
+	int64_t GetTimeSinceLastFrame();
+	/// <summary>
+	/// Sleeps until the next deadline, or until the waiter is signaled.
+	/// </summary>
+	FrameWaitResult WaitForDeadline();
+	/// <summary>
+	/// Sleeps for a time, or until the waiter is signaled.
+	/// </summary>
+	FrameWaitResult WaitFor(int64_t duration100Nanos);
+	/// <summary>
+	/// Ends the current frame, and sets the deadline of the next.
+	/// </summary>
+	/// <returns>The duration of the frame</returns>
+	int64_t CompleteFrame();
+	inline FRAME_PACER_STATS GetStats() const { return m_Stats; }
+
+private:
+	FrameWaiter *m_Waiter;
+	const int64_t m_Interval;
+	const bool m_IsFixedFramerate;
+	//Where the previous frame ended on the timeline.
+	int64_t m_LastFrameEnd;
+	int64_t m_NextDeadline;
+	FRAME_PACER_STATS m_Stats;
+
+	FrameWaitResult WaitUntil(int64_t time100Nanos);
+};
@@ -0,0 +1,291 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct FRAME_PIPELINE_STAGE_STATS
+{
+	std::string Name;
+	//The number of items the stage processed.
+	uint64_t ProcessedCount = 0;
+	//The time spent processing items, which is the latency the stage adds to a frame.
+	uint64_t TotalProcessMicros = 0;
+	uint64_t MaxProcessMicros = 0;
+	//The time items waited in the queue of the stage, from being handed over until the stage took them.
+	uint64_t TotalQueueLatencyMicros = 0;
+	uint64_t MaxQueueLatencyMicros = 0;
+	//The number of hand-overs that had to wait for room in the queue of the stage, and the total time they waited. This is the backpressure of the stage on the one before it.
+	uint64_t BlockedCount = 0;
+	uint64_t BlockedMicros = 0;
+	//The sum of the queue depths seen by each hand-over, and the largest depth, for the occupancy of the queue.
+	uint64_t TotalDepth = 0;
+	size_t MaxDepth = 0;
+	//The time since the pipeline started, for the share of it the stage was busy.
+	uint64_t ElapsedMicros = 0;
+
+	inline double GetAverageProcessMillis() const { return ProcessedCount > 0 ? TotalProcessMicros / 1000.0 / ProcessedCount : 0; }
+	inline double GetAverageQueueLatencyMillis() const { return ProcessedCount > 0 ? TotalQueueLatencyMicros / 1000.0 / ProcessedCount : 0; }
+	inline double GetAverageDepth() const { return ProcessedCount > 0 ? static_cast<double>(TotalDepth) / ProcessedCount : 0; }
+	inline double GetUtilization() const { return ElapsedMicros > 0 ? static_cast<double>(TotalProcessMicros) / ElapsedMicros : 0; }
+};
+
+/// <summary>
+/// A chain of stages that each process items on a thread of their own, with a bounded queue in front of every stage. An item passes through the stages in the order they were added, so a stage works on one frame while the stage before it works on the next.
+/// A stage that finds the queue of the next stage full waits for room, so a slow stage holds back the stages before it, and in the end the producer.
+/// If a stage fails, the pipeline stops processing, discards what is queued, and all further pushes fail.
+/// </summary>
+template <typename T>
+class FramePipeline
+{
+public:
+	//Processes an item on the thread of a stage. Returns false if processing failed.
+	typedef std::function<bool(T &item)> StageFunction;
+
+	/// <param name="depth">The maximum number of items queued in front of each stage, not counting the item being processed</param>
+	explicit FramePipeline(size_t depth) :
+		m_Depth((std::max)(depth, static_cast<size_t>(1))),
+		m_IsStarted(false),
+		m_IsClosed(false),
+		m_IsFailed(false)
+	{
+	}
+
+	~FramePipeline()
+	{
+		Close();
+	}
+
+	FramePipeline(const FramePipeline &) = delete;
+	FramePipeline &operator=(const FramePipeline &) = delete;
+
+	/// <summary>
+	/// Adds a stage after the stages added before. Stages must be added before the pipeline is started.
+	/// </summary>
+	void AddStage(const std::string &name, StageFunction process)
+	{
+		std::unique_ptr<STAGE> stage = std::make_unique<STAGE>();
+		stage->Process = process;
+		stage->Stats.Name = name;
+		m_Stages.push_back(std::move(stage));
+	}
+
+	/// <summary>
+	/// Starts the threads of the stages.
+	/// </summary>
+	void Start()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (m_IsStarted) {
+			return;
+		}
+		m_IsStarted = true;
+		m_StartTime = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < m_Stages.size(); i++) {
+			m_Stages[i]->Thread = std::thread(&FramePipeline::StageLoop, this, i);
+		}
+	}
+
+	/// <summary>
+	/// Hands an item to the first stage, waiting while its queue is full.
+	/// </summary>
+	/// <returns>false if a stage failed or the pipeline is closed, and the item was not queued</returns>
+	bool Push(T &&item)
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		if (m_IsFailed || m_IsClosed || m_Stages.empty()) {
+			return false;
+		}
+		return HandOver(lock, 0, std::move(item));
+	}
+
+	/// <summary>
+	/// Waits until every item pushed has passed through all stages.
+	/// </summary>
+	/// <returns>false if a stage failed</returns>
+	bool Drain()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		m_Idle.wait(lock, [this]() { return IsIdle() || m_IsFailed; });
+		return !m_IsFailed;
+	}
+
+	/// <summary>
+	/// Lets the stages process the items still queued, and stops their threads. Further pushes fail.
+	/// </summary>
+	/// <returns>false if a stage failed</returns>
+	bool Close()
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_IsClosed = true;
+			if (!m_Stages.empty()) {
+				m_Stages.front()->ItemAvailable.notify_all();
+			}
+		}
+		//Each stage stops when the stage before it has stopped and its queue is empty, so the threads end in order.
+		for (std::unique_ptr<STAGE> &stage : m_Stages) {
+			if (stage->Thread.joinable()) {
+				stage->Thread.join();
+			}
+		}
+		return !IsFailed();
+	}
+
+	bool IsFailed()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_IsFailed;
+	}
+
+	std::vector<FRAME_PIPELINE_STAGE_STATS> GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		uint64_t elapsed = m_IsStarted ? MicrosSince(m_StartTime) : 0;
+		std::vector<FRAME_PIPELINE_STAGE_STATS> stats;
+		for (std::unique_ptr<STAGE> &stage : m_Stages) {
+			stats.push_back(stage->Stats);
+			stats.back().ElapsedMicros = elapsed;
+		}
+		return stats;
+	}
+
+	inline size_t GetDepth() const { return m_Depth; }
+
+private:
+	struct QUEUED_ITEM
+	{
+		T Item;
+		std::chrono::steady_clock::time_point PushTime;
+	};
+	struct STAGE
+	{
+		StageFunction Process;
+		std::deque<QUEUED_ITEM> Queue;
+		std::condition_variable ItemAvailable;
+		std::condition_variable SpaceAvailable;
+		bool IsProcessing = false;
+		//Set when the thread of the stage has stopped, so the stage after it stops once its queue is empty.
+		bool IsFinished = false;
+		FRAME_PIPELINE_STAGE_STATS Stats;
+		std::thread Thread;
+	};
+
+	const size_t m_Depth;
+	std::mutex m_Mutex;
+	std::condition_variable m_Idle;
+	std::vector<std::unique_ptr<STAGE>> m_Stages;
+	bool m_IsStarted;
+	bool m_IsClosed;
+	bool m_IsFailed;
+	std::chrono::steady_clock::time_point m_StartTime;
+
+	static uint64_t MicrosSince(std::chrono::steady_clock::time_point start)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
+	}
+
+	bool IsIdle()
+	{
+		for (std::unique_ptr<STAGE> &stage : m_Stages) {
+			if (!stage->Queue.empty() || stage->IsProcessing) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//Queues an item in front of a stage, waiting for room. Must be called with the lock held.
+	bool HandOver(std::unique_lock<std::mutex> &lock, size_t index, T &&item)
+	{
+		STAGE &stage = *m_Stages[index];
+		if (stage.Queue.size() >= m_Depth) {
+			auto blockStart = std::chrono::steady_clock::now();
+			stage.SpaceAvailable.wait(lock, [this, &stage]() { return stage.Queue.size() < m_Depth || m_IsFailed; });
+			stage.Stats.BlockedCount++;
+			stage.Stats.BlockedMicros += MicrosSince(blockStart);
+			if (m_IsFailed) {
+				return false;
+			}
+		}
+		stage.Queue.push_back(QUEUED_ITEM{ std::move(item), std::chrono::steady_clock::now() });
+		stage.Stats.TotalDepth += stage.Queue.size();
+		stage.Stats.MaxDepth = (std::max)(stage.Stats.MaxDepth, stage.Queue.size());
+		stage.ItemAvailable.notify_one();
+		return true;
+	}
+
+	//Stops all stages after one failed, and wakes every thread that waits on them. Must be called with the lock held.
+	void Fail()
+	{
+		m_IsFailed = true;
+		for (std::unique_ptr<STAGE> &stage : m_Stages) {
+			stage->Queue.clear();
+			stage->ItemAvailable.notify_all();
+			stage->SpaceAvailable.notify_all();
+		}
+		m_Idle.notify_all();
+	}
+
+	void StageLoop(size_t index)
+	{
+		STAGE &stage = *m_Stages[index];
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		auto IsInputFinished = [this, index]() { return index == 0 ? m_IsClosed : m_Stages[index - 1]->IsFinished; };
+		while (true) {
+			stage.ItemAvailable.wait(lock, [&]() { return !stage.Queue.empty() || IsInputFinished() || m_IsFailed; });
+			if (m_IsFailed || stage.Queue.empty()) {
+				break;
+			}
+			QUEUED_ITEM queued = std::move(stage.Queue.front());
+			stage.Queue.pop_front();
+			stage.IsProcessing = true;
+			uint64_t queueLatency = MicrosSince(queued.PushTime);
+			stage.SpaceAvailable.notify_one();
+
+			//Processing runs unlocked, so the other stages keep going meanwhile.
+			lock.unlock();
+			auto processStart = std::chrono::steady_clock::now();
+			bool isProcessed = stage.Process(queued.Item);
+			uint64_t processTime = MicrosSince(processStart);
+			bool isLastStage = index + 1 >= m_Stages.size();
+			if (!isProcessed || isLastStage) {
+				//The item is released before the lock is taken again, so its resources are not held after the pipeline is drained.
+				queued = QUEUED_ITEM{};
+			}
+			lock.lock();
+
+			stage.Stats.TotalQueueLatencyMicros += queueLatency;
+			stage.Stats.MaxQueueLatencyMicros = (std::max)(stage.Stats.MaxQueueLatencyMicros, queueLatency);
+			if (!isProcessed) {
+				stage.IsProcessing = false;
+				Fail();
+				break;
+			}
+			stage.Stats.ProcessedCount++;
+			stage.Stats.TotalProcessMicros += processTime;
+			stage.Stats.MaxProcessMicros = (std::max)(stage.Stats.MaxProcessMicros, processTime);
+			bool isHandedOver = isLastStage || HandOver(lock, index + 1, std::move(queued.Item));
+			stage.IsProcessing = false;
+			if (!isHandedOver) {
+				break;
+			}
+			if (IsIdle()) {
+				m_Idle.notify_all();
+			}
+		}
+		stage.IsFinished = true;
+		if (index + 1 < m_Stages.size()) {
+			m_Stages[index + 1]->ItemAvailable.notify_all();
+		}
+		m_Idle.notify_all();
+	}
+};
@@ -0,0 +1,154 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+
+#define FRAME_SLOT_COUNT 3
+
+struct FRAME_SLOT_EXCHANGE_STATS
+{
+	//Number of slots the producer published, and number of slots the consumer took.
+	uint64_t PublishedCount = 0;
+	uint64_t ConsumedCount = 0;
+	//Number of published slots that were replaced by a newer slot before the consumer took them. High when the producer outpaces the consumer.
+	uint64_t OverwrittenCount = 0;
+	//Number of times the consumer looked for a slot and found nothing new. High when the consumer polls faster than the producer publishes.
+	uint64_t EmptyAcquireCount = 0;
+	//The time from a slot being published until the consumer took it.
+	uint64_t TotalLatencyMicros = 0;
+	uint64_t MaxLatencyMicros = 0;
+
+	inline double GetAverageLatencyMillis() const { return ConsumedCount > 0 ? TotalLatencyMicros / 1000.0 / ConsumedCount : 0; }
+	inline double GetOverwriteRate() const { return PublishedCount > 0 ? static_cast<double>(OverwrittenCount) / PublishedCount : 0; }
+};
+
+/// <summary>
+/// Hands frames from one producer thread to one consumer thread through three slots, e.g. textures, without either side waiting for the other.
+/// The producer owns a back slot it writes the next frame into, the consumer owns a front slot it reads from, and the third slot holds the latest published frame. Publishing and taking a frame swap a slot index with the one in the middle in a single atomic exchange, so the producer never writes a slot the consumer reads, and the consumer always gets the latest complete frame.
+/// A published frame that is replaced before the consumer takes it is overwritten, which is counted, but the consumer can not see a frame that is older than one it already took.
+/// </summary>
+class FrameSlotExchange
+{
+public:
+	FrameSlotExchange() :
+		m_Middle(1),
+		m_BackSlot(2),
+		m_PublishedSequence(0),
+		m_FrontSlot(0),
+		m_ConsumedSequence(0),
+		m_PublishedCount(0),
+		m_OverwrittenCount(0),
+		m_ConsumedCount(0),
+		m_EmptyAcquireCount(0),
+		m_TotalLatencyMicros(0),
+		m_MaxLatencyMicros(0),
+		m_Sequence{},
+		m_PublishTime{}
+	{
+	}
+
+	FrameSlotExchange(const FrameSlotExchange &) = delete;
+	FrameSlotExchange &operator=(const FrameSlotExchange &) = delete;
+
+	/// <summary>
+	/// The slot the producer writes the next frame into. Must only be called by the producer.
+	/// </summary>
+	inline uint32_t GetBackSlot() const { return m_BackSlot; }
+
+	/// <summary>
+	/// Publishes the back slot as the latest frame, and gives the producer a new back slot. Must only be called by the producer, after it finished writing the back slot.
+	/// </summary>
+	/// <returns>The new back slot</returns>
+	uint32_t Publish()
+	{
+		m_Sequence[m_BackSlot] = ++m_PublishedSequence;
+		m_PublishTime[m_BackSlot] = std::chrono::steady_clock::now();
+		//The release makes the slot and its sequence visible to the consumer, and the acquire makes the consumer's reads of the slot the producer gets back complete.
+		uint32_t previous = m_Middle.exchange(m_BackSlot | FRESH_FLAG, std::memory_order_acq_rel);
+		m_BackSlot = previous & SLOT_MASK;
+		m_PublishedCount.fetch_add(1, std::memory_order_relaxed);
+		if (previous & FRESH_FLAG) {
+			m_OverwrittenCount.fetch_add(1, std::memory_order_relaxed);
+		}
+		return m_BackSlot;
+	}
+
+	/// <summary>
+	/// Takes the latest published frame as the front slot, if one was published since the last call. Must only be called by the consumer.
+	/// </summary>
+	/// <param name="pSlot">Set to the front slot, which holds the latest frame. Unchanged if there is no new frame</param>
+	/// <param name="pPublishedCount">Set to the number of frames published since the last frame the consumer took, including the overwritten ones</param>
+	/// <returns>false if no frame was published since the last call</returns>
+	bool AcquireLatest(uint32_t *pSlot, uint64_t *pPublishedCount = nullptr)
+	{
+		if (!IsFramePublished()) {
+			m_EmptyAcquireCount.fetch_add(1, std::memory_order_relaxed);
+			return false;
+		}
+		//The producer only sets the fresh flag, so it is still set after the check, and the exchange is sure to take a new frame.
+		uint32_t previous = m_Middle.exchange(m_FrontSlot, std::memory_order_acq_rel);
+		m_FrontSlot = previous & SLOT_MASK;
+		uint64_t sequence = m_Sequence[m_FrontSlot];
+		uint64_t latency = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - m_PublishTime[m_FrontSlot]).count());
+		if (pPublishedCount) {
+			*pPublishedCount = sequence - m_ConsumedSequence;
+		}
+		m_ConsumedSequence = sequence;
+		m_ConsumedCount.fetch_add(1, std::memory_order_relaxed);
+		m_TotalLatencyMicros.fetch_add(latency, std::memory_order_relaxed);
+		if (latency > m_MaxLatencyMicros.load(std::memory_order_relaxed)) {
+			m_MaxLatencyMicros.store(latency, std::memory_order_relaxed);
+		}
+		*pSlot = m_FrontSlot;
+		return true;
+	}
+
+	/// <summary>
+	/// Whether a frame was published that the consumer has not taken yet. Can be called from any thread.
+	/// </summary>
+	inline bool IsFramePublished() const { return (m_Middle.load(std::memory_order_acquire) & FRESH_FLAG) != 0; }
+
+	/// <summary>
+	/// The slot the consumer reads the latest frame it took from. Must only be called by the consumer.
+	/// </summary>
+	inline uint32_t GetFrontSlot() const { return m_FrontSlot; }
+
+	/// <summary>
+	/// Can be called from any thread. The counters are read one by one, so they may be off by a frame while the slots are exchanged.
+	/// </summary>
+	FRAME_SLOT_EXCHANGE_STATS GetStats() const
+	{
+		FRAME_SLOT_EXCHANGE_STATS stats{};
+		stats.PublishedCount = m_PublishedCount.load(std::memory_order_relaxed);
+		stats.OverwrittenCount = m_OverwrittenCount.load(std::memory_order_relaxed);
+		stats.ConsumedCount = m_ConsumedCount.load(std::memory_order_relaxed);
+		stats.EmptyAcquireCount = m_EmptyAcquireCount.load(std::memory_order_relaxed);
+		stats.TotalLatencyMicros = m_TotalLatencyMicros.load(std::memory_order_relaxed);
+		stats.MaxLatencyMicros = m_MaxLatencyMicros.load(std::memory_order_relaxed);
+		return stats;
+	}
+
+private:
+	static constexpr uint32_t SLOT_MASK = 0x3;
+	//Set in the middle index when it holds a frame the consumer has not taken.
+	static constexpr uint32_t FRESH_FLAG = 0x4;
+
+	//The slot between producer and consumer, and whether it is fresh. The only state both sides change.
+	std::atomic<uint32_t> m_Middle;
+	//Owned by the producer.
+	uint32_t m_BackSlot;
+	uint64_t m_PublishedSequence;
+	//Owned by the consumer.
+	uint32_t m_FrontSlot;
+	uint64_t m_ConsumedSequence;
+	//Counters are only written by one side each, and are atomic so the stats can be read from any thread.
+	std::atomic<uint64_t> m_PublishedCount;
+	std::atomic<uint64_t> m_OverwrittenCount;
+	std::atomic<uint64_t> m_ConsumedCount;
+	std::atomic<uint64_t> m_EmptyAcquireCount;
+	std::atomic<uint64_t> m_TotalLatencyMicros;
+	std::atomic<uint64_t> m_MaxLatencyMicros;
+	//The publish sequence and time of the frame in each slot, written by the side that owns the slot.
+	uint64_t m_Sequence[FRAME_SLOT_COUNT];
+	std::chrono::steady_clock::time_point m_PublishTime[FRAME_SLOT_COUNT];
+};
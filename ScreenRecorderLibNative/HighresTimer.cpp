@@ -102,6 +102,14 @@ HRESULT HighresTimer::WaitForNextTick()
 
 HRESULT HighresTimer::WaitFor(INT64 interval100Nanos)
 {
+	return WaitFor(interval100Nanos, nullptr, nullptr);
+}
+
+HRESULT HighresTimer::WaitFor(INT64 interval100Nanos, _In_opt_ HANDLE hWakeEvent, _Out_opt_ bool *pIsWoken)
+{
+	if (pIsWoken) {
+		*pIsWoken = false;
+	}
 	LARGE_INTEGER liFirstFire;
 	liFirstFire.QuadPart = -interval100Nanos; // negative means relative time
 	BOOL bOK = SetWaitableTimer(
@@ -115,13 +123,27 @@ HRESULT HighresTimer::WaitFor(INT64 interval100Nanos)
 		return E_FAIL;
 	}
 	m_IsActive = true;
+	HANDLE eventArray[3]{ m_StopEvent, m_TickEvent, hWakeEvent };
+	DWORD waitResult = WaitForMultipleObjects(hWakeEvent ? 3 : 2, eventArray, FALSE, INFINITE);
+	m_IsActive = false;
 	//WAIT_OBJECT_0 means the first handle in the array, the stop event, signaled the stop, so exit.
-	if (WaitForMultipleObjects(ARRAYSIZE(m_EventArray), m_EventArray, FALSE, INFINITE) == WAIT_OBJECT_0) {
+	if (waitResult == WAIT_OBJECT_0) {
 		LOG_TRACE("HighresTimer was canceled");
-		m_IsActive = false;
 		return E_FAIL;
 	}
-	m_IsActive = false;
+	else if (waitResult == WAIT_OBJECT_0 + 2) {
+		//The timer is still pending, and would end the next wait early if it fired.
+		CancelWaitableTimer(m_TickEvent);
+		if (pIsWoken) {
+			*pIsWoken = true;
+		}
+		return S_OK;
+	}
+	else if (waitResult == WAIT_FAILED) {
+		DWORD dwErr = GetLastError();
+		LOG_ERROR(L"HighresTimer::WaitFor failed waiting: last error = %u", dwErr);
+		return HRESULT_FROM_WIN32(dwErr);
+	}
 	m_LastTick = std::chrono::steady_clock::now();
 	m_TickCount++;
 	return S_OK;
@@ -132,4 +154,25 @@ double HighresTimer::GetMillisUntilNextTick()
 	if (m_TickCount == 0)
 		return 0;
 	return max(0, (m_Interval - std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_LastTick).count()));
-}
\ No newline at end of file
+}
+
+int64_t HighresFrameWaiter::Now()
+{
+	return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count() / 100;
+}
+
+FrameWaitResult HighresFrameWaiter::WaitUntil(int64_t time100Nanos)
+{
+	INT64 interval100Nanos = time100Nanos - Now();
+	if (interval100Nanos <= 0) {
+		//Takes a frame event that is already set, so it does not end the next wait early.
+		return WaitForSingleObject(m_FrameEvent, 0) == WAIT_OBJECT_0 ? FrameWaitResult::Signaled : FrameWaitResult::Deadline;
+	}
+	bool isWoken = false;
+	if (FAILED(m_Timer.WaitFor(interval100Nanos, m_FrameEvent, &isWoken))) {
+		//Without the timer, the wait is rounded up to whole milliseconds.
+		DWORD waitMillis = static_cast<DWORD>((interval100Nanos + 9999) / 10000);
+		return WaitForSingleObject(m_FrameEvent, waitMillis) == WAIT_OBJECT_0 ? FrameWaitResult::Signaled : FrameWaitResult::Deadline;
+	}
+	return isWoken ? FrameWaitResult::Signaled : FrameWaitResult::Deadline;
+}
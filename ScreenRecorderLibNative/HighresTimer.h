@@ -1,6 +1,7 @@
 #pragma once
 #include "CommonTypes.h"
 #include "Util.h"
+#include "FramePacer.h"
 class HighresTimer
 {
 public:
@@ -11,6 +12,13 @@ public:
 	HRESULT StopTimer(bool waitForCompletion);
 	HRESULT WaitForNextTick();
 	HRESULT WaitFor(INT64 interval100Nanos);
+	/// <summary>
+	/// Waits for the interval to pass, or for an event to be set, whichever comes first.
+	/// </summary>
+	/// <param name="interval100Nanos">The most time to wait</param>
+	/// <param name="hWakeEvent">An event that ends the wait early, or nullptr</param>
+	/// <param name="pIsWoken">Receives true if the event ended the wait</param>
+	HRESULT WaitFor(INT64 interval100Nanos, _In_opt_ HANDLE hWakeEvent, _Out_opt_ bool *pIsWoken);
 	double GetMillisUntilNextTick();
 	inline INT64 GetTickCount() { return m_TickCount; }
 private:
@@ -22,4 +30,19 @@ private:
 	HANDLE m_TickEvent;
 	HANDLE m_StopEvent;
 	HANDLE m_EventArray[2];
-};
\ No newline at end of file
+};
+
+/// <summary>
+/// A FrameWaiter that sleeps on a HighresTimer, and wakes early when an event is set, e.g. by the capture threads when they have written a new frame.
+/// </summary>
+class HighresFrameWaiter : public FrameWaiter
+{
+public:
+	HighresFrameWaiter(_In_ HANDLE hFrameEvent) : m_FrameEvent(hFrameEvent) {}
+	int64_t Now() override;
+	FrameWaitResult WaitUntil(int64_t time100Nanos) override;
+	void Signal() override { SetEvent(m_FrameEvent); }
+private:
+	HighresTimer m_Timer;
+	HANDLE m_FrameEvent;
+};
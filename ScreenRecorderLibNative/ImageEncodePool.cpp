@@ -0,0 +1,146 @@
+#include "ImageEncodePool.h"
+#include <algorithm>
+
+namespace {
+	uint64_t ToMicros(std::chrono::steady_clock::duration duration)
+	{
+		return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(duration).count());
+	}
+}
+
+ImageEncodePool::ImageEncodePool(uint32_t threadCount, uint64_t maxInFlightBytes, ThreadFunction onThreadStarted, ThreadFunction onThreadStopped) :
+	m_MaxInFlightBytes(maxInFlightBytes),
+	m_OnThreadStarted(onThreadStarted),
+	m_OnThreadStopped(onThreadStopped),
+	m_NextSequence(0),
+	m_NextCompletion(0),
+	m_IsCompleting(false),
+	m_InFlightBytes(0),
+	m_IsStopping(false),
+	m_Stats{}
+{
+	uint32_t count = threadCount > 0 ? threadCount : GetAutomaticThreadCount();
+	for (uint32_t i = 0; i < count; i++) {
+		m_Threads.emplace_back(&ImageEncodePool::WorkerLoop, this);
+	}
+}
+
+ImageEncodePool::~ImageEncodePool()
+{
+	WaitForAll();
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsStopping = true;
+	}
+	m_JobQueued.notify_all();
+	for (std::thread &thread : m_Threads) {
+		thread.join();
+	}
+}
+
+uint32_t ImageEncodePool::GetAutomaticThreadCount()
+{
+	uint32_t processorCount = std::thread::hardware_concurrency();
+	return (std::min)((std::max)(processorCount / 2, 1u), MAX_AUTOMATIC_THREAD_COUNT);
+}
+
+uint64_t ImageEncodePool::Submit(size_t bytes, EncodeFunction encode, CompletionFunction onCompleted)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	auto hasRoom = [this, bytes] { return m_MaxInFlightBytes == 0 || m_InFlightBytes == 0 || m_InFlightBytes + bytes <= m_MaxInFlightBytes; };
+	if (!hasRoom()) {
+		m_Stats.StallCount++;
+		m_JobEncoded.wait(lock, hasRoom);
+	}
+	JOB job{};
+	job.Sequence = m_NextSequence++;
+	job.Bytes = bytes;
+	job.Encode = std::move(encode);
+	job.OnCompleted = std::move(onCompleted);
+	job.SubmitTime = Clock::now();
+	m_Queued.push_back(std::move(job));
+	m_InFlightBytes += bytes;
+	m_Stats.SubmittedCount++;
+	m_Stats.MaxInFlightBytes = (std::max)(m_Stats.MaxInFlightBytes, m_InFlightBytes);
+	m_JobQueued.notify_one();
+	return m_NextSequence - 1;
+}
+
+void ImageEncodePool::WaitForAll()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	m_JobCompleted.wait(lock, [this] { return m_NextCompletion == m_NextSequence && !m_IsCompleting; });
+}
+
+IMAGE_ENCODE_STATS ImageEncodePool::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+void ImageEncodePool::CompleteInOrder(std::unique_lock<std::mutex> &lock)
+{
+	if (m_IsCompleting) {
+		return;
+	}
+	m_IsCompleting = true;
+	auto next = m_Completed.find(m_NextCompletion);
+	while (next != m_Completed.end()) {
+		COMPLETED_JOB completed = std::move(next->second);
+		m_Completed.erase(next);
+		lock.unlock();
+		if (completed.OnCompleted) {
+			completed.OnCompleted(completed.Result);
+		}
+		lock.lock();
+		m_NextCompletion++;
+		next = m_Completed.find(m_NextCompletion);
+	}
+	m_IsCompleting = false;
+	m_JobCompleted.notify_all();
+}
+
+void ImageEncodePool::WorkerLoop()
+{
+	if (m_OnThreadStarted) {
+		m_OnThreadStarted();
+	}
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true) {
+		m_JobQueued.wait(lock, [this] { return m_IsStopping || !m_Queued.empty(); });
+		if (m_Queued.empty()) {
+			break;
+		}
+		JOB job = std::move(m_Queued.front());
+		m_Queued.pop_front();
+		lock.unlock();
+		Clock::time_point encodeStart = Clock::now();
+		int32_t status = job.Encode();
+		Clock::time_point encodeEnd = Clock::now();
+		//Frees the image before its memory is released for other submits.
+		job.Encode = nullptr;
+		lock.lock();
+
+		COMPLETED_JOB completed{};
+		completed.Result.Sequence = job.Sequence;
+		completed.Result.Status = status;
+		completed.Result.QueuedMicros = ToMicros(encodeStart - job.SubmitTime);
+		completed.Result.EncodeMicros = ToMicros(encodeEnd - encodeStart);
+		completed.OnCompleted = std::move(job.OnCompleted);
+		uint64_t latency = ToMicros(encodeEnd - job.SubmitTime);
+		m_Stats.CompletedCount++;
+		m_Stats.FailedCount += completed.Result.IsFailed() ? 1 : 0;
+		m_Stats.TotalEncodeMicros += completed.Result.EncodeMicros;
+		m_Stats.MaxEncodeMicros = (std::max)(m_Stats.MaxEncodeMicros, completed.Result.EncodeMicros);
+		m_Stats.TotalLatencyMicros += latency;
+		m_Stats.MaxLatencyMicros = (std::max)(m_Stats.MaxLatencyMicros, latency);
+		m_Completed.emplace(job.Sequence, std::move(completed));
+		m_InFlightBytes -= job.Bytes;
+		m_JobEncoded.notify_all();
+		CompleteInOrder(lock);
+	}
+	lock.unlock();
+	if (m_OnThreadStopped) {
+		m_OnThreadStopped();
+	}
+}
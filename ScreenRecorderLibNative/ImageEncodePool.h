@@ -0,0 +1,137 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct IMAGE_ENCODE_RESULT
+{
+	//The order the image was submitted in, starting at zero.
+	uint64_t Sequence = 0;
+	//The status returned by the encode function, e.g. an HRESULT. Negative values are failures.
+	int32_t Status = 0;
+	//The time the image waited for a worker, and the time it took to encode.
+	uint64_t QueuedMicros = 0;
+	uint64_t EncodeMicros = 0;
+
+	inline bool IsFailed() const { return Status < 0; }
+};
+
+struct IMAGE_ENCODE_STATS
+{
+	uint64_t SubmittedCount = 0;
+	uint64_t CompletedCount = 0;
+	uint64_t FailedCount = 0;
+	//The number of submits that waited for memory, because the images in flight were over the limit.
+	uint64_t StallCount = 0;
+	uint64_t TotalEncodeMicros = 0;
+	uint64_t MaxEncodeMicros = 0;
+	//The time from submit to encoded, including the wait for a worker.
+	uint64_t TotalLatencyMicros = 0;
+	uint64_t MaxLatencyMicros = 0;
+	//The most memory held by images waiting for or being encoded.
+	uint64_t MaxInFlightBytes = 0;
+
+	inline double GetAverageEncodeMillis() const { return CompletedCount > 0 ? TotalEncodeMicros / 1000.0 / CompletedCount : 0; }
+	inline double GetAverageLatencyMillis() const { return CompletedCount > 0 ? TotalLatencyMicros / 1000.0 / CompletedCount : 0; }
+};
+
+/// <summary>
+/// Encodes images on a fixed number of worker threads, so e.g. slideshow frames can be written faster than a single thread encodes them.
+/// Images are encoded in parallel, but their completion functions are called one at a time, in the order the images were submitted. Bookkeeping that depends on the frame order can be done there.
+/// The memory held by images waiting for or being encoded is capped. Submit waits for memory to free up when the cap would be exceeded, which slows the caller down to the speed of the workers.
+/// Submit and WaitForAll must be called from a single thread at a time.
+/// </summary>
+class ImageEncodePool
+{
+public:
+	//Encodes an image, and returns a status, e.g. an HRESULT. Negative values are failures. The image data should be owned by the function, so it is freed as soon as it has run.
+	typedef std::function<int32_t()> EncodeFunction;
+	//Called on a worker thread once an image and every image submitted before it are encoded.
+	typedef std::function<void(const IMAGE_ENCODE_RESULT &result)> CompletionFunction;
+	//Called on every worker thread when it starts and when it stops, e.g. to initialize COM.
+	typedef std::function<void()> ThreadFunction;
+
+	static constexpr uint32_t MAX_AUTOMATIC_THREAD_COUNT = 4;
+
+	/// <param name="threadCount">The number of worker threads. 0 uses half the processors, up to MAX_AUTOMATIC_THREAD_COUNT</param>
+	/// <param name="maxInFlightBytes">The most memory the images waiting for or being encoded can hold. 0 for no limit. A single image larger than the limit is still encoded, on its own</param>
+	/// <param name="onThreadStarted">Called on every worker thread before it encodes, or nullptr</param>
+	/// <param name="onThreadStopped">Called on every worker thread before it exits, or nullptr</param>
+	ImageEncodePool(uint32_t threadCount, uint64_t maxInFlightBytes, ThreadFunction onThreadStarted = nullptr, ThreadFunction onThreadStopped = nullptr);
+	/// <summary>
+	/// Encodes the images that are left, and stops the workers.
+	/// </summary>
+	~ImageEncodePool();
+
+	ImageEncodePool(const ImageEncodePool &) = delete;
+	ImageEncodePool &operator=(const ImageEncodePool &) = delete;
+
+	/// <summary>
+	/// Queues an image for encoding. Waits while the images in flight hold too much memory to add this one.
+	/// </summary>
+	/// <param name="bytes">The memory held by the image until it is encoded</param>
+	/// <param name="encode">Encodes the image</param>
+	/// <param name="onCompleted">Called in submission order after the image is encoded, or nullptr</param>
+	/// <returns>The sequence number of the image</returns>
+	uint64_t Submit(size_t bytes, EncodeFunction encode, CompletionFunction onCompleted);
+	/// <summary>
+	/// Waits until every submitted image is encoded and its completion function has returned.
+	/// </summary>
+	void WaitForAll();
+	uint32_t GetThreadCount() const { return static_cast<uint32_t>(m_Threads.size()); }
+	//Half the processors, up to MAX_AUTOMATIC_THREAD_COUNT. Used when no thread count is given.
+	static uint32_t GetAutomaticThreadCount();
+	IMAGE_ENCODE_STATS GetStats();
+
+private:
+	typedef std::chrono::steady_clock Clock;
+
+	struct JOB
+	{
+		uint64_t Sequence = 0;
+		size_t Bytes = 0;
+		EncodeFunction Encode;
+		CompletionFunction OnCompleted;
+		Clock::time_point SubmitTime;
+	};
+	struct COMPLETED_JOB
+	{
+		IMAGE_ENCODE_RESULT Result;
+		CompletionFunction OnCompleted;
+	};
+
+	const uint64_t m_MaxInFlightBytes;
+	ThreadFunction m_OnThreadStarted;
+	ThreadFunction m_OnThreadStopped;
+	//Jobs waiting for a worker, oldest first.
+	std::deque<JOB> m_Queued;
+	//Encoded jobs waiting for the jobs before them, by sequence number.
+	std::map<uint64_t, COMPLETED_JOB> m_Completed;
+	uint64_t m_NextSequence;
+	//The sequence number of the next job to call the completion function of.
+	uint64_t m_NextCompletion;
+	//Set while a worker is calling completion functions. Other workers leave theirs to it, which keeps the calls in order and one at a time.
+	bool m_IsCompleting;
+	uint64_t m_InFlightBytes;
+	bool m_IsStopping;
+	IMAGE_ENCODE_STATS m_Stats;
+	std::mutex m_Mutex;
+	//Signaled when a job is queued or the pool stops.
+	std::condition_variable m_JobQueued;
+	//Signaled when a job is encoded and its memory is freed.
+	std::condition_variable m_JobEncoded;
+	//Signaled when completion functions have been called.
+	std::condition_variable m_JobCompleted;
+	std::vector<std::thread> m_Threads;
+
+	//Calls the completion functions of the jobs that are next in order. Must be called with m_Mutex locked.
+	void CompleteInOrder(std::unique_lock<std::mutex> &lock);
+	void WorkerLoop();
+};
@@ -0,0 +1,260 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct LEASE_POOL_STATS
+{
+	//Number of leases that had to create a new object, and number of leases served by a free object.
+	uint64_t AllocationCount = 0;
+	uint64_t ReuseCount = 0;
+	//Number of objects that failed to be created.
+	uint64_t AllocationFailedCount = 0;
+	//Number of free objects destroyed, because they were the least recently used when there were too many, or were not leased for too many frames.
+	uint64_t TrimmedCount = 0;
+	//Number of leases that were still held after the leak age, or when leaks were reported. Each lease is counted once.
+	uint64_t LeakCount = 0;
+	//Number of frames the pool was told about.
+	uint64_t FrameCount = 0;
+	//Number of objects leased and free right now, and the most that were leased at once.
+	uint64_t LeasedCount = 0;
+	uint64_t IdleCount = 0;
+	uint64_t MaxLeasedCount = 0;
+
+	inline double GetReuseRate() const { return AllocationCount + ReuseCount > 0 ? static_cast<double>(ReuseCount) / (AllocationCount + ReuseCount) : 0; }
+	inline double GetAllocationsPerFrame() const { return FrameCount > 0 ? static_cast<double>(AllocationCount) / FrameCount : 0; }
+};
+
+/// <summary>
+/// Thread safe pool of objects by key, e.g. textures by size and format, that are leased out instead of created for every frame.
+/// The pool keeps a reference to every object it created. A lease ends when everyone else has released the object, which the pool checks when it is asked for an object and on every frame, so a lease lives for as long as the frame that uses it. Free objects are then reused by leases of the same key, most recently used first.
+/// Free objects are trimmed least recently used first, when there are more than the pool keeps, or when they were not leased for too many frames. Leases held for longer than the leak age are reported as leaks.
+/// </summary>
+template <typename TKey, typename T>
+class LeasePool
+{
+public:
+	//Creates a new object for a key. Returns false if creating it failed.
+	typedef std::function<bool(const TKey &key, T *pObject)> CreateFunction;
+	//Returns whether anyone but the pool holds the object.
+	typedef std::function<bool(const T &object)> IsLeasedFunction;
+
+	/// <param name="create">Creates objects when there is no free object for a key</param>
+	/// <param name="isLeased">Checks if a lease has ended</param>
+	/// <param name="maxIdleCount">The number of free objects kept over all keys</param>
+	/// <param name="maxIdleFrames">The number of frames a free object is kept without being leased. 0 to keep free objects until there are too many</param>
+	/// <param name="leakFrames">The number of frames after which a lease is reported as a leak. 0 to not report leaks</param>
+	LeasePool(CreateFunction create, IsLeasedFunction isLeased, size_t maxIdleCount = DEFAULT_MAX_IDLE_COUNT, uint64_t maxIdleFrames = DEFAULT_MAX_IDLE_FRAMES, uint64_t leakFrames = DEFAULT_LEAK_FRAMES) :
+		m_Create(create),
+		m_IsLeased(isLeased),
+		m_MaxIdleCount(maxIdleCount),
+		m_MaxIdleFrames(maxIdleFrames),
+		m_LeakFrames(leakFrames),
+		m_Frame(0),
+		m_ReleaseSequence(0),
+		m_Stats{}
+	{
+	}
+
+	LeasePool(const LeasePool &) = delete;
+	LeasePool &operator=(const LeasePool &) = delete;
+
+	/// <summary>
+	/// Leases an object for the key, reusing a free object if there is one, and otherwise creating a new one. The lease ends when the caller and everyone it handed the object to have released it.
+	/// A reused object is as the previous lease left it.
+	/// </summary>
+	/// <param name="pIsReused">Set to whether the object was reused</param>
+	/// <param name="create">Creates the object instead of the create function of the pool, e.g. to get the error of a failed create back to the caller. Called under the lock of the pool</param>
+	/// <returns>false if there was no free object and creating one failed, in which case object is unchanged</returns>
+	bool Acquire(const TKey &key, T *pObject, bool *pIsReused = nullptr, const CreateFunction &create = nullptr)
+	{
+		std::vector<T> trimmed;
+		std::scoped_lock lock(m_Mutex);
+		ReclaimLeases(&trimmed);
+		T object{};
+		bool isReused = false;
+		auto idle = m_Idle.find(key);
+		if (idle != m_Idle.end() && !idle->second.empty()) {
+			object = std::move(idle->second.back().Object);
+			idle->second.pop_back();
+			if (idle->second.empty()) {
+				m_Idle.erase(idle);
+			}
+			m_Stats.IdleCount--;
+			m_Stats.ReuseCount++;
+			isReused = true;
+		}
+		else if (create ? create(key, &object) : m_Create(key, &object)) {
+			m_Stats.AllocationCount++;
+		}
+		else {
+			m_Stats.AllocationFailedCount++;
+			return false;
+		}
+		m_Leases.push_back(LEASE{ key, object, m_Frame, false });
+		m_Stats.LeasedCount++;
+		m_Stats.MaxLeasedCount = (std::max)(m_Stats.MaxLeasedCount, m_Stats.LeasedCount);
+		*pObject = std::move(object);
+		if (pIsReused) {
+			*pIsReused = isReused;
+		}
+		return true;
+	}
+
+	/// <summary>
+	/// Starts the next frame. Ended leases are taken back, free objects that were not leased for too many frames are trimmed, and leases that reached the leak age are counted.
+	/// </summary>
+	/// <returns>The number of leases that reached the leak age in this frame</returns>
+	uint64_t NextFrame()
+	{
+		std::vector<T> trimmed;
+		std::scoped_lock lock(m_Mutex);
+		m_Frame++;
+		m_Stats.FrameCount++;
+		ReclaimLeases(&trimmed);
+		if (m_MaxIdleFrames > 0) {
+			for (auto idle = m_Idle.begin(); idle != m_Idle.end();) {
+				std::vector<IDLE_OBJECT> &objects = idle->second;
+				//The objects of a key are in the order they were freed, so the expired ones are at the front.
+				size_t expiredCount = 0;
+				while (expiredCount < objects.size() && m_Frame - objects[expiredCount].ReleasedFrame > m_MaxIdleFrames) {
+					trimmed.push_back(std::move(objects[expiredCount].Object));
+					expiredCount++;
+				}
+				objects.erase(objects.begin(), objects.begin() + expiredCount);
+				m_Stats.IdleCount -= expiredCount;
+				m_Stats.TrimmedCount += expiredCount;
+				idle = objects.empty() ? m_Idle.erase(idle) : std::next(idle);
+			}
+		}
+		uint64_t leakCount = 0;
+		if (m_LeakFrames > 0) {
+			for (LEASE &lease : m_Leases) {
+				if (!lease.IsLeakReported && m_Frame - lease.AcquiredFrame >= m_LeakFrames) {
+					lease.IsLeakReported = true;
+					leakCount++;
+				}
+			}
+		}
+		m_Stats.LeakCount += leakCount;
+		return leakCount;
+	}
+
+	/// <summary>
+	/// Takes back ended leases, and counts the leases that are still held as leaks. Used when every holder should have released its objects, e.g. at the end of a recording, where objects may otherwise be held for long on purpose.
+	/// </summary>
+	/// <returns>The number of leases still held that were not counted as leaks before</returns>
+	uint64_t ReportLeaks()
+	{
+		std::vector<T> trimmed;
+		std::scoped_lock lock(m_Mutex);
+		ReclaimLeases(&trimmed);
+		uint64_t leakCount = 0;
+		for (LEASE &lease : m_Leases) {
+			if (!lease.IsLeakReported) {
+				lease.IsLeakReported = true;
+				leakCount++;
+			}
+		}
+		m_Stats.LeakCount += leakCount;
+		return leakCount;
+	}
+
+	/// <summary>
+	/// Destroys the free objects, and forgets the leased objects, which are destroyed when their holders release them. Used when the objects can no longer be used, e.g. when the device that created them is lost.
+	/// </summary>
+	void Clear()
+	{
+		//The objects are destroyed outside the lock, in case destroying one leases another.
+		std::map<TKey, std::vector<IDLE_OBJECT>> idle;
+		std::vector<LEASE> leases;
+		{
+			std::scoped_lock lock(m_Mutex);
+			idle.swap(m_Idle);
+			leases.swap(m_Leases);
+			m_Stats.IdleCount = 0;
+			m_Stats.LeasedCount = 0;
+		}
+	}
+
+	LEASE_POOL_STATS GetStats()
+	{
+		std::scoped_lock lock(m_Mutex);
+		return m_Stats;
+	}
+
+	static constexpr size_t DEFAULT_MAX_IDLE_COUNT = 8;
+	static constexpr uint64_t DEFAULT_MAX_IDLE_FRAMES = 120;
+	static constexpr uint64_t DEFAULT_LEAK_FRAMES = 600;
+
+private:
+	struct LEASE
+	{
+		TKey Key;
+		T Object;
+		uint64_t AcquiredFrame;
+		bool IsLeakReported;
+	};
+	struct IDLE_OBJECT
+	{
+		T Object;
+		uint64_t ReleasedFrame;
+		//Orders the free objects of all keys by when they were freed, for trimming the least recently used.
+		uint64_t ReleaseSequence;
+	};
+
+	std::mutex m_Mutex;
+	CreateFunction m_Create;
+	IsLeasedFunction m_IsLeased;
+	const size_t m_MaxIdleCount;
+	const uint64_t m_MaxIdleFrames;
+	const uint64_t m_LeakFrames;
+	uint64_t m_Frame;
+	uint64_t m_ReleaseSequence;
+	std::vector<LEASE> m_Leases;
+	//The free objects of each key, in the order they were freed.
+	std::map<TKey, std::vector<IDLE_OBJECT>> m_Idle;
+	LEASE_POOL_STATS m_Stats;
+
+	//Moves the objects of ended leases to the free objects, and trims the least recently used free objects beyond the maximum into trimmed, to be destroyed outside the lock.
+	void ReclaimLeases(std::vector<T> *pTrimmed)
+	{
+		//The leases are kept in the order they were acquired, so objects freed at the same time are trimmed in that order.
+		size_t leasedCount = 0;
+		for (size_t i = 0; i < m_Leases.size(); i++) {
+			LEASE &lease = m_Leases[i];
+			if (m_IsLeased(lease.Object)) {
+				if (i != leasedCount) {
+					m_Leases[leasedCount] = std::move(lease);
+				}
+				leasedCount++;
+				continue;
+			}
+			m_Idle[lease.Key].push_back(IDLE_OBJECT{ std::move(lease.Object), m_Frame, m_ReleaseSequence++ });
+			m_Stats.IdleCount++;
+			m_Stats.LeasedCount--;
+		}
+		m_Leases.erase(m_Leases.begin() + leasedCount, m_Leases.end());
+		while (m_Stats.IdleCount > m_MaxIdleCount) {
+			auto leastRecentlyUsed = m_Idle.begin();
+			for (auto idle = m_Idle.begin(); idle != m_Idle.end(); idle++) {
+				if (idle->second.front().ReleaseSequence < leastRecentlyUsed->second.front().ReleaseSequence) {
+					leastRecentlyUsed = idle;
+				}
+			}
+			std::vector<IDLE_OBJECT> &objects = leastRecentlyUsed->second;
+			pTrimmed->push_back(std::move(objects.front().Object));
+			objects.erase(objects.begin());
+			if (objects.empty()) {
+				m_Idle.erase(leastRecentlyUsed);
+			}
+			m_Stats.IdleCount--;
+			m_Stats.TrimmedCount++;
+		}
+	}
+};
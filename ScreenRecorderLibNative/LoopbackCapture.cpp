@@ -1,7 +1,6 @@
 //https://github.com/mvaneerde/blog/tree/master/loopback-capture
 #include "Cleanup.h"
 #include "LoopbackCapture.h"
-#include <mutex>
 #include <ppltasks.h> 
 using namespace std;
 LoopbackCapture::LoopbackCapture(_In_opt_ std::wstring tag) :
@@ -15,14 +14,152 @@ LoopbackCapture::~LoopbackCapture()
 	StopCapture();
 	CloseHandle(m_CaptureStopEvent);
 	CloseHandle(m_CaptureStartedEvent);
-	m_Resampler.Finalize();
 }
 
 struct LoopbackCapture::TaskWrapper {
-	std::mutex m_Mutex;
 	Concurrency::task<void> m_CaptureTask = concurrency::task_from_result();
 };
 
+/// <summary>
+/// Returns the sample format of a wave format, or false if the format is not one the capture can convert.
+/// </summary>
+static bool GetCaptureSampleFormat(_In_ const WAVEFORMATEX *pwfx, _Out_ AudioSampleFormat *pFormat)
+{
+	bool isFloat = pwfx->wFormatTag == WAVE_FORMAT_IEEE_FLOAT;
+	bool isPcm = pwfx->wFormatTag == WAVE_FORMAT_PCM;
+	if (pwfx->wFormatTag == WAVE_FORMAT_EXTENSIBLE) {
+		const WAVEFORMATEXTENSIBLE *pEx = reinterpret_cast<const WAVEFORMATEXTENSIBLE *>(pwfx);
+		isFloat = IsEqualGUID(KSDATAFORMAT_SUBTYPE_IEEE_FLOAT, pEx->SubFormat);
+		isPcm = IsEqualGUID(KSDATAFORMAT_SUBTYPE_PCM, pEx->SubFormat);
+	}
+	if (isFloat && pwfx->wBitsPerSample == 32) {
+		*pFormat = AudioSampleFormat::Float32;
+		return true;
+	}
+	if (isPcm) {
+		switch (pwfx->wBitsPerSample)
+		{
+		case 16:
+			*pFormat = AudioSampleFormat::Int16;
+			return true;
+		case 24:
+			*pFormat = AudioSampleFormat::Int24;
+			return true;
+		case 32:
+			*pFormat = AudioSampleFormat::Int32;
+			return true;
+		default:
+			break;
+		}
+	}
+	return false;
+}
+
+/// <summary>
+/// Drives an AudioCaptureLoop from a WASAPI capture client.
+/// The wake up handle is the event set by the audio engine for event driven capture, or a waitable timer for polled capture.
+/// </summary>
+class WasapiCaptureDevice : public IAudioCaptureDevice
+{
+public:
+	WasapiCaptureDevice(_In_ IAudioCaptureClient *pCaptureClient, _In_ HANDLE hStopEvent, _In_ HANDLE hWakeUp, _In_ bool isEventDriven, _In_ std::wstring tag) :
+		m_CaptureClient(pCaptureClient),
+		m_WaitArray{ hStopEvent, hWakeUp },
+		m_IsEventDriven(isEventDriven),
+		m_Tag(tag),
+		m_LastResult(S_OK)
+	{
+	}
+	bool IsEventDriven() const override { return m_IsEventDriven; }
+	inline HRESULT GetLastResult() { return m_LastResult; }
+
+	bool GetNextPacket(AUDIO_CAPTURE_PACKET *pPacket) override
+	{
+		*pPacket = AUDIO_CAPTURE_PACKET();
+		UINT32 nNextPacketSize;
+		m_LastResult = m_CaptureClient->GetNextPacketSize(&nNextPacketSize);
+		if (FAILED(m_LastResult)) {
+			LOG_ERROR(L"IAudioCaptureClient::GetNextPacketSize failed on %ls: hr = 0x%08x", m_Tag.c_str(), m_LastResult);
+			return false;
+		}
+		if (nNextPacketSize == 0) {
+			return true;
+		}
+		BYTE *pData;
+		UINT32 nNumFramesToRead;
+		DWORD dwFlags;
+		UINT64 nDevicePosition;
+		m_LastResult = m_CaptureClient->GetBuffer(&pData, &nNumFramesToRead, &dwFlags, &nDevicePosition, NULL);
+		if (FAILED(m_LastResult)) {
+			LOG_ERROR(L"IAudioCaptureClient::GetBuffer failed on %ls: hr = 0x%08x", m_Tag.c_str(), m_LastResult);
+			return false;
+		}
+		if (0 == nNumFramesToRead) {
+			LOG_ERROR(L"IAudioCaptureClient::GetBuffer said to read 0 frames on %ls", m_Tag.c_str());
+			m_LastResult = E_UNEXPECTED;
+			return false;
+		}
+		if (0 != dwFlags) {
+			LOG_DEBUG(L"IAudioCaptureClient::GetBuffer set flags to 0x%08x on %ls", dwFlags, m_Tag.c_str());
+		}
+		pPacket->Data = pData;
+		pPacket->FrameCount = nNumFramesToRead;
+		pPacket->DevicePosition = nDevicePosition;
+		//Captured data should be replaced with silence as according to https://docs.microsoft.com/en-us/windows/win32/coreaudio/capturing-a-stream
+		pPacket->IsSilent = (dwFlags & AUDCLNT_BUFFERFLAGS_SILENT) != 0;
+		pPacket->IsDiscontinuity = (dwFlags & AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY) != 0;
+		return true;
+	}
+
+	bool ReleasePacket(uint32_t frameCount) override
+	{
+		m_LastResult = m_CaptureClient->ReleaseBuffer(frameCount);
+		if (FAILED(m_LastResult)) {
+			LOG_ERROR(L"IAudioCaptureClient::ReleaseBuffer failed on %ls: hr = 0x%08x", m_Tag.c_str(), m_LastResult);
+			return false;
+		}
+		return true;
+	}
+
+	AudioCaptureWaitResult Wait(uint32_t timeoutMicros) override
+	{
+		DWORD timeoutMillis = INFINITE;
+		if (m_IsEventDriven) {
+			//The timeout only guards against a device that stops signaling, e.g. when it is removed.
+			timeoutMillis = (timeoutMicros + 999) / 1000;
+		}
+		else {
+			LARGE_INTEGER liDueTime;
+			liDueTime.QuadPart = -(LONGLONG)timeoutMicros * 10; // negative means relative time
+			if (!SetWaitableTimer(m_WaitArray[1], &liDueTime, 0, NULL, NULL, FALSE)) {
+				DWORD dwErr = GetLastError();
+				LOG_ERROR(L"SetWaitableTimer failed on %ls: last error = %u", m_Tag.c_str(), dwErr);
+				m_LastResult = HRESULT_FROM_WIN32(dwErr);
+				return AudioCaptureWaitResult::Failed;
+			}
+		}
+		DWORD dwWaitResult = WaitForMultipleObjects(ARRAYSIZE(m_WaitArray), m_WaitArray, FALSE, timeoutMillis);
+		switch (dwWaitResult) {
+		case WAIT_OBJECT_0:
+			return AudioCaptureWaitResult::Stop;
+		case WAIT_OBJECT_0 + 1:
+			return m_IsEventDriven ? AudioCaptureWaitResult::DataReady : AudioCaptureWaitResult::Timeout;
+		case WAIT_TIMEOUT:
+			return AudioCaptureWaitResult::Timeout;
+		default:
+			LOG_ERROR(L"Unexpected WaitForMultipleObjects return value %u on %ls", dwWaitResult, m_Tag.c_str());
+			m_LastResult = E_UNEXPECTED;
+			return AudioCaptureWaitResult::Failed;
+		}
+	}
+private:
+	IAudioCaptureClient *m_CaptureClient;
+	HANDLE m_WaitArray[2];
+	bool m_IsEventDriven;
+	std::wstring m_Tag;
+	HRESULT m_LastResult;
+};
+
 HRESULT LoopbackCapture::StartLoopbackCapture(
 	IMMDevice *pMMDevice,
 	HMMIO hFile,
@@ -103,6 +240,11 @@ HRESULT LoopbackCapture::StartLoopbackCapture(
 			return E_UNEXPECTED;
 		}
 	}
+	if (!GetCaptureSampleFormat(pwfx, &m_CaptureSampleFormat)) {
+		LOG_ERROR(L"Unsupported mix format on %ls: wFormatTag = 0x%08x, %u bits per sample", m_Tag.c_str(), pwfx->wFormatTag, pwfx->wBitsPerSample);
+		return E_UNEXPECTED;
+	}
+	m_CaptureFrameBytes = pwfx->nBlockAlign;
 	UINT32 outputSampleRate;
 	// set resampler options
 	if (samplerate != 0)
@@ -126,51 +268,63 @@ HRESULT LoopbackCapture::StartLoopbackCapture(
 	m_InputFormat.sampleRate = pwfx->nSamplesPerSec;
 	m_InputFormat.dwChannelMask = 0;
 	m_InputFormat.validBitsPerSample = pwfx->wBitsPerSample;
-	m_InputFormat.sampleFormat = WWMFBitFormatType::WWMFBitFormatInt;
+	m_InputFormat.sampleFormat = m_CaptureSampleFormat == AudioSampleFormat::Float32 ? WWMFBitFormatType::WWMFBitFormatFloat : WWMFBitFormatType::WWMFBitFormatInt;
 
 	m_OutputFormat = m_InputFormat;
 	m_OutputFormat.sampleRate = outputSampleRate;
 	m_OutputFormat.nChannels = channels;
+	m_OutputFormat.bits = 32;
+	m_OutputFormat.validBitsPerSample = 32;
+	m_OutputFormat.sampleFormat = WWMFBitFormatType::WWMFBitFormatFloat;
+
+	// The resampler is used even if the formats match, since it also corrects the drift between the device clock and the video timeline.
+	LOG_DEBUG("Resampler created for %ls", m_Tag.c_str());
+	LOG_DEBUG("Resampler (bits): %u -> %u", m_InputFormat.bits, m_OutputFormat.bits);
+	LOG_DEBUG("Resampler (channels): %u -> %u", m_InputFormat.nChannels, m_OutputFormat.nChannels);
+	LOG_DEBUG("Resampler (sampleFormat): %i -> %i", m_InputFormat.sampleFormat, m_OutputFormat.sampleFormat);
+	LOG_DEBUG("Resampler (sampleRate): %lu -> %lu", m_InputFormat.sampleRate, m_OutputFormat.sampleRate);
+	LOG_DEBUG("Resampler (validBitsPerSample): %u -> %u", m_InputFormat.validBitsPerSample, m_OutputFormat.validBitsPerSample);
+	if (!m_Resampler.Initialize(m_InputFormat.sampleRate, m_InputFormat.nChannels, m_OutputFormat.sampleRate, m_OutputFormat.nChannels, RESAMPLER_QUALITY, true)) {
+		LOG_ERROR(L"Failed to initialize resampler for %ls", m_Tag.c_str());
+		return E_INVALIDARG;
+	}
 
-	// initialize resampler if input sample rate or channels are different from output.
-	if (requiresResampling()) {
-		LOG_DEBUG("Resampler created for %ls", m_Tag.c_str());
-		LOG_DEBUG("Resampler (bits): %u -> %u", m_InputFormat.bits, m_OutputFormat.bits);
-		LOG_DEBUG("Resampler (channels): %u -> %u", m_InputFormat.nChannels, m_OutputFormat.nChannels);
-		LOG_DEBUG("Resampler (sampleFormat): %i -> %i", m_InputFormat.sampleFormat, m_OutputFormat.sampleFormat);
-		LOG_DEBUG("Resampler (sampleRate): %lu -> %lu", m_InputFormat.sampleRate, m_OutputFormat.sampleRate);
-		LOG_DEBUG("Resampler (validBitsPerSample): %u -> %u", m_InputFormat.validBitsPerSample, m_OutputFormat.validBitsPerSample);
-		m_Resampler.Initialize(m_InputFormat, m_OutputFormat, 60);
+	// The capture thread is the only producer and GetRecordedSamples the only consumer, so the buffer can be lock free.
+	// StartCapture blocks until hStartedEvent is set, so the consumer is not active while the buffer is initialized.
+	m_RecordedBytes.Initialize(pwfx->nAvgBytesPerSec * RECORDED_BYTES_BUFFER_SECONDS, pwfx->nBlockAlign);
+
+	// the microphone path is event driven, so the capture thread only wakes when the device has a packet.
+	// AUDCLNT_STREAMFLAGS_LOOPBACK and AUDCLNT_STREAMFLAGS_EVENTCALLBACK do not work together,
+	// the "data ready" event never gets set, so loopback capture polls on a waitable timer instead.
+	bool isEventDriven = flow == eCapture;
+	HANDLE hWakeUp = nullptr;
+	if (isEventDriven) {
+		hWakeUp = CreateEvent(nullptr, FALSE, FALSE, nullptr);
 	}
-	else
-	{
-		LOG_DEBUG("No resampling nescessary");
+	else {
+		//CREATE_WAITABLE_TIMER_HIGH_RESOLUTION is an undocumented flag introduced in Windows 10 1803.
+		//CreateWaitableTimerEx returns NULL if not available.
+		hWakeUp = CreateWaitableTimerEx(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+		if (NULL == hWakeUp) {
+			hWakeUp = CreateWaitableTimer(NULL, FALSE, NULL);
+		}
 	}
-
-	// create a periodic waitable timer
-	HANDLE hWakeUp = CreateWaitableTimer(NULL, FALSE, NULL);
 	if (NULL == hWakeUp) {
 		DWORD dwErr = GetLastError();
-		LOG_ERROR(L"CreateWaitableTimer failed: last error = %u", dwErr);
+		LOG_ERROR(L"Failed to create wake up event for %ls: last error = %u", m_Tag.c_str(), dwErr);
 		return HRESULT_FROM_WIN32(dwErr);
 	}
 	CloseHandleOnExit closeWakeUp(hWakeUp);
 
-	UINT32 nBlockAlign = pwfx->nBlockAlign;
-	UINT32 nFrames = 0;
 	long audioClientBuffer = 200 * 10000; //200ms in 100-nanosecond units.
 	// call IAudioClient::Initialize
-	// note that AUDCLNT_STREAMFLAGS_LOOPBACK and AUDCLNT_STREAMFLAGS_EVENTCALLBACK
-	// do not work together...
-	// the "data ready" event never gets set
-	// so we're going to do a timer-driven loop
 	switch (flow)
 	{
 	case eRender:
 		hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK, audioClientBuffer, 0, pwfx, 0);
 		break;
 	case eCapture:
-		hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, 0, audioClientBuffer, 0, pwfx, 0);
+		hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_EVENTCALLBACK, audioClientBuffer, 0, pwfx, 0);
 		break;
 	default:
 		hr = pAudioClient->Initialize(AUDCLNT_SHAREMODE_SHARED, AUDCLNT_STREAMFLAGS_LOOPBACK, audioClientBuffer, 0, pwfx, 0);
@@ -180,6 +334,13 @@ HRESULT LoopbackCapture::StartLoopbackCapture(
 		LOG_ERROR(L"IAudioClient::Initialize failed on %ls: hr = 0x%08x", m_Tag.c_str(), hr);
 		return hr;
 	}
+	if (isEventDriven) {
+		hr = pAudioClient->SetEventHandle(hWakeUp);
+		if (FAILED(hr)) {
+			LOG_ERROR(L"IAudioClient::SetEventHandle failed on %ls: hr = 0x%08x", m_Tag.c_str(), hr);
+			return hr;
+		}
+	}
 
 	// activate an IAudioCaptureClient
 	IAudioCaptureClient *pAudioCaptureClient;
@@ -203,23 +364,6 @@ HRESULT LoopbackCapture::StartLoopbackCapture(
 	}
 	AvRevertMmThreadCharacteristicsOnExit unregisterMmcss(hTask);
 
-	// set the waitable timer
-	LARGE_INTEGER liFirstFire;
-	liFirstFire.QuadPart = -hnsDefaultDevicePeriod / 2; // negative means relative time
-	LONG lTimeBetweenFires = (LONG)hnsDefaultDevicePeriod / 2 / (10 * 1000); // convert to milliseconds
-	BOOL bOK = SetWaitableTimer(
-		hWakeUp,
-		&liFirstFire,
-		lTimeBetweenFires,
-		NULL, NULL, FALSE
-	);
-	if (!bOK) {
-		DWORD dwErr = GetLastError();
-		LOG_ERROR(L"SetWaitableTimer failed on %ls: last error = %u", m_Tag.c_str(), dwErr);
-		return HRESULT_FROM_WIN32(dwErr);
-	}
-	CancelWaitableTimerOnExit cancelWakeUp(hWakeUp);
-
 	// call IAudioClient::Start
 	hr = pAudioClient->Start();
 	if (FAILED(hr)) {
@@ -228,157 +372,92 @@ HRESULT LoopbackCapture::StartLoopbackCapture(
 	}
 	AudioClientStopOnExit stopAudioClient(pAudioClient);
 
+	//Polls never wait longer than a quarter of the device buffer, so audio that starts while the device is idle cannot overflow it.
+	AudioCaptureLoop captureLoop;
+	captureLoop.Initialize(pwfx->nSamplesPerSec, pwfx->nBlockAlign, (UINT32)(hnsDefaultDevicePeriod / 10), (UINT32)(audioClientBuffer / 10 / 4));
+	WasapiCaptureDevice captureDevice(pAudioCaptureClient, hStopEvent, hWakeUp, isEventDriven, m_Tag);
+
 	SetEvent(hStartedEvent);
 	m_IsCapturing = true;
-	// loopback capture loop
-	HANDLE waitArray[2] = { hStopEvent, hWakeUp };
-	DWORD dwWaitResult;
-
-	bool bDone = false;
-	bool bFirstPacket = true;
-	UINT64 nLastDevicePosition = 0;
-	for (UINT32 nPasses = 0; !bDone; nPasses++) {
-		// drain data while it is available
-		UINT32 nNextPacketSize;
-		for (
-			hr = pAudioCaptureClient->GetNextPacketSize(&nNextPacketSize);
-			SUCCEEDED(hr) && nNextPacketSize > 0;
-			hr = pAudioCaptureClient->GetNextPacketSize(&nNextPacketSize)
-			) {
-			// get the captured data
-			BYTE *pData;
-			UINT32 nNumFramesToRead;
-			DWORD dwFlags;
-			UINT64 nDevicePosition;
-
-			hr = pAudioCaptureClient->GetBuffer(
-				&pData,
-				&nNumFramesToRead,
-				&dwFlags,
-				&nDevicePosition,
-				NULL
-			);
-			if (FAILED(hr)) {
-				LOG_ERROR(L"IAudioCaptureClient::GetBuffer failed on pass %u after %u frames on %ls: hr = 0x%08x", nPasses, nFrames, m_Tag.c_str(), hr);
-				bDone = true;
-				continue; // exits loop
-			}
-			bool isDiscontinuity = false;
-			if ((dwFlags & (AUDCLNT_BUFFERFLAGS_DATA_DISCONTINUITY)) != 0) {
-				if (bFirstPacket) {
-					LOG_DEBUG(L"Probably spurious glitch reported on first packet on %ls", m_Tag.c_str());
-				}
-				else {
-					LOG_DEBUG(L"IAudioCaptureClient::GetBuffer set flags to 0x%08x on pass %u after %u frames on %ls", dwFlags, nPasses, nFrames, m_Tag.c_str());
-					isDiscontinuity = true;
-				}
-			}
-			else if ((dwFlags & AUDCLNT_BUFFERFLAGS_SILENT) != 0) {
-				//Captured data should be replaced with silence as according to https://docs.microsoft.com/en-us/windows/win32/coreaudio/capturing-a-stream
-				LOG_DEBUG(L"IAudioCaptureClient::GetBuffer set flags to 0x%08x on pass %u after %u frames on %ls", dwFlags, nPasses, nFrames, m_Tag.c_str());
-				memset(pData, 0, sizeof(pData));
-			}
-			else if (0 != dwFlags) {
-				LOG_DEBUG(L"IAudioCaptureClient::GetBuffer set flags to 0x%08x on pass %u after %u frames on %ls", dwFlags, nPasses, nFrames, m_Tag.c_str());
-			}
-
-			if (0 == nNumFramesToRead) {
-				LOG_ERROR(L"IAudioCaptureClient::GetBuffer said to read 0 frames on pass %u after %u frames on %ls", nPasses, nFrames, m_Tag.c_str());
-				hr = E_UNEXPECTED;
-				bDone = true;
-				continue; // exits loop
-			}
-
-			LONG lBytesToWrite = nNumFramesToRead * nBlockAlign;
-#pragma prefast(suppress: __WARNING_INCORRECT_ANNOTATION, "IAudioCaptureClient::GetBuffer SAL annotation implies a 1-byte buffer")
-
-			m_TaskWrapperImpl->m_Mutex.lock();
-			int size = lBytesToWrite;
-			if (m_RecordedBytes.size() == 0)
-				m_RecordedBytes.reserve(size);
-			m_RecordedBytes.insert(m_RecordedBytes.end(), &pData[0], &pData[size]);
-			//This should reduce glitching if there is discontinuity in the audio stream.
-			if (isDiscontinuity) {
-				UINT64 frameDiff = nDevicePosition - nLastDevicePosition;
-				if (frameDiff != nNumFramesToRead) {
-					m_RecordedBytes.insert(m_RecordedBytes.begin(), (size_t)(frameDiff * nBlockAlign), 0);
-					LOG_DEBUG(L"Discontinuity detected, padded audio bytes with %d bytes of silence on %ls", frameDiff, m_Tag.c_str());
-				}
-			}
-			m_TaskWrapperImpl->m_Mutex.unlock();
-
-			nFrames += nNumFramesToRead;
-
-			hr = pAudioCaptureClient->ReleaseBuffer(nNumFramesToRead);
-			if (FAILED(hr)) {
-				LOG_ERROR(L"IAudioCaptureClient::ReleaseBuffer failed on pass %u after %u frames on %ls: hr = 0x%08x", nPasses, nFrames, m_Tag.c_str(), hr);
-				bDone = true;
-				continue; // exits loop
-			}
-			bFirstPacket = false;
-			nLastDevicePosition = nDevicePosition;
-		}
-
-		if (FAILED(hr)) {
-			LOG_ERROR(L"IAudioCaptureClient::GetNextPacketSize failed on pass %u after %u frames on %ls: hr = 0x%08x", nPasses, nFrames, m_Tag.c_str(), hr);
-			bDone = true;
-			continue; // exits loop
-		}
-
-		dwWaitResult = WaitForMultipleObjects(
-			ARRAYSIZE(waitArray), waitArray,
-			FALSE, INFINITE
-		);
-
-		if (WAIT_OBJECT_0 == dwWaitResult) {
-			LOG_DEBUG(L"Received stop event after %u passes and %u frames on %ls", nPasses, nFrames, m_Tag.c_str());
-			bDone = true;
-			continue; // exits loop
-		}
-
-		if (WAIT_OBJECT_0 + 1 != dwWaitResult) {
-			LOG_ERROR(L"Unexpected WaitForMultipleObjects return value %u on pass %u after %u frames on %ls", dwWaitResult, nPasses, nFrames, m_Tag.c_str());
-			hr = E_UNEXPECTED;
-			bDone = true;
-			continue; // exits loop
-		}
-	} // capture loop
+	if (captureLoop.Run(captureDevice, m_RecordedBytes)) {
+		LOG_DEBUG(L"Received stop event on %ls", m_Tag.c_str());
+	}
+	else {
+		hr = FAILED(captureDevice.GetLastResult()) ? captureDevice.GetLastResult() : E_UNEXPECTED;
+	}
+	AUDIO_CAPTURE_STATS stats = captureLoop.GetStats();
+	LOG_DEBUG(L"Audio capture on %ls (%ls) stopped after %llu frames in %llu packets. %llu wake ups, %llu without packets, %llu silent packets, %llu discontinuities",
+		m_Tag.c_str(), isEventDriven ? L"event driven" : L"polled", stats.Frames, stats.Packets, stats.Wakeups, stats.EmptyWakeups, stats.SilentPackets, stats.Discontinuities);
 	m_IsCapturing = false;
 	return hr;
 }
 std::vector<BYTE> LoopbackCapture::PeakRecordedBytes()
 {
-	return m_RecordedBytes;
+	AUDIO_RING_SPAN span = m_RecordedBytes.GetReadSpan();
+	std::vector<BYTE> bytes;
+	bytes.reserve(span.Size());
+	bytes.insert(bytes.end(), span.First, span.First + span.FirstSize);
+	bytes.insert(bytes.end(), span.Second, span.Second + span.SecondSize);
+	return bytes;
 }
 
-std::vector<BYTE> LoopbackCapture::GetRecordedBytes()
+void LoopbackCapture::GetRecordedSamples(_Inout_ std::vector<float> &newvector)
 {
-	auto byteCount = m_RecordedBytes.size();
-	m_TaskWrapperImpl->m_Mutex.lock();
-
-	std::vector<BYTE> newvector(m_RecordedBytes.begin(), m_RecordedBytes.begin() + byteCount);
+	//Only read what is available now, the capture thread may keep appending while we read.
+	AUDIO_RING_SPAN span = m_RecordedBytes.GetReadSpan();
+	size_t byteCount = span.Size();
+	//The caller's vector is reused, so its capacity carries over between calls and steady state reads do not allocate.
+	newvector.clear();
 	// convert audio
-	if (requiresResampling() && byteCount > 0) {
-		WWMFSampleData sampleData;
-		HRESULT hr = m_Resampler.Resample(newvector.data(), (DWORD)newvector.size(), &sampleData);
+	if (byteCount > 0) {
+		//The resampler is streaming, so a wrapped span is resampled in two parts without first copying it to a contiguous buffer.
+		//Only a frame straddling the wrap point, which happens when the frame size is not a power of two, is copied.
+		size_t frameBytes = m_CaptureFrameBytes;
+		size_t firstWholeBytes = span.FirstSize - span.FirstSize % frameBytes;
+		size_t straddleBytes = span.FirstSize - firstWholeBytes;
+		HRESULT hr = ResampleInto(span.First, (DWORD)firstWholeBytes, newvector);
+		if (SUCCEEDED(hr) && straddleBytes > 0) {
+			m_StraddleFrame.assign(span.First + firstWholeBytes, span.First + span.FirstSize);
+			m_StraddleFrame.insert(m_StraddleFrame.end(), span.Second, span.Second + (frameBytes - straddleBytes));
+			hr = ResampleInto(m_StraddleFrame.data(), (DWORD)frameBytes, newvector);
+			straddleBytes = frameBytes - straddleBytes;
+		}
+		if (SUCCEEDED(hr) && span.SecondSize > straddleBytes) {
+			hr = ResampleInto(span.Second + straddleBytes, (DWORD)(span.SecondSize - straddleBytes), newvector);
+		}
 		if (SUCCEEDED(hr)) {
 			LOG_TRACE(L"Resampled audio from %dch %uhz to %dch %uhz", m_InputFormat.nChannels, m_InputFormat.sampleRate, m_OutputFormat.nChannels, m_OutputFormat.sampleRate);
 		}
 		else {
 			LOG_ERROR(L"Resampling of audio failed: hr = 0x%08x", hr);
 		}
-		newvector.clear();
-		newvector.insert(newvector.end(), &sampleData.data[0], &sampleData.data[sampleData.bytes]);
-		sampleData.Release();
-	}
-	if (m_OverflowBytes.size() > 0) {
-		newvector.insert(newvector.begin(), m_OverflowBytes.begin(), m_OverflowBytes.end());
-		m_OverflowBytes.clear();
-	}
-	m_RecordedBytes.erase(m_RecordedBytes.begin(), m_RecordedBytes.begin() + byteCount);
-	LOG_TRACE(L"Got %d bytes from LoopbackCapture %ls. %d bytes remaining", newvector.size(), m_Tag.c_str(), m_RecordedBytes.size());
-	m_TaskWrapperImpl->m_Mutex.unlock();
-	return newvector;
+	}
+	m_RecordedBytes.CommitRead(byteCount);
+	LOG_TRACE(L"Got %d samples from LoopbackCapture %ls. %d bytes remaining", newvector.size(), m_Tag.c_str(), m_RecordedBytes.AvailableToRead());
+}
+
+HRESULT LoopbackCapture::ResampleInto(_In_ const BYTE *pData, _In_ DWORD bytes, _Inout_ std::vector<float> &output)
+{
+	size_t inputFrameBytes = m_CaptureFrameBytes;
+	size_t outputFrameSamples = m_Resampler.GetOutputChannels();
+	if (inputFrameBytes == 0 || bytes % inputFrameBytes != 0) {
+		LOG_ERROR(L"Audio buffer of %u bytes is not a whole number of %u byte frames", bytes, (UINT32)inputFrameBytes);
+		return E_INVALIDARG;
+	}
+	size_t inputFrames = bytes / inputFrameBytes;
+	size_t inputSamples = inputFrames * m_Resampler.GetInputChannels();
+	//Float capture is resampled straight from the ring buffer. Anything else is converted to float first, which is the only conversion before the sink.
+	const float *pSamples = reinterpret_cast<const float *>(pData);
+	if (m_CaptureSampleFormat != AudioSampleFormat::Float32 || reinterpret_cast<uintptr_t>(pData) % alignof(float) != 0) {
+		m_ConvertedSamples.resize(inputSamples);
+		m_SampleConverter.ToFloat(pData, m_CaptureSampleFormat, inputSamples, m_ConvertedSamples.data());
+		pSamples = m_ConvertedSamples.data();
+	}
+	size_t offset = output.size();
+	output.resize(offset + m_Resampler.GetMaxOutputFrames(inputFrames) * outputFrameSamples);
+	size_t outputFrames = m_Resampler.Process(pSamples, inputFrames, output.data() + offset);
+	output.resize(offset + outputFrames * outputFrameSamples);
+	return S_OK;
 }
 
 HRESULT LoopbackCapture::StartCapture(UINT32 sampleRate, UINT32 audioChannels, std::wstring device, EDataFlow flow)
@@ -403,20 +482,38 @@ HRESULT LoopbackCapture::StartCapture(UINT32 sampleRate, UINT32 audioChannels, s
 
 		IMMDevice *device = prefs.m_pMMDevice;
 		auto file = prefs.m_hFile;
+		m_CaptureResult = S_OK;
 		m_TaskWrapperImpl->m_CaptureTask = concurrency::create_task([this, flow, sampleRate, audioChannels, device, file]() {
-			if (FAILED(StartLoopbackCapture(device,
+			HRESULT captureHr = StartLoopbackCapture(device,
 				file,
-				true,
+				false,
 				m_CaptureStartedEvent,
 				m_CaptureStopEvent,
 				flow,
 				sampleRate,
-				audioChannels))) {
+				audioChannels);
+			if (FAILED(captureHr)) {
+				//Set before the event, so StartCapture sees it when it wakes.
+				m_CaptureResult = captureHr;
 				SetEvent(m_CaptureStopEvent);
 			}
 			});
 		HANDLE events[2] = { m_CaptureStartedEvent ,m_CaptureStopEvent };
-		hr = WaitForMultipleObjects(ARRAYSIZE(events), events, false, INFINITE);
+		DWORD waitResult = WaitForMultipleObjects(ARRAYSIZE(events), events, false, INFINITE);
+		switch (waitResult)
+		{
+			case WAIT_OBJECT_0:
+				hr = S_OK;
+				break;
+			case WAIT_OBJECT_0 + 1:
+				//The capture thread failed before it started capturing.
+				hr = FAILED(m_CaptureResult) ? m_CaptureResult : E_FAIL;
+				break;
+			default:
+				LOG_ERROR(L"Waiting for audio capture to start failed: last error is %u", GetLastError());
+				hr = E_FAIL;
+				break;
+		}
 	}
 	return hr;
 }
@@ -425,28 +522,19 @@ HRESULT LoopbackCapture::StopCapture()
 {
 	SetEvent(m_CaptureStopEvent);
 	m_TaskWrapperImpl->m_CaptureTask.wait();
+	if (m_RecordedBytes.GetOverflowCount() > 0) {
+		LOG_WARN(L"Audio buffer on %ls overflowed %llu times, %llu bytes dropped", m_Tag.c_str(), m_RecordedBytes.GetOverflowCount(), m_RecordedBytes.GetOverflowBytes());
+	}
 	return S_OK;
 }
 
-void LoopbackCapture::ReturnAudioBytesToBuffer(std::vector<BYTE> bytes)
+void LoopbackCapture::SetRateAdjustment(double ratio)
 {
-	m_OverflowBytes.swap(bytes);
-	LOG_TRACE(L"Returned %d bytes to buffer in LoopbackCapture %ls", m_OverflowBytes.size(), m_Tag.c_str());
-}
-
-bool LoopbackCapture::requiresResampling()
-{
-	return m_InputFormat.sampleRate != m_OutputFormat.sampleRate
-		|| m_InputFormat.nChannels != m_OutputFormat.nChannels;
-}
-
-bool LoopbackCapture::IsCapturing() {
-	return m_IsCapturing;
+	m_Resampler.SetRateAdjustment(ratio);
 }
 
 void LoopbackCapture::ClearRecordedBytes()
 {
-	m_TaskWrapperImpl->m_Mutex.lock();
-	m_RecordedBytes.clear();
-	m_TaskWrapperImpl->m_Mutex.unlock();
+	m_RecordedBytes.Clear();
+	m_Resampler.Reset();
 }
\ No newline at end of file
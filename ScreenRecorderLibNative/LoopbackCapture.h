@@ -4,7 +4,12 @@
 #include <avrt.h>
 #include <mmdeviceapi.h>
 #include "WWMFResampler.h"
+#include "AudioResampler.h"
+#include "AudioSampleConverter.h"
 #include "AudioPrefs.h"
+#include "AudioRingBuffer.h"
+#include "AudioGraph.h"
+#include "AudioCaptureLoop.h"
 #include "Log.h"
 #include <thread>
 #include <stdio.h>
@@ -14,7 +19,7 @@
 #pragma comment(lib, "ole32.lib")
 #pragma comment(lib, "winmm.lib")
 
-class LoopbackCapture
+class LoopbackCapture : public IAudioGraphInput
 {
 public:
 	LoopbackCapture(_In_opt_ std::wstring tag = L"");
@@ -32,27 +37,51 @@ public:
 		UINT32 channels
 	);
 	std::vector<BYTE> PeakRecordedBytes();
-	std::vector<BYTE> GetRecordedBytes();
+	/// <summary>
+	/// Replaces the contents of the vector with the audio recorded since the last call, as interleaved 32-bit float frames in the requested sample rate and channel count.
+	/// </summary>
+	void GetRecordedSamples(_Inout_ std::vector<float> &output);
+	inline void ReadAvailable(_Inout_ std::vector<float> &output) override { GetRecordedSamples(output); }
 	HRESULT StartCapture(UINT32 audioChannels, std::wstring device, EDataFlow flow) { return StartCapture(0, audioChannels, device, flow); }
 	HRESULT StartCapture(UINT32 sampleRate, UINT32 audioChannels, std::wstring device, EDataFlow flow);
 	HRESULT StopCapture();
-	void ReturnAudioBytesToBuffer(std::vector<BYTE> bytes);
+	/// <summary>
+	/// Fine tunes the resampling ratio to compensate for clock drift. Values above 1 consume the captured audio faster.
+	/// Must be called from the thread that calls GetRecordedSamples.
+	/// </summary>
+	void SetRateAdjustment(double ratio) override;
+	inline UINT64 GetOverflowBytes() { return m_RecordedBytes.GetOverflowBytes(); }
+	inline UINT64 GetUnderrunCount() { return m_RecordedBytes.GetUnderrunCount(); }
 
 private:
 	struct TaskWrapper;
 	std::unique_ptr<TaskWrapper> m_TaskWrapperImpl;
 
 	bool m_IsCapturing = false;
-	std::vector<BYTE> m_OverflowBytes = {};
-	std::vector<BYTE> m_RecordedBytes = {};
+	//The result of the capture thread, if it failed to start.
+	HRESULT m_CaptureResult = S_OK;
+	//Lock free queue between the capture thread (producer) and the recorder thread (consumer).
+	AudioRingBuffer m_RecordedBytes;
 	std::wstring m_Tag;
 	HANDLE m_CaptureStartedEvent = nullptr;
 	HANDLE m_CaptureStopEvent = nullptr;
 
-	WWMFResampler m_Resampler;
+	AudioResampler m_Resampler;
+	//The captured audio is kept in the format of the audio engine, which is float on all current versions of Windows, and only converted if it is not.
+	AudioSampleConverter m_SampleConverter;
+	AudioSampleFormat m_CaptureSampleFormat = AudioSampleFormat::Float32;
+	size_t m_CaptureFrameBytes = 0;
+	std::vector<float> m_ConvertedSamples;
+	//A frame split by the wrap point of m_RecordedBytes.
+	std::vector<BYTE> m_StraddleFrame;
 	WWMFPcmFormat m_InputFormat;
 	WWMFPcmFormat m_OutputFormat;
 
-	bool requiresResampling();
+	//The capacity of m_RecordedBytes, in seconds of captured audio.
+	static const UINT32 RECORDED_BYTES_BUFFER_SECONDS = 5;
+	//The half filter length of the resampler, 1 (min) to 60 (max).
+	static const int RESAMPLER_QUALITY = 60;
+
+	HRESULT ResampleInto(_In_ const BYTE *pData, _In_ DWORD bytes, _Inout_ std::vector<float> &output);
 };
 
@@ -0,0 +1,227 @@
+#include "MFEncoder.h"
+#include "MF.util.h"
+#include "Log.h"
+#include "util.h"
+#include "cleanup.h"
+#include <strmif.h>
+
+MFEncoder::MFEncoder() :
+	m_Transform(nullptr),
+	m_MediaTypeIn(nullptr),
+	m_MediaTypeOut(nullptr),
+	m_OutputInfo{},
+	m_OutputSample(nullptr),
+	m_OutputType(nullptr),
+	m_OnPacket(nullptr),
+	m_IsVideo(false),
+	m_IsStarted(false)
+{
+}
+
+MFEncoder::~MFEncoder()
+{
+	if (m_IsStarted) {
+		m_Transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_STREAMING, 0);
+	}
+}
+
+HRESULT MFEncoder::Create(_In_ IMFMediaType *pMediaTypeIn, _In_ IMFMediaType *pMediaTypeOut)
+{
+	MFT_REGISTER_TYPE_INFO inputInfo{};
+	MFT_REGISTER_TYPE_INFO outputInfo{};
+	RETURN_ON_BAD_HR(pMediaTypeIn->GetGUID(MF_MT_MAJOR_TYPE, &inputInfo.guidMajorType));
+	RETURN_ON_BAD_HR(pMediaTypeIn->GetGUID(MF_MT_SUBTYPE, &inputInfo.guidSubtype));
+	RETURN_ON_BAD_HR(pMediaTypeOut->GetGUID(MF_MT_MAJOR_TYPE, &outputInfo.guidMajorType));
+	RETURN_ON_BAD_HR(pMediaTypeOut->GetGUID(MF_MT_SUBTYPE, &outputInfo.guidSubtype));
+	m_IsVideo = outputInfo.guidMajorType == MFMediaType_Video;
+	m_MediaTypeIn = pMediaTypeIn;
+	m_MediaTypeOut = pMediaTypeOut;
+	if (m_IsVideo) {
+		//The input has no frame rate when recording with a variable frame rate, but the encoder needs one that matches its output.
+		UINT32 numerator = 0;
+		UINT32 denominator = 0;
+		RETURN_ON_BAD_HR(MFGetAttributeRatio(pMediaTypeOut, MF_MT_FRAME_RATE, &numerator, &denominator));
+		m_MediaTypeIn.Release();
+		RETURN_ON_BAD_HR(CopyMediaType(pMediaTypeIn, &m_MediaTypeIn));
+		RETURN_ON_BAD_HR(MFSetAttributeRatio(m_MediaTypeIn, MF_MT_FRAME_RATE, numerator, denominator));
+		RETURN_ON_BAD_HR(m_MediaTypeIn->SetUINT32(MF_MT_INTERLACE_MODE, MFVideoInterlace_Progressive));
+	}
+
+	IMFActivate **ppActivate = nullptr;
+	UINT32 count = 0;
+	HRESULT hr = MFTEnumEx(m_IsVideo ? MFT_CATEGORY_VIDEO_ENCODER : MFT_CATEGORY_AUDIO_ENCODER,
+		MFT_ENUM_FLAG_SYNCMFT | MFT_ENUM_FLAG_LOCALMFT | MFT_ENUM_FLAG_SORTANDFILTER,
+		&inputInfo,
+		&outputInfo,
+		&ppActivate,
+		&count);
+	if (SUCCEEDED(hr) && count == 0)
+	{
+		hr = MF_E_TOPO_CODEC_NOT_FOUND;
+	}
+	if (SUCCEEDED(hr))
+	{
+		hr = ppActivate[0]->ActivateObject(IID_PPV_ARGS(&m_Transform));
+	}
+	for (UINT32 i = 0; i < count; i++)
+	{
+		ppActivate[i]->Release();
+	}
+	CoTaskMemFree(ppActivate);
+	return hr;
+}
+
+HRESULT MFEncoder::ConfigureVideo(_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions, _In_ UINT32 keyframeInterval)
+{
+	auto SetAttributeU32([](_Inout_ CComPtr<ICodecAPI> &codec, _In_ const GUID &guid, _In_ UINT32 value)
+	{
+		VARIANT val;
+		val.vt = VT_UI4;
+		val.uintVal = value;
+		return codec->SetValue(&guid, &val);
+	});
+
+	//Codec properties are set before the media types, since some encoders only read them then.
+	CComPtr<ICodecAPI> encoder = nullptr;
+	m_Transform->QueryInterface(IID_PPV_ARGS(&encoder));
+	if (!encoder) {
+		LOG_WARN("Video encoder has no codec properties, encoding with its defaults");
+		return S_FALSE;
+	}
+	RETURN_ON_BAD_HR(SetAttributeU32(encoder, CODECAPI_AVEncCommonRateControlMode, pEncoderOptions->GetVideoBitrateMode()));
+	if (pEncoderOptions->GetVideoBitrateMode() == eAVEncCommonRateControlMode_Quality) {
+		RETURN_ON_BAD_HR(SetAttributeU32(encoder, CODECAPI_AVEncCommonQuality, pEncoderOptions->GetVideoQuality()));
+	}
+	if (FAILED(SetAttributeU32(encoder, CODECAPI_AVEncMPVGOPSize, keyframeInterval))) {
+		LOG_WARN("Failed to set keyframe interval of video encoder to %u frames, using the encoder default", keyframeInterval);
+	}
+	SetAttributeU32(encoder, CODECAPI_AVEncMPVDefaultBPictureCount, 0);
+	return S_OK;
+}
+
+HRESULT MFEncoder::Start(_In_ PacketFunction onPacket)
+{
+	//Video encoders need the output type set first, and audio encoders the input type.
+	if (SUCCEEDED(m_Transform->SetOutputType(0, m_MediaTypeOut, 0))) {
+		RETURN_ON_BAD_HR(m_Transform->SetInputType(0, m_MediaTypeIn, 0));
+	}
+	else {
+		RETURN_ON_BAD_HR(m_Transform->SetInputType(0, m_MediaTypeIn, 0));
+		RETURN_ON_BAD_HR(m_Transform->SetOutputType(0, m_MediaTypeOut, 0));
+	}
+	RETURN_ON_BAD_HR(m_Transform->GetOutputStreamInfo(0, &m_OutputInfo));
+	if (!(m_OutputInfo.dwFlags & (MFT_OUTPUT_STREAM_PROVIDES_SAMPLES | MFT_OUTPUT_STREAM_CAN_PROVIDE_SAMPLES))) {
+		CComPtr<IMFMediaBuffer> pBuffer = nullptr;
+		RETURN_ON_BAD_HR(MFCreateMemoryBuffer(m_OutputInfo.cbSize, &pBuffer));
+		RETURN_ON_BAD_HR(MFCreateSample(&m_OutputSample));
+		RETURN_ON_BAD_HR(m_OutputSample->AddBuffer(pBuffer));
+	}
+	RETURN_ON_BAD_HR(m_Transform->ProcessMessage(MFT_MESSAGE_NOTIFY_BEGIN_STREAMING, 0));
+	RETURN_ON_BAD_HR(m_Transform->ProcessMessage(MFT_MESSAGE_NOTIFY_START_OF_STREAM, 0));
+	m_OnPacket = onPacket;
+	m_IsStarted = true;
+	return S_OK;
+}
+
+HRESULT MFEncoder::Encode(_In_ IMFSample *pSample)
+{
+	if (!m_IsStarted) {
+		return MF_E_NOT_INITIALIZED;
+	}
+	HRESULT hr = m_Transform->ProcessInput(0, pSample, 0);
+	if (hr == MF_E_NOTACCEPTING) {
+		RETURN_ON_BAD_HR(ProcessOutput());
+		hr = m_Transform->ProcessInput(0, pSample, 0);
+	}
+	RETURN_ON_BAD_HR(hr);
+	return ProcessOutput();
+}
+
+HRESULT MFEncoder::Drain()
+{
+	if (!m_IsStarted) {
+		return MF_E_NOT_INITIALIZED;
+	}
+	RETURN_ON_BAD_HR(m_Transform->ProcessMessage(MFT_MESSAGE_NOTIFY_END_OF_STREAM, 0));
+	RETURN_ON_BAD_HR(m_Transform->ProcessMessage(MFT_MESSAGE_COMMAND_DRAIN, 0));
+	return ProcessOutput();
+}
+
+CComPtr<IMFMediaType> MFEncoder::GetOutputType()
+{
+	std::lock_guard<std::mutex> lock(m_TypeMutex);
+	return m_OutputType;
+}
+
+HRESULT MFEncoder::ProcessOutput()
+{
+	while (true) {
+		if (m_OutputSample) {
+			CComPtr<IMFMediaBuffer> pOutputBuffer = nullptr;
+			RETURN_ON_BAD_HR(m_OutputSample->GetBufferByIndex(0, &pOutputBuffer));
+			RETURN_ON_BAD_HR(pOutputBuffer->SetCurrentLength(0));
+		}
+		MFT_OUTPUT_DATA_BUFFER outputDataBuffer{};
+		outputDataBuffer.dwStreamID = 0;
+		outputDataBuffer.pSample = m_OutputSample;
+		DWORD status = 0;
+		HRESULT hr = m_Transform->ProcessOutput(0, 1, &outputDataBuffer, &status);
+		SafeRelease(&outputDataBuffer.pEvents);
+		if (hr == MF_E_TRANSFORM_NEED_MORE_INPUT) {
+			return S_OK;
+		}
+		if (hr == MF_E_TRANSFORM_STREAM_CHANGE) {
+			//The encoder changed its output format, e.g. to add the codec private data. Accept the first type it offers.
+			CComPtr<IMFMediaType> pMediaType = nullptr;
+			RETURN_ON_BAD_HR(m_Transform->GetOutputAvailableType(0, 0, &pMediaType));
+			RETURN_ON_BAD_HR(m_Transform->SetOutputType(0, pMediaType, 0));
+			std::lock_guard<std::mutex> lock(m_TypeMutex);
+			m_OutputType.Release();
+			continue;
+		}
+		RETURN_ON_BAD_HR(hr);
+		CComPtr<IMFSample> pOutputSample = nullptr;
+		if (m_OutputSample) {
+			pOutputSample = m_OutputSample;
+		}
+		else {
+			pOutputSample.Attach(outputDataBuffer.pSample);
+		}
+		if (!GetOutputType()) {
+			//The output type is only complete once the encoder has produced output, so it is read after the first packet.
+			CComPtr<IMFMediaType> pMediaType = nullptr;
+			RETURN_ON_BAD_HR(m_Transform->GetOutputCurrentType(0, &pMediaType));
+			std::lock_guard<std::mutex> lock(m_TypeMutex);
+			m_OutputType = pMediaType;
+		}
+
+		//The packet is copied into a buffer of its actual size, since the output buffer of an encoder is sized for the worst case.
+		CComPtr<IMFMediaBuffer> pOutputBuffer = nullptr;
+		RETURN_ON_BAD_HR(pOutputSample->ConvertToContiguousBuffer(&pOutputBuffer));
+		BYTE *pSource = nullptr;
+		DWORD length = 0;
+		RETURN_ON_BAD_HR(pOutputBuffer->Lock(&pSource, nullptr, &length));
+		CComPtr<IMFMediaBuffer> pPacketBuffer = nullptr;
+		BYTE *pDest = nullptr;
+		hr = MFCreateMemoryBuffer(length, &pPacketBuffer);
+		if (SUCCEEDED(hr)) {
+			hr = pPacketBuffer->Lock(&pDest, nullptr, nullptr);
+		}
+		if (SUCCEEDED(hr)) {
+			memcpy(pDest, pSource, length);
+			pPacketBuffer->Unlock();
+			hr = pPacketBuffer->SetCurrentLength(length);
+		}
+		pOutputBuffer->Unlock();
+		RETURN_ON_BAD_HR(hr);
+
+		ENCODED_PACKET packet{};
+		pOutputSample->GetSampleTime(&packet.StartPos);
+		pOutputSample->GetSampleDuration(&packet.Duration);
+		//Every audio packet can be decoded on its own, so only video packets are marked by the encoder.
+		packet.IsKeyframe = !m_IsVideo || MFGetAttributeUINT32(pOutputSample, MFSampleExtension_CleanPoint, FALSE);
+		packet.Buffer = pPacketBuffer;
+		packet.Size = length;
+		RETURN_ON_BAD_HR(m_OnPacket(packet));
+	}
+}
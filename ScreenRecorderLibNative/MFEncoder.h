@@ -0,0 +1,76 @@
+#pragma once
+#include <mfapi.h>
+#include <mfidl.h>
+#include <mftransform.h>
+#include <atlbase.h>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "CommonTypes.h"
+
+/// <summary>
+/// A packet of encoded video or audio.
+/// </summary>
+struct ENCODED_PACKET
+{
+	//Timestamp of the start of the packet, in 100 nanosecond units.
+	INT64 StartPos = 0;
+	//Duration of the packet, in 100 nanosecond units.
+	INT64 Duration = 0;
+	//Whether the packet can be decoded without the packets before it. Always set for audio.
+	bool IsKeyframe = false;
+	//The encoded data, in a buffer of its own that the encoder does not reuse.
+	CComPtr<IMFMediaBuffer> Buffer;
+	DWORD Size = 0;
+};
+
+/// <summary>
+/// Runs a Media Foundation encoder transform directly, for outputs that need the encoded packets instead of a finished file, such as the replay buffer and the fragmented MP4 writer.
+/// Only synchronous encoders are used. Hardware encoders are asynchronous, and need the event loop the sink writer otherwise provides, so encoding runs on the CPU.
+/// Samples must be encoded from a single thread. Packets are passed to the packet function on that thread, in the order the encoder outputs them.
+/// </summary>
+class MFEncoder
+{
+public:
+	typedef std::function<HRESULT(ENCODED_PACKET &packet)> PacketFunction;
+
+	MFEncoder();
+	~MFEncoder();
+	/// <summary>
+	/// Creates an encoder that converts the input type to the output type. Codec properties can be set before the encoder is started.
+	/// </summary>
+	HRESULT Create(_In_ IMFMediaType *pMediaTypeIn, _In_ IMFMediaType *pMediaTypeOut);
+	/// <summary>
+	/// Sets the rate control of a video encoder from the encoder options, and asks for a keyframe every keyframeInterval frames.
+	/// B-frames are turned off, since the packets are muxed without decode timestamps.
+	/// </summary>
+	HRESULT ConfigureVideo(_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions, _In_ UINT32 keyframeInterval);
+	/// <summary>
+	/// Sets the media types and starts streaming. Encoded packets are passed to onPacket, and a failure returned by it fails the call to Encode.
+	/// </summary>
+	HRESULT Start(_In_ PacketFunction onPacket);
+	HRESULT Encode(_In_ IMFSample *pSample);
+	/// <summary>
+	/// Encodes the samples the encoder still holds, e.g. for lookahead. Called at the end of the stream.
+	/// </summary>
+	HRESULT Drain();
+	/// <summary>
+	/// The output type of the encoder, with the codec private data a muxer needs. Null until the first packet is encoded. Can be called from any thread.
+	/// </summary>
+	CComPtr<IMFMediaType> GetOutputType();
+	inline bool IsStarted() const { return m_IsStarted; }
+private:
+	CComPtr<IMFTransform> m_Transform;
+	CComPtr<IMFMediaType> m_MediaTypeIn;
+	CComPtr<IMFMediaType> m_MediaTypeOut;
+	MFT_OUTPUT_STREAM_INFO m_OutputInfo;
+	//Reused for the output of encoders that do not provide their own samples. Packets are copied out of it at their actual size.
+	CComPtr<IMFSample> m_OutputSample;
+	CComPtr<IMFMediaType> m_OutputType;
+	std::mutex m_TypeMutex;
+	PacketFunction m_OnPacket;
+	bool m_IsVideo;
+	bool m_IsStarted;
+
+	HRESULT ProcessOutput();
+};
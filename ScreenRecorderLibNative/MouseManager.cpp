@@ -256,6 +256,11 @@ HRESULT MouseManager::ProcessMousePointer(_In_ ID3D11Texture2D *pFrame, _In_ PTR
 	return hr;
 }
 
+bool MouseManager::IsDrawingMouseClick()
+{
+	return m_MouseOptions && m_MouseOptions->IsMouseClicksDetected() && g_LastMouseClickDurationRemaining > 0;
+}
+
 HRESULT MouseManager::DrawMouseClick(_In_ PTR_INFO *pPtrInfo, _In_ ID3D11Texture2D *pBgTexture, std::string colorStr, float radius, DXGI_MODE_ROTATION rotation)
 {
 	ATL::CComPtr<IDXGISurface> pSharedSurface;
@@ -17,6 +17,8 @@ public:
 	void InitializeMouseClickDetection();
 	void StopMouseClickDetection();
 	HRESULT ProcessMousePointer(_In_ ID3D11Texture2D *pFrame, _In_ PTR_INFO *pPtrInfo);
+	//Whether ProcessMousePointer draws a mouse click, which fades out over time.
+	bool IsDrawingMouseClick();
 	HRESULT GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuffer, _In_ DXGI_OUTDUPL_FRAME_INFO *pFrameInfo, _In_ RECT screenRect, _In_ IDXGIOutputDuplication *pDeskDupl, _In_ int offsetX, _In_ int offsetY);
 	HRESULT GetMouse(_Inout_ PTR_INFO *pPtrInfo, _In_ bool getShapeBuffer, _In_ int offsetX, _In_ int offsetY);
 	void CleanDX();
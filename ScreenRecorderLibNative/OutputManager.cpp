@@ -1,5 +1,7 @@
 #include "OutputManager.h"
 #include "screengrab.h"
+#include "DX.util.h"
+#include "RawEncoderBackend.h"
 #include <ppltasks.h> 
 #include <concrt.h>
 #include <filesystem>
@@ -9,29 +11,33 @@ using namespace concurrency;
 OutputManager::OutputManager() :
 	m_Device(nullptr),
 	m_DeviceContext(nullptr),
-	m_CallBack(nullptr),
-	m_FinalizeEvent(nullptr),
-	m_SinkWriter(nullptr),
 	m_OutStream(nullptr),
 	m_EncoderOptions(nullptr),
 	m_AudioOptions(nullptr),
 	m_SnapshotOptions(nullptr),
 	m_OutputOptions(nullptr),
+	m_VideoOutputFrameSize{},
+	m_ReplayBuffer(nullptr),
+	m_OnFragmentWritten(nullptr),
 	m_VideoStreamIndex(0),
 	m_AudioStreamIndex(0),
 	m_OutputFolder(L""),
 	m_OutputFullPath(L""),
-	m_LastFrameHadAudio(false),
 	m_RenderedFrameCount(0),
-	m_MediaTransform(nullptr)
+	m_MediaTransform(nullptr),
+	m_SamplePool(nullptr),
+	m_ImageEncodePool(nullptr),
+	m_ImageEncodeResult(S_OK)
 {
-	m_FinalizeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	CMFSamplePool::Create(&m_SamplePool);
 }
 
 OutputManager::~OutputManager()
 {
-	CloseHandle(m_FinalizeEvent);
-	m_FinalizeEvent = nullptr;
+	//The images still being written report back to this instance, so they are waited for first.
+	m_ImageEncodePool.reset();
+	//Segments that were never finalized are closed here, so their files are still readable.
+	m_Segments.reset();
 }
 
 HRESULT OutputManager::Initialize(
@@ -44,10 +50,19 @@ HRESULT OutputManager::Initialize(
 {
 	m_DeviceContext = pDeviceContext;
 	m_Device = pDevice;
+	m_StagingTexture.Release();
 	m_EncoderOptions = pEncoderOptions;
 	m_AudioOptions = pAudioOptions;
 	m_SnapshotOptions = pSnapshotOptions;
 	m_OutputOptions = pOutputOptions;
+	bool isWritingImages = pOutputOptions->GetRecorderMode() == RecorderModeInternal::Slideshow
+		|| (pOutputOptions->GetRecorderMode() == RecorderModeInternal::Video && pSnapshotOptions->IsSnapshotWithVideoEnabled());
+	if (isWritingImages && !m_ImageEncodePool) {
+		m_ImageEncodePool = make_unique<ImageEncodePool>(pSnapshotOptions->GetImageEncoderThreadCount(), pSnapshotOptions->GetImageEncoderMaxBytes(),
+			[]() { CoInitializeEx(nullptr, COINIT_MULTITHREADED | COINIT_DISABLE_OLE1DDE); },
+			[]() { CoUninitialize(); });
+		LOG_DEBUG("Writing images on %u threads", m_ImageEncodePool->GetThreadCount());
+	}
 	return S_OK;
 }
 
@@ -55,22 +70,22 @@ HRESULT OutputManager::BeginRecording(_In_ std::wstring outputPath, _In_ SIZE vi
 {
 	HRESULT hr = S_FALSE;
 	m_OutputFullPath = outputPath;
+	auto recorderMode = GetOutputOptions()->GetRecorderMode();
+	if (recorderMode == RecorderModeInternal::ReplayBuffer) {
+		//The path is only the default folder of saved replays, and can be left out when they are saved to streams.
+		m_OutputFolder = outputPath;
+		return InitializeReplayBuffer(videoOutputFrameSize);
+	}
 	if (outputPath.empty()) {
 		LOG_ERROR("Failed to start recording due to output path parameter being empty");
 		return E_INVALIDARG;
 	}
 	std::filesystem::path filePath = outputPath;
 	m_OutputFolder = filePath.has_extension() ? filePath.parent_path().wstring() : filePath.wstring();
-	ResetEvent(m_FinalizeEvent);
 
-	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video) {
-		if (m_FinalizeEvent) {
-			m_CallBack = new (std::nothrow)CMFSinkWriterCallback(m_FinalizeEvent, nullptr);
-		}
-		RECT inputMediaFrameRect = RECT{ 0,0,videoOutputFrameSize.cx,videoOutputFrameSize.cy };
-		CComPtr<IMFByteStream> mfByteStream = nullptr;
-		RETURN_ON_BAD_HR(MFCreateFile(MF_ACCESSMODE_READWRITE, MF_OPENMODE_FAIL_IF_EXIST, MF_FILEFLAGS_NONE, outputPath.c_str(), &mfByteStream));
-		RETURN_ON_BAD_HR(hr = InitializeVideoSinkWriter(mfByteStream, m_Device, inputMediaFrameRect, videoOutputFrameSize, DXGI_MODE_ROTATION_UNSPECIFIED, m_CallBack, &m_SinkWriter, &m_VideoStreamIndex, &m_AudioStreamIndex));
+	if (recorderMode == RecorderModeInternal::Video) {
+		m_VideoOutputFrameSize = videoOutputFrameSize;
+		RETURN_ON_BAD_HR(hr = StartSegmentedOutput(GetOutputOptions()->GetSegmentPolicy()));
 	}
 	return hr;
 }
@@ -83,16 +98,20 @@ HRESULT OutputManager::BeginRecording(_In_ IStream *pStream, _In_ SIZE videoOutp
 		return E_INVALIDARG;
 	}
 	m_OutStream = pStream;
-	ResetEvent(m_FinalizeEvent);
+	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::ReplayBuffer) {
+		LOG_ERROR("Replay buffer recordings are saved with SaveReplay, and cannot be recorded to a stream");
+		return E_NOTIMPL;
+	}
 	if (GetOutputOptions()->GetRecorderMode() == RecorderModeInternal::Video) {
-		CComPtr<IMFByteStream> mfByteStream = nullptr;
-		RETURN_ON_BAD_HR(hr = MFCreateMFByteStreamOnStream(pStream, &mfByteStream));
-
-		if (m_FinalizeEvent) {
-			m_CallBack = new (std::nothrow)CMFSinkWriterCallback(m_FinalizeEvent, nullptr);
+		if (IsEncoderBackendRequired()) {
+			LOG_ERROR("The selected video encoder can only record to a file");
+			return E_NOTIMPL;
+		}
+		if (GetOutputOptions()->GetSegmentPolicy().IsEnabled()) {
+			LOG_WARN("Segmented recording is only supported when recording to a file. The stream is written as a single segment.");
 		}
-		RECT inputMediaFrameRect = RECT{ 0,0,videoOutputFrameSize.cx,videoOutputFrameSize.cy };
-		RETURN_ON_BAD_HR(hr = InitializeVideoSinkWriter(mfByteStream, m_Device, inputMediaFrameRect, videoOutputFrameSize, DXGI_MODE_ROTATION_UNSPECIFIED, m_CallBack, &m_SinkWriter, &m_VideoStreamIndex, &m_AudioStreamIndex));
+		m_VideoOutputFrameSize = videoOutputFrameSize;
+		RETURN_ON_BAD_HR(hr = StartSegmentedOutput(SEGMENT_POLICY{}));
 	}
 	return hr;
 }
@@ -102,18 +121,249 @@ HRESULT OutputManager::FinalizeRecording()
 	LOG_INFO("Cleaning up resources");
 	LOG_INFO("Finalizing recording");
 	HRESULT finalizeResult = S_OK;
-	if (m_SinkWriter) {
+	if (m_ImageEncodePool) {
+		m_ImageEncodePool->WaitForAll();
+		IMAGE_ENCODE_STATS stats = m_ImageEncodePool->GetStats();
+		if (stats.SubmittedCount > 0) {
+			LOG_INFO("Wrote %llu images on %u threads, and %llu failed. Encoding took %.1f ms on average and at most %.1f ms, and %.1f ms on average from capture to file. Frames waited for the encoder threads %llu times.",
+				stats.CompletedCount - stats.FailedCount, m_ImageEncodePool->GetThreadCount(), stats.FailedCount, stats.GetAverageEncodeMillis(), stats.MaxEncodeMicros / 1000.0, stats.GetAverageLatencyMillis(), stats.StallCount);
+		}
+		finalizeResult = m_ImageEncodeResult;
+	}
+	if (m_Segments) {
+		if (GetSegment().SinkWriter) {
+			RECYCLING_POOL_STATS poolStats = m_SamplePool->GetStats();
+			LOG_DEBUG("Video sample pool: %llu hits, %llu misses (%.1f%% hit rate), %llu samples discarded", poolStats.HitCount, poolStats.MissCount, poolStats.GetHitRate() * 100, poolStats.DiscardedCount);
+		}
+		if (!m_Segments->Close()) {
+			finalizeResult = E_FAIL;
+		}
+		if (m_Segments->GetPolicy().IsEnabled()) {
+			SEGMENT_STATS stats = m_Segments->GetStats();
+			LOG_INFO("Recording was written to %u segments. %u failed to open and %u failed to finalize. Finalizing took at most %.1f ms.", stats.OpenedCount, stats.OpenFailedCount, stats.FinalizeFailedCount, stats.MaxFinalizeMicros / 1000.0);
+		}
+		m_Segments.reset();
+	}
+	//The next recording may have another frame size or converter mode.
+	m_MediaTransform.Release();
+	m_ColorConverter.reset();
+	if (m_ReplayBuffer) {
+		//Stopping discards the buffer. Whatever should be kept has been saved with SaveReplay.
+		PACKET_RING_STATS stats = m_ReplayBuffer->GetStats();
+		LOG_INFO("Replay buffer held at most %llu bytes. %llu packets were evicted, and the buffer overflowed %llu times.", stats.MaxBytes, stats.EvictedCount, stats.OverflowCount);
+		std::lock_guard<std::mutex> lock(m_ReplayBufferMutex);
+		m_ReplayBuffer.reset();
+	}
+	return finalizeResult;
+}
+
+HRESULT OutputManager::SaveReplay(_In_ std::wstring outputPath)
+{
+	std::shared_ptr<ReplayBuffer> pReplayBuffer = GetReplayBuffer();
+	if (!pReplayBuffer) {
+		LOG_ERROR("Failed to save replay, the recording is not in replay buffer mode");
+		return MF_E_NOT_INITIALIZED;
+	}
+	CComPtr<IMFByteStream> pOutStream = nullptr;
+	RETURN_ON_BAD_HR(MFCreateFile(MF_ACCESSMODE_READWRITE, MF_OPENMODE_FAIL_IF_EXIST, MF_FILEFLAGS_NONE, outputPath.c_str(), &pOutStream));
+	HRESULT hr = pReplayBuffer->Save(pOutStream);
+	pOutStream->Close();
+	pOutStream.Release();
+	if (hr == S_OK) {
+		LOG_INFO(L"Saved replay to %s", outputPath.c_str());
+	}
+	else {
+		//Nothing playable was written, so the file is not left behind.
+		DeleteFileW(outputPath.c_str());
+	}
+	return hr;
+}
+
+HRESULT OutputManager::SaveReplay(_In_ IStream *pStream)
+{
+	if (pStream == nullptr) {
+		LOG_ERROR("Failed to save replay due to output stream parameter being NULL");
+		return E_INVALIDARG;
+	}
+	std::shared_ptr<ReplayBuffer> pReplayBuffer = GetReplayBuffer();
+	if (!pReplayBuffer) {
+		LOG_ERROR("Failed to save replay, the recording is not in replay buffer mode");
+		return MF_E_NOT_INITIALIZED;
+	}
+	CComPtr<CWriteBehindStream> pBufferedStream = nullptr;
+	CComPtr<IMFByteStream> pOutStream = nullptr;
+	RETURN_ON_BAD_HR(CreateBufferedByteStream(pStream, &pBufferedStream, &pOutStream));
+	HRESULT hr = pReplayBuffer->Save(pOutStream);
+	pOutStream.Release();
+	HRESULT flushResult = FlushBufferedStream(pBufferedStream);
+	return FAILED(hr) ? hr : FAILED(flushResult) ? flushResult : hr;
+}
+
+std::shared_ptr<ReplayBuffer> OutputManager::GetReplayBuffer()
+{
+	std::lock_guard<std::mutex> lock(m_ReplayBufferMutex);
+	return m_ReplayBuffer;
+}
+
+HRESULT OutputManager::InitializeReplayBuffer(_In_ SIZE outputFrameSize)
+{
+	if (IsEncoderBackendRequired()) {
+		LOG_ERROR("The selected video encoder cannot be used with the replay buffer");
+		return E_NOTIMPL;
+	}
+	UINT destWidth = max(0, outputFrameSize.cx);
+	UINT destHeight = max(0, outputFrameSize.cy);
+	CComPtr<IMFMediaType> pVideoMediaTypeOut = nullptr;
+	CComPtr<IMFMediaType> pAudioMediaTypeOut = nullptr;
+	CComPtr<IMFMediaType> pVideoMediaTypeIn = nullptr;
+	CComPtr<IMFMediaType> pVideoMediaTypeIntermediate = nullptr;
+	CComPtr<IMFMediaType> pAudioMediaTypeIn = nullptr;
+	RETURN_ON_BAD_HR(ConfigureOutputMediaTypes(destWidth, destHeight, &pVideoMediaTypeOut, &pAudioMediaTypeOut));
+	RETURN_ON_BAD_HR(ConfigureInputMediaTypes(destWidth, destHeight, MFVideoRotationFormat_0, pVideoMediaTypeOut, &pVideoMediaTypeIn, &pAudioMediaTypeIn));
+	RETURN_ON_BAD_HR(CopyMediaType(pVideoMediaTypeIn, &pVideoMediaTypeIntermediate));
+	RETURN_ON_BAD_HR(pVideoMediaTypeIntermediate->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12));
+	RETURN_ON_BAD_HR(InitializeFrameConverter(m_Device, destHeight, pVideoMediaTypeIn, pVideoMediaTypeIntermediate));
+
+	std::shared_ptr<ReplayBuffer> pReplayBuffer = std::make_shared<ReplayBuffer>();
+	RETURN_ON_BAD_HR(pReplayBuffer->Initialize(pVideoMediaTypeIntermediate, pVideoMediaTypeOut, pAudioMediaTypeIn, pAudioMediaTypeOut, GetEncoderOptions(),
+		MillisToHundredNanos(GetOutputOptions()->GetReplayBufferDuration()), GetOutputOptions()->GetReplayBufferMaxBytes()));
+	m_VideoStreamIndex = ReplayBuffer::VIDEO_STREAM_INDEX;
+	m_AudioStreamIndex = ReplayBuffer::AUDIO_STREAM_INDEX;
+	std::lock_guard<std::mutex> lock(m_ReplayBufferMutex);
+	m_ReplayBuffer = pReplayBuffer;
+	return S_OK;
+}
+
+HRESULT OutputManager::InitializeFragmentedMp4Writer(_Inout_ RECORDING_SEGMENT &segment)
+{
+	UINT destWidth = max(0, m_VideoOutputFrameSize.cx);
+	UINT destHeight = max(0, m_VideoOutputFrameSize.cy);
+	CComPtr<IMFMediaType> pVideoMediaTypeOut = nullptr;
+	CComPtr<IMFMediaType> pAudioMediaTypeOut = nullptr;
+	CComPtr<IMFMediaType> pVideoMediaTypeIn = nullptr;
+	CComPtr<IMFMediaType> pVideoMediaTypeIntermediate = nullptr;
+	CComPtr<IMFMediaType> pAudioMediaTypeIn = nullptr;
+	RETURN_ON_BAD_HR(ConfigureOutputMediaTypes(destWidth, destHeight, &pVideoMediaTypeOut, &pAudioMediaTypeOut));
+	RETURN_ON_BAD_HR(ConfigureInputMediaTypes(destWidth, destHeight, MFVideoRotationFormat_0, pVideoMediaTypeOut, &pVideoMediaTypeIn, &pAudioMediaTypeIn));
+	RETURN_ON_BAD_HR(CopyMediaType(pVideoMediaTypeIn, &pVideoMediaTypeIntermediate));
+	RETURN_ON_BAD_HR(pVideoMediaTypeIntermediate->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12));
+	RETURN_ON_BAD_HR(InitializeFrameConverter(m_Device, destHeight, pVideoMediaTypeIn, pVideoMediaTypeIntermediate));
 
-		finalizeResult = m_SinkWriter->Finalize();
-		if (SUCCEEDED(finalizeResult) && m_FinalizeEvent) {
-			WaitForSingleObject(m_FinalizeEvent, INFINITE);
+	std::wstring path = segment.Path;
+	auto onFragment = [this, path](const FMP4_FRAGMENT_INFO &fragment) {
+		LOG_TRACE(L"Wrote fragment %u of %llu bytes at offset %llu, starting at %lld ms", fragment.SequenceNumber, fragment.Size, fragment.Offset, HundredNanosToMillis(fragment.StartPos));
+		if (m_OnFragmentWritten) {
+			m_OnFragmentWritten(path, fragment);
+		}
+	};
+	segment.Fmp4Writer = std::make_unique<FragmentedMp4Writer>();
+	HRESULT hr = segment.Fmp4Writer->Initialize(segment.ByteStream, pVideoMediaTypeIntermediate, pVideoMediaTypeOut, pAudioMediaTypeIn, pAudioMediaTypeOut, GetEncoderOptions(),
+		MillisToHundredNanos(GetEncoderOptions()->GetFragmentDuration()), onFragment);
+	if (FAILED(hr)) {
+		segment.Fmp4Writer.reset();
+		return hr;
+	}
+	m_VideoStreamIndex = FragmentedMp4Writer::VIDEO_STREAM_INDEX;
+	m_AudioStreamIndex = FragmentedMp4Writer::AUDIO_STREAM_INDEX;
+	return S_OK;
+}
+
+HRESULT OutputManager::WriteSample(_In_ DWORD streamIndex, _In_ IMFSample *pSample)
+{
+	if (m_ReplayBuffer) {
+		return m_ReplayBuffer->WriteSample(streamIndex, pSample);
+	}
+	RECORDING_SEGMENT &segment = GetSegment();
+	if (segment.Fmp4Writer) {
+		return segment.Fmp4Writer->WriteSample(streamIndex, pSample);
+	}
+	return segment.SinkWriter->WriteSample(streamIndex, pSample);
+}
+
+HRESULT OutputManager::StartSegmentedOutput(_In_ SEGMENT_POLICY policy)
+{
+	RECORDING_SEGMENT first{};
+	RETURN_ON_BAD_HR(OpenSegment(0, first));
+	m_Segments = std::make_unique<SegmentedOutput<RECORDING_SEGMENT>>(policy,
+		[this](uint32_t index, RECORDING_SEGMENT &segment) {
+			HRESULT hr = OpenSegment(index, segment);
+			if (FAILED(hr)) {
+				_com_error err(hr);
+				LOG_ERROR(L"Failed to open recording segment %s, continuing in the current segment: %s", segment.Path.c_str(), err.ErrorMessage());
+				return false;
+			}
+			LOG_INFO(L"Recording to segment %s", segment.Path.c_str());
+			return true;
+		},
+		[this](RECORDING_SEGMENT &segment) {
+			return SUCCEEDED(FinalizeSegment(segment));
+		});
+	m_Segments->Start(0, std::move(first));
+	if (policy.IsEnabled()) {
+		LOG_INFO("Splitting recording into segments of %lld ms and %llu bytes at most (0 is unlimited)", HundredNanosToMillis(policy.MaxDuration), policy.MaxBytes);
+	}
+	return S_OK;
+}
+
+HRESULT OutputManager::OpenSegment(_In_ UINT32 index, _Inout_ RECORDING_SEGMENT &segment)
+{
+	segment.Path = GetSegmentPath(index);
+	if (IsEncoderBackendRequired()) {
+		return InitializeEncoderBackend(segment.Path, m_VideoOutputFrameSize, &segment.Backend);
+	}
+	if (m_OutStream) {
+		RETURN_ON_BAD_HR(CreateBufferedByteStream(m_OutStream, &segment.BufferedStream, &segment.ByteStream));
+	}
+	else {
+		RETURN_ON_BAD_HR(MFCreateFile(MF_ACCESSMODE_READWRITE, MF_OPENMODE_FAIL_IF_EXIST, MF_FILEFLAGS_NONE, segment.Path.c_str(), &segment.ByteStream));
+	}
+	if (IsFragmentedMp4WriterRequired()) {
+		return InitializeFragmentedMp4Writer(segment);
+	}
+	segment.FinalizeEvent = CreateEvent(NULL, FALSE, FALSE, NULL);
+	if (segment.FinalizeEvent) {
+		segment.CallBack = new (std::nothrow)CMFSinkWriterCallback(segment.FinalizeEvent, nullptr);
+	}
+	//Every segment gets a sink writer of its own, so its encoder starts the segment with a keyframe.
+	RECT inputMediaFrameRect = RECT{ 0,0,m_VideoOutputFrameSize.cx,m_VideoOutputFrameSize.cy };
+	HRESULT hr = InitializeVideoSinkWriter(segment.ByteStream, m_Device, inputMediaFrameRect, m_VideoOutputFrameSize, DXGI_MODE_ROTATION_UNSPECIFIED, segment.CallBack, &segment.SinkWriter, &m_VideoStreamIndex, &m_AudioStreamIndex);
+	if (FAILED(hr) && segment.FinalizeEvent) {
+		CloseHandle(segment.FinalizeEvent);
+		segment.FinalizeEvent = nullptr;
+	}
+	return hr;
+}
+
+HRESULT OutputManager::FinalizeSegment(_Inout_ RECORDING_SEGMENT &segment)
+{
+	HRESULT finalizeResult = S_OK;
+	if (segment.Backend) {
+		if (!segment.Backend->Finalize()) {
+			LOG_ERROR(L"Failed to finalize encoder backend for %s", segment.Path.c_str());
+			finalizeResult = E_FAIL;
+		}
+		segment.Backend.reset();
+	}
+	if (segment.Fmp4Writer) {
+		finalizeResult = segment.Fmp4Writer->Finalize();
+		if (FAILED(finalizeResult)) {
+			LOG_ERROR(L"Failed to finalize fragmented MP4 writer for %s", segment.Path.c_str());
+		}
+		segment.Fmp4Writer.reset();
+		segment.ByteStream->Close();
+		segment.ByteStream.Release();
+	}
+	if (segment.SinkWriter) {
+		finalizeResult = segment.SinkWriter->Finalize();
+		if (SUCCEEDED(finalizeResult) && segment.FinalizeEvent) {
+			WaitForSingleObject(segment.FinalizeEvent, INFINITE);
 		}
 		if (FAILED(finalizeResult)) {
 			LOG_ERROR("Failed to finalize sink writer");
 		}
 		//Dispose of MPEG4MediaSink 
-		IMFMediaSink *pSink;
-		if (SUCCEEDED(m_SinkWriter->GetServiceForStream(MF_SINK_WRITER_MEDIASINK, GUID_NULL, IID_PPV_ARGS(&pSink)))) {
+		CComPtr<IMFMediaSink> pSink;
+		if (SUCCEEDED(segment.SinkWriter->GetServiceForStream(MF_SINK_WRITER_MEDIASINK, GUID_NULL, IID_PPV_ARGS(&pSink)))) {
 			finalizeResult = pSink->Shutdown();
 			if (FAILED(finalizeResult)) {
 				LOG_ERROR("Failed to shut down IMFMediaSink");
@@ -122,10 +372,12 @@ HRESULT OutputManager::FinalizeRecording()
 				LOG_DEBUG("Shut down IMFMediaSink");
 			}
 		};
-		if (!m_OutputFullPath.empty()) {
+		segment.SinkWriter.Release();
+		segment.ByteStream.Release();
+		if (!segment.Path.empty()) {
 			bool isFileAvailable = false;
 			for (int i = 0; i < 10; i++) {
-				isFileAvailable = IsFileAvailableForReading(m_OutputFullPath);
+				isFileAvailable = IsFileAvailableForReading(segment.Path);
 				if (isFileAvailable) {
 					LOG_TRACE(L"Output file is ready");
 					break;
@@ -140,41 +392,107 @@ HRESULT OutputManager::FinalizeRecording()
 			}
 		}
 	}
+	if (segment.BufferedStream) {
+		//The media sink is done with the stream, but the last writes can still be in the buffer.
+		HRESULT flushResult = FlushBufferedStream(segment.BufferedStream);
+		if (SUCCEEDED(finalizeResult)) {
+			finalizeResult = flushResult;
+		}
+		segment.BufferedStream.Release();
+	}
+	if (segment.FinalizeEvent) {
+		CloseHandle(segment.FinalizeEvent);
+		segment.FinalizeEvent = nullptr;
+	}
 	return finalizeResult;
 }
 
+HRESULT OutputManager::CreateBufferedByteStream(_In_ IStream *pStream, _Outptr_ CWriteBehindStream **ppBufferedStream, _Outptr_ IMFByteStream **ppByteStream)
+{
+	*ppBufferedStream = nullptr;
+	*ppByteStream = nullptr;
+	CComPtr<CWriteBehindStream> pBufferedStream = nullptr;
+	RETURN_ON_BAD_HR(CWriteBehindStream::Create(pStream, &pBufferedStream));
+	RETURN_ON_BAD_HR(MFCreateMFByteStreamOnStream(pBufferedStream, ppByteStream));
+	*ppBufferedStream = pBufferedStream.Detach();
+	return S_OK;
+}
+
+HRESULT OutputManager::FlushBufferedStream(_In_ CWriteBehindStream *pBufferedStream)
+{
+	HRESULT hr = pBufferedStream->Flush();
+	if (FAILED(hr)) {
+		LOG_ERROR("Failed to write buffered data to the output stream");
+	}
+	WRITE_BEHIND_STATS stats = pBufferedStream->GetStats();
+	LOG_DEBUG("Output stream buffer combined %llu writes into %llu, averaging %.0f bytes, with %llu seeks and %llu patches. Writes waited for the stream %llu times.",
+		stats.WriteCount, stats.TargetWriteCount, stats.GetAverageTargetWriteSize(), stats.TargetSeekCount, stats.PatchCount, stats.StallCount);
+	return hr;
+}
+
+std::wstring OutputManager::GetSegmentPath(_In_ UINT32 index)
+{
+	//The first segment is written to the output path, so the path reported for the recording is the start of it. Later segments get a number, e.g. recording_002.mp4.
+	if (m_OutStream) {
+		return L"";
+	}
+	if (index == 0) {
+		return m_OutputFullPath;
+	}
+	std::filesystem::path path = m_OutputFullPath;
+	std::wstring number = to_wstring(index + 1);
+	number.insert(0, number.size() < 3 ? 3 - number.size() : 0, L'0');
+	return (path.parent_path() / (path.stem().wstring() + L"_" + number + path.extension().wstring())).wstring();
+}
+
+UINT64 OutputManager::GetSegmentSize(_In_ RECORDING_SEGMENT &segment)
+{
+	if (segment.Backend) {
+		return segment.Backend->GetOutputSize();
+	}
+	if (segment.Fmp4Writer) {
+		return segment.Fmp4Writer->GetOutputSize();
+	}
+	QWORD length = 0;
+	if (segment.ByteStream && SUCCEEDED(segment.ByteStream->GetLength(&length))) {
+		return length;
+	}
+	return 0;
+}
+
 HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 	HRESULT hr(S_OK);
 	auto recorderMode = GetOutputOptions()->GetRecorderMode();
-	if (recorderMode == RecorderModeInternal::Video) {
-		hr = WriteFrameToVideo(model.StartPos, model.Duration, m_VideoStreamIndex, model.Frame);
+	if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::ReplayBuffer) {
+		INT64 segmentStartPos = 0;
+		if (m_Segments) {
+			if (m_Segments->Advance(model.StartPos)) {
+				LOG_INFO(L"Started new segment at %lld ms", HundredNanosToMillis(model.StartPos));
+			}
+			//Each segment has a timeline of its own, starting at zero.
+			segmentStartPos = m_Segments->GetCurrentStartPos();
+		}
+		hr = WriteFrameToVideo(model.StartPos - segmentStartPos, model.Duration, m_VideoStreamIndex, model.Frame);
 		bool wroteAudioSample = false;
 		if (FAILED(hr)) {
 			_com_error err(hr);
 			LOG_ERROR(L"Writing of video frame with start pos %lld ms failed: %s", (HundredNanosToMillis(model.StartPos)), err.ErrorMessage());
 			return hr;//Stop recording if we fail
 		}
-		bool paddedAudio = false;
-
-		/* If the audio pCaptureInstance returns no data, i.e. the source is silent, we need to pad the PCM stream with zeros to give the media sink silence as input.
-		 * If we don't, the sink writer will begin throttling video frames because it expects audio samples to be delivered, and think they are delayed.
-		 * We ignore every instance where the last frame had audio, due to sometimes very short frame durations due to mouse cursor changes have zero audio length,
-		 * and inserting silence between two frames that has audio leads to glitching. */
-		if (GetAudioOptions()->IsAudioEnabled() && model.Audio.size() == 0 && model.Duration > 0) {
-			if (!m_LastFrameHadAudio) {
-				int frameCount = int(ceil(GetAudioOptions()->GetAudioSamplesPerSecond() * HundredNanosToMillis(model.Duration) / 1000));
-				int byteCount = frameCount * (GetAudioOptions()->GetAudioBitsPerSample() / 8) * GetAudioOptions()->GetAudioChannels();
-				model.Audio.insert(model.Audio.end(), byteCount, 0);
-				paddedAudio = true;
+		for (AudioWriteModel &merged : model.MergedAudio) {
+			if (merged.Audio.GetSize() > 0) {
+				hr = WriteAudioSamplesToVideo(merged.StartPos - segmentStartPos, merged.Duration, m_AudioStreamIndex, merged.Audio);
+				if (FAILED(hr)) {
+					_com_error err(hr);
+					LOG_ERROR(L"Writing of audio sample with start pos %lld ms failed: %s", (HundredNanosToMillis(merged.StartPos)), err.ErrorMessage());
+					return hr;//Stop recording if we fail
+				}
+				wroteAudioSample = true;
 			}
-			m_LastFrameHadAudio = false;
-		}
-		else {
-			m_LastFrameHadAudio = true;
 		}
-
-		if (model.Audio.size() > 0) {
-			hr = WriteAudioSamplesToVideo(model.StartPos, model.Duration, m_AudioStreamIndex, &(model.Audio)[0], (DWORD)model.Audio.size());
+		//The audio manager fills frames without captured audio with silence, so the sink writer always gets audio to go along with the video.
+		if (model.Audio.GetSize() > 0) {
+			hr = WriteAudioSamplesToVideo(model.StartPos - segmentStartPos, model.Duration, m_AudioStreamIndex, model.Audio);
 			if (FAILED(hr)) {
 				_com_error err(hr);
 				LOG_ERROR(L"Writing of audio sample with start pos %lld ms failed: %s", (HundredNanosToMillis(model.StartPos)), err.ErrorMessage());
@@ -184,24 +502,39 @@ HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 				wroteAudioSample = true;
 			}
 		}
-		auto frameInfoStr = wroteAudioSample ? (paddedAudio ? L"video sample and audio padding" : L"video and audio sample") : L"video sample";
+		if (m_Segments && m_Segments->GetPolicy().MaxBytes > 0) {
+			m_Segments->SetCurrentSize(GetSegmentSize(GetSegment()));
+		}
+		auto frameInfoStr = wroteAudioSample ? L"video and audio sample" : L"video sample";
 		LOG_TRACE(L"Wrote %s with duration %.2f ms", frameInfoStr, HundredNanosToMillisDouble(model.Duration));
 	}
 	else if (recorderMode == RecorderModeInternal::Slideshow) {
 		wstring	path = m_OutputFolder + L"\\" + to_wstring(m_RenderedFrameCount) + GetSnapshotOptions()->GetImageExtension();
-		hr = WriteFrameToImage(model.Frame, path);
 		INT64 startposMs = HundredNanosToMillis(model.StartPos);
 		INT64 durationMs = HundredNanosToMillis(model.Duration);
+		int frameDelay = m_RenderedFrameCount == 0 ? 0 : (int)durationMs;
+		//A frame that failed to write on an encoder thread stops the recording with the next frame.
+		hr = m_ImageEncodeResult;
+		if (SUCCEEDED(hr)) {
+			hr = QueueFrameToImage(model.Frame, m_StagingTexture, path, [this, path, frameDelay, startposMs, durationMs](const IMAGE_ENCODE_RESULT &result) {
+				if (result.IsFailed()) {
+					_com_error err(result.Status);
+					LOG_ERROR(L"Writing of slideshow frame with start pos %lld ms failed: %s", startposMs, err.ErrorMessage());
+					HRESULT expected = S_OK;
+					m_ImageEncodeResult.compare_exchange_strong(expected, result.Status);
+				}
+				else {
+					//The frames complete in the order they were queued, so the delays stay in frame order.
+					m_FrameDelays.insert(std::pair<wstring, int>(path, frameDelay));
+					LOG_TRACE(L"Wrote video slideshow frame with start pos %lld ms and with duration %lld ms in %.1f ms, after waiting %.1f ms", startposMs, durationMs, result.EncodeMicros / 1000.0, result.QueuedMicros / 1000.0);
+				}
+			});
+		}
 		if (FAILED(hr)) {
 			_com_error err(hr);
 			LOG_ERROR(L"Writing of slideshow frame with start pos %lld ms failed: %s", startposMs, err.ErrorMessage());
 			return hr; //Stop recording if we fail
 		}
-		else {
-
-			m_FrameDelays.insert(std::pair<wstring, int>(path, m_RenderedFrameCount == 0 ? 0 : (int)durationMs));
-			LOG_TRACE(L"Wrote video slideshow frame with start pos %lld ms and with duration %lld ms", startposMs, durationMs);
-		}
 	}
 	else if (recorderMode == RecorderModeInternal::Screenshot) {
 		if (m_OutStream) {
@@ -218,37 +551,96 @@ HRESULT OutputManager::RenderFrame(_In_ FrameWriteModel &model) {
 	return hr;
 }
 
+void OutputManager::MergeDroppedFrame(_Inout_ FrameWriteModel &dropped, _Inout_ FrameWriteModel &survivor)
+{
+	auto TakeAudio([](FrameWriteModel &model, std::vector<AudioWriteModel> &audio) {
+		for (AudioWriteModel &merged : model.MergedAudio) {
+			audio.push_back(std::move(merged));
+		}
+		model.MergedAudio.clear();
+		if (model.Audio) {
+			audio.push_back(AudioWriteModel{ model.StartPos, model.Duration, std::move(model.Audio) });
+		}
+	});
+	std::vector<AudioWriteModel> audio;
+	bool isDroppedFirst = dropped.StartPos < survivor.StartPos;
+	TakeAudio(isDroppedFirst ? dropped : survivor, audio);
+	TakeAudio(isDroppedFirst ? survivor : dropped, audio);
+	INT64 start = min(dropped.StartPos, survivor.StartPos);
+	INT64 end = max(dropped.StartPos + dropped.Duration, survivor.StartPos + survivor.Duration);
+	survivor.StartPos = start;
+	survivor.Duration = end - start;
+	survivor.MergedAudio = std::move(audio);
+	dropped.Frame.Release();
+}
+
 HRESULT OutputManager::WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ std::wstring filePath)
 {
+	if (GetSnapshotOptions()->GetSnapshotEncoderFormat() == GUID_ContainerFormatQoi) {
+		D3D11_TEXTURE2D_DESC desc;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		RETURN_ON_BAD_HR(MapFrame(pAcquiredDesktopImage, m_StagingTexture, &desc, &mapped));
+		HRESULT hr = SaveQoiImageToFile(desc.Format, desc.Width, desc.Height, static_cast<const BYTE *>(mapped.pData), mapped.RowPitch, GetQoiEncoderThreadCount(), filePath.c_str());
+		m_DeviceContext->Unmap(m_StagingTexture, 0);
+		return hr;
+	}
 	return SaveWICTextureToFile(m_DeviceContext, pAcquiredDesktopImage, GetSnapshotOptions()->GetSnapshotEncoderFormat(), filePath.c_str());
 }
 HRESULT OutputManager::WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ IStream *pStream)
 {
+	if (GetSnapshotOptions()->GetSnapshotEncoderFormat() == GUID_ContainerFormatQoi) {
+		D3D11_TEXTURE2D_DESC desc;
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		RETURN_ON_BAD_HR(MapFrame(pAcquiredDesktopImage, m_StagingTexture, &desc, &mapped));
+		HRESULT hr = SaveQoiImageToStream(desc.Format, desc.Width, desc.Height, static_cast<const BYTE *>(mapped.pData), mapped.RowPitch, GetQoiEncoderThreadCount(), pStream);
+		m_DeviceContext->Unmap(m_StagingTexture, 0);
+		return hr;
+	}
 	return SaveWICTextureToStream(m_DeviceContext, pAcquiredDesktopImage, GetSnapshotOptions()->GetSnapshotEncoderFormat(), pStream);
 }
+UINT32 OutputManager::GetQoiEncoderThreadCount()
+{
+	UINT32 threadCount = GetSnapshotOptions()->GetImageEncoderThreadCount();
+	return threadCount > 0 ? threadCount : ImageEncodePool::GetAutomaticThreadCount();
+}
 void OutputManager::WriteTextureToImageAsync(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ std::wstring filePath, _In_opt_ std::function<void(HRESULT)> onCompletion)
 {
-	pAcquiredDesktopImage->AddRef();
-	Concurrency::create_task([this, pAcquiredDesktopImage, filePath, onCompletion]() {
-		return WriteFrameToImage(pAcquiredDesktopImage, filePath);
-	   }).then([this, filePath, pAcquiredDesktopImage, onCompletion](concurrency::task<HRESULT> t)
-		   {
-			   HRESULT hr;
-			   try {
-				   hr = t.get();
-				   // if .get() didn't throw and the HRESULT succeeded, there are no errors.
-			   }
-			   catch (const exception &e) {
-				   // handle error
-				   LOG_ERROR(L"Exception saving snapshot: %s", e.what());
-				   hr = E_FAIL;
-			   }
-			   pAcquiredDesktopImage->Release();
-			   if (onCompletion) {
-				   std::invoke(onCompletion, hr);
-			   }
-			   return hr;
-		   });
+	HRESULT hr = QueueFrameToImage(pAcquiredDesktopImage, m_SnapshotStagingTexture, filePath, [onCompletion](const IMAGE_ENCODE_RESULT &result) {
+		if (onCompletion) {
+			std::invoke(onCompletion, static_cast<HRESULT>(result.Status));
+		}
+	});
+	if (FAILED(hr) && onCompletion) {
+		std::invoke(onCompletion, hr);
+	}
+}
+
+HRESULT OutputManager::QueueFrameToImage(_In_ ID3D11Texture2D *pFrame, _Inout_ CComPtr<ID3D11Texture2D> &pStagingTexture, _In_ std::wstring filePath, _In_opt_ ImageEncodePool::CompletionFunction onCompleted)
+{
+	if (!m_ImageEncodePool) {
+		return E_NOT_VALID_STATE;
+	}
+	D3D11_TEXTURE2D_DESC desc;
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	RETURN_ON_BAD_HR(MapFrame(pFrame, pStagingTexture, &desc, &mapped));
+	//The encoder threads get a copy of the frame, so the staging texture can be used for the next one right away.
+	UINT rowPitch = desc.Width * 4;
+	std::vector<BYTE> pixels(static_cast<size_t>(rowPitch) * desc.Height);
+	for (UINT row = 0; row < desc.Height; row++) {
+		memcpy(pixels.data() + static_cast<size_t>(row) * rowPitch, static_cast<const BYTE *>(mapped.pData) + static_cast<size_t>(row) * mapped.RowPitch, rowPitch);
+	}
+	m_DeviceContext->Unmap(pStagingTexture, 0);
+
+	size_t size = pixels.size();
+	GUID containerFormat = GetSnapshotOptions()->GetSnapshotEncoderFormat();
+	m_ImageEncodePool->Submit(size, [pixels = std::move(pixels), desc, rowPitch, containerFormat, filePath]() {
+		if (containerFormat == GUID_ContainerFormatQoi) {
+			//The pool already encodes frames in parallel, so each frame is encoded on a single thread.
+			return static_cast<int32_t>(SaveQoiImageToFile(desc.Format, desc.Width, desc.Height, pixels.data(), rowPitch, 1, filePath.c_str()));
+		}
+		return static_cast<int32_t>(SaveWICImageToFile(desc.Format, desc.Width, desc.Height, pixels.data(), rowPitch, containerFormat, filePath.c_str()));
+	}, onCompleted);
+	return S_OK;
 }
 
 
@@ -335,6 +727,48 @@ HRESULT OutputManager::ConfigureInputMediaTypes(
 	return S_OK;
 }
 
+HRESULT OutputManager::InitializeFrameConverter(
+	_In_ ID3D11Device *pDevice,
+	_In_ UINT sourceHeight,
+	_In_ IMFMediaType *pVideoMediaTypeIn,
+	_Inout_ IMFMediaType *pVideoMediaTypeIntermediate)
+{
+	//Every segment of a recording converts the same frames, so the converter is created for the first segment and reused by the ones after it.
+	if (!m_MediaTransform && !m_ColorConverter) {
+		CComPtr<IMFMediaType> pVideoMediaTypeTransform = nullptr;
+		RETURN_ON_BAD_HR(CopyMediaType(pVideoMediaTypeIntermediate, &pVideoMediaTypeTransform));
+		pVideoMediaTypeTransform->DeleteItem(MF_MT_FRAME_RATE);
+
+		ColorConverterMode converterMode = GetEncoderOptions()->GetColorConverterMode();
+		if (converterMode == ColorConverterMode::Auto && IsSoftwareAdapter(pDevice)) {
+			//Without a GPU the video processor converts on the CPU as well, but much slower than the SIMD converter.
+			converterMode = ColorConverterMode::Software;
+		}
+		if (converterMode != ColorConverterMode::Software) {
+			HRESULT hr = CreateIMFTransform(0, pVideoMediaTypeIn, pVideoMediaTypeTransform, &m_MediaTransform);
+			if (FAILED(hr)) {
+				if (converterMode == ColorConverterMode::MediaFoundation) {
+					return hr;
+				}
+				LOG_WARN("Failed to create video processor transform, converting frames on the CPU instead: hr = 0x%08x", hr);
+				m_MediaTransform.Release();
+			}
+		}
+		if (!m_MediaTransform) {
+			//The video processor does not tag its output, so encoders assume BT.601 below HD and BT.709 from HD up. The converter follows the same rule, and tags the frames to be sure.
+			YuvMatrix matrix = sourceHeight >= 720 ? YuvMatrix::BT709 : YuvMatrix::BT601;
+			m_ColorConverter = std::make_unique<ColorConverter>();
+			m_ColorConverter->Initialize(YuvFormat::NV12, matrix, YuvRange::Limited);
+			LOG_INFO("Converting frames to NV12 on the CPU with the %hs kernel on %u threads", ColorConverter::GetKernelName(m_ColorConverter->GetKernel()), m_ColorConverter->GetThreadCount());
+		}
+	}
+	if (m_ColorConverter) {
+		RETURN_ON_BAD_HR(pVideoMediaTypeIntermediate->SetUINT32(MF_MT_YUV_MATRIX, m_ColorConverter->GetMatrix() == YuvMatrix::BT709 ? MFVideoTransferMatrix_BT709 : MFVideoTransferMatrix_BT601));
+		RETURN_ON_BAD_HR(pVideoMediaTypeIntermediate->SetUINT32(MF_MT_VIDEO_NOMINAL_RANGE, m_ColorConverter->GetRange() == YuvRange::Full ? MFNominalRange_0_255 : MFNominalRange_16_235));
+	}
+	return S_OK;
+}
+
 HRESULT OutputManager::InitializeVideoSinkWriter(
 	_In_ IMFByteStream *pOutStream,
 	_In_ ID3D11Device *pDevice,
@@ -357,7 +791,6 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 	CComPtr<IMFMediaType>         pAudioMediaTypeOut = nullptr;
 	CComPtr<IMFMediaType>         pVideoMediaTypeIn = nullptr;
 	CComPtr<IMFMediaType>		  pVideoMediaTypeIntermediate = nullptr;
-	CComPtr<IMFMediaType>		  pVideoMediaTypeTransform = nullptr;
 	CComPtr<IMFMediaType>         pAudioMediaTypeIn = nullptr;
 	CComPtr<IMFAttributes>        pAttributes = nullptr;
 
@@ -390,14 +823,13 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 	//The source samples have the format ARGB32, but the video encoders need the input to be a YUV format, so we convert ARGB32->NV12->H264/HEVC
 	CopyMediaType(pVideoMediaTypeIn, &pVideoMediaTypeIntermediate);
 	RETURN_ON_BAD_HR(pVideoMediaTypeIntermediate->SetGUID(MF_MT_SUBTYPE, MFVideoFormat_NV12));
-	CopyMediaType(pVideoMediaTypeIntermediate, &pVideoMediaTypeTransform);
-	pVideoMediaTypeTransform->DeleteItem(MF_MT_FRAME_RATE);
 
-	RETURN_ON_BAD_HR(CreateIMFTransform(videoStreamIndex, pVideoMediaTypeIn, pVideoMediaTypeTransform, &m_MediaTransform));
+	RETURN_ON_BAD_HR(InitializeFrameConverter(pDevice, sourceHeight, pVideoMediaTypeIn, pVideoMediaTypeIntermediate));
 
 	//Creates a streaming writer
 	CComPtr<IMFMediaSink> pMp4StreamSink = nullptr;
 	if (GetEncoderOptions()->GetIsFragmentedMp4Enabled()) {
+		LOG_WARN("The fragment duration and fragment index are only available for H.264 with hardware encoding disabled, using the fragmented MP4 sink of Media Foundation");
 		RETURN_ON_BAD_HR(MFCreateFMPEG4MediaSink(pOutStream, pVideoMediaTypeOut, pAudioMediaTypeOut, &pMp4StreamSink));
 	}
 	else {
@@ -463,6 +895,12 @@ HRESULT OutputManager::InitializeVideoSinkWriter(
 
 HRESULT OutputManager::WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage)
 {
+	if (m_Segments && GetSegment().Backend) {
+		return WriteFrameToEncoderBackend(frameStartPos, frameDuration, pAcquiredDesktopImage);
+	}
+	if (m_ColorConverter) {
+		return WriteConvertedFrameToVideo(frameStartPos, frameDuration, streamIndex, pAcquiredDesktopImage);
+	}
 	IMFMediaBuffer *pMediaBuffer;
 	HRESULT hr = MFCreateDXGISurfaceBuffer(__uuidof(ID3D11Texture2D), pAcquiredDesktopImage, 0, FALSE, &pMediaBuffer);
 	IMF2DBuffer *p2DBuffer;
@@ -479,10 +917,13 @@ HRESULT OutputManager::WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 fr
 	{
 		hr = pMediaBuffer->SetCurrentLength(length);
 	}
-	IMFSample *pSample;
+	//The samples come from a pool and go back to it once the transform and the sink writer are done with them, so the frame sized transform output is not allocated for every frame.
+	D3D11_TEXTURE2D_DESC desc;
+	pAcquiredDesktopImage->GetDesc(&desc);
+	IMFSample *pSample = nullptr;
 	if (SUCCEEDED(hr))
 	{
-		hr = MFCreateSample(&pSample);
+		hr = m_SamplePool->AcquireSample(MF_SAMPLE_POOL_KEY{ MFVideoFormat_ARGB32, desc.Width, desc.Height, 0 }, &pSample);
 	}
 	if (SUCCEEDED(hr))
 	{
@@ -502,21 +943,15 @@ HRESULT OutputManager::WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 fr
 	{
 		hr = m_MediaTransform->GetOutputStreamInfo(streamIndex, &info);
 	}
-	IMFMediaBuffer *transformBuffer;
-	if (SUCCEEDED(hr))
-	{
-		hr = MFCreateMemoryBuffer(info.cbSize, &transformBuffer);
-	}
-	IMFSample *transformSample;
+	IMFSample *transformSample = nullptr;
 	if (SUCCEEDED(hr))
 	{
-		hr = MFCreateSample(&transformSample);
+		hr = m_SamplePool->AcquireSample(MF_SAMPLE_POOL_KEY{ MFVideoFormat_NV12, desc.Width, desc.Height, info.cbSize }, &transformSample);
 	}
 	MFT_OUTPUT_DATA_BUFFER outputDataBuffer;
 	RtlZeroMemory(&outputDataBuffer, sizeof(outputDataBuffer));
 	if (SUCCEEDED(hr))
 	{
-		hr = transformSample->AddBuffer(transformBuffer);
 		outputDataBuffer.dwStreamID = streamIndex;
 		outputDataBuffer.pSample = transformSample;
 	}
@@ -531,9 +966,9 @@ HRESULT OutputManager::WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 fr
 	}
 	if (SUCCEEDED(hr))
 	{
-		hr = m_SinkWriter->WriteSample(streamIndex, outputDataBuffer.pSample);
+		hr = WriteSample(streamIndex, outputDataBuffer.pSample);
 	}
-	SafeRelease(&transformBuffer);
+	SafeRelease(&outputDataBuffer.pEvents);
 	SafeRelease(&transformSample);
 	SafeRelease(&pSample);
 	SafeRelease(&p2DBuffer);
@@ -541,46 +976,121 @@ HRESULT OutputManager::WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 fr
 	return hr;
 }
 
-HRESULT OutputManager::WriteAudioSamplesToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ BYTE *pSrc, _In_ DWORD cbData)
+HRESULT OutputManager::MapFrame(_In_ ID3D11Texture2D *pFrame, _Inout_ CComPtr<ID3D11Texture2D> &pStagingTexture, _Out_ D3D11_TEXTURE2D_DESC *pDesc, _Out_ D3D11_MAPPED_SUBRESOURCE *pMapped)
 {
-	IMFMediaBuffer *pBuffer = nullptr;
-	BYTE *pData = nullptr;
-	// Create the media buffer.
-	HRESULT hr = MFCreateMemoryBuffer(
-		cbData,   // Amount of memory to allocate, in bytes.
-		&pBuffer
-	);
-	//once in awhile, things get behind and we get an out of memory error when trying to create the buffer
-	//so, just check, wait and try again if necessary
-	int counter = 0;
-	while (!SUCCEEDED(hr) && counter++ < 100) {
-		Sleep(10);
-		hr = MFCreateMemoryBuffer(cbData, &pBuffer);
-	}
-	// Lock the buffer to get a pointer to the memory.
-	if (SUCCEEDED(hr))
-	{
-		hr = pBuffer->Lock(&pData, nullptr, nullptr);
+	pFrame->GetDesc(pDesc);
+	if (pDesc->Format != DXGI_FORMAT_B8G8R8A8_UNORM) {
+		LOG_ERROR("Unsupported texture format for reading frames on the CPU: %d", pDesc->Format);
+		return E_INVALIDARG;
 	}
-
-	if (SUCCEEDED(hr))
-	{
-		memcpy_s(pData, cbData, pSrc, cbData);
+	if (pStagingTexture) {
+		D3D11_TEXTURE2D_DESC stagingDesc;
+		pStagingTexture->GetDesc(&stagingDesc);
+		if (stagingDesc.Width != pDesc->Width || stagingDesc.Height != pDesc->Height) {
+			pStagingTexture.Release();
+		}
+	}
+	if (!pStagingTexture) {
+		D3D11_TEXTURE2D_DESC stagingDesc = *pDesc;
+		stagingDesc.MipLevels = 1;
+		stagingDesc.ArraySize = 1;
+		stagingDesc.SampleDesc.Count = 1;
+		stagingDesc.SampleDesc.Quality = 0;
+		stagingDesc.Usage = D3D11_USAGE_STAGING;
+		stagingDesc.BindFlags = 0;
+		stagingDesc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+		stagingDesc.MiscFlags = 0;
+		RETURN_ON_BAD_HR(m_Device->CreateTexture2D(&stagingDesc, nullptr, &pStagingTexture));
 	}
+	m_DeviceContext->CopyResource(pStagingTexture, pFrame);
+	//Mapping waits for the copy to finish on the GPU.
+	return m_DeviceContext->Map(pStagingTexture, 0, D3D11_MAP_READ, 0, pMapped);
+}
 
-	// Update the current length.
-	if (SUCCEEDED(hr))
-	{
-		hr = pBuffer->SetCurrentLength(cbData);
+HRESULT OutputManager::WriteConvertedFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	pAcquiredDesktopImage->GetDesc(&desc);
+	DWORD bufferSize = static_cast<DWORD>(ColorConverter::GetImageBytes(YuvFormat::NV12, desc.Width, desc.Height));
+	CComPtr<IMFSample> pSample;
+	RETURN_ON_BAD_HR(m_SamplePool->AcquireSample(MF_SAMPLE_POOL_KEY{ MFVideoFormat_NV12, desc.Width, desc.Height, bufferSize }, &pSample));
+	CComPtr<IMFMediaBuffer> pBuffer;
+	RETURN_ON_BAD_HR(pSample->GetBufferByIndex(0, &pBuffer));
+	BYTE *pData = nullptr;
+	RETURN_ON_BAD_HR(pBuffer->Lock(&pData, nullptr, nullptr));
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	HRESULT hr = MapFrame(pAcquiredDesktopImage, m_StagingTexture, &desc, &mapped);
+	if (SUCCEEDED(hr)) {
+		YUV_IMAGE image = ColorConverter::GetContiguousImage(YuvFormat::NV12, pData, desc.Width, desc.Height);
+		if (!m_ColorConverter->Convert(static_cast<const uint8_t *>(mapped.pData), mapped.RowPitch, desc.Width, desc.Height, image)) {
+			hr = E_INVALIDARG;
+		}
+		m_DeviceContext->Unmap(m_StagingTexture, 0);
 	}
+	pBuffer->Unlock();
+	RETURN_ON_BAD_HR(hr);
+	RETURN_ON_BAD_HR(pBuffer->SetCurrentLength(bufferSize));
+	RETURN_ON_BAD_HR(pSample->SetSampleTime(frameStartPos));
+	RETURN_ON_BAD_HR(pSample->SetSampleDuration(frameDuration));
+	return WriteSample(streamIndex, pSample);
+}
 
-	// Unlock the buffer.
-	if (pData)
-	{
-		hr = pBuffer->Unlock();
+HRESULT OutputManager::WriteFrameToEncoderBackend(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ ID3D11Texture2D *pAcquiredDesktopImage)
+{
+	D3D11_TEXTURE2D_DESC desc;
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	RETURN_ON_BAD_HR(MapFrame(pAcquiredDesktopImage, m_StagingTexture, &desc, &mapped));
+	ENCODER_VIDEO_FRAME frame{};
+	frame.StartPos = frameStartPos;
+	frame.Duration = frameDuration;
+	frame.Data = static_cast<const uint8_t *>(mapped.pData);
+	frame.Stride = mapped.RowPitch;
+	bool isEncoded = GetSegment().Backend->EncodeVideo(frame);
+	m_DeviceContext->Unmap(m_StagingTexture, 0);
+	return isEncoded ? S_OK : E_FAIL;
+}
+
+HRESULT OutputManager::InitializeEncoderBackend(_In_ std::wstring outputPath, _In_ SIZE outputFrameSize, _Out_ std::unique_ptr<EncoderBackend> *pBackend)
+{
+	std::unique_ptr<EncoderBackend> backend = std::make_unique<RawEncoderBackend>(outputPath);
+	ENCODER_BACKEND_CONFIG config{};
+	config.Width = static_cast<uint32_t>(max(0, outputFrameSize.cx));
+	config.Height = static_cast<uint32_t>(max(0, outputFrameSize.cy));
+	config.FrameRate = GetEncoderOptions()->GetVideoFps();
+	config.IsAudioEnabled = GetAudioOptions()->IsAudioEnabled();
+	config.AudioSampleRate = GetAudioOptions()->GetAudioSamplesPerSecond();
+	config.AudioChannels = GetAudioOptions()->GetAudioChannels();
+	config.AudioBitsPerSample = GetAudioOptions()->GetAudioBitsPerSample();
+	if (!backend->Configure(config)) {
+		LOG_ERROR(L"Failed to configure encoder backend for %s", outputPath.c_str());
+		return E_FAIL;
 	}
+	*pBackend = std::move(backend);
+	LOG_INFO(L"Writing raw video and audio to %s", outputPath.c_str());
+	return S_OK;
+}
+
+bool OutputManager::IsEncoderBackendRequired()
+{
+	return GetEncoderOptions()->GetVideoEncoderFormat() == MFVideoFormat_I420;
+}
 
-	IMFSample *pSample;
+bool OutputManager::IsFragmentedMp4WriterRequired()
+{
+	return GetEncoderOptions()->GetIsFragmentedMp4Enabled()
+		&& GetEncoderOptions()->GetVideoEncoderFormat() == MFVideoFormat_H264
+		&& !GetEncoderOptions()->GetIsHardwareEncodingEnabled();
+}
+
+HRESULT OutputManager::WriteAudioSamplesToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ AudioBufferRef &audio)
+{
+	if (m_Segments && GetSegment().Backend) {
+		return GetSegment().Backend->EncodeAudio(frameStartPos, frameDuration, audio) ? S_OK : E_FAIL;
+	}
+	IMFMediaBuffer *pBuffer = nullptr;
+	IMFSample *pSample = nullptr;
+	// Wrap the pooled audio buffer in a media buffer. The audio is not copied, and the buffer returns to its pool once the sink writer is done with it.
+	HRESULT hr = CAudioMediaBuffer::Create(audio, &pBuffer);
 	if (SUCCEEDED(hr))
 	{
 		hr = MFCreateSample(&pSample);
@@ -602,7 +1112,7 @@ HRESULT OutputManager::WriteAudioSamplesToVideo(_In_ INT64 frameStartPos, _In_ I
 	if (SUCCEEDED(hr))
 	{
 		// Send the sample to the Sink Writer.
-		hr = m_SinkWriter->WriteSample(streamIndex, pSample);
+		hr = WriteSample(streamIndex, pSample);
 	}
 	SafeRelease(&pSample);
 	SafeRelease(&pBuffer);
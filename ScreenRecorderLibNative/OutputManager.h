@@ -4,9 +4,27 @@
 #include "Util.h"
 #include "MF.util.h"
 #include "CMFSinkWriterCallback.h"
+#include "CAudioMediaBuffer.h"
+#include "CMFSamplePool.h"
+#include "CWriteBehindStream.h"
+#include "AudioBufferPool.h"
+#include "ColorConverter.h"
+#include "EncoderBackend.h"
+#include "SegmentedOutput.h"
+#include "ReplayBuffer.h"
+#include "FragmentedMp4Writer.h"
+#include "ImageEncodePool.h"
 #include "cleanup.h"
 #include "fifo_map.h"
 #include <mfreadwrite.h>
+#include <atomic>
+
+struct AudioWriteModel
+{
+	INT64 StartPos;
+	INT64 Duration;
+	AudioBufferRef Audio;
+};
 
 struct FrameWriteModel
 {
@@ -14,12 +32,35 @@ struct FrameWriteModel
 	INT64 StartPos;
 	//Duration of the frame, in 100 nanosecond units.
 	INT64 Duration;
-	//The audio sample bytes for this frame.
-	std::vector<BYTE> Audio;
+	//The audio samples for this frame. Passed on to the media sink without copying.
+	AudioBufferRef Audio;
+	//The audio of frames that were dropped from the encode queue and merged into this one, in timeline order. Written before Audio.
+	std::vector<AudioWriteModel> MergedAudio;
 	//The frame texture.
 	CComPtr<ID3D11Texture2D> Frame;
 };
 
+//The output of a video recording, or of one segment of it when the recording is split into several files.
+struct RECORDING_SEGMENT
+{
+	//The output file, or empty when recording to a stream.
+	std::wstring Path;
+	CComPtr<IMFByteStream> ByteStream;
+	//Buffers the writes to the output stream under ByteStream, when recording to a stream.
+	CComPtr<CWriteBehindStream> BufferedStream;
+	CComPtr<IMFSinkWriter> SinkWriter;
+	CComPtr<IMFSinkWriterCallback> CallBack;
+	//Signaled by CallBack when the sink writer is finalized. Closed when the segment is finalized.
+	HANDLE FinalizeEvent = nullptr;
+	//Encodes the segment instead of the sink writer, for encoders that are not Media Foundation transforms.
+	std::unique_ptr<EncoderBackend> Backend;
+	//Writes the segment to ByteStream instead of the sink writer, when recording fragmented MP4 with fragments set by the recorder.
+	std::unique_ptr<FragmentedMp4Writer> Fmp4Writer;
+};
+
+//Called with the output path, or an empty path when recording to a stream, whenever a fragment of a fragmented MP4 recording is written.
+typedef std::function<void(std::wstring, const FMP4_FRAGMENT_INFO &)> FragmentWrittenFunction;
+
 class OutputManager
 {
 public:
@@ -36,8 +77,19 @@ public:
 	HRESULT BeginRecording(_In_ std::wstring outputPath, _In_ SIZE videoOutputFrameSizer);
 	HRESULT BeginRecording(_In_ IStream *pStream, _In_ SIZE videoOutputFrameSize);
 	HRESULT FinalizeRecording();
+	/// <summary>
+	/// Writes the contents of the replay buffer to a new file. Can be called from any thread while recording in replay buffer mode, and does not interrupt the recording.
+	/// </summary>
+	/// <returns>S_FALSE if the buffer was still empty</returns>
+	HRESULT SaveReplay(_In_ std::wstring outputPath);
+	HRESULT SaveReplay(_In_ IStream *pStream);
 	HRESULT RenderFrame(_In_ FrameWriteModel &model);
+	/// <summary>
+	/// Merges a frame dropped from the encode queue into the frame that takes its place, so the surviving frame covers the time of both and the audio of the dropped frame is still written.
+	/// </summary>
+	static void MergeDroppedFrame(_Inout_ FrameWriteModel &dropped, _Inout_ FrameWriteModel &survivor);
 	void WriteTextureToImageAsync(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ std::wstring filePath, _In_opt_ std::function<void(HRESULT)> onCompletion = nullptr);
+	inline void SetFragmentWrittenCallback(_In_ FragmentWrittenFunction onFragmentWritten) { m_OnFragmentWritten = onFragmentWritten; }
 	inline nlohmann::fifo_map<std::wstring, int> GetFrameDelays() { return m_FrameDelays; }
 	inline UINT64 GetRenderedFrameCount() { return m_RenderedFrameCount; }
 private:
@@ -51,16 +103,30 @@ private:
 
 	nlohmann::fifo_map<std::wstring, int> m_FrameDelays;
 
-	CComPtr<IMFSinkWriter> m_SinkWriter;
-	CComPtr<IMFSinkWriterCallback> m_CallBack;
 	CComPtr<IMFTransform> m_MediaTransform;
+	CComPtr<CMFSamplePool> m_SamplePool;
+	//Converts frames to NV12 on the CPU when the video processor transform is not used.
+	std::unique_ptr<ColorConverter> m_ColorConverter;
+	//CPU readable copy of the frame, for m_ColorConverter, encoder backends and slideshow frames.
+	CComPtr<ID3D11Texture2D> m_StagingTexture;
+	//CPU readable copy of snapshots taken with video, which are queued from the capture thread instead of the thread rendering the frames.
+	CComPtr<ID3D11Texture2D> m_SnapshotStagingTexture;
+	//Writes slideshow frames and snapshots to image files in parallel. Only created for recordings that write images.
+	std::unique_ptr<ImageEncodePool> m_ImageEncodePool;
+	//The first failure to write a slideshow frame on m_ImageEncodePool, which stops the recording.
+	std::atomic<HRESULT> m_ImageEncodeResult;
+	//The segments of the video recording. Recordings that are not split are written as a single segment.
+	std::unique_ptr<SegmentedOutput<RECORDING_SEGMENT>> m_Segments;
+	SIZE m_VideoOutputFrameSize;
+	//Holds the encoded recording in replay buffer mode. Shared with threads saving the replay, and guarded by m_ReplayBufferMutex when set or reset.
+	std::shared_ptr<ReplayBuffer> m_ReplayBuffer;
+	std::mutex m_ReplayBufferMutex;
+	FragmentWrittenFunction m_OnFragmentWritten;
 	IStream *m_OutStream;
 	DWORD m_VideoStreamIndex;
 	DWORD m_AudioStreamIndex;
-	HANDLE m_FinalizeEvent;
 	std::wstring m_OutputFolder;
 	std::wstring m_OutputFullPath;
-	bool m_LastFrameHadAudio;
 	UINT64 m_RenderedFrameCount;
 	std::chrono::steady_clock::time_point m_PreviousSnapshotTaken;
 
@@ -68,13 +134,58 @@ private:
 	std::shared_ptr<ENCODER_OPTIONS> GetEncoderOptions() { return m_EncoderOptions; }
 	std::shared_ptr<SNAPSHOT_OPTIONS> GetSnapshotOptions() { return m_SnapshotOptions; }
 	std::shared_ptr<OUTPUT_OPTIONS> GetOutputOptions() { return m_OutputOptions; }
+	RECORDING_SEGMENT &GetSegment() { return m_Segments->GetCurrent(); }
 
 	HRESULT ConfigureOutputMediaTypes(_In_ UINT destWidth, _In_ UINT destHeight, _Outptr_ IMFMediaType **pVideoMediaTypeOut, _Outptr_result_maybenull_ IMFMediaType **pAudioMediaTypeOut);
 	HRESULT ConfigureInputMediaTypes(_In_ UINT sourceWidth, _In_ UINT sourceHeight, _In_ MFVideoRotationFormat rotationFormat, _In_ IMFMediaType *pVideoMediaTypeOut, _Outptr_ IMFMediaType **pVideoMediaTypeIn, _Outptr_result_maybenull_ IMFMediaType **pAudioMediaTypeIn);
+	/// <summary>
+	/// Sets up conversion of frames to the intermediate YUV format, with the video processor transform or m_ColorConverter. The converter is created once per recording, and later calls only tag the intermediate type for it.
+	/// </summary>
+	HRESULT InitializeFrameConverter(_In_ ID3D11Device *pDevice, _In_ UINT sourceHeight, _In_ IMFMediaType *pVideoMediaTypeIn, _Inout_ IMFMediaType *pVideoMediaTypeIntermediate);
 	HRESULT InitializeVideoSinkWriter(_In_ IMFByteStream *pOutStream, _In_ ID3D11Device *pDevice, _In_ RECT sourceRect, _In_ SIZE outputFrameSize, _In_ DXGI_MODE_ROTATION rotation, _In_ IMFSinkWriterCallback *pCallback, _Outptr_ IMFSinkWriter **ppWriter, _Out_ DWORD *pVideoStreamIndex, _Out_ DWORD *pAudioStreamIndex);
+	HRESULT InitializeReplayBuffer(_In_ SIZE outputFrameSize);
+	HRESULT InitializeFragmentedMp4Writer(_Inout_ RECORDING_SEGMENT &segment);
+	std::shared_ptr<ReplayBuffer> GetReplayBuffer();
+	/// <summary>
+	/// Writes a converted video frame or audio sample to the replay buffer, or to the fragmented MP4 writer or sink writer of the current segment.
+	/// </summary>
+	HRESULT WriteSample(_In_ DWORD streamIndex, _In_ IMFSample *pSample);
 	HRESULT WriteFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage);
+	HRESULT InitializeEncoderBackend(_In_ std::wstring outputPath, _In_ SIZE outputFrameSize, _Out_ std::unique_ptr<EncoderBackend> *pBackend);
+	/// <summary>
+	/// Opens the first segment of the video recording, and starts a new segment whenever the segment policy says so.
+	/// </summary>
+	HRESULT StartSegmentedOutput(_In_ SEGMENT_POLICY policy);
+	HRESULT OpenSegment(_In_ UINT32 index, _Inout_ RECORDING_SEGMENT &segment);
+	HRESULT FinalizeSegment(_Inout_ RECORDING_SEGMENT &segment);
+	std::wstring GetSegmentPath(_In_ UINT32 index);
+	/// <summary>
+	/// Wraps a stream in a CWriteBehindStream and a byte stream on top of it, so the many small writes of a media sink reach the stream as a few large ones.
+	/// </summary>
+	HRESULT CreateBufferedByteStream(_In_ IStream *pStream, _Outptr_ CWriteBehindStream **ppBufferedStream, _Outptr_ IMFByteStream **ppByteStream);
+	HRESULT FlushBufferedStream(_In_ CWriteBehindStream *pBufferedStream);
+	UINT64 GetSegmentSize(_In_ RECORDING_SEGMENT &segment);
+	bool IsEncoderBackendRequired();
+	/// <summary>
+	/// Whether fragmented MP4 is written with FragmentedMp4Writer. The muxer only supports H.264, and its encoder only runs on the CPU. Other formats, and recordings with hardware encoding enabled, use the fragmented MP4 sink of Media Foundation, which cuts fragments on its own.
+	/// </summary>
+	bool IsFragmentedMp4WriterRequired();
+	/// <summary>
+	/// Copies the frame to a staging texture and maps it for reading. The staging texture is created or resized as needed. The caller unmaps it when done.
+	/// </summary>
+	HRESULT MapFrame(_In_ ID3D11Texture2D *pFrame, _Inout_ CComPtr<ID3D11Texture2D> &pStagingTexture, _Out_ D3D11_TEXTURE2D_DESC *pDesc, _Out_ D3D11_MAPPED_SUBRESOURCE *pMapped);
+	/// <summary>
+	/// Copies the frame to memory and queues it on m_ImageEncodePool to be written to an image file. Waits if too many frames are queued already.
+	/// </summary>
+	/// <param name="pStagingTexture">The staging texture used to read the frame, which is only used by the calling thread</param>
+	/// <param name="onCompleted">Called on an encoder thread once the image is written, in the order the frames were queued</param>
+	HRESULT QueueFrameToImage(_In_ ID3D11Texture2D *pFrame, _Inout_ CComPtr<ID3D11Texture2D> &pStagingTexture, _In_ std::wstring filePath, _In_opt_ ImageEncodePool::CompletionFunction onCompleted);
+	HRESULT WriteFrameToEncoderBackend(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ ID3D11Texture2D *pAcquiredDesktopImage);
+	HRESULT WriteConvertedFrameToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ ID3D11Texture2D *pAcquiredDesktopImage);
 	HRESULT WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ std::wstring filePath);
 	HRESULT WriteFrameToImage(_In_ ID3D11Texture2D *pAcquiredDesktopImage, _In_ IStream *pStream);
-	HRESULT WriteAudioSamplesToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ BYTE *pSrc, _In_ DWORD cbData);
+	//The number of threads a single QOI screenshot is encoded on.
+	UINT32 GetQoiEncoderThreadCount();
+	HRESULT WriteAudioSamplesToVideo(_In_ INT64 frameStartPos, _In_ INT64 frameDuration, _In_ DWORD streamIndex, _In_ AudioBufferRef &audio);
 };
 
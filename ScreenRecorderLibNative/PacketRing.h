@@ -0,0 +1,187 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+struct PACKET_RING_STATS
+{
+	//The number of packets pushed, evicted to stay within the limits, and dropped while waiting for a keyframe.
+	uint64_t PushedCount = 0;
+	uint64_t EvictedCount = 0;
+	uint64_t DroppedCount = 0;
+	//The number of times the ring was emptied because a single group of pictures did not fit in the memory limit.
+	uint64_t OverflowCount = 0;
+	//The largest number of bytes held at once.
+	uint64_t MaxBytes = 0;
+};
+
+/// <summary>
+/// Memory bounded ring of encoded packets that holds the last part of a stream, e.g. the last two minutes of a recording for an instant replay.
+/// Packets of the key stream, usually the video, are indexed by keyframe, and packets are evicted a whole group of pictures at a time, so the ring always starts with a keyframe and its contents can be decoded.
+/// Packets of other streams, e.g. audio, are kept with the group of pictures they were pushed in.
+/// Push and Snapshot can be called from different threads. Payloads are copied by Snapshot, so they should be cheap to copy, such as reference counted buffers.
+/// </summary>
+template <typename TPayload>
+class PacketRing
+{
+public:
+	struct PACKET
+	{
+		uint32_t StreamIndex = 0;
+		//Timestamp of the start of the packet, in 100 nanosecond units.
+		int64_t StartPos = 0;
+		//Duration of the packet, in 100 nanosecond units.
+		int64_t Duration = 0;
+		//Whether the packet can be decoded without the packets before it. Only used for the key stream.
+		bool IsKeyframe = false;
+		//The size of the payload in bytes, counted against the memory limit.
+		size_t Size = 0;
+		TPayload Payload{};
+	};
+
+	/// <param name="maxDuration">The duration of the key stream to keep, in 100 nanosecond units. The ring holds at least this much once it has filled, and less than one group of pictures more.</param>
+	/// <param name="maxBytes">The largest number of payload bytes to hold</param>
+	/// <param name="keyStreamIndex">The stream the ring is indexed by</param>
+	PacketRing(int64_t maxDuration, uint64_t maxBytes, uint32_t keyStreamIndex = 0) :
+		m_MaxDuration(maxDuration),
+		m_MaxBytes(maxBytes),
+		m_KeyStreamIndex(keyStreamIndex),
+		m_FirstSequence(0),
+		m_Bytes(0),
+		m_EndPos(0),
+		m_Stats{}
+	{
+	}
+
+	PacketRing(const PacketRing &) = delete;
+	PacketRing &operator=(const PacketRing &) = delete;
+
+	/// <summary>
+	/// Adds a packet to the end of the ring, and evicts the oldest groups of pictures that are no longer needed to stay within the limits.
+	/// Packets pushed while the ring is empty are dropped until a keyframe of the key stream arrives.
+	/// </summary>
+	/// <returns>false if the packet was dropped</returns>
+	bool Push(PACKET &&packet)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.PushedCount++;
+		bool isKeyPacket = packet.StreamIndex == m_KeyStreamIndex;
+		if (m_Packets.empty() && !(isKeyPacket && packet.IsKeyframe)) {
+			m_Stats.DroppedCount++;
+			return false;
+		}
+		if (isKeyPacket) {
+			if (packet.IsKeyframe) {
+				m_Keyframes.push_back(m_FirstSequence + m_Packets.size());
+			}
+			m_EndPos = (std::max)(m_EndPos, packet.StartPos + packet.Duration);
+		}
+		m_Bytes += packet.Size;
+		m_Packets.push_back(std::move(packet));
+		m_Stats.MaxBytes = (std::max)(m_Stats.MaxBytes, m_Bytes);
+		Evict();
+		return !m_Packets.empty();
+	}
+
+	/// <summary>
+	/// Copies the packets in the ring, starting with a keyframe, without removing them.
+	/// </summary>
+	std::vector<PACKET> Snapshot()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return std::vector<PACKET>(m_Packets.begin(), m_Packets.end());
+	}
+
+	void Clear()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_FirstSequence += m_Packets.size();
+		m_Packets.clear();
+		m_Keyframes.clear();
+		m_Bytes = 0;
+	}
+
+	size_t GetPacketCount()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Packets.size();
+	}
+
+	uint64_t GetBytes()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Bytes;
+	}
+
+	/// <summary>
+	/// The duration of the key stream held, from the first keyframe to the end of the last packet.
+	/// </summary>
+	int64_t GetDuration()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Packets.empty() ? 0 : m_EndPos - m_Packets.front().StartPos;
+	}
+
+	PACKET_RING_STATS GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+private:
+	const int64_t m_MaxDuration;
+	const uint64_t m_MaxBytes;
+	const uint32_t m_KeyStreamIndex;
+
+	std::mutex m_Mutex;
+	std::deque<PACKET> m_Packets;
+	//The sequence numbers of the keyframes in the ring. A packet's sequence number is its position in the ring plus m_FirstSequence.
+	std::deque<uint64_t> m_Keyframes;
+	uint64_t m_FirstSequence;
+	uint64_t m_Bytes;
+	//The end of the last packet of the key stream.
+	int64_t m_EndPos;
+	PACKET_RING_STATS m_Stats;
+
+	void Evict()
+	{
+		//The first group of pictures goes once the rest of the ring covers the duration on its own.
+		while (m_Keyframes.size() > 1 && m_EndPos - StartPosOf(m_Keyframes[1]) >= m_MaxDuration) {
+			EvictFirstGroup();
+		}
+		while (m_MaxBytes > 0 && m_Bytes > m_MaxBytes) {
+			if (m_Keyframes.size() > 1) {
+				EvictFirstGroup();
+			}
+			else {
+				//A single group of pictures is larger than the limit. Nothing in it can be kept, so the ring starts over at the next keyframe.
+				m_Stats.EvictedCount += m_Packets.size();
+				m_Stats.OverflowCount++;
+				m_FirstSequence += m_Packets.size();
+				m_Packets.clear();
+				m_Keyframes.clear();
+				m_Bytes = 0;
+			}
+		}
+	}
+
+	void EvictFirstGroup()
+	{
+		uint64_t end = m_Keyframes[1];
+		while (m_FirstSequence < end) {
+			m_Bytes -= m_Packets.front().Size;
+			m_Packets.pop_front();
+			m_FirstSequence++;
+			m_Stats.EvictedCount++;
+		}
+		m_Keyframes.pop_front();
+	}
+
+	int64_t StartPosOf(uint64_t sequence) const
+	{
+		return m_Packets[static_cast<size_t>(sequence - m_FirstSequence)].StartPos;
+	}
+};
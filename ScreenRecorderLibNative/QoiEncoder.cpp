@@ -0,0 +1,247 @@
+#include "QoiEncoder.h"
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace {
+	constexpr uint8_t OP_INDEX = 0x00;
+	constexpr uint8_t OP_DIFF = 0x40;
+	constexpr uint8_t OP_LUMA = 0x80;
+	constexpr uint8_t OP_RUN = 0xc0;
+	constexpr uint8_t OP_RGB = 0xfe;
+	constexpr uint8_t OP_RGBA = 0xff;
+	constexpr uint8_t OP_MASK = 0xc0;
+	constexpr int MAX_RUN = 62;
+	//The largest image the format allows.
+	constexpr uint64_t MAX_PIXELS = 400000000;
+	//The most bytes a pixel can take, as QOI_OP_RGBA.
+	constexpr size_t MAX_PIXEL_SIZE = 5;
+	constexpr uint8_t MAGIC[] = { 'q', 'o', 'i', 'f' };
+	constexpr uint8_t END_MARKER[QoiEncoder::END_MARKER_SIZE] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+	struct PIXEL
+	{
+		uint8_t R;
+		uint8_t G;
+		uint8_t B;
+		uint8_t A;
+
+		inline bool operator==(const PIXEL &other) const { return R == other.R && G == other.G && B == other.B && A == other.A; }
+	};
+
+	inline uint32_t Hash(const PIXEL &px)
+	{
+		return (px.R * 3 + px.G * 5 + px.B * 7 + px.A * 11) % 64;
+	}
+
+	void WriteUInt32(uint8_t *pData, uint32_t value)
+	{
+		pData[0] = static_cast<uint8_t>(value >> 24);
+		pData[1] = static_cast<uint8_t>(value >> 16);
+		pData[2] = static_cast<uint8_t>(value >> 8);
+		pData[3] = static_cast<uint8_t>(value);
+	}
+
+	uint32_t ReadUInt32(const uint8_t *pData)
+	{
+		return static_cast<uint32_t>(pData[0]) << 24 | static_cast<uint32_t>(pData[1]) << 16 | static_cast<uint32_t>(pData[2]) << 8 | pData[3];
+	}
+
+	/// <summary>
+	/// Encodes a band of rows. The first band continues from the initial state of a decoder. Later bands start with a full color and only use the colors indexed by themselves, because the decoder state at their start depends on the bands before them.
+	/// </summary>
+	void EncodeBand(const uint8_t *pBgra, uint32_t width, uint32_t firstRow, uint32_t rowCount, size_t rowPitch, bool hasAlpha, bool isFirstBand, std::vector<uint8_t> &output)
+	{
+		PIXEL index[64]{};
+		bool isIndexed[64]{};
+		PIXEL previous{ 0, 0, 0, 255 };
+		bool isPreviousKnown = isFirstBand;
+		int run = 0;
+		size_t rowCapacity = static_cast<size_t>(width) * MAX_PIXEL_SIZE + 1;
+		size_t position = 0;
+		output.resize(rowCapacity);
+		for (uint32_t row = firstRow; row < firstRow + rowCount; row++) {
+			if (output.size() - position < rowCapacity) {
+				output.resize((std::max)(output.size() * 2, position + rowCapacity));
+			}
+			uint8_t *pOut = output.data() + position;
+			const uint8_t *pIn = pBgra + row * rowPitch;
+			for (uint32_t x = 0; x < width; x++, pIn += 4) {
+				PIXEL px{ pIn[2], pIn[1], pIn[0], hasAlpha ? pIn[3] : static_cast<uint8_t>(255) };
+				if (px == previous && isPreviousKnown) {
+					run++;
+					if (run == MAX_RUN) {
+						*pOut++ = static_cast<uint8_t>(OP_RUN | (run - 1));
+						run = 0;
+					}
+					continue;
+				}
+				if (run > 0) {
+					*pOut++ = static_cast<uint8_t>(OP_RUN | (run - 1));
+					run = 0;
+				}
+				uint32_t hash = Hash(px);
+				if (isIndexed[hash] && index[hash] == px) {
+					*pOut++ = static_cast<uint8_t>(OP_INDEX | hash);
+				}
+				else {
+					index[hash] = px;
+					isIndexed[hash] = true;
+					if (isPreviousKnown && px.A == previous.A) {
+						int8_t dr = static_cast<int8_t>(px.R - previous.R);
+						int8_t dg = static_cast<int8_t>(px.G - previous.G);
+						int8_t db = static_cast<int8_t>(px.B - previous.B);
+						int8_t drg = static_cast<int8_t>(dr - dg);
+						int8_t dbg = static_cast<int8_t>(db - dg);
+						if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1) {
+							*pOut++ = static_cast<uint8_t>(OP_DIFF | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2));
+						}
+						else if (dg >= -32 && dg <= 31 && drg >= -8 && drg <= 7 && dbg >= -8 && dbg <= 7) {
+							*pOut++ = static_cast<uint8_t>(OP_LUMA | (dg + 32));
+							*pOut++ = static_cast<uint8_t>((drg + 8) << 4 | (dbg + 8));
+						}
+						else {
+							*pOut++ = OP_RGB;
+							*pOut++ = px.R;
+							*pOut++ = px.G;
+							*pOut++ = px.B;
+						}
+					}
+					else {
+						*pOut++ = OP_RGBA;
+						*pOut++ = px.R;
+						*pOut++ = px.G;
+						*pOut++ = px.B;
+						*pOut++ = px.A;
+					}
+				}
+				previous = px;
+				isPreviousKnown = true;
+			}
+			//Runs are ended with the band, but not with the row. The space for a row includes a byte for the run.
+			if (row == firstRow + rowCount - 1 && run > 0) {
+				*pOut++ = static_cast<uint8_t>(OP_RUN | (run - 1));
+			}
+			position = pOut - output.data();
+		}
+		output.resize(position);
+	}
+}
+
+bool QoiEncoder::Encode(const uint8_t *pBgra, uint32_t width, uint32_t height, size_t rowPitch, bool hasAlpha, uint32_t threadCount, std::vector<uint8_t> *pOutput)
+{
+	if (!pBgra || !pOutput || width == 0 || height == 0 || static_cast<uint64_t>(width) * height > MAX_PIXELS || rowPitch < static_cast<size_t>(width) * 4) {
+		return false;
+	}
+	uint32_t bandCount = (std::max)(1u, (std::min)((std::max)(threadCount, 1u), height / MIN_ROWS_PER_BAND));
+	uint32_t rowsPerBand = (height + bandCount - 1) / bandCount;
+	bandCount = (height + rowsPerBand - 1) / rowsPerBand;
+	std::vector<std::vector<uint8_t>> bands(bandCount);
+	std::vector<std::thread> threads;
+	for (uint32_t band = 1; band < bandCount; band++) {
+		uint32_t firstRow = band * rowsPerBand;
+		threads.emplace_back(EncodeBand, pBgra, width, firstRow, (std::min)(rowsPerBand, height - firstRow), rowPitch, hasAlpha, false, std::ref(bands[band]));
+	}
+	EncodeBand(pBgra, width, 0, (std::min)(rowsPerBand, height), rowPitch, hasAlpha, true, bands[0]);
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	size_t size = HEADER_SIZE + END_MARKER_SIZE;
+	for (const std::vector<uint8_t> &band : bands) {
+		size += band.size();
+	}
+	pOutput->resize(size);
+	uint8_t *pOut = pOutput->data();
+	memcpy(pOut, MAGIC, sizeof(MAGIC));
+	WriteUInt32(pOut + 4, width);
+	WriteUInt32(pOut + 8, height);
+	pOut[12] = hasAlpha ? 4 : 3;
+	pOut[13] = 0;
+	pOut += HEADER_SIZE;
+	for (const std::vector<uint8_t> &band : bands) {
+		if (!band.empty()) {
+			memcpy(pOut, band.data(), band.size());
+			pOut += band.size();
+		}
+	}
+	memcpy(pOut, END_MARKER, END_MARKER_SIZE);
+	return true;
+}
+
+bool QoiEncoder::Decode(const uint8_t *pData, size_t size, std::vector<uint8_t> *pBgra, QOI_IMAGE_INFO *pInfo)
+{
+	if (!pData || !pBgra || !pInfo || size < HEADER_SIZE + END_MARKER_SIZE || memcmp(pData, MAGIC, sizeof(MAGIC)) != 0) {
+		return false;
+	}
+	QOI_IMAGE_INFO info{};
+	info.Width = ReadUInt32(pData + 4);
+	info.Height = ReadUInt32(pData + 8);
+	info.Channels = pData[12];
+	info.Colorspace = pData[13];
+	uint64_t pixelCount = static_cast<uint64_t>(info.Width) * info.Height;
+	if (pixelCount == 0 || pixelCount > MAX_PIXELS || (info.Channels != 3 && info.Channels != 4) || info.Colorspace > 1) {
+		return false;
+	}
+	pBgra->resize(static_cast<size_t>(pixelCount) * 4);
+	PIXEL index[64]{};
+	PIXEL px{ 0, 0, 0, 255 };
+	int run = 0;
+	size_t position = HEADER_SIZE;
+	size_t chunksEnd = size - END_MARKER_SIZE;
+	uint8_t *pOut = pBgra->data();
+	for (uint64_t i = 0; i < pixelCount; i++) {
+		if (run > 0) {
+			run--;
+		}
+		else {
+			if (position >= chunksEnd) {
+				return false;
+			}
+			uint8_t op = pData[position++];
+			if (op == OP_RGB || op == OP_RGBA) {
+				size_t length = op == OP_RGB ? 3 : 4;
+				if (chunksEnd - position < length) {
+					return false;
+				}
+				px.R = pData[position++];
+				px.G = pData[position++];
+				px.B = pData[position++];
+				if (op == OP_RGBA) {
+					px.A = pData[position++];
+				}
+			}
+			else if ((op & OP_MASK) == OP_INDEX) {
+				px = index[op];
+			}
+			else if ((op & OP_MASK) == OP_DIFF) {
+				px.R += ((op >> 4) & 0x03) - 2;
+				px.G += ((op >> 2) & 0x03) - 2;
+				px.B += (op & 0x03) - 2;
+			}
+			else if ((op & OP_MASK) == OP_LUMA) {
+				if (position >= chunksEnd) {
+					return false;
+				}
+				uint8_t next = pData[position++];
+				int dg = (op & 0x3f) - 32;
+				px.R += dg - 8 + ((next >> 4) & 0x0f);
+				px.G += dg;
+				px.B += dg - 8 + (next & 0x0f);
+			}
+			else {
+				run = op & 0x3f;
+			}
+			index[Hash(px)] = px;
+		}
+		*pOut++ = px.B;
+		*pOut++ = px.G;
+		*pOut++ = px.R;
+		*pOut++ = px.A;
+	}
+	if (memcmp(pData + chunksEnd, END_MARKER, END_MARKER_SIZE) != 0) {
+		return false;
+	}
+	*pInfo = info;
+	return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+struct QOI_IMAGE_INFO
+{
+	uint32_t Width = 0;
+	uint32_t Height = 0;
+	//3 for RGB, 4 for RGBA.
+	uint8_t Channels = 0;
+	//0 for sRGB with linear alpha, 1 for all channels linear.
+	uint8_t Colorspace = 0;
+};
+
+/// <summary>
+/// Encodes BGRA frames as QOI ("Quite OK Image") files, a lossless format that is many times faster to write than PNG. It suits screen content well: flat areas become runs, and the repeated colors of text and UI become one byte references, so files are only somewhat larger than PNG.
+/// Large images are split in bands of rows that are encoded on separate threads. Each band starts with a full color and only refers to colors of its own band, so the bands joined together are a valid QOI stream that any decoder reads.
+/// Decode is the reference decoder the encoder is tested against.
+/// </summary>
+class QoiEncoder
+{
+public:
+	static constexpr size_t HEADER_SIZE = 14;
+	static constexpr size_t END_MARKER_SIZE = 8;
+	//Bands smaller than this are not worth a thread of their own.
+	static constexpr uint32_t MIN_ROWS_PER_BAND = 64;
+
+	/// <summary>
+	/// Encodes an image in BGRA byte order, which is how captured frames are laid out in memory.
+	/// </summary>
+	/// <param name="pBgra">The first row of the image</param>
+	/// <param name="width">The width in pixels</param>
+	/// <param name="height">The height in pixels</param>
+	/// <param name="rowPitch">The bytes from the start of one row to the next</param>
+	/// <param name="hasAlpha">Whether the alpha channel is written. If not, the image is written as RGB and alpha is ignored, since captured screens are opaque</param>
+	/// <param name="threadCount">The most threads to encode on, including the calling thread</param>
+	/// <param name="pOutput">Receives the QOI file</param>
+	/// <returns>false if the size is invalid</returns>
+	static bool Encode(const uint8_t *pBgra, uint32_t width, uint32_t height, size_t rowPitch, bool hasAlpha, uint32_t threadCount, std::vector<uint8_t> *pOutput);
+	/// <summary>
+	/// Decodes a QOI file to BGRA pixels with a row pitch of four times the width.
+	/// </summary>
+	/// <returns>false if the data is not a complete QOI file</returns>
+	static bool Decode(const uint8_t *pData, size_t size, std::vector<uint8_t> *pBgra, QOI_IMAGE_INFO *pInfo);
+};
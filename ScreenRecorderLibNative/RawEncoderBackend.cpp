@@ -0,0 +1,233 @@
+#include "RawEncoderBackend.h"
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+namespace {
+	const int64_t HundredNanosPerSecond = 10 * 1000 * 1000;
+	const uint16_t WaveFormatPcm = 1;
+
+	inline int64_t RoundedScale(int64_t value, int64_t numerator, int64_t denominator) {
+		//Timestamps are non-negative, and a recording would need to last for thousands of years to overflow.
+		return (value * numerator + denominator / 2) / denominator;
+	}
+
+	inline void PutUInt16(uint8_t *pDest, uint16_t value) {
+		pDest[0] = static_cast<uint8_t>(value);
+		pDest[1] = static_cast<uint8_t>(value >> 8);
+	}
+
+	inline void PutUInt32(uint8_t *pDest, uint32_t value) {
+		PutUInt16(pDest, static_cast<uint16_t>(value));
+		PutUInt16(pDest + 2, static_cast<uint16_t>(value >> 16));
+	}
+}
+
+RawEncoderBackend::RawEncoderBackend(const std::filesystem::path &videoPath) :
+	m_VideoPath(videoPath),
+	m_AudioPath(std::filesystem::path(videoPath).replace_extension(".wav")),
+	m_Config{},
+	m_FrameImage{},
+	m_HasFrame(false),
+	m_NextFrameSlot(0),
+	m_AudioFramesWritten(0),
+	m_AudioBlockAlign(0),
+	m_VideoBytes(0),
+	m_IsConfigured(false),
+	m_IsFinalized(false),
+	m_Stats{}
+{
+}
+
+RawEncoderBackend::~RawEncoderBackend()
+{
+	if (m_IsConfigured && !m_IsFinalized) {
+		Finalize();
+	}
+}
+
+bool RawEncoderBackend::Configure(const ENCODER_BACKEND_CONFIG &config)
+{
+	if (m_IsConfigured || config.Width == 0 || config.Height == 0 || config.Width % 2 != 0 || config.Height % 2 != 0 || config.FrameRate == 0) {
+		return false;
+	}
+	if (config.IsAudioEnabled && (config.AudioSampleRate == 0 || config.AudioChannels == 0 || config.AudioBitsPerSample % 8 != 0 || config.AudioBitsPerSample == 0)) {
+		return false;
+	}
+	m_Config = config;
+	//Y4M has no way to tag the color matrix, so it follows the same rule as untagged video elsewhere: BT.601 below HD and BT.709 from HD up.
+	m_Converter.Initialize(YuvFormat::I420, config.Height >= 720 ? YuvMatrix::BT709 : YuvMatrix::BT601, YuvRange::Limited);
+	m_Frame.assign(ColorConverter::GetImageBytes(YuvFormat::I420, config.Width, config.Height), 0);
+	m_FrameImage = ColorConverter::GetContiguousImage(YuvFormat::I420, m_Frame.data(), config.Width, config.Height);
+
+	m_VideoFile.open(m_VideoPath, std::ios::binary | std::ios::trunc);
+	if (!m_VideoFile) {
+		return false;
+	}
+	std::string header = "YUV4MPEG2 W" + std::to_string(config.Width) + " H" + std::to_string(config.Height)
+		+ " F" + std::to_string(config.FrameRate) + ":1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
+	m_VideoFile.write(header.data(), header.size());
+	m_VideoBytes += header.size();
+
+	if (config.IsAudioEnabled) {
+		m_AudioBlockAlign = config.AudioChannels * config.AudioBitsPerSample / 8;
+		m_AudioFile.open(m_AudioPath, std::ios::binary | std::ios::trunc);
+		if (!m_AudioFile) {
+			return false;
+		}
+		//The header is written again with the real sizes when the recording is finalized.
+		WriteWavHeader(0);
+	}
+	m_IsConfigured = true;
+	return m_VideoFile.good() && (!config.IsAudioEnabled || m_AudioFile.good());
+}
+
+bool RawEncoderBackend::EncodeVideo(const ENCODER_VIDEO_FRAME &frame)
+{
+	if (!m_IsConfigured || m_IsFinalized || !frame.Data) {
+		return false;
+	}
+	m_Stats.EncodedFrameCount++;
+	int64_t firstSlot = ToFrameSlot(frame.StartPos);
+	int64_t endSlot = ToFrameSlot(frame.StartPos + frame.Duration);
+	//The first frame also covers the start of the timeline, so there is no gap to fill before it.
+	if (m_HasFrame && firstSlot > m_NextFrameSlot) {
+		int64_t gap = firstSlot - m_NextFrameSlot;
+		if (!WriteFrames(gap)) {
+			return false;
+		}
+		m_Stats.RepeatedFrameCount += gap;
+	}
+	//A frame shorter than the frame interval gets at least one slot, unless a previous frame already took it.
+	endSlot = (std::max)(endSlot, firstSlot + 1);
+	int64_t count = endSlot - m_NextFrameSlot;
+	if (count <= 0) {
+		m_Stats.DroppedFrameCount++;
+		return true;
+	}
+	if (!m_Converter.Convert(frame.Data, frame.Stride, m_Config.Width, m_Config.Height, m_FrameImage)) {
+		return false;
+	}
+	m_HasFrame = true;
+	if (!WriteFrames(count)) {
+		return false;
+	}
+	m_Stats.RepeatedFrameCount += count - 1;
+	return true;
+}
+
+bool RawEncoderBackend::EncodeAudio(int64_t startPos, int64_t /*duration*/, const AudioBufferRef &audio)
+{
+	if (!m_IsConfigured || m_IsFinalized) {
+		return false;
+	}
+	if (!m_Config.IsAudioEnabled || !audio) {
+		return true;
+	}
+	size_t size = audio.GetSize() - audio.GetSize() % m_AudioBlockAlign;
+	size_t offset = 0;
+	int64_t startFrame = ToAudioFrame(startPos);
+	int64_t drift = startFrame - static_cast<int64_t>(m_AudioFramesWritten);
+	int64_t tolerance = static_cast<int64_t>(m_Config.AudioSampleRate) * AUDIO_SYNC_TOLERANCE_MILLIS / 1000;
+	if (drift > tolerance) {
+		uint64_t padding = static_cast<uint64_t>(drift) * m_AudioBlockAlign;
+		if (!WriteSilence(padding)) {
+			return false;
+		}
+		m_Stats.PaddedAudioBytes += padding;
+	}
+	else if (drift < -tolerance) {
+		offset = (std::min)(static_cast<size_t>(-drift) * m_AudioBlockAlign, size);
+		m_Stats.TrimmedAudioBytes += offset;
+	}
+	if (audio->IsSilent()) {
+		if (!WriteSilence(size - offset)) {
+			return false;
+		}
+	}
+	else {
+		m_AudioFile.write(reinterpret_cast<const char *>(audio->GetData() + offset), size - offset);
+		m_AudioFramesWritten += (size - offset) / m_AudioBlockAlign;
+		m_Stats.AudioBytes += size - offset;
+	}
+	return m_AudioFile.good();
+}
+
+bool RawEncoderBackend::Finalize()
+{
+	if (!m_IsConfigured || m_IsFinalized) {
+		return false;
+	}
+	m_IsFinalized = true;
+	bool isSuccess = m_VideoFile.good();
+	m_VideoFile.close();
+	if (m_AudioFile.is_open()) {
+		isSuccess = isSuccess && m_AudioFile.good();
+		m_AudioFile.seekp(0);
+		WriteWavHeader(m_Stats.AudioBytes);
+		isSuccess = isSuccess && m_AudioFile.good();
+		m_AudioFile.close();
+	}
+	return isSuccess;
+}
+
+uint64_t RawEncoderBackend::GetOutputSize() const
+{
+	return m_VideoBytes + (m_Config.IsAudioEnabled ? WAV_HEADER_BYTES + m_Stats.AudioBytes : 0);
+}
+
+int64_t RawEncoderBackend::ToFrameSlot(int64_t pos) const
+{
+	return RoundedScale(pos, m_Config.FrameRate, HundredNanosPerSecond);
+}
+
+int64_t RawEncoderBackend::ToAudioFrame(int64_t pos) const
+{
+	return RoundedScale(pos, m_Config.AudioSampleRate, HundredNanosPerSecond);
+}
+
+bool RawEncoderBackend::WriteFrames(int64_t count)
+{
+	static const char FrameHeader[] = "FRAME\n";
+	for (int64_t i = 0; i < count; i++) {
+		m_VideoFile.write(FrameHeader, sizeof(FrameHeader) - 1);
+		m_VideoFile.write(reinterpret_cast<const char *>(m_Frame.data()), m_Frame.size());
+		m_Stats.WrittenFrameCount++;
+		m_VideoBytes += sizeof(FrameHeader) - 1 + m_Frame.size();
+	}
+	m_NextFrameSlot += count;
+	return m_VideoFile.good();
+}
+
+bool RawEncoderBackend::WriteSilence(uint64_t bytes)
+{
+	static const char Zeros[4096] = {};
+	m_AudioFramesWritten += bytes / m_AudioBlockAlign;
+	m_Stats.AudioBytes += bytes;
+	while (bytes > 0) {
+		size_t chunk = static_cast<size_t>((std::min)(bytes, static_cast<uint64_t>(sizeof(Zeros))));
+		m_AudioFile.write(Zeros, chunk);
+		bytes -= chunk;
+	}
+	return m_AudioFile.good();
+}
+
+void RawEncoderBackend::WriteWavHeader(uint64_t dataBytes)
+{
+	//RIFF sizes are 32-bit. Readers treat the maximum as "until the end of the file" for longer recordings.
+	uint32_t dataSize = static_cast<uint32_t>((std::min)(dataBytes, static_cast<uint64_t>(UINT32_MAX - WAV_HEADER_BYTES)));
+	uint8_t header[WAV_HEADER_BYTES]{};
+	memcpy(header, "RIFF", 4);
+	PutUInt32(header + 4, static_cast<uint32_t>(dataSize + WAV_HEADER_BYTES - 8));
+	memcpy(header + 8, "WAVEfmt ", 8);
+	PutUInt32(header + 16, 16);
+	PutUInt16(header + 20, WaveFormatPcm);
+	PutUInt16(header + 22, static_cast<uint16_t>(m_Config.AudioChannels));
+	PutUInt32(header + 24, m_Config.AudioSampleRate);
+	PutUInt32(header + 28, m_Config.AudioSampleRate * m_AudioBlockAlign);
+	PutUInt16(header + 32, static_cast<uint16_t>(m_AudioBlockAlign));
+	PutUInt16(header + 34, static_cast<uint16_t>(m_Config.AudioBitsPerSample));
+	memcpy(header + 36, "data", 4);
+	PutUInt32(header + 40, dataSize);
+	m_AudioFile.write(reinterpret_cast<const char *>(header), sizeof(header));
+}
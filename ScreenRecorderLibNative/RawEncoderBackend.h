@@ -0,0 +1,81 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+#include "EncoderBackend.h"
+#include "ColorConverter.h"
+
+struct RAW_ENCODER_STATS
+{
+	//The number of frames passed to EncodeVideo.
+	uint64_t EncodedFrameCount = 0;
+	//The number of frames written to the video file, including repeats.
+	uint64_t WrittenFrameCount = 0;
+	//The number of times a frame was written again to fill a gap in the timeline.
+	uint64_t RepeatedFrameCount = 0;
+	//The number of frames that were not written because they fell within the frame interval of a previous frame.
+	uint64_t DroppedFrameCount = 0;
+	//The number of audio bytes written, including padding.
+	uint64_t AudioBytes = 0;
+	//The number of bytes of silence inserted to fill gaps in the audio, and of audio skipped because it overlapped audio already written.
+	uint64_t PaddedAudioBytes = 0;
+	uint64_t TrimmedAudioBytes = 0;
+};
+
+/// <summary>
+/// Software encoder backend that writes uncompressed video to a YUV4MPEG2 (.y4m) file and PCM audio to a .wav file next to it.
+/// Y4M has a constant frame rate, so frames are placed on the frame grid by their timestamps: gaps are filled by repeating the previous frame, and frames landing on a slot that is already written are dropped.
+/// Audio is kept in sync with the timestamps the same way, by inserting silence or skipping overlapping audio.
+/// The output can be compared byte for byte and is read by most tools, which makes it suited for testing the recording pipeline without a hardware encoder.
+/// </summary>
+class RawEncoderBackend : public EncoderBackend
+{
+public:
+	/// <param name="videoPath">The path of the video file. The audio is written to the same path with the extension .wav.</param>
+	explicit RawEncoderBackend(const std::filesystem::path &videoPath);
+	~RawEncoderBackend() override;
+
+	bool Configure(const ENCODER_BACKEND_CONFIG &config) override;
+	bool EncodeVideo(const ENCODER_VIDEO_FRAME &frame) override;
+	bool EncodeAudio(int64_t startPos, int64_t duration, const AudioBufferRef &audio) override;
+	bool Finalize() override;
+	uint64_t GetOutputSize() const override;
+
+	inline const std::filesystem::path &GetVideoPath() const { return m_VideoPath; }
+	inline const std::filesystem::path &GetAudioPath() const { return m_AudioPath; }
+	inline RAW_ENCODER_STATS GetStats() const { return m_Stats; }
+
+private:
+	//Audio that starts within this many milliseconds of where it is expected is written as is, so rounding in the timestamps does not insert or skip samples.
+	static constexpr uint32_t AUDIO_SYNC_TOLERANCE_MILLIS = 1;
+	static constexpr size_t WAV_HEADER_BYTES = 44;
+
+	std::filesystem::path m_VideoPath;
+	std::filesystem::path m_AudioPath;
+	std::ofstream m_VideoFile;
+	std::ofstream m_AudioFile;
+	ENCODER_BACKEND_CONFIG m_Config;
+	ColorConverter m_Converter;
+	//The last frame in I420, which is written again to fill gaps.
+	std::vector<uint8_t> m_Frame;
+	YUV_IMAGE m_FrameImage;
+	bool m_HasFrame;
+	//The slot on the frame grid the next frame is written to.
+	int64_t m_NextFrameSlot;
+	//The number of audio frames, i.e. samples per channel, written.
+	uint64_t m_AudioFramesWritten;
+	uint32_t m_AudioBlockAlign;
+	//The number of bytes written to the video file.
+	uint64_t m_VideoBytes;
+	bool m_IsConfigured;
+	bool m_IsFinalized;
+	RAW_ENCODER_STATS m_Stats;
+
+	int64_t ToFrameSlot(int64_t pos) const;
+	int64_t ToAudioFrame(int64_t pos) const;
+	bool WriteFrames(int64_t count);
+	bool WriteSilence(uint64_t bytes);
+	void WriteWavHeader(uint64_t dataBytes);
+};
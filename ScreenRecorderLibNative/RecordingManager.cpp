@@ -15,6 +15,7 @@
 #include "Screengrab.h"
 #include "DynamicWait.h"
 #include "HighresTimer.h"
+#include "FramePipeline.h"
 #include "AudioPrefs.h"
 
 #pragma comment(lib, "dxguid.lib")
@@ -74,6 +75,8 @@ RecordingManager::RecordingManager() :
 	RecordingSnapshotCreatedCallback(nullptr),
 	RecordingStatusChangedCallback(nullptr),
 	RecordingFrameNumberChangedCallback(nullptr),
+	RecordingAudioLevelsChangedCallback(nullptr),
+	RecordingFragmentWrittenCallback(nullptr),
 	m_TextureManager(nullptr),
 	m_OutputManager(nullptr),
 	m_EncoderOptions(new H264_ENCODER_OPTIONS()),
@@ -133,7 +136,7 @@ HRESULT RecordingManager::ConfigureOutputDir(_In_ std::wstring path) {
 	auto recorderMode = GetOutputOptions()->GetRecorderMode();
 	if (!path.empty()) {
 		wstring dir = path;
-		if (recorderMode == RecorderModeInternal::Slideshow) {
+		if (recorderMode == RecorderModeInternal::Slideshow || recorderMode == RecorderModeInternal::ReplayBuffer) {
 			if (!dir.empty() && dir.back() != '\\')
 				dir += '\\';
 		}
@@ -239,12 +242,19 @@ HRESULT RecordingManager::BeginRecording(_In_opt_ std::wstring path, _In_opt_ IS
 		m_TextureManager->Initialize(m_DxResources.Context, m_DxResources.Device);
 		m_OutputManager = make_unique<OutputManager>();
 		m_OutputManager->Initialize(m_DxResources.Context, m_DxResources.Device, GetEncoderOptions(), GetAudioOptions(), GetSnapshotOptions(), GetOutputOptions());
+		m_OutputManager->SetFragmentWrittenCallback([this](std::wstring path, const FMP4_FRAGMENT_INFO &fragment) {
+			if (RecordingFragmentWrittenCallback != nullptr && !m_IsDestructing) {
+				RecordingFragmentWrittenCallback(path, fragment);
+			}
+		});
 
 		result = StartRecorderLoop(m_RecordingSources, m_Overlays, stream);
 		if (RecordingStatusChangedCallback != nullptr && !m_IsDestructing) {
 			RecordingStatusChangedCallback(STATUS_FINALIZING);
 		}
 		result.FinalizeResult = m_OutputManager->FinalizeRecording();
+		//The recording and its output have released all frames now, so pooled textures still in use are leaked.
+		m_TextureManager->ReportLeakedTextures();
 		CoUninitialize();
 
 		LOG_INFO("Exiting recording task");
@@ -304,6 +314,28 @@ void RecordingManager::ResumeRecording() {
 	}
 }
 
+HRESULT RecordingManager::SaveReplay(_In_opt_ std::wstring path) {
+	if (!m_IsRecording || !m_OutputManager) {
+		LOG_WARN("Failed to save replay, no recording is in progress");
+		return MF_E_NOT_INITIALIZED;
+	}
+	if (path.empty()) {
+		if (m_OutputFolder.empty()) {
+			LOG_ERROR("Failed to save replay, no output path was given and the recording has no output folder");
+			return E_INVALIDARG;
+		}
+		path = m_OutputFolder + L"\\" + s2ws(CurrentTimeToFormattedString()) + m_EncoderOptions->GetVideoExtension();
+	}
+	return m_OutputManager->SaveReplay(path);
+}
+HRESULT RecordingManager::SaveReplay(_In_ IStream *stream) {
+	if (!m_IsRecording || !m_OutputManager) {
+		LOG_WARN("Failed to save replay, no recording is in progress");
+		return MF_E_NOT_INITIALIZED;
+	}
+	return m_OutputManager->SaveReplay(stream);
+}
+
 bool RecordingManager::SetExcludeFromCapture(HWND hwnd, bool isExcluded) {
 	// The API call causes ugly black window on older builds of Windows, so skip if the contract is down-level. 
 	if (winrt::Windows::Foundation::Metadata::ApiInformation::IsApiContractPresent(L"Windows.Foundation.UniversalApiContract", 9))
@@ -355,9 +387,10 @@ void RecordingManager::SetRecordingCompleteStatus(_In_ REC_RESULT result, nlohma
 	}
 	else {
 		if (RecordingFailedCallback) {
-			if (FAILED(m_EncoderResult)) {
-				_com_error encoderFailure(m_EncoderResult);
-				errMsg = string_format(L"Write error (0x%lx) in video encoder: %s", m_EncoderResult, encoderFailure.ErrorMessage());
+			HRESULT encoderResult = m_EncoderResult;
+			if (FAILED(encoderResult)) {
+				_com_error encoderFailure(encoderResult);
+				errMsg = string_format(L"Write error (0x%lx) in video encoder: %s", encoderResult, encoderFailure.ErrorMessage());
 				if (GetEncoderOptions()->GetIsHardwareEncodingEnabled()) {
 					errMsg += L" If the problem persists, disabling hardware encoding may improve stability.";
 				}
@@ -397,7 +430,15 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 	}
 	CloseHandleOnExit closeExpectedErrorEvent(ErrorEvent);
 
-	RETURN_RESULT_ON_BAD_HR(hr = pCapture->StartCapture(sources, overlays, ErrorEvent), L"Failed to start capture");
+	// Event for when a thread has written a new frame, to wake the recorder loop
+	HANDLE FrameUpdatedEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	if (nullptr == FrameUpdatedEvent) {
+		LOG_ERROR(L"CreateEvent failed: last error is %u", GetLastError());
+		return CAPTURE_RESULT(E_FAIL, L"Failed to create event");
+	}
+	CloseHandleOnExit closeFrameUpdatedEvent(FrameUpdatedEvent);
+
+	RETURN_RESULT_ON_BAD_HR(hr = pCapture->StartCapture(sources, overlays, ErrorEvent, FrameUpdatedEvent), L"Failed to start capture");
 
 	CaptureStopOnExit stopCaptureOnExit(pCapture.get());
 
@@ -416,17 +457,16 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 	RETURN_RESULT_ON_BAD_HR(hr = pMouseManager->Initialize(m_DxResources.Context, m_DxResources.Device, GetMouseOptions()), L"Failed to initialize mouse manager");
 	SetViewPort(m_DxResources.Context, static_cast<float>(videoOutputFrameSize.cx), static_cast<float>(videoOutputFrameSize.cy));
 
-	if (recorderMode == RecorderModeInternal::Video) {
+	if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::ReplayBuffer) {
 		hr = pAudioManager->Initialize(GetAudioOptions());
 		if (FAILED(hr)) {
 			LOG_ERROR(L"Audio capture failed to start: hr = 0x%08x", hr);
 		}
 	}
 
-	std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
 	std::chrono::steady_clock::time_point previousSnapshotTaken = (std::chrono::steady_clock::time_point::min)();
 	INT64 videoFrameDurationMillis = 0;
-	if (recorderMode == RecorderModeInternal::Video) {
+	if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::ReplayBuffer) {
 		videoFrameDurationMillis = 1000 / GetEncoderOptions()->GetVideoFps();
 	}
 	else if (recorderMode == RecorderModeInternal::Slideshow) {
@@ -434,9 +474,100 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 	}
 	INT64 videoFrameDuration100Nanos = MillisToHundredNanos(videoFrameDurationMillis);
 
+	//The loop sleeps until the next frame is due, or until a capture thread writes a new frame, instead of polling.
+	//With a fixed framerate, frames are timed on a grid of whole frame durations, so they are evenly spaced in the output.
+	HighresFrameWaiter frameWaiter(FrameUpdatedEvent);
+	FramePacer framePacer(&frameWaiter, videoFrameDuration100Nanos, GetEncoderOptions()->GetIsFixedFramerate());
+
+	//Frames are encoded on a separate thread, so a slow encoder or disk write does not delay the next capture.
+	//The device is multithread protected, so the encoder thread can use the device context concurrently with capture.
+	EncodeQueue<FrameWriteModel> encodeQueue(GetEncoderOptions()->GetEncodeQueueDepth(), GetEncoderOptions()->GetEncodeQueueDropPolicy(),
+		[&](FrameWriteModel &model) {
+			HRESULT renderResult = m_OutputManager->RenderFrame(model);
+			m_EncoderResult = renderResult;
+			return SUCCEEDED(renderResult);
+		},
+		&OutputManager::MergeDroppedFrame);
+
+	//With a fixed framerate, frames where nothing changed can repeat the rendered frame before them, instead of copying and rendering it again.
+	bool isCfrRepeatSupported = GetEncoderOptions()->GetIsFixedFramerate() && (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::ReplayBuffer);
+	CfrRepeatMode cfrRepeatMode = isCfrRepeatSupported ? GetEncoderOptions()->GetCfrRepeatMode() : CfrRepeatMode::Encode;
+	CfrTimeline<CComPtr<ID3D11Texture2D>> cfrTimeline(cfrRepeatMode, isCfrRepeatSupported ? videoFrameDuration100Nanos : 0, m_MaxFrameLength100Nanos,
+		[&](const CComPtr<ID3D11Texture2D> &pFrame, INT64 startPos100Nanos, INT64 duration100Nanos) {
+			FrameWriteModel model{};
+			model.Frame = pFrame;
+			model.Duration = duration100Nanos;
+			model.StartPos = startPos100Nanos;
+			model.Audio = pAudioManager->GrabAudioFrame(model.StartPos + model.Duration);
+			return encodeQueue.Push(std::move(model));
+		});
+
+	//A frame on its way from the recorder loop to the encoder. Repeats of the frame before have no texture.
+	struct PIPELINE_FRAME
+	{
+		CComPtr<ID3D11Texture2D> Frame;
+		INT64 Duration100Nanos;
+		UINT32 SourceUpdateCount;
+		RECT InputFrameRect;
+		bool IsSnapshotDue;
+		bool IsRepeat;
+	};
+	//The recorder loop captures, composes and draws the mouse pointer, and hands each frame to the pipeline. Cropping, resizing and snapshots run on the transform stage, and the timeline on the write stage,
+	//so they work on one frame while the loop composes the next. The write stage hands the frames to the encode queue, which is the last stage.
+	//The device is multithread protected, and the stages hold its lock while drawing, so the draw calls of different stages are not interleaved.
+	//Set by the stage that fails, and read on the recorder loop once the pipeline reports the failure.
+	std::atomic<HRESULT> pipelineResult{ S_OK };
+	FramePipeline<PIPELINE_FRAME> framePipeline(FRAME_PIPELINE_DEPTH);
+	framePipeline.AddStage("Transform", [&](PIPELINE_FRAME &frame) {
+		if (frame.IsRepeat) {
+			return true;
+		}
+		HRESULT transformHr;
+		CComPtr<ID3D11Texture2D> pProcessedTexture;
+		{
+			CComPtr<ID3D10Multithread> pMultithread;
+			if (SUCCEEDED(m_DxResources.Context->QueryInterface(IID_PPV_ARGS(&pMultithread)))) {
+				pMultithread->Enter();
+			}
+			LeaveMultithreadOnExit leaveMultithread(pMultithread);
+			transformHr = ProcessTextureTransforms(frame.Frame, &pProcessedTexture, frame.InputFrameRect, videoOutputFrameSize);
+		}
+		if (FAILED(transformHr)) {
+			pipelineResult = transformHr;
+			return false;
+		}
+		if (transformHr == S_OK) {
+			frame.Frame = pProcessedTexture;
+		}
+		if (frame.IsSnapshotDue) {
+			HRESULT snapshotHr = SaveTextureAsVideoSnapshot(frame.Frame, frame.InputFrameRect);
+			if (FAILED(snapshotHr)) {
+				_com_error err(snapshotHr);
+				LOG_ERROR("Error saving video snapshot: %ls", err.ErrorMessage());
+			}
+		}
+		return true;
+	});
+	framePipeline.AddStage("Write", [&](PIPELINE_FRAME &frame) {
+		bool isWritten = frame.IsRepeat ? cfrTimeline.RepeatFrame(frame.Duration100Nanos) : cfrTimeline.AddFrame(frame.Frame, frame.Duration100Nanos, frame.SourceUpdateCount);
+		if (!isWritten) {
+			HRESULT encoderResult = m_EncoderResult;
+			pipelineResult = FAILED(encoderResult) ? encoderResult : E_ABORT;
+		}
+		return isWritten;
+	});
+	framePipeline.Start();
+
 	int frameNr = 0;
-	INT64 lastFrameStartPos100Nanos = 0;
 	bool havePrematureFrame = false;
+	//The number of source updates captured since the last frame was rendered.
+	UINT32 sourceUpdateCount = 0;
+	//What the last rendered frame was drawn with, to tell whether it can be repeated.
+	RECT renderedSourceRect = GetOutputOptions()->GetSourceRectangle();
+	PTR_INFO renderedPtrInfo{};
+	bool isMouseClickRendered = false;
+	//Whether a frame was handed to the pipeline, which later frames can repeat. The timeline of the write stage holds the frame itself.
+	bool hasRenderedFrame = false;
 	cancellation_token token = m_TaskWrapperImpl->m_RecordTaskCts.get_token();
 	INT64 minimumTimeForDelay100Nanons = 5000;//0.5ms
 	INT64 maxFrameLengthMillis = HundredNanosToMillis(m_MaxFrameLength100Nanos);
@@ -452,11 +583,11 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 
 	auto ShouldSkipDelay([&](CAPTURED_FRAME capturedFrame)
 	{
-		if (m_OutputManager->GetRenderedFrameCount() == 0) {
+		if (frameNr == 0) {
 			return true;
 		}
 
-		if (recorderMode == RecorderModeInternal::Video)
+		if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::ReplayBuffer)
 		{
 			if (!GetEncoderOptions()->GetIsFixedFramerate()
 				&& (GetMouseOptions()->IsMousePointerEnabled() && capturedFrame.PtrInfo && capturedFrame.PtrInfo->IsPointerShapeUpdated)//and never delay when pointer changes if we draw pointer
@@ -467,12 +598,54 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 		}
 		return false;
 	});
+	auto IsRenderedFrameUnchanged([&]()
+	{
+		RECT sourceRect = GetOutputOptions()->GetSourceRectangle();
+		if (!EqualRect(&sourceRect, &renderedSourceRect) || isMouseClickRendered || pMouseManager->IsDrawingMouseClick()) {
+			return false;
+		}
+		if (GetSnapshotOptions()->IsSnapshotWithVideoEnabled() && IsTimeToTakeSnapshot()) {
+			return false;
+		}
+		if (pPtrInfo && GetMouseOptions()->IsMousePointerEnabled()) {
+			if (pPtrInfo->IsPointerShapeUpdated
+				|| pPtrInfo->LastTimeStamp.QuadPart != renderedPtrInfo.LastTimeStamp.QuadPart
+				|| pPtrInfo->Position.x != renderedPtrInfo.Position.x
+				|| pPtrInfo->Position.y != renderedPtrInfo.Position.y
+				|| pPtrInfo->Visible != renderedPtrInfo.Visible) {
+				return false;
+			}
+		}
+		return true;
+	});
+	auto OnFrameRecorded([&]() {
+		frameNr++;
+		if (RecordingFrameNumberChangedCallback != nullptr && !m_IsDestructing) {
+			RecordingFrameNumberChangedCallback(frameNr);
+		}
+		AUDIO_LEVELS_REPORT audioLevels;
+		if (RecordingAudioLevelsChangedCallback != nullptr && !m_IsDestructing && pAudioManager->GetAudioLevels(&audioLevels)) {
+			RecordingAudioLevelsChangedCallback(audioLevels);
+		}
+	});
 	auto PrepareAndRenderFrame([&](CComPtr<ID3D11Texture2D> pTextureToRender, INT64 duration100Nanos)->HRESULT {
-		HRESULT renderHr = E_FAIL;
+		HRESULT renderHr = S_OK;
+		//Textures leased for the frames before are back in the pool by now, unless the pipeline, the encoder or the timeline still holds them.
+		m_TextureManager->NextFrame();
+		renderedSourceRect = GetOutputOptions()->GetSourceRectangle();
+		isMouseClickRendered = pMouseManager->IsDrawingMouseClick();
 		if (pPtrInfo) {
-			renderHr = pMouseManager->ProcessMousePointer(pTextureToRender, pPtrInfo);
-			if (FAILED(renderHr)) {
-				_com_error err(renderHr);
+			renderedPtrInfo.LastTimeStamp = pPtrInfo->LastTimeStamp;
+			renderedPtrInfo.Position = pPtrInfo->Position;
+			renderedPtrInfo.Visible = pPtrInfo->Visible;
+			CComPtr<ID3D10Multithread> pMultithread;
+			if (SUCCEEDED(m_DxResources.Context->QueryInterface(IID_PPV_ARGS(&pMultithread)))) {
+				pMultithread->Enter();
+			}
+			LeaveMultithreadOnExit leaveMultithread(pMultithread);
+			HRESULT mouseHr = pMouseManager->ProcessMousePointer(pTextureToRender, pPtrInfo);
+			if (FAILED(mouseHr)) {
+				_com_error err(mouseHr);
 				LOG_ERROR(L"Error drawing mouse pointer: %s", err.ErrorMessage());
 				//We just log the error and continue if the mouse pointer failed to draw. If there is an error with DXGI, it will be handled on the next call to AcquireNextFrame.
 			}
@@ -480,40 +653,36 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 		if (IsValidRect(GetOutputOptions()->GetSourceRectangle())) {
 			RETURN_ON_BAD_HR(hr = InitializeRects(pCapture->GetOutputSize(), &videoInputFrameRect, nullptr));
 		}
-		CComPtr<ID3D11Texture2D> processedTexture;
-		RETURN_ON_BAD_HR(renderHr = ProcessTextureTransforms(pTextureToRender, &processedTexture, videoInputFrameRect, videoOutputFrameSize));
-		if (renderHr == S_OK) {
-			pTextureToRender.Release();
-			pTextureToRender.Attach(processedTexture);
-			(*pTextureToRender).AddRef();
-		}
-		if (recorderMode == RecorderModeInternal::Video) {
-			if (GetSnapshotOptions()->IsSnapshotWithVideoEnabled() && IsTimeToTakeSnapshot()) {
-				if (SUCCEEDED(renderHr = SaveTextureAsVideoSnapshot(pTextureToRender, videoInputFrameRect))) {
-					previousSnapshotTaken = steady_clock::now();
-				}
-				else {
-					_com_error err(renderHr);
-					LOG_ERROR("Error saving video snapshot: %ls", err.ErrorMessage());
-				}
-			}
+		PIPELINE_FRAME frame{};
+		frame.Frame = pTextureToRender;
+		frame.Duration100Nanos = duration100Nanos;
+		frame.SourceUpdateCount = sourceUpdateCount;
+		frame.InputFrameRect = videoInputFrameRect;
+		frame.IsSnapshotDue = recorderMode == RecorderModeInternal::Video && GetSnapshotOptions()->IsSnapshotWithVideoEnabled() && IsTimeToTakeSnapshot();
+		if (frame.IsSnapshotDue) {
+			previousSnapshotTaken = steady_clock::now();
 		}
-
-
-		FrameWriteModel model{};
-		model.Frame = pTextureToRender;
-		model.Duration = duration100Nanos;
-		model.StartPos = lastFrameStartPos100Nanos;
-		model.Audio = pAudioManager->GrabAudioFrame();
-		RETURN_ON_BAD_HR(renderHr = m_EncoderResult = m_OutputManager->RenderFrame(model));
-		frameNr++;
-		if (RecordingFrameNumberChangedCallback != nullptr && !m_IsDestructing) {
-			RecordingFrameNumberChangedCallback(frameNr);
+		if (!framePipeline.Push(std::move(frame))) {
+			HRESULT failedHr = pipelineResult;
+			RETURN_ON_BAD_HR(renderHr = FAILED(failedHr) ? failedHr : E_ABORT);
 		}
+		hasRenderedFrame = true;
+		OnFrameRecorded();
 		havePrematureFrame = false;
-		lastFrameStartPos100Nanos += duration100Nanos;
+		sourceUpdateCount = 0;
 		return renderHr;
 	});
+	auto RepeatRenderedFrame([&](INT64 duration100Nanos)->HRESULT {
+		PIPELINE_FRAME frame{};
+		frame.Duration100Nanos = duration100Nanos;
+		frame.IsRepeat = true;
+		if (!framePipeline.Push(std::move(frame))) {
+			HRESULT failedHr = pipelineResult;
+			return FAILED(failedHr) ? failedHr : E_ABORT;
+		}
+		OnFrameRecorded();
+		return S_OK;
+	});
 
 	while (true)
 	{
@@ -545,6 +714,11 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 							pPreviousFrameCopy.Release();
 						}
 
+						//Frames already in the pipeline, held by the timeline or queued for the encoder were captured on the stale device, so they are written before the output manager is reinitialized.
+						framePipeline.Drain();
+						cfrTimeline.Flush();
+						hasRenderedFrame = false;
+						encodeQueue.Drain();
 						//Reinitialize and restart capture
 						hr = pCapture->StopCapture();
 						if (SUCCEEDED(hr)) {
@@ -572,7 +746,7 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 						}
 						if (SUCCEEDED(hr)) {
 							ResetEvent(ErrorEvent);
-							hr = pCapture->StartCapture(sources, overlays, ErrorEvent);
+							hr = pCapture->StartCapture(sources, overlays, ErrorEvent, FrameUpdatedEvent);
 						}
 
 						if (FAILED(hr)) {
@@ -599,7 +773,7 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 		if (m_IsPaused) {
 			wait(10);
 			previousSnapshotTaken = steady_clock::now();
-			lastFrame = steady_clock::now();
+			framePacer.Start();
 			if (pAudioManager)
 				pAudioManager->ClearRecordedBytes();
 			continue;
@@ -615,20 +789,23 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 			if (capturedFrame.PtrInfo) {
 				pPtrInfo = capturedFrame.PtrInfo;
 			}
+			sourceUpdateCount += capturedFrame.FrameUpdateCount + capturedFrame.OverlayUpdateCount;
 		}
 
-		INT64 durationSinceLastFrame100Nanos = max(duration_cast<nanoseconds>(chrono::steady_clock::now() - lastFrame).count() / 100, 0);
+		INT64 durationSinceLastFrame100Nanos = framePacer.GetTimeSinceLastFrame();
 
 		if ((recorderMode == RecorderModeInternal::Slideshow
 			|| recorderMode == RecorderModeInternal::Screenshot)
 		   && (!pCapture->IsInitialFrameWriteComplete() || !pCapture->IsInitialOverlayWriteComplete())
 		   && durationSinceLastFrame100Nanos < max(videoFrameDuration100Nanos, m_MaxFrameLength100Nanos)) {
+			//Waits for every source and overlay to write its first frame.
+			framePacer.WaitFor(max(videoFrameDuration100Nanos, m_MaxFrameLength100Nanos) - durationSinceLastFrame100Nanos);
 			continue;
 		}
 		else if (((!pCurrentFrameCopy && !pPreviousFrameCopy) || !pCapture->IsInitialFrameWriteComplete())
 			&& durationSinceLastFrame100Nanos < max(videoFrameDuration100Nanos, m_MaxFrameLength100Nanos)) {
-			//There is no first frame yet, so retry.
-			wait(1);
+			//There is no first frame yet, so retry when one is written.
+			framePacer.WaitFor(max(videoFrameDuration100Nanos, m_MaxFrameLength100Nanos) - durationSinceLastFrame100Nanos);
 			continue;
 		}
 		else if (durationSinceLastFrame100Nanos < videoFrameDuration100Nanos) {
@@ -663,22 +840,17 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 					if (pPreviousFrameCopy == nullptr) {
 						D3D11_TEXTURE2D_DESC desc;
 						pCurrentFrameCopy->GetDesc(&desc);
-						RETURN_RESULT_ON_BAD_HR(hr = m_DxResources.Device->CreateTexture2D(&desc, nullptr, &pPreviousFrameCopy), L"Failed to create texture");
+						RETURN_RESULT_ON_BAD_HR(hr = m_TextureManager->AcquireTexture(desc, &pPreviousFrameCopy), L"Failed to create texture");
 					}
 					m_DxResources.Context->CopyResource(pPreviousFrameCopy, pCurrentFrameCopy);
 					havePrematureFrame = true;
 				}
 
-				if (delay100Nanos > MillisToHundredNanos(1)) {
-					//We recommend that you use Flush when the CPU waits for an arbitrary amount of time(such as when you call the Sleep function).
-					//https://docs.microsoft.com/en-us/windows/win32/api/d3d11/nf-d3d11-id3d11devicecontext-flush
-					m_DxResources.Context->Flush();
-					std::this_thread::yield();
-					Sleep(1);
-				}
-				else {
-					std::this_thread::yield();
-				}
+				//We recommend that you use Flush when the CPU waits for an arbitrary amount of time(such as when you call the Sleep function).
+				//https://docs.microsoft.com/en-us/windows/win32/api/d3d11/nf-d3d11-id3d11devicecontext-flush
+				m_DxResources.Context->Flush();
+				//Wakes at the deadline, or earlier if a new frame is written, so it can be cached.
+				framePacer.WaitFor(delay100Nanos);
 				continue;
 			}
 		}
@@ -691,24 +863,29 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 			m_TextureManager->CreateTexture(videoOutputFrameSize.cx, videoOutputFrameSize.cy, &pCurrentFrameCopy, 0, D3D11_BIND_RENDER_TARGET);
 		}
 
-		lastFrame = steady_clock::now();
+		INT64 frameDuration100Nanos = framePacer.CompleteFrame();
+
+		if (cfrRepeatMode != CfrRepeatMode::Encode && !pCurrentFrameCopy && !havePrematureFrame && hasRenderedFrame && IsRenderedFrameUnchanged()) {
+			RETURN_RESULT_ON_BAD_HR(hr = RepeatRenderedFrame(frameDuration100Nanos), L"Failed to repeat frame");
+			continue;
+		}
 
 		if (pCurrentFrameCopy) {
 			if (pPreviousFrameCopy) {
 				pPreviousFrameCopy.Release();
 			}
 			//Copy new frame to pPreviousFrameCopy
-			if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::Slideshow) {
+			if (recorderMode == RecorderModeInternal::Video || recorderMode == RecorderModeInternal::Slideshow || recorderMode == RecorderModeInternal::ReplayBuffer) {
 				D3D11_TEXTURE2D_DESC desc;
 				pCurrentFrameCopy->GetDesc(&desc);
-				RETURN_RESULT_ON_BAD_HR(hr = m_DxResources.Device->CreateTexture2D(&desc, nullptr, &pPreviousFrameCopy), L"");
+				RETURN_RESULT_ON_BAD_HR(hr = m_TextureManager->AcquireTexture(desc, &pPreviousFrameCopy), L"");
 				m_DxResources.Context->CopyResource(pPreviousFrameCopy, pCurrentFrameCopy);
 			}
 		}
 		else if (pPreviousFrameCopy) {
 			D3D11_TEXTURE2D_DESC desc;
 			pPreviousFrameCopy->GetDesc(&desc);
-			RETURN_RESULT_ON_BAD_HR(hr = m_DxResources.Device->CreateTexture2D(&desc, nullptr, &pCurrentFrameCopy), L"");
+			RETURN_RESULT_ON_BAD_HR(hr = m_TextureManager->AcquireTexture(desc, &pCurrentFrameCopy), L"");
 			m_DxResources.Context->CopyResource(pCurrentFrameCopy, pPreviousFrameCopy);
 		}
 
@@ -723,7 +900,7 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 				LOG_DEBUG("Changed Recording Status to Recording");
 			}
 		}
-		RETURN_RESULT_ON_BAD_HR(hr = PrepareAndRenderFrame(pCurrentFrameCopy, durationSinceLastFrame100Nanos), L"Failed to render frame");
+		RETURN_RESULT_ON_BAD_HR(hr = PrepareAndRenderFrame(pCurrentFrameCopy, frameDuration100Nanos), L"Failed to render frame");
 		if (recorderMode == RecorderModeInternal::Screenshot) {
 			break;
 		}
@@ -731,9 +908,52 @@ REC_RESULT RecordingManager::StartRecorderLoop(_In_ const std::vector<RECORDING_
 
 	//Push any last frame waiting to be recorded to the sink writer.
 	if (pPreviousFrameCopy != nullptr) {
-		INT64 duration = duration_cast<nanoseconds>(chrono::steady_clock::now() - lastFrame).count() / 100;
+		INT64 duration = framePacer.CompleteFrame();
 		RETURN_RESULT_ON_BAD_HR(hr = PrepareAndRenderFrame(pPreviousFrameCopy, duration), L"Failed to render frame");
 	}
+	if (!framePipeline.Close()) {
+		HRESULT failedHr = pipelineResult;
+		RETURN_RESULT_ON_BAD_HR(hr = FAILED(failedHr) ? failedHr : E_ABORT, L"Failed to render frame");
+	}
+	if (!cfrTimeline.Flush()) {
+		HRESULT encoderResult = m_EncoderResult;
+		RETURN_RESULT_ON_BAD_HR(hr = FAILED(encoderResult) ? encoderResult : E_ABORT, L"Failed to render frame");
+	}
+	bool isEncoderSuccessful = encodeQueue.Close();
+	ENCODE_QUEUE_STATS encodeStats = encodeQueue.GetStats();
+	LOG_DEBUG("Encode queue: %llu frames encoded, %llu dropped, %llu pushes blocked for %.2f ms in total. Queue latency avg %.2f ms, max %.2f ms. Encode time avg %.2f ms, max %.2f ms",
+		encodeStats.EncodedCount, encodeStats.DroppedCount, encodeStats.BlockedCount, encodeStats.BlockedMicros / 1000.0,
+		encodeStats.GetAverageQueueLatencyMillis(), encodeStats.MaxQueueLatencyMicros / 1000.0,
+		encodeStats.GetAverageEncodeMillis(), encodeStats.MaxEncodeMicros / 1000.0);
+	for (const FRAME_PIPELINE_STAGE_STATS &stageStats : framePipeline.GetStats()) {
+		LOG_DEBUG("Frame pipeline %hs stage: %llu frames, busy %.1f%% of the time. Processing avg %.2f ms, max %.2f ms. Queue latency avg %.2f ms, max %.2f ms. Queue depth avg %.2f, max %llu. %llu hand-overs blocked for %.2f ms in total",
+			stageStats.Name.c_str(), stageStats.ProcessedCount, stageStats.GetUtilization() * 100, stageStats.GetAverageProcessMillis(), stageStats.MaxProcessMicros / 1000.0,
+			stageStats.GetAverageQueueLatencyMillis(), stageStats.MaxQueueLatencyMicros / 1000.0, stageStats.GetAverageDepth(), (UINT64)stageStats.MaxDepth,
+			stageStats.BlockedCount, stageStats.BlockedMicros / 1000.0);
+	}
+	CFR_TIMELINE_STATS timelineStats = cfrTimeline.GetStats();
+	LOG_DEBUG("Frame timeline: %llu frames written as %llu samples. %llu duplicate frames, %llu written as references and %llu merged into the frame before. %llu source updates dropped",
+		timelineStats.FrameCount, timelineStats.SampleCount, timelineStats.DuplicateCount, timelineStats.ReferencedCount, timelineStats.ElidedCount, timelineStats.DroppedCount);
+	LEASE_POOL_STATS texturePoolStats = m_TextureManager->GetTexturePoolStats();
+	LEASE_POOL_STATS captureTexturePoolStats = pCapture->GetTexturePoolStats();
+	LOG_DEBUG("Texture pool: %llu textures created, %llu reused (%.1f%% reuse rate), %.3f created per frame. %llu trimmed, at most %llu in use. Captured frames: %llu textures created, %llu reused",
+		texturePoolStats.AllocationCount, texturePoolStats.ReuseCount, texturePoolStats.GetReuseRate() * 100, texturePoolStats.GetAllocationsPerFrame(),
+		texturePoolStats.TrimmedCount, texturePoolStats.MaxLeasedCount,
+		captureTexturePoolStats.AllocationCount, captureTexturePoolStats.ReuseCount);
+	std::vector<FRAME_SLOT_EXCHANGE_STATS> frameSlotStats = pCapture->GetFrameSlotStats();
+	for (size_t i = 0; i < frameSlotStats.size(); i++) {
+		const FRAME_SLOT_EXCHANGE_STATS &slotStats = frameSlotStats[i];
+		LOG_DEBUG("Frame slots of source %llu: %llu frames published, %llu taken, %llu overwritten before they were taken (%.1f%%). %llu polls found no new frame. Latency avg %.2f ms, max %.2f ms",
+			(UINT64)i, slotStats.PublishedCount, slotStats.ConsumedCount, slotStats.OverwrittenCount, slotStats.GetOverwriteRate() * 100,
+			slotStats.EmptyAcquireCount, slotStats.GetAverageLatencyMillis(), slotStats.MaxLatencyMicros / 1000.0);
+	}
+	FRAME_PACER_STATS pacerStats = framePacer.GetStats();
+	LOG_DEBUG("Frame pacing: %llu frames, %llu frame intervals missed. Frame lateness avg %.2f ms, max %.2f ms. %llu waits, %llu woken by new frames. Wake lateness avg %.2f ms, max %.2f ms",
+		pacerStats.FrameCount, pacerStats.MissedIntervalCount, pacerStats.GetAverageLatenessMillis(), pacerStats.MaxLateness100Nanos / 10000.0,
+		pacerStats.WaitCount, pacerStats.SignaledWaitCount, pacerStats.GetAverageWakeLatenessMillis(), pacerStats.MaxWakeLateness100Nanos / 10000.0);
+	if (!isEncoderSuccessful) {
+		RETURN_RESULT_ON_BAD_HR(hr = m_EncoderResult, L"Failed to render frame");
+	}
 	return CAPTURE_RESULT(hr);
 }
 
@@ -784,7 +1004,8 @@ HRESULT RecordingManager::ProcessTextureTransforms(_In_ ID3D11Texture2D *pTextur
 		desc.Width = videoOutputFrameSize.cx;
 		desc.Height = videoOutputFrameSize.cy;
 		ID3D11Texture2D *pCanvas;
-		RETURN_ON_BAD_HR(hr = m_DxResources.Device->CreateTexture2D(&desc, nullptr, &pCanvas));
+		//The canvas is cleared, so the margins around the content are black.
+		RETURN_ON_BAD_HR(hr = m_TextureManager->AcquireTexture(desc, &pCanvas, true));
 		int leftMargin = (int)max(0, round(((double)videoOutputFrameSize.cx - (double)RectWidth(contentRect))) / 2);
 		int topMargin = (int)max(0, round(((double)videoOutputFrameSize.cy - (double)RectHeight(contentRect))) / 2);
 
@@ -856,7 +1077,7 @@ HRESULT RecordingManager::SaveTextureAsVideoSnapshot(_In_ ID3D11Texture2D *pText
 		RETURN_ON_BAD_HR(hr = m_TextureManager->CropTexture(pTexture, destRect, &pProcessedTexture));
 	}
 	else {
-		RETURN_ON_BAD_HR(hr = m_DxResources.Device->CreateTexture2D(&frameDesc, nullptr, &pProcessedTexture));
+		RETURN_ON_BAD_HR(hr = m_TextureManager->AcquireTexture(frameDesc, &pProcessedTexture));
 		// Copy the current frame for a separate thread to write it to a file asynchronously.
 		m_DxResources.Context->CopyResource(pProcessedTexture, pTexture);
 	}
@@ -5,11 +5,14 @@
 #include "OutputManager.h"
 #include "Log.h"
 #include "fifo_map.h"
+#include <atomic>
 typedef void(__stdcall *CallbackCompleteFunction)(std::wstring, nlohmann::fifo_map<std::wstring, int>);
 typedef void(__stdcall *CallbackStatusChangedFunction)(int);
 typedef void(__stdcall *CallbackErrorFunction)(std::wstring, std::wstring);
 typedef void(__stdcall *CallbackSnapshotFunction)(std::wstring);
 typedef void(__stdcall *CallbackFrameNumberChangedFunction)(int);
+typedef void(__stdcall *CallbackAudioLevelsChangedFunction)(AUDIO_LEVELS_REPORT);
+typedef void(__stdcall *CallbackFragmentWrittenFunction)(std::wstring, FMP4_FRAGMENT_INFO);
 
 #define STATUS_IDLE 0
 #define STATUS_RECORDING 1
@@ -19,6 +22,9 @@ typedef void(__stdcall *CallbackFrameNumberChangedFunction)(int);
 #define API_DESKTOP_DUPLICATION 0
 #define API_GRAPHICS_CAPTURE 1
 
+//The number of frames queued in front of each stage of the frame pipeline.
+#define FRAME_PIPELINE_DEPTH 2
+
 class RecordingManager
 {
 public:
@@ -29,12 +35,19 @@ public:
 	CallbackStatusChangedFunction RecordingStatusChangedCallback;
 	CallbackSnapshotFunction RecordingSnapshotCreatedCallback;
 	CallbackFrameNumberChangedFunction RecordingFrameNumberChangedCallback;
+	CallbackAudioLevelsChangedFunction RecordingAudioLevelsChangedCallback;
+	CallbackFragmentWrittenFunction RecordingFragmentWrittenCallback;
 	HRESULT BeginRecording(_In_opt_ std::wstring path);
 	HRESULT BeginRecording(_In_opt_ std::wstring path, _In_opt_ IStream *stream);
 	HRESULT BeginRecording(_In_opt_ IStream *stream);
 	void EndRecording();
 	void PauseRecording();
 	void ResumeRecording();
+	/// <summary>
+	/// Saves the contents of the replay buffer while recording in replay buffer mode. With an empty path, the replay is saved with a timestamped name in the folder passed to BeginRecording.
+	/// </summary>
+	HRESULT SaveReplay(_In_opt_ std::wstring path);
+	HRESULT SaveReplay(_In_ IStream *stream);
 
 	bool IsRecording() { return m_IsRecording; }
 
@@ -87,7 +100,8 @@ private:
 
 	std::unique_ptr<TextureManager> m_TextureManager;
 	std::unique_ptr<OutputManager> m_OutputManager;
-	HRESULT m_EncoderResult = E_FAIL;
+	//Written on the encoder thread, and read on the recorder loop and the write stage of the frame pipeline.
+	std::atomic<HRESULT> m_EncoderResult{ E_FAIL };
 	HRESULT m_MfStartupResult = E_FAIL;
 	std::wstring m_OutputFolder = L"";
 	std::wstring m_OutputFullPath = L"";
@@ -0,0 +1,107 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+struct RECYCLING_POOL_STATS
+{
+	//Number of acquires served by an idle object.
+	uint64_t HitCount = 0;
+	//Number of acquires that found no idle object, so the caller had to create one.
+	uint64_t MissCount = 0;
+	//Number of objects returned to the pool.
+	uint64_t RecycledCount = 0;
+	//Number of returned objects that were not kept, because the pool for their key was full.
+	uint64_t DiscardedCount = 0;
+	//Number of idle objects in the pool.
+	uint64_t IdleCount = 0;
+
+	inline double GetHitRate() const { return HitCount + MissCount > 0 ? static_cast<double>(HitCount) / (HitCount + MissCount) : 0; }
+};
+
+/// <summary>
+/// Thread safe pool of idle objects by key, e.g. buffers by size and format. The pool only keeps objects, so creating an object on a miss and deciding when one is returned is up to the caller.
+/// Objects can be acquired on one thread and returned on another.
+/// </summary>
+template <typename TKey, typename T>
+class RecyclingPool
+{
+public:
+	/// <param name="maxIdlePerKey">The number of idle objects kept for each key. Objects returned beyond this are discarded.</param>
+	explicit RecyclingPool(size_t maxIdlePerKey = DEFAULT_MAX_IDLE_PER_KEY) :
+		m_MaxIdlePerKey(maxIdlePerKey),
+		m_Stats{}
+	{
+	}
+
+	/// <summary>
+	/// Takes an idle object for the key out of the pool.
+	/// </summary>
+	/// <returns>false on a miss, in which case object is unchanged and the caller creates a new object</returns>
+	bool TryAcquire(const TKey &key, T &object)
+	{
+		std::scoped_lock lock(m_Mutex);
+		auto idle = m_Idle.find(key);
+		if (idle == m_Idle.end() || idle->second.empty()) {
+			m_Stats.MissCount++;
+			return false;
+		}
+		object = std::move(idle->second.back());
+		idle->second.pop_back();
+		m_Stats.HitCount++;
+		m_Stats.IdleCount--;
+		return true;
+	}
+
+	/// <summary>
+	/// Returns an object to the pool. If the pool for the key is full, the object is destroyed with the argument.
+	/// </summary>
+	/// <returns>true if the object was kept</returns>
+	bool Recycle(const TKey &key, T object)
+	{
+		std::scoped_lock lock(m_Mutex);
+		std::vector<T> &idle = m_Idle[key];
+		if (idle.size() >= m_MaxIdlePerKey) {
+			m_Stats.DiscardedCount++;
+			return false;
+		}
+		if (idle.capacity() < m_MaxIdlePerKey) {
+			idle.reserve(m_MaxIdlePerKey);
+		}
+		idle.push_back(std::move(object));
+		m_Stats.RecycledCount++;
+		m_Stats.IdleCount++;
+		return true;
+	}
+
+	/// <summary>
+	/// Destroys all idle objects.
+	/// </summary>
+	void Clear()
+	{
+		//The objects are destroyed outside the lock, in case destroying one returns another to the pool.
+		std::map<TKey, std::vector<T>> idle;
+		{
+			std::scoped_lock lock(m_Mutex);
+			idle.swap(m_Idle);
+			m_Stats.IdleCount = 0;
+		}
+	}
+
+	RECYCLING_POOL_STATS GetStats()
+	{
+		std::scoped_lock lock(m_Mutex);
+		return m_Stats;
+	}
+
+	static constexpr size_t DEFAULT_MAX_IDLE_PER_KEY = 8;
+
+private:
+	std::mutex m_Mutex;
+	std::map<TKey, std::vector<T>> m_Idle;
+	size_t m_MaxIdlePerKey;
+	RECYCLING_POOL_STATS m_Stats;
+};
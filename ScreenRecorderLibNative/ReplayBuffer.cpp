@@ -0,0 +1,122 @@
+#include "ReplayBuffer.h"
+#include "Log.h"
+#include "util.h"
+#include <mfreadwrite.h>
+#include <Mferror.h>
+
+ReplayBuffer::ReplayBuffer() :
+	m_Packets(nullptr),
+	m_IsAudioEnabled(false)
+{
+}
+
+ReplayBuffer::~ReplayBuffer()
+{
+}
+
+HRESULT ReplayBuffer::Initialize(
+	_In_ IMFMediaType *pVideoMediaTypeIn,
+	_In_ IMFMediaType *pVideoMediaTypeOut,
+	_In_opt_ IMFMediaType *pAudioMediaTypeIn,
+	_In_opt_ IMFMediaType *pAudioMediaTypeOut,
+	_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions,
+	_In_ INT64 maxDuration,
+	_In_ UINT64 maxBytes)
+{
+	if (pEncoderOptions->GetIsHardwareEncodingEnabled()) {
+		LOG_WARN("Hardware encoding is not available with the replay buffer, encoding video on the CPU");
+	}
+	m_Packets = std::make_unique<ReplayPacketRing>(maxDuration, maxBytes, VIDEO_STREAM_INDEX);
+	RETURN_ON_BAD_HR(m_VideoEncoder.Create(pVideoMediaTypeIn, pVideoMediaTypeOut));
+	RETURN_ON_BAD_HR(m_VideoEncoder.ConfigureVideo(pEncoderOptions, pEncoderOptions->GetVideoFps() * KEYFRAME_INTERVAL_SECONDS));
+	RETURN_ON_BAD_HR(m_VideoEncoder.Start([this](ENCODED_PACKET &packet) { return AddPacket(VIDEO_STREAM_INDEX, packet); }));
+
+	m_IsAudioEnabled = pAudioMediaTypeIn && pAudioMediaTypeOut;
+	if (m_IsAudioEnabled) {
+		RETURN_ON_BAD_HR(m_AudioEncoder.Create(pAudioMediaTypeIn, pAudioMediaTypeOut));
+		RETURN_ON_BAD_HR(m_AudioEncoder.Start([this](ENCODED_PACKET &packet) { return AddPacket(AUDIO_STREAM_INDEX, packet); }));
+	}
+	LOG_INFO("Replay buffer keeps the last %lld ms of the recording, using at most %llu bytes", HundredNanosToMillis(maxDuration), maxBytes);
+	return S_OK;
+}
+
+HRESULT ReplayBuffer::WriteSample(_In_ DWORD streamIndex, _In_ IMFSample *pSample)
+{
+	if (!m_Packets) {
+		return MF_E_NOT_INITIALIZED;
+	}
+	if (streamIndex == VIDEO_STREAM_INDEX) {
+		return m_VideoEncoder.Encode(pSample);
+	}
+	else if (streamIndex == AUDIO_STREAM_INDEX && m_IsAudioEnabled) {
+		return m_AudioEncoder.Encode(pSample);
+	}
+	return MF_E_INVALIDSTREAMNUMBER;
+}
+
+HRESULT ReplayBuffer::Save(_In_ IMFByteStream *pOutStream)
+{
+	std::lock_guard<std::mutex> saveLock(m_SaveMutex);
+	if (!m_Packets) {
+		return MF_E_NOT_INITIALIZED;
+	}
+	//The packets are copied out of the ring, so capture and encoding go on while they are written.
+	std::vector<ReplayPacketRing::PACKET> packets = m_Packets->Snapshot();
+	if (packets.empty()) {
+		LOG_WARN("Replay buffer is empty, nothing to save");
+		return S_FALSE;
+	}
+	CComPtr<IMFMediaType> pVideoMediaType = m_VideoEncoder.GetOutputType();
+	CComPtr<IMFMediaType> pAudioMediaType = m_AudioEncoder.GetOutputType();
+
+	CComPtr<IMFMediaSink> pMp4StreamSink = nullptr;
+	RETURN_ON_BAD_HR(MFCreateMPEG4MediaSink(pOutStream, pVideoMediaType, pAudioMediaType, &pMp4StreamSink));
+	CComPtr<IMFAttributes> pAttributes = nullptr;
+	RETURN_ON_BAD_HR(MFCreateAttributes(&pAttributes, 1));
+	RETURN_ON_BAD_HR(pAttributes->SetUINT32(MF_SINK_WRITER_DISABLE_THROTTLING, TRUE));
+	CComPtr<IMFSinkWriter> pSinkWriter = nullptr;
+	RETURN_ON_BAD_HR(MFCreateSinkWriterFromMediaSink(pMp4StreamSink, pAttributes, &pSinkWriter));
+	//The input types are the encoded types, so the sink writer only muxes the packets.
+	RETURN_ON_BAD_HR(pSinkWriter->SetInputMediaType(VIDEO_STREAM_INDEX, pVideoMediaType, nullptr));
+	if (pAudioMediaType) {
+		RETURN_ON_BAD_HR(pSinkWriter->SetInputMediaType(AUDIO_STREAM_INDEX, pAudioMediaType, nullptr));
+	}
+	RETURN_ON_BAD_HR(pSinkWriter->BeginWriting());
+
+	INT64 startPos = packets.front().StartPos;
+	INT64 endPos = startPos;
+	for (ReplayPacketRing::PACKET &packet : packets) {
+		if (packet.StreamIndex == AUDIO_STREAM_INDEX && (!pAudioMediaType || packet.StartPos < startPos)) {
+			continue;
+		}
+		//The buffered samples are shared with other saves, so the packets are written in new samples with timestamps relative to the start of the replay.
+		CComPtr<IMFSample> pSample = nullptr;
+		RETURN_ON_BAD_HR(MFCreateSample(&pSample));
+		RETURN_ON_BAD_HR(pSample->AddBuffer(packet.Payload));
+		RETURN_ON_BAD_HR(pSample->SetSampleTime(packet.StartPos - startPos));
+		RETURN_ON_BAD_HR(pSample->SetSampleDuration(packet.Duration));
+		if (packet.IsKeyframe) {
+			RETURN_ON_BAD_HR(pSample->SetUINT32(MFSampleExtension_CleanPoint, TRUE));
+		}
+		RETURN_ON_BAD_HR(pSinkWriter->WriteSample(packet.StreamIndex, pSample));
+		endPos = max(endPos, packet.StartPos + packet.Duration);
+	}
+	//Without an async callback, Finalize returns when the file is written.
+	RETURN_ON_BAD_HR(pSinkWriter->Finalize());
+	pMp4StreamSink->Shutdown();
+	LOG_INFO("Saved %lld ms of replay buffer in %zu packets", HundredNanosToMillis(endPos - startPos), packets.size());
+	return S_OK;
+}
+
+HRESULT ReplayBuffer::AddPacket(_In_ DWORD streamIndex, _In_ ENCODED_PACKET &encodedPacket)
+{
+	ReplayPacketRing::PACKET packet{};
+	packet.StreamIndex = streamIndex;
+	packet.StartPos = encodedPacket.StartPos;
+	packet.Duration = encodedPacket.Duration;
+	packet.IsKeyframe = encodedPacket.IsKeyframe;
+	packet.Size = encodedPacket.Size;
+	packet.Payload = encodedPacket.Buffer;
+	m_Packets->Push(std::move(packet));
+	return S_OK;
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include "MFEncoder.h"
+#include "PacketRing.h"
+
+/// <summary>
+/// Keeps the last part of a recording in memory as encoded packets, and writes it to an MP4 file or stream on request, e.g. to save the last two minutes of a session without recording all of it to disk.
+/// Video and audio are encoded with synchronous Media Foundation encoders on the thread that writes the samples, so hardware encoding is not used even if it is enabled. Saving muxes the buffered packets without encoding them again, and can run on any thread while samples are being written.
+/// The video gets a keyframe every KEYFRAME_INTERVAL_SECONDS, which is how fine grained the buffer is trimmed.
+/// </summary>
+class ReplayBuffer
+{
+public:
+	ReplayBuffer();
+	~ReplayBuffer();
+	/// <summary>
+	/// Creates and starts the encoders.
+	/// </summary>
+	/// <param name="pVideoMediaTypeIn">The uncompressed video type, in a YUV format the encoder accepts</param>
+	/// <param name="pVideoMediaTypeOut">The encoded video type</param>
+	/// <param name="pAudioMediaTypeIn">The PCM audio type, or nullptr for no audio</param>
+	/// <param name="pAudioMediaTypeOut">The encoded audio type, or nullptr for no audio</param>
+	/// <param name="pEncoderOptions">The rate control and frame rate of the video encoder</param>
+	/// <param name="maxDuration">The duration to keep, in 100 nanosecond units</param>
+	/// <param name="maxBytes">The largest number of encoded bytes to keep</param>
+	HRESULT Initialize(
+		_In_ IMFMediaType *pVideoMediaTypeIn,
+		_In_ IMFMediaType *pVideoMediaTypeOut,
+		_In_opt_ IMFMediaType *pAudioMediaTypeIn,
+		_In_opt_ IMFMediaType *pAudioMediaTypeOut,
+		_In_ std::shared_ptr<ENCODER_OPTIONS> pEncoderOptions,
+		_In_ INT64 maxDuration,
+		_In_ UINT64 maxBytes);
+	/// <summary>
+	/// Encodes a sample and adds the output to the buffer. Samples must be written from a single thread.
+	/// </summary>
+	HRESULT WriteSample(_In_ DWORD streamIndex, _In_ IMFSample *pSample);
+	/// <summary>
+	/// Writes the buffered packets to an MP4 file, with the timeline starting at zero. The buffer is left as is.
+	/// </summary>
+	/// <returns>S_FALSE if the buffer holds no keyframe yet, and nothing was written</returns>
+	HRESULT Save(_In_ IMFByteStream *pOutStream);
+	PACKET_RING_STATS GetStats() { return m_Packets ? m_Packets->GetStats() : PACKET_RING_STATS{}; }
+	INT64 GetBufferedDuration() { return m_Packets ? m_Packets->GetDuration() : 0; }
+	UINT64 GetBufferedBytes() { return m_Packets ? m_Packets->GetBytes() : 0; }
+
+	static constexpr DWORD VIDEO_STREAM_INDEX = 0;
+	static constexpr DWORD AUDIO_STREAM_INDEX = 1;
+private:
+	static constexpr UINT32 KEYFRAME_INTERVAL_SECONDS = 2;
+
+	typedef PacketRing<CComPtr<IMFMediaBuffer>> ReplayPacketRing;
+
+	std::unique_ptr<ReplayPacketRing> m_Packets;
+	MFEncoder m_VideoEncoder;
+	MFEncoder m_AudioEncoder;
+	bool m_IsAudioEnabled;
+	//Saves are serialized, since each one writes the whole buffer.
+	std::mutex m_SaveMutex;
+
+	HRESULT AddPacket(_In_ DWORD streamIndex, _In_ ENCODED_PACKET &encodedPacket);
+};
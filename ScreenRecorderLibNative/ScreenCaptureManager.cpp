@@ -18,13 +18,14 @@ ScreenCaptureManager::ScreenCaptureManager() :
 	m_Device(nullptr),
 	m_DeviceContext(nullptr),
 	m_TerminateThreadsEvent(nullptr),
+	m_FramePublishedEvent(nullptr),
 	m_LastAcquiredFrameTimeStamp{},
 	m_OutputRect{},
-	m_SharedSurf(nullptr),
-	m_KeyMutex(nullptr),
+	m_CanvasSurf(nullptr),
 	m_CaptureThreadCount(0),
 	m_CaptureThreadHandles(nullptr),
 	m_CaptureThreadData(nullptr),
+	m_CaptureFrameSlots(nullptr),
 	m_OverlayThreadCount(0),
 	m_OverlayThreadHandles(nullptr),
 	m_OverlayThreadData(nullptr),
@@ -34,6 +35,9 @@ ScreenCaptureManager::ScreenCaptureManager() :
 {
 	// Event to tell spawned threads to quit
 	m_TerminateThreadsEvent = CreateEvent(nullptr, TRUE, FALSE, nullptr);
+	// Event to tell AcquireNextFrame that a thread published a frame
+	m_FramePublishedEvent = CreateEvent(nullptr, FALSE, FALSE, nullptr);
+	InitializeCriticalSection(&m_PtrInfoCriticalSection);
 }
 
 ScreenCaptureManager::~ScreenCaptureManager()
@@ -42,6 +46,7 @@ ScreenCaptureManager::~ScreenCaptureManager()
 		StopCapture();
 	}
 	Clean();
+	DeleteCriticalSection(&m_PtrInfoCriticalSection);
 }
 
 //
@@ -63,22 +68,22 @@ HRESULT ScreenCaptureManager::Initialize(_In_ ID3D11DeviceContext *pDeviceContex
 //
 // Start up threads for video capture
 //
-HRESULT ScreenCaptureManager::StartCapture(_In_ const std::vector<RECORDING_SOURCE *> &sources, _In_ const std::vector<RECORDING_OVERLAY *> &overlays, _In_  HANDLE hErrorEvent)
+HRESULT ScreenCaptureManager::StartCapture(_In_ const std::vector<RECORDING_SOURCE *> &sources, _In_ const std::vector<RECORDING_OVERLAY *> &overlays, _In_  HANDLE hErrorEvent, _In_opt_ HANDLE hFrameUpdatedEvent)
 {
 	ResetEvent(m_TerminateThreadsEvent);
 
 	HRESULT hr = E_FAIL;
 	std::vector<RECORDING_SOURCE_DATA *> CreatedOutputs{};
-	RETURN_ON_BAD_HR(hr = CreateSharedSurf(sources, &CreatedOutputs, &m_OutputRect));
+	RETURN_ON_BAD_HR(hr = CreateCanvasSurf(sources, &CreatedOutputs, &m_OutputRect));
 	m_CaptureThreadCount = (UINT)(CreatedOutputs.size());
 	m_CaptureThreadHandles = new (std::nothrow) HANDLE[m_CaptureThreadCount]{};
 	m_CaptureThreadData = new (std::nothrow) CAPTURE_THREAD_DATA[m_CaptureThreadCount]{};
-	if (!m_CaptureThreadHandles || !m_CaptureThreadData)
+	m_CaptureFrameSlots = new (std::nothrow) CAPTURE_FRAME_SLOTS[m_CaptureThreadCount]{};
+	if (!m_CaptureThreadHandles || !m_CaptureThreadData || !m_CaptureFrameSlots)
 	{
 		return E_OUTOFMEMORY;
 	}
 
-	HANDLE sharedHandle = GetSharedHandle(m_SharedSurf);
 	// Create appropriate # of threads for duplication
 
 	for (UINT i = 0; i < m_CaptureThreadCount; i++)
@@ -86,11 +91,15 @@ HRESULT ScreenCaptureManager::StartCapture(_In_ const std::vector<RECORDING_SOUR
 		RECORDING_SOURCE_DATA *data = CreatedOutputs.at(i);
 		m_CaptureThreadData[i].ThreadResult = new CAPTURE_RESULT();
 		m_CaptureThreadData[i].ErrorEvent = hErrorEvent;
+		m_CaptureThreadData[i].FrameUpdatedEvent = hFrameUpdatedEvent;
+		m_CaptureThreadData[i].FramePublishedEvent = m_FramePublishedEvent;
 		m_CaptureThreadData[i].TerminateThreadsEvent = m_TerminateThreadsEvent;
-		m_CaptureThreadData[i].CanvasTexSharedHandle = sharedHandle;
 		m_CaptureThreadData[i].PtrInfo = &m_PtrInfo;
+		m_CaptureThreadData[i].PtrInfoCriticalSection = &m_PtrInfoCriticalSection;
 
 		m_CaptureThreadData[i].RecordingSource = data;
+		RETURN_ON_BAD_HR(hr = CreateFrameSlots(data, &m_CaptureFrameSlots[i], m_CaptureThreadData[i].FrameSlotSharedHandles));
+		m_CaptureThreadData[i].FrameSlots = &m_CaptureFrameSlots[i].Exchange;
 		RtlZeroMemory(&m_CaptureThreadData[i].RecordingSource->DxRes, sizeof(DX_RESOURCES));
 		RETURN_ON_BAD_HR(hr = InitializeDx(nullptr, &m_CaptureThreadData[i].RecordingSource->DxRes));
 
@@ -113,8 +122,9 @@ HRESULT ScreenCaptureManager::StartCapture(_In_ const std::vector<RECORDING_SOUR
 		auto overlay = overlays.at(i);
 		m_OverlayThreadData[i].ThreadResult = new CAPTURE_RESULT();
 		m_OverlayThreadData[i].ErrorEvent = hErrorEvent;
+		m_OverlayThreadData[i].FrameUpdatedEvent = hFrameUpdatedEvent;
+		m_OverlayThreadData[i].FramePublishedEvent = m_FramePublishedEvent;
 		m_OverlayThreadData[i].TerminateThreadsEvent = m_TerminateThreadsEvent;
-		m_OverlayThreadData[i].CanvasTexSharedHandle = sharedHandle;
 		m_OverlayThreadData[i].TerminateThreadsEvent = m_TerminateThreadsEvent;
 		m_OverlayThreadData[i].RecordingOverlay = new RECORDING_OVERLAY_DATA(overlay);
 		RtlZeroMemory(&m_OverlayThreadData[i].RecordingOverlay->DxRes, sizeof(DX_RESOURCES));
@@ -148,42 +158,45 @@ HRESULT ScreenCaptureManager::StopCapture()
 
 HRESULT ScreenCaptureManager::AcquireNextFrame(_In_  DWORD timeoutMillis, _Inout_ CAPTURED_FRAME *pFrame)
 {
-	HRESULT hr;
-	// Try to acquire keyed mutex in order to access shared surface
+	HRESULT hr = S_OK;
+	// Wait for a capture or overlay thread to publish a frame. The threads publish without waiting for the recorder loop, so there is no lock to take here.
 	{
-		MeasureExecutionTime measure(L"AcquireNextFrame wait for sync");
-		hr = m_KeyMutex->AcquireSync(1, timeoutMillis);
-
+		MeasureExecutionTime measure(L"AcquireNextFrame wait for frames");
+		ULONGLONG timeoutTime = GetTickCount64() + timeoutMillis;
+		while (!IsUpdatedFramesAvailable()) {
+			ULONGLONG now = GetTickCount64();
+			if (now >= timeoutTime) {
+				return DXGI_ERROR_WAIT_TIMEOUT;
+			}
+			WaitForSingleObjectEx(m_FramePublishedEvent, static_cast<DWORD>(timeoutTime - now), FALSE);
+		}
 	}
-	if (hr == static_cast<HRESULT>(WAIT_TIMEOUT))
-	{
+	if (!IsInitialFrameWriteComplete()) {
 		return DXGI_ERROR_WAIT_TIMEOUT;
 	}
-	else if (FAILED(hr))
-	{
-		return hr;
-	}
 
 	ID3D11Texture2D *pDesktopFrame = nullptr;
 	{
-		ReleaseKeyedMutexOnExit releaseMutex(m_KeyMutex, 0);
-
-		if (!IsInitialFrameWriteComplete()) {
-			return DXGI_ERROR_WAIT_TIMEOUT;
-		}
-		if (!IsUpdatedFramesAvailable()) {
-			return DXGI_ERROR_WAIT_TIMEOUT;
-		}
 		MeasureExecutionTime measure(L"AcquireNextFrame lock");
-		int updatedFrameCount = GetUpdatedFrameCount(true);
+		//Overlays are drawn while the frame pipeline transforms the frame before, so the device lock keeps their draw calls apart.
+		CComPtr<ID3D10Multithread> pMultithread;
+		if (SUCCEEDED(m_DeviceContext->QueryInterface(IID_PPV_ARGS(&pMultithread)))) {
+			pMultithread->Enter();
+		}
+		LeaveMultithreadOnExit leaveMultithread(pMultithread);
+
+		int updatedFrameCount = 0;
+		RETURN_ON_BAD_HR(hr = ProcessFrameSlots(m_CanvasSurf, &updatedFrameCount));
 
 		D3D11_TEXTURE2D_DESC desc;
-		m_SharedSurf->GetDesc(&desc);
+		m_CanvasSurf->GetDesc(&desc);
 		desc.MiscFlags = 0;
 		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D11_BIND_RENDER_TARGET;
-		RETURN_ON_BAD_HR(hr = m_Device->CreateTexture2D(&desc, nullptr, &pDesktopFrame));
+		m_TextureManager->NextFrame();
+		//Without video capture, the frame only has the overlays, so it is cleared first.
+		RETURN_ON_BAD_HR(hr = m_TextureManager->AcquireTexture(desc, &pDesktopFrame, !m_OutputOptions->IsVideoCaptureEnabled()));
 		if (m_OutputOptions->IsVideoCaptureEnabled()) {
-			m_DeviceContext->CopyResource(pDesktopFrame, m_SharedSurf);
+			m_DeviceContext->CopyResource(pDesktopFrame, m_CanvasSurf);
 		}
 		int updatedOverlaysCount = 0;
 		ProcessOverlays(pDesktopFrame, &updatedOverlaysCount);
@@ -205,14 +218,9 @@ HRESULT ScreenCaptureManager::AcquireNextFrame(_In_  DWORD timeoutMillis, _Inout
 //
 void ScreenCaptureManager::Clean()
 {
-	if (m_SharedSurf) {
-		m_SharedSurf->Release();
-		m_SharedSurf = nullptr;
-	}
-	if (m_KeyMutex)
-	{
-		m_KeyMutex->Release();
-		m_KeyMutex = nullptr;
+	if (m_CanvasSurf) {
+		m_CanvasSurf->Release();
+		m_CanvasSurf = nullptr;
 	}
 	if (m_PtrInfo.PtrShapeBuffer)
 	{
@@ -249,6 +257,12 @@ void ScreenCaptureManager::Clean()
 		m_CaptureThreadData = nullptr;
 	}
 
+	if (m_CaptureFrameSlots)
+	{
+		delete[] m_CaptureFrameSlots;
+		m_CaptureFrameSlots = nullptr;
+	}
+
 	m_CaptureThreadCount = 0;
 
 	if (m_OverlayThreadHandles) {
@@ -282,6 +296,7 @@ void ScreenCaptureManager::Clean()
 	m_OverlayThreadCount = 0;
 
 	CloseHandle(m_TerminateThreadsEvent);
+	CloseHandle(m_FramePublishedEvent);
 }
 
 //
@@ -323,7 +338,7 @@ bool ScreenCaptureManager::IsUpdatedFramesAvailable()
 {
 	for (UINT i = 0; i < m_CaptureThreadCount; ++i)
 	{
-		if (m_CaptureThreadData[i].LastUpdateTimeStamp.QuadPart > m_LastAcquiredFrameTimeStamp.QuadPart) {
+		if (m_CaptureFrameSlots[i].Exchange.IsFramePublished()) {
 			return true;
 		}
 	}
@@ -364,20 +379,39 @@ bool ScreenCaptureManager::IsInitialOverlayWriteComplete()
 	return true;
 }
 
-UINT ScreenCaptureManager::GetUpdatedFrameCount(_In_ bool resetUpdatedFrameCounts)
+//
+// Copies the latest published frame of each capture thread to the canvas
+//
+HRESULT ScreenCaptureManager::ProcessFrameSlots(_Inout_ ID3D11Texture2D *pCanvasFrame, _Out_ int *updateCount)
 {
+	HRESULT hr = S_OK;
 	int updatedFrameCount = 0;
-
 	for (UINT i = 0; i < m_CaptureThreadCount; ++i)
 	{
-		if (m_CaptureThreadData[i].LastUpdateTimeStamp.QuadPart > m_LastAcquiredFrameTimeStamp.QuadPart) {
-			updatedFrameCount += m_CaptureThreadData[i].UpdatedFrameCountSinceLastWrite;
-			if (resetUpdatedFrameCounts) {
-				m_CaptureThreadData[i].UpdatedFrameCountSinceLastWrite = 0;
-			}
+		CAPTURE_FRAME_SLOTS &frameSlots = m_CaptureFrameSlots[i];
+		uint32_t slot;
+		uint64_t publishedCount;
+		if (!frameSlots.Exchange.AcquireLatest(&slot, &publishedCount)) {
+			continue;
 		}
+		//The slot is ours until the next frame is taken, so the keyed mutex is never held by the capture thread here. It only makes the GPU finish the writes of the other device first.
+		RETURN_ON_BAD_HR(hr = frameSlots.KeyMutexes[slot]->AcquireSync(0, INFINITE));
+		ReleaseKeyedMutexOnExit releaseMutex(frameSlots.KeyMutexes[slot], 0);
+		m_DeviceContext->CopySubresourceRegion(pCanvasFrame, 0, frameSlots.CanvasPosition.x, frameSlots.CanvasPosition.y, 0, frameSlots.Textures[slot], 0, nullptr);
+		updatedFrameCount += static_cast<int>(publishedCount);
+	}
+	*updateCount = updatedFrameCount;
+	return hr;
+}
+
+std::vector<FRAME_SLOT_EXCHANGE_STATS> ScreenCaptureManager::GetFrameSlotStats()
+{
+	std::vector<FRAME_SLOT_EXCHANGE_STATS> stats;
+	for (UINT i = 0; i < m_CaptureThreadCount; ++i)
+	{
+		stats.push_back(m_CaptureFrameSlots[i].Exchange.GetStats());
 	}
-	return updatedFrameCount;
+	return stats;
 }
 
 std::vector<CAPTURE_THREAD_DATA> ScreenCaptureManager::GetCaptureThreadData()
@@ -490,7 +524,7 @@ HRESULT ScreenCaptureManager::ProcessOverlays(_Inout_ ID3D11Texture2D *pCanvasTe
 	return hr;
 }
 
-HRESULT ScreenCaptureManager::CreateSharedSurf(_In_ const std::vector<RECORDING_SOURCE *> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds)
+HRESULT ScreenCaptureManager::CreateCanvasSurf(_In_ const std::vector<RECORDING_SOURCE *> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds)
 {
 	*pCreatedOutputs = std::vector<RECORDING_SOURCE_DATA *>();
 	std::vector<std::pair<RECORDING_SOURCE *, RECT>> validOutputs;
@@ -521,15 +555,13 @@ HRESULT ScreenCaptureManager::CreateSharedSurf(_In_ const std::vector<RECORDING_
 	}
 
 	// Set created outputs
-	hr = ScreenCaptureManager::CreateSharedSurf(*pDeskBounds, &m_SharedSurf, &m_KeyMutex);
+	hr = ScreenCaptureManager::CreateCanvasSurf(*pDeskBounds, &m_CanvasSurf);
 	return hr;
 }
 
-HRESULT ScreenCaptureManager::CreateSharedSurf(_In_ RECT desktopRect, _Outptr_ ID3D11Texture2D **ppSharedTexture, _Outptr_ IDXGIKeyedMutex **ppKeyedMutex)
+HRESULT ScreenCaptureManager::CreateCanvasSurf(_In_ RECT desktopRect, _Outptr_ ID3D11Texture2D **ppCanvasTexture)
 {
-	CComPtr<ID3D11Texture2D> pSharedTexture = nullptr;
-	CComPtr<IDXGIKeyedMutex> pKeyedMutex = nullptr;
-	// Create shared texture for all capture threads to draw into
+	// Create the texture the frames of all capture threads are copied into
 	D3D11_TEXTURE2D_DESC DeskTexD;
 	RtlZeroMemory(&DeskTexD, sizeof(D3D11_TEXTURE2D_DESC));
 	DeskTexD.Width = RectWidth(desktopRect);
@@ -541,29 +573,49 @@ HRESULT ScreenCaptureManager::CreateSharedSurf(_In_ RECT desktopRect, _Outptr_ I
 	DeskTexD.Usage = D3D11_USAGE_DEFAULT;
 	DeskTexD.BindFlags = D3D11_BIND_RENDER_TARGET;
 	DeskTexD.CPUAccessFlags = 0;
-	DeskTexD.MiscFlags = D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX;
+	DeskTexD.MiscFlags = 0;
 
-	HRESULT hr = m_Device->CreateTexture2D(&DeskTexD, nullptr, &pSharedTexture);
+	HRESULT hr = m_Device->CreateTexture2D(&DeskTexD, nullptr, ppCanvasTexture);
 	if (FAILED(hr))
 	{
-		LOG_ERROR(L"Failed to create shared texture");
-		return hr;
+		LOG_ERROR(L"Failed to create canvas texture");
 	}
-	// Get keyed mutex
-	hr = pSharedTexture->QueryInterface(__uuidof(IDXGIKeyedMutex), reinterpret_cast<void **>(&pKeyedMutex));
-	if (FAILED(hr))
+	return hr;
+}
+
+HRESULT ScreenCaptureManager::CreateFrameSlots(_In_ RECORDING_SOURCE_DATA *pSource, _Inout_ CAPTURE_FRAME_SLOTS *pFrameSlots, _Out_writes_(FRAME_SLOT_COUNT) HANDLE *pSharedHandles)
+{
+	HRESULT hr = S_OK;
+	// Create shared textures for the capture thread to publish frames in. Each has a keyed mutex, as the thread writes them on a device of its own.
+	D3D11_TEXTURE2D_DESC SlotTexD;
+	RtlZeroMemory(&SlotTexD, sizeof(D3D11_TEXTURE2D_DESC));
+	SlotTexD.Width = RectWidth(pSource->FrameCoordinates);
+	SlotTexD.Height = RectHeight(pSource->FrameCoordinates);
+	SlotTexD.MipLevels = 1;
+	SlotTexD.ArraySize = 1;
+	SlotTexD.Format = DXGI_FORMAT_B8G8R8A8_UNORM;
+	SlotTexD.SampleDesc.Count = 1;
+	SlotTexD.Usage = D3D11_USAGE_DEFAULT;
+	SlotTexD.BindFlags = D3D11_BIND_RENDER_TARGET | D3D11_BIND_SHADER_RESOURCE;
+	SlotTexD.CPUAccessFlags = 0;
+	SlotTexD.MiscFlags = D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX;
+	for (UINT i = 0; i < FRAME_SLOT_COUNT; i++)
 	{
-		LOG_ERROR(L"Failed to query for keyed mutex in OUTPUTMANAGER");
-		return hr;
-	}
-	if (ppSharedTexture) {
-		*ppSharedTexture = pSharedTexture;
-		(*ppSharedTexture)->AddRef();
-	}
-	if (ppKeyedMutex) {
-		*ppKeyedMutex = pKeyedMutex;
-		(*ppKeyedMutex)->AddRef();
+		hr = m_Device->CreateTexture2D(&SlotTexD, nullptr, &pFrameSlots->Textures[i]);
+		if (FAILED(hr))
+		{
+			LOG_ERROR(L"Failed to create frame slot texture");
+			return hr;
+		}
+		hr = pFrameSlots->Textures[i]->QueryInterface(__uuidof(IDXGIKeyedMutex), reinterpret_cast<void **>(&pFrameSlots->KeyMutexes[i]));
+		if (FAILED(hr))
+		{
+			LOG_ERROR(L"Failed to query for keyed mutex of frame slot");
+			return hr;
+		}
+		pSharedHandles[i] = GetSharedHandle(pFrameSlots->Textures[i]);
 	}
+	pFrameSlots->CanvasPosition = POINT{ pSource->FrameCoordinates.left + pSource->OffsetX, pSource->FrameCoordinates.top + pSource->OffsetY };
 	return hr;
 }
 
@@ -572,8 +624,9 @@ DWORD WINAPI CaptureThreadProc(_In_ void *Param)
 {
 	HRESULT hr = E_FAIL;
 	// D3D objects
-	CComPtr<ID3D11Texture2D> SharedSurf = nullptr;
-	CComPtr<IDXGIKeyedMutex> KeyMutex = nullptr;
+	CComPtr<ID3D11Texture2D> CaptureSurf = nullptr;
+	CComPtr<ID3D11Texture2D> SlotSurfs[FRAME_SLOT_COUNT]{};
+	CComPtr<IDXGIKeyedMutex> SlotKeyMutexes[FRAME_SLOT_COUNT]{};
 
 	// Data passed in from thread creation
 	CAPTURE_THREAD_DATA *pData = static_cast<CAPTURE_THREAD_DATA *>(Param);
@@ -631,18 +684,21 @@ DWORD WINAPI CaptureThreadProc(_In_ void *Param)
 			goto Exit;
 		}
 
-		// Obtain handle to sync shared Surface
-		hr = pSourceData->DxRes.Device->OpenSharedResource(pData->CanvasTexSharedHandle, __uuidof(ID3D11Texture2D), reinterpret_cast<void **>(&SharedSurf));
-		if (FAILED(hr))
+		// Obtain handles to the shared frame slots
+		for (UINT i = 0; i < FRAME_SLOT_COUNT; i++)
 		{
-			LOG_ERROR(L"Opening shared texture failed");
-			goto Exit;
-		}
-		hr = SharedSurf->QueryInterface(__uuidof(IDXGIKeyedMutex), reinterpret_cast<void **>(&KeyMutex));
-		if (FAILED(hr))
-		{
-			LOG_ERROR(L"Failed to get keyed mutex interface in spawned thread");
-			goto Exit;
+			hr = pSourceData->DxRes.Device->OpenSharedResource(pData->FrameSlotSharedHandles[i], __uuidof(ID3D11Texture2D), reinterpret_cast<void **>(&SlotSurfs[i]));
+			if (FAILED(hr))
+			{
+				LOG_ERROR(L"Opening shared texture failed");
+				goto Exit;
+			}
+			hr = SlotSurfs[i]->QueryInterface(__uuidof(IDXGIKeyedMutex), reinterpret_cast<void **>(&SlotKeyMutexes[i]));
+			if (FAILED(hr))
+			{
+				LOG_ERROR(L"Failed to get keyed mutex interface in spawned thread");
+				goto Exit;
+			}
 		}
 
 		// Make duplication
@@ -668,11 +724,19 @@ DWORD WINAPI CaptureThreadProc(_In_ void *Param)
 			LOG_ERROR(L"Failed to initialize TextureManager");
 			goto Exit;
 		}
+		//Updates are written to a surface of the thread's own, which holds the full frame of the source, and then copied to a frame slot.
+		//The source is written at the origin of the surface, instead of at its position on the canvas.
+		hr = textureManager.CreateTexture(RectWidth(pSourceData->FrameCoordinates), RectHeight(pSourceData->FrameCoordinates), &CaptureSurf, 0, D3D11_BIND_RENDER_TARGET);
+		if (FAILED(hr))
+		{
+			LOG_ERROR(L"Failed to create capture texture");
+			goto Exit;
+		}
+		INT surfaceOffsetX = -pSourceData->FrameCoordinates.left;
+		INT surfaceOffsetY = -pSourceData->FrameCoordinates.top;
 		// Main duplication loop
 		bool IsCapturingVideo = true;
-		bool IsSharedSurfaceDirty = false;
-		bool WaitToProcessCurrentFrame = false;
-		std::chrono::steady_clock::time_point WaitForFrameBegin = (std::chrono::steady_clock::time_point::min)();
+		bool IsCaptureSurfaceDirty = false;
 		while (true)
 		{
 			if (WaitForSingleObjectEx(pData->TerminateThreadsEvent, 0, FALSE) == WAIT_OBJECT_0) {
@@ -683,95 +747,79 @@ DWORD WINAPI CaptureThreadProc(_In_ void *Param)
 				Sleep(1);
 				if (pSource->IsVideoCaptureEnabled.value_or(true)) {
 					IsCapturingVideo = true;
-					IsSharedSurfaceDirty = true;
+					IsCaptureSurfaceDirty = true;
 				}
 				continue;
 			}
 			CComPtr<ID3D11Texture2D> pFrame = nullptr;
-			if (!WaitToProcessCurrentFrame)
-			{
-				if (IsSharedSurfaceDirty) {
-					hr = pRecordingSourceCapture->AcquireNextFrame(10, &pFrame);
-				}
-				else {
-					hr = pRecordingSourceCapture->AcquireNextFrame(10, nullptr);
-				}
-				if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
-					continue;
-				}
-				else if (FAILED(hr)) {
-					break;
-				}
+			if (IsCaptureSurfaceDirty) {
+				hr = pRecordingSourceCapture->AcquireNextFrame(10, &pFrame);
 			}
-			{
-				MeasureExecutionTime measure(L"CaptureThreadProc wait for sync");
-				// We have a new frame so try and process it
-				// Try to acquire keyed mutex in order to access shared surface
-				hr = KeyMutex->AcquireSync(0, 1);
+			else {
+				hr = pRecordingSourceCapture->AcquireNextFrame(10, nullptr);
 			}
-			if (hr == static_cast<HRESULT>(WAIT_TIMEOUT))
-			{
-				// Can't use shared surface right now, try again later
-				if (!WaitToProcessCurrentFrame) {
-					WaitForFrameBegin = chrono::steady_clock::now();
-				}
-				WaitToProcessCurrentFrame = true;
+			if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
 				continue;
 			}
-			else if (FAILED(hr))
-			{
-				// Generic unknown failure
-				LOG_ERROR(L"Unexpected error acquiring KeyMutex");
+			else if (FAILED(hr)) {
 				break;
 			}
-			{
-				MeasureExecutionTime measureLock(string_format(L"CaptureThreadProc sync lock for %ls", pRecordingSourceCapture->Name().c_str()));
-				ReleaseKeyedMutexOnExit releaseMutex(KeyMutex, 1);
-
-				// We can now process the current frame
-				if (WaitToProcessCurrentFrame) {
-					WaitToProcessCurrentFrame = false;
-					LONGLONG waitTimeMillis = duration_cast<milliseconds>(chrono::steady_clock::now() - WaitForFrameBegin).count();
-					LOG_TRACE(L"CaptureThreadProc waited for busy shared surface for %lld ms", waitTimeMillis);
-				}
-				if (pSource->IsCursorCaptureEnabled.value_or(false)) {
-					// Get mouse info
-					hr = pRecordingSourceCapture->GetMouse(pData->PtrInfo, pSourceData->FrameCoordinates, pSourceData->OffsetX, pSourceData->OffsetY);
-					if (FAILED(hr)) {
-						LOG_ERROR("Failed to get mouse data");
-					}
+			if (pSource->IsCursorCaptureEnabled.value_or(false)) {
+				// Get mouse info. The pointer is shared with the other capture threads.
+				EnterCriticalSection(pData->PtrInfoCriticalSection);
+				LeaveCriticalSectionOnExit leaveCriticalSection(pData->PtrInfoCriticalSection);
+				hr = pRecordingSourceCapture->GetMouse(pData->PtrInfo, pSourceData->FrameCoordinates, pSourceData->OffsetX, pSourceData->OffsetY);
+				if (FAILED(hr)) {
+					LOG_ERROR("Failed to get mouse data");
 				}
-				if (pSource->IsVideoCaptureEnabled.value_or(true)) {
-					if (IsSharedSurfaceDirty) {
-						//The screen has been blacked out, so we restore a full frame to the shared surface before starting to apply updates.
-						RECT offsetFrameCoordinates = pSourceData->FrameCoordinates;
-						OffsetRect(&offsetFrameCoordinates, pSourceData->OffsetX, pSourceData->OffsetY);
-						hr = textureManager.DrawTexture(SharedSurf, pFrame, offsetFrameCoordinates);
-						IsSharedSurfaceDirty = false;
-					}
-
-					hr = pRecordingSourceCapture->WriteNextFrameToSharedSurface(0, SharedSurf, pSourceData->OffsetX, pSourceData->OffsetY, pSourceData->FrameCoordinates);
-				}
-				else {
-					hr = textureManager.BlankTexture(SharedSurf, pSourceData->FrameCoordinates, pSourceData->OffsetX, pSourceData->OffsetY);
-					if (SUCCEEDED(hr)) {
-						IsCapturingVideo = false;
-					}
+			}
+			bool isFullFrameWritten = false;
+			if (pSource->IsVideoCaptureEnabled.value_or(true)) {
+				if (IsCaptureSurfaceDirty) {
+					//The screen has been blacked out, so we restore a full frame to the surface before starting to apply updates.
+					RECT offsetFrameCoordinates = pSourceData->FrameCoordinates;
+					OffsetRect(&offsetFrameCoordinates, surfaceOffsetX, surfaceOffsetY);
+					hr = textureManager.DrawTexture(CaptureSurf, pFrame, offsetFrameCoordinates);
+					IsCaptureSurfaceDirty = false;
+					isFullFrameWritten = SUCCEEDED(hr);
 				}
 
+				hr = pRecordingSourceCapture->WriteNextFrameToSharedSurface(0, CaptureSurf, surfaceOffsetX, surfaceOffsetY, pSourceData->FrameCoordinates);
 			}
-			if (hr == DXGI_ERROR_WAIT_TIMEOUT) {
-				continue;
+			else {
+				hr = textureManager.BlankTexture(CaptureSurf, pSourceData->FrameCoordinates, surfaceOffsetX, surfaceOffsetY);
+				if (SUCCEEDED(hr)) {
+					IsCapturingVideo = false;
+				}
 			}
-			else if (FAILED(hr)) {
+			if (FAILED(hr) && hr != DXGI_ERROR_WAIT_TIMEOUT) {
 				break;
 			}
-			else if (hr == S_FALSE) {
+			else if (hr != S_OK && !isFullFrameWritten) {
 				continue;
 			}
-			pData->UpdatedFrameCountSinceLastWrite++;
+			{
+				MeasureExecutionTime measure(string_format(L"CaptureThreadProc publish frame for %ls", pRecordingSourceCapture->Name().c_str()));
+				// The back slot is only ever used by this thread, so acquiring its keyed mutex does not wait for the recorder loop. It only orders the GPU work of the two devices.
+				uint32_t backSlot = pData->FrameSlots->GetBackSlot();
+				hr = SlotKeyMutexes[backSlot]->AcquireSync(0, INFINITE);
+				if (FAILED(hr))
+				{
+					LOG_ERROR(L"Unexpected error acquiring KeyMutex");
+					break;
+				}
+				{
+					ReleaseKeyedMutexOnExit releaseMutex(SlotKeyMutexes[backSlot], 0);
+					pSourceData->DxRes.Context->CopyResource(SlotSurfs[backSlot], CaptureSurf);
+				}
+				pData->FrameSlots->Publish();
+			}
 			pData->TotalUpdatedFrameCount++;
 			QueryPerformanceCounter(&pData->LastUpdateTimeStamp);
+			SetEvent(pData->FramePublishedEvent);
+			if (pData->FrameUpdatedEvent) {
+				SetEvent(pData->FrameUpdatedEvent);
+			}
 		}
 	}
 Exit:
@@ -793,6 +841,10 @@ Exit:
 			SetEvent(pData->ErrorEvent);
 		}
 	}
+	if (pData->FrameUpdatedEvent) {
+		//Wakes the recorder loop, so it sees the result of the thread without waiting for the next frame.
+		SetEvent(pData->FrameUpdatedEvent);
+	}
 	CoUninitialize();
 	LOG_DEBUG("Exiting CaptureThreadProc");
 	return 0;
@@ -811,8 +863,6 @@ DWORD WINAPI OverlayCaptureThreadProc(_In_ void *Param) {
 	// D3D objects
 	CComPtr<ID3D11Texture2D> pSharedTexture = nullptr;
 	CComPtr<ID3D11Texture2D> pCurrentFrame = nullptr;
-	CComPtr<ID3D11Texture2D> SharedSurf = nullptr;
-	CComPtr<IDXGIKeyedMutex> KeyMutex = nullptr;
 
 	switch (pOverlay->Type)
 	{
@@ -864,19 +914,6 @@ DWORD WINAPI OverlayCaptureThreadProc(_In_ void *Param) {
 		goto Exit;
 	}
 
-	// Obtain handle to sync shared Surface
-	hr = pOverlayData->DxRes.Device->OpenSharedResource(pData->CanvasTexSharedHandle, __uuidof(ID3D11Texture2D), reinterpret_cast<void **>(&SharedSurf));
-	if (FAILED(hr))
-	{
-		LOG_ERROR(L"Opening shared texture failed");
-		goto Exit;
-	}
-	hr = SharedSurf->QueryInterface(__uuidof(IDXGIKeyedMutex), reinterpret_cast<void **>(&KeyMutex));
-	if (FAILED(hr))
-	{
-		LOG_ERROR(L"Failed to get keyed mutex interface in spawned thread");
-		goto Exit;
-	}
 	bool IsCapturingVideo = true;
 	// Main capture loop
 	while (true)
@@ -928,11 +965,10 @@ DWORD WINAPI OverlayCaptureThreadProc(_In_ void *Param) {
 		//https://docs.microsoft.com/en-us/windows/win32/api/d3d11/nf-d3d11-id3d11device-opensharedresource
 		pOverlayData->DxRes.Context->Flush();
 		QueryPerformanceCounter(&pData->LastUpdateTimeStamp);
-		// Try to acquire keyed mutex in order to access shared surface. The timeout value is 0, and we just continue if we don't get a lock.
-		// This is just used to notify the rendering loop about updated overlays, so no reason to wait around if it's already updating.
-		if (KeyMutex->AcquireSync(0, 0) == S_OK) {
-			MeasureExecutionTime measureLock(string_format(L"OverlayCapture sync lock for %ls", overlayCapture->Name().c_str()));
-			KeyMutex->ReleaseSync(1);
+		// Wakes AcquireNextFrame if it waits for an update, so the overlay is drawn on the next frame.
+		SetEvent(pData->FramePublishedEvent);
+		if (pData->FrameUpdatedEvent) {
+			SetEvent(pData->FrameUpdatedEvent);
 		}
 	}
 Exit:
@@ -954,6 +990,10 @@ Exit:
 			SetEvent(pData->ErrorEvent);
 		}
 	}
+	if (pData->FrameUpdatedEvent) {
+		//Wakes the recorder loop, so it sees the result of the thread without waiting for the next frame.
+		SetEvent(pData->FrameUpdatedEvent);
+	}
 	CoUninitialize();
 	LOG_DEBUG("Exiting OverlayCaptureThreadProc");
 	return 0;
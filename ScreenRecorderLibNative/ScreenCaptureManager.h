@@ -8,6 +8,18 @@
 
 void ProcessCaptureHRESULT(_In_ HRESULT hr, _Inout_ CAPTURE_RESULT *pResult, _In_opt_ ID3D11Device *pDevice);
 
+//
+// The consumer side of the frame slots of a capture thread
+//
+struct CAPTURE_FRAME_SLOTS
+{
+	FrameSlotExchange Exchange{};
+	CComPtr<ID3D11Texture2D> Textures[FRAME_SLOT_COUNT]{};
+	CComPtr<IDXGIKeyedMutex> KeyMutexes[FRAME_SLOT_COUNT]{};
+	//Where the slots are copied to on the canvas.
+	POINT CanvasPosition{};
+};
+
 class ScreenCaptureManager
 {
 public:
@@ -20,29 +32,35 @@ public:
 	virtual RECT GetOutputRect() { return m_OutputRect; }
 	virtual SIZE GetOutputSize() { return SIZE{ RectWidth(m_OutputRect),RectHeight(m_OutputRect) }; }
 	virtual HRESULT AcquireNextFrame(_In_ DWORD timeoutMillis, _Inout_ CAPTURED_FRAME *pFrame);
-	virtual HRESULT StartCapture(_In_ const std::vector<RECORDING_SOURCE*> &sources, _In_ const std::vector<RECORDING_OVERLAY*> &overlays, _In_  HANDLE hErrorEvent);
+	virtual HRESULT StartCapture(_In_ const std::vector<RECORDING_SOURCE*> &sources, _In_ const std::vector<RECORDING_OVERLAY*> &overlays, _In_  HANDLE hErrorEvent, _In_opt_ HANDLE hFrameUpdatedEvent);
 	virtual HRESULT StopCapture();
 	virtual bool IsUpdatedFramesAvailable();
 	virtual bool IsInitialFrameWriteComplete();
 	virtual bool IsInitialOverlayWriteComplete();
 	virtual bool IsCapturing() { return m_IsCapturing; }
-	virtual UINT GetUpdatedFrameCount(_In_ bool resetUpdatedFrameCounts);
 	std::vector<CAPTURE_THREAD_DATA> GetCaptureThreadData();
 	std::vector<OVERLAY_THREAD_DATA> GetOverlayThreadData();
+	//The texture pool of the captured frames.
+	LEASE_POOL_STATS GetTexturePoolStats() { return m_TextureManager ? m_TextureManager->GetTexturePoolStats() : LEASE_POOL_STATS{}; }
+	//The frame slots of each capture thread.
+	std::vector<FRAME_SLOT_EXCHANGE_STATS> GetFrameSlotStats();
 protected:
 	LARGE_INTEGER m_LastAcquiredFrameTimeStamp;
-	ID3D11Texture2D *m_SharedSurf;
-	IDXGIKeyedMutex *m_KeyMutex;
+	//The frames of all sources composed, only used by the recorder loop.
+	ID3D11Texture2D *m_CanvasSurf;
 	ID3D11Device *m_Device;
 	ID3D11DeviceContext *m_DeviceContext;
 	RECT m_OutputRect;
 	PTR_INFO m_PtrInfo;
 
-	virtual HRESULT CreateSharedSurf(_In_ RECT desktopRect, _Outptr_ ID3D11Texture2D **ppSharedTexture, _Outptr_ IDXGIKeyedMutex **ppKeyedMutex);
-	virtual HRESULT CreateSharedSurf(_In_ const std::vector<RECORDING_SOURCE*> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds);
+	virtual HRESULT CreateCanvasSurf(_In_ RECT desktopRect, _Outptr_ ID3D11Texture2D **ppCanvasTexture);
+	virtual HRESULT CreateCanvasSurf(_In_ const std::vector<RECORDING_SOURCE*> &sources, _Out_ std::vector<RECORDING_SOURCE_DATA *> *pCreatedOutputs, _Out_ RECT *pDeskBounds);
+	virtual HRESULT CreateFrameSlots(_In_ RECORDING_SOURCE_DATA *pSource, _Inout_ CAPTURE_FRAME_SLOTS *pFrameSlots, _Out_writes_(FRAME_SLOT_COUNT) HANDLE *pSharedHandles);
 private:
 	bool m_IsCapturing;
 	HANDLE m_TerminateThreadsEvent;
+	HANDLE m_FramePublishedEvent;
+	CRITICAL_SECTION m_PtrInfoCriticalSection;
 
 	std::shared_ptr<OUTPUT_OPTIONS> m_OutputOptions;
 
@@ -51,6 +69,8 @@ private:
 	UINT m_CaptureThreadCount;
 	_Field_size_(m_CaptureThreadCount) HANDLE *m_CaptureThreadHandles;
 	_Field_size_(m_CaptureThreadCount) CAPTURE_THREAD_DATA *m_CaptureThreadData;
+	//The slot textures of each capture thread, created on the device of the recorder loop.
+	_Field_size_(m_CaptureThreadCount) CAPTURE_FRAME_SLOTS *m_CaptureFrameSlots;
 
 	UINT m_OverlayThreadCount;
 	_Field_size_(m_OverlayThreadCount) HANDLE *m_OverlayThreadHandles;
@@ -62,5 +82,6 @@ private:
 	RECT GetSourceRect(_In_ SIZE canvasSize, _In_ RECORDING_SOURCE_DATA *pSource);
 	RECT GetOverlayRect(_In_ SIZE canvasSize, _In_ SIZE overlayTextureSize, _In_ RECORDING_OVERLAY *pOverlay);
 	HRESULT ProcessOverlays(_Inout_ ID3D11Texture2D *pBackgroundFrame, _Out_ int *updateCount);
+	HRESULT ProcessFrameSlots(_Inout_ ID3D11Texture2D *pCanvasFrame, _Out_ int *updateCount);
 };
 
@@ -0,0 +1,283 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+/// <summary>
+/// When SegmentedOutput closes a segment and starts the next.
+/// </summary>
+struct SEGMENT_POLICY
+{
+	//The longest duration of a segment, in 100 nanosecond units. 0 for no limit.
+	int64_t MaxDuration = 0;
+	//The size in bytes at which a segment is closed. 0 for no limit. A segment can grow past it by the frame that reaches it.
+	uint64_t MaxBytes = 0;
+
+	inline bool IsEnabled() const { return MaxDuration > 0 || MaxBytes > 0; }
+};
+
+struct SEGMENT_STATS
+{
+	//The number of segments opened, finalized, and that failed to open or finalize.
+	uint32_t OpenedCount = 0;
+	uint32_t FinalizedCount = 0;
+	uint32_t OpenFailedCount = 0;
+	uint32_t FinalizeFailedCount = 0;
+	//The time spent finalizing segments.
+	uint64_t TotalFinalizeMicros = 0;
+	uint64_t MaxFinalizeMicros = 0;
+	//The largest number of segments that were waiting to be finalized at once.
+	size_t MaxPendingCount = 0;
+};
+
+/// <summary>
+/// Splits a recording into consecutive segments by duration or size, e.g. one file per hour for recording around the clock.
+/// A new segment is opened before the previous one is handed off, and starts at the timestamp of the frame that triggered the rotation, so the segments cover the timeline without gaps or overlap.
+/// The open function gives every segment an encoder of its own, so every segment starts with a keyframe and can be decoded on its own. Segments other than the last are finalized on a background thread, so the writer does not stall while a container is written out.
+/// All methods other than GetStats must be called from the thread that writes the recording.
+/// </summary>
+template <typename TSegment>
+class SegmentedOutput
+{
+public:
+	//Opens the segment with the given zero based index, for every segment after the first. Returns false if the segment could not be opened.
+	typedef std::function<bool(uint32_t index, TSegment &segment)> OpenFunction;
+	//Flushes and closes a segment. Called on the finalizer thread for all segments but the last. Returns false if finalizing failed.
+	typedef std::function<bool(TSegment &segment)> FinalizeFunction;
+
+	/// <param name="policy">When to start a new segment. With neither limit set, the recording is a single segment</param>
+	/// <param name="open">The function that opens segments</param>
+	/// <param name="finalize">The function that finalizes segments</param>
+	SegmentedOutput(SEGMENT_POLICY policy, OpenFunction open, FinalizeFunction finalize) :
+		m_Policy(policy),
+		m_Open(open),
+		m_Finalize(finalize),
+		m_Current{},
+		m_IsOpen(false),
+		m_CurrentIndex(0),
+		m_CurrentStartPos(0),
+		m_CurrentSize(0),
+		m_LimitStartPos(0),
+		m_LimitStartSize(0),
+		m_IsClosed(false),
+		m_IsFinalizerRunning(false),
+		m_IsFinalizeFailed(false),
+		m_Stats{}
+	{
+	}
+
+	~SegmentedOutput()
+	{
+		Close();
+	}
+
+	SegmentedOutput(const SegmentedOutput &) = delete;
+	SegmentedOutput &operator=(const SegmentedOutput &) = delete;
+
+	/// <summary>
+	/// Starts writing to the first segment, starting at startPos on the timeline of the recording. The caller opens the first segment, so it can report why opening failed before the recording starts.
+	/// </summary>
+	/// <returns>false if the output was already started or closed</returns>
+	bool Start(int64_t startPos, TSegment &&first)
+	{
+		if (m_IsOpen || m_IsClosed) {
+			return false;
+		}
+		m_Current = std::move(first);
+		m_IsOpen = true;
+		m_CurrentIndex = 0;
+		ResetLimits(startPos);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_Stats.OpenedCount++;
+		return true;
+	}
+
+	/// <summary>
+	/// Whether the current segment has reached a limit of the policy at the given timestamp.
+	/// </summary>
+	bool IsRotationDue(int64_t pos) const
+	{
+		if (!m_IsOpen) {
+			return false;
+		}
+		return (m_Policy.MaxDuration > 0 && pos - m_LimitStartPos >= m_Policy.MaxDuration)
+			|| (m_Policy.MaxBytes > 0 && m_CurrentSize - m_LimitStartSize >= m_Policy.MaxBytes);
+	}
+
+	/// <summary>
+	/// Called before a frame starting at pos is written. If rotation is due, the next segment is opened to start at pos, and the current one is queued for finalizing.
+	/// If the next segment cannot be opened, writing continues in the current segment, and rotation is tried again once the limits are reached anew from the failed attempt.
+	/// </summary>
+	/// <returns>true if the frame starts a new segment</returns>
+	bool Advance(int64_t pos)
+	{
+		if (!IsRotationDue(pos)) {
+			return false;
+		}
+		TSegment next{};
+		if (!OpenSegment(m_CurrentIndex + 1, next)) {
+			m_LimitStartPos = pos;
+			m_LimitStartSize = m_CurrentSize;
+			return false;
+		}
+		QueueFinalize(std::move(m_Current));
+		m_Current = std::move(next);
+		m_CurrentIndex++;
+		ResetLimits(pos);
+		return true;
+	}
+
+	/// <summary>
+	/// Sets the number of bytes written to the current segment so far, for the size limit of the policy.
+	/// </summary>
+	inline void SetCurrentSize(uint64_t bytes) { m_CurrentSize = bytes; }
+	inline TSegment &GetCurrent() { return m_Current; }
+	inline bool IsOpen() const { return m_IsOpen; }
+	inline uint32_t GetCurrentIndex() const { return m_CurrentIndex; }
+	//The timestamp on the timeline of the recording the current segment starts at. Timestamps written to the segment are relative to it.
+	inline int64_t GetCurrentStartPos() const { return m_CurrentStartPos; }
+	inline const SEGMENT_POLICY &GetPolicy() const { return m_Policy; }
+
+	/// <summary>
+	/// Finalizes the current segment on the calling thread, and waits for the finalizer thread to finish the segments before it.
+	/// </summary>
+	/// <returns>false if any segment failed to finalize</returns>
+	bool Close()
+	{
+		if (m_IsClosed) {
+			return !IsFinalizeFailed();
+		}
+		m_IsClosed = true;
+		if (m_IsOpen) {
+			m_IsOpen = false;
+			TSegment last = std::move(m_Current);
+			FinalizeSegment(last);
+		}
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_IsFinalizerRunning = false;
+		}
+		m_PendingAvailable.notify_all();
+		if (m_Thread.joinable()) {
+			m_Thread.join();
+		}
+		return !IsFinalizeFailed();
+	}
+
+	bool IsFinalizeFailed()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_IsFinalizeFailed;
+	}
+
+	size_t GetPendingCount()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Pending.size();
+	}
+
+	SEGMENT_STATS GetStats()
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		return m_Stats;
+	}
+
+private:
+	const SEGMENT_POLICY m_Policy;
+	OpenFunction m_Open;
+	FinalizeFunction m_Finalize;
+
+	//The segment being written, only used by the writing thread.
+	TSegment m_Current;
+	bool m_IsOpen;
+	uint32_t m_CurrentIndex;
+	int64_t m_CurrentStartPos;
+	uint64_t m_CurrentSize;
+	//Where the limits of the policy are counted from. The start of the segment, or the last failed attempt to open the next one.
+	int64_t m_LimitStartPos;
+	uint64_t m_LimitStartSize;
+	bool m_IsClosed;
+
+	//Segments waiting for the finalizer thread, which is started with the first rotation.
+	std::mutex m_Mutex;
+	std::condition_variable m_PendingAvailable;
+	std::deque<TSegment> m_Pending;
+	bool m_IsFinalizerRunning;
+	bool m_IsFinalizeFailed;
+	SEGMENT_STATS m_Stats;
+	std::thread m_Thread;
+
+	void ResetLimits(int64_t startPos)
+	{
+		m_CurrentStartPos = startPos;
+		m_CurrentSize = 0;
+		m_LimitStartPos = startPos;
+		m_LimitStartSize = 0;
+	}
+
+	bool OpenSegment(uint32_t index, TSegment &segment)
+	{
+		bool isOpened = m_Open(index, segment);
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (isOpened) {
+			m_Stats.OpenedCount++;
+		}
+		else {
+			m_Stats.OpenFailedCount++;
+		}
+		return isOpened;
+	}
+
+	void QueueFinalize(TSegment &&segment)
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (!m_Thread.joinable()) {
+			m_IsFinalizerRunning = true;
+			m_Thread = std::thread(&SegmentedOutput::FinalizeLoop, this);
+		}
+		m_Pending.push_back(std::move(segment));
+		m_Stats.MaxPendingCount = (std::max)(m_Stats.MaxPendingCount, m_Pending.size());
+		m_PendingAvailable.notify_one();
+	}
+
+	void FinalizeSegment(TSegment &segment)
+	{
+		auto finalizeStart = std::chrono::steady_clock::now();
+		bool isFinalized = m_Finalize(segment);
+		uint64_t finalizeTime = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - finalizeStart).count());
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		if (isFinalized) {
+			m_Stats.FinalizedCount++;
+		}
+		else {
+			m_Stats.FinalizeFailedCount++;
+			m_IsFinalizeFailed = true;
+		}
+		m_Stats.TotalFinalizeMicros += finalizeTime;
+		m_Stats.MaxFinalizeMicros = (std::max)(m_Stats.MaxFinalizeMicros, finalizeTime);
+	}
+
+	void FinalizeLoop()
+	{
+		std::unique_lock<std::mutex> lock(m_Mutex);
+		while (true) {
+			m_PendingAvailable.wait(lock, [this]() { return !m_Pending.empty() || !m_IsFinalizerRunning; });
+			if (m_Pending.empty()) {
+				break;
+			}
+			TSegment segment = std::move(m_Pending.front());
+			m_Pending.pop_front();
+			//A segment that fails to finalize does not stop the others, since each segment is a file of its own.
+			lock.unlock();
+			FinalizeSegment(segment);
+			segment = TSegment{};
+			lock.lock();
+		}
+	}
+};
@@ -12,7 +12,18 @@ TextureManager::TextureManager() :
 	m_BlendState(nullptr),
 	m_VertexShader(nullptr),
 	m_PixelShader(nullptr),
-	m_InputLayout(nullptr)
+	m_InputLayout(nullptr),
+	m_TexturePool(
+		[this](const TEXTURE_POOL_KEY &key, CComPtr<ID3D11Texture2D> *pTexture) { return SUCCEEDED(CreatePooledTexture(key, pTexture)); },
+		[](const CComPtr<ID3D11Texture2D> &pTexture) {
+			//The pool holds one reference, so any other means the texture is still in use.
+			pTexture.p->AddRef();
+			return pTexture.p->Release() > 1;
+		},
+		LeasePool<TEXTURE_POOL_KEY, CComPtr<ID3D11Texture2D>>::DEFAULT_MAX_IDLE_COUNT,
+		LeasePool<TEXTURE_POOL_KEY, CComPtr<ID3D11Texture2D>>::DEFAULT_MAX_IDLE_FRAMES,
+		//Frames are held for as long as nothing changes, e.g. the previous frame of a static desktop, so leaks are only reported at the end of a recording.
+		0)
 {
 }
 
@@ -124,7 +135,7 @@ HRESULT TextureManager::ResizeTexture(_In_ ID3D11Texture2D *pOrgTexture, _In_  S
 	CComPtr<ID3D11Texture2D> pResizedFrame = nullptr;
 	D3D11_TEXTURE2D_DESC targetDesc;
 	InitializeDesc(targetWidth, targetHeight, &targetDesc);
-	hr = m_Device->CreateTexture2D(&targetDesc, nullptr, &pResizedFrame);
+	hr = AcquireTexture(targetDesc, &pResizedFrame, true);
 	RETURN_ON_BAD_HR(hr);
 	*ppResizedTexture = pResizedFrame;
 	(*ppResizedTexture)->AddRef();
@@ -578,7 +589,12 @@ HRESULT TextureManager::CropTexture(_In_ ID3D11Texture2D *pTexture, _In_ RECT cr
 	CComPtr<ID3D11Device> pDevice;
 	pTexture->GetDevice(&pDevice);
 	CComPtr<ID3D11Texture2D> pCroppedFrameCopy = nullptr;
-	RETURN_ON_BAD_HR(pDevice->CreateTexture2D(&frameDesc, nullptr, &pCroppedFrameCopy));
+	if (pDevice.p == m_Device) {
+		RETURN_ON_BAD_HR(AcquireTexture(frameDesc, &pCroppedFrameCopy));
+	}
+	else {
+		RETURN_ON_BAD_HR(pDevice->CreateTexture2D(&frameDesc, nullptr, &pCroppedFrameCopy));
+	}
 	D3D11_BOX sourceRegion;
 	RtlZeroMemory(&sourceRegion, sizeof(sourceRegion));
 	sourceRegion.left = cropRect.left;
@@ -712,6 +728,65 @@ HRESULT TextureManager::BlankTexture(_Inout_ ID3D11Texture2D *pTexture, _In_ REC
 	return S_OK;
 }
 
+HRESULT TextureManager::AcquireTexture(_In_ const D3D11_TEXTURE2D_DESC &desc, _Outptr_ ID3D11Texture2D **ppTexture, _In_ bool clear)
+{
+	*ppTexture = nullptr;
+	//Shared textures can be held through their handles, which the pool cannot see, and textures that are not render targets cannot be cleared.
+	bool isPoolable = desc.MipLevels == 1 && desc.ArraySize == 1 && desc.SampleDesc.Count == 1
+		&& (desc.MiscFlags & (D3D11_RESOURCE_MISC_SHARED | D3D11_RESOURCE_MISC_SHARED_KEYEDMUTEX | D3D11_RESOURCE_MISC_SHARED_NTHANDLE)) == 0
+		&& (!clear || (desc.BindFlags & D3D11_BIND_RENDER_TARGET));
+	if (!isPoolable) {
+		return m_Device->CreateTexture2D(&desc, nullptr, ppTexture);
+	}
+	CComPtr<ID3D11Texture2D> pTexture;
+	bool isReused = false;
+	//Textures are acquired from more than one thread, so the result of a failed create is kept per call.
+	HRESULT createResult = E_FAIL;
+	auto create = [this, &createResult](const TEXTURE_POOL_KEY &key, CComPtr<ID3D11Texture2D> *pPooledTexture) {
+		createResult = CreatePooledTexture(key, pPooledTexture);
+		return SUCCEEDED(createResult);
+	};
+	if (!m_TexturePool.Acquire(TEXTURE_POOL_KEY{ desc }, &pTexture, &isReused, create)) {
+		return createResult;
+	}
+	if (isReused && clear) {
+		CComPtr<ID3D11RenderTargetView> pRTV;
+		RETURN_ON_BAD_HR(m_Device->CreateRenderTargetView(pTexture, nullptr, &pRTV));
+		FLOAT transparent[4] = { 0.f, 0.f, 0.f, 0.f };
+		m_DeviceContext->ClearRenderTargetView(pRTV, transparent);
+	}
+	*ppTexture = pTexture.Detach();
+	return S_OK;
+}
+
+void TextureManager::NextFrame()
+{
+	m_TexturePool.NextFrame();
+}
+
+void TextureManager::ReportLeakedTextures()
+{
+	uint64_t leakCount = m_TexturePool.ReportLeaks();
+	if (leakCount > 0) {
+		LOG_WARN(L"%llu pooled textures were not released, and may be leaked", leakCount);
+	}
+}
+
+LEASE_POOL_STATS TextureManager::GetTexturePoolStats()
+{
+	return m_TexturePool.GetStats();
+}
+
+HRESULT TextureManager::CreatePooledTexture(_In_ const TEXTURE_POOL_KEY &key, _Out_ CComPtr<ID3D11Texture2D> *pTexture)
+{
+	HRESULT hr = m_Device->CreateTexture2D(&key.Desc, nullptr, &pTexture->p);
+	if (FAILED(hr)) {
+		_com_error err(hr);
+		LOG_ERROR(L"Failed to create pooled texture: %ls", err.ErrorMessage());
+	}
+	return hr;
+}
+
 //
 // Releases all references
 //
@@ -746,4 +821,6 @@ void TextureManager::CleanRefs()
 		m_BlendState->Release();
 		m_BlendState = nullptr;
 	}
+
+	m_TexturePool.Clear();
 }
@@ -1,7 +1,23 @@
 #pragma once
 #include <DirectXMath.h>
+#include <atlbase.h>
 #include "CommonTypes.h"
 #include "DX.util.h"
+#include "LeasePool.h"
+
+/// <summary>
+/// The description of the textures in a texture pool, which a texture must match to be reused.
+/// </summary>
+struct TEXTURE_POOL_KEY
+{
+	D3D11_TEXTURE2D_DESC Desc;
+
+	bool operator<(const TEXTURE_POOL_KEY &other) const {
+		//The description only has 32 bit fields, so there is no padding to compare.
+		return memcmp(&Desc, &other.Desc, sizeof(D3D11_TEXTURE2D_DESC)) < 0;
+	}
+};
+
 class TextureManager
 {
 public:
@@ -29,10 +45,28 @@ public:
 	HRESULT CreateTexture(_In_ UINT width, _In_ UINT height, _Outptr_ ID3D11Texture2D **ppTexture, UINT miscFlag = 0, UINT bindFlag = 0);
 	HRESULT CreateTextureFromBuffer(_In_ BYTE *pFrameBuffer, _In_ LONG stride, _In_ UINT width, _In_ UINT height, _Outptr_ ID3D11Texture2D **ppTexture, UINT miscFlag = 0, UINT bindFlag = 0);
 	HRESULT BlankTexture(_Inout_ ID3D11Texture2D *pTexture, _In_ RECT rect, _In_ INT OffsetX, _In_  INT OffsetY);
+	/// <summary>
+	/// Leases a texture from the texture pool, or creates one if the pool has no free texture with the same description. The texture goes back to the pool when all references to it are released.
+	/// Textures that cannot be pooled, e.g. shared textures, are created every time.
+	/// </summary>
+	/// <param name="desc">The description of the texture</param>
+	/// <param name="ppTexture">The texture</param>
+	/// <param name="clear">Whether a reused texture is cleared to transparent black, like a new texture. Otherwise it has the content of its previous use, so it must be overwritten. Textures that are not render targets are not reused when this is set</param>
+	HRESULT AcquireTexture(_In_ const D3D11_TEXTURE2D_DESC &desc, _Outptr_ ID3D11Texture2D **ppTexture, _In_ bool clear = false);
+	/// <summary>
+	/// Starts the next frame of the texture pool, which trims textures that were not used for a while.
+	/// </summary>
+	void NextFrame();
+	/// <summary>
+	/// Logs the pooled textures that are still in use. Called when all frames should have been released, at the end of a recording.
+	/// </summary>
+	void ReportLeakedTextures();
+	LEASE_POOL_STATS GetTexturePoolStats();
 private:
 	HRESULT InitializeDesc(_In_ UINT width, _In_ UINT height, _Out_ D3D11_TEXTURE2D_DESC *pTargetDesc);
 	void ConfigureRotationVertices(_Inout_ VERTEX(&vertices)[6], _In_ RECT textureRect, _In_opt_ DXGI_MODE_ROTATION rotation = DXGI_MODE_ROTATION_UNSPECIFIED);
 	void CleanRefs();
+	HRESULT CreatePooledTexture(_In_ const TEXTURE_POOL_KEY &key, _Out_ CComPtr<ID3D11Texture2D> *pTexture);
 
 	ID3D11Device *m_Device;
 	ID3D11DeviceContext *m_DeviceContext;
@@ -41,5 +75,6 @@ private:
 	ID3D11VertexShader *m_VertexShader;
 	ID3D11PixelShader *m_PixelShader;
 	ID3D11InputLayout *m_InputLayout;
+	LeasePool<TEXTURE_POOL_KEY, CComPtr<ID3D11Texture2D>> m_TexturePool;
 };
 
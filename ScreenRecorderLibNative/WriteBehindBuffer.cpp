@@ -0,0 +1,188 @@
+#include "WriteBehindBuffer.h"
+#include <algorithm>
+#include <cstring>
+
+WriteBehindBuffer::WriteBehindBuffer(WriteFunction write, SeekFunction seek, uint64_t position, uint64_t length, size_t chunkSize, size_t maxPendingChunks) :
+	m_Write(write),
+	m_Seek(seek),
+	m_ChunkSize((std::max)(chunkSize, size_t(1))),
+	m_MaxPendingChunks((std::max)(maxPendingChunks, size_t(1))),
+	m_Position(position),
+	m_Length(length),
+	m_Open{},
+	m_TargetPosition(position),
+	m_IsFlushing(false),
+	m_IsStopping(false),
+	m_IsFailed(false),
+	m_Stats{}
+{
+	m_Thread = std::thread(&WriteBehindBuffer::FlushLoop, this);
+}
+
+WriteBehindBuffer::~WriteBehindBuffer()
+{
+	Flush();
+	{
+		std::lock_guard<std::mutex> lock(m_Mutex);
+		m_IsStopping = true;
+	}
+	m_ChunkQueued.notify_all();
+	m_Thread.join();
+}
+
+bool WriteBehindBuffer::Write(const uint8_t *pData, size_t size)
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	if (m_IsFailed) {
+		return false;
+	}
+	m_Stats.WriteCount++;
+	m_Stats.WrittenBytes += size;
+	if (size == 0) {
+		return true;
+	}
+	uint64_t position = m_Position;
+	m_Position += size;
+	m_Length = (std::max)(m_Length, m_Position);
+
+	if (!m_Open.Data.empty() && position >= m_Open.Offset && position <= m_Open.End()) {
+		//Appends to the open chunk, or overwrites the end of it and appends the rest.
+		size_t overlap = static_cast<size_t>((std::min)(static_cast<uint64_t>(size), m_Open.End() - position));
+		memcpy(m_Open.Data.data() + (position - m_Open.Offset), pData, overlap);
+		m_Open.Data.insert(m_Open.Data.end(), pData + overlap, pData + size);
+	}
+	else if (TryPatch(position, pData, size)) {
+		m_Stats.PatchCount++;
+		return true;
+	}
+	else {
+		if (!m_Open.Data.empty()) {
+			QueueOpenChunk(lock);
+		}
+		m_Open.Offset = position;
+		m_Open.Data.reserve((std::max)(m_ChunkSize, size));
+		m_Open.Data.assign(pData, pData + size);
+	}
+	if (m_Open.Data.size() >= m_ChunkSize) {
+		QueueOpenChunk(lock);
+	}
+	return !m_IsFailed;
+}
+
+bool WriteBehindBuffer::Flush()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	if (!m_Open.Data.empty()) {
+		QueueOpenChunk(lock);
+	}
+	m_ChunkFlushed.wait(lock, [this] { return m_Pending.empty() && !m_IsFlushing; });
+	if (!m_IsFailed && m_TargetPosition != m_Position) {
+		if (m_Seek(m_Position)) {
+			m_TargetPosition = m_Position;
+			m_Stats.TargetSeekCount++;
+		}
+		else {
+			m_IsFailed = true;
+		}
+	}
+	return !m_IsFailed;
+}
+
+void WriteBehindBuffer::Reset(uint64_t position, uint64_t length)
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	m_Position = position;
+	m_TargetPosition = position;
+	m_Length = length;
+}
+
+bool WriteBehindBuffer::IsFailed()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_IsFailed;
+}
+
+WRITE_BEHIND_STATS WriteBehindBuffer::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_Mutex);
+	return m_Stats;
+}
+
+bool WriteBehindBuffer::TryPatch(uint64_t position, const uint8_t *pData, size_t size)
+{
+	//Only the newest chunk that holds any of the bytes can be patched, or an older write would end up on top of a newer one.
+	uint64_t end = position + size;
+	auto overlaps = [position, end](const CHUNK &chunk) { return !chunk.Data.empty() && position < chunk.End() && end > chunk.Offset; };
+	if (overlaps(m_Open)) {
+		return false;
+	}
+	for (auto chunk = m_Pending.rbegin(); chunk != m_Pending.rend(); chunk++) {
+		if (overlaps(*chunk)) {
+			if (position < chunk->Offset || end > chunk->End()) {
+				return false;
+			}
+			memcpy(chunk->Data.data() + (position - chunk->Offset), pData, size);
+			return true;
+		}
+	}
+	return false;
+}
+
+void WriteBehindBuffer::QueueOpenChunk(std::unique_lock<std::mutex> &lock)
+{
+	if (m_Pending.size() >= m_MaxPendingChunks) {
+		m_Stats.StallCount++;
+		m_ChunkFlushed.wait(lock, [this] { return m_Pending.size() < m_MaxPendingChunks; });
+	}
+	m_Pending.push_back(std::move(m_Open));
+	m_Open = CHUNK{};
+	m_ChunkQueued.notify_one();
+}
+
+bool WriteBehindBuffer::WriteToTarget(const CHUNK &chunk, bool *pIsSeeked)
+{
+	*pIsSeeked = false;
+	if (m_TargetPosition != chunk.Offset) {
+		if (!m_Seek(chunk.Offset)) {
+			return false;
+		}
+		m_TargetPosition = chunk.Offset;
+		*pIsSeeked = true;
+	}
+	if (!m_Write(chunk.Data.data(), chunk.Data.size())) {
+		return false;
+	}
+	m_TargetPosition = chunk.End();
+	return true;
+}
+
+void WriteBehindBuffer::FlushLoop()
+{
+	std::unique_lock<std::mutex> lock(m_Mutex);
+	while (true) {
+		m_ChunkQueued.wait(lock, [this] { return m_IsStopping || !m_Pending.empty(); });
+		if (m_Pending.empty()) {
+			return;
+		}
+		CHUNK chunk = std::move(m_Pending.front());
+		m_Pending.pop_front();
+		m_IsFlushing = true;
+		//After a failure the remaining chunks are discarded, since the target is in an unknown state.
+		bool isFailed = m_IsFailed;
+		lock.unlock();
+		bool isSeeked = false;
+		bool isWritten = !isFailed && WriteToTarget(chunk, &isSeeked);
+		lock.lock();
+		m_IsFlushing = false;
+		if (!isFailed) {
+			m_Stats.TargetSeekCount += isSeeked ? 1 : 0;
+			if (isWritten) {
+				m_Stats.TargetWriteCount++;
+			}
+			else {
+				m_IsFailed = true;
+			}
+		}
+		m_ChunkFlushed.notify_all();
+	}
+}
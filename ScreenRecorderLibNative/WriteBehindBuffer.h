@@ -0,0 +1,121 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct WRITE_BEHIND_STATS
+{
+	//The number of writes received, and the bytes in them.
+	uint64_t WriteCount = 0;
+	uint64_t WrittenBytes = 0;
+	//The number of writes and seeks passed on to the target.
+	uint64_t TargetWriteCount = 0;
+	uint64_t TargetSeekCount = 0;
+	//The number of writes that overwrote data still waiting to be flushed, e.g. box sizes patched by a muxer, instead of becoming a write of their own.
+	uint64_t PatchCount = 0;
+	//The number of times a write waited for the flush thread, because the buffer was full.
+	uint64_t StallCount = 0;
+
+	inline double GetAverageTargetWriteSize() const { return TargetWriteCount > 0 ? (double)WrittenBytes / TargetWriteCount : 0; }
+};
+
+/// <summary>
+/// Combines many small writes to a seekable output into a few large ones, which are written on a background thread.
+/// Writes are collected in chunks of consecutive bytes. A chunk is handed to the flush thread when it is full, or when a write goes elsewhere in the output.
+/// Seeks only move the position of the buffer, and reach the target as part of the next chunk written. Writes into data that is still buffered, such as a muxer patching the size of a box it just wrote, overwrite the buffered data instead.
+/// The target always ends up with the same content as if every write had gone to it directly, in order.
+/// All methods but GetStats must be called from a single thread at a time. The target functions are only called from the flush thread, or from Flush.
+/// </summary>
+class WriteBehindBuffer
+{
+public:
+	//Writes the next bytes at the current position of the target. Returns false if the write failed.
+	typedef std::function<bool(const uint8_t *pData, size_t size)> WriteFunction;
+	//Moves the current position of the target. Returns false if the seek failed.
+	typedef std::function<bool(uint64_t position)> SeekFunction;
+
+	static constexpr size_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+	static constexpr size_t DEFAULT_MAX_PENDING_CHUNKS = 8;
+
+	/// <param name="write">Writes to the target</param>
+	/// <param name="seek">Seeks the target</param>
+	/// <param name="position">The current position of the target</param>
+	/// <param name="length">The current length of the target</param>
+	/// <param name="chunkSize">The size at which a chunk is handed to the flush thread</param>
+	/// <param name="maxPendingChunks">The number of chunks that can wait for the flush thread before writes wait for it</param>
+	WriteBehindBuffer(WriteFunction write, SeekFunction seek, uint64_t position, uint64_t length,
+		size_t chunkSize = DEFAULT_CHUNK_SIZE, size_t maxPendingChunks = DEFAULT_MAX_PENDING_CHUNKS);
+	/// <summary>
+	/// Flushes the buffer and stops the flush thread.
+	/// </summary>
+	~WriteBehindBuffer();
+
+	WriteBehindBuffer(const WriteBehindBuffer &) = delete;
+	WriteBehindBuffer &operator=(const WriteBehindBuffer &) = delete;
+
+	/// <summary>
+	/// Writes at the current position, and moves the position past the written bytes.
+	/// </summary>
+	/// <returns>false if an earlier write to the target failed. Failures of the target are reported by the next call after them</returns>
+	bool Write(const uint8_t *pData, size_t size);
+	void SetPosition(uint64_t position) { m_Position = position; }
+	uint64_t GetPosition() const { return m_Position; }
+	//The length of the output, including the buffered writes.
+	uint64_t GetLength() const { return m_Length; }
+	/// <summary>
+	/// Writes everything buffered to the target and waits for it, and seeks the target to the current position, so the target can be used directly until the next write.
+	/// </summary>
+	/// <returns>false if a write or seek to the target failed</returns>
+	bool Flush();
+	/// <summary>
+	/// Sets the position and length after the target was used directly, e.g. read from or truncated. Only valid right after Flush.
+	/// </summary>
+	void Reset(uint64_t position, uint64_t length);
+	bool IsFailed();
+	WRITE_BEHIND_STATS GetStats();
+
+private:
+	struct CHUNK
+	{
+		uint64_t Offset = 0;
+		std::vector<uint8_t> Data;
+
+		inline uint64_t End() const { return Offset + Data.size(); }
+	};
+
+	WriteFunction m_Write;
+	SeekFunction m_Seek;
+	const size_t m_ChunkSize;
+	const size_t m_MaxPendingChunks;
+	uint64_t m_Position;
+	uint64_t m_Length;
+	//The chunk writes are added to. Only used by the writing thread.
+	CHUNK m_Open;
+	//Chunks waiting for the flush thread, oldest first.
+	std::deque<CHUNK> m_Pending;
+	//The position of the target. Only used by the flush thread, and by Flush while the flush thread is idle.
+	uint64_t m_TargetPosition;
+	bool m_IsFlushing;
+	bool m_IsStopping;
+	bool m_IsFailed;
+	WRITE_BEHIND_STATS m_Stats;
+	std::mutex m_Mutex;
+	//Signaled when a chunk is queued or the buffer stops.
+	std::condition_variable m_ChunkQueued;
+	//Signaled when the flush thread has written a chunk.
+	std::condition_variable m_ChunkFlushed;
+	std::thread m_Thread;
+
+	//Overwrites buffered data with a write that falls within it. Returns false if the write is not covered by the newest buffered data at its position.
+	bool TryPatch(uint64_t position, const uint8_t *pData, size_t size);
+	//Queues the open chunk for the flush thread. Must be called with m_Mutex locked.
+	void QueueOpenChunk(std::unique_lock<std::mutex> &lock);
+	//Writes a chunk on the flush thread, and seeks the target first if the chunk is elsewhere.
+	bool WriteToTarget(const CHUNK &chunk, bool *pIsSeeked);
+	void FlushLoop();
+};
@@ -1,6 +1,7 @@
 // Cleanup.h
 #pragma once
 #include <audioclient.h>
+#include <d3d10.h>
 #include "WWMFResampler.h"
 #include "Log.h"
 #include "ScreenCaptureManager.h"
@@ -249,6 +250,20 @@ private:
 	UINT64 m_key;
 };
 
+//Leaves the lock of a multithread protected device, which is entered so a sequence of calls on the device context, such as setting up a draw and drawing, is not interleaved with calls from other threads.
+class LeaveMultithreadOnExit {
+public:
+	LeaveMultithreadOnExit(ID3D10Multithread *p) : m_p(p) {}
+	~LeaveMultithreadOnExit() {
+		if (m_p) {
+			m_p->Leave();
+		}
+	}
+
+private:
+	ID3D10Multithread *m_p;
+};
+
 class ReleaseMutexHandleOnExit {
 public:
 	ReleaseMutexHandleOnExit(HANDLE p) : m_p(p) {}
@@ -4,6 +4,7 @@
 #include "Log.h"
 #include <atlbase.h>
 #include "Cleanup.h"
+#include "QoiEncoder.h"
 namespace {
 	bool g_WIC2 = false;
 
@@ -183,6 +184,28 @@ namespace {
 		}
 		return S_OK;
 	}
+
+	HRESULT EncodeQoiImage(
+		_In_ DXGI_FORMAT format,
+		_In_ UINT width,
+		_In_ UINT height,
+		_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+		_In_ UINT rowPitch,
+		_In_ UINT threadCount,
+		_Out_ std::vector<uint8_t> *pImage)
+	{
+		if (!pData)
+			return E_INVALIDARG;
+
+		// Captured frames are BGRA, and screenshots leave out the alpha channel like the WIC path does
+		if (format != DXGI_FORMAT_B8G8R8A8_UNORM && format != DXGI_FORMAT_B8G8R8X8_UNORM)
+			return HRESULT_FROM_WIN32(ERROR_NOT_SUPPORTED);
+
+		if (!QoiEncoder::Encode(pData, width, height, rowPitch, false, threadCount, pImage))
+			return E_INVALIDARG;
+
+		return S_OK;
+	}
 } // anonymous namespace
 
 HRESULT __cdecl SaveWICTextureToFile(
@@ -248,6 +271,41 @@ HRESULT __cdecl SaveWICTextureToStream(
 	return hr;
 }
 
+HRESULT __cdecl SaveWICImageToFile(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath,
+	_In_opt_ const std::optional<SIZE> destSize,
+	_In_opt_ const GUID *targetFormat,
+	_In_opt_ std::function<void(IPropertyBag2 *)> setCustomProps)
+{
+	if (!filePath)
+		return E_INVALIDARG;
+
+	CComPtr<IWICImagingFactory> pWIC = _GetWIC();
+	if (!pWIC)
+		return E_NOINTERFACE;
+
+	CComPtr<IWICStream> wicStream;
+	HRESULT hr = pWIC->CreateStream(&wicStream);
+	if (FAILED(hr))
+		return hr;
+
+	hr = wicStream->InitializeFromFilename(filePath, GENERIC_WRITE);
+	if (FAILED(hr))
+		return hr;
+	hr = SaveWICImageToWicStream(format, width, height, pData, rowPitch, guidContainerFormat, wicStream, destSize, targetFormat, setCustomProps);
+	if (FAILED(hr)) {
+		wicStream.Release();
+		DeleteFileW(filePath);
+	}
+	return hr;
+}
+
 HRESULT __cdecl SaveWICTextureToWicStream(
 	_In_ ID3D11DeviceContext *pContext,
 	_In_ ID3D11Resource *pSource,
@@ -266,10 +324,36 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 	if (FAILED(hr))
 		return hr;
 
+	D3D11_MAPPED_SUBRESOURCE mapped;
+	hr = pContext->Map(pStaging, 0, D3D11_MAP_READ, 0, &mapped);
+	if (FAILED(hr))
+		return hr;
+
+	hr = SaveWICImageToWicStream(desc.Format, desc.Width, desc.Height, reinterpret_cast<const BYTE *>(mapped.pData), mapped.RowPitch,
+		guidContainerFormat, pStream, destSize, targetFormat, setCustomProps);
+	pContext->Unmap(pStaging, 0);
+	return hr;
+}
+
+HRESULT __cdecl SaveWICImageToWicStream(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ REFGUID guidContainerFormat,
+	_Inout_ IWICStream *pStream,
+	_In_opt_ const std::optional<SIZE> destSize,
+	_In_opt_ const GUID *targetFormat,
+	_In_opt_ std::function<void(IPropertyBag2 *)> setCustomProps)
+{
+	if (!pStream || !pData)
+		return E_INVALIDARG;
+
 	// Determine source format's WIC equivalent
 	WICPixelFormatGUID pfGuid;
 	bool sRGB = false;
-	switch (desc.Format)
+	switch (format)
 	{
 	case DXGI_FORMAT_R32G32B32A32_FLOAT:            pfGuid = GUID_WICPixelFormat128bppRGBAFloat; break;
 	case DXGI_FORMAT_R16G16B16A16_FLOAT:            pfGuid = GUID_WICPixelFormat64bppRGBAHalf; break;
@@ -320,7 +404,7 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 		return E_NOINTERFACE;
 
 	CComPtr<IWICBitmapEncoder> encoder;
-	hr = pWIC->CreateEncoder(guidContainerFormat, 0, &encoder);
+	HRESULT hr = pWIC->CreateEncoder(guidContainerFormat, 0, &encoder);
 	if (FAILED(hr))
 		return hr;
 
@@ -355,11 +439,11 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 	if (FAILED(hr))
 		return hr;
 
-	int outputWidth = desc.Width;
-	int outputHeight = desc.Height;
+	UINT outputWidth = width;
+	UINT outputHeight = height;
 	if (destSize.has_value()) {
-		outputWidth = destSize.value().cx;
-		outputHeight = destSize.value().cy;
+		outputWidth = static_cast<UINT>(destSize.value().cx);
+		outputHeight = static_cast<UINT>(destSize.value().cy);
 	}
 
 	hr = frame->SetSize(outputWidth, outputHeight);
@@ -379,7 +463,7 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 	else
 	{
 		// Screenshots dont typically include the alpha channel of the render target
-		switch (desc.Format)
+		switch (format)
 		{
 #if (_WIN32_WINNT >= _WIN32_WINNT_WIN8) || defined(_WIN7_PLATFORM_UPDATE)
 		case DXGI_FORMAT_R32G32B32A32_FLOAT:
@@ -461,27 +545,18 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 		}
 	}
 
-	D3D11_MAPPED_SUBRESOURCE mapped;
-	hr = pContext->Map(pStaging, 0, D3D11_MAP_READ, 0, &mapped);
-	if (FAILED(hr))
-		return hr;
-
-
 	CComPtr<IWICBitmap> source;
-	hr = pWIC->CreateBitmapFromMemory(desc.Width, desc.Height, pfGuid,
-		mapped.RowPitch, mapped.RowPitch * desc.Height,
-		reinterpret_cast<BYTE *>(mapped.pData), &source);
+	hr = pWIC->CreateBitmapFromMemory(width, height, pfGuid,
+		rowPitch, rowPitch * height,
+		const_cast<BYTE *>(pData), &source);
 	if (FAILED(hr))
-	{
-		pContext->Unmap(pStaging, 0);
 		return hr;
-	}
 	CComPtr<IWICBitmapScaler> bitmapScaler;
 	hr = pWIC->CreateBitmapScaler(&bitmapScaler);
 	if (FAILED(hr))
 		return hr;
 	CComPtr<IWICBitmapSource> imageSource;
-	if (outputWidth != desc.Width || outputHeight != desc.Height) {
+	if (outputWidth != width || outputHeight != height) {
 		bitmapScaler->Initialize(source, outputWidth, outputHeight, WICBitmapInterpolationMode::WICBitmapInterpolationModeNearestNeighbor);
 		imageSource = bitmapScaler;
 	}
@@ -494,10 +569,7 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 		CComPtr<IWICFormatConverter> FC;
 		hr = pWIC->CreateFormatConverter(&FC);
 		if (FAILED(hr))
-		{
-			pContext->Unmap(pStaging, 0);
 			return hr;
-		}
 
 		BOOL canConvert = FALSE;
 		hr = FC->CanConvert(pfGuid, targetGuid, &canConvert);
@@ -508,16 +580,12 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 
 		hr = FC->Initialize(imageSource, targetGuid, WICBitmapDitherTypeNone, 0, 0, WICBitmapPaletteTypeMedianCut);
 		if (FAILED(hr))
-		{
-			pContext->Unmap(pStaging, 0);
 			return hr;
-		}
 		imageSource.Release();
 		imageSource = FC;
 	}
 
 	hr = frame->WriteSource(imageSource, NULL);
-	pContext->Unmap(pStaging, 0);
 	if (FAILED(hr))
 		return hr;
 
@@ -532,6 +600,63 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 	return S_OK;
 }
 
+HRESULT __cdecl SaveQoiImageToFile(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT threadCount,
+	_In_z_ const wchar_t *filePath)
+{
+	if (!filePath)
+		return E_INVALIDARG;
+
+	std::vector<uint8_t> image;
+	HRESULT hr = EncodeQoiImage(format, width, height, pData, rowPitch, threadCount, &image);
+	if (FAILED(hr))
+		return hr;
+
+	HANDLE hFile = CreateFileW(filePath, GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return HRESULT_FROM_WIN32(GetLastError());
+
+	DWORD written = 0;
+	if (!WriteFile(hFile, image.data(), static_cast<DWORD>(image.size()), &written, nullptr) || written != image.size()) {
+		hr = HRESULT_FROM_WIN32(GetLastError());
+		hr = FAILED(hr) ? hr : E_FAIL;
+	}
+	CloseHandle(hFile);
+	if (FAILED(hr)) {
+		DeleteFileW(filePath);
+	}
+	return hr;
+}
+
+HRESULT __cdecl SaveQoiImageToStream(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT threadCount,
+	_In_ IStream *pStream)
+{
+	if (!pStream)
+		return E_INVALIDARG;
+
+	std::vector<uint8_t> image;
+	HRESULT hr = EncodeQoiImage(format, width, height, pData, rowPitch, threadCount, &image);
+	if (FAILED(hr))
+		return hr;
+
+	ULONG written = 0;
+	hr = pStream->Write(image.data(), static_cast<ULONG>(image.size()), &written);
+	if (SUCCEEDED(hr) && written != image.size())
+		return STG_E_WRITEFAULT;
+	return hr;
+}
+
 HRESULT CreateWICBitmapFromFile(_In_z_ const wchar_t *filePath, _In_ const GUID targetFormat, _Outptr_ IWICBitmapSource **ppIWICBitmapSource)
 {
 	HRESULT hr = S_OK;
@@ -33,6 +33,48 @@ HRESULT __cdecl SaveWICTextureToWicStream(
 	_In_opt_ const GUID *targetFormat = nullptr,
 	_In_opt_ std::function<void __cdecl(IPropertyBag2 *)> setCustomProps = nullptr);
 
+HRESULT __cdecl SaveWICImageToFile(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ REFGUID guidContainerFormat,
+	_In_z_ const wchar_t *filePath,
+	_In_opt_ const std::optional<SIZE> destSize = std::nullopt,
+	_In_opt_ const GUID *targetFormat = nullptr,
+	_In_opt_ std::function<void __cdecl(IPropertyBag2 *)> setCustomProps = nullptr);
+
+HRESULT __cdecl SaveWICImageToWicStream(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ REFGUID guidContainerFormat,
+	_In_ IWICStream *pStream,
+	_In_opt_ const std::optional<SIZE> destSize = std::nullopt,
+	_In_opt_ const GUID *targetFormat = nullptr,
+	_In_opt_ std::function<void __cdecl(IPropertyBag2 *)> setCustomProps = nullptr);
+
+HRESULT __cdecl SaveQoiImageToFile(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT threadCount,
+	_In_z_ const wchar_t *filePath);
+
+HRESULT __cdecl SaveQoiImageToStream(
+	_In_ DXGI_FORMAT format,
+	_In_ UINT width,
+	_In_ UINT height,
+	_In_reads_bytes_(rowPitch * height) const BYTE *pData,
+	_In_ UINT rowPitch,
+	_In_ UINT threadCount,
+	_In_ IStream *pStream);
+
 HRESULT CreateWICBitmapFromFile(
 	_In_z_ const wchar_t *filePath,
 	_In_ const GUID targetFormat,
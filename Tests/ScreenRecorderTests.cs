@@ -745,6 +745,61 @@ namespace ScreenRecorderLib
             }
         }
 
+        [TestMethod]
+        [DataRow(DuplicateFrameMode.Reference)]
+        [DataRow(DuplicateFrameMode.Extend)]
+        public void FixedFramerateDuplicateFrames(DuplicateFrameMode duplicateFrameMode)
+        {
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".mp4"));
+            try
+            {
+                using (var outStream = File.Open(filePath, FileMode.Create, FileAccess.ReadWrite, FileShare.Read))
+                {
+                    RecorderOptions options = new RecorderOptions();
+                    options.VideoEncoderOptions = new VideoEncoderOptions { IsFixedFramerate = true, DuplicateFrameMode = duplicateFrameMode };
+                    options.VideoEncoderOptions.Framerate = 10;
+                    using (var rec = Recorder.CreateRecorder(options))
+                    {
+                        string error = "";
+                        bool isError = false;
+                        bool isComplete = false;
+                        ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                        ManualResetEvent recordingResetEvent = new ManualResetEvent(false);
+                        rec.OnRecordingComplete += (s, args) =>
+                        {
+                            isComplete = true;
+                            finalizeResetEvent.Set();
+                        };
+                        rec.OnRecordingFailed += (s, args) =>
+                        {
+                            isError = true;
+                            error = args.Error;
+                            finalizeResetEvent.Set();
+                            recordingResetEvent.Set();
+                        };
+                        int durationMillis = 5000;
+                        rec.Record(outStream);
+                        recordingResetEvent.WaitOne(durationMillis);
+                        rec.Stop();
+                        finalizeResetEvent.WaitOne(5000);
+                        outStream.Flush();
+                        Assert.IsFalse(isError, error);
+                        Assert.IsTrue(isComplete);
+                        Assert.AreNotEqual(outStream.Length, 0);
+                        var mediaInfo = new MediaInfoWrapper(filePath);
+                        //Repeated frames are counted as recorded, also when they are merged into the frame before.
+                        int estimatedFrameCount = (int)Math.Floor(options.VideoEncoderOptions.Framerate * ((double)durationMillis / 1000));
+                        Assert.IsTrue(Math.Abs(rec.CurrentFrameNumber - estimatedFrameCount) <= 2, "Recorder framenumber {0} not equal to estimated frame number {1}", rec.CurrentFrameNumber, estimatedFrameCount);
+                        Assert.IsTrue(Math.Abs(mediaInfo.Duration - durationMillis) <= 1000, "MediaInfo duration {0} not equal to recording duration {1}", mediaInfo.Duration, durationMillis);
+                    }
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
         [TestMethod]
         public void CustomFixedBitrate()
         {
@@ -959,6 +1014,62 @@ namespace ScreenRecorderLib
             }
         }
 
+        [TestMethod]
+        [DataRow(RecorderApi.DesktopDuplication)]
+        [DataRow(RecorderApi.WindowsGraphicsCapture)]
+        public void ScreenshotQoi(RecorderApi api)
+        {
+            RecorderOptions options = new RecorderOptions();
+            options.OutputOptions = new OutputOptions
+            {
+                RecorderMode = RecorderMode.Screenshot,
+                SourceRect = new ScreenRect(100, 100, 200, 200)
+            };
+            options.SnapshotOptions = new SnapshotOptions { SnapshotFormat = ImageFormat.QOI };
+            options.SourceOptions = new SourceOptions { RecordingSources = { new DisplayRecordingSource { DeviceName = DisplayRecordingSource.MainMonitor.DeviceName, RecorderApi = api } } };
+            string filePath = Path.Combine(GetTempPath(), Path.ChangeExtension(Path.GetRandomFileName(), ".qoi"));
+            try
+            {
+                using (var rec = Recorder.CreateRecorder(options))
+                {
+                    string error = "";
+                    bool isError = false;
+                    bool isComplete = false;
+                    ManualResetEvent finalizeResetEvent = new ManualResetEvent(false);
+                    rec.OnRecordingComplete += (s, args) =>
+                    {
+                        isComplete = true;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.OnRecordingFailed += (s, args) =>
+                    {
+                        isError = true;
+                        error = args.Error;
+                        finalizeResetEvent.Set();
+                    };
+                    rec.Record(filePath);
+                    finalizeResetEvent.WaitOne(5000);
+
+                    Assert.IsFalse(isError, error);
+                    Assert.IsTrue(isComplete);
+                    byte[] file = File.ReadAllBytes(filePath);
+                    //14 byte header and 8 byte end marker.
+                    Assert.IsTrue(file.Length > 22);
+                    Assert.AreEqual("qoif", System.Text.Encoding.ASCII.GetString(file, 0, 4));
+                    int width = file[4] << 24 | file[5] << 16 | file[6] << 8 | file[7];
+                    int height = file[8] << 24 | file[9] << 16 | file[10] << 8 | file[11];
+                    Assert.AreEqual((int)options.OutputOptions.SourceRect.Width, width);
+                    Assert.AreEqual((int)options.OutputOptions.SourceRect.Height, height);
+                    Assert.AreEqual(3, file[12]);
+                    CollectionAssert.AreEqual(new byte[] { 0, 0, 0, 0, 0, 0, 0, 1 }, file.Skip(file.Length - 8).ToArray());
+                }
+            }
+            finally
+            {
+                File.Delete(filePath);
+            }
+        }
+
         [TestMethod]
         public void Slideshow()
         {
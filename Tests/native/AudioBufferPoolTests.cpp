@@ -0,0 +1,147 @@
+#include "TestHarness.h"
+#include "AudioBufferPool.h"
+#include <thread>
+
+TEST_CASE(AcquireRoundsCapacityUpToSizeClass)
+{
+	auto pool = AudioBufferPool::Create();
+	AudioBufferRef buffer = pool->Acquire(5000);
+	CHECK(buffer);
+	CHECK(!buffer->IsSilent());
+	CHECK_EQUAL(8192, buffer->GetCapacity());
+	CHECK_EQUAL(5000, buffer.GetSize());
+	buffer->SetSize(100000);
+	CHECK_EQUAL(8192, buffer.GetSize());
+	//Requests below the smallest size class get a 4 KB buffer.
+	CHECK_EQUAL(4096, pool->Acquire(1)->GetCapacity());
+}
+
+TEST_CASE(ReleasedBuffersAreReused)
+{
+	auto pool = AudioBufferPool::Create();
+	AudioBuffer *pFirst;
+	{
+		AudioBufferRef buffer = pool->Acquire(3840);
+		pFirst = buffer.Get();
+		CHECK_EQUAL(1, pool->GetStats().OutstandingCount);
+	}
+	AUDIO_BUFFER_POOL_STATS stats = pool->GetStats();
+	CHECK_EQUAL(0, stats.OutstandingCount);
+	CHECK_EQUAL(4096, stats.IdleBytes);
+	AudioBufferRef buffer = pool->Acquire(4000);
+	CHECK(buffer.Get() == pFirst);
+	stats = pool->GetStats();
+	CHECK_EQUAL(2, stats.AcquireCount);
+	CHECK_EQUAL(1, stats.AllocationCount);
+	CHECK_EQUAL(0, stats.IdleBytes);
+}
+
+TEST_CASE(CopiesShareTheBufferUntilTheLastIsReleased)
+{
+	auto pool = AudioBufferPool::Create();
+	AudioBufferRef buffer = pool->Acquire(100);
+	AudioBufferRef copy = buffer;
+	AudioBufferRef moved = std::move(copy);
+	CHECK(!copy);
+	buffer.Reset();
+	CHECK_EQUAL(1, pool->GetStats().OutstandingCount);
+	moved = nullptr;
+	CHECK_EQUAL(0, pool->GetStats().OutstandingCount);
+}
+
+TEST_CASE(IdleBuffersBeyondTheLimitAreFreed)
+{
+	auto pool = AudioBufferPool::Create(2);
+	{
+		std::vector<AudioBufferRef> buffers;
+		for (int i = 0; i < 5; i++) {
+			buffers.push_back(pool->Acquire(4096));
+		}
+	}
+	AUDIO_BUFFER_POOL_STATS stats = pool->GetStats();
+	CHECK_EQUAL(3, stats.FreeCount);
+	CHECK_EQUAL(2 * 4096, stats.IdleBytes);
+	pool->Trim();
+	stats = pool->GetStats();
+	CHECK_EQUAL(5, stats.FreeCount);
+	CHECK_EQUAL(0, stats.IdleBytes);
+}
+
+TEST_CASE(OversizedBuffersAreNotKept)
+{
+	auto pool = AudioBufferPool::Create();
+	size_t size = (static_cast<size_t>(16) << 20) + 1;
+	pool->Acquire(size).Reset();
+	AUDIO_BUFFER_POOL_STATS stats = pool->GetStats();
+	CHECK_EQUAL(1, stats.FreeCount);
+	CHECK_EQUAL(0, stats.IdleBytes);
+}
+
+TEST_CASE(SilentBuffersHaveNoDataUntilMaterialized)
+{
+	auto pool = AudioBufferPool::Create();
+	AudioBufferRef silence = pool->AcquireSilence(1920);
+	CHECK(silence->IsSilent());
+	CHECK(silence->GetData() == nullptr);
+	CHECK_EQUAL(1920, silence.GetSize());
+	AudioBufferRef materialized = AudioBufferPool::Materialize(silence);
+	CHECK(materialized);
+	CHECK(!materialized->IsSilent());
+	CHECK_EQUAL(1920, materialized.GetSize());
+	for (size_t i = 0; i < materialized.GetSize(); i++) {
+		CHECK_EQUAL(0, materialized->GetData()[i]);
+	}
+	AUDIO_BUFFER_POOL_STATS stats = pool->GetStats();
+	CHECK_EQUAL(1, stats.SilentCount);
+	CHECK_EQUAL(1, stats.MaterializedCount);
+	//A buffer with data is returned as it is.
+	CHECK(AudioBufferPool::Materialize(materialized).Get() == materialized.Get());
+}
+
+TEST_CASE(BuffersKeepThePoolAlive)
+{
+	auto pool = AudioBufferPool::Create();
+	std::weak_ptr<AudioBufferPool> weakPool = pool;
+	AudioBufferRef buffer = pool->Acquire(100);
+	pool.reset();
+	CHECK(!weakPool.expired());
+	buffer.Reset();
+	CHECK(weakPool.expired());
+}
+
+TEST_CASE(BuffersCanBeReleasedOnAnotherThread)
+{
+	auto pool = AudioBufferPool::Create();
+	const int count = 20000;
+	std::vector<AudioBufferRef> buffers;
+	std::mutex mutex;
+	bool isDone = false;
+	std::thread consumer([&]() {
+		while (true) {
+			std::vector<AudioBufferRef> released;
+			{
+				std::scoped_lock lock(mutex);
+				released.swap(buffers);
+				if (released.empty() && isDone) {
+					return;
+				}
+			}
+			if (released.empty()) {
+				std::this_thread::yield();
+			}
+		}
+	});
+	for (int i = 0; i < count; i++) {
+		AudioBufferRef buffer = i % 3 == 0 ? pool->AcquireSilence(1920) : pool->Acquire(1920 + i % 5000);
+		std::scoped_lock lock(mutex);
+		buffers.push_back(std::move(buffer));
+	}
+	{
+		std::scoped_lock lock(mutex);
+		isDone = true;
+	}
+	consumer.join();
+	AUDIO_BUFFER_POOL_STATS stats = pool->GetStats();
+	CHECK_EQUAL(count, stats.AcquireCount);
+	CHECK_EQUAL(0, stats.OutstandingCount);
+}
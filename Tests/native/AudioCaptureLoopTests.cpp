@@ -0,0 +1,204 @@
+#include "TestHarness.h"
+#include "AudioCaptureLoop.h"
+#include <algorithm>
+#include <deque>
+
+namespace {
+	//A device that delivers a scripted list of packets per wake up, and stops the capture once the script ends.
+	class ScriptedDevice : public IAudioCaptureDevice
+	{
+	public:
+		explicit ScriptedDevice(bool isEventDriven) :
+			m_IsEventDriven(isEventDriven),
+			m_Data(4096, 0x11)
+		{
+		}
+
+		//Adds a wake up delivering the packets. An empty list is a wake up that finds nothing.
+		void AddWakeup(const std::vector<AUDIO_CAPTURE_PACKET> &packets)
+		{
+			m_Wakeups.push_back(packets);
+		}
+
+		static AUDIO_CAPTURE_PACKET Packet(uint64_t position, uint32_t frames, bool isDiscontinuity = false, bool isSilent = false)
+		{
+			AUDIO_CAPTURE_PACKET packet;
+			packet.FrameCount = frames;
+			packet.DevicePosition = position;
+			packet.IsDiscontinuity = isDiscontinuity;
+			packet.IsSilent = isSilent;
+			return packet;
+		}
+
+		bool IsEventDriven() const override { return m_IsEventDriven; }
+
+		bool GetNextPacket(AUDIO_CAPTURE_PACKET *pPacket) override
+		{
+			*pPacket = AUDIO_CAPTURE_PACKET();
+			if (IsFailing) {
+				return false;
+			}
+			if (!m_Ready.empty()) {
+				*pPacket = m_Ready.front();
+				if (!pPacket->IsSilent) {
+					pPacket->Data = m_Data.data();
+				}
+			}
+			return true;
+		}
+
+		bool ReleasePacket(uint32_t frameCount) override
+		{
+			ReleasedFrames += frameCount;
+			m_Ready.pop_front();
+			return true;
+		}
+
+		AudioCaptureWaitResult Wait(uint32_t timeoutMicros) override
+		{
+			WaitTimeouts.push_back(timeoutMicros);
+			if (m_Wakeups.empty()) {
+				return AudioCaptureWaitResult::Stop;
+			}
+			m_Ready.insert(m_Ready.end(), m_Wakeups.front().begin(), m_Wakeups.front().end());
+			m_Wakeups.pop_front();
+			return m_Ready.empty() ? AudioCaptureWaitResult::Timeout : AudioCaptureWaitResult::DataReady;
+		}
+
+		bool IsFailing = false;
+		uint64_t ReleasedFrames = 0;
+		std::vector<uint32_t> WaitTimeouts;
+
+	private:
+		bool m_IsEventDriven;
+		std::vector<uint8_t> m_Data;
+		std::deque<std::vector<AUDIO_CAPTURE_PACKET>> m_Wakeups;
+		std::deque<AUDIO_CAPTURE_PACKET> m_Ready;
+	};
+
+	const uint32_t SampleRate = 48000;
+	const uint32_t BlockAlign = 8;
+	const uint32_t PeriodMicros = 10000;
+	const uint32_t MaxWaitMicros = 50000;
+}
+
+TEST_CASE(CapturesPacketsUntilStopped)
+{
+	ScriptedDevice device(true);
+	device.AddWakeup({ ScriptedDevice::Packet(0, 480) });
+	device.AddWakeup({ ScriptedDevice::Packet(480, 480), ScriptedDevice::Packet(960, 480) });
+	device.AddWakeup({});
+	AudioRingBuffer buffer(1 << 16, BlockAlign);
+	AudioCaptureLoop loop;
+	loop.Initialize(SampleRate, BlockAlign, PeriodMicros, MaxWaitMicros);
+	CHECK(loop.Run(device, buffer));
+	AUDIO_CAPTURE_STATS stats = loop.GetStats();
+	CHECK_EQUAL(3, stats.Packets);
+	CHECK_EQUAL(1440, stats.Frames);
+	CHECK_EQUAL(3, stats.Wakeups);
+	CHECK_EQUAL(1, stats.EmptyWakeups);
+	CHECK_EQUAL(1440, device.ReleasedFrames);
+	CHECK_EQUAL(1440 * BlockAlign, buffer.AvailableToRead());
+	//An event driven device is always waited on for the longest wait.
+	for (uint32_t timeout : device.WaitTimeouts) {
+		CHECK_EQUAL(MaxWaitMicros, timeout);
+	}
+}
+
+TEST_CASE(SilentPacketsAreWrittenAsZeros)
+{
+	ScriptedDevice device(true);
+	device.AddWakeup({ ScriptedDevice::Packet(0, 100, false, true) });
+	AudioRingBuffer buffer(1 << 16, BlockAlign);
+	AudioCaptureLoop loop;
+	loop.Initialize(SampleRate, BlockAlign, PeriodMicros, MaxWaitMicros);
+	CHECK(loop.Run(device, buffer));
+	CHECK_EQUAL(1, loop.GetStats().SilentPackets);
+	std::vector<uint8_t> read(100 * BlockAlign, 0xFF);
+	CHECK_EQUAL(read.size(), buffer.Read(read.data(), read.size()));
+	CHECK(std::all_of(read.begin(), read.end(), [](uint8_t value) { return value == 0; }));
+}
+
+TEST_CASE(DiscontinuityIsPaddedWithSilence)
+{
+	ScriptedDevice device(true);
+	//The discontinuity on the first packet is ignored, the one after 200 lost frames is padded.
+	device.AddWakeup({ ScriptedDevice::Packet(0, 100, true) });
+	device.AddWakeup({ ScriptedDevice::Packet(300, 100, true) });
+	AudioRingBuffer buffer(1 << 16, BlockAlign);
+	AudioCaptureLoop loop;
+	loop.Initialize(SampleRate, BlockAlign, PeriodMicros, MaxWaitMicros);
+	CHECK(loop.Run(device, buffer));
+	AUDIO_CAPTURE_STATS stats = loop.GetStats();
+	CHECK_EQUAL(1, stats.Discontinuities);
+	CHECK_EQUAL(200, stats.PaddedFrames);
+	CHECK_EQUAL(400 * BlockAlign, buffer.AvailableToRead());
+}
+
+TEST_CASE(DiscontinuityPaddingIsCappedAtWholeFrames)
+{
+	ScriptedDevice device(true);
+	device.AddWakeup({ ScriptedDevice::Packet(0, 1) });
+	device.AddWakeup({ ScriptedDevice::Packet(1000000, 1, true) });
+	//The capacity of 1024 bytes is not a whole number of 12 byte frames.
+	const uint32_t blockAlign = 12;
+	AudioRingBuffer buffer(1024, blockAlign);
+	AudioCaptureLoop loop;
+	loop.Initialize(SampleRate, blockAlign, PeriodMicros, MaxWaitMicros);
+	CHECK(loop.Run(device, buffer));
+	CHECK_EQUAL(1024 / blockAlign, loop.GetStats().PaddedFrames);
+	CHECK_EQUAL(0, buffer.AvailableToRead() % blockAlign);
+}
+
+TEST_CASE(FailingDeviceEndsCapture)
+{
+	ScriptedDevice device(true);
+	device.IsFailing = true;
+	AudioRingBuffer buffer(1024, BlockAlign);
+	AudioCaptureLoop loop;
+	loop.Initialize(SampleRate, BlockAlign, PeriodMicros, MaxWaitMicros);
+	CHECK(!loop.Run(device, buffer));
+}
+
+TEST_CASE(PolledDeviceBacksOffWhileIdle)
+{
+	ScriptedDevice device(false);
+	device.AddWakeup({ ScriptedDevice::Packet(0, 480) });
+	for (int i = 0; i < 8; i++) {
+		device.AddWakeup({});
+	}
+	AudioRingBuffer buffer(1 << 16, BlockAlign);
+	AudioCaptureLoop loop;
+	loop.Initialize(SampleRate, BlockAlign, PeriodMicros, MaxWaitMicros);
+	CHECK(loop.Run(device, buffer));
+	const std::vector<uint32_t> &timeouts = device.WaitTimeouts;
+	CHECK(timeouts.size() >= 4);
+	//The first empty poll is retried soon, after which the polls back off to the longest wait.
+	CHECK(timeouts[2] < timeouts[1]);
+	for (size_t i = 3; i < timeouts.size(); i++) {
+		CHECK(timeouts[i] >= timeouts[i - 1]);
+	}
+	CHECK_EQUAL(MaxWaitMicros, timeouts.back());
+}
+
+TEST_CASE(PollSchedulerFollowsPacketLength)
+{
+	AudioPollScheduler scheduler;
+	scheduler.Initialize(SampleRate, PeriodMicros, MaxWaitMicros);
+	CHECK_EQUAL(PeriodMicros, scheduler.GetInterval());
+	//Packets of 20 ms pull the interval towards 20 ms.
+	for (int i = 0; i < 100; i++) {
+		scheduler.Update(1, 960);
+	}
+	CHECK_NEAR(20000, scheduler.GetPacketMicros(), 10);
+	CHECK_NEAR(20000, scheduler.GetInterval(), 10);
+	//More than one packet per poll means the polls lag, so the next one comes early.
+	CHECK(scheduler.Update(2, 1920) < 15000);
+	//The interval never drops below 1 ms or exceeds the longest wait.
+	for (int i = 0; i < 40; i++) {
+		scheduler.Update(0, 0);
+	}
+	CHECK_EQUAL(MaxWaitMicros, scheduler.GetInterval());
+	scheduler.Initialize(SampleRate, 100, MaxWaitMicros);
+	CHECK(scheduler.Update(0, 0) >= 1000);
+}
@@ -0,0 +1,227 @@
+#include "TestHarness.h"
+#include "AudioGraph.h"
+#include <cmath>
+
+namespace {
+	const uint32_t SampleRate = 48000;
+	const uint32_t Channels = 2;
+	//One block of the graph.
+	const size_t BlockFrames = 480;
+
+	//An input delivering a constant value, with a configurable number of frames per read.
+	class ConstantInput : public IAudioGraphInput
+	{
+	public:
+		explicit ConstantInput(float value) : Value(value) {}
+
+		void ReadAvailable(std::vector<float> &output) override
+		{
+			size_t frames = 0;
+			if (Rate > 0) {
+				m_Position += Rate;
+				frames = static_cast<size_t>(m_Position) - m_Delivered;
+				m_Delivered += frames;
+			}
+			frames += Backlog;
+			Backlog = 0;
+			output.assign(frames * Channels, Value);
+		}
+
+		void SetRateAdjustment(double ratio) override
+		{
+			RateAdjustment = ratio;
+		}
+
+		float Value;
+		//Frames delivered per read. Fractional rates deliver a varying number of frames.
+		double Rate = BlockFrames;
+		//Frames delivered once on top of the rate.
+		size_t Backlog = 0;
+		double RateAdjustment = 1.0;
+
+	private:
+		double m_Position = 0;
+		size_t m_Delivered = 0;
+	};
+}
+
+TEST_CASE(SourcesAreMixedWithGain)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 0);
+	CHECK_EQUAL(BlockFrames, graph.GetBlockFrames());
+	ConstantInput first(0.25f);
+	ConstantInput second(0.5f);
+	AUDIO_GRAPH_SOURCE_OPTIONS options;
+	options.Gain = 0.5f;
+	graph.AddSource(&first);
+	graph.AddSource(&second, options);
+	graph.SetMasterGain(2.0f);
+	std::vector<float> output(BlockFrames * Channels);
+	graph.Render(BlockFrames, output.data());
+	for (float sample : output) {
+		CHECK_NEAR(2.0 * (0.25 + 0.5 * 0.5), sample, 1e-6);
+	}
+}
+
+TEST_CASE(MutedSourceIsReadButNotMixed)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 0);
+	ConstantInput first(0.25f);
+	ConstantInput second(0.5f);
+	AUDIO_GRAPH_SOURCE_OPTIONS options;
+	options.IsMuted = true;
+	graph.AddSource(&first);
+	int mutedId = graph.AddSource(&second, options);
+	std::vector<float> output(BlockFrames * Channels);
+	for (int i = 0; i < 10; i++) {
+		graph.Render(BlockFrames, output.data());
+		CHECK_NEAR(0.25, output[0], 1e-6);
+	}
+	AUDIO_SILENCE_STATS stats;
+	CHECK(graph.GetSourceSilenceStats(mutedId, &stats));
+	CHECK_EQUAL(10 * BlockFrames, stats.SilentFrames);
+	CHECK_EQUAL(0, stats.AudibleFrames);
+	//The muted source kept being read, so its audio did not pile up.
+	AUDIO_DRIFT_STATS driftStats;
+	CHECK(graph.GetSourceStats(mutedId, &driftStats));
+	CHECK_EQUAL(0, driftStats.DroppedFrames);
+}
+
+TEST_CASE(SilenceIsNotMixed)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 0);
+	ConstantInput input(0.0f);
+	int id = graph.AddSource(&input);
+	CHECK(!graph.PullFrames(BlockFrames));
+	graph.MixFrames(nullptr);
+	std::vector<float> output(BlockFrames * Channels, 1.0f);
+	graph.Render(BlockFrames, output.data());
+	for (float sample : output) {
+		CHECK_EQUAL(0.0f, sample);
+	}
+	AUDIO_SILENCE_STATS stats;
+	CHECK(graph.GetSourceSilenceStats(id, &stats));
+	CHECK_EQUAL(2 * BlockFrames, stats.SilentFrames);
+}
+
+TEST_CASE(DelayedSourceStartsWithSilence)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 0);
+	ConstantInput input(0.5f);
+	AUDIO_GRAPH_SOURCE_OPTIONS options;
+	options.DelayMillis = 10;
+	graph.AddSource(&input, options);
+	std::vector<float> output(2 * BlockFrames * Channels);
+	graph.Render(2 * BlockFrames, output.data());
+	CHECK_EQUAL(0.0f, output[0]);
+	CHECK_EQUAL(0.0f, output[BlockFrames * Channels - 1]);
+	CHECK_NEAR(0.5, output[BlockFrames * Channels], 1e-6);
+	CHECK_NEAR(0.5, output.back(), 1e-6);
+}
+
+TEST_CASE(NoiseGateLeavesQuietSourceOut)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 0);
+	//-60 dBFS is below the default threshold of -50 dBFS.
+	ConstantInput input(0.001f);
+	AUDIO_GRAPH_SOURCE_OPTIONS options;
+	options.NoiseGate.IsEnabled = true;
+	int id = graph.AddSource(&input, options);
+	std::vector<float> output(BlockFrames * Channels);
+	for (int i = 0; i < 5; i++) {
+		graph.Render(BlockFrames, output.data());
+	}
+	CHECK_EQUAL(0.0f, output[0]);
+	AUDIO_SILENCE_STATS stats;
+	CHECK(graph.GetSourceSilenceStats(id, &stats));
+	CHECK_EQUAL(5 * BlockFrames, stats.GatedFrames);
+	//A loud source opens the gate, fading in over the first block.
+	input.Value = 0.5f;
+	graph.Render(BlockFrames, output.data());
+	CHECK(output[0] < 0.01f);
+	CHECK_NEAR(0.5, output.back(), 1e-6);
+	graph.Render(BlockFrames, output.data());
+	CHECK_NEAR(0.5, output[0], 1e-6);
+}
+
+TEST_CASE(MeteringReadsSourceLevels)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 0);
+	ConstantInput input(0.5f);
+	AUDIO_GRAPH_SOURCE_OPTIONS options;
+	options.IsMuted = true;
+	int id = graph.AddSource(&input, options);
+	graph.SetMeteringEnabled(true);
+	std::vector<float> output(BlockFrames * Channels);
+	for (int i = 0; i < 50; i++) {
+		graph.Render(BlockFrames, output.data());
+	}
+	//Sources are metered before mute.
+	AUDIO_METER_READING reading;
+	CHECK(graph.ReadSourceLevels(id, &reading));
+	CHECK_NEAR(20 * std::log10(0.5), reading.PeakDb, 0.01);
+	CHECK_NEAR(20 * std::log10(0.5), reading.RmsDb, 0.01);
+	CHECK(!graph.ReadSourceLevels(id + 1, &reading));
+}
+
+TEST_CASE(FastSourceIsSlowedDown)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 50);
+	ConstantInput input(0.5f);
+	//The device clock runs 0.2% fast.
+	input.Rate = BlockFrames * 1.002;
+	int id = graph.AddSource(&input);
+	std::vector<float> output(BlockFrames * Channels);
+	for (int i = 0; i < 3000; i++) {
+		graph.Render(BlockFrames, output.data());
+	}
+	AUDIO_DRIFT_STATS stats;
+	CHECK(graph.GetSourceStats(id, &stats));
+	CHECK(input.RateAdjustment > 1.0);
+	CHECK(stats.DriftPpm > 0);
+	CHECK_EQUAL(0, stats.DroppedFrames);
+	CHECK_EQUAL(0, stats.UnderrunFrames);
+}
+
+TEST_CASE(BacklogIsDropped)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 50);
+	ConstantInput input(0.5f);
+	int id = graph.AddSource(&input);
+	std::vector<float> output(BlockFrames * Channels);
+	graph.Render(BlockFrames, output.data());
+	input.Backlog = SampleRate;
+	graph.Render(BlockFrames, output.data());
+	AUDIO_DRIFT_STATS stats;
+	CHECK(graph.GetSourceStats(id, &stats));
+	CHECK_EQUAL(SampleRate, stats.DroppedFrames);
+}
+
+TEST_CASE(SourcesCanBeRemoved)
+{
+	AudioGraph graph;
+	graph.Initialize(SampleRate, Channels, 0);
+	ConstantInput input(0.5f);
+	int id = graph.AddSource(&input);
+	CHECK_EQUAL(AudioGraph::INVALID_SOURCE_ID, graph.AddSource(nullptr));
+	CHECK_EQUAL(1, graph.GetSourceCount());
+	AUDIO_GRAPH_SOURCE_OPTIONS options;
+	options.DelayMillis = 5000;
+	CHECK(graph.SetSourceOptions(id, options));
+	CHECK(graph.GetSourceOptions(id, &options));
+	CHECK_EQUAL(1000, options.DelayMillis);
+	CHECK(graph.RemoveSource(id));
+	CHECK(!graph.RemoveSource(id));
+	CHECK(!graph.SetSourceOptions(id, options));
+	CHECK_EQUAL(0, graph.GetSourceCount());
+	AUDIO_METER_READING reading;
+	CHECK(!graph.ReadSourceLevels(AudioGraph::INVALID_SOURCE_ID, &reading));
+}
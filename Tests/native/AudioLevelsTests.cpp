@@ -0,0 +1,73 @@
+#include "TestHarness.h"
+#include "AudioLevels.h"
+
+namespace {
+	const AudioMixerKernel Kernels[] = { AudioMixerKernel::Scalar, AudioMixerKernel::SSE2, AudioMixerKernel::AVX2 };
+}
+
+TEST_CASE(KernelsComputePeakAndRms)
+{
+	//An odd length exercises the tails after the vector loops.
+	std::vector<float> samples(1003);
+	for (size_t i = 0; i < samples.size(); i++) {
+		samples[i] = (i % 2 == 0 ? 0.5f : -0.5f);
+	}
+	samples[777] = -0.9f;
+	double sumOfSquares = 0;
+	for (float sample : samples) {
+		sumOfSquares += static_cast<double>(sample) * sample;
+	}
+	for (AudioMixerKernel kernel : Kernels) {
+		if (!AudioMixer::IsKernelSupported(kernel)) {
+			continue;
+		}
+		AudioLevelAnalyzer analyzer(kernel);
+		AUDIO_LEVELS levels = analyzer.Analyze(samples.data(), samples.size());
+		CHECK_NEAR(0.9, levels.Peak, 1e-6);
+		CHECK_NEAR(std::sqrt(sumOfSquares / samples.size()), levels.Rms, 1e-6);
+		CHECK(!levels.IsSilent());
+		std::vector<float> silence(100, 0.0f);
+		CHECK(analyzer.Analyze(silence.data(), silence.size()).IsSilent());
+	}
+}
+
+TEST_CASE(DecibelsConvertBothWays)
+{
+	CHECK_NEAR(0, AudioLevelAnalyzer::ToDecibels(1.0f), 1e-6);
+	CHECK_NEAR(-6.0206, AudioLevelAnalyzer::ToDecibels(0.5f), 1e-3);
+	CHECK_EQUAL(AudioLevelAnalyzer::MIN_DECIBELS, AudioLevelAnalyzer::ToDecibels(0.0f));
+	CHECK_NEAR(0.5, AudioLevelAnalyzer::FromDecibels(-6.0206f), 1e-4);
+	CHECK_EQUAL(0.0f, AudioLevelAnalyzer::FromDecibels(AudioLevelAnalyzer::MIN_DECIBELS));
+}
+
+TEST_CASE(NoiseGateOpensAtThresholdAndHoldsBeforeClosing)
+{
+	AudioNoiseGate gate;
+	AUDIO_NOISE_GATE_OPTIONS options;
+	options.IsEnabled = true;
+	options.ThresholdDb = -40;
+	options.HysteresisDb = 6;
+	options.HoldMillis = 100;
+	gate.Initialize(48000, options);
+	AUDIO_LEVELS quiet;
+	quiet.Rms = quiet.Peak = AudioLevelAnalyzer::FromDecibels(-50);
+	AUDIO_LEVELS loud;
+	loud.Rms = loud.Peak = AudioLevelAnalyzer::FromDecibels(-30);
+	AUDIO_LEVELS between;
+	between.Rms = between.Peak = AudioLevelAnalyzer::FromDecibels(-43);
+	CHECK(!gate.Process(quiet, 480));
+	CHECK(gate.Process(loud, 480));
+	//Levels within the hysteresis keep the gate open indefinitely.
+	for (int i = 0; i < 100; i++) {
+		CHECK(gate.Process(between, 480));
+	}
+	//100 ms of quiet at 48 kHz is 4800 frames, so the 11th block of 480 frames closes the gate.
+	for (int i = 0; i < 10; i++) {
+		CHECK(gate.Process(quiet, 480));
+	}
+	CHECK(!gate.Process(quiet, 480));
+	//A disabled gate is always open.
+	options.IsEnabled = false;
+	gate.Initialize(48000, options);
+	CHECK(gate.Process(quiet, 480));
+}
@@ -0,0 +1,73 @@
+#include "TestHarness.h"
+#include "AudioMeter.h"
+
+namespace {
+	const double Pi = 3.14159265358979323846;
+
+	std::vector<float> MakeSine(uint32_t sampleRate, uint32_t channels, double frequency, double amplitude, size_t frameCount)
+	{
+		std::vector<float> samples(frameCount * channels);
+		for (size_t frame = 0; frame < frameCount; frame++) {
+			float sample = static_cast<float>(amplitude * std::sin(2 * Pi * frequency * frame / sampleRate));
+			for (uint32_t channel = 0; channel < channels; channel++) {
+				samples[frame * channels + channel] = sample;
+			}
+		}
+		return samples;
+	}
+}
+
+TEST_CASE(FullScaleSineReadsMinusThreeLufs)
+{
+	AudioLoudnessMeter meter;
+	meter.Initialize(48000, 1);
+	auto sine = MakeSine(48000, 1, 1000, 1.0, 48000);
+	meter.Process(sine.data(), 48000);
+	CHECK_NEAR(-3.01, meter.GetMomentaryLoudness(), 0.05);
+	//Stereo adds up both channels, so it reads 3 dB louder.
+	meter.Initialize(44100, 2);
+	sine = MakeSine(44100, 2, 1000, 1.0, 44100);
+	meter.Process(sine.data(), 44100);
+	CHECK_NEAR(0.0, meter.GetMomentaryLoudness(), 0.05);
+}
+
+TEST_CASE(LoudnessDecaysToSilence)
+{
+	AudioLoudnessMeter meter;
+	meter.Initialize(48000, 2);
+	CHECK_EQUAL(AudioLevelAnalyzer::MIN_DECIBELS, meter.GetMomentaryLoudness());
+	auto sine = MakeSine(48000, 2, 1000, 0.1, 48000);
+	meter.Process(sine.data(), 48000);
+	CHECK_NEAR(-20.0, meter.GetMomentaryLoudness(), 0.05);
+	//After a window of 400 ms of silence, only the ring out of the filters in its first step is left.
+	meter.ProcessSilence(48000 * 4 / 10);
+	CHECK(meter.GetMomentaryLoudness() < -60);
+	//One 100 ms step later, the window is silent.
+	meter.ProcessSilence(48000 / 10);
+	CHECK_EQUAL(AudioLevelAnalyzer::MIN_DECIBELS, meter.GetMomentaryLoudness());
+}
+
+TEST_CASE(LevelMeterReadsOncePerInterval)
+{
+	AudioLevelMeter meter;
+	meter.Initialize(48000, 2, 100);
+	auto sine = MakeSine(48000, 2, 1000, 0.5, 4800);
+	meter.Process(sine.data(), 2400);
+	CHECK(!meter.IsReadingDue());
+	meter.Process(sine.data() + 2400 * 2, 2400);
+	CHECK(meter.IsReadingDue());
+	AUDIO_METER_READING reading = meter.Read();
+	CHECK_NEAR(-6.02, reading.PeakDb, 0.01);
+	CHECK_NEAR(-9.03, reading.RmsDb, 0.01);
+	CHECK(!meter.IsReadingDue());
+	//Silence lowers the RMS but not the peak.
+	meter.Process(sine.data(), 2400);
+	meter.ProcessSilence(2400);
+	reading = meter.Read();
+	CHECK_NEAR(-6.02, reading.PeakDb, 0.01);
+	CHECK_NEAR(-12.04, reading.RmsDb, 0.01);
+	meter.ProcessSilence(4800);
+	reading = meter.Read();
+	CHECK_EQUAL(AudioLevelAnalyzer::MIN_DECIBELS, reading.PeakDb);
+	CHECK_EQUAL(AudioLevelAnalyzer::MIN_DECIBELS, reading.RmsDb);
+}
@@ -0,0 +1,75 @@
+#include "TestHarness.h"
+#include "AudioMixer.h"
+
+namespace {
+	const AudioMixerKernel Kernels[] = { AudioMixerKernel::Scalar, AudioMixerKernel::SSE2, AudioMixerKernel::AVX2 };
+
+	std::vector<float> MakeSignal(size_t count, float scale)
+	{
+		std::vector<float> samples(count);
+		for (size_t i = 0; i < count; i++) {
+			samples[i] = scale * static_cast<float>(static_cast<int>(i % 101) - 50) / 50.0f;
+		}
+		return samples;
+	}
+}
+
+TEST_CASE(ScalarKernelIsAlwaysSupported)
+{
+	CHECK(AudioMixer::IsKernelSupported(AudioMixerKernel::Scalar));
+	CHECK(AudioMixer::IsKernelSupported(AudioMixer::GetBestSupportedKernel()));
+	CHECK(AudioMixer().GetKernel() == AudioMixer::GetBestSupportedKernel());
+}
+
+TEST_CASE(KernelsSumStreamsWithGain)
+{
+	//Odd lengths exercise the tails after the vector loops.
+	const size_t count = 1027;
+	std::vector<float> first = MakeSignal(count, 0.8f);
+	std::vector<float> second = MakeSignal(count - 100, -0.3f);
+	AUDIO_MIX_INPUT inputs[2];
+	inputs[0].Samples = first.data();
+	inputs[0].SampleCount = first.size();
+	inputs[0].Gain = 0.5f;
+	inputs[1].Samples = second.data();
+	inputs[1].SampleCount = second.size();
+	inputs[1].Gain = 2.0f;
+	for (AudioMixerKernel kernel : Kernels) {
+		if (!AudioMixer::IsKernelSupported(kernel)) {
+			continue;
+		}
+		AudioMixer mixer(kernel);
+		std::vector<float> output(count, 99.0f);
+		mixer.Mix(inputs, 2, output.data(), output.size());
+		for (size_t i = 0; i < count; i++) {
+			//The shorter stream is silence past its end.
+			float expected = first[i] * 0.5f + (i < second.size() ? second[i] * 2.0f : 0.0f);
+			CHECK_NEAR(expected, output[i], 1e-6);
+		}
+	}
+}
+
+TEST_CASE(MixWithoutInputsWritesSilence)
+{
+	AudioMixer mixer;
+	std::vector<float> output(64, 1.0f);
+	mixer.Mix(nullptr, 0, output.data(), output.size());
+	for (float sample : output) {
+		CHECK_EQUAL(0.0f, sample);
+	}
+}
+
+TEST_CASE(MixIsNotClipped)
+{
+	std::vector<float> loud(32, 0.9f);
+	AUDIO_MIX_INPUT inputs[3];
+	for (AUDIO_MIX_INPUT &input : inputs) {
+		input.Samples = loud.data();
+		input.SampleCount = loud.size();
+	}
+	AudioMixer mixer;
+	std::vector<float> output(32);
+	mixer.Mix(inputs, 3, output.data(), output.size());
+	CHECK_NEAR(2.7, output[0], 1e-6);
+	CHECK_NEAR(2.7, output[31], 1e-6);
+}
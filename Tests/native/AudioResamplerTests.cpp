@@ -0,0 +1,176 @@
+#include "TestHarness.h"
+#include "AudioResampler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	const double Pi = 3.14159265358979323846;
+
+	std::vector<float> MakeSine(uint32_t sampleRate, uint32_t channels, double frequency, size_t frameCount)
+	{
+		std::vector<float> samples(frameCount * channels);
+		for (size_t frame = 0; frame < frameCount; frame++) {
+			for (uint32_t channel = 0; channel < channels; channel++) {
+				samples[frame * channels + channel] = static_cast<float>(0.5 * std::sin(2 * Pi * frequency * frame / sampleRate));
+			}
+		}
+		return samples;
+	}
+
+	//Runs all input through the resampler in chunks of varying size, including the flush.
+	std::vector<float> Resample(AudioResampler &resampler, const std::vector<float> &input, size_t maxChunkFrames)
+	{
+		uint32_t inputChannels = resampler.GetInputChannels();
+		uint32_t outputChannels = resampler.GetOutputChannels();
+		size_t inputFrames = input.size() / inputChannels;
+		std::vector<float> output;
+		std::vector<float> chunk;
+		size_t position = 0;
+		for (size_t i = 1; position < inputFrames; i++) {
+			size_t frames = (std::min)(inputFrames - position, i * 37 % maxChunkFrames + 1);
+			chunk.resize(resampler.GetMaxOutputFrames(frames) * outputChannels);
+			size_t written = resampler.Process(input.data() + position * inputChannels, frames, chunk.data());
+			CHECK(written <= resampler.GetMaxOutputFrames(frames));
+			output.insert(output.end(), chunk.begin(), chunk.begin() + written * outputChannels);
+			position += frames;
+		}
+		CHECK_EQUAL(inputFrames, resampler.GetInputFrameTotal());
+		CHECK_EQUAL(output.size() / outputChannels, resampler.GetOutputFrameTotal());
+		chunk.resize(resampler.GetMaxOutputFrames(0) * outputChannels);
+		size_t written = resampler.Flush(chunk.data());
+		CHECK(written <= resampler.GetMaxOutputFrames(0));
+		output.insert(output.end(), chunk.begin(), chunk.begin() + written * outputChannels);
+		return output;
+	}
+
+	//The signal to noise ratio in dB of the first channel against the sine it should be, skipping the edges where the filter ramps up and down.
+	double GetSnr(const std::vector<float> &output, uint32_t channels, uint32_t sampleRate, double frequency)
+	{
+		size_t frames = output.size() / channels;
+		double signal = 0;
+		double noise = 0;
+		for (size_t frame = 200; frame + 200 < frames; frame++) {
+			double ideal = 0.5 * std::sin(2 * Pi * frequency * frame / sampleRate);
+			double error = output[frame * channels] - ideal;
+			signal += ideal * ideal;
+			noise += error * error;
+		}
+		return 10 * std::log10(signal / noise);
+	}
+}
+
+TEST_CASE(InvalidParametersAreRejected)
+{
+	AudioResampler resampler;
+	CHECK(!resampler.Initialize(0, 2, 48000, 2, 30));
+	CHECK(!resampler.Initialize(48000, 0, 48000, 2, 30));
+	CHECK(resampler.Initialize(48000, 2, 48000, 2, 30));
+	CHECK(resampler.IsPassthrough());
+	CHECK(!resampler.SetRateAdjustment(1.01));
+}
+
+TEST_CASE(PassthroughCopiesInput)
+{
+	AudioResampler resampler;
+	resampler.Initialize(48000, 2, 48000, 2, 30);
+	std::vector<float> input = MakeSine(48000, 2, 1000, 1000);
+	std::vector<float> output(resampler.GetMaxOutputFrames(1000) * 2);
+	CHECK_EQUAL(1000, resampler.Process(input.data(), 1000, output.data()));
+	CHECK(std::equal(input.begin(), input.end(), output.begin()));
+	CHECK_EQUAL(0, resampler.Flush(output.data()));
+}
+
+TEST_CASE(ConversionKeepsTheSignal)
+{
+	struct CONVERSION
+	{
+		uint32_t InputRate;
+		uint32_t OutputRate;
+		int HalfLength;
+		double MinSnr;
+	};
+	const CONVERSION conversions[] = {
+		{ 44100, 48000, 60, 80 },
+		{ 48000, 44100, 60, 80 },
+		{ 48000, 16000, 30, 60 },
+		{ 8000, 48000, 40, 60 },
+		{ 192000, 44100, 8, 30 },
+	};
+	for (const CONVERSION &conversion : conversions) {
+		AudioResampler resampler;
+		CHECK(resampler.Initialize(conversion.InputRate, 2, conversion.OutputRate, 2, conversion.HalfLength));
+		CHECK(!resampler.IsPassthrough());
+		std::vector<float> output = Resample(resampler, MakeSine(conversion.InputRate, 2, 440, conversion.InputRate), 1000);
+		//One second of input gives one second of output.
+		CHECK_NEAR(conversion.OutputRate, output.size() / 2, 2);
+		//Flush restarts the resampler, so the totals start over.
+		CHECK_EQUAL(0, resampler.GetInputFrameTotal());
+		CHECK(GetSnr(output, 2, conversion.OutputRate, 440) > conversion.MinSnr);
+	}
+}
+
+TEST_CASE(ChunkSizeDoesNotChangeOutput)
+{
+	std::vector<float> input = MakeSine(44100, 2, 440, 20000);
+	AudioResampler whole;
+	whole.Initialize(44100, 2, 48000, 2, 30);
+	std::vector<float> expected = Resample(whole, input, 100000);
+	AudioResampler chunked;
+	chunked.Initialize(44100, 2, 48000, 2, 30);
+	std::vector<float> output = Resample(chunked, input, 300);
+	CHECK_EQUAL(expected.size(), output.size());
+	for (size_t i = 0; i < output.size(); i++) {
+		CHECK_NEAR(expected[i], output[i], 1e-6);
+	}
+}
+
+TEST_CASE(ChannelsAreMixed)
+{
+	AudioResampler upmix;
+	upmix.Initialize(48000, 1, 44100, 2, 30);
+	std::vector<float> output = Resample(upmix, MakeSine(48000, 1, 440, 48000), 1000);
+	for (size_t frame = 0; frame < output.size() / 2; frame++) {
+		CHECK_EQUAL(output[frame * 2], output[frame * 2 + 1]);
+	}
+	CHECK(GetSnr(output, 2, 44100, 440) > 60);
+
+	//Stereo is averaged to mono, so opposite channels cancel.
+	AudioResampler downmix;
+	downmix.Initialize(48000, 2, 48000, 1, 30);
+	std::vector<float> input = MakeSine(48000, 2, 440, 1000);
+	for (size_t frame = 0; frame < 1000; frame++) {
+		input[frame * 2 + 1] = -input[frame * 2];
+	}
+	output = Resample(downmix, input, 1000);
+	CHECK_EQUAL(1000, output.size());
+	for (float sample : output) {
+		CHECK_EQUAL(0.0f, sample);
+	}
+}
+
+TEST_CASE(RateAdjustmentChangesOutputLength)
+{
+	AudioResampler resampler;
+	resampler.Initialize(48000, 2, 48000, 2, 16, true);
+	CHECK(!resampler.IsPassthrough());
+	CHECK(resampler.SetRateAdjustment(1.01));
+	CHECK_NEAR(1.01, resampler.GetRateAdjustment(), 1e-9);
+	std::vector<float> output = Resample(resampler, MakeSine(48000, 2, 440, 48000), 1000);
+	CHECK_NEAR(48000 / 1.01, output.size() / 2, 20);
+	//Adjustments are clamped to 5%.
+	resampler.SetRateAdjustment(2.0);
+	CHECK_NEAR(1.05, resampler.GetRateAdjustment(), 1e-9);
+}
+
+TEST_CASE(Int16IsConverted)
+{
+	AudioResampler resampler;
+	resampler.Initialize(44100, 2, 48000, 2, 30);
+	std::vector<int16_t> input(4410 * 2, 1000);
+	std::vector<int16_t> output(resampler.GetMaxOutputFrames(input.size() / 2) * 2);
+	size_t frames = resampler.Process(input.data(), input.size() / 2, output.data());
+	CHECK(frames > 4000);
+	//A constant signal stays constant once the filter is past the silence it starts from.
+	CHECK_NEAR(1000, output[(frames / 2) * 2], 1);
+	CHECK_NEAR(1000, output[(frames / 2) * 2 + 1], 1);
+}
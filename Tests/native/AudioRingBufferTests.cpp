@@ -0,0 +1,137 @@
+#include "TestHarness.h"
+#include "AudioRingBuffer.h"
+#include <algorithm>
+#include <thread>
+
+TEST_CASE(CapacityIsRoundedUpToPowerOfTwo)
+{
+	AudioRingBuffer buffer(1000);
+	CHECK_EQUAL(1024, buffer.GetCapacity());
+	CHECK_EQUAL(0, buffer.AvailableToRead());
+	CHECK_EQUAL(1024, buffer.AvailableToWrite());
+}
+
+TEST_CASE(UninitializedBufferIgnoresWrites)
+{
+	AudioRingBuffer buffer;
+	uint8_t data[16]{};
+	CHECK(!buffer.IsInitialized());
+	CHECK_EQUAL(0, buffer.Write(data, sizeof(data)));
+	CHECK_EQUAL(0, buffer.GetReadSpan().Size());
+}
+
+TEST_CASE(ReadReturnsWrittenBytesAcrossTheWrap)
+{
+	AudioRingBuffer buffer(1024);
+	std::vector<uint8_t> data(700);
+	for (size_t i = 0; i < data.size(); i++) {
+		data[i] = static_cast<uint8_t>(i);
+	}
+	CHECK_EQUAL(700, buffer.Write(data.data(), data.size()));
+	std::vector<uint8_t> read(700);
+	CHECK_EQUAL(500, buffer.Read(read.data(), 500));
+	CHECK(std::equal(data.begin(), data.begin() + 500, read.begin()));
+
+	//The second write wraps, so the readable bytes are split in two spans.
+	CHECK_EQUAL(700, buffer.Write(data.data(), data.size()));
+	AUDIO_RING_SPAN span = buffer.GetReadSpan();
+	CHECK_EQUAL(900, span.Size());
+	CHECK(span.SecondSize > 0);
+	CHECK_EQUAL(900, buffer.Read(read.data(), 200) + buffer.Read(read.data(), 700));
+	CHECK(std::equal(data.begin(), data.end(), read.begin()));
+}
+
+TEST_CASE(OverflowDropsFramesThatDoNotFit)
+{
+	AudioRingBuffer buffer(1024, 6);
+	CHECK_EQUAL(6, buffer.GetBlockBytes());
+	std::vector<uint8_t> data(1000, 1);
+	CHECK_EQUAL(1000, buffer.Write(data.data(), data.size()));
+	//24 bytes are free, which is 4 frames of 6 bytes.
+	CHECK_EQUAL(24, buffer.Write(data.data(), 30));
+	CHECK_EQUAL(6, buffer.GetOverflowBytes());
+	CHECK_EQUAL(1, buffer.GetOverflowCount());
+	buffer.Clear();
+	CHECK_EQUAL(0, buffer.AvailableToRead());
+}
+
+TEST_CASE(OverflowCutsSilenceAtWholeFrames)
+{
+	AudioRingBuffer buffer(64, 8);
+	CHECK_EQUAL(60, buffer.WriteSilence(60));
+	//4 bytes are free, which is less than a frame.
+	CHECK_EQUAL(0, buffer.WriteSilence(8));
+	CHECK_EQUAL(8, buffer.GetOverflowBytes());
+	AUDIO_RING_SPAN span = buffer.GetReadSpan();
+	CHECK_EQUAL(60, span.Size());
+	for (size_t i = 0; i < span.FirstSize; i++) {
+		CHECK_EQUAL(0, span.First[i]);
+	}
+}
+
+TEST_CASE(ShortReadCountsUnderrun)
+{
+	AudioRingBuffer buffer(64);
+	uint8_t data[8]{ 1, 2, 3, 4, 5, 6, 7, 8 };
+	buffer.Write(data, 4);
+	uint8_t read[8]{};
+	CHECK_EQUAL(4, buffer.Read(read, 8));
+	CHECK_EQUAL(1, buffer.GetUnderrunCount());
+	CHECK_EQUAL(0, buffer.Read(read, 1));
+	CHECK_EQUAL(2, buffer.GetUnderrunCount());
+}
+
+TEST_CASE(CommitReadIsLimitedToAvailableBytes)
+{
+	AudioRingBuffer buffer(64);
+	uint8_t data[10]{};
+	buffer.Write(data, 10);
+	buffer.CommitRead(100);
+	CHECK_EQUAL(0, buffer.AvailableToRead());
+	CHECK_EQUAL(64, buffer.AvailableToWrite());
+}
+
+TEST_CASE(ProducerAndConsumerThreadsSeeEveryByteInOrder)
+{
+	AudioRingBuffer buffer(4096, 4);
+	const size_t total = 4 * 1000 * 1000;
+	std::thread producer([&]() {
+		std::vector<uint8_t> packet(1920);
+		size_t written = 0;
+		uint8_t next = 0;
+		while (written < total) {
+			size_t count = (std::min)(packet.size(), total - written);
+			for (size_t i = 0; i < count; i++) {
+				packet[i] = next++;
+			}
+			size_t offset = 0;
+			while (offset < count) {
+				offset += buffer.Write(packet.data() + offset, count - offset);
+				if (offset < count) {
+					std::this_thread::yield();
+				}
+			}
+			written += count;
+		}
+	});
+	size_t read = 0;
+	uint8_t expected = 0;
+	bool isInOrder = true;
+	while (read < total) {
+		AUDIO_RING_SPAN span = buffer.GetReadSpan();
+		for (size_t i = 0; i < span.FirstSize; i++) {
+			isInOrder &= span.First[i] == expected++;
+		}
+		for (size_t i = 0; i < span.SecondSize; i++) {
+			isInOrder &= span.Second[i] == expected++;
+		}
+		buffer.CommitRead(span.Size());
+		read += span.Size();
+		if (span.Size() == 0) {
+			std::this_thread::yield();
+		}
+	}
+	producer.join();
+	CHECK(isInOrder);
+	CHECK_EQUAL(total, read);
+}
@@ -0,0 +1,124 @@
+#include "TestHarness.h"
+#include "AudioSampleConverter.h"
+#include <cmath>
+#include <limits>
+
+namespace {
+	const AudioMixerKernel Kernels[] = { AudioMixerKernel::Scalar, AudioMixerKernel::SSE2, AudioMixerKernel::AVX2 };
+}
+
+TEST_CASE(SampleBytesMatchFormat)
+{
+	CHECK_EQUAL(2, AudioSampleConverter::GetSampleBytes(AudioSampleFormat::Int16));
+	CHECK_EQUAL(3, AudioSampleConverter::GetSampleBytes(AudioSampleFormat::Int24));
+	CHECK_EQUAL(4, AudioSampleConverter::GetSampleBytes(AudioSampleFormat::Int32));
+	CHECK_EQUAL(4, AudioSampleConverter::GetSampleBytes(AudioSampleFormat::Float32));
+}
+
+TEST_CASE(IntegerFormatsConvertToFullScaleFloat)
+{
+	//Odd lengths exercise the tails after the vector loops.
+	std::vector<int16_t> int16Samples(37);
+	std::vector<int32_t> int32Samples(37);
+	for (size_t i = 0; i < int16Samples.size(); i++) {
+		int16Samples[i] = static_cast<int16_t>(-32768 + static_cast<int>(i) * 1771);
+		int32Samples[i] = static_cast<int32_t>(int16Samples[i]) * 65536;
+	}
+	for (AudioMixerKernel kernel : Kernels) {
+		if (!AudioMixer::IsKernelSupported(kernel)) {
+			continue;
+		}
+		AudioSampleConverter converter(kernel);
+		std::vector<float> fromInt16(int16Samples.size());
+		std::vector<float> fromInt32(int32Samples.size());
+		converter.ToFloat(int16Samples.data(), AudioSampleFormat::Int16, int16Samples.size(), fromInt16.data());
+		converter.ToFloat(int32Samples.data(), AudioSampleFormat::Int32, int32Samples.size(), fromInt32.data());
+		for (size_t i = 0; i < int16Samples.size(); i++) {
+			CHECK_EQUAL(int16Samples[i] / 32768.0f, fromInt16[i]);
+			CHECK_EQUAL(fromInt16[i], fromInt32[i]);
+		}
+		CHECK_EQUAL(-1.0f, fromInt16[0]);
+	}
+}
+
+TEST_CASE(PackedInt24ConvertsToFloat)
+{
+	//-8388608, 0, 4194304 and 8388607, little endian.
+	const uint8_t packed[] = { 0x00, 0x00, 0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0xFF, 0xFF, 0x7F };
+	AudioSampleConverter converter;
+	float samples[4];
+	converter.ToFloat(packed, AudioSampleFormat::Int24, 4, samples);
+	CHECK_EQUAL(-1.0f, samples[0]);
+	CHECK_EQUAL(0.0f, samples[1]);
+	CHECK_EQUAL(0.5f, samples[2]);
+	CHECK_NEAR(1.0, samples[3], 1e-6);
+}
+
+TEST_CASE(FloatIsCopied)
+{
+	const float source[] = { 0.25f, -1.5f, 3.0f };
+	float samples[3];
+	AudioSampleConverter().ToFloat(source, AudioSampleFormat::Float32, 3, samples);
+	CHECK_EQUAL(-1.5f, samples[1]);
+	CHECK_EQUAL(3.0f, samples[2]);
+}
+
+TEST_CASE(KernelsRoundAndClipToInt16)
+{
+	std::vector<float> samples(1029);
+	for (size_t i = 0; i < samples.size(); i++) {
+		samples[i] = static_cast<float>(static_cast<int>(i) - 514) / 500.0f;
+	}
+	samples[3] = std::numeric_limits<float>::quiet_NaN();
+	size_t expectedClipped = 0;
+	for (float sample : samples) {
+		float scaled = sample * 32768.0f;
+		expectedClipped += (scaled > 32767.0f || scaled < -32768.0f) ? 1 : 0;
+	}
+	for (AudioMixerKernel kernel : Kernels) {
+		if (!AudioMixer::IsKernelSupported(kernel)) {
+			continue;
+		}
+		AudioSampleConverter converter(kernel);
+		CHECK(!converter.IsDitherEnabled());
+		std::vector<int16_t> output(samples.size());
+		CHECK_EQUAL(expectedClipped, converter.ToInt16(samples.data(), samples.size(), output.data()));
+		for (size_t i = 0; i < samples.size(); i++) {
+			if (i == 3) {
+				//NaN ends up at the minimum in every kernel.
+				CHECK_EQUAL(-32768, output[i]);
+				continue;
+			}
+			float scaled = (std::max)(-32768.0f, (std::min)(32767.0f, samples[i] * 32768.0f));
+			CHECK_EQUAL(static_cast<int16_t>(std::lrintf(scaled)), output[i]);
+		}
+	}
+}
+
+TEST_CASE(DitherAddsAtMostOneLsbOfNoise)
+{
+	std::vector<float> samples(4099);
+	for (size_t i = 0; i < samples.size(); i++) {
+		samples[i] = 0.3f * std::sin(static_cast<float>(i) * 0.01f);
+	}
+	for (AudioMixerKernel kernel : Kernels) {
+		if (!AudioMixer::IsKernelSupported(kernel)) {
+			continue;
+		}
+		AudioSampleConverter converter(kernel);
+		converter.SetDitherEnabled(true);
+		std::vector<int16_t> output(samples.size());
+		CHECK_EQUAL(0, converter.ToInt16(samples.data(), samples.size(), output.data()));
+		double errorSum = 0;
+		size_t changedCount = 0;
+		for (size_t i = 0; i < samples.size(); i++) {
+			double error = output[i] - samples[i] * 32768.0;
+			CHECK(std::fabs(error) <= 1.5);
+			errorSum += error;
+			changedCount += output[i] != static_cast<int16_t>(std::lrintf(samples[i] * 32768.0f)) ? 1 : 0;
+		}
+		//The dither has no DC offset, and changes a good share of the samples.
+		CHECK(std::fabs(errorSum / samples.size()) < 0.05);
+		CHECK(changedCount > samples.size() / 10);
+	}
+}
@@ -0,0 +1,78 @@
+#include "TestHarness.h"
+#include "AudioTimeline.h"
+
+TEST_CASE(ConversionsRoundToNearest)
+{
+	CHECK_EQUAL(48000, AudioTimeline::HundredNanosToFrames(10000000, 48000));
+	CHECK_EQUAL(0, AudioTimeline::HundredNanosToFrames(-5, 48000));
+	CHECK_EQUAL(0, AudioTimeline::HundredNanosToFrames(10000000, 0));
+	//One frame at 44.1 kHz is 226.76 units.
+	CHECK_EQUAL(1, AudioTimeline::HundredNanosToFrames(227, 44100));
+	CHECK_EQUAL(227, AudioTimeline::FramesToHundredNanos(1, 44100));
+	CHECK_EQUAL(10000000, AudioTimeline::FramesToHundredNanos(44100, 44100));
+	//A day at 192 kHz does not overflow.
+	int64_t day = 24LL * 3600 * 10000000;
+	CHECK_EQUAL(24ULL * 3600 * 192000, AudioTimeline::HundredNanosToFrames(day, 192000));
+	CHECK_EQUAL(day, AudioTimeline::FramesToHundredNanos(24ULL * 3600 * 192000, 192000));
+}
+
+TEST_CASE(AdvanceDoesNotAccumulateRounding)
+{
+	AudioTimeline timeline;
+	timeline.Initialize(44100);
+	//Frames of a 30 fps video are 333333 or 333334 units long, neither of which is a whole number of audio frames.
+	uint64_t total = 0;
+	for (int64_t frame = 1; frame <= 30 * 3600; frame++) {
+		total += timeline.Advance(frame * 10000000 / 30);
+	}
+	CHECK_EQUAL(44100ULL * 3600, total);
+	CHECK_EQUAL(total, timeline.GetFramePosition());
+	CHECK_EQUAL(3600LL * 10000000, timeline.GetPosition100Nanos());
+	//Positions that are not past the end of the timeline add nothing.
+	CHECK_EQUAL(0, timeline.Advance(0));
+	CHECK_EQUAL(0, timeline.Advance(3600LL * 10000000));
+}
+
+TEST_CASE(DriftCompensatorConvergesOnDeviceDrift)
+{
+	const uint32_t sampleRate = 48000;
+	const size_t blockFrames = 480;
+	const size_t targetFrames = 2400;
+	const double drift = 500e-6;
+	AudioDriftCompensator compensator;
+	compensator.Initialize(sampleRate, targetFrames);
+	CHECK_EQUAL(targetFrames, compensator.GetTargetLatencyFrames());
+	//The device delivers 500 ppm too much audio, and the buffer is drained at the rate the compensator asks for.
+	double buffered = static_cast<double>(targetFrames);
+	double ratio = 1.0;
+	for (int block = 0; block < 600 * 100; block++) {
+		double delivered = blockFrames * (1 + drift);
+		buffered += delivered - blockFrames * ratio;
+		ratio = compensator.Update(static_cast<size_t>(buffered), blockFrames, static_cast<size_t>(delivered));
+	}
+	AUDIO_DRIFT_STATS stats = compensator.GetStats();
+	CHECK_NEAR(500, stats.DriftPpm, 20);
+	CHECK_NEAR(500, stats.CorrectionPpm, 20);
+	CHECK_NEAR(50, stats.LatencyMillis, 1);
+	CHECK_EQUAL(600ULL * sampleRate, stats.TimelineFrames);
+	//Latency resets keep the drift, since it belongs to the device clock.
+	compensator.ResetLatency();
+	CHECK_NEAR(500, compensator.GetStats().DriftPpm, 20);
+}
+
+TEST_CASE(DriftCorrectionIsBounded)
+{
+	AudioDriftCompensator compensator;
+	compensator.Initialize(48000, 2400);
+	//A buffer stuck far above the target saturates the correction at 1%.
+	for (int block = 0; block < 100000; block++) {
+		compensator.Update(48000, 480, 480);
+	}
+	CHECK_NEAR(1.01, compensator.GetRateAdjustment(), 1e-9);
+	CHECK_NEAR(5000, compensator.GetStats().DriftPpm, 1e-6);
+	CHECK_EQUAL(2400 * 4 + 4800, compensator.GetMaxLatencyFrames());
+	compensator.AddUnderrun(10);
+	compensator.AddDropped(20);
+	CHECK_EQUAL(10, compensator.GetStats().UnderrunFrames);
+	CHECK_EQUAL(20, compensator.GetStats().DroppedFrames);
+}
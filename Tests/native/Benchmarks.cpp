@@ -0,0 +1,458 @@
+//Throughput benchmarks of the portable parts of ScreenRecorderLibNative.
+//  NativeBenchmarks [--quick] [filter]
+//--quick runs a fraction of the iterations, as ctest does to check that the benchmarks still run. The filter runs only the benchmarks whose name contains it.
+#include "AudioBufferPool.h"
+#include "AudioMixer.h"
+#include "AudioResampler.h"
+#include "AudioRingBuffer.h"
+#include "AudioSampleConverter.h"
+#include "ColorConverter.h"
+#include "EncodeQueue.h"
+#include "Fmp4Muxer.h"
+#include "FramePipeline.h"
+#include "FrameSlotExchange.h"
+#include "LeasePool.h"
+#include "QoiEncoder.h"
+#include "RecyclingPool.h"
+#include "WriteBehindBuffer.h"
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#ifdef NATIVE_BENCHMARKS_PNG
+#include <png.h>
+#endif
+
+namespace {
+	struct BENCHMARK
+	{
+		BENCHMARK(const char *name, const char *unit, double bytesPerOperation, std::function<void(uint64_t count)> run, uint64_t count, std::shared_ptr<double> outputBytesPerOperation = nullptr) :
+			Name(name),
+			Unit(unit),
+			BytesPerOperation(bytesPerOperation),
+			Run(std::move(run)),
+			Count(count),
+			OutputBytesPerOperation(std::move(outputBytesPerOperation))
+		{
+		}
+
+		const char *Name;
+		//What one operation is, for the printed rate.
+		const char *Unit;
+		//The number of bytes one operation processes, or 0 to only print operations per second.
+		double BytesPerOperation;
+		//Runs the given number of operations.
+		std::function<void(uint64_t count)> Run;
+		uint64_t Count;
+		//Set by Run to the number of bytes one operation outputs, to print the ratio of output to input, or null.
+		std::shared_ptr<double> OutputBytesPerOperation;
+	};
+
+	double g_Scale = 1.0;
+
+	uint64_t Scaled(uint64_t count)
+	{
+		return (std::max)(static_cast<uint64_t>(count * g_Scale), static_cast<uint64_t>(1));
+	}
+
+	void RunBenchmark(const BENCHMARK &benchmark)
+	{
+		uint64_t count = Scaled(benchmark.Count);
+		//One short run first, so caches, pools and threads are warm.
+		benchmark.Run((std::max)(count / 10, static_cast<uint64_t>(1)));
+		auto start = std::chrono::steady_clock::now();
+		benchmark.Run(count);
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		double rate = count / seconds;
+		if (benchmark.OutputBytesPerOperation && benchmark.BytesPerOperation > 0) {
+			printf("%-40s %12.0f %s/s %10.1f MB/s %8.3f output/input\n", benchmark.Name, rate, benchmark.Unit, rate * benchmark.BytesPerOperation / 1e6, *benchmark.OutputBytesPerOperation / benchmark.BytesPerOperation);
+		}
+		else if (benchmark.BytesPerOperation > 0) {
+			printf("%-40s %12.0f %s/s %10.1f MB/s\n", benchmark.Name, rate, benchmark.Unit, rate * benchmark.BytesPerOperation / 1e6);
+		}
+		else {
+			printf("%-40s %12.0f %s/s\n", benchmark.Name, rate, benchmark.Unit);
+		}
+		fflush(stdout);
+	}
+
+	std::vector<float> MakeSignal(size_t count)
+	{
+		std::vector<float> samples(count);
+		std::mt19937 random(1);
+		std::uniform_real_distribution<float> distribution(-0.5f, 0.5f);
+		for (float &sample : samples) {
+			sample = distribution(random);
+		}
+		return samples;
+	}
+
+	//A desktop-like frame: flat panels, a gradient title bar and text-like noise.
+	std::vector<uint8_t> MakeScreen(uint32_t width, uint32_t height)
+	{
+		std::mt19937 random(7);
+		std::vector<uint8_t> image(static_cast<size_t>(width) * height * 4);
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				uint8_t *pPixel = &image[(static_cast<size_t>(y) * width + x) * 4];
+				uint8_t value = (x / 300 + y / 200) % 2 ? 240 : 32;
+				pPixel[0] = value;
+				pPixel[1] = value;
+				pPixel[2] = value;
+				pPixel[3] = 255;
+				if (y % 200 < 24) {
+					pPixel[0] = static_cast<uint8_t>(x * 255 / width);
+					pPixel[1] = 120;
+					pPixel[2] = 200;
+				}
+				if (y % 20 < 12 && x % 9 < 6 && (x / 300) % 2 && random() % 3 == 0) {
+					pPixel[0] = pPixel[1] = pPixel[2] = 0;
+				}
+			}
+		}
+		return image;
+	}
+
+	//10 ms of 48 kHz stereo float.
+	const size_t BlockSamples = 480 * 2;
+	const uint32_t FrameWidth = 1920;
+	const uint32_t FrameHeight = 1080;
+
+	void AddAudioBenchmarks(std::vector<BENCHMARK> &benchmarks)
+	{
+		benchmarks.push_back({ "AudioRingBuffer write and read", "block", BlockSamples * 4.0, [](uint64_t count) {
+			AudioRingBuffer buffer(64 * 1024, 8);
+			std::vector<uint8_t> block(BlockSamples * 4, 1);
+			std::vector<uint8_t> read(block.size());
+			for (uint64_t i = 0; i < count; i++) {
+				buffer.Write(block.data(), block.size());
+				buffer.Read(read.data(), read.size());
+			}
+		}, 2000000 });
+		benchmarks.push_back({ "AudioRingBuffer across threads", "block", BlockSamples * 4.0, [](uint64_t count) {
+			AudioRingBuffer buffer(256 * 1024, 8);
+			std::vector<uint8_t> block(BlockSamples * 4, 1);
+			uint64_t totalBytes = count * block.size();
+			std::thread writer([&]() {
+				uint64_t written = 0;
+				while (written < totalBytes) {
+					size_t bytes = buffer.Write(block.data(), block.size());
+					written += bytes;
+					if (bytes == 0) {
+						std::this_thread::yield();
+					}
+				}
+			});
+			std::vector<uint8_t> read(block.size());
+			uint64_t readBytes = 0;
+			while (readBytes < totalBytes) {
+				size_t bytes = buffer.Read(read.data(), read.size());
+				readBytes += bytes;
+				if (bytes == 0) {
+					std::this_thread::yield();
+				}
+			}
+			writer.join();
+		}, 500000 });
+		for (AudioMixerKernel kernel : { AudioMixerKernel::Scalar, AudioMixerKernel::SSE2, AudioMixerKernel::AVX2 }) {
+			if (!AudioMixer::IsKernelSupported(kernel)) {
+				continue;
+			}
+			static const char *Names[] = { "AudioMixer 4 streams Scalar", "AudioMixer 4 streams SSE2", "AudioMixer 4 streams AVX2" };
+			benchmarks.push_back({ Names[static_cast<int>(kernel)], "block", BlockSamples * 4.0 * 4, [kernel](uint64_t count) {
+				std::vector<float> signal = MakeSignal(BlockSamples);
+				AUDIO_MIX_INPUT inputs[4];
+				for (AUDIO_MIX_INPUT &input : inputs) {
+					input.Samples = signal.data();
+					input.SampleCount = signal.size();
+					input.Gain = 0.7f;
+				}
+				std::vector<float> output(BlockSamples);
+				AudioMixer mixer(kernel);
+				for (uint64_t i = 0; i < count; i++) {
+					mixer.Mix(inputs, 4, output.data(), output.size());
+				}
+			}, 2000000 });
+		}
+		benchmarks.push_back({ "AudioResampler 44.1 to 48 kHz stereo", "block", BlockSamples * 4.0, [](uint64_t count) {
+			AudioResampler resampler;
+			resampler.Initialize(44100, 2, 48000, 2, 16);
+			std::vector<float> input = MakeSignal(441 * 2);
+			std::vector<float> output(resampler.GetMaxOutputFrames(441) * 2);
+			for (uint64_t i = 0; i < count; i++) {
+				resampler.Process(input.data(), 441, output.data());
+			}
+		}, 100000 });
+		benchmarks.push_back({ "AudioSampleConverter int16 to float", "block", BlockSamples * 2.0, [](uint64_t count) {
+			AudioSampleConverter converter(AudioMixer::GetBestSupportedKernel());
+			std::vector<int16_t> input(BlockSamples, 1000);
+			std::vector<float> output(BlockSamples);
+			for (uint64_t i = 0; i < count; i++) {
+				converter.ToFloat(input.data(), AudioSampleFormat::Int16, input.size(), output.data());
+			}
+		}, 2000000 });
+		benchmarks.push_back({ "AudioSampleConverter float to int16", "block", BlockSamples * 4.0, [](uint64_t count) {
+			AudioSampleConverter converter(AudioMixer::GetBestSupportedKernel());
+			std::vector<float> input = MakeSignal(BlockSamples);
+			std::vector<int16_t> output(BlockSamples);
+			for (uint64_t i = 0; i < count; i++) {
+				converter.ToInt16(input.data(), input.size(), output.data());
+			}
+		}, 2000000 });
+		benchmarks.push_back({ "AudioBufferPool acquire and release", "buffer", 0, [](uint64_t count) {
+			auto pool = AudioBufferPool::Create();
+			for (uint64_t i = 0; i < count; i++) {
+				AudioBufferRef buffer = pool->Acquire(BlockSamples * 2);
+			}
+		}, 5000000 });
+	}
+
+	void AddVideoBenchmarks(std::vector<BENCHMARK> &benchmarks)
+	{
+		auto screen = std::make_shared<std::vector<uint8_t>>(MakeScreen(FrameWidth, FrameHeight));
+		const double frameBytes = FrameWidth * FrameHeight * 4.0;
+		for (ColorConverterKernel kernel : { ColorConverterKernel::Scalar, ColorConverterKernel::SSE41, ColorConverterKernel::AVX2 }) {
+			if (!ColorConverter::IsKernelSupported(kernel)) {
+				continue;
+			}
+			static const char *Names[] = { "ColorConverter 1080p NV12 Scalar", "ColorConverter 1080p NV12 SSE4.1", "ColorConverter 1080p NV12 AVX2" };
+			benchmarks.push_back({ Names[static_cast<int>(kernel)], "frame", frameBytes, [screen, kernel](uint64_t count) {
+				ColorConverter converter(kernel);
+				converter.Initialize(YuvFormat::NV12, YuvMatrix::BT709, YuvRange::Limited, 1);
+				std::vector<uint8_t> output(ColorConverter::GetImageBytes(YuvFormat::NV12, FrameWidth, FrameHeight));
+				YUV_IMAGE image = ColorConverter::GetContiguousImage(YuvFormat::NV12, output.data(), FrameWidth, FrameHeight);
+				for (uint64_t i = 0; i < count; i++) {
+					converter.Convert(screen->data(), FrameWidth * 4, FrameWidth, FrameHeight, image);
+				}
+			}, 300 });
+		}
+		benchmarks.push_back({ "ColorConverter 1080p NV12 all threads", "frame", frameBytes, [screen](uint64_t count) {
+			ColorConverter converter;
+			converter.Initialize(YuvFormat::NV12, YuvMatrix::BT709, YuvRange::Limited);
+			std::vector<uint8_t> output(ColorConverter::GetImageBytes(YuvFormat::NV12, FrameWidth, FrameHeight));
+			YUV_IMAGE image = ColorConverter::GetContiguousImage(YuvFormat::NV12, output.data(), FrameWidth, FrameHeight);
+			for (uint64_t i = 0; i < count; i++) {
+				converter.Convert(screen->data(), FrameWidth * 4, FrameWidth, FrameHeight, image);
+			}
+		}, 300 });
+		for (uint32_t threadCount : { 1u, 4u }) {
+			benchmarks.push_back({ threadCount == 1 ? "QoiEncoder 1080p 1 thread" : "QoiEncoder 1080p 4 threads", "frame", frameBytes, [screen, threadCount](uint64_t count) {
+				std::vector<uint8_t> output;
+				for (uint64_t i = 0; i < count; i++) {
+					QoiEncoder::Encode(screen->data(), FrameWidth, FrameHeight, FrameWidth * 4, false, threadCount, &output);
+				}
+			}, 100 });
+		}
+	}
+#ifdef NATIVE_BENCHMARKS_PNG
+
+	//Decodes a PNG file to BGRA pixels with a row pitch of four times the width.
+	bool LoadPng(const std::string &path, std::vector<uint8_t> *pBgra, uint32_t *pWidth, uint32_t *pHeight)
+	{
+		png_image image;
+		memset(&image, 0, sizeof(image));
+		image.version = PNG_IMAGE_VERSION;
+		if (!png_image_begin_read_from_file(&image, path.c_str())) {
+			return false;
+		}
+		image.format = PNG_FORMAT_BGRA;
+		pBgra->resize(PNG_IMAGE_SIZE(image));
+		if (!png_image_finish_read(&image, nullptr, pBgra->data(), 0, nullptr)) {
+			return false;
+		}
+		*pWidth = image.width;
+		*pHeight = image.height;
+		return true;
+	}
+
+	//Real images, to measure the compression ratio along with the speed.
+	void AddTestmediaBenchmarks(std::vector<BENCHMARK> &benchmarks)
+	{
+		static const char *Files[] = { "renault.png", "alphatest.png" };
+		static const char *Names[] = { "QoiEncoder renault.png", "QoiEncoder alphatest.png" };
+		for (size_t i = 0; i < std::size(Files); i++) {
+			auto image = std::make_shared<std::vector<uint8_t>>();
+			uint32_t width = 0;
+			uint32_t height = 0;
+			if (!LoadPng(std::string(TESTMEDIA_DIR) + "/" + Files[i], image.get(), &width, &height)) {
+				printf("%-40s could not be read\n", Names[i]);
+				continue;
+			}
+			auto outputBytes = std::make_shared<double>(0);
+			benchmarks.push_back({ Names[i], "image", width * height * 4.0, [image, width, height, outputBytes](uint64_t count) {
+				std::vector<uint8_t> output;
+				for (uint64_t j = 0; j < count; j++) {
+					QoiEncoder::Encode(image->data(), width, height, width * 4, true, 1, &output);
+				}
+				*outputBytes = static_cast<double>(output.size());
+			}, 2000, outputBytes });
+		}
+	}
+#endif
+
+	typedef std::shared_ptr<std::vector<uint8_t>> Texture;
+
+	bool CreateTexture(const int &size, Texture *pTexture)
+	{
+		*pTexture = std::make_shared<std::vector<uint8_t>>(size);
+		return true;
+	}
+
+	bool IsTextureLeased(const Texture &texture)
+	{
+		return texture.use_count() > 1;
+	}
+
+	//Leases a copy and a canvas texture each frame, as the recorder does.
+	void RunLeasePool(uint64_t count)
+	{
+		LeasePool<int, Texture> pool(CreateTexture, IsTextureLeased);
+		for (uint64_t i = 0; i < count; i++) {
+			Texture copy;
+			Texture canvas;
+			pool.Acquire(4096, &copy);
+			pool.Acquire(1024, &canvas);
+			pool.NextFrame();
+		}
+	}
+
+	void AddPipelineBenchmarks(std::vector<BENCHMARK> &benchmarks)
+	{
+		benchmarks.push_back({ "EncodeQueue push to encode", "item", 0, [](uint64_t count) {
+			uint64_t encodedCount = 0;
+			EncodeQueue<uint64_t> queue(8, EncodeQueueDropPolicy::Block, [&encodedCount](uint64_t &) {
+				encodedCount++;
+				return true;
+			});
+			for (uint64_t i = 0; i < count; i++) {
+				queue.Push(uint64_t(i));
+			}
+			queue.Close();
+		}, 500000 });
+		benchmarks.push_back({ "FramePipeline 3 stages", "item", 0, [](uint64_t count) {
+			FramePipeline<uint64_t> pipeline(2);
+			for (const char *name : { "Compose", "Transform", "Encode" }) {
+				pipeline.AddStage(name, [](uint64_t &item) { item++; return true; });
+			}
+			pipeline.Start();
+			for (uint64_t i = 0; i < count; i++) {
+				pipeline.Push(uint64_t(i));
+			}
+			pipeline.Close();
+		}, 200000 });
+		benchmarks.push_back({ "FrameSlotExchange publish and acquire", "frame", 0, [](uint64_t count) {
+			FrameSlotExchange exchange;
+			uint32_t slot;
+			for (uint64_t i = 0; i < count; i++) {
+				exchange.Publish();
+				exchange.AcquireLatest(&slot);
+			}
+		}, 20000000 });
+		benchmarks.push_back({ "LeasePool acquire per frame", "frame", 0, RunLeasePool, 1000000 });
+		benchmarks.push_back({ "RecyclingPool acquire and recycle", "object", 0, [](uint64_t count) {
+			RecyclingPool<size_t, std::vector<uint8_t>> pool;
+			for (uint64_t i = 0; i < count; i++) {
+				std::vector<uint8_t> buffer;
+				if (!pool.TryAcquire(4096, buffer)) {
+					buffer.resize(4096);
+				}
+				pool.Recycle(4096, std::move(buffer));
+			}
+		}, 5000000 });
+	}
+
+	void AddOutputBenchmarks(std::vector<BENCHMARK> &benchmarks)
+	{
+		//50 KB frames at 30 fps and 1024 sample AAC frames, written to memory.
+		const size_t videoFrameBytes = 50000;
+		const size_t audioFrameBytes = 400;
+		benchmarks.push_back({ "Fmp4Muxer 30 fps with audio", "frame", videoFrameBytes + 1.5 * audioFrameBytes, [=](uint64_t count) {
+			std::vector<uint8_t> keyframe = { 0, 0, 0, 1, 0x67, 0x64, 0, 0x1F, 0xAC, 0xD9, 0, 0, 0, 1, 0x68, 0xEB, 0xE3, 0, 0, 0, 1, 0x65 };
+			keyframe.resize(videoFrameBytes, 0x11);
+			std::vector<uint8_t> deltaFrame = { 0, 0, 0, 1, 0x41 };
+			deltaFrame.resize(videoFrameBytes, 0x22);
+			std::vector<uint8_t> audioFrame(audioFrameBytes, 0x33);
+			uint64_t outputBytes = 0;
+			Fmp4Muxer muxer([&outputBytes](const uint8_t *, size_t size) {
+				outputBytes += size;
+				return true;
+			}, 20000000);
+			FMP4_TRACK_CONFIG videoConfig;
+			videoConfig.Codec = Fmp4Codec::H264;
+			videoConfig.Width = FrameWidth;
+			videoConfig.Height = FrameHeight;
+			FMP4_TRACK_CONFIG audioConfig;
+			audioConfig.Codec = Fmp4Codec::AAC;
+			uint32_t videoTrack = muxer.AddTrack(videoConfig);
+			uint32_t audioTrack = muxer.AddTrack(audioConfig);
+			int64_t audioPos = 0;
+			for (uint64_t i = 0; i < count; i++) {
+				int64_t pos = static_cast<int64_t>(i) * 333333;
+				const std::vector<uint8_t> &frame = i % 60 == 0 ? keyframe : deltaFrame;
+				FMP4_SAMPLE sample;
+				sample.StartPos = pos;
+				sample.Duration = 333333;
+				sample.IsKeyframe = i % 60 == 0;
+				sample.Data = frame.data();
+				sample.Size = frame.size();
+				muxer.WriteSample(videoTrack, sample);
+				while (audioPos < pos + 333333) {
+					FMP4_SAMPLE audio;
+					audio.StartPos = audioPos;
+					audio.Duration = 213333;
+					audio.IsKeyframe = true;
+					audio.Data = audioFrame.data();
+					audio.Size = audioFrame.size();
+					muxer.WriteSample(audioTrack, audio);
+					audioPos += 213333;
+				}
+			}
+			muxer.Finalize();
+		}, 20000 });
+		benchmarks.push_back({ "WriteBehindBuffer 100 byte writes", "write", 100, [](uint64_t count) {
+			uint64_t targetBytes = 0;
+			WriteBehindBuffer buffer([&targetBytes](const uint8_t *, size_t size) {
+				targetBytes += size;
+				return true;
+			}, [](uint64_t) { return true; }, 0, 0);
+			uint8_t data[100];
+			memset(data, 1, sizeof(data));
+			for (uint64_t i = 0; i < count; i++) {
+				buffer.Write(data, sizeof(data));
+			}
+			buffer.Flush();
+		}, 10000000 });
+	}
+}
+
+int main(int argc, char **argv)
+{
+	const char *filter = nullptr;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--quick") == 0) {
+			g_Scale = 0.02;
+		}
+		else {
+			filter = argv[i];
+		}
+	}
+	std::vector<BENCHMARK> benchmarks;
+	AddAudioBenchmarks(benchmarks);
+	AddVideoBenchmarks(benchmarks);
+#ifdef NATIVE_BENCHMARKS_PNG
+	AddTestmediaBenchmarks(benchmarks);
+#endif
+	AddPipelineBenchmarks(benchmarks);
+	AddOutputBenchmarks(benchmarks);
+	for (const BENCHMARK &benchmark : benchmarks) {
+		if (!filter || strstr(benchmark.Name, filter)) {
+			RunBenchmark(benchmark);
+		}
+	}
+	return 0;
+}
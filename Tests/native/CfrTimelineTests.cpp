@@ -0,0 +1,132 @@
+#include "TestHarness.h"
+#include "CfrTimeline.h"
+#include <memory>
+#include <random>
+
+namespace {
+	struct SAMPLE
+	{
+		int Frame;
+		int64_t StartPos;
+		int64_t Duration;
+	};
+
+	//The frame interval at 60 fps.
+	const int64_t Interval = 166667;
+
+	//Records a mostly static desktop at 60 fps, with a change every 60 frames of 1 to 3 source updates, and checks that the samples cover the timeline without gaps.
+	std::vector<SAMPLE> Record(CfrRepeatMode mode, CFR_TIMELINE_STATS *pStats)
+	{
+		std::mt19937 random(1);
+		std::vector<SAMPLE> samples;
+		CfrTimeline<std::shared_ptr<int>> timeline(mode, Interval, 5000000, [&](const std::shared_ptr<int> &frame, int64_t startPos, int64_t duration) {
+			samples.push_back(SAMPLE{ *frame, startPos, duration });
+			return true;
+		});
+		int frameId = 0;
+		for (int i = 0; i < 3600; i++) {
+			uint32_t updateCount = i % 60 == 0 ? 1 + random() % 3 : 0;
+			if (updateCount > 0 || mode == CfrRepeatMode::Encode) {
+				CHECK(timeline.AddFrame(std::make_shared<int>(frameId++), Interval, updateCount));
+			}
+			else {
+				CHECK(timeline.RepeatFrame(Interval));
+			}
+		}
+		int64_t endPos = timeline.GetPosition();
+		CHECK(timeline.Flush());
+		CHECK(!timeline.HasFrame());
+		CHECK(!timeline.RepeatFrame(Interval));
+		int64_t position = 0;
+		for (const SAMPLE &sample : samples) {
+			CHECK_EQUAL(position, sample.StartPos);
+			CHECK(sample.Duration > 0);
+			position += sample.Duration;
+		}
+		CHECK_EQUAL(endPos, position);
+		CHECK_EQUAL(3600 * Interval, position);
+		*pStats = timeline.GetStats();
+		return samples;
+	}
+}
+
+TEST_CASE(EncodeModeWritesEveryFrame)
+{
+	CFR_TIMELINE_STATS stats;
+	std::vector<SAMPLE> samples = Record(CfrRepeatMode::Encode, &stats);
+	CHECK_EQUAL(3600, stats.SampleCount);
+	CHECK_EQUAL(3600, stats.FrameCount);
+	CHECK_EQUAL(3540, stats.DuplicateCount);
+	CHECK_EQUAL(0, stats.ReferencedCount);
+	CHECK(stats.DroppedCount > 0);
+}
+
+TEST_CASE(ReferenceModeRepeatsTheFrameBefore)
+{
+	CFR_TIMELINE_STATS stats;
+	std::vector<SAMPLE> samples = Record(CfrRepeatMode::Reference, &stats);
+	CHECK_EQUAL(3600, stats.SampleCount);
+	CHECK_EQUAL(60, stats.FrameCount);
+	CHECK_EQUAL(3540, stats.ReferencedCount);
+	CHECK_EQUAL(3540, stats.DuplicateCount);
+	for (size_t i = 0; i < samples.size(); i++) {
+		CHECK_EQUAL(static_cast<int>(i / 60), samples[i].Frame);
+	}
+}
+
+TEST_CASE(ExtendModeMergesRepeatsUpToTheLongestSample)
+{
+	CFR_TIMELINE_STATS stats;
+	std::vector<SAMPLE> samples = Record(CfrRepeatMode::Extend, &stats);
+	CHECK_EQUAL(60, stats.FrameCount);
+	//Each change is held for 30 intervals, the longest sample of 0.5 seconds, and then continues as a reference.
+	CHECK_EQUAL(120, stats.SampleCount);
+	CHECK_EQUAL(60, stats.ReferencedCount);
+	CHECK_EQUAL(3480, stats.ElidedCount);
+	CHECK_EQUAL(3540, stats.DuplicateCount);
+	for (const SAMPLE &sample : samples) {
+		CHECK_EQUAL(30 * Interval, sample.Duration);
+	}
+}
+
+TEST_CASE(LateFrameCountsMissedIntervals)
+{
+	std::vector<SAMPLE> samples;
+	CfrTimeline<std::shared_ptr<int>> timeline(CfrRepeatMode::Extend, Interval, 10 * Interval, [&](const std::shared_ptr<int> &frame, int64_t startPos, int64_t duration) {
+		samples.push_back(SAMPLE{ *frame, startPos, duration });
+		return true;
+	});
+	timeline.AddFrame(std::make_shared<int>(7), Interval, 1);
+	for (int i = 0; i < 24; i++) {
+		CHECK(timeline.RepeatFrame(Interval));
+	}
+	CHECK_EQUAL(2, samples.size());
+	CHECK_EQUAL(10 * Interval, samples[1].Duration);
+	CHECK_EQUAL(7, samples[1].Frame);
+	CHECK_EQUAL(25 * Interval, timeline.GetPosition());
+	//The frame is two intervals late.
+	timeline.AddFrame(std::make_shared<int>(8), 3 * Interval, 1);
+	timeline.Flush();
+	CHECK_EQUAL(4, samples.size());
+	CHECK_EQUAL(5 * Interval, samples[2].Duration);
+	CHECK_EQUAL(3 * Interval, samples[3].Duration);
+	CFR_TIMELINE_STATS stats = timeline.GetStats();
+	CHECK_EQUAL(22, stats.ElidedCount);
+	CHECK_EQUAL(2, stats.ReferencedCount);
+	CHECK_EQUAL(26, stats.DuplicateCount);
+}
+
+TEST_CASE(FailedWriteIsReported)
+{
+	CfrTimeline<int> timeline(CfrRepeatMode::Reference, Interval, 0, [](const int &, int64_t, int64_t) { return false; });
+	CHECK(!timeline.AddFrame(1, Interval, 1));
+	CHECK_EQUAL(0, timeline.GetStats().SampleCount);
+}
+
+TEST_CASE(VariableFramerateCountsNoDuplicates)
+{
+	CfrTimeline<int> timeline(CfrRepeatMode::Encode, 0, 0, [](const int &, int64_t, int64_t) { return true; });
+	timeline.AddFrame(1, 123456, 0);
+	CHECK_EQUAL(0, timeline.GetStats().DuplicateCount);
+	CHECK_EQUAL(123456, timeline.GetPosition());
+}
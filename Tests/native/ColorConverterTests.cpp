@@ -0,0 +1,188 @@
+#include "TestHarness.h"
+#include "ColorConverter.h"
+#include <cstring>
+#include <random>
+
+namespace {
+	const ColorConverterKernel Kernels[] = { ColorConverterKernel::Scalar, ColorConverterKernel::SSE41, ColorConverterKernel::AVX2 };
+	const YuvFormat Formats[] = { YuvFormat::NV12, YuvFormat::I420, YuvFormat::P010 };
+
+	//A BGRA frame with random pixels and padding at the end of each row.
+	struct FRAME
+	{
+		uint32_t Width;
+		uint32_t Height;
+		size_t Stride;
+		std::vector<uint8_t> Pixels;
+	};
+
+	FRAME MakeRandomFrame(uint32_t width, uint32_t height)
+	{
+		std::mt19937 random(width * 31 + height);
+		FRAME frame{ width, height, width * 4 + 64, {} };
+		frame.Pixels.resize(frame.Stride * height);
+		for (uint8_t &value : frame.Pixels) {
+			value = static_cast<uint8_t>(random());
+		}
+		return frame;
+	}
+
+	FRAME MakeSolidFrame(uint32_t width, uint32_t height, uint8_t blue, uint8_t green, uint8_t red)
+	{
+		FRAME frame{ width, height, width * 4, {} };
+		frame.Pixels.resize(frame.Stride * height);
+		for (size_t i = 0; i < frame.Pixels.size(); i += 4) {
+			frame.Pixels[i] = blue;
+			frame.Pixels[i + 1] = green;
+			frame.Pixels[i + 2] = red;
+			frame.Pixels[i + 3] = 255;
+		}
+		return frame;
+	}
+
+	std::vector<uint8_t> Convert(ColorConverter &converter, const FRAME &frame)
+	{
+		size_t stride = converter.GetFormat() == YuvFormat::P010 ? frame.Width * 2 : frame.Width;
+		std::vector<uint8_t> output(ColorConverter::GetImageBytes(converter.GetFormat(), frame.Width, frame.Height), 0xCD);
+		YUV_IMAGE image = ColorConverter::GetContiguousImage(converter.GetFormat(), output.data(), stride, frame.Height);
+		CHECK(converter.Convert(frame.Pixels.data(), frame.Stride, frame.Width, frame.Height, image));
+		return output;
+	}
+}
+
+TEST_CASE(ImageLayoutMatchesFormat)
+{
+	CHECK_EQUAL(1920 * 1080 * 3 / 2, ColorConverter::GetImageBytes(YuvFormat::NV12, 1920, 1080));
+	CHECK_EQUAL(1920 * 1080 * 3 / 2, ColorConverter::GetImageBytes(YuvFormat::I420, 1920, 1080));
+	CHECK_EQUAL(1920 * 1080 * 3, ColorConverter::GetImageBytes(YuvFormat::P010, 1920, 1080));
+	uint8_t buffer[64 * 16 * 3 / 2];
+	YUV_IMAGE image = ColorConverter::GetContiguousImage(YuvFormat::I420, buffer, 64, 16);
+	CHECK(image.Planes[1] == buffer + 64 * 16);
+	CHECK(image.Planes[2] == buffer + 64 * 16 + 32 * 8);
+	CHECK_EQUAL(32, image.Strides[2]);
+	image = ColorConverter::GetContiguousImage(YuvFormat::NV12, buffer, 64, 16);
+	CHECK(image.Planes[2] == nullptr);
+	CHECK_EQUAL(64, image.Strides[1]);
+}
+
+TEST_CASE(OddFramesAreRejected)
+{
+	ColorConverter converter;
+	converter.Initialize(YuvFormat::NV12, YuvMatrix::BT709, YuvRange::Limited, 1);
+	FRAME frame = MakeSolidFrame(4, 4, 0, 0, 0);
+	std::vector<uint8_t> output(64);
+	YUV_IMAGE image = ColorConverter::GetContiguousImage(YuvFormat::NV12, output.data(), 4, 4);
+	CHECK(!converter.Convert(frame.Pixels.data(), frame.Stride, 3, 4, image));
+	CHECK(!converter.Convert(frame.Pixels.data(), frame.Stride, 4, 3, image));
+	image.Planes[1] = nullptr;
+	CHECK(!converter.Convert(frame.Pixels.data(), frame.Stride, 4, 4, image));
+}
+
+TEST_CASE(GraysMapToTheEndsOfTheRange)
+{
+	struct EXPECTED
+	{
+		YuvRange Range;
+		uint8_t Gray;
+		uint8_t Y;
+	};
+	const EXPECTED expectations[] = {
+		{ YuvRange::Limited, 0, 16 },
+		{ YuvRange::Limited, 255, 235 },
+		{ YuvRange::Full, 0, 0 },
+		{ YuvRange::Full, 255, 255 },
+	};
+	for (ColorConverterKernel kernel : Kernels) {
+		if (!ColorConverter::IsKernelSupported(kernel)) {
+			continue;
+		}
+		for (const EXPECTED &expected : expectations) {
+			ColorConverter converter(kernel);
+			converter.Initialize(YuvFormat::NV12, YuvMatrix::BT709, expected.Range, 1);
+			FRAME frame = MakeSolidFrame(64, 8, expected.Gray, expected.Gray, expected.Gray);
+			std::vector<uint8_t> output = Convert(converter, frame);
+			for (size_t i = 0; i < 64 * 8; i++) {
+				CHECK_EQUAL(expected.Y, output[i]);
+			}
+			for (size_t i = 64 * 8; i < output.size(); i++) {
+				CHECK_EQUAL(128, output[i]);
+			}
+			//P010 holds the 8-bit values times 4, in the high bits of each sample.
+			converter.Initialize(YuvFormat::P010, YuvMatrix::BT709, expected.Range, 1);
+			output = Convert(converter, frame);
+			uint16_t luma;
+			uint16_t chroma;
+			memcpy(&luma, output.data(), 2);
+			memcpy(&chroma, output.data() + 64 * 8 * 2, 2);
+			CHECK_EQUAL(expected.Y * 4 << 6, luma);
+			CHECK_EQUAL(512 << 6, chroma);
+		}
+	}
+}
+
+TEST_CASE(PrimariesFollowTheMatrix)
+{
+	ColorConverter converter(ColorConverterKernel::Scalar);
+	//Pure red in limited range BT.709 is Y 63, U 102, V 240, and in BT.601 Y 81, U 90, V 240.
+	FRAME frame = MakeSolidFrame(2, 2, 0, 0, 255);
+	converter.Initialize(YuvFormat::I420, YuvMatrix::BT709, YuvRange::Limited, 1);
+	std::vector<uint8_t> output = Convert(converter, frame);
+	CHECK_NEAR(63, output[0], 1);
+	CHECK_NEAR(102, output[4], 1);
+	CHECK_NEAR(240, output[5], 1);
+	converter.Initialize(YuvFormat::I420, YuvMatrix::BT601, YuvRange::Limited, 1);
+	CHECK(converter.GetMatrix() == YuvMatrix::BT601);
+	CHECK(converter.GetRange() == YuvRange::Limited);
+	output = Convert(converter, frame);
+	CHECK_NEAR(81, output[0], 1);
+	CHECK_NEAR(90, output[4], 1);
+	CHECK_NEAR(240, output[5], 1);
+}
+
+TEST_CASE(KernelsMatchScalar)
+{
+	//The width leaves a tail after the vector loops.
+	FRAME frame = MakeRandomFrame(206, 34);
+	for (YuvFormat format : Formats) {
+		for (YuvMatrix matrix : { YuvMatrix::BT601, YuvMatrix::BT709 }) {
+			for (YuvRange range : { YuvRange::Limited, YuvRange::Full }) {
+				ColorConverter scalar(ColorConverterKernel::Scalar);
+				scalar.Initialize(format, matrix, range, 1);
+				std::vector<uint8_t> expected = Convert(scalar, frame);
+				for (ColorConverterKernel kernel : Kernels) {
+					if (!ColorConverter::IsKernelSupported(kernel)) {
+						continue;
+					}
+					ColorConverter converter(kernel);
+					converter.Initialize(format, matrix, range, 1);
+					CHECK(expected == Convert(converter, frame));
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE(ThreadedConversionMatchesSingleThread)
+{
+	FRAME frame = MakeRandomFrame(320, 182);
+	for (YuvFormat format : Formats) {
+		ColorConverter single;
+		single.Initialize(format, YuvMatrix::BT709, YuvRange::Limited, 1);
+		CHECK_EQUAL(1, single.GetThreadCount());
+		std::vector<uint8_t> expected = Convert(single, frame);
+		ColorConverter threaded;
+		threaded.Initialize(format, YuvMatrix::BT709, YuvRange::Limited, 4);
+		CHECK_EQUAL(4, threaded.GetThreadCount());
+		for (int i = 0; i < 20; i++) {
+			CHECK(expected == Convert(threaded, frame));
+		}
+	}
+}
+
+TEST_CASE(KernelNamesAreKnown)
+{
+	CHECK(ColorConverter::IsKernelSupported(ColorConverterKernel::Scalar));
+	CHECK(ColorConverter::IsKernelSupported(ColorConverter::GetBestSupportedKernel()));
+	CHECK(strlen(ColorConverter::GetKernelName(ColorConverterKernel::AVX2)) > 0);
+	CHECK(ColorConverter().GetKernel() == ColorConverter::GetBestSupportedKernel());
+}
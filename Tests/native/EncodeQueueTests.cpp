@@ -0,0 +1,175 @@
+#include "TestHarness.h"
+#include "EncodeQueue.h"
+#include <atomic>
+
+namespace {
+	struct ITEM
+	{
+		int Id = 0;
+		//Stands in for data that must not be lost with a dropped frame, e.g. its audio.
+		int Audio = 0;
+	};
+
+	//Holds the encoder on its first item until it is opened, so the queue can be filled deterministically.
+	class EncoderGate
+	{
+	public:
+		void WaitUntilOpen()
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_IsWaiting = true;
+			m_Changed.notify_all();
+			m_Changed.wait(lock, [this]() { return m_IsOpen; });
+		}
+
+		void WaitUntilEncoderWaits()
+		{
+			std::unique_lock<std::mutex> lock(m_Mutex);
+			m_Changed.wait(lock, [this]() { return m_IsWaiting; });
+		}
+
+		void Open()
+		{
+			std::lock_guard<std::mutex> lock(m_Mutex);
+			m_IsOpen = true;
+			m_Changed.notify_all();
+		}
+
+	private:
+		std::mutex m_Mutex;
+		std::condition_variable m_Changed;
+		bool m_IsWaiting = false;
+		bool m_IsOpen = false;
+	};
+
+	ITEM Item(int id)
+	{
+		ITEM item;
+		item.Id = id;
+		item.Audio = 1;
+		return item;
+	}
+
+	//Fills a queue of depth 2 behind a held first item, pushing items 0 to 5, then encodes everything.
+	std::vector<ITEM> EncodeWithDrops(EncodeQueueDropPolicy policy, ENCODE_QUEUE_STATS *pStats)
+	{
+		EncoderGate gate;
+		std::vector<ITEM> encoded;
+		EncodeQueue<ITEM> queue(2, policy, [&](ITEM &item) {
+			if (encoded.empty()) {
+				gate.WaitUntilOpen();
+			}
+			encoded.push_back(item);
+			return true;
+		}, [](ITEM &dropped, ITEM &survivor) {
+			survivor.Audio += dropped.Audio;
+		});
+		CHECK(queue.Push(Item(0)));
+		gate.WaitUntilEncoderWaits();
+		for (int id = 1; id < 6; id++) {
+			CHECK(queue.Push(Item(id)));
+		}
+		CHECK_EQUAL(2, queue.GetQueuedCount());
+		gate.Open();
+		CHECK(queue.Drain());
+		CHECK(queue.Close());
+		*pStats = queue.GetStats();
+		return encoded;
+	}
+}
+
+TEST_CASE(BlockingQueueEncodesEveryItemInOrder)
+{
+	std::vector<int> encoded;
+	EncodeQueue<int> queue(4, EncodeQueueDropPolicy::Block, [&](int &item) {
+		encoded.push_back(item);
+		return true;
+	});
+	CHECK_EQUAL(4, queue.GetDepth());
+	for (int i = 0; i < 10000; i++) {
+		CHECK(queue.Push(int(i)));
+	}
+	CHECK(queue.Close());
+	CHECK_EQUAL(10000, encoded.size());
+	for (int i = 0; i < 10000; i++) {
+		CHECK_EQUAL(i, encoded[i]);
+	}
+	ENCODE_QUEUE_STATS stats = queue.GetStats();
+	CHECK_EQUAL(10000, stats.PushedCount);
+	CHECK_EQUAL(10000, stats.EncodedCount);
+	CHECK_EQUAL(0, stats.DroppedCount);
+	CHECK(stats.MaxDepth <= 4);
+	//A closed queue takes no more items.
+	CHECK(!queue.Push(1));
+}
+
+TEST_CASE(DropOldestKeepsTheNewestItems)
+{
+	ENCODE_QUEUE_STATS stats;
+	std::vector<ITEM> encoded = EncodeWithDrops(EncodeQueueDropPolicy::DropOldest, &stats);
+	CHECK_EQUAL(3, encoded.size());
+	CHECK_EQUAL(0, encoded[0].Id);
+	CHECK_EQUAL(4, encoded[1].Id);
+	CHECK_EQUAL(5, encoded[2].Id);
+	//The audio of the dropped items 1 to 3 was carried over to item 4.
+	CHECK_EQUAL(4, encoded[1].Audio);
+	CHECK_EQUAL(1, encoded[2].Audio);
+	CHECK_EQUAL(3, stats.DroppedCount);
+	CHECK_EQUAL(6, stats.PushedCount);
+	CHECK_EQUAL(3, stats.EncodedCount);
+}
+
+TEST_CASE(DropNewestKeepsTheQueuedItems)
+{
+	ENCODE_QUEUE_STATS stats;
+	std::vector<ITEM> encoded = EncodeWithDrops(EncodeQueueDropPolicy::DropNewest, &stats);
+	CHECK_EQUAL(3, encoded.size());
+	CHECK_EQUAL(1, encoded[1].Id);
+	CHECK_EQUAL(2, encoded[2].Id);
+	//The audio of the dropped items 3 to 5 was carried over to item 2.
+	CHECK_EQUAL(1, encoded[1].Audio);
+	CHECK_EQUAL(4, encoded[2].Audio);
+	CHECK_EQUAL(3, stats.DroppedCount);
+}
+
+TEST_CASE(BlockedPushWaitsForRoom)
+{
+	EncoderGate gate;
+	EncodeQueue<int> queue(1, EncodeQueueDropPolicy::Block, [&](int &item) {
+		if (item == 0) {
+			gate.WaitUntilOpen();
+		}
+		return true;
+	});
+	CHECK(queue.Push(0));
+	gate.WaitUntilEncoderWaits();
+	CHECK(queue.Push(1));
+	std::atomic<bool> isPushed(false);
+	std::thread producer([&]() {
+		queue.Push(2);
+		isPushed = true;
+	});
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	CHECK(!isPushed);
+	gate.Open();
+	producer.join();
+	CHECK(queue.Close());
+	ENCODE_QUEUE_STATS stats = queue.GetStats();
+	CHECK_EQUAL(1, stats.BlockedCount);
+	CHECK_EQUAL(3, stats.EncodedCount);
+}
+
+TEST_CASE(FailedEncodeFailsTheQueue)
+{
+	EncodeQueue<int> queue(8, EncodeQueueDropPolicy::Block, [](int &item) {
+		return item != 3;
+	});
+	for (int i = 0; i < 4; i++) {
+		queue.Push(int(i));
+	}
+	CHECK(!queue.Drain());
+	CHECK(queue.IsFailed());
+	CHECK(!queue.Push(4));
+	CHECK(!queue.Close());
+	CHECK_EQUAL(3, queue.GetStats().EncodedCount);
+}
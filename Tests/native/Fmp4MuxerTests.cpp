@@ -0,0 +1,199 @@
+#include "TestHarness.h"
+#include "Fmp4Muxer.h"
+#include <map>
+#include <string>
+
+namespace {
+	//A keyframe in Annex B format, with an access unit delimiter, SPS and PPS ahead of the IDR slice.
+	const std::vector<uint8_t> Keyframe = { 0, 0, 0, 1, 0x09, 0xF0, 0, 0, 0, 1, 0x67, 0x64, 0, 0x1F, 0xAC, 0xD9, 0, 0, 0, 1, 0x68, 0xEB, 0xE3, 0, 0, 1, 0x65, 1, 2, 3, 0, 0 };
+	const std::vector<uint8_t> DeltaFrame = { 0, 0, 0, 1, 0x41, 9, 8, 7, 6 };
+	const std::vector<uint8_t> AudioFrame(300, 0x21);
+	//A 1024 sample AAC frame at 48 kHz.
+	const int64_t AudioFrameDuration = 213333;
+
+	//Reads the boxes of the output.
+	class BoxReader
+	{
+	public:
+		explicit BoxReader(const std::vector<uint8_t> &data) : m_Data(data) {}
+
+		uint32_t Read32(size_t pos) const
+		{
+			return (static_cast<uint32_t>(m_Data[pos]) << 24) | (static_cast<uint32_t>(m_Data[pos + 1]) << 16) | (static_cast<uint32_t>(m_Data[pos + 2]) << 8) | m_Data[pos + 3];
+		}
+
+		uint64_t Read64(size_t pos) const
+		{
+			return (static_cast<uint64_t>(Read32(pos)) << 32) | Read32(pos + 4);
+		}
+
+		std::string GetType(size_t pos) const
+		{
+			return std::string(reinterpret_cast<const char *>(&m_Data[pos + 4]), 4);
+		}
+
+		uint64_t GetSize(size_t pos) const
+		{
+			uint64_t size = Read32(pos);
+			return size == 1 ? Read64(pos + 8) : size;
+		}
+
+	private:
+		const std::vector<uint8_t> &m_Data;
+	};
+
+	FMP4_SAMPLE Sample(int64_t startPos, int64_t duration, bool isKeyframe, const std::vector<uint8_t> &data)
+	{
+		FMP4_SAMPLE sample;
+		sample.StartPos = startPos;
+		sample.Duration = duration;
+		sample.IsKeyframe = isKeyframe;
+		sample.Data = data.data();
+		sample.Size = data.size();
+		return sample;
+	}
+}
+
+TEST_CASE(FragmentsStartAtKeyframesAndCoverTheTimeline)
+{
+	std::vector<uint8_t> output;
+	std::vector<FMP4_FRAGMENT_INFO> fragments;
+	Fmp4Muxer muxer([&](const uint8_t *pData, size_t size) {
+		output.insert(output.end(), pData, pData + size);
+		return true;
+	}, 20000000, [&](const FMP4_FRAGMENT_INFO &fragment) {
+		fragments.push_back(fragment);
+	});
+	FMP4_TRACK_CONFIG videoConfig;
+	videoConfig.Codec = Fmp4Codec::H264;
+	videoConfig.Width = 1920;
+	videoConfig.Height = 1080;
+	FMP4_TRACK_CONFIG audioConfig;
+	audioConfig.Codec = Fmp4Codec::AAC;
+	audioConfig.Bitrate = 192000;
+	uint32_t videoTrack = muxer.AddTrack(videoConfig);
+	uint32_t audioTrack = muxer.AddTrack(audioConfig);
+	//Audio ahead of the first keyframe is kept, video is dropped since it cannot be decoded.
+	CHECK(muxer.WriteSample(audioTrack, Sample(0, AudioFrameDuration, true, AudioFrame)));
+	CHECK(muxer.WriteSample(videoTrack, Sample(0, 333333, false, DeltaFrame)));
+	int64_t audioPos = AudioFrameDuration;
+	//10 seconds at 30 fps, with a keyframe every 2 seconds.
+	for (int i = 1; i < 300; i++) {
+		int64_t startPos = i * 10000000LL / 30;
+		bool isKeyframe = i % 60 == 1;
+		CHECK(muxer.WriteSample(videoTrack, Sample(startPos, (i + 1) * 10000000LL / 30 - startPos, isKeyframe, isKeyframe ? Keyframe : DeltaFrame)));
+		for (; audioPos < startPos; audioPos += AudioFrameDuration) {
+			CHECK(muxer.WriteSample(audioTrack, Sample(audioPos, AudioFrameDuration, true, AudioFrame)));
+		}
+	}
+	CHECK(muxer.Finalize());
+	CHECK(!muxer.IsFailed());
+	CHECK_EQUAL(output.size(), muxer.GetOutputSize());
+
+	//Walk the boxes, checking that every sample lies in the mdat of its fragment, and that the decode times of each track are continuous.
+	BoxReader reader(output);
+	std::vector<size_t> moofPositions;
+	std::vector<std::string> topLevelTypes;
+	std::map<uint32_t, uint64_t> nextDecodeTimes;
+	size_t pos = 0;
+	while (pos < output.size()) {
+		uint64_t size = reader.GetSize(pos);
+		CHECK(size >= 8 && pos + size <= output.size());
+		std::string type = reader.GetType(pos);
+		topLevelTypes.push_back(type);
+		if (type == "moof") {
+			moofPositions.push_back(pos);
+			size_t mdatPos = pos + static_cast<size_t>(size);
+			CHECK(reader.GetType(mdatPos) == "mdat");
+			uint64_t mdatEnd = mdatPos + reader.GetSize(mdatPos);
+			for (size_t child = pos + 8; child < pos + size; child += reader.Read32(child)) {
+				if (reader.GetType(child) != "traf") {
+					continue;
+				}
+				uint32_t trackId = 0;
+				uint64_t decodeTime = 0;
+				uint64_t duration = 0;
+				for (size_t box = child + 8; box < child + reader.Read32(child); box += reader.Read32(box)) {
+					std::string boxType = reader.GetType(box);
+					if (boxType == "tfhd") {
+						trackId = reader.Read32(box + 12);
+					}
+					else if (boxType == "tfdt") {
+						decodeTime = reader.Read64(box + 12);
+					}
+					else if (boxType == "trun") {
+						uint32_t sampleCount = reader.Read32(box + 12);
+						uint32_t dataOffset = reader.Read32(box + 16);
+						uint64_t dataSize = 0;
+						for (uint32_t i = 0; i < sampleCount; i++) {
+							duration += reader.Read32(box + 20 + i * 12);
+							dataSize += reader.Read32(box + 24 + i * 12);
+						}
+						CHECK(pos + dataOffset >= mdatPos + 8);
+						CHECK(pos + dataOffset + dataSize <= mdatEnd);
+						if (trackId == 1) {
+							//Video samples are length prefixed, with the parameter sets and delimiters removed.
+							size_t samplePos = pos + dataOffset;
+							CHECK(samplePos + 4 + reader.Read32(samplePos) <= mdatEnd);
+							uint8_t nalType = output[samplePos + 4] & 0x1F;
+							CHECK(nalType == 5 || nalType == 1);
+						}
+					}
+				}
+				if (nextDecodeTimes.count(trackId) > 0) {
+					CHECK_EQUAL(nextDecodeTimes[trackId], decodeTime);
+				}
+				nextDecodeTimes[trackId] = decodeTime + duration;
+			}
+		}
+		pos += static_cast<size_t>(size);
+	}
+	CHECK_EQUAL(output.size(), pos);
+	CHECK(topLevelTypes[0] == "ftyp");
+	CHECK(topLevelTypes[1] == "moov");
+	CHECK_EQUAL(2, nextDecodeTimes.size());
+
+	//A fragment is cut at the first keyframe after 2 seconds, so there is one per keyframe.
+	CHECK_EQUAL(5, fragments.size());
+	CHECK_EQUAL(fragments.size(), moofPositions.size());
+	CHECK_EQUAL(fragments.size(), muxer.GetFragments().size());
+	CHECK_EQUAL(moofPositions[0], muxer.GetInitSegmentSize());
+	uint64_t endPos = moofPositions[0];
+	for (size_t i = 0; i < fragments.size(); i++) {
+		CHECK_EQUAL(moofPositions[i], fragments[i].Offset);
+		CHECK_EQUAL(endPos, fragments[i].Offset);
+		endPos += fragments[i].Size;
+		CHECK(fragments[i].IsKeyframe);
+		CHECK_EQUAL(i + 1, fragments[i].SequenceNumber);
+	}
+	CHECK_EQUAL(output.size(), endPos);
+}
+
+TEST_CASE(MissingParameterSetsFailFinalize)
+{
+	Fmp4Muxer muxer([](const uint8_t *, size_t) { return true; }, 0);
+	FMP4_TRACK_CONFIG config;
+	config.Codec = Fmp4Codec::H264;
+	config.Width = 640;
+	config.Height = 480;
+	uint32_t track = muxer.AddTrack(config);
+	CHECK(muxer.WriteSample(track, Sample(0, 333333, false, DeltaFrame)));
+	CHECK(!muxer.Finalize());
+	CHECK_EQUAL(0, muxer.GetInitSegmentSize());
+}
+
+TEST_CASE(FailedWriteFailsTheMuxer)
+{
+	Fmp4Muxer muxer([](const uint8_t *, size_t) { return false; }, 0);
+	FMP4_TRACK_CONFIG config;
+	config.Codec = Fmp4Codec::AAC;
+	uint32_t track = muxer.AddTrack(config);
+	bool isWritten = true;
+	for (int i = 0; i < 10 && isWritten; i++) {
+		isWritten = muxer.WriteSample(track, Sample(i * AudioFrameDuration, AudioFrameDuration, true, AudioFrame));
+	}
+	isWritten &= muxer.Finalize();
+	CHECK(!isWritten);
+	CHECK(muxer.IsFailed());
+	CHECK(!muxer.WriteSample(track, Sample(0, AudioFrameDuration, true, AudioFrame)));
+}
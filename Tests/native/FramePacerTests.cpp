@@ -0,0 +1,165 @@
+#include "TestHarness.h"
+#include "FramePacer.h"
+#include <deque>
+#include <random>
+#include <thread>
+
+namespace {
+	//A simulated clock. Waits jump the clock to the deadline plus a random timer jitter, or to the next signal if it comes first.
+	class FakeFrameWaiter : public FrameWaiter
+	{
+	public:
+		int64_t Time = 1000000;
+		//The times at which signals arrive.
+		std::deque<int64_t> Signals;
+		int64_t MaxWakeJitter = 10000;
+
+		int64_t Now() override
+		{
+			return Time;
+		}
+
+		FrameWaitResult WaitUntil(int64_t time100Nanos) override
+		{
+			if (!Signals.empty() && Signals.front() <= (std::max)(Time, time100Nanos)) {
+				Time = (std::max)(Time, Signals.front());
+				Signals.pop_front();
+				return FrameWaitResult::Signaled;
+			}
+			if (time100Nanos > Time) {
+				Time = time100Nanos + std::uniform_int_distribution<int64_t>(0, MaxWakeJitter)(m_Random);
+			}
+			return FrameWaitResult::Deadline;
+		}
+
+		void Signal() override
+		{
+			Signals.push_back(Time);
+		}
+
+	private:
+		std::mt19937 m_Random{ 42 };
+	};
+
+	//Runs the recorder loop at a fixed framerate: a frame is written once its deadline passed, otherwise the loop waits for the deadline or a captured frame.
+	FRAME_PACER_STATS RunFixedFramerate(int64_t interval, int64_t captureInterval, int frameCount, int64_t maxRenderTime, int64_t *pTimelineBehind)
+	{
+		FakeFrameWaiter waiter;
+		std::mt19937 random(7);
+		for (int64_t time = waiter.Time; time < waiter.Time + interval * (frameCount + 5); time += captureInterval) {
+			waiter.Signals.push_back(time + std::uniform_int_distribution<int64_t>(0, 20000)(random));
+		}
+		FramePacer pacer(&waiter, interval, true);
+		int64_t startTime = waiter.Time;
+		int64_t timeline = 0;
+		//The first frame is written right away.
+		pacer.CompleteFrame();
+		for (int frame = 1; frame < frameCount;) {
+			if (pacer.GetTimeSinceLastFrame() < interval) {
+				pacer.WaitFor(pacer.GetNextDeadline() - pacer.Now());
+				continue;
+			}
+			int64_t duration = pacer.CompleteFrame();
+			CHECK(duration > 0);
+			CHECK_EQUAL(0, duration % interval);
+			timeline += duration;
+			frame++;
+			waiter.Time += std::uniform_int_distribution<int64_t>(0, maxRenderTime)(random);
+		}
+		*pTimelineBehind = (waiter.Time - startTime) - timeline;
+		return pacer.GetStats();
+	}
+}
+
+TEST_CASE(FixedFramerateStaysInStepWithTheClock)
+{
+	const int64_t interval = 333333;
+	const int64_t maxRenderTime = 50000;
+	int64_t behind;
+	FRAME_PACER_STATS stats = RunFixedFramerate(interval, 166666, 3000, maxRenderTime, &behind);
+	CHECK_EQUAL(3000, stats.FrameCount);
+	CHECK_EQUAL(0, stats.MissedIntervalCount);
+	CHECK(behind >= 0 && behind < interval + maxRenderTime);
+	CHECK(stats.MaxLateness100Nanos <= 10000 + maxRenderTime);
+	//Frames are waited for, not polled: at most one wake up per captured frame, plus one for the deadline.
+	CHECK(stats.WaitCount <= 3000ULL * 4);
+	CHECK(stats.SignaledWaitCount > 0);
+}
+
+TEST_CASE(SlowRenderingMissesIntervals)
+{
+	const int64_t interval = 333333;
+	const int64_t maxRenderTime = 800000;
+	int64_t behind;
+	FRAME_PACER_STATS stats = RunFixedFramerate(interval, 166666, 3000, maxRenderTime, &behind);
+	CHECK(stats.MissedIntervalCount > 0);
+	CHECK(stats.MaxLateness100Nanos < interval);
+	CHECK(behind >= 0 && behind < interval + maxRenderTime);
+}
+
+TEST_CASE(VariableFramerateUsesCompletionTimes)
+{
+	FakeFrameWaiter waiter;
+	FramePacer pacer(&waiter, 333333, false);
+	waiter.Time += 100000;
+	CHECK_EQUAL(100000, pacer.CompleteFrame());
+	waiter.Time += 500000;
+	CHECK_EQUAL(500000, pacer.CompleteFrame());
+	CHECK_EQUAL(0, pacer.GetStats().PacedFrameCount);
+	CHECK_EQUAL(0, pacer.GetStats().MissedIntervalCount);
+	CHECK_EQUAL(waiter.Time + 333333, pacer.GetNextDeadline());
+}
+
+TEST_CASE(LateFrameIsMovedBackToItsInterval)
+{
+	FakeFrameWaiter waiter;
+	FramePacer pacer(&waiter, 100000, true);
+	//An early frame, e.g. the first one, ends when it is completed.
+	waiter.Time += 30000;
+	CHECK_EQUAL(30000, pacer.CompleteFrame());
+	CHECK_EQUAL(waiter.Time + 100000, pacer.GetNextDeadline());
+	//2.5 intervals later, one interval was missed.
+	waiter.Time += 250000;
+	CHECK_EQUAL(200000, pacer.CompleteFrame());
+	CHECK_EQUAL(1, pacer.GetStats().MissedIntervalCount);
+	CHECK_EQUAL(50000, pacer.GetTimeSinceLastFrame());
+	//Restarting after a pause leaves the paused time out.
+	waiter.Time += 1000000;
+	pacer.Start();
+	CHECK_EQUAL(0, pacer.GetTimeSinceLastFrame());
+	waiter.Time += 100000;
+	CHECK_EQUAL(100000, pacer.CompleteFrame());
+	//Without an interval, frames are not paced.
+	FramePacer unpaced(&waiter, 0, true);
+	waiter.Time += 5;
+	CHECK_EQUAL(5, unpaced.CompleteFrame());
+}
+
+TEST_CASE(PendingSignalEndsTheWait)
+{
+	FakeFrameWaiter waiter;
+	FramePacer pacer(&waiter, 100000, true);
+	waiter.Signal();
+	int64_t time = waiter.Time;
+	CHECK(pacer.WaitForDeadline() == FrameWaitResult::Signaled);
+	CHECK_EQUAL(time, waiter.Time);
+	CHECK(pacer.WaitForDeadline() == FrameWaitResult::Deadline);
+	CHECK_EQUAL(1, pacer.GetStats().SignaledWaitCount);
+}
+
+TEST_CASE(SteadyWaiterWaitsAndIsSignaled)
+{
+	SteadyFrameWaiter waiter;
+	int64_t start = waiter.Now();
+	CHECK(waiter.WaitUntil(start + 20000) == FrameWaitResult::Deadline);
+	CHECK(waiter.Now() >= start + 20000);
+	//A signal sent before the wait is not lost.
+	waiter.Signal();
+	CHECK(waiter.WaitUntil(waiter.Now() + 100000000) == FrameWaitResult::Signaled);
+	std::thread signaler([&]() {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		waiter.Signal();
+	});
+	CHECK(waiter.WaitUntil(waiter.Now() + 100000000) == FrameWaitResult::Signaled);
+	signaler.join();
+}
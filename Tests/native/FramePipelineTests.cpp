@@ -0,0 +1,166 @@
+#include "TestHarness.h"
+#include "FramePipeline.h"
+#include <atomic>
+
+namespace {
+	struct FRAME
+	{
+		int Id = -1;
+		//The stages the frame passed through.
+		std::vector<int> Trace;
+		//Stands in for a texture the frame holds, to check when frames are released.
+		std::shared_ptr<int> Resource;
+	};
+
+	//Sleeps stand in for work, so stages overlap even on a single core.
+	void Work(int micros)
+	{
+		std::this_thread::sleep_for(std::chrono::microseconds(micros));
+	}
+}
+
+TEST_CASE(ItemsPassThroughEveryStageInOrder)
+{
+	std::vector<int> written;
+	bool isTraceCorrect = true;
+	FramePipeline<FRAME> pipeline(2);
+	CHECK_EQUAL(2, pipeline.GetDepth());
+	pipeline.AddStage("Compose", [](FRAME &frame) { frame.Trace.push_back(1); return true; });
+	pipeline.AddStage("Transform", [](FRAME &frame) { frame.Trace.push_back(2); return true; });
+	pipeline.AddStage("Encode", [&](FRAME &frame) {
+		frame.Trace.push_back(3);
+		isTraceCorrect &= frame.Trace == std::vector<int>{ 1, 2, 3 };
+		written.push_back(frame.Id);
+		return true;
+	});
+	pipeline.Start();
+	for (int i = 0; i < 500; i++) {
+		FRAME frame;
+		frame.Id = i;
+		CHECK(pipeline.Push(std::move(frame)));
+	}
+	CHECK(pipeline.Close());
+	CHECK(isTraceCorrect);
+	CHECK_EQUAL(500, written.size());
+	for (int i = 0; i < 500; i++) {
+		CHECK_EQUAL(i, written[i]);
+	}
+	std::vector<FRAME_PIPELINE_STAGE_STATS> stats = pipeline.GetStats();
+	CHECK_EQUAL(3, stats.size());
+	CHECK(stats[1].Name == "Transform");
+	for (const FRAME_PIPELINE_STAGE_STATS &stageStats : stats) {
+		CHECK_EQUAL(500, stageStats.ProcessedCount);
+		CHECK(stageStats.MaxDepth <= 2);
+	}
+}
+
+TEST_CASE(StagesOverlap)
+{
+	FramePipeline<FRAME> pipeline(2);
+	for (const char *name : { "Compose", "Transform", "Encode" }) {
+		pipeline.AddStage(name, [](FRAME &) { Work(5000); return true; });
+	}
+	pipeline.Start();
+	auto start = std::chrono::steady_clock::now();
+	for (int i = 0; i < 60; i++) {
+		pipeline.Push(FRAME());
+	}
+	CHECK(pipeline.Drain());
+	//Three stages of 5 ms take about 5 ms per frame, not 15.
+	double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	CHECK(millis < 60 * 15 * 0.7);
+}
+
+TEST_CASE(SlowStageHoldsBackTheStagesBeforeIt)
+{
+	std::atomic<int> inFlight(0);
+	int maxInFlight = 0;
+	FramePipeline<FRAME> pipeline(1);
+	pipeline.AddStage("Fast", [&](FRAME &) {
+		maxInFlight = (std::max)(maxInFlight, ++inFlight);
+		return true;
+	});
+	pipeline.AddStage("Slow", [&](FRAME &) {
+		Work(2000);
+		inFlight--;
+		return true;
+	});
+	pipeline.Start();
+	for (int i = 0; i < 30; i++) {
+		pipeline.Push(FRAME());
+	}
+	CHECK(pipeline.Close());
+	std::vector<FRAME_PIPELINE_STAGE_STATS> stats = pipeline.GetStats();
+	//One frame in the slow stage, one queued for it, one held by the fast stage waiting for room, and the one the fast stage counts.
+	CHECK(maxInFlight <= 4);
+	CHECK(stats[0].BlockedCount > 0);
+	CHECK(stats[1].BlockedCount > 0);
+}
+
+TEST_CASE(FailedStageStopsThePipelineAndReleasesItems)
+{
+	auto resource = std::make_shared<int>(0);
+	std::atomic<int> encodedCount(0);
+	FramePipeline<FRAME> pipeline(4);
+	pipeline.AddStage("Transform", [](FRAME &frame) { return frame.Id != 10; });
+	pipeline.AddStage("Encode", [&](FRAME &) {
+		Work(1000);
+		encodedCount++;
+		return true;
+	});
+	pipeline.Start();
+	bool isPushFailed = false;
+	for (int i = 0; i < 100 && !isPushFailed; i++) {
+		FRAME frame;
+		frame.Id = i;
+		frame.Resource = resource;
+		isPushFailed = !pipeline.Push(std::move(frame));
+		if (!isPushFailed) {
+			Work(200);
+		}
+	}
+	CHECK(!pipeline.Drain());
+	CHECK(pipeline.IsFailed());
+	CHECK(!pipeline.Close());
+	CHECK(encodedCount <= 10);
+	CHECK_EQUAL(1, resource.use_count());
+}
+
+TEST_CASE(DrainLeavesNoItemHeld)
+{
+	auto resource = std::make_shared<int>(0);
+	FramePipeline<FRAME> pipeline(2);
+	pipeline.AddStage("A", [](FRAME &) { Work(300); return true; });
+	pipeline.AddStage("B", [](FRAME &) { Work(300); return true; });
+	pipeline.Start();
+	for (int round = 0; round < 3; round++) {
+		for (int i = 0; i < 10; i++) {
+			FRAME frame;
+			frame.Resource = resource;
+			pipeline.Push(std::move(frame));
+		}
+		CHECK(pipeline.Drain());
+		CHECK_EQUAL(1, resource.use_count());
+	}
+	CHECK(pipeline.Close());
+	CHECK_EQUAL(30, pipeline.GetStats()[1].ProcessedCount);
+	CHECK(!pipeline.Push(FRAME()));
+}
+
+TEST_CASE(PipelineCanBeClosedTwiceOrDestroyedOpen)
+{
+	FramePipeline<FRAME> pipeline(2);
+	pipeline.AddStage("A", [](FRAME &) { return true; });
+	pipeline.Start();
+	{
+		FramePipeline<FRAME> unclosed(2);
+		unclosed.AddStage("A", [](FRAME &) { return true; });
+		unclosed.Start();
+		unclosed.Push(FRAME());
+	}
+	CHECK(pipeline.Close());
+	CHECK(pipeline.Close());
+	//A pipeline without stages takes nothing.
+	FramePipeline<FRAME> empty(2);
+	CHECK(!empty.Push(FRAME()));
+}
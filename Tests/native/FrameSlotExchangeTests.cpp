@@ -0,0 +1,129 @@
+#include "TestHarness.h"
+#include "FrameSlotExchange.h"
+#include <thread>
+#include <vector>
+
+namespace {
+	//A frame filled with its frame number, so a torn or stale read is detected.
+	struct FRAME
+	{
+		std::vector<uint64_t> Pixels = std::vector<uint64_t>(256);
+	};
+
+	//Publishes frames 1 to total on one thread while another takes them, optionally sleeping every few frames on either side.
+	void RunProducerAndConsumer(uint64_t total, int producerSleepEvery, int consumerSleepEvery)
+	{
+		FrameSlotExchange exchange;
+		FRAME frames[FRAME_SLOT_COUNT];
+		std::atomic<bool> isDone(false);
+		std::thread producer([&]() {
+			for (uint64_t number = 1; number <= total; number++) {
+				for (uint64_t &pixel : frames[exchange.GetBackSlot()].Pixels) {
+					pixel = number;
+				}
+				exchange.Publish();
+				if (producerSleepEvery > 0 && number % producerSleepEvery == 0) {
+					std::this_thread::sleep_for(std::chrono::microseconds(50));
+				}
+			}
+			isDone = true;
+		});
+		uint64_t lastNumber = 0;
+		uint64_t takenCount = 0;
+		uint64_t publishedCount = 0;
+		bool isTorn = false;
+		bool isStale = false;
+		bool isCountWrong = false;
+		auto Take([&]() {
+			uint32_t slot;
+			uint64_t count;
+			if (!exchange.AcquireLatest(&slot, &count)) {
+				return;
+			}
+			const FRAME &frame = frames[slot];
+			uint64_t number = frame.Pixels[0];
+			for (uint64_t pixel : frame.Pixels) {
+				isTorn |= pixel != number;
+			}
+			isStale |= number <= lastNumber;
+			isCountWrong |= count != number - lastNumber;
+			publishedCount += count;
+			lastNumber = number;
+			takenCount++;
+			if (consumerSleepEvery > 0 && takenCount % consumerSleepEvery == 0) {
+				std::this_thread::sleep_for(std::chrono::microseconds(50));
+			}
+		});
+		while (!isDone) {
+			Take();
+		}
+		producer.join();
+		Take();
+		CHECK(!isTorn);
+		CHECK(!isStale);
+		CHECK(!isCountWrong);
+		CHECK_EQUAL(total, lastNumber);
+		CHECK_EQUAL(total, publishedCount);
+		FRAME_SLOT_EXCHANGE_STATS stats = exchange.GetStats();
+		CHECK_EQUAL(total, stats.PublishedCount);
+		CHECK_EQUAL(takenCount, stats.ConsumedCount);
+		CHECK_EQUAL(total, stats.ConsumedCount + stats.OverwrittenCount);
+	}
+}
+
+TEST_CASE(ConsumerTakesTheLatestFrame)
+{
+	FrameSlotExchange exchange;
+	uint32_t slot = 99;
+	uint64_t count = 0;
+	CHECK(!exchange.AcquireLatest(&slot, &count));
+	CHECK_EQUAL(99, slot);
+	exchange.Publish();
+	CHECK(exchange.IsFramePublished());
+	CHECK(exchange.AcquireLatest(&slot, &count));
+	CHECK_EQUAL(1, count);
+	CHECK_EQUAL(exchange.GetFrontSlot(), slot);
+	CHECK(!exchange.IsFramePublished());
+	exchange.Publish();
+	exchange.Publish();
+	exchange.Publish();
+	CHECK(exchange.AcquireLatest(&slot, &count));
+	CHECK_EQUAL(3, count);
+	FRAME_SLOT_EXCHANGE_STATS stats = exchange.GetStats();
+	CHECK_EQUAL(4, stats.PublishedCount);
+	CHECK_EQUAL(2, stats.ConsumedCount);
+	CHECK_EQUAL(2, stats.OverwrittenCount);
+	CHECK_EQUAL(1, stats.EmptyAcquireCount);
+	CHECK_NEAR(0.5, stats.GetOverwriteRate(), 1e-9);
+}
+
+TEST_CASE(ProducerAndConsumerNeverShareASlot)
+{
+	FrameSlotExchange exchange;
+	uint32_t slot;
+	for (int i = 0; i < 100; i++) {
+		if (i % 3 != 0) {
+			exchange.Publish();
+		}
+		if (i % 2 != 0) {
+			exchange.AcquireLatest(&slot);
+		}
+		CHECK(exchange.GetBackSlot() != exchange.GetFrontSlot());
+		CHECK(exchange.GetBackSlot() < FRAME_SLOT_COUNT);
+	}
+}
+
+TEST_CASE(ThreadsExchangeFramesWithoutTearing)
+{
+	RunProducerAndConsumer(200000, 0, 0);
+}
+
+TEST_CASE(SlowConsumerSeesOverwrites)
+{
+	RunProducerAndConsumer(200000, 0, 10);
+}
+
+TEST_CASE(SlowProducerIsFollowed)
+{
+	RunProducerAndConsumer(20000, 10, 0);
+}
@@ -0,0 +1,84 @@
+#include "TestHarness.h"
+#include "ImageEncodePool.h"
+#include <atomic>
+#include <memory>
+#include <random>
+
+TEST_CASE(ImagesCompleteInSubmissionOrder)
+{
+	for (int round = 0; round < 10; round++) {
+		std::atomic<int> concurrentCount(0);
+		std::atomic<int> maxConcurrentCount(0);
+		std::vector<uint64_t> order;
+		std::vector<int32_t> statuses;
+		const uint64_t maxInFlightBytes = 10000;
+		ImageEncodePool pool(3, maxInFlightBytes);
+		CHECK_EQUAL(3, pool.GetThreadCount());
+		std::mt19937 random(round);
+		for (int i = 0; i < 200; i++) {
+			//One image is larger than the limit, and is still encoded on its own.
+			size_t bytes = i == 50 ? 50000 : 500 + random() % 4000;
+			auto image = std::make_shared<std::vector<uint8_t>>(bytes);
+			int sleepMicros = random() % 300;
+			pool.Submit(bytes, [image, sleepMicros, i, &concurrentCount, &maxConcurrentCount]() {
+				int count = ++concurrentCount;
+				int maxCount = maxConcurrentCount;
+				while (count > maxCount && !maxConcurrentCount.compare_exchange_weak(maxCount, count)) {
+				}
+				std::this_thread::sleep_for(std::chrono::microseconds(sleepMicros));
+				--concurrentCount;
+				return static_cast<int32_t>(i % 17 == 0 ? -1 : 0);
+			}, [&order, &statuses](const IMAGE_ENCODE_RESULT &result) {
+				order.push_back(result.Sequence);
+				statuses.push_back(result.Status);
+			});
+		}
+		pool.WaitForAll();
+		CHECK_EQUAL(200, order.size());
+		for (size_t i = 0; i < order.size(); i++) {
+			CHECK_EQUAL(i, order[i]);
+			CHECK_EQUAL(i % 17 == 0 ? -1 : 0, statuses[i]);
+		}
+		IMAGE_ENCODE_STATS stats = pool.GetStats();
+		CHECK_EQUAL(200, stats.SubmittedCount);
+		CHECK_EQUAL(200, stats.CompletedCount);
+		CHECK_EQUAL(12, stats.FailedCount);
+		CHECK(stats.MaxInFlightBytes <= 50000);
+		CHECK(maxConcurrentCount <= 3);
+	}
+}
+
+TEST_CASE(SubmitWaitsWhenMemoryIsOverTheLimit)
+{
+	ImageEncodePool pool(4, 1000);
+	for (int i = 0; i < 100; i++) {
+		pool.Submit(300, []() {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			return 0;
+		}, nullptr);
+	}
+	pool.WaitForAll();
+	IMAGE_ENCODE_STATS stats = pool.GetStats();
+	CHECK(stats.MaxInFlightBytes <= 1000);
+	CHECK(stats.StallCount > 0);
+}
+
+TEST_CASE(DestructorEncodesWhatIsLeft)
+{
+	std::atomic<int> startedCount(0);
+	std::atomic<int> stoppedCount(0);
+	std::atomic<int> completedCount(0);
+	uint32_t threadCount;
+	{
+		ImageEncodePool pool(0, 0, [&]() { startedCount++; }, [&]() { stoppedCount++; });
+		threadCount = pool.GetThreadCount();
+		for (int i = 0; i < 50; i++) {
+			pool.Submit(1, []() { return 0; }, [&](const IMAGE_ENCODE_RESULT &) { completedCount++; });
+		}
+	}
+	CHECK_EQUAL(50, completedCount);
+	CHECK_EQUAL(ImageEncodePool::GetAutomaticThreadCount(), threadCount);
+	CHECK(threadCount >= 1 && threadCount <= ImageEncodePool::MAX_AUTOMATIC_THREAD_COUNT);
+	CHECK_EQUAL(static_cast<int>(threadCount), startedCount);
+	CHECK_EQUAL(startedCount, stoppedCount);
+}
@@ -0,0 +1,292 @@
+#include "TestHarness.h"
+#include "LeasePool.h"
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <tuple>
+
+namespace {
+	struct TEXTURE_KEY
+	{
+		int Width;
+		int Height;
+		int Format;
+
+		bool operator<(const TEXTURE_KEY &other) const
+		{
+			return std::tie(Width, Height, Format) < std::tie(other.Width, other.Height, other.Format);
+		}
+	};
+
+	struct MOCK_TEXTURE
+	{
+		TEXTURE_KEY Key;
+		int Id;
+	};
+
+	typedef std::shared_ptr<MOCK_TEXTURE> Texture;
+	typedef LeasePool<TEXTURE_KEY, Texture> TexturePool;
+
+	//Creates textures that count themselves, so the tests can see when the pool destroys them.
+	class MockAllocator
+	{
+	public:
+		Texture Create(const TEXTURE_KEY &key)
+		{
+			if (IsFailing) {
+				return nullptr;
+			}
+			AllocatedCount++;
+			LiveCount++;
+			return Texture(new MOCK_TEXTURE{ key, AllocatedCount }, [this](MOCK_TEXTURE *pTexture) {
+				LiveCount--;
+				delete pTexture;
+			});
+		}
+
+		TexturePool::CreateFunction GetCreateFunction()
+		{
+			return [this](const TEXTURE_KEY &key, Texture *pTexture) {
+				*pTexture = Create(key);
+				return *pTexture != nullptr;
+			};
+		}
+
+		int AllocatedCount = 0;
+		std::atomic<int> LiveCount{ 0 };
+		bool IsFailing = false;
+	};
+
+	bool IsLeased(const Texture &texture)
+	{
+		return texture.use_count() > 1;
+	}
+
+	const TEXTURE_KEY Key4k{ 3840, 2160, 87 };
+	const TEXTURE_KEY Key1080{ 1920, 1080, 87 };
+}
+
+TEST_CASE(SteadyFramesReuseTheirTextures)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased);
+	//Each frame leases two textures, which are released by the end of the frame.
+	for (int frame = 0; frame < 1000; frame++) {
+		Texture copy;
+		Texture canvas;
+		bool isReused;
+		CHECK(pool.Acquire(Key4k, &copy, &isReused));
+		CHECK_EQUAL(frame > 0, isReused);
+		CHECK(pool.Acquire(Key1080, &canvas));
+		CHECK_EQUAL(3840, copy->Key.Width);
+		CHECK_EQUAL(1920, canvas->Key.Width);
+		pool.NextFrame();
+	}
+	pool.NextFrame();
+	LEASE_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(2, stats.AllocationCount);
+	CHECK_EQUAL(1998, stats.ReuseCount);
+	CHECK_EQUAL(2, allocator.LiveCount);
+	CHECK_EQUAL(2, stats.IdleCount);
+	CHECK_EQUAL(0, stats.LeasedCount);
+	CHECK_EQUAL(2, stats.MaxLeasedCount);
+}
+
+TEST_CASE(HeldLeasesAreNotReused)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased);
+	//Frames held across frames, e.g. by an encode queue of three.
+	std::vector<Texture> queue;
+	for (int frame = 0; frame < 100; frame++) {
+		Texture texture;
+		pool.Acquire(Key4k, &texture);
+		for (const Texture &queued : queue) {
+			CHECK(queued.get() != texture.get());
+		}
+		queue.push_back(texture);
+		if (queue.size() > 3) {
+			queue.erase(queue.begin());
+		}
+		pool.NextFrame();
+	}
+	LEASE_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(4, stats.AllocationCount);
+	CHECK_EQUAL(3, stats.LeasedCount);
+}
+
+TEST_CASE(LeastRecentlyUsedAreTrimmed)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased, 2, 0, 0);
+	{
+		std::vector<Texture> held;
+		for (int i = 0; i < 5; i++) {
+			Texture texture;
+			pool.Acquire(TEXTURE_KEY{ i + 1, 1, 1 }, &texture);
+			held.push_back(texture);
+		}
+	}
+	pool.NextFrame();
+	LEASE_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(2, stats.IdleCount);
+	CHECK_EQUAL(3, stats.TrimmedCount);
+	CHECK_EQUAL(2, allocator.LiveCount);
+	Texture texture;
+	bool isReused;
+	pool.Acquire(TEXTURE_KEY{ 5, 1, 1 }, &texture, &isReused);
+	CHECK(isReused);
+	pool.Acquire(TEXTURE_KEY{ 4, 1, 1 }, &texture, &isReused);
+	CHECK(isReused);
+	pool.Acquire(TEXTURE_KEY{ 1, 1, 1 }, &texture, &isReused);
+	CHECK(!isReused);
+}
+
+TEST_CASE(UnusedTexturesExpire)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased, 8, 10, 0);
+	{
+		Texture texture;
+		pool.Acquire(Key4k, &texture);
+	}
+	//The output size changed, so the 4K texture is no longer leased.
+	for (int frame = 0; frame < 10; frame++) {
+		Texture texture;
+		pool.Acquire(Key1080, &texture);
+		pool.NextFrame();
+	}
+	CHECK_EQUAL(2, allocator.LiveCount);
+	pool.NextFrame();
+	LEASE_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(1, allocator.LiveCount);
+	CHECK_EQUAL(1, stats.TrimmedCount);
+	CHECK_EQUAL(1, stats.IdleCount);
+}
+
+TEST_CASE(OldLeasesAreCountedAsLeaksOnce)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased, 8, 120, 5);
+	Texture leaked;
+	pool.Acquire(Key4k, &leaked);
+	uint64_t leakCount = 0;
+	for (int frame = 0; frame < 20; frame++) {
+		Texture texture;
+		pool.Acquire(Key1080, &texture);
+		leakCount += pool.NextFrame();
+	}
+	CHECK_EQUAL(1, leakCount);
+	CHECK_EQUAL(1, pool.GetStats().LeakCount);
+	//The lease was already counted, so reporting leaks does not count it again.
+	CHECK_EQUAL(0, pool.ReportLeaks());
+}
+
+TEST_CASE(ReportLeaksCountsOnlyLeasesStillHeld)
+{
+	MockAllocator allocator;
+	//Leases are not aged, since holders such as the previous frame keep textures for long on purpose.
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased, 8, 120, 0);
+	Texture previousFrame;
+	pool.Acquire(Key4k, &previousFrame);
+	for (int frame = 0; frame < 1000; frame++) {
+		Texture texture;
+		pool.Acquire(Key1080, &texture);
+		CHECK_EQUAL(0, pool.NextFrame());
+	}
+	//Released before the report, so it is not a leak.
+	previousFrame.reset();
+	Texture leaked;
+	pool.Acquire(Key4k, &leaked);
+	Texture released;
+	pool.Acquire(Key1080, &released);
+	released.reset();
+	CHECK_EQUAL(1, pool.ReportLeaks());
+	CHECK_EQUAL(0, pool.ReportLeaks());
+	LEASE_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(1, stats.LeakCount);
+	CHECK_EQUAL(1, stats.LeasedCount);
+}
+
+TEST_CASE(CreateCanBeGivenPerAcquire)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased);
+	//The create function of the call reports its own error, and is used instead of the one of the pool.
+	int error = 0;
+	Texture texture;
+	CHECK(!pool.Acquire(Key4k, &texture, nullptr, [&error](const TEXTURE_KEY &, Texture *) {
+		error = -1;
+		return false;
+	}));
+	CHECK_EQUAL(-1, error);
+	CHECK(!texture);
+	CHECK_EQUAL(0, allocator.AllocatedCount);
+	CHECK_EQUAL(1, pool.GetStats().AllocationFailedCount);
+	int createCount = 0;
+	CHECK(pool.Acquire(Key4k, &texture, nullptr, [&](const TEXTURE_KEY &key, Texture *pTexture) {
+		createCount++;
+		*pTexture = allocator.Create(key);
+		return true;
+	}));
+	CHECK_EQUAL(1, createCount);
+	texture.reset();
+	//A free texture is reused without calling create.
+	bool isReused;
+	CHECK(pool.Acquire(Key4k, &texture, &isReused, [&](const TEXTURE_KEY &, Texture *) {
+		createCount++;
+		return false;
+	}));
+	CHECK(isReused);
+	CHECK_EQUAL(1, createCount);
+}
+
+TEST_CASE(ClearForgetsLeasesWithoutDestroyingThem)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased);
+	allocator.IsFailing = true;
+	Texture texture;
+	CHECK(!pool.Acquire(Key4k, &texture));
+	CHECK(!texture);
+	allocator.IsFailing = false;
+	CHECK(pool.Acquire(Key4k, &texture));
+	Texture idle;
+	pool.Acquire(Key1080, &idle);
+	idle.reset();
+	pool.NextFrame();
+	pool.Clear();
+	CHECK_EQUAL(1, allocator.LiveCount);
+	CHECK(texture);
+	texture.reset();
+	CHECK_EQUAL(0, allocator.LiveCount);
+	LEASE_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(1, stats.AllocationFailedCount);
+	CHECK_EQUAL(0, stats.LeasedCount);
+	CHECK_EQUAL(0, stats.IdleCount);
+}
+
+TEST_CASE(LeasesCanBeReleasedOnOtherThreads)
+{
+	MockAllocator allocator;
+	TexturePool pool(allocator.GetCreateFunction(), IsLeased);
+	std::vector<std::thread> threads;
+	for (int frame = 0; frame < 200; frame++) {
+		Texture texture;
+		pool.Acquire(Key4k, &texture);
+		threads.emplace_back([texture]() mutable { texture.reset(); });
+		if (threads.size() > 4) {
+			threads.front().join();
+			threads.erase(threads.begin());
+		}
+		pool.NextFrame();
+	}
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+	pool.NextFrame();
+	LEASE_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(200, stats.AllocationCount + stats.ReuseCount);
+	CHECK_EQUAL(0, stats.LeasedCount);
+	CHECK(stats.IdleCount <= TexturePool::DEFAULT_MAX_IDLE_COUNT);
+}
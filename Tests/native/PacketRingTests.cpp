@@ -0,0 +1,145 @@
+#include "TestHarness.h"
+#include "PacketRing.h"
+#include <memory>
+#include <thread>
+
+namespace {
+	typedef PacketRing<std::shared_ptr<std::vector<uint8_t>>> Ring;
+
+	const int64_t FrameDuration = 333333;
+	const int64_t AudioDuration = 100000;
+
+	Ring::PACKET VideoPacket(int64_t frame, int keyframeInterval, size_t size = 1000)
+	{
+		Ring::PACKET packet;
+		packet.StreamIndex = 0;
+		packet.StartPos = frame * FrameDuration;
+		packet.Duration = FrameDuration;
+		packet.IsKeyframe = frame % keyframeInterval == 0;
+		packet.Size = size;
+		packet.Payload = std::make_shared<std::vector<uint8_t>>(1, static_cast<uint8_t>(frame));
+		return packet;
+	}
+
+	Ring::PACKET AudioPacket(int64_t index)
+	{
+		Ring::PACKET packet;
+		packet.StreamIndex = 1;
+		packet.StartPos = index * AudioDuration;
+		packet.Duration = AudioDuration;
+		packet.Size = 100;
+		return packet;
+	}
+}
+
+TEST_CASE(RingStartsAtAKeyframe)
+{
+	Ring ring(10 * FrameDuration, 0);
+	//Joining a stream halfway, the packets before the first keyframe are dropped.
+	for (int64_t frame = 5; frame < 10; frame++) {
+		CHECK(!ring.Push(VideoPacket(frame, 30)));
+	}
+	CHECK(!ring.Push(AudioPacket(0)));
+	CHECK_EQUAL(0, ring.GetPacketCount());
+	CHECK(ring.Push(VideoPacket(30, 30)));
+	CHECK(ring.Push(AudioPacket(1)));
+	CHECK(ring.Push(VideoPacket(31, 30)));
+	PACKET_RING_STATS stats = ring.GetStats();
+	CHECK_EQUAL(9, stats.PushedCount);
+	CHECK_EQUAL(6, stats.DroppedCount);
+	std::vector<Ring::PACKET> packets = ring.Snapshot();
+	CHECK_EQUAL(3, packets.size());
+	CHECK(packets[0].IsKeyframe);
+	CHECK_EQUAL(1, packets[1].StreamIndex);
+	CHECK_EQUAL(2 * FrameDuration, ring.GetDuration());
+}
+
+TEST_CASE(WholeGroupsAreEvictedOnceTheRestCoversTheDuration)
+{
+	const int keyframeInterval = 30;
+	const int64_t maxDuration = 120 * FrameDuration;
+	Ring ring(maxDuration, 0);
+	for (int64_t frame = 0; frame < 1000; frame++) {
+		ring.Push(VideoPacket(frame, keyframeInterval));
+		//Three audio packets for each frame, kept with the group they were pushed in.
+		for (int64_t i = 0; i < 3; i++) {
+			ring.Push(AudioPacket(frame * 3 + i));
+		}
+		if (frame >= 120) {
+			CHECK(ring.GetDuration() >= maxDuration);
+			CHECK(ring.GetDuration() < maxDuration + keyframeInterval * FrameDuration);
+		}
+	}
+	std::vector<Ring::PACKET> packets = ring.Snapshot();
+	CHECK(packets.front().IsKeyframe);
+	CHECK_EQUAL(0, packets.front().StreamIndex);
+	CHECK_EQUAL(0, packets.front().StartPos / FrameDuration % keyframeInterval);
+	CHECK_EQUAL(999 * FrameDuration, packets[packets.size() - 4].StartPos);
+	PACKET_RING_STATS stats = ring.GetStats();
+	CHECK_EQUAL(4000, stats.PushedCount);
+	CHECK_EQUAL(0, stats.DroppedCount);
+	CHECK_EQUAL(4000, stats.EvictedCount + packets.size());
+	CHECK_EQUAL(ring.GetBytes(), packets.size() / 4 * 1300);
+}
+
+TEST_CASE(MemoryLimitEvictsGroupsEarly)
+{
+	//Room for two and a half groups of 30 frames of 1000 bytes.
+	Ring ring(1000 * FrameDuration, 75000);
+	for (int64_t frame = 0; frame < 300; frame++) {
+		CHECK(ring.Push(VideoPacket(frame, 30)));
+		CHECK(ring.GetBytes() <= 75000);
+	}
+	CHECK(ring.Snapshot().front().IsKeyframe);
+	CHECK_EQUAL(60, ring.GetPacketCount());
+	PACKET_RING_STATS stats = ring.GetStats();
+	//The packet that went over the limit was held until the group before it was evicted.
+	CHECK_EQUAL(76000, stats.MaxBytes);
+	CHECK_EQUAL(0, stats.OverflowCount);
+}
+
+TEST_CASE(GroupLargerThanTheLimitEmptiesTheRing)
+{
+	Ring ring(1000 * FrameDuration, 10000);
+	bool isKept = true;
+	for (int64_t frame = 0; frame < 30; frame++) {
+		isKept &= ring.Push(VideoPacket(frame, 30));
+	}
+	//The eleventh frame overflowed the single group, and the rest of the group was dropped waiting for a keyframe.
+	CHECK(!isKept);
+	CHECK_EQUAL(0, ring.GetPacketCount());
+	CHECK_EQUAL(0, ring.GetDuration());
+	PACKET_RING_STATS stats = ring.GetStats();
+	CHECK_EQUAL(1, stats.OverflowCount);
+	CHECK_EQUAL(11, stats.EvictedCount);
+	CHECK_EQUAL(19, stats.DroppedCount);
+	CHECK(ring.Push(VideoPacket(30, 30)));
+	ring.Clear();
+	CHECK_EQUAL(0, ring.GetBytes());
+	CHECK(!ring.Push(VideoPacket(31, 30)));
+	CHECK(ring.Push(VideoPacket(60, 30)));
+}
+
+TEST_CASE(SnapshotsCanBeTakenWhilePushing)
+{
+	Ring ring(60 * FrameDuration, 0);
+	std::thread pusher([&ring]() {
+		for (int64_t frame = 0; frame < 20000; frame++) {
+			ring.Push(VideoPacket(frame, 15));
+		}
+	});
+	bool isValid = true;
+	for (int i = 0; i < 200; i++) {
+		std::vector<Ring::PACKET> packets = ring.Snapshot();
+		if (packets.empty()) {
+			continue;
+		}
+		isValid &= packets.front().IsKeyframe;
+		for (size_t j = 1; j < packets.size(); j++) {
+			isValid &= packets[j].StartPos == packets[j - 1].StartPos + FrameDuration;
+		}
+	}
+	pusher.join();
+	CHECK(isValid);
+	CHECK(ring.GetDuration() >= 60 * FrameDuration);
+}
@@ -0,0 +1,88 @@
+#include "TestHarness.h"
+#include "QoiEncoder.h"
+#include <random>
+
+namespace {
+	//Encodes and decodes the image, and checks that the pixels survived.
+	void CheckRoundTrip(const std::vector<uint8_t> &image, uint32_t width, uint32_t height, size_t rowPitch, bool hasAlpha, uint32_t threadCount)
+	{
+		std::vector<uint8_t> encoded;
+		CHECK(QoiEncoder::Encode(image.data(), width, height, rowPitch, hasAlpha, threadCount, &encoded));
+		std::vector<uint8_t> decoded;
+		QOI_IMAGE_INFO info;
+		CHECK(QoiEncoder::Decode(encoded.data(), encoded.size(), &decoded, &info));
+		CHECK_EQUAL(width, info.Width);
+		CHECK_EQUAL(height, info.Height);
+		CHECK_EQUAL(hasAlpha ? 4 : 3, info.Channels);
+		CHECK_EQUAL(static_cast<size_t>(width) * height * 4, decoded.size());
+		bool isEqual = true;
+		for (uint32_t y = 0; y < height; y++) {
+			for (uint32_t x = 0; x < width; x++) {
+				const uint8_t *pSource = &image[y * rowPitch + x * 4];
+				const uint8_t *pDecoded = &decoded[(static_cast<size_t>(y) * width + x) * 4];
+				isEqual &= pSource[0] == pDecoded[0] && pSource[1] == pDecoded[1] && pSource[2] == pDecoded[2];
+				isEqual &= pDecoded[3] == (hasAlpha ? pSource[3] : 255);
+			}
+		}
+		CHECK(isEqual);
+	}
+}
+
+TEST_CASE(ImagesRoundTripAtEverySizeAndThreadCount)
+{
+	std::mt19937 random(1);
+	for (uint32_t width : { 1u, 2u, 7u, 64u, 333u }) {
+		for (uint32_t height : { 1u, 63u, 64u, 65u, 129u, 300u }) {
+			//Noise for the full color ops, small steps and runs for the difference ops, and sparse transparent pixels for alpha. The second kind has padding at the end of each row.
+			for (int kind = 0; kind < 3; kind++) {
+				size_t rowPitch = static_cast<size_t>(width) * 4 + (kind == 1 ? 12 : 0);
+				std::vector<uint8_t> image(rowPitch * height);
+				for (size_t i = 0; i < image.size(); i++) {
+					if (kind == 0) {
+						image[i] = static_cast<uint8_t>(random());
+					}
+					else if (kind == 1) {
+						image[i] = static_cast<uint8_t>((i / 37) % 5 * 3);
+					}
+					else {
+						image[i] = static_cast<uint8_t>(random() % 8 == 0 ? random() % 4 : 0);
+					}
+				}
+				for (bool hasAlpha : { false, true }) {
+					for (uint32_t threadCount : { 1u, 2u, 3u, 8u }) {
+						CheckRoundTrip(image, width, height, rowPitch, hasAlpha, threadCount);
+					}
+				}
+			}
+		}
+	}
+}
+
+TEST_CASE(FlatImageIsMostlyRuns)
+{
+	const uint32_t width = 1920;
+	const uint32_t height = 1080;
+	std::vector<uint8_t> image(static_cast<size_t>(width) * height * 4, 200);
+	std::vector<uint8_t> encoded;
+	CHECK(QoiEncoder::Encode(image.data(), width, height, width * 4, false, 4, &encoded));
+	//A run covers at most 62 pixels in one byte.
+	CHECK(encoded.size() < static_cast<size_t>(width) * height / 62 + 4 * 64 + QoiEncoder::HEADER_SIZE + QoiEncoder::END_MARKER_SIZE);
+	CheckRoundTrip(image, width, height, width * 4, false, 4);
+}
+
+TEST_CASE(InvalidImagesAreRejected)
+{
+	std::vector<uint8_t> encoded;
+	uint8_t pixel[4] = { 1, 2, 3, 4 };
+	CHECK(!QoiEncoder::Encode(nullptr, 1, 1, 4, false, 1, &encoded));
+	CHECK(!QoiEncoder::Encode(pixel, 0, 1, 4, false, 1, &encoded));
+	CHECK(!QoiEncoder::Encode(pixel, 2, 1, 4, false, 1, &encoded));
+	CHECK(QoiEncoder::Encode(pixel, 1, 1, 4, true, 1, &encoded));
+	CHECK_EQUAL('q', encoded[0]);
+	//Every truncated file is rejected.
+	std::vector<uint8_t> decoded;
+	QOI_IMAGE_INFO info;
+	for (size_t size = 0; size < encoded.size(); size++) {
+		CHECK(!QoiEncoder::Decode(encoded.data(), size, &decoded, &info));
+	}
+}
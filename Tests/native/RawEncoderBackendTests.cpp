@@ -0,0 +1,152 @@
+#include "TestHarness.h"
+#include "RawEncoderBackend.h"
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace {
+	const int64_t FrameDuration = 333333;
+	const uint32_t Width = 64;
+	const uint32_t Height = 48;
+
+	std::vector<uint8_t> ReadFile(const std::filesystem::path &path)
+	{
+		std::ifstream file(path, std::ios::binary);
+		return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	}
+
+	uint32_t GetUInt32(const uint8_t *pData)
+	{
+		return pData[0] | pData[1] << 8 | pData[2] << 16 | static_cast<uint32_t>(pData[3]) << 24;
+	}
+
+	//A test output in the temporary directory, deleted when the test ends.
+	class TempOutput
+	{
+	public:
+		TempOutput(const char *name) :
+			VideoPath(std::filesystem::temp_directory_path() / name)
+		{
+		}
+
+		~TempOutput()
+		{
+			std::error_code error;
+			std::filesystem::remove(VideoPath, error);
+			std::filesystem::remove(std::filesystem::path(VideoPath).replace_extension(".wav"), error);
+		}
+
+		const std::filesystem::path VideoPath;
+	};
+
+	ENCODER_BACKEND_CONFIG GetConfig(bool isAudioEnabled)
+	{
+		ENCODER_BACKEND_CONFIG config;
+		config.Width = Width;
+		config.Height = Height;
+		config.FrameRate = 30;
+		config.IsAudioEnabled = isAudioEnabled;
+		return config;
+	}
+}
+
+TEST_CASE(FramesArePlacedOnTheFrameGrid)
+{
+	TempOutput output("RawEncoderBackendTests_Grid.y4m");
+	std::vector<uint8_t> white(Width * Height * 4, 255);
+	{
+		RawEncoderBackend backend(output.VideoPath);
+		CHECK(backend.Configure(GetConfig(false)));
+		CHECK(!backend.Configure(GetConfig(false)));
+		ENCODER_VIDEO_FRAME frame;
+		frame.Data = white.data();
+		frame.Stride = Width * 4;
+		frame.Duration = FrameDuration;
+		CHECK(backend.EncodeVideo(frame));
+		//One slot is skipped, and filled with the previous frame.
+		frame.StartPos = 2 * FrameDuration;
+		CHECK(backend.EncodeVideo(frame));
+		//A frame within a slot that was already written is dropped.
+		frame.StartPos = 2 * FrameDuration + 100000;
+		CHECK(backend.EncodeVideo(frame));
+		//A long frame takes every slot it covers.
+		frame.StartPos = 3 * FrameDuration;
+		frame.Duration = 3 * FrameDuration;
+		CHECK(backend.EncodeVideo(frame));
+		CHECK(backend.Finalize());
+		CHECK(!backend.EncodeVideo(frame));
+		RAW_ENCODER_STATS stats = backend.GetStats();
+		CHECK_EQUAL(4, stats.EncodedFrameCount);
+		CHECK_EQUAL(6, stats.WrittenFrameCount);
+		CHECK_EQUAL(3, stats.RepeatedFrameCount);
+		CHECK_EQUAL(1, stats.DroppedFrameCount);
+		CHECK_EQUAL(std::filesystem::file_size(output.VideoPath), backend.GetOutputSize());
+	}
+	std::vector<uint8_t> video = ReadFile(output.VideoPath);
+	std::string header = "YUV4MPEG2 W64 H48 F30:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n";
+	const size_t frameBytes = 6 + Width * Height * 3 / 2;
+	CHECK_EQUAL(header.size() + 6 * frameBytes, video.size());
+	CHECK(memcmp(video.data(), header.data(), header.size()) == 0);
+	const uint8_t *pFrame = video.data() + header.size();
+	CHECK(memcmp(pFrame, "FRAME\n", 6) == 0);
+	//White in limited range.
+	CHECK_EQUAL(235, pFrame[6]);
+	CHECK_EQUAL(128, pFrame[6 + Width * Height]);
+}
+
+TEST_CASE(AudioIsPaddedAndTrimmedToTheTimestamps)
+{
+	TempOutput output("RawEncoderBackendTests_Audio.y4m");
+	auto pool = AudioBufferPool::Create();
+	//10 ms of 48 kHz 16-bit stereo.
+	const size_t blockBytes = 480 * 4;
+	const int64_t blockDuration = 100000;
+	{
+		RawEncoderBackend backend(output.VideoPath);
+		CHECK(backend.Configure(GetConfig(true)));
+		AudioBufferRef audio = pool->Acquire(blockBytes);
+		memset(audio->GetData(), 1, blockBytes);
+		CHECK(backend.EncodeAudio(0, blockDuration, audio));
+		//10 ms late, so 10 ms of silence is inserted.
+		CHECK(backend.EncodeAudio(2 * blockDuration, blockDuration, audio));
+		//5 ms of overlap with the audio already written is skipped.
+		CHECK(backend.EncodeAudio(25 * blockDuration / 10, blockDuration, audio));
+		//Silent buffers are written as zeros, and a start within the tolerance is not corrected.
+		CHECK(backend.EncodeAudio(35 * blockDuration / 10 + 5000, blockDuration, pool->AcquireSilence(blockBytes)));
+		CHECK(backend.Finalize());
+		RAW_ENCODER_STATS stats = backend.GetStats();
+		CHECK_EQUAL(blockBytes / 2, stats.TrimmedAudioBytes);
+		CHECK_EQUAL(blockBytes, stats.PaddedAudioBytes);
+		CHECK_EQUAL(blockBytes * 9 / 2, stats.AudioBytes);
+		CHECK_EQUAL(std::filesystem::file_size(output.VideoPath) + std::filesystem::file_size(backend.GetAudioPath()), backend.GetOutputSize());
+	}
+	std::vector<uint8_t> wav = ReadFile(std::filesystem::path(output.VideoPath).replace_extension(".wav"));
+	CHECK_EQUAL(44 + blockBytes * 9 / 2, wav.size());
+	CHECK(memcmp(wav.data(), "RIFF", 4) == 0);
+	CHECK_EQUAL(wav.size() - 8, GetUInt32(wav.data() + 4));
+	CHECK(memcmp(wav.data() + 8, "WAVEfmt ", 8) == 0);
+	CHECK_EQUAL(48000, GetUInt32(wav.data() + 24));
+	CHECK_EQUAL(blockBytes * 9 / 2, GetUInt32(wav.data() + 40));
+	const uint8_t *pData = wav.data() + 44;
+	CHECK_EQUAL(1, pData[0]);
+	CHECK_EQUAL(0, pData[blockBytes]);
+	CHECK_EQUAL(1, pData[2 * blockBytes]);
+	CHECK_EQUAL(1, pData[blockBytes * 7 / 2 - 1]);
+	CHECK_EQUAL(0, pData[blockBytes * 7 / 2]);
+}
+
+TEST_CASE(InvalidConfigurationsAreRejected)
+{
+	TempOutput output("RawEncoderBackendTests_Invalid.y4m");
+	RawEncoderBackend backend(output.VideoPath);
+	ENCODER_BACKEND_CONFIG config = GetConfig(true);
+	config.Width = 63;
+	CHECK(!backend.Configure(config));
+	config = GetConfig(true);
+	config.AudioBitsPerSample = 12;
+	CHECK(!backend.Configure(config));
+	ENCODER_VIDEO_FRAME frame;
+	CHECK(!backend.EncodeVideo(frame));
+	CHECK(!backend.Finalize());
+	CHECK(!std::filesystem::exists(output.VideoPath));
+}
@@ -0,0 +1,69 @@
+#include "TestHarness.h"
+#include "RecyclingPool.h"
+#include <memory>
+#include <thread>
+
+TEST_CASE(RecycledObjectsAreHitsForTheirKey)
+{
+	RecyclingPool<int, std::vector<uint8_t>> pool;
+	std::vector<uint8_t> buffer;
+	CHECK(!pool.TryAcquire(1024, buffer));
+	buffer.resize(1024, 7);
+	const uint8_t *pData = buffer.data();
+	CHECK(pool.Recycle(1024, std::move(buffer)));
+	std::vector<uint8_t> other;
+	CHECK(!pool.TryAcquire(2048, other));
+	CHECK(pool.TryAcquire(1024, other));
+	CHECK(other.data() == pData);
+	CHECK_EQUAL(7, other[1023]);
+	RECYCLING_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(1, stats.HitCount);
+	CHECK_EQUAL(2, stats.MissCount);
+	CHECK_EQUAL(1, stats.RecycledCount);
+	CHECK_EQUAL(0, stats.IdleCount);
+	CHECK_NEAR(1.0 / 3, stats.GetHitRate(), 1e-9);
+}
+
+TEST_CASE(ObjectsBeyondTheLimitAreDiscarded)
+{
+	auto object = std::make_shared<int>(0);
+	RecyclingPool<int, std::shared_ptr<int>> pool(2);
+	CHECK(pool.Recycle(1, object));
+	CHECK(pool.Recycle(1, object));
+	CHECK(!pool.Recycle(1, object));
+	CHECK(pool.Recycle(2, object));
+	//The discarded object was destroyed, and the kept ones are held by the pool.
+	CHECK_EQUAL(4, object.use_count());
+	RECYCLING_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(3, stats.RecycledCount);
+	CHECK_EQUAL(1, stats.DiscardedCount);
+	CHECK_EQUAL(3, stats.IdleCount);
+	pool.Clear();
+	CHECK_EQUAL(1, object.use_count());
+	CHECK_EQUAL(0, pool.GetStats().IdleCount);
+}
+
+TEST_CASE(ObjectsCanBeReturnedOnAnotherThread)
+{
+	RecyclingPool<int, std::unique_ptr<int>> pool(4);
+	std::thread recycler([&pool]() {
+		for (int i = 0; i < 10000; i++) {
+			pool.Recycle(i % 2, std::make_unique<int>(i));
+		}
+	});
+	uint64_t hitCount = 0;
+	for (int i = 0; i < 10000; i++) {
+		std::unique_ptr<int> object;
+		if (pool.TryAcquire(i % 2, object)) {
+			CHECK_EQUAL(i % 2, *object % 2);
+			hitCount++;
+		}
+	}
+	recycler.join();
+	RECYCLING_POOL_STATS stats = pool.GetStats();
+	CHECK_EQUAL(hitCount, stats.HitCount);
+	CHECK_EQUAL(10000, stats.HitCount + stats.MissCount);
+	CHECK_EQUAL(10000, stats.RecycledCount + stats.DiscardedCount);
+	CHECK_EQUAL(stats.RecycledCount - stats.HitCount, stats.IdleCount);
+	CHECK(stats.IdleCount <= 8);
+}
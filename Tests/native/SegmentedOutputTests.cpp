@@ -0,0 +1,179 @@
+#include "TestHarness.h"
+#include "SegmentedOutput.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+namespace {
+	const int64_t FrameDuration = 333333;
+	const int64_t Second = 10000000;
+
+	//Stands in for an output file, and records the frames written to it.
+	struct SEGMENT
+	{
+		uint32_t Index = 0;
+		std::vector<int64_t> Frames;
+		//Set when the segment is finalized, to check that every segment is finalized once.
+		std::shared_ptr<std::atomic<int>> FinalizedCount;
+	};
+
+	class SegmentRecorder
+	{
+	public:
+		std::vector<SEGMENT> Finalized;
+		std::mutex Mutex;
+		uint32_t FailOpenIndex = UINT32_MAX;
+		uint32_t FailFinalizeIndex = UINT32_MAX;
+		int FinalizeMillis = 0;
+
+		SegmentedOutput<SEGMENT>::OpenFunction GetOpenFunction()
+		{
+			return [this](uint32_t index, SEGMENT &segment) {
+				if (index == FailOpenIndex) {
+					FailOpenIndex = UINT32_MAX;
+					return false;
+				}
+				segment.Index = index;
+				segment.FinalizedCount = std::make_shared<std::atomic<int>>(0);
+				return true;
+			};
+		}
+
+		SegmentedOutput<SEGMENT>::FinalizeFunction GetFinalizeFunction()
+		{
+			return [this](SEGMENT &segment) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(FinalizeMillis));
+				(*segment.FinalizedCount)++;
+				std::lock_guard<std::mutex> lock(Mutex);
+				Finalized.push_back(segment);
+				return segment.Index != FailFinalizeIndex;
+			};
+		}
+
+		SEGMENT First()
+		{
+			SEGMENT segment;
+			segment.FinalizedCount = std::make_shared<std::atomic<int>>(0);
+			return segment;
+		}
+	};
+
+	//Writes frames at 30 fps, and returns the number of rotations.
+	int WriteFrames(SegmentedOutput<SEGMENT> &output, int64_t firstFrame, int64_t frameCount, uint64_t frameBytes = 0)
+	{
+		int rotationCount = 0;
+		for (int64_t frame = firstFrame; frame < firstFrame + frameCount; frame++) {
+			int64_t pos = frame * FrameDuration;
+			if (output.Advance(pos)) {
+				rotationCount++;
+			}
+			SEGMENT &segment = output.GetCurrent();
+			segment.Frames.push_back(frame);
+			output.SetCurrentSize(segment.Frames.size() * frameBytes);
+		}
+		return rotationCount;
+	}
+}
+
+TEST_CASE(SegmentsCoverTheTimelineWithoutGaps)
+{
+	SegmentRecorder recorder;
+	SEGMENT_POLICY policy;
+	policy.MaxDuration = 10 * Second;
+	SegmentedOutput<SEGMENT> output(policy, recorder.GetOpenFunction(), recorder.GetFinalizeFunction());
+	CHECK(output.Start(0, recorder.First()));
+	CHECK(!output.Start(0, recorder.First()));
+	CHECK_EQUAL(5, WriteFrames(output, 0, 30 * 60));
+	CHECK(output.Close());
+	CHECK(!output.IsOpen());
+	CHECK_EQUAL(6, recorder.Finalized.size());
+	std::sort(recorder.Finalized.begin(), recorder.Finalized.end(), [](const SEGMENT &a, const SEGMENT &b) { return a.Index < b.Index; });
+	int64_t nextFrame = 0;
+	for (const SEGMENT &segment : recorder.Finalized) {
+		CHECK_EQUAL(nextFrame, segment.Frames.front());
+		//Frames are a little shorter than 1/30 s, so 10 seconds take 301 frames.
+		CHECK_EQUAL(segment.Index * 301, segment.Frames.front());
+		CHECK_EQUAL(1, *segment.FinalizedCount);
+		nextFrame = segment.Frames.back() + 1;
+	}
+	CHECK_EQUAL(30 * 60, nextFrame);
+	SEGMENT_STATS stats = output.GetStats();
+	CHECK_EQUAL(6, stats.OpenedCount);
+	CHECK_EQUAL(6, stats.FinalizedCount);
+}
+
+TEST_CASE(SizeLimitRotatesAtTheNextFrame)
+{
+	SegmentRecorder recorder;
+	SEGMENT_POLICY policy;
+	policy.MaxBytes = 100000;
+	SegmentedOutput<SEGMENT> output(policy, recorder.GetOpenFunction(), recorder.GetFinalizeFunction());
+	output.Start(5 * FrameDuration, recorder.First());
+	//The limit is reached after 100 frames of a segment, so segments start at frames 105 and 205.
+	CHECK_EQUAL(2, WriteFrames(output, 5, 250, 1000));
+	CHECK_EQUAL(2, output.GetCurrentIndex());
+	CHECK_EQUAL(205 * FrameDuration, output.GetCurrentStartPos());
+	CHECK(output.Close());
+}
+
+TEST_CASE(FailedOpenKeepsWritingToTheCurrentSegment)
+{
+	SegmentRecorder recorder;
+	recorder.FailOpenIndex = 1;
+	SEGMENT_POLICY policy;
+	policy.MaxDuration = 10 * Second;
+	SegmentedOutput<SEGMENT> output(policy, recorder.GetOpenFunction(), recorder.GetFinalizeFunction());
+	output.Start(0, recorder.First());
+	CHECK_EQUAL(0, WriteFrames(output, 0, 300));
+	//The attempt at 10 seconds fails, and the next is 10 seconds later.
+	CHECK(!output.Advance(10 * Second));
+	CHECK(!output.IsRotationDue(20 * Second - 1));
+	CHECK(output.IsRotationDue(20 * Second));
+	CHECK(output.Advance(20 * Second));
+	CHECK_EQUAL(1, output.GetCurrentIndex());
+	CHECK(output.Close());
+	SEGMENT_STATS stats = output.GetStats();
+	CHECK_EQUAL(1, stats.OpenFailedCount);
+	CHECK_EQUAL(2, stats.OpenedCount);
+}
+
+TEST_CASE(SlowFinalizeDoesNotStallTheWriter)
+{
+	SegmentRecorder recorder;
+	recorder.FinalizeMillis = 50;
+	recorder.FailFinalizeIndex = 1;
+	SEGMENT_POLICY policy;
+	policy.MaxDuration = Second;
+	SegmentedOutput<SEGMENT> output(policy, recorder.GetOpenFunction(), recorder.GetFinalizeFunction());
+	output.Start(0, recorder.First());
+	auto start = std::chrono::steady_clock::now();
+	CHECK_EQUAL(4, WriteFrames(output, 0, 150));
+	double millis = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	CHECK(millis < 4 * 50);
+	//A failed segment does not stop the ones after it.
+	CHECK(!output.Close());
+	CHECK(!output.Close());
+	CHECK(output.IsFinalizeFailed());
+	CHECK_EQUAL(5, recorder.Finalized.size());
+	SEGMENT_STATS stats = output.GetStats();
+	CHECK_EQUAL(4, stats.FinalizedCount);
+	CHECK_EQUAL(1, stats.FinalizeFailedCount);
+	CHECK(stats.MaxPendingCount >= 1);
+	CHECK(stats.MaxFinalizeMicros >= 50000);
+}
+
+TEST_CASE(WithoutLimitsTheRecordingIsOneSegment)
+{
+	SegmentRecorder recorder;
+	SEGMENT_POLICY policy;
+	CHECK(!policy.IsEnabled());
+	{
+		SegmentedOutput<SEGMENT> output(policy, recorder.GetOpenFunction(), recorder.GetFinalizeFunction());
+		CHECK(!output.IsRotationDue(0));
+		output.Start(0, recorder.First());
+		CHECK_EQUAL(0, WriteFrames(output, 0, 1000, 1000000));
+	}
+	//The destructor finalizes the last segment.
+	CHECK_EQUAL(1, recorder.Finalized.size());
+	CHECK_EQUAL(1000, recorder.Finalized[0].Frames.size());
+}
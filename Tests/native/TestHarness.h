@@ -0,0 +1,126 @@
+#pragma once
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <exception>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+/// <summary>
+/// A minimal test runner for the portable parts of ScreenRecorderLibNative, so they can be tested on any platform without a test framework.
+/// Tests are registered with TEST_CASE, and a failed check ends the test it is in. TestMain.cpp runs the tests of an executable, optionally filtered by name.
+/// </summary>
+struct TEST_CASE_INFO
+{
+	const char *Name;
+	void(*Run)();
+};
+
+std::vector<TEST_CASE_INFO> &GetTestCases();
+
+struct TestRegistration
+{
+	TestRegistration(const char *name, void(*run)())
+	{
+		GetTestCases().push_back(TEST_CASE_INFO{ name, run });
+	}
+};
+
+class TestFailure : public std::exception
+{
+public:
+	TestFailure(const char *file, int line, const std::string &message)
+	{
+		std::ostringstream text;
+		text << file << ":" << line << ": " << message;
+		m_What = text.str();
+	}
+	const char *what() const noexcept override { return m_What.c_str(); }
+private:
+	std::string m_What;
+};
+
+namespace TestHarness {
+	//Compares integers of different signedness by value, so checks against literals do not depend on the type of the literal.
+	template <typename TExpected, typename TActual>
+	bool AreEqual(const TExpected &expected, const TActual &actual)
+	{
+		if constexpr (std::is_integral_v<TExpected> && std::is_integral_v<TActual> && std::is_signed_v<TExpected> != std::is_signed_v<TActual>) {
+			if constexpr (std::is_signed_v<TExpected>) {
+				return expected >= 0 && static_cast<std::make_unsigned_t<TExpected>>(expected) == actual;
+			}
+			else {
+				return actual >= 0 && expected == static_cast<std::make_unsigned_t<TActual>>(actual);
+			}
+		}
+		else {
+			return expected == actual;
+		}
+	}
+
+	//Copies a checked value, loading atomics.
+	template <typename T>
+	T GetValue(const T &value)
+	{
+		return value;
+	}
+
+	template <typename T>
+	T GetValue(const std::atomic<T> &value)
+	{
+		return value.load();
+	}
+
+	template <typename T>
+	std::string ToString(const T &value)
+	{
+		if constexpr (std::is_enum_v<T>) {
+			return std::to_string(static_cast<long long>(value));
+		}
+		else if constexpr (std::is_same_v<T, bool>) {
+			return value ? "true" : "false";
+		}
+		else if constexpr (std::is_arithmetic_v<T>) {
+			std::ostringstream text;
+			text.precision(10);
+			text << +value;
+			return text.str();
+		}
+		else {
+			return "(value)";
+		}
+	}
+}
+
+#define TEST_CASE(name) \
+	static void name(); \
+	static TestRegistration name##Registration(#name, name); \
+	static void name()
+
+#define CHECK(condition) \
+	do { \
+		if (!(condition)) { \
+			throw TestFailure(__FILE__, __LINE__, "CHECK(" #condition ") failed"); \
+		} \
+	} while (0)
+
+//The values are copied, since a reference to a member of a temporary, e.g. GetStats().Count, would not outlive the declaration.
+#define CHECK_EQUAL(expected, actual) \
+	do { \
+		const auto expectedValue = TestHarness::GetValue(expected); \
+		const auto actualValue = TestHarness::GetValue(actual); \
+		if (!TestHarness::AreEqual(expectedValue, actualValue)) { \
+			throw TestFailure(__FILE__, __LINE__, "CHECK_EQUAL(" #expected ", " #actual ") failed: expected " + TestHarness::ToString(expectedValue) + ", got " + TestHarness::ToString(actualValue)); \
+		} \
+	} while (0)
+
+#define CHECK_NEAR(expected, actual, tolerance) \
+	do { \
+		double expectedValue = static_cast<double>(expected); \
+		double actualValue = static_cast<double>(actual); \
+		if (!(std::fabs(expectedValue - actualValue) <= static_cast<double>(tolerance))) { \
+			throw TestFailure(__FILE__, __LINE__, "CHECK_NEAR(" #expected ", " #actual ", " #tolerance ") failed: expected " + TestHarness::ToString(expectedValue) + ", got " + TestHarness::ToString(actualValue)); \
+		} \
+	} while (0)
@@ -0,0 +1,39 @@
+#include "TestHarness.h"
+#include <cstdio>
+#include <cstring>
+
+std::vector<TEST_CASE_INFO> &GetTestCases()
+{
+	static std::vector<TEST_CASE_INFO> testCases;
+	return testCases;
+}
+
+//Runs the tests registered in the executable. Arguments are substrings of the names of the tests to run; with none, all tests run.
+int main(int argc, char *argv[])
+{
+	int runCount = 0;
+	int failedCount = 0;
+	for (const TEST_CASE_INFO &testCase : GetTestCases()) {
+		bool isSelected = argc < 2;
+		for (int i = 1; i < argc && !isSelected; i++) {
+			isSelected = strstr(testCase.Name, argv[i]) != nullptr;
+		}
+		if (!isSelected) {
+			continue;
+		}
+		runCount++;
+		printf("[ RUN  ] %s\n", testCase.Name);
+		fflush(stdout);
+		try {
+			testCase.Run();
+			printf("[   OK ] %s\n", testCase.Name);
+		}
+		catch (const std::exception &ex) {
+			failedCount++;
+			printf("%s\n[ FAIL ] %s\n", ex.what(), testCase.Name);
+		}
+		fflush(stdout);
+	}
+	printf("%d of %d tests passed\n", runCount - failedCount, runCount);
+	return failedCount == 0 && runCount > 0 ? 0 : 1;
+}
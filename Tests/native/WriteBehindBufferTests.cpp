@@ -0,0 +1,159 @@
+#include "TestHarness.h"
+#include "WriteBehindBuffer.h"
+#include <cstring>
+#include <random>
+
+namespace {
+	//An in-memory output that counts the calls it gets.
+	class MemoryTarget
+	{
+	public:
+		std::vector<uint8_t> Data;
+		uint64_t Position = 0;
+		int WriteCount = 0;
+		int SeekCount = 0;
+		//The number of writes that succeed before the target fails, or -1 to never fail.
+		int FailAfterWriteCount = -1;
+
+		WriteBehindBuffer::WriteFunction GetWriteFunction()
+		{
+			return [this](const uint8_t *pData, size_t size) {
+				if (FailAfterWriteCount >= 0 && WriteCount >= FailAfterWriteCount) {
+					return false;
+				}
+				if (Data.size() < Position + size) {
+					Data.resize(Position + size);
+				}
+				memcpy(Data.data() + Position, pData, size);
+				Position += size;
+				WriteCount++;
+				return true;
+			};
+		}
+
+		WriteBehindBuffer::SeekFunction GetSeekFunction()
+		{
+			return [this](uint64_t position) {
+				Position = position;
+				SeekCount++;
+				return true;
+			};
+		}
+	};
+}
+
+TEST_CASE(TargetMatchesDirectWritesForRandomWritesAndSeeks)
+{
+	std::mt19937 random(1);
+	for (int round = 0; round < 100; round++) {
+		MemoryTarget target;
+		std::vector<uint8_t> expected;
+		uint64_t position = 0;
+		size_t chunkSize = 1 + random() % 4096;
+		size_t maxPendingChunks = 1 + random() % 4;
+		{
+			WriteBehindBuffer buffer(target.GetWriteFunction(), target.GetSeekFunction(), 0, 0, chunkSize, maxPendingChunks);
+			for (int i = 0; i < 2000; i++) {
+				int operation = random() % 10;
+				if (operation < 7) {
+					//Mostly small writes, with some larger than a chunk.
+					size_t size = random() % (operation == 0 ? 5000 : 64);
+					std::vector<uint8_t> data(size);
+					for (uint8_t &byte : data) {
+						byte = static_cast<uint8_t>(random());
+					}
+					CHECK(buffer.Write(data.data(), size));
+					if (expected.size() < position + size) {
+						expected.resize(position + size);
+					}
+					std::copy(data.begin(), data.end(), expected.begin() + position);
+					position += size;
+				}
+				else if (operation < 9) {
+					position = random() % 4 == 0 || expected.empty() ? expected.size() : random() % (expected.size() + 1);
+					buffer.SetPosition(position);
+				}
+				else if (random() % 20 == 0) {
+					CHECK(buffer.Flush());
+					CHECK(target.Data == expected);
+					CHECK_EQUAL(position, target.Position);
+				}
+				CHECK_EQUAL(position, buffer.GetPosition());
+				CHECK_EQUAL(expected.size(), buffer.GetLength());
+			}
+		}
+		//The destructor flushes.
+		CHECK(target.Data == expected);
+	}
+}
+
+TEST_CASE(SmallWritesAndPatchesAreCombined)
+{
+	MemoryTarget target;
+	WriteBehindBuffer buffer(target.GetWriteFunction(), target.GetSeekFunction(), 0, 0);
+	//The pattern of a muxer: a box header, many small writes, and the size of the box patched when it is done.
+	uint8_t header[8] = {};
+	buffer.Write(header, sizeof(header));
+	for (int i = 0; i < 10000; i++) {
+		uint8_t sample[100];
+		memset(sample, i, sizeof(sample));
+		buffer.Write(sample, sizeof(sample));
+	}
+	uint8_t size[4] = { 1, 2, 3, 4 };
+	buffer.SetPosition(0);
+	buffer.Write(size, sizeof(size));
+	buffer.SetPosition(buffer.GetLength());
+	buffer.Write(size, sizeof(size));
+	CHECK(buffer.Flush());
+	CHECK_EQUAL(8 + 1000000 + 4, target.Data.size());
+	CHECK_EQUAL(1, target.Data[0]);
+	CHECK_EQUAL(4, target.Data[3]);
+	CHECK_EQUAL(0, target.Data[4]);
+	CHECK_EQUAL(99 % 256, target.Data[8 + 99 * 100]);
+	WRITE_BEHIND_STATS stats = buffer.GetStats();
+	CHECK_EQUAL(10003, stats.WriteCount);
+	CHECK_EQUAL(target.WriteCount, stats.TargetWriteCount);
+	//Everything fits in one chunk, so the size was overwritten in the open chunk, and the target got a single write.
+	CHECK_EQUAL(1, stats.TargetWriteCount);
+	CHECK_EQUAL(0, stats.PatchCount);
+	CHECK(stats.GetAverageTargetWriteSize() > 100000);
+}
+
+TEST_CASE(TargetCanBeUsedDirectlyAfterFlush)
+{
+	MemoryTarget target;
+	target.Data.assign(100, 9);
+	target.Position = 100;
+	WriteBehindBuffer buffer(target.GetWriteFunction(), target.GetSeekFunction(), 100, 100, 16, 2);
+	uint8_t data[40];
+	memset(data, 1, sizeof(data));
+	buffer.Write(data, sizeof(data));
+	buffer.SetPosition(50);
+	CHECK(buffer.Flush());
+	CHECK_EQUAL(50, target.Position);
+	CHECK_EQUAL(140, target.Data.size());
+	//The target is truncated directly, and the buffer continues from there.
+	target.Data.resize(120);
+	target.Position = 120;
+	buffer.Reset(120, 120);
+	buffer.Write(data, 10);
+	CHECK(buffer.Flush());
+	CHECK_EQUAL(130, target.Data.size());
+	CHECK_EQUAL(9, target.Data[99]);
+	CHECK_EQUAL(1, target.Data[129]);
+}
+
+TEST_CASE(FailedTargetWriteIsReported)
+{
+	MemoryTarget target;
+	target.FailAfterWriteCount = 2;
+	WriteBehindBuffer buffer(target.GetWriteFunction(), target.GetSeekFunction(), 0, 0, 16, 2);
+	uint8_t data[16] = {};
+	bool isWritten = true;
+	for (int i = 0; i < 100 && isWritten; i++) {
+		isWritten = buffer.Write(data, sizeof(data));
+	}
+	CHECK(!buffer.Flush());
+	CHECK(buffer.IsFailed());
+	CHECK(!buffer.Write(data, sizeof(data)));
+}